@@ -0,0 +1,138 @@
+/**
+ * @file bench_common.h
+ * @brief Helpers shared by the benchmark executables
+ *
+ * Corpus files are recorded model output (bench/corpus/). Token-by-token
+ * replay splits them the way a BPE tokenizer roughly would: a word with
+ * its leading space, a single multibyte character, or a punctuation byte.
+ */
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "agent_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_ITERATIONS 200
+#define BENCH_MAX_WORD_TOKEN 8
+
+typedef struct {
+    char* data;
+    size_t length;
+} bench_file_t;
+
+typedef struct {
+    size_t offset;
+    size_t length;
+} bench_token_t;
+
+static inline uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static inline bool bench_read_file(const char* path, bench_file_t* out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(f);
+        return false;
+    }
+
+    out->data = malloc((size_t)size + 1);
+    out->length = out->data ? fread(out->data, 1, (size_t)size, f) : 0;
+    fclose(f);
+    if (!out->data) {
+        return false;
+    }
+    out->data[out->length] = '\0';
+    return true;
+}
+
+static inline bool bench_is_word_byte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/* Length of the pseudo-token starting at text */
+static inline size_t bench_token_length(const char* text, size_t avail) {
+    const unsigned char* p = (const unsigned char*)text;
+    size_t n = 0;
+
+    if (p[0] == ' ' && avail > 1 && bench_is_word_byte(p[1])) {
+        n = 1;
+    }
+    while (n < avail && n < BENCH_MAX_WORD_TOKEN && bench_is_word_byte(p[n])) {
+        n++;
+    }
+    if (n > 0) {
+        return n;
+    }
+
+    size_t char_len = agent_utf8_char_length(p[0]);
+    if (char_len == 0 || char_len > avail) {
+        char_len = 1;
+    }
+    return char_len;
+}
+
+/* Split a transcript into tokens; returns the count, or 0 on failure */
+static inline size_t bench_tokenize(const bench_file_t* file, bench_token_t** out_tokens) {
+    bench_token_t* tokens = malloc((file->length + 1) * sizeof(bench_token_t));
+    if (!tokens) {
+        return 0;
+    }
+
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < file->length) {
+        size_t len = bench_token_length(file->data + pos, file->length - pos);
+        tokens[count].offset = pos;
+        tokens[count].length = len;
+        count++;
+        pos += len;
+    }
+
+    *out_tokens = tokens;
+    return count;
+}
+
+/* Iteration count from "-n N" at the front of argv; returns the first path index */
+static inline int bench_parse_args(int argc, char** argv, int* iterations) {
+    *iterations = BENCH_DEFAULT_ITERATIONS;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        *iterations = atoi(argv[2]);
+        if (*iterations < 1) *iterations = 1;
+        return 3;
+    }
+    return 1;
+}
+
+static inline const char* bench_basename(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static inline void bench_report(const char* file, const char* what, size_t bytes, size_t tokens,
+                                int iterations, uint64_t elapsed_ns, size_t arena_bytes) {
+    double seconds = (double)elapsed_ns / 1e9;
+    double mb_per_s = seconds > 0 ? (double)bytes * iterations / seconds / (1024.0 * 1024.0) : 0;
+    double ns_per_token = tokens ? (double)elapsed_ns / ((double)tokens * iterations) : 0;
+    double arena_per_token = tokens ? (double)arena_bytes / (double)tokens : 0;
+
+    printf("%-22s %-16s %9.1f MB/s %9.1f ns/token %9.1f arena B/token\n",
+           file, what, mb_per_s, ns_per_token, arena_per_token);
+}
+
+#endif /* BENCH_COMMON_H */
@@ -0,0 +1,84 @@
+/**
+ * @file bench_json.c
+ * @brief JSON parse and serialize throughput over the corpus
+ *
+ * Usage: bench_json [-n iterations] file.json...
+ */
+
+#include "bench_common.h"
+
+static bool bench_file(agent_context_t* ctx, const char* name, const bench_file_t* file,
+                       int iterations) {
+    bench_token_t* tokens = NULL;
+    size_t token_count = bench_tokenize(file, &tokens);
+    free(tokens);
+
+    size_t sp = agent_context_savepoint(ctx);
+    size_t arena_bytes = 0;
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        agent_json_parse_result_t result = agent_json_parse(ctx, file->data, file->length);
+        if (result.error != AGENT_OK) {
+            fprintf(stderr, "%s: parse error at %zu: %s\n", name, result.error_position,
+                    result.error_message ? result.error_message : "unknown");
+            return false;
+        }
+        if (i == 0) {
+            arena_bytes = agent_context_used(ctx) - sp;
+        }
+        agent_context_restore(ctx, sp);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report(name, "json_parse", file->length, token_count, iterations, elapsed, arena_bytes);
+
+    /* Serialize one parsed tree repeatedly into a reused buffer */
+    agent_json_parse_result_t result = agent_json_parse(ctx, file->data, file->length);
+    agent_string_t out;
+    if (agent_string_init(&out, file->length) != AGENT_OK) {
+        return false;
+    }
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        agent_string_clear(&out);
+        agent_json_serialize(result.value, &out, false);
+    }
+    elapsed = bench_now_ns() - start;
+    bench_report(name, "json_serialize", out.length, token_count, iterations, elapsed, 0);
+
+    agent_string_free(&out);
+    agent_context_restore(ctx, sp);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int iterations;
+    int first = bench_parse_args(argc, argv, &iterations);
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [-n iterations] file.json...\n", argv[0]);
+        return 1;
+    }
+
+    agent_context_t* ctx = agent_context_create(0);
+    if (!ctx) {
+        return 1;
+    }
+
+    int status = 0;
+    for (int a = first; a < argc && status == 0; a++) {
+        bench_file_t file;
+        if (!bench_read_file(argv[a], &file)) {
+            status = 1;
+            break;
+        }
+        if (!bench_file(ctx, bench_basename(argv[a]), &file, iterations)) {
+            status = 1;
+        }
+        free(file.data);
+        agent_context_reset(ctx);
+    }
+
+    agent_context_destroy(ctx);
+    return status;
+}
@@ -0,0 +1,320 @@
+/**
+ * @file bench_orchestrator.c
+ * @brief Library overhead of agent_run_streaming over long conversations
+ *
+ * A mock model replays each transcript: it is cut after every run of
+ * tool calls, and each loop iteration streams the next piece token by
+ * token. Mock tools answer with a fixed result. Time spent inside the
+ * mocks (their pacing sleeps included) is subtracted, so what is
+ * reported is the orchestrator's own cost per token, per iteration and
+ * per turn, plus how the history arena grows, for conversations of 1 to
+ * max_turns turns.
+ *
+ * Usage: bench_orchestrator [-n repetitions] [-r tokens_per_second]
+ *                           [-l tool_latency_us] [-t max_turns] transcript...
+ *
+ * -r 0 (the default) streams as fast as possible; -l 0 runs tools instantly.
+ */
+
+#include "bench_common.h"
+
+#define BENCH_MAX_SEGMENTS 64
+#define BENCH_TOOL_RESULT_LENGTH 512
+
+static const char* const TOOLS_SCHEMA =
+    "[{\"name\":\"read_file\",\"description\":\"Read a file\","
+    "\"parameters\":{\"type\":\"object\",\"properties\":{\"path\":{\"type\":\"string\"}},"
+    "\"required\":[\"path\"]}}]";
+
+/* One generation's worth of the transcript and its pseudo-tokens */
+typedef struct {
+    const char* data;
+    size_t length;
+    bench_token_t* tokens;
+    size_t token_count;
+} bench_segment_t;
+
+typedef struct {
+    bench_segment_t segments[BENCH_MAX_SEGMENTS];
+    size_t segment_count;
+    size_t next_segment;          /* Reset at the start of every turn */
+
+    uint64_t token_interval_ns;   /* 0 = no pacing */
+    uint64_t tool_latency_ns;
+    char tool_result[BENCH_TOOL_RESULT_LENGTH];
+
+    uint64_t mock_ns;             /* Time inside the mocks, library calls excluded */
+    size_t tokens;
+    size_t tool_calls;
+} bench_mock_t;
+
+/* generate's user_data belongs to token_callback, so the mocks share this */
+static bench_mock_t mock;
+
+static void bench_sleep_ns(uint64_t ns) {
+    if (ns == 0) {
+        return;
+    }
+    struct timespec ts = {(time_t)(ns / 1000000000u), (long)(ns % 1000000000u)};
+    nanosleep(&ts, NULL);
+}
+
+/* Cut the transcript after each run of consecutive tool calls */
+static bool bench_split_segments(const bench_file_t* file) {
+    static const char close_tag[] = "</tool_call>";
+    static const char open_tag[] = "<tool_call>";
+    const char* text = file->data;
+    const char* end = text + file->length;
+    const char* start = text;
+
+    mock.segment_count = 0;
+    while (start < end && mock.segment_count < BENCH_MAX_SEGMENTS - 1) {
+        const char* cut = NULL;
+        const char* search = start;
+        const char* close;
+        while ((close = strstr(search, close_tag)) != NULL) {
+            const char* after = close + sizeof(close_tag) - 1;
+            while (after < end && (*after == ' ' || *after == '\n' || *after == '\r' || *after == '\t')) {
+                after++;
+            }
+            if ((size_t)(end - after) >= sizeof(open_tag) - 1 &&
+                memcmp(after, open_tag, sizeof(open_tag) - 1) == 0) {
+                search = after;
+                continue;
+            }
+            cut = after;
+            break;
+        }
+        if (!cut) {
+            cut = end;
+        }
+
+        bench_segment_t* segment = &mock.segments[mock.segment_count++];
+        segment->data = start;
+        segment->length = (size_t)(cut - start);
+        start = cut;
+    }
+
+    /* A transcript ending in a tool call still needs a final answer */
+    if (mock.segment_count == 0 ||
+        strstr(mock.segments[mock.segment_count - 1].data, close_tag) != NULL) {
+        static const char done[] = "Done.";
+        bench_segment_t* segment = &mock.segments[mock.segment_count++];
+        segment->data = done;
+        segment->length = sizeof(done) - 1;
+    }
+
+    for (size_t i = 0; i < mock.segment_count; i++) {
+        bench_file_t view = {(char*)mock.segments[i].data, mock.segments[i].length};
+        mock.segments[i].token_count = bench_tokenize(&view, &mock.segments[i].tokens);
+        if (mock.segments[i].token_count == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static agent_llm_result_t mock_generate(const agent_message_t* messages, size_t message_count,
+                                        const char* system_prompt,
+                                        agent_token_callback_t token_callback, void* user_data) {
+    (void)messages;
+    (void)message_count;
+    (void)system_prompt;
+    uint64_t entered = bench_now_ns();
+    uint64_t library_ns = 0;
+
+    size_t index = mock.next_segment < mock.segment_count ? mock.next_segment
+                                                          : mock.segment_count - 1;
+    mock.next_segment++;
+    const bench_segment_t* segment = &mock.segments[index];
+
+    agent_llm_result_t result = {0};
+    result.error = AGENT_OK;
+    size_t streamed = segment->length;
+    for (size_t t = 0; t < segment->token_count; t++) {
+        bench_sleep_ns(mock.token_interval_ns);
+        const bench_token_t* token = &segment->tokens[t];
+        mock.tokens++;
+
+        uint64_t before = bench_now_ns();
+        bool keep_going = token_callback(segment->data + token->offset, token->length, user_data);
+        library_ns += bench_now_ns() - before;
+        if (!keep_going) {
+            streamed = token->offset + token->length;
+            break;
+        }
+    }
+    result.text.data = segment->data;
+    result.text.length = streamed;
+
+    mock.mock_ns += bench_now_ns() - entered - library_ns;
+    return result;
+}
+
+static agent_tool_execute_result_t mock_execute_tool(const char* tool_name,
+                                                     const agent_json_value_t* arguments,
+                                                     void* user_data) {
+    (void)tool_name;
+    (void)arguments;
+    (void)user_data;
+    uint64_t entered = bench_now_ns();
+
+    bench_sleep_ns(mock.tool_latency_ns);
+    mock.tool_calls++;
+
+    agent_tool_execute_result_t result = {0};
+    result.error = AGENT_OK;
+    result.content.data = mock.tool_result;
+    result.content.length = BENCH_TOOL_RESULT_LENGTH - 1;
+
+    mock.mock_ns += bench_now_ns() - entered;
+    return result;
+}
+
+static bool mock_on_token(const char* token, size_t len, void* user_data) {
+    (void)token;
+    (void)len;
+    (void)user_data;
+    return true;
+}
+
+static const char* mock_tools_schema(void* user_data) {
+    (void)user_data;
+    return TOOLS_SCHEMA;
+}
+
+/* Run turns user turns in a fresh agent; false if any run fails */
+static bool bench_conversation(const char* name, int turns, int repetitions) {
+    agent_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.on_token = mock_on_token;
+    config.get_tools_schema = mock_tools_schema;
+    config.max_iterations = (int)mock.segment_count + 1;
+
+    uint64_t overhead_ns = 0;
+    size_t tokens = 0;
+    size_t iterations = 0;
+    size_t tool_calls = 0;
+    size_t history_bytes = 0;
+    size_t run_peak_bytes = 0;
+
+    for (int rep = 0; rep < repetitions; rep++) {
+        agent_state_t state;
+        if (agent_init(&state, &config) != AGENT_OK) {
+            fprintf(stderr, "%s: agent_init failed\n", name);
+            return false;
+        }
+        mock.mock_ns = 0;
+        mock.tokens = 0;
+        mock.tool_calls = 0;
+
+        uint64_t start = bench_now_ns();
+        for (int turn = 0; turn < turns; turn++) {
+            char prompt[64];
+            snprintf(prompt, sizeof(prompt), "Request number %d, please continue.", turn + 1);
+            mock.next_segment = 0;
+            if (agent_add_user_message(&state, prompt) != AGENT_OK) {
+                fprintf(stderr, "%s: agent_add_user_message failed at turn %d\n", name, turn + 1);
+                agent_free(&state);
+                return false;
+            }
+            agent_run_result_t result = agent_run_streaming(&state);
+            if (result.error != AGENT_OK) {
+                fprintf(stderr, "%s: run failed at turn %d: error %d %s\n", name, turn + 1,
+                        (int)result.error, result.error_message ? result.error_message : "");
+                agent_free(&state);
+                return false;
+            }
+            iterations += (size_t)result.iterations;
+
+            agent_context_stats_t run_stats = agent_context_stats(state.run_ctx);
+            if (run_stats.peak_bytes > run_peak_bytes) {
+                run_peak_bytes = run_stats.peak_bytes;
+            }
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+
+        overhead_ns += elapsed > mock.mock_ns ? elapsed - mock.mock_ns : 0;
+        tokens += mock.tokens;
+        tool_calls += mock.tool_calls;
+        history_bytes = agent_context_stats(state.ctx).bytes_used;
+        agent_free(&state);
+    }
+
+    double reps = (double)repetitions;
+    printf("%-22s %5d turns %7.0f tokens %5.0f tools %9.1f ns/token %9.2f us/iter %9.2f us/turn "
+           "%9.0f history B/turn %9zu run peak B\n",
+           name, turns, (double)tokens / reps, (double)tool_calls / reps,
+           tokens ? (double)overhead_ns / (double)tokens : 0,
+           iterations ? (double)overhead_ns / (double)iterations / 1e3 : 0,
+           (double)overhead_ns / ((double)turns * reps) / 1e3,
+           (double)history_bytes / (double)turns, run_peak_bytes);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int repetitions = 1;
+    double tokens_per_second = 0;
+    long tool_latency_us = 0;
+    int max_turns = 200;
+
+    int first = 1;
+    while (first + 1 < argc && argv[first][0] == '-') {
+        const char* flag = argv[first];
+        const char* value = argv[first + 1];
+        if (strcmp(flag, "-n") == 0) {
+            repetitions = atoi(value) > 0 ? atoi(value) : 1;
+        } else if (strcmp(flag, "-r") == 0) {
+            tokens_per_second = atof(value);
+        } else if (strcmp(flag, "-l") == 0) {
+            tool_latency_us = atol(value);
+        } else if (strcmp(flag, "-t") == 0) {
+            max_turns = atoi(value) > 0 ? atoi(value) : 1;
+        } else {
+            break;
+        }
+        first += 2;
+    }
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [-n repetitions] [-r tokens_per_second] [-l tool_latency_us] "
+                        "[-t max_turns] transcript...\n", argv[0]);
+        return 1;
+    }
+
+    static const int turn_counts[] = {1, 10, 50, 100, 200};
+    mock.token_interval_ns = tokens_per_second > 0 ? (uint64_t)(1e9 / tokens_per_second) : 0;
+    mock.tool_latency_ns = tool_latency_us > 0 ? (uint64_t)tool_latency_us * 1000u : 0;
+    memset(mock.tool_result, 'x', BENCH_TOOL_RESULT_LENGTH - 1);
+    mock.tool_result[BENCH_TOOL_RESULT_LENGTH - 1] = '\0';
+
+    int status = 0;
+    for (int a = first; a < argc && status == 0; a++) {
+        bench_file_t file;
+        if (!bench_read_file(argv[a], &file)) {
+            return 1;
+        }
+        const char* name = bench_basename(argv[a]);
+
+        if (!bench_split_segments(&file)) {
+            fprintf(stderr, "%s: cannot split transcript\n", name);
+            status = 1;
+        }
+        for (size_t i = 0; status == 0 && i < sizeof(turn_counts) / sizeof(turn_counts[0]); i++) {
+            int turns = turn_counts[i] < max_turns ? turn_counts[i] : max_turns;
+            if (!bench_conversation(name, turns, repetitions)) {
+                status = 1;
+            }
+            if (turns == max_turns) {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < mock.segment_count; i++) {
+            free(mock.segments[i].tokens);
+        }
+        free(file.data);
+    }
+    return status;
+}
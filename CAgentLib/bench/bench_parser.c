@@ -0,0 +1,111 @@
+/**
+ * @file bench_parser.c
+ * @brief Response parser throughput over the transcript corpus
+ *
+ * Usage: bench_parser [-n iterations] transcript...
+ */
+
+#include "bench_common.h"
+
+static void bench_parse(agent_context_t* ctx, const char* name, const bench_file_t* file,
+                        size_t token_count, int iterations) {
+    size_t sp = agent_context_savepoint(ctx);
+    size_t arena_bytes = 0;
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        agent_parse_result_t result = agent_parser_parse(ctx, file->data, file->length);
+        (void)result;
+        if (i == 0) {
+            arena_bytes = agent_context_used(ctx) - sp;
+        }
+        agent_context_restore(ctx, sp);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    bench_report(name, "parse", file->length, token_count, iterations, elapsed, arena_bytes);
+}
+
+static void discard_text(const char* text, size_t len, void* user_data) {
+    (void)text;
+    (void)len;
+    (void)user_data;
+}
+
+static void discard_tool_call(const char* name, const agent_json_value_t* args, void* user_data) {
+    (void)name;
+    (void)args;
+    (void)user_data;
+}
+
+static void bench_stream(agent_context_t* ctx, const char* name, const bench_file_t* file,
+                         const bench_token_t* tokens, size_t token_count, int iterations,
+                         bool coalesce) {
+    size_t sp = agent_context_savepoint(ctx);
+    size_t arena_bytes = 0;
+    agent_text_coalescing_t policy = {64, 8};
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        agent_streaming_parser_t parser;
+        agent_streaming_parser_init(&parser, ctx);
+        parser.on_text = discard_text;
+        parser.on_thinking = discard_text;
+        parser.on_tool_call = discard_tool_call;
+        if (coalesce) {
+            agent_streaming_parser_set_text_coalescing(&parser, &policy);
+        }
+
+        for (size_t t = 0; t < token_count; t++) {
+            agent_streaming_parser_feed(&parser, file->data + tokens[t].offset, tokens[t].length);
+        }
+        agent_streaming_parser_flush(&parser);
+
+        if (i == 0) {
+            arena_bytes = agent_context_used(ctx) - sp;
+        }
+        agent_streaming_parser_free(&parser);
+        agent_context_restore(ctx, sp);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    bench_report(name, coalesce ? "stream/coalesce" : "stream", file->length, token_count,
+                 iterations, elapsed, arena_bytes);
+}
+
+int main(int argc, char** argv) {
+    int iterations;
+    int first = bench_parse_args(argc, argv, &iterations);
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [-n iterations] transcript...\n", argv[0]);
+        return 1;
+    }
+
+    agent_context_t* ctx = agent_context_create(0);
+    if (!ctx) {
+        return 1;
+    }
+
+    for (int a = first; a < argc; a++) {
+        bench_file_t file;
+        if (!bench_read_file(argv[a], &file)) {
+            agent_context_destroy(ctx);
+            return 1;
+        }
+
+        bench_token_t* tokens = NULL;
+        size_t token_count = bench_tokenize(&file, &tokens);
+        const char* name = bench_basename(argv[a]);
+
+        bench_parse(ctx, name, &file, token_count, iterations);
+        bench_stream(ctx, name, &file, tokens, token_count, iterations, false);
+        bench_stream(ctx, name, &file, tokens, token_count, iterations, true);
+
+        free(tokens);
+        free(file.data);
+        agent_context_reset(ctx);
+    }
+
+    agent_context_destroy(ctx);
+    return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file bench_schema.c
+ * @brief Prompt size of the tools schema: JSON versus compact signatures
+ *
+ * Reads MCP tools/list responses, registers their tools and compares the
+ * token counts of agent_mcp_get_schema_json() and
+ * agent_mcp_get_schema_compact(), then times both emitters.
+ *
+ * Usage: bench_schema [-n iterations] tools_list.json...
+ */
+
+#include "bench_common.h"
+
+static agent_schema_type_t schema_type(const agent_json_value_t* schema) {
+    agent_string_view_t type = {NULL, 0};
+    agent_json_get_string(agent_json_object_get(schema, "type"), &type);
+    if (agent_sv_equals_cstr(type, "integer")) return AGENT_SCHEMA_INTEGER;
+    if (agent_sv_equals_cstr(type, "number")) return AGENT_SCHEMA_NUMBER;
+    if (agent_sv_equals_cstr(type, "boolean")) return AGENT_SCHEMA_BOOLEAN;
+    if (agent_sv_equals_cstr(type, "array")) return AGENT_SCHEMA_ARRAY;
+    if (agent_sv_equals_cstr(type, "object")) return AGENT_SCHEMA_OBJECT;
+    return AGENT_SCHEMA_STRING;
+}
+
+static const char* copy_sv(agent_context_t* ctx, agent_string_view_t sv) {
+    return sv.data ? agent_context_strndup(ctx, sv.data, sv.length) : NULL;
+}
+
+static void convert_property(agent_context_t* ctx, const char* name,
+                             const agent_json_value_t* schema, bool required,
+                             agent_property_schema_t* out);
+
+/* Fill the properties of an object schema */
+static void convert_properties(agent_context_t* ctx, const agent_json_value_t* schema,
+                               agent_property_schema_t** out, size_t* out_count) {
+    const agent_json_value_t* properties = agent_json_object_get(schema, "properties");
+    const agent_json_value_t* required = agent_json_object_get(schema, "required");
+    size_t count = agent_json_object_length(properties);
+    *out = NULL;
+    *out_count = 0;
+    if (count == 0) {
+        return;
+    }
+
+    agent_property_schema_t* props = agent_context_alloc(ctx, count * sizeof(agent_property_schema_t));
+    for (size_t i = 0; i < count; i++) {
+        const agent_json_entry_t* entry = &properties->data.object_value.entries[i];
+        bool is_required = false;
+        for (size_t r = 0; r < agent_json_array_length(required); r++) {
+            agent_string_view_t name;
+            if (agent_json_get_string(agent_json_array_get(required, r), &name) == AGENT_OK &&
+                agent_sv_equals(name, entry->key)) {
+                is_required = true;
+            }
+        }
+        convert_property(ctx, copy_sv(ctx, entry->key), entry->value, is_required, &props[i]);
+    }
+    *out = props;
+    *out_count = count;
+}
+
+static void convert_property(agent_context_t* ctx, const char* name,
+                             const agent_json_value_t* schema, bool required,
+                             agent_property_schema_t* out) {
+    memset(out, 0, sizeof(*out));
+    out->name = name;
+    out->type = schema_type(schema);
+    out->required = required;
+
+    agent_string_view_t description;
+    if (agent_json_get_string(agent_json_object_get(schema, "description"), &description) == AGENT_OK) {
+        out->description = copy_sv(ctx, description);
+    }
+
+    const agent_json_value_t* values = agent_json_object_get(schema, "enum");
+    size_t enum_count = agent_json_array_length(values);
+    if (enum_count > 0) {
+        const char** enum_values = agent_context_alloc(ctx, enum_count * sizeof(const char*));
+        for (size_t i = 0; i < enum_count; i++) {
+            agent_string_view_t value = {NULL, 0};
+            agent_json_get_string(agent_json_array_get(values, i), &value);
+            enum_values[i] = value.data ? copy_sv(ctx, value) : "";
+        }
+        out->enum_values = enum_values;
+        out->enum_count = enum_count;
+    }
+
+    const agent_json_value_t* items = agent_json_object_get(schema, "items");
+    if (out->type == AGENT_SCHEMA_ARRAY && items) {
+        out->items_schema = agent_context_alloc(ctx, sizeof(agent_property_schema_t));
+        convert_property(ctx, NULL, items, false, out->items_schema);
+    }
+    if (out->type == AGENT_SCHEMA_OBJECT) {
+        convert_properties(ctx, schema, &out->properties, &out->properties_count);
+    }
+}
+
+static bool load_registry(agent_context_t* ctx, const char* name, const bench_file_t* file,
+                          agent_tool_registry_t* registry) {
+    agent_json_parse_result_t result = agent_json_parse(ctx, file->data, file->length);
+    const agent_json_value_t* tools =
+        agent_json_object_get(agent_json_object_get(result.value, "result"), "tools");
+    if (result.error != AGENT_OK || agent_json_get_type(tools) != AGENT_JSON_ARRAY) {
+        fprintf(stderr, "%s: not a tools/list response\n", name);
+        return false;
+    }
+
+    for (size_t i = 0; i < agent_json_array_length(tools); i++) {
+        const agent_json_value_t* tool = agent_json_array_get(tools, i);
+        agent_string_view_t tool_name = {NULL, 0};
+        agent_string_view_t description = {NULL, 0};
+        agent_json_get_string(agent_json_object_get(tool, "name"), &tool_name);
+        agent_json_get_string(agent_json_object_get(tool, "description"), &description);
+
+        agent_tool_definition_t def;
+        memset(&def, 0, sizeof(def));
+        def.name = copy_sv(ctx, tool_name);
+        def.description = copy_sv(ctx, description);
+        convert_properties(ctx, agent_json_object_get(tool, "inputSchema"),
+                           &def.parameters, &def.parameters_count);
+        if (!def.name || agent_tool_registry_add(registry, &def) != AGENT_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t count_tokens(const char* text) {
+    bench_file_t file = {(char*)text, strlen(text)};
+    bench_token_t* tokens = NULL;
+    size_t count = bench_tokenize(&file, &tokens);
+    free(tokens);
+    return count;
+}
+
+static bool bench_file(agent_context_t* ctx, const char* name, const bench_file_t* file,
+                       int iterations) {
+    agent_tool_registry_t registry;
+    if (agent_tool_registry_init(&registry, 8) != AGENT_OK) {
+        return false;
+    }
+    if (!load_registry(ctx, name, file, &registry)) {
+        agent_tool_registry_free(&registry);
+        return false;
+    }
+
+    size_t sp = agent_context_savepoint(ctx);
+    const char* json = agent_mcp_get_schema_json(ctx, &registry, false);
+    const char* compact = agent_mcp_get_schema_compact(ctx, &registry);
+    /* Both strings are gone once the arena is restored below */
+    size_t json_len = strlen(json);
+    size_t compact_len = strlen(compact);
+    size_t json_tokens = count_tokens(json);
+    size_t compact_tokens = count_tokens(compact);
+    printf("%-22s %zu tools: json %zu tokens (%zu B), compact %zu tokens (%zu B), %.0f%% saved\n",
+           name, registry.count, json_tokens, json_len, compact_tokens, compact_len,
+           json_tokens ? 100.0 * (double)(json_tokens - compact_tokens) / (double)json_tokens : 0.0);
+    agent_context_restore(ctx, sp);
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        agent_mcp_get_schema_json(ctx, &registry, false);
+        agent_context_restore(ctx, sp);
+    }
+    bench_report(name, "schema_json", json_len, json_tokens, iterations,
+                 bench_now_ns() - start, 0);
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        agent_mcp_get_schema_compact(ctx, &registry);
+        agent_context_restore(ctx, sp);
+    }
+    bench_report(name, "schema_compact", compact_len, compact_tokens, iterations,
+                 bench_now_ns() - start, 0);
+
+    agent_tool_registry_free(&registry);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int iterations;
+    int first = bench_parse_args(argc, argv, &iterations);
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [-n iterations] tools_list.json...\n", argv[0]);
+        return 1;
+    }
+
+    agent_context_t* ctx = agent_context_create(0);
+    if (!ctx) {
+        return 1;
+    }
+
+    int status = 0;
+    for (int a = first; a < argc && status == 0; a++) {
+        bench_file_t file;
+        if (!bench_read_file(argv[a], &file)) {
+            status = 1;
+            break;
+        }
+        if (!bench_file(ctx, bench_basename(argv[a]), &file, iterations)) {
+            status = 1;
+        }
+        free(file.data);
+        agent_context_reset(ctx);
+    }
+
+    agent_context_destroy(ctx);
+    return status;
+}
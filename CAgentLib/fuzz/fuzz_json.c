@@ -0,0 +1,44 @@
+/**
+ * @file fuzz_json.c
+ * @brief libFuzzer harness for the JSON parser and serializer
+ *
+ * Anything that parses must serialize, and the serialized form must parse
+ * back to an identical serialization.
+ */
+
+#include "agent_lib.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static agent_context_t* ctx;
+    if (!ctx) {
+        ctx = agent_context_create(0);
+        if (!ctx) return 0;
+    }
+
+    agent_json_parse_result_t result = agent_json_parse(ctx, (const char*)data, size);
+    if (result.error == AGENT_OK && result.value) {
+        agent_string_t first;
+        agent_string_t second;
+        agent_string_init_arena(&first, ctx, 64);
+        agent_string_init_arena(&second, ctx, 64);
+
+        if (agent_json_serialize(result.value, &first, false) != AGENT_OK) {
+            abort();
+        }
+        agent_json_parse_result_t again = agent_json_parse(ctx, first.data, first.length);
+        if (again.error != AGENT_OK ||
+            agent_json_serialize(again.value, &second, false) != AGENT_OK ||
+            first.length != second.length ||
+            memcmp(first.data, second.data, first.length) != 0) {
+            abort();
+        }
+    }
+
+    agent_context_reset(ctx);
+    return 0;
+}
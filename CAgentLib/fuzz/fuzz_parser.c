@@ -0,0 +1,62 @@
+/**
+ * @file fuzz_parser.c
+ * @brief libFuzzer harness for the response parsers
+ *
+ * The static parse and the streaming parser see the same input; the first
+ * byte picks the streaming chunk size so tags and JSON get split at every
+ * offset over a run.
+ */
+
+#include "agent_lib.h"
+#include <stdint.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static void ignore_text(const char* text, size_t len, void* user_data) {
+    (void)text;
+    (void)len;
+    (void)user_data;
+}
+
+static void ignore_tool_call(const char* name, const agent_json_value_t* args, void* user_data) {
+    (void)name;
+    (void)args;
+    (void)user_data;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static agent_context_t* ctx;
+    if (!ctx) {
+        ctx = agent_context_create(0);
+        if (!ctx) return 0;
+    }
+
+    const char* text = (const char*)data;
+    agent_parser_parse(ctx, text, size);
+
+    agent_string_view_t thinking, content;
+    agent_parser_extract_thinking(ctx, text, size, &thinking, &content);
+    agent_parser_find_bare_json(ctx, text, size, NULL, NULL);
+
+    agent_streaming_parser_t parser;
+    if (agent_streaming_parser_init(&parser, ctx) == AGENT_OK) {
+        parser.on_text = ignore_text;
+        parser.on_thinking = ignore_text;
+        parser.on_tool_call = ignore_tool_call;
+        if (size > 0 && (data[0] & 0x80)) {
+            agent_text_coalescing_t policy = {16, 4};
+            agent_streaming_parser_set_text_coalescing(&parser, &policy);
+        }
+
+        size_t chunk = size > 0 ? (size_t)(data[0] & 0x0f) + 1 : 1;
+        for (size_t pos = 0; pos < size; pos += chunk) {
+            size_t n = size - pos < chunk ? size - pos : chunk;
+            agent_streaming_parser_feed(&parser, text + pos, n);
+        }
+        agent_streaming_parser_flush(&parser);
+        agent_streaming_parser_free(&parser);
+    }
+
+    agent_context_reset(ctx);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file agent_alloc.h
+ * @brief Pluggable system allocator used by every library module
+ */
+
+#ifndef AGENT_ALLOC_H
+#define AGENT_ALLOC_H
+
+#include "agent_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Allocator vtable
+ *
+ * All three functions are required. They follow malloc/realloc/free
+ * semantics and receive user_data as their last argument.
+ */
+typedef struct {
+    void* (*alloc)(size_t size, void* user_data);
+    void* (*realloc)(void* ptr, size_t size, void* user_data);
+    void (*free)(void* ptr, void* user_data);
+    void* user_data;
+} agent_allocator_t;
+
+/**
+ * @brief Install the allocator used for all library heap memory
+ * @param allocator Allocator to install (copied), or NULL for the system allocator
+ * @return AGENT_OK on success, AGENT_ERROR_INVALID_ARGUMENT if a function is missing
+ *
+ * Memory must be freed by the allocator that allocated it, so install the
+ * allocator before creating any library objects. Usually called through
+ * agent_lib_init_with_allocator.
+ */
+agent_error_t agent_set_allocator(const agent_allocator_t* allocator);
+
+/**
+ * @brief Get the installed allocator
+ * @return Current allocator (never NULL)
+ */
+const agent_allocator_t* agent_get_allocator(void);
+
+/**
+ * @brief Allocate memory through the installed allocator
+ * @param size Size in bytes
+ * @return Pointer to memory, or NULL on failure
+ */
+void* agent_mem_alloc(size_t size);
+
+/**
+ * @brief Allocate zeroed memory through the installed allocator
+ * @param count Number of elements
+ * @param size Size of each element
+ * @return Pointer to memory, or NULL on failure or overflow
+ */
+void* agent_mem_calloc(size_t count, size_t size);
+
+/**
+ * @brief Resize memory through the installed allocator
+ * @param ptr Existing allocation (or NULL)
+ * @param size New size in bytes
+ * @return Pointer to memory, or NULL on failure (ptr stays valid)
+ */
+void* agent_mem_realloc(void* ptr, size_t size);
+
+/**
+ * @brief Free memory through the installed allocator
+ * @param ptr Memory to free (NULL is ignored)
+ */
+void agent_mem_free(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AGENT_ALLOC_H */
@@ -19,6 +19,19 @@ extern "C" {
  */
 agent_context_t* agent_context_create(size_t initial_size);
 
+/**
+ * @brief Create a context backed by one reserved virtual memory range
+ * @param reserve_size Bytes of address space to reserve (rounded up to 64KB)
+ * @return New context, or NULL on failure or if the platform lacks mmap
+ *
+ * Pages are committed in 64KB steps as the arena grows, so allocations are
+ * always contiguous and restore is a single pointer move. Allocations
+ * past the reservation fail instead of adding blocks. Reset keeps the
+ * committed range but lets the kernel reclaim everything past the first
+ * 64KB (MADV_FREE).
+ */
+agent_context_t* agent_context_create_reserved(size_t reserve_size);
+
 /**
  * @brief Destroy context and free all memory
  * @param ctx Context to destroy
@@ -42,19 +55,62 @@ void* agent_context_alloc(agent_context_t* ctx, size_t size);
  */
 void* agent_context_calloc(agent_context_t* ctx, size_t count, size_t size);
 
+/**
+ * @brief Cache line size assumed for SIMD-friendly buffers
+ */
+#define AGENT_CONTEXT_CACHE_LINE 64
+
+/**
+ * @brief Allocate memory from the arena with a specific alignment
+ * @param ctx Context
+ * @param size Size in bytes
+ * @param align Alignment in bytes (power of two, e.g. 16, 64 or a page size)
+ * @return Pointer to allocated memory, or NULL on failure or invalid alignment
+ *
+ * Padding needed to reach the alignment is taken from the current block.
+ */
+void* agent_context_alloc_aligned(agent_context_t* ctx, size_t size, size_t align);
+
+/**
+ * @brief Allocate zeroed memory from the arena with a specific alignment
+ * @param ctx Context
+ * @param count Number of elements
+ * @param size Size of each element
+ * @param align Alignment in bytes (power of two)
+ * @return Pointer to allocated memory, or NULL on failure
+ */
+void* agent_context_calloc_aligned(agent_context_t* ctx, size_t count, size_t size, size_t align);
+
+/**
+ * @brief Resize an allocation
+ * @param ctx Context
+ * @param ptr Existing allocation (or NULL to allocate)
+ * @param old_size Size of the existing allocation
+ * @param new_size Requested size
+ * @return Pointer to resized memory (possibly ptr itself), or NULL on failure
+ *
+ * If ptr is the most recent allocation and the current block has room, the
+ * allocation is resized in place. Otherwise new memory is allocated and the
+ * contents copied; the old allocation stays in the arena until reset.
+ * New bytes are not zeroed.
+ */
+void* agent_context_realloc(agent_context_t* ctx, void* ptr, size_t old_size, size_t new_size);
+
 /**
  * @brief Reset the arena (free all allocations but keep the memory)
  * @param ctx Context
  *
  * This is very fast - just resets the allocation pointer.
  * Use this between iterations to reuse memory.
+ * Blocks beyond the first are kept on a free-list (up to the retention
+ * limit) and reused by later allocations instead of calling malloc.
  */
 void agent_context_reset(agent_context_t* ctx);
 
 /**
  * @brief Create a savepoint for partial reset
  * @param ctx Context
- * @return Savepoint value
+ * @return Savepoint value (opaque position in the arena, valid across blocks)
  */
 size_t agent_context_savepoint(agent_context_t* ctx);
 
@@ -62,6 +118,11 @@ size_t agent_context_savepoint(agent_context_t* ctx);
  * @brief Restore to a previous savepoint
  * @param ctx Context
  * @param savepoint Savepoint value from agent_context_savepoint
+ *
+ * Frees every allocation made after the savepoint, even if the arena has
+ * grown into new blocks since. Blocks past the savepoint are kept and
+ * reused by later allocations. Savepoints taken after a reset, or after an
+ * earlier restore to a point before them, are invalid.
  */
 void agent_context_restore(agent_context_t* ctx, size_t savepoint);
 
@@ -75,10 +136,74 @@ size_t agent_context_used(agent_context_t* ctx);
 /**
  * @brief Get total memory capacity
  * @param ctx Context
- * @return Total arena capacity in bytes
+ * @return Total arena capacity in bytes (excluding retained free blocks)
  */
 size_t agent_context_capacity(agent_context_t* ctx);
 
+/**
+ * @brief Number of buckets in the allocation size histogram
+ *
+ * Bucket i counts allocations of up to 16 << (2 * i) bytes
+ * (16, 64, 256, 1K, 4K, 16K, 64K); the last bucket counts everything larger.
+ */
+#define AGENT_CONTEXT_STATS_BUCKETS 8
+
+/**
+ * @brief Arena statistics
+ *
+ * bytes_used and block_count describe the current state; the remaining
+ * counters accumulate over the lifetime of the context.
+ */
+typedef struct {
+    size_t bytes_used;          /* Bytes currently allocated (incl. padding) */
+    size_t peak_bytes;          /* High-water mark of bytes_used */
+    size_t capacity;            /* Same as agent_context_capacity */
+    size_t retained_bytes;      /* Same as agent_context_retained */
+    size_t block_count;         /* Blocks in the active chain */
+    size_t allocation_count;    /* Number of allocations */
+    size_t padding_bytes;       /* Bytes lost to alignment */
+    size_t histogram[AGENT_CONTEXT_STATS_BUCKETS];
+} agent_context_stats_t;
+
+/**
+ * @brief Get arena statistics
+ * @param ctx Context
+ * @return Snapshot of the counters (all zero if ctx is NULL)
+ */
+agent_context_stats_t agent_context_stats(agent_context_t* ctx);
+
+/**
+ * @brief Get memory retained on the free-list
+ * @param ctx Context
+ * @return Bytes held by blocks retired by agent_context_reset
+ */
+size_t agent_context_retained(agent_context_t* ctx);
+
+/**
+ * @brief Set the free-list retention limit
+ * @param ctx Context
+ * @param max_bytes Maximum bytes kept after reset (0 to free everything; default: 256KB)
+ *
+ * Retained blocks above the new limit are released immediately.
+ */
+void agent_context_set_retain_limit(agent_context_t* ctx, size_t max_bytes);
+
+/**
+ * @brief Set a memory budget for the arena
+ * @param ctx Context
+ * @param soft_limit Footprint above which on_pressure fires (0 = none)
+ * @param hard_limit Footprint the arena may never grow past (0 = unlimited)
+ * @param on_pressure Called once each time the soft limit is crossed (may be NULL)
+ * @param user_data Passed to on_pressure
+ *
+ * The footprint is everything the arena holds from the system allocator:
+ * capacity plus retained free-list blocks. Allocations that would need a
+ * new block past the hard limit return NULL. on_pressure runs inside the
+ * allocation that crossed the limit and must not reset or restore ctx.
+ */
+void agent_context_set_budget(agent_context_t* ctx, size_t soft_limit, size_t hard_limit,
+                              agent_memory_pressure_callback_t on_pressure, void* user_data);
+
 /**
  * @brief Duplicate a string into the arena
  * @param ctx Context
@@ -113,6 +238,31 @@ agent_string_view_t agent_context_string_view(agent_context_t* ctx, const char*
  */
 agent_string_view_t agent_context_string_view_n(agent_context_t* ctx, const char* str, size_t len);
 
+/**
+ * @brief Longest string agent_context_intern shares; longer ones are copied
+ */
+#define AGENT_CONTEXT_INTERN_MAX_LENGTH 64
+
+/**
+ * @brief Get the context's one copy of a string, adding it on first use
+ * @param ctx Context
+ * @param str String to intern
+ * @param len Length of string
+ * @return String view of the shared, null-terminated arena copy
+ *
+ * Equal strings interned in the same context have the same data pointer
+ * until the context is reset or restored to a savepoint taken before one
+ * was added. Used for JSON object keys.
+ */
+agent_string_view_t agent_context_intern(agent_context_t* ctx, const char* str, size_t len);
+
+/**
+ * @brief Number of distinct strings currently interned
+ * @param ctx Context
+ * @return Table size
+ */
+size_t agent_context_intern_count(agent_context_t* ctx);
+
 #ifdef __cplusplus
 }
 #endif
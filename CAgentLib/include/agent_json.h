@@ -26,6 +26,13 @@ typedef enum {
     AGENT_JSON_OBJECT = 6
 } agent_json_type_t;
 
+/**
+ * @brief Number of keys at which an object gets a hash index
+ *
+ * Smaller objects are searched linearly.
+ */
+#define AGENT_JSON_INDEX_THRESHOLD 16
+
 /**
  * @brief JSON object entry (key-value pair)
  */
@@ -47,10 +54,16 @@ struct agent_json_value_t {
         struct {
             agent_json_value_t** items;
             size_t count;
+            size_t capacity;
         } array_value;
         struct {
             agent_json_entry_t* entries;
             size_t count;
+            size_t capacity;
+            /* Open-addressing hash index (entry position + 1, 0 = empty),
+               built once the object reaches AGENT_JSON_INDEX_THRESHOLD keys */
+            uint32_t* index;
+            size_t index_capacity;
         } object_value;
     } data;
 };
@@ -121,6 +134,14 @@ agent_json_value_t* agent_json_array(agent_context_t* ctx, size_t initial_capaci
  */
 agent_json_value_t* agent_json_object(agent_context_t* ctx, size_t initial_capacity);
 
+/**
+ * @brief Deep-copy a JSON value into an arena
+ * @param ctx Destination arena context
+ * @param value Value to copy (may live in another arena)
+ * @return Copy, or NULL on error (or if value is NULL)
+ */
+agent_json_value_t* agent_json_clone(agent_context_t* ctx, const agent_json_value_t* value);
+
 /* Array operations */
 
 /**
@@ -206,6 +227,50 @@ bool agent_json_object_has(const agent_json_value_t* object, const char* key);
  */
 size_t agent_json_object_length(const agent_json_value_t* object);
 
+/* Compiled paths */
+
+/**
+ * @brief One step of a compiled path: an object key or an array index
+ */
+typedef struct {
+    const char* key;
+    size_t key_length;
+    uint32_t hash;      /**< Key hash, matching the object index */
+    size_t index;
+    bool is_index;
+} agent_json_path_segment_t;
+
+/**
+ * @brief Path compiled once and evaluated against any value
+ */
+typedef struct {
+    agent_json_path_segment_t* segments;
+    size_t count;
+} agent_json_path_t;
+
+/**
+ * @brief Compile a path expression such as "arguments.options[0].limit"
+ *
+ * Keys are separated by '.', array indices are written as [N]. An empty
+ * expression selects the value itself.
+ *
+ * @param ctx Arena context for the compiled segments
+ * @param expression Path expression
+ * @param out_path Output compiled path
+ * @return AGENT_OK on success, AGENT_ERROR_PARSE_ERROR if malformed
+ */
+agent_error_t agent_json_path_compile(agent_context_t* ctx, const char* expression,
+                                      agent_json_path_t* out_path);
+
+/**
+ * @brief Evaluate a compiled path
+ * @param path Compiled path
+ * @param value Value to start from
+ * @return Selected value, or NULL if any step does not match
+ */
+agent_json_value_t* agent_json_path_eval(const agent_json_path_t* path,
+                                         const agent_json_value_t* value);
+
 /* Type accessors */
 
 /**
@@ -276,6 +341,272 @@ agent_json_parse_result_t agent_json_parse(agent_context_t* ctx, const char* jso
  */
 agent_json_parse_result_t agent_json_parse_cstr(agent_context_t* ctx, const char* json);
 
+/**
+ * @brief Parse JSON destructively in place
+ *
+ * String values and keys are decoded inside the caller's buffer and point
+ * into it, so no string payloads are copied into the arena. The buffer is
+ * overwritten and must outlive the returned values.
+ *
+ * @param ctx Arena context for value nodes
+ * @param json Mutable JSON text
+ * @param length JSON text length
+ * @return Parse result
+ */
+agent_json_parse_result_t agent_json_parse_insitu(agent_context_t* ctx, char* json, size_t length);
+
+/* Tape representation */
+
+/**
+ * @brief Read-only JSON document stored as one flat tape
+ *
+ * Values are laid out in document order as 64-bit slots; containers record
+ * the position of their closing slot, so siblings are reached without
+ * walking children. Decoded strings live in a single NUL-separated area.
+ */
+typedef struct {
+    uint64_t* slots;
+    size_t slot_count;
+    char* strings;
+    size_t strings_length;
+} agent_json_tape_t;
+
+/**
+ * @brief Reference to a value on a tape (invalid when tape is NULL)
+ */
+typedef struct {
+    const agent_json_tape_t* tape;
+    size_t index;
+} agent_json_tape_ref_t;
+
+/**
+ * @brief Tape parse result
+ */
+typedef struct {
+    agent_json_tape_t* tape;
+    agent_error_t error;
+    const char* error_message;
+    size_t error_position;
+} agent_json_tape_parse_result_t;
+
+/**
+ * @brief Parse JSON into a tape
+ * @param ctx Arena context for the tape
+ * @param json JSON string
+ * @param length JSON string length
+ * @return Parse result
+ */
+agent_json_tape_parse_result_t agent_json_tape_parse(agent_context_t* ctx, const char* json,
+                                                     size_t length);
+
+/**
+ * @brief Get the root value of a tape
+ * @param tape Parsed tape
+ * @return Reference to the root value
+ */
+agent_json_tape_ref_t agent_json_tape_root(const agent_json_tape_t* tape);
+
+/**
+ * @brief Check whether a reference points at a value
+ *
+ * Iteration past the last child of a container yields an invalid reference.
+ *
+ * @param ref Tape reference
+ * @return true if ref is a value
+ */
+bool agent_json_tape_valid(agent_json_tape_ref_t ref);
+
+/**
+ * @brief Get the type of a tape value
+ * @param ref Tape reference
+ * @return Value type (AGENT_JSON_NULL for invalid references)
+ */
+agent_json_type_t agent_json_tape_type(agent_json_tape_ref_t ref);
+
+/**
+ * @brief Get boolean value
+ * @param ref Tape reference
+ * @param out_value Output boolean
+ * @return AGENT_OK if value is a boolean
+ */
+agent_error_t agent_json_tape_get_bool(agent_json_tape_ref_t ref, bool* out_value);
+
+/**
+ * @brief Get integer value
+ * @param ref Tape reference
+ * @param out_value Output integer
+ * @return AGENT_OK if value is an integer
+ */
+agent_error_t agent_json_tape_get_int(agent_json_tape_ref_t ref, int64_t* out_value);
+
+/**
+ * @brief Get double value
+ * @param ref Tape reference
+ * @param out_value Output double
+ * @return AGENT_OK if value is numeric
+ */
+agent_error_t agent_json_tape_get_double(agent_json_tape_ref_t ref, double* out_value);
+
+/**
+ * @brief Get string value (also used for object keys)
+ * @param ref Tape reference
+ * @param out_value Output string view (NUL-terminated, points into the tape)
+ * @return AGENT_OK if value is a string
+ */
+agent_error_t agent_json_tape_get_string(agent_json_tape_ref_t ref, agent_string_view_t* out_value);
+
+/**
+ * @brief Get the number of elements or members of a container
+ * @param ref Array or object reference
+ * @return Element count, or 0 if not a container
+ */
+size_t agent_json_tape_length(agent_json_tape_ref_t ref);
+
+/**
+ * @brief Get the first child of a container
+ *
+ * For objects, children alternate between key strings and values.
+ *
+ * @param ref Array or object reference
+ * @return First child, or an invalid reference if empty
+ */
+agent_json_tape_ref_t agent_json_tape_child(agent_json_tape_ref_t ref);
+
+/**
+ * @brief Get the value following ref, skipping any nested contents
+ * @param ref Tape reference
+ * @return Next sibling, or an invalid reference at the end of a container
+ */
+agent_json_tape_ref_t agent_json_tape_next(agent_json_tape_ref_t ref);
+
+/**
+ * @brief Get array element by index
+ * @param array Array reference
+ * @param index Element index
+ * @return Element, or an invalid reference if out of bounds
+ */
+agent_json_tape_ref_t agent_json_tape_array_get(agent_json_tape_ref_t array, size_t index);
+
+/**
+ * @brief Get object member value by key
+ * @param object Object reference
+ * @param key Key string
+ * @return Value, or an invalid reference if not found
+ */
+agent_json_tape_ref_t agent_json_tape_object_get(agent_json_tape_ref_t object, const char* key);
+
+/**
+ * @brief Convert a tape value to a mutable DOM value
+ * @param ctx Arena context for the new value
+ * @param ref Tape reference
+ * @return DOM value or NULL on error
+ */
+agent_json_value_t* agent_json_tape_to_value(agent_context_t* ctx, agent_json_tape_ref_t ref);
+
+/* Incremental parsing */
+
+/** Maximum container nesting tracked by the incremental parser */
+#define AGENT_JSON_INCREMENTAL_MAX_DEPTH 64
+
+/**
+ * @brief Incremental parser status
+ */
+typedef enum {
+    AGENT_JSON_INCREMENTAL_NEED_MORE = 0,  /**< Document not yet complete */
+    AGENT_JSON_INCREMENTAL_COMPLETE,       /**< Top-level value closed */
+    AGENT_JSON_INCREMENTAL_ERROR           /**< Malformed input */
+} agent_json_incremental_status_t;
+
+/**
+ * @brief Completed top-level object member (offsets into the buffer)
+ */
+typedef struct {
+    size_t key_start;
+    size_t key_length;
+    size_t value_start;
+    size_t value_length;
+    agent_json_value_t* value;  /**< Parsed lazily by agent_json_incremental_field */
+} agent_json_incremental_field_t;
+
+/**
+ * @brief Resumable JSON parser fed in arbitrary chunks
+ *
+ * Feeding only scans the new bytes, tracking nesting, strings and the
+ * boundaries of top-level object members; nothing is re-scanned and the
+ * DOM is built once, on demand, from the buffered text.
+ */
+typedef struct {
+    agent_context_t* ctx;
+    agent_string_t buffer;
+    agent_json_incremental_status_t status;
+    size_t scan_pos;
+
+    /* Structural state */
+    char containers[AGENT_JSON_INCREMENTAL_MAX_DEPTH];
+    int depth;
+    bool in_string;
+    bool escape;
+
+    /* Top-level member tracking */
+    int member_state;
+    size_t key_start;
+    size_t key_end;
+    size_t value_start;
+    agent_json_incremental_field_t* fields;
+    size_t field_count;
+    size_t field_capacity;
+
+    agent_json_value_t* value;
+} agent_json_incremental_t;
+
+/**
+ * @brief Initialize an incremental parser
+ * @param inc Parser to initialize
+ * @param ctx Arena context for parsed values
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_json_incremental_init(agent_json_incremental_t* inc, agent_context_t* ctx);
+
+/**
+ * @brief Free an incremental parser's buffers
+ * @param inc Parser to free
+ */
+void agent_json_incremental_free(agent_json_incremental_t* inc);
+
+/**
+ * @brief Discard buffered input so the parser can start a new document
+ * @param inc Parser to reset
+ */
+void agent_json_incremental_reset(agent_json_incremental_t* inc);
+
+/**
+ * @brief Feed the next chunk of input
+ *
+ * Bytes after the top-level value has closed are ignored.
+ *
+ * @param inc Parser
+ * @param data Chunk data
+ * @param length Chunk length
+ * @return Current status
+ */
+agent_json_incremental_status_t agent_json_incremental_feed(agent_json_incremental_t* inc,
+                                                            const char* data, size_t length);
+
+/**
+ * @brief Get the parsed document once complete
+ * @param inc Parser
+ * @return Parsed value, or NULL if incomplete or invalid
+ */
+agent_json_value_t* agent_json_incremental_value(agent_json_incremental_t* inc);
+
+/**
+ * @brief Get a top-level object member that has already been fully received
+ * @param inc Parser
+ * @param key Member key
+ * @return Parsed member value, or NULL if not (yet) available
+ */
+agent_json_value_t* agent_json_incremental_field(agent_json_incremental_t* inc, const char* key);
+
 /* Serialization */
 
 /**
@@ -287,6 +618,18 @@ agent_json_parse_result_t agent_json_parse_cstr(agent_context_t* ctx, const char
  */
 agent_error_t agent_json_serialize(const agent_json_value_t* value, agent_string_t* str, bool pretty);
 
+/**
+ * @brief Serialize JSON value compactly with object keys in bytewise order
+ *
+ * Equal values give equal text whatever order their keys were written in,
+ * so the output can be used as a cache key.
+ *
+ * @param value JSON value
+ * @param str Output string (must be initialized)
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_json_serialize_canonical(const agent_json_value_t* value, agent_string_t* str);
+
 /**
  * @brief Serialize JSON value to arena string
  * @param ctx Arena context
@@ -12,7 +12,8 @@
 /* Core types and data structures */
 #include "agent_types.h"
 
-/* Memory management (arena allocator) */
+/* Memory management (system allocator hooks, arena allocator) */
+#include "agent_alloc.h"
 #include "agent_context.h"
 
 /* String and UTF-8 utilities */
@@ -27,9 +28,18 @@
 /* MCP schema generation */
 #include "agent_mcp.h"
 
+/* BM25 index over the conversation (context recall) */
+#include "agent_recall.h"
+
 /* Agent orchestrator (main loop) */
 #include "agent_orchestrator.h"
 
+/* Multi-session scheduler (batched decoding over the step API) */
+#include "agent_scheduler.h"
+
+/* Conversation snapshot and restore */
+#include "agent_snapshot.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,10 +67,24 @@ const char* agent_lib_version(void);
  */
 agent_error_t agent_lib_init(void);
 
+/**
+ * @brief Initialize the library with a custom allocator
+ *
+ * Like agent_lib_init, but routes all heap memory used by the library
+ * (arena blocks, mutable strings, tool registries) through allocator.
+ * Must be called before any other library function allocates memory.
+ *
+ * @param allocator Allocator vtable (copied); NULL for the system allocator
+ * @return AGENT_OK on success, AGENT_ERROR_INVALID_ARGUMENT if the library
+ *         is already initialized or the vtable is incomplete
+ */
+agent_error_t agent_lib_init_with_allocator(const agent_allocator_t* allocator);
+
 /**
  * @brief Cleanup the library
  *
- * Should be called when done using the library.
+ * Should be called when done using the library, after all library
+ * objects are freed. Restores the system allocator.
  */
 void agent_lib_cleanup(void);
 
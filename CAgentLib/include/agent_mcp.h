@@ -47,6 +47,11 @@ typedef struct agent_property_schema_t {
     size_t properties_count;
 } agent_property_schema_t;
 
+/**
+ * @brief cache_ttl_ms for tools whose result depends only on their arguments
+ */
+#define AGENT_TOOL_CACHE_FOREVER (-1)
+
 /**
  * @brief Tool definition
  */
@@ -55,6 +60,15 @@ typedef struct {
     const char* description;
     agent_property_schema_t* parameters;
     size_t parameters_count;
+
+    /* How long a result may be reused for the same arguments, in ms
+       (0 = never, e.g. tools with side effects; AGENT_TOOL_CACHE_FOREVER = pure) */
+    int64_t cache_ttl_ms;
+
+    /* Words that suggest the tool is wanted ("weather", "天気", ...),
+       for agent_tool_registry_select() */
+    const char* const* keywords;
+    size_t keywords_count;
 } agent_tool_definition_t;
 
 /**
@@ -63,9 +77,47 @@ typedef struct {
 typedef struct {
     agent_tool_definition_t* tools;
     size_t count;
-    size_t capacity;
+    size_t capacity;                   /* 0 = tools not owned (static table) */
+
+    /* Open-addressing name index kept by agent_tool_registry_add: slot
+       holds a tool index + 1, 0 = empty (NULL = not indexed, scan tools) */
+    uint32_t* index;
+    size_t index_capacity;             /* Power of two, at least twice count */
+
+    /* Bumped by every agent_tool_registry_add */
+    uint64_t version;
+
+    /* Memoized text (heap), rebuilt once version moves on */
+    char* schema_json[2];              /* [pretty] */
+    uint64_t schema_json_version[2];
+    char* schema_compact;
+    uint64_t schema_compact_version;
+    char* grammar;
+    uint64_t grammar_version;
+    char* description[2];              /* [japanese] */
+    uint64_t description_version[2];
+
+    bool frozen;                       /* No more adds (agent_tool_registry_freeze) */
 } agent_tool_registry_t;
 
+/**
+ * @brief Registry over a static array of tool definitions
+ *
+ *     static agent_tool_definition_t tools[] = {...};
+ *     static agent_tool_registry_t registry = AGENT_TOOL_REGISTRY_STATIC(tools);
+ *
+ * Nothing is allocated or copied; the registry starts frozen. Call
+ * agent_tool_registry_freeze() once (off the launch path) to build the
+ * name index and the serialized schemas, and agent_tool_registry_free()
+ * to release what that built.
+ */
+#define AGENT_TOOL_REGISTRY_STATIC(tools_array) {                         \
+        .tools = (tools_array),                                           \
+        .count = sizeof(tools_array) / sizeof((tools_array)[0]),          \
+        .version = 1,                                                     \
+        .frozen = true                                                    \
+    }
+
 /**
  * @brief Initialize tool registry
  * @param registry Registry to initialize
@@ -84,11 +136,24 @@ void agent_tool_registry_free(agent_tool_registry_t* registry);
  * @brief Register a tool
  * @param registry Registry
  * @param tool Tool definition
- * @return AGENT_OK on success
+ * @return AGENT_OK on success, AGENT_ERROR_INVALID_ARGUMENT once frozen
  */
 agent_error_t agent_tool_registry_add(agent_tool_registry_t* registry,
                                       const agent_tool_definition_t* tool);
 
+/**
+ * @brief Stop adding tools and precompute what a run needs
+ *
+ * Builds the name index, the schema JSON (both variants), the compact
+ * signatures, the tool call grammar and the descriptions, so later calls
+ * only return them. The orchestrator reads these through its const
+ * registry pointer instead of building its own copy per generation.
+ *
+ * @param registry Registry (initialized or AGENT_TOOL_REGISTRY_STATIC)
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_tool_registry_freeze(agent_tool_registry_t* registry);
+
 /**
  * @brief Find tool by name
  * @param registry Registry
@@ -98,6 +163,159 @@ agent_error_t agent_tool_registry_add(agent_tool_registry_t* registry,
 const agent_tool_definition_t* agent_tool_registry_find(const agent_tool_registry_t* registry,
                                                         const char* name);
 
+/**
+ * @brief Tools schema JSON, serialized once per registry version
+ *
+ * Suits get_tools_schema: returns the same pointer until a tool is added,
+ * so the orchestrator's system prompt cache keeps hitting.
+ *
+ * @param registry Registry
+ * @param pretty Pretty print
+ * @return JSON owned by the registry, valid until the next add or free;
+ *         NULL on allocation failure
+ */
+const char* agent_tool_registry_schema_json(agent_tool_registry_t* registry, bool pretty);
+
+/**
+ * @brief Compact tool signatures, built once per registry version
+ * @param registry Registry
+ * @return Signatures owned by the registry, valid until the next add or
+ *         free; NULL on allocation failure
+ */
+const char* agent_tool_registry_schema_compact(agent_tool_registry_t* registry);
+
+/**
+ * @brief Tool call grammar, built once per registry version
+ * @param registry Registry
+ * @return Grammar owned by the registry, valid until the next add or free;
+ *         NULL on allocation failure
+ */
+const char* agent_tool_registry_grammar(agent_tool_registry_t* registry);
+
+/**
+ * @brief Human-readable tool descriptions, built once per registry version
+ * @param registry Registry
+ * @param japanese Use Japanese language
+ * @return Markdown owned by the registry, valid until the next add or free;
+ *         NULL on allocation failure
+ */
+const char* agent_tool_registry_description(agent_tool_registry_t* registry, bool japanese);
+
+/**
+ * @brief Pick the tools a request most likely needs
+ *
+ * A tool scores 2 for each of its keywords and 1 for each part of its
+ * name (split at '.' and '_', three bytes or longer) found in query,
+ * ignoring ASCII case. Tools scoring 0 are left out.
+ *
+ * @param registry Registry
+ * @param query Text to match, typically the latest user message
+ * @param top_k Most tools to pick
+ * @param out_indices Output: registry indices, best first (ties in
+ *        registration order); room for top_k entries
+ * @return Number of tools picked
+ */
+size_t agent_tool_registry_select(const agent_tool_registry_t* registry, agent_string_view_t query,
+                                  size_t top_k, size_t* out_indices);
+
+/**
+ * @brief Generate tools schema JSON string for some of the tools
+ * @param ctx Arena context
+ * @param registry Tool registry
+ * @param indices Registry indices of the tools to include, in order
+ * @param count Number of indices
+ * @param pretty Pretty print
+ * @return JSON string (arena-allocated)
+ */
+char* agent_mcp_get_subset_schema_json(agent_context_t* ctx,
+                                       const agent_tool_registry_t* registry,
+                                       const size_t* indices,
+                                       size_t count,
+                                       bool pretty);
+
+/**
+ * @brief Find tool by name view (e.g. a parsed tool call's name)
+ * @param registry Registry
+ * @param name Tool name (need not be NUL-terminated)
+ * @return Tool definition or NULL if not found; the first registered wins
+ */
+const agent_tool_definition_t* agent_tool_registry_find_sv(const agent_tool_registry_t* registry,
+                                                           agent_string_view_t name);
+
+/* Validated argument parsing */
+
+/**
+ * @brief Result of a schema-validated argument parse
+ */
+typedef struct {
+    agent_json_value_t* value;      /* Parsed arguments object */
+    agent_json_value_t** fields;    /* fields[i] is the value of tool->parameters[i], or NULL */
+    size_t field_count;
+    agent_error_t error;            /* AGENT_ERROR_PARSE_ERROR or, for schema violations,
+                                       AGENT_ERROR_INVALID_ARGUMENT */
+    const char* error_message;
+    size_t error_position;
+    const char* error_field;        /* Offending property name, if any */
+} agent_json_validated_result_t;
+
+/**
+ * @brief Parse tool arguments and check them against the tool's schema
+ *
+ * Types, enum membership and required fields are checked while parsing, so
+ * a mismatch stops the parse at the offending value. Optional parameters
+ * may be null; properties not in the schema are accepted unchecked.
+ *
+ * @param ctx Arena context
+ * @param json Arguments JSON
+ * @param length JSON length
+ * @param tool Tool definition providing the parameter schema
+ * @return Validated result
+ */
+agent_json_validated_result_t agent_json_parse_validated(agent_context_t* ctx, const char* json,
+                                                         size_t length,
+                                                         const agent_tool_definition_t* tool);
+
+/* Flat tool arguments */
+
+/**
+ * @brief One tool argument, typed by its parameter schema
+ *
+ * Strings point into the parsed JSON, so a slot lives as long as the
+ * arena holding the arguments.
+ */
+typedef struct {
+    agent_schema_type_t type;           /* tool->parameters[i].type */
+    bool present;                       /* False when absent or null */
+    union {
+        bool bool_value;                /* AGENT_SCHEMA_BOOLEAN */
+        int64_t int_value;              /* AGENT_SCHEMA_INTEGER */
+        double number_value;            /* AGENT_SCHEMA_NUMBER (integers converted) */
+        agent_string_view_t string_value;  /* AGENT_SCHEMA_STRING */
+    } data;
+    const agent_json_value_t* value;    /* The JSON value; read arrays and objects here */
+} agent_tool_arg_t;
+
+/**
+ * @brief Flatten a tool call's arguments into schema order
+ *
+ * out_args[i] receives tool->parameters[i], so callers read arguments by
+ * index instead of looking them up by name. Types follow
+ * agent_json_parse_validated: integers may stand in for numbers but not
+ * the other way round, and optional parameters may be absent or null.
+ * Properties not in the schema are ignored.
+ *
+ * @param tool Tool definition providing the parameter schema
+ * @param arguments Parsed arguments object (NULL = no arguments)
+ * @param out_args Output: room for tool->parameters_count slots
+ * @param out_error_field Output: offending parameter name on failure (may be NULL)
+ * @return AGENT_OK, or AGENT_ERROR_INVALID_ARGUMENT for a wrong type or a
+ *         missing required parameter
+ */
+agent_error_t agent_tool_args_flatten(const agent_tool_definition_t* tool,
+                                      const agent_json_value_t* arguments,
+                                      agent_tool_arg_t* out_args,
+                                      const char** out_error_field);
+
 /* Schema generation */
 
 /**
@@ -138,6 +356,79 @@ char* agent_mcp_get_schema_json(agent_context_t* ctx,
                                 const agent_tool_registry_t* registry,
                                 bool pretty);
 
+/* Compact signatures */
+
+/**
+ * @brief Write a tool as a one-line signature
+ *
+ * calendar.add(title:str, date:str, note?:str, tags?:[str],
+ * repeat?:"daily"|"weekly") - Add an event. Types are str, int, num and
+ * bool, [T] for arrays and {field:T, ...} for objects; '?' marks an
+ * optional parameter. Parameter descriptions are left out.
+ *
+ * @param ctx Arena context
+ * @param tool Tool definition
+ * @return Signature string (arena-allocated)
+ */
+char* agent_mcp_tool_signature(agent_context_t* ctx, const agent_tool_definition_t* tool);
+
+/**
+ * @brief Signatures for all tools in registry, one per line
+ * @param ctx Arena context
+ * @param registry Tool registry
+ * @return Signatures (arena-allocated)
+ */
+char* agent_mcp_get_schema_compact(agent_context_t* ctx, const agent_tool_registry_t* registry);
+
+/**
+ * @brief Signatures for some of the tools, one per line
+ * @param ctx Arena context
+ * @param registry Tool registry
+ * @param indices Registry indices of the tools to include, in order
+ * @param count Number of indices
+ * @return Signatures (arena-allocated)
+ */
+char* agent_mcp_get_subset_schema_compact(agent_context_t* ctx,
+                                          const agent_tool_registry_t* registry,
+                                          const size_t* indices,
+                                          size_t count);
+
+/* Tool call grammar */
+
+/**
+ * @brief Text that opens the region a tool call grammar constrains
+ */
+#define AGENT_TOOL_GRAMMAR_TRIGGER "<tool_call>"
+
+/**
+ * @brief GBNF grammar for one tool call
+ *
+ * The root rule matches <tool_call>{"name": ..., "arguments": {...}}</tool_call>
+ * for the registry's tools: names are fixed, arguments follow the tools'
+ * parameter types and enums, required ones always present and all of them
+ * in declaration order. Meant for a lazy grammar sampler triggered by
+ * AGENT_TOOL_GRAMMAR_TRIGGER (llama_sampler_init_grammar_lazy_patterns),
+ * so text outside tool calls stays free.
+ *
+ * @param ctx Arena context
+ * @param registry Tool registry
+ * @return Grammar (arena-allocated), NULL for an empty registry
+ */
+char* agent_mcp_get_tool_grammar(agent_context_t* ctx, const agent_tool_registry_t* registry);
+
+/**
+ * @brief GBNF grammar for a call to one of some of the tools
+ * @param ctx Arena context
+ * @param registry Tool registry
+ * @param indices Registry indices of the callable tools
+ * @param count Number of indices
+ * @return Grammar (arena-allocated), NULL when no index is valid
+ */
+char* agent_mcp_get_subset_tool_grammar(agent_context_t* ctx,
+                                        const agent_tool_registry_t* registry,
+                                        const size_t* indices,
+                                        size_t count);
+
 /* Helper functions for building tool definitions */
 
 /**
@@ -8,9 +8,11 @@
 
 #include "agent_types.h"
 #include "agent_context.h"
+#include "agent_string.h"
 #include "agent_json.h"
 #include "agent_parser.h"
 #include "agent_mcp.h"
+#include "agent_recall.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,21 +28,101 @@ extern "C" {
  */
 #define AGENT_MAX_TOOL_RESULT_LENGTH 3000
 
+/**
+ * @brief Length older tool results are cut to when the context is over budget
+ */
+#define AGENT_CONTEXT_TOOL_RESULT_LENGTH 200
+
+/**
+ * @brief Tokens counted per message for role markers and separators
+ */
+#define AGENT_MESSAGE_TOKEN_OVERHEAD 4
+
+/**
+ * @brief Default number of results the tool cache keeps
+ */
+#define AGENT_TOOL_CACHE_CAPACITY 64
+
+/**
+ * @brief Default interval between batched event deliveries, in milliseconds
+ */
+#define AGENT_EVENT_BATCH_INTERVAL_MS 16
+
+/**
+ * @brief Default bytes the router may write before a tool call, see route_generate
+ */
+#define AGENT_ROUTE_PROBE_LENGTH 64
+
+/**
+ * @brief Default longest image side handed to image_preprocess, in pixels
+ */
+#define AGENT_IMAGE_INPUT_SIZE 448
+
+/**
+ * @brief Default number of image embeddings the image cache keeps
+ */
+#define AGENT_IMAGE_CACHE_CAPACITY 8
+
+/**
+ * @brief Which part of an over-long tool result is kept
+ */
+typedef enum {
+    AGENT_TRUNCATE_HEAD = 0,       /* The start, then "..." */
+    AGENT_TRUNCATE_HEAD_TAIL       /* The start and the end around "\n...\n" */
+} agent_truncation_t;
+
 /**
  * @brief Agent configuration
  */
 typedef struct {
-    /* Callbacks - required */
+    /* Callbacks - required (generate or generate_with_prefix, and
+       execute_tool or execute_tool_cancellable) */
     agent_llm_generate_callback_t generate;
     agent_tool_execute_callback_t execute_tool;
 
+    /* Used instead of generate when set; also receives the stable-prefix hint */
+    agent_llm_generate_prefix_callback_t generate_with_prefix;
+
+    /* Used instead of execute_tool when set; also receives the cancellation
+       token and the result limits */
+    agent_tool_execute_cancellable_callback_t execute_tool_cancellable;
+
     /* Callbacks - optional */
     agent_token_callback_t on_token;
     agent_tool_call_notify_t on_tool_call;
     agent_step_callback_t on_step_change;
 
+    /* An iteration is generated again after its text was streamed (a call
+       to a tool tool_selection_top_k left out): drop that text */
+    agent_discard_callback_t on_discard;
+
+    /*
+     * Batched delivery: when set, token, step and tool call events are
+     * queued (consecutive tokens merged) and handed over together at most
+     * every event_batch_interval_ms, before a tool runs, when the run ends
+     * and on agent_flush_events(). The four callbacks above are not
+     * called then; AGENT_EVENT_DISCARD stands in for on_discard.
+     */
+    agent_events_callback_t on_events;
+    uint32_t event_batch_interval_ms;  /* 0 = use default (16) */
+
+    /* Runs an iteration's tool calls together when there is more than one;
+       results still reach the history in call order (NULL = one at a time) */
+    agent_tool_execute_batch_callback_t execute_tools;
+
+    /*
+     * Speculative execution: start_tool fires once a tool call's JSON
+     * closes while the model is still decoding, so the host can begin it
+     * on a worker. If the final parse has the same call, it still goes
+     * through execute_tool, which should hand over the started work;
+     * otherwise discard_tool fires for it. Both are NULL by default.
+     */
+    agent_tool_speculate_callback_t start_tool;
+    agent_tool_speculate_callback_t discard_tool;
+
     /* Schema callback (returns tool schema JSON) */
     agent_tools_schema_callback_t get_tools_schema;
+    uint64_t tools_schema_version;  /* Bump when the schema text changes behind the same pointer */
 
     /* User data passed to all callbacks */
     void* user_data;
@@ -48,43 +130,369 @@ typedef struct {
     /* Settings */
     int max_iterations;          /* 0 = use default (10) */
     size_t max_tool_result_len;  /* 0 = use default (3000) */
+    size_t max_tool_result_tokens;  /* With count_tokens: also cut results to this many tokens */
+    agent_truncation_t tool_result_truncation;
     bool use_japanese;           /* Use Japanese in prompts */
+    bool early_tool_dispatch;    /* Stop generating once a tool call's JSON object closes */
+    int64_t run_timeout_ms;      /* Cancel a run that takes longer (0 = no deadline) */
+
+    /* Tool call and thinking tags the model emits (NULL = Hermes <tool_call>) */
+    const agent_parser_dialect_t* dialect;
 
     /* Custom system prompt (appended to default) */
     const char* custom_system_prompt;
+
+    /*
+     * Memory budget for the conversation history arena, in bytes
+     * (0 = unlimited). Past the hard limit, adding messages fails with
+     * AGENT_ERROR_OUT_OF_MEMORY; on_memory_pressure fires when the soft
+     * limit is crossed, e.g. to trim or reset the conversation.
+     */
+    size_t memory_soft_limit;
+    size_t memory_hard_limit;
+    agent_memory_pressure_callback_t on_memory_pressure;
+
+    /*
+     * Prompt budget per generation, in tokens, system prompt included
+     * (0 or no count_tokens = send the whole history). Over budget, tool
+     * results before the latest round are cut to context_tool_result_len
+     * first, then the oldest turns are left out. System messages and the
+     * current turn are always sent. With context_recall_turns, up to that
+     * many earlier turns that best match the latest user message (BM25,
+     * see agent_recall.h) are kept first, then the newest of the rest
+     * while they fit.
+     */
+    agent_token_count_callback_t count_tokens;
+    size_t context_token_budget;
+    size_t context_tool_result_len;  /* 0 = use default (200) */
+    size_t context_recall_turns;     /* 0 = keep the newest turns only */
+
+    /*
+     * Opt-in result cache: tools in this registry with a cache_ttl_ms get
+     * their earlier result back when called again with the same
+     * arguments, without execute_tool running (NULL = no caching).
+     */
+    const agent_tool_registry_t* tool_registry;
+    size_t tool_cache_capacity;  /* 0 = use default (64) */
+
+    /*
+     * Per-run tool selection (needs tool_registry): the system prompt
+     * offers only the tool_selection_top_k tools agent_tool_registry_select()
+     * ranks highest for the latest user message, instead of
+     * get_tools_schema's full set. When nothing matches, or the model calls
+     * a tool it was not offered, the full set is used (the generation is
+     * redone, and its streamed text taken back through on_discard).
+     * 0 = always the full set.
+     */
+    size_t tool_selection_top_k;
+    bool compact_tool_schema;    /* Selected tools as signatures (agent_mcp_tool_signature) */
+
+    /*
+     * Pass agent_mcp_get_tool_grammar() for tool_registry (or the selected
+     * subset) in agent_generation_info_t.grammar, for backends that can
+     * constrain sampling inside <tool_call>.
+     */
+    bool constrain_tool_calls;
+
+    /*
+     * Hand tool calls of tool_registry tools to the host as schema-ordered
+     * agent_tool_arg_t slots too (agent_run_request_t.tool_args), so it can
+     * read arguments by index instead of walking the JSON.
+     */
+    bool flat_tool_arguments;
+
+    /* Message ids from agent_uuid_generate_ordered(): sort by creation */
+    bool ordered_message_ids;
+
+    /*
+     * Two-tier routing: when set, every iteration is first generated by
+     * route_generate, a small fast model. If its response has a tool call
+     * that parses, the calls run as usual. Otherwise (a text answer, a
+     * malformed call, or route_probe_length bytes without a tool call tag)
+     * the iteration is generated again with generate, which writes the
+     * answer; the redo counts as another iteration. The router's tokens
+     * are not streamed to on_token. Step-driven hosts see the choice in
+     * agent_run_request_t.route. NULL = generate only.
+     */
+    agent_llm_generate_callback_t route_generate;
+    size_t route_probe_length;   /* 0 = use default (64) */
+
+    /*
+     * Vision input: image_preprocess decodes each image once, when its
+     * message is added, to pixels no larger than image_input_size on
+     * either side; the message keeps those instead of the encoded bytes.
+     * NULL, or a failed decode, keeps the encoded bytes. The vision
+     * encoder's output can then be kept per message in the image cache
+     * (agent_image_embedding_store), so later iterations and turns skip it.
+     */
+    agent_image_preprocess_callback_t image_preprocess;
+    uint32_t image_input_size;     /* 0 = use default (448); at most 65535 */
+    size_t image_cache_capacity;   /* 0 = use default (8) */
 } agent_config_t;
 
+/**
+ * @brief Where a step-driven run stands
+ */
+typedef enum {
+    AGENT_RUN_IDLE = 0,              /* No run in progress */
+    AGENT_RUN_NEEDS_GENERATION,      /* Host must generate a response */
+    AGENT_RUN_NEEDS_TOOL_RESULTS,    /* Host must submit a result for every pending call */
+    AGENT_RUN_DONE                   /* Finished; collect it with agent_run_end() */
+} agent_run_status_t;
+
+/**
+ * @brief A tool call's arguments in schema order (flat_tool_arguments)
+ */
+typedef struct {
+    const agent_tool_definition_t* tool;  /* NULL when the tool is not in tool_registry */
+    const agent_tool_arg_t* args;         /* tool->parameters_count slots; NULL when the
+                                             arguments do not fit the schema or there
+                                             are no parameters */
+    size_t count;
+    const char* error_field;              /* Parameter that did not fit, if any */
+} agent_tool_args_t;
+
+/**
+ * @brief What the host has to do next, filled in by agent_run_poll()
+ *
+ * Pointers stay valid until the request is answered.
+ */
+typedef struct {
+    /* AGENT_RUN_NEEDS_GENERATION */
+    const agent_message_t* messages;
+    size_t message_count;
+    const char* system_prompt;
+    agent_generation_info_t generation;   /* Relative to the same model's previous generation */
+    bool route;                           /* Generate with the router model (route_generate) */
+
+    /* AGENT_RUN_NEEDS_TOOL_RESULTS */
+    const agent_tool_call_t* tool_calls;
+    size_t tool_call_count;
+    const agent_tool_args_t* tool_args;   /* With flat_tool_arguments: tool_args[i] is
+                                             tool_calls[i]'s, else NULL */
+} agent_run_request_t;
+
+/**
+ * @brief Where one loop iteration spent its time (monotonic clock)
+ */
+typedef struct {
+    uint64_t prompt_build_ns;       /* System prompt and context selection */
+    uint64_t first_token_ns;        /* Generation requested to first token */
+    uint64_t decode_ns;             /* Generation requested to response submitted */
+    size_t decode_tokens;
+    double tokens_per_second;
+    uint64_t parse_ns;              /* Parsing the response into text and tool calls */
+    uint64_t tools_ns;              /* Tool calls requested to last result */
+    bool routed;                    /* Generated by the router model */
+    size_t tool_first;              /* This iteration's calls in tool_calls / tool_latency_ns */
+    size_t tool_count;
+    size_t iteration_arena_bytes;   /* Scratch in use when the iteration ended */
+    size_t run_arena_bytes;
+} agent_iteration_trace_t;
+
+/**
+ * @brief Cached tool result
+ */
+typedef struct {
+    uint64_t hash;
+    char* key;               /* Tool name, NUL, canonical arguments (heap) */
+    size_t key_length;
+    char* content;           /* Heap */
+    size_t content_length;
+    int64_t expires_ms;      /* Monotonic clock; INT64_MAX = never */
+    uint64_t last_used;
+} agent_tool_cache_entry_t;
+
+/**
+ * @brief Tool results keyed by tool name and arguments; survives agent_reset
+ */
+typedef struct {
+    agent_tool_cache_entry_t* entries;   /* Heap */
+    size_t count;
+    size_t capacity;
+    uint64_t clock;                      /* Use counter for LRU eviction */
+    uint64_t hits;
+    uint64_t misses;                     /* Cacheable calls that had to run */
+} agent_tool_cache_t;
+
+/**
+ * @brief Projected embedding of one message's image
+ */
+typedef struct {
+    agent_uuid_t message_id;
+    float* embedding;        /* Heap; n_tokens rows of n_embd */
+    size_t n_tokens;
+    size_t n_embd;
+    uint64_t last_used;
+} agent_image_cache_entry_t;
+
+/**
+ * @brief Image embeddings keyed by message id; survives agent_reset, so a
+ * reloaded snapshot finds them again
+ */
+typedef struct {
+    agent_image_cache_entry_t* entries;  /* Heap */
+    size_t count;
+    size_t capacity;
+    uint64_t clock;                      /* Use counter for LRU eviction */
+    uint64_t hits;
+    uint64_t misses;
+} agent_image_cache_t;
+
+/**
+ * @brief A tool call handed to start_tool during the current generation
+ */
+typedef struct {
+    const char* name;
+    const agent_json_value_t* arguments;
+    agent_string_t key;      /* Name and canonical arguments */
+    bool confirmed;          /* The final parse has the same call */
+} agent_speculated_call_t;
+
+typedef struct {
+    agent_speculated_call_t* items;   /* Iteration arena */
+    size_t count;
+    size_t capacity;
+} agent_tool_speculation_t;
+
+/**
+ * @brief A message as the previous generation was sent it
+ */
+typedef struct {
+    agent_uuid_t id;
+    size_t content_length;  /* Differs when a tool result was cut */
+} agent_sent_message_t;
+
+/**
+ * @brief What one model was sent in its previous generation
+ */
+typedef struct {
+    agent_sent_message_t* messages;   /* Heap; survives arena resets */
+    size_t count;
+    size_t capacity;
+    uint64_t prompt_generation;
+} agent_sent_prompt_t;
+
 /**
  * @brief Agent state
  */
 typedef struct {
+    /*
+     * Arenas, from longest to shortest lived:
+     * - ctx: conversation history (reset only by agent_reset)
+     * - run_ctx: tool calls, results and messages of the latest run
+     *   (reset when the next run starts)
+     * - iteration_ctx: system prompts, parse trees and other scratch
+     *   (reset after every loop iteration)
+     */
     agent_context_t* ctx;
+    agent_context_t* run_ctx;
+    agent_context_t* iteration_ctx;
     agent_config_t config;
 
     /* Message history */
     agent_message_array_t messages;
 
-    /* Working history (includes tool messages) */
+    /*
+     * Working history (includes tool messages). A view over messages;
+     * during a run, its assistant and tool messages are appended in the
+     * spare slots past messages.count. Back to the plain conversation
+     * once the run ends.
+     */
     agent_message_array_t working_history;
 
     /* Current state */
     agent_step_t current_step;
     int iteration_count;
     bool is_processing;
-    bool should_stop;
+    agent_cancel_token_t cancel;              /* Shared with callbacks; see agent_stop() */
 
-    /* Streaming parser */
+    /* Streaming parser; its compiled dialect is used for all parsing */
     agent_streaming_parser_t parser;
 
     /* Generated content in current turn */
-    agent_string_t current_response;
+    agent_rope_t current_response;           /* Run arena */
 
     /* Extracted thinking content */
     agent_string_t thinking_content;
+
+    /* Built system prompt and the inputs it was built from */
+    agent_template_t prompt_template[2];      /* [japanese], compiled by agent_init */
+    agent_string_t prompt_cache;
+    bool prompt_valid;
+    const char* prompt_schema;
+    uint64_t prompt_schema_version;
+    const char* prompt_custom;
+    bool prompt_japanese;
+    uint64_t prompt_generation;               /* Bumped on every rebuild */
+    size_t prompt_tokens;
+    uint64_t prompt_tokens_generation;        /* Prompt that prompt_tokens measured */
+
+    /* Messages for the pending generation: working_history or a window of it */
+    const agent_message_t* send_messages;
+    size_t send_count;
+    size_t tool_round_start;                  /* Where the latest tool results begin */
+    agent_recall_index_t recall;              /* Heap; doc i is messages[i] */
+    size_t recall_indexed;                    /* Messages added to recall */
+
+    /* Messages sent to the previous generation, for the stable-prefix hint */
+    agent_uuid_t conversation_id;
+    agent_sent_prompt_t sent[2];              /* [routed]: each model keeps its own cache */
+    agent_generation_info_t generation;       /* Hint for the pending generation */
+    bool routed;                              /* Pending generation goes to route_generate */
+
+    agent_tool_cache_t tool_cache;
+    agent_image_cache_t image_cache;
+
+    /* Tools offered this run; see tool_selection_top_k */
+    bool tool_subset_active;                  /* false = the full schema */
+    size_t* tool_subset;                      /* Heap; registry indices */
+    size_t tool_subset_count;
+    size_t tool_subset_capacity;
+    uint64_t tool_subset_registry_version;
+    agent_string_t tool_subset_schema;        /* Heap */
+    uint64_t tool_subset_version;             /* Bumped when the subset changes */
+
+    /* Events waiting for on_events; texts are laid out in order in event_text */
+    agent_event_t* events;                    /* Heap */
+    size_t event_count;
+    size_t event_capacity;
+    agent_string_t event_text;                /* Heap */
+    uint64_t events_due_ns;                   /* Deliver once the clock passes this */
+
+    /* Run in progress; see agent_run_begin() */
+    agent_run_status_t run_status;
+    agent_error_t run_error;
+    const char* run_error_message;
+    agent_tool_call_array_t run_tool_calls;   /* Every call made during the run */
+    char* system_prompt;                      /* Prompt for the pending generation */
+    agent_tool_tag_scanner_t tag_scanner;     /* Resumes where the last token ended */
+    bool detected_tool_call;
+    bool tool_call_closed;                    /* Early dispatch: the call's JSON has balanced */
+    size_t streamed_length;                   /* Bytes of this iteration's text sent to the host */
+    agent_tool_speculation_t speculations;    /* Started early, awaiting the final parse */
+    size_t pending_first;                     /* First run_tool_calls entry awaiting a result */
+    size_t pending_count;
+    size_t pending_submitted;
+    agent_tool_result_t* pending_results;
+    bool* pending_done;
+    agent_tool_args_t* pending_args;          /* flat_tool_arguments (iteration arena) */
+    agent_message_t pending_assistant;        /* Recorded after this iteration's tool results */
+    bool has_pending_assistant;
+
+    /* Performance trace of the run (run arena) */
+    agent_iteration_trace_t* trace;           /* max_iterations entries */
+    uint64_t* tool_latency_ns;                /* Grows with run_tool_calls */
+    size_t tool_latency_capacity;
+    uint64_t generation_started_ns;
+    uint64_t tools_started_ns;
 } agent_state_t;
 
 /**
  * @brief Agent run result
+ *
+ * All views and pointers stay valid until the next agent_run call or
+ * agent_reset.
  */
 typedef struct {
     agent_error_t error;
@@ -102,6 +510,11 @@ typedef struct {
 
     /* Number of iterations used */
     int iterations;
+
+    /* One entry per iteration, and each tool call's latency (parallel to tool_calls) */
+    const agent_iteration_trace_t* trace;
+    size_t trace_count;
+    const uint64_t* tool_latency_ns;
 } agent_run_result_t;
 
 /**
@@ -177,12 +590,102 @@ agent_run_result_t agent_run(agent_state_t* state);
  */
 agent_run_result_t agent_run_streaming(agent_state_t* state);
 
+/*
+ * Step-driven runs. Instead of blocking in agent_run(), the host asks
+ * what is needed next and answers when it is ready:
+ *
+ *   agent_run_begin(state);
+ *   while (agent_run_poll(state, &request) != AGENT_RUN_DONE) {
+ *       NEEDS_GENERATION:   agent_run_feed_token() per token, then
+ *                           agent_run_submit_generation()
+ *       NEEDS_TOOL_RESULTS: agent_run_submit_tool_result() per call,
+ *                           in any order
+ *   }
+ *   result = agent_run_end(state);
+ *
+ * The generate and execute_tool callbacks are not called in this mode;
+ * agent_run() is a driver of exactly this loop around them.
+ */
+
+/**
+ * @brief Start a run over the current history
+ * @param state Agent state
+ * @return AGENT_OK, or AGENT_ERROR_INVALID_ARGUMENT if a run is in progress
+ */
+agent_error_t agent_run_begin(agent_state_t* state);
+
+/**
+ * @brief Report what the run needs next
+ * @param state Agent state
+ * @param out_request Output: details for the returned status (may be NULL)
+ * @return Current status
+ */
+agent_run_status_t agent_run_poll(agent_state_t* state, agent_run_request_t* out_request);
+
+/**
+ * @brief Feed one streamed token of the pending generation
+ * @param state Agent state
+ * @param token Token bytes
+ * @param length Token length
+ * @return true to keep generating, false to stop (stop requested, user
+ *         on_token declined, or early dispatch saw the tool call complete)
+ */
+bool agent_run_feed_token(agent_state_t* state, const char* token, size_t length);
+
+/**
+ * @brief Finish the pending generation
+ *
+ * If no tokens were fed, result->text is taken as the whole response.
+ *
+ * @param state Agent state
+ * @param result Generation outcome
+ * @return AGENT_OK, or AGENT_ERROR_INVALID_ARGUMENT if no generation is pending
+ */
+agent_error_t agent_run_submit_generation(agent_state_t* state, const agent_llm_result_t* result);
+
+/**
+ * @brief Answer one pending tool call
+ * @param state Agent state
+ * @param index Index into the request's tool_calls
+ * @param result Tool output (content is copied)
+ * @return AGENT_OK, or AGENT_ERROR_INVALID_ARGUMENT for an unknown or
+ *         already answered call
+ */
+agent_error_t agent_run_submit_tool_result(agent_state_t* state, size_t index,
+                                           const agent_tool_execute_result_t* result);
+
+/**
+ * @brief Collect a finished run and record its response in the history
+ * @param state Agent state
+ * @return Run result (AGENT_ERROR_INVALID_ARGUMENT if the run is not done)
+ */
+agent_run_result_t agent_run_end(agent_state_t* state);
+
 /**
  * @brief Request the agent to stop
+ *
+ * Safe to call from any thread. Generation stops at the next token and no
+ * further tool starts; callbacks that poll the cancellation token can
+ * return sooner.
+ *
  * @param state Agent state
  */
 void agent_stop(agent_state_t* state);
 
+/**
+ * @brief Check a cancellation token
+ * @param token Token from agent_generation_info_t or a cancellable callback
+ * @return true once the run was stopped or its deadline has passed
+ */
+bool agent_cancel_requested(const agent_cancel_token_t* token);
+
+/**
+ * @brief Deliver queued events to on_events now
+ * @param state Agent state
+ * @return on_events' answer: false if generation should stop
+ */
+bool agent_flush_events(agent_state_t* state);
+
 /**
  * @brief Check if agent is currently processing
  * @param state Agent state
@@ -209,13 +712,57 @@ void agent_get_messages(const agent_state_t* state,
 
 /**
  * @brief Build the system prompt
+ *
+ * The prompt is cached in the state and the same pointer is returned
+ * until the schema pointer, tools_schema_version, the tool_registry's
+ * version, custom_system_prompt or use_japanese changes, so the LLM layer
+ * can reuse it as a prefix.
+ *
  * @param state Agent state
- * @return System prompt string (arena-allocated)
+ * @return System prompt string (owned by the state, valid until rebuilt)
  */
 char* agent_build_system_prompt(agent_state_t* state);
 
 /**
- * @brief Execute a single tool call
+ * @brief Drop every cached tool result (hit and miss counts are kept)
+ * @param state Agent state
+ */
+void agent_tool_cache_clear(agent_state_t* state);
+
+/**
+ * @brief Keep the vision encoder's output for a message's image
+ * @param state Agent state
+ * @param message_id Id of the message that carries the image
+ * @param embedding n_tokens * n_embd floats (copied)
+ * @param n_tokens Image tokens
+ * @param n_embd Floats per token
+ * @return AGENT_OK, or AGENT_ERROR_OUT_OF_MEMORY (nothing is kept)
+ *
+ * Replaces an earlier embedding for the same message; the least recently
+ * used entry makes room when the cache is full.
+ */
+agent_error_t agent_image_embedding_store(agent_state_t* state, agent_uuid_t message_id,
+                                          const float* embedding, size_t n_tokens, size_t n_embd);
+
+/**
+ * @brief Look up a message's image embedding
+ * @param state Agent state
+ * @param message_id Id of the message that carries the image
+ * @param n_tokens Set to the image tokens on a hit
+ * @param n_embd Set to the floats per token on a hit
+ * @return The embedding (valid until the next store or clear), or NULL
+ */
+const float* agent_image_embedding_lookup(agent_state_t* state, agent_uuid_t message_id,
+                                          size_t* n_tokens, size_t* n_embd);
+
+/**
+ * @brief Drop every cached image embedding (hit and miss counts are kept)
+ * @param state Agent state
+ */
+void agent_image_cache_clear(agent_state_t* state);
+
+/**
+ * @brief Execute a single tool call, or answer it from the tool cache
  * @param state Agent state
  * @param tool_call Tool call to execute
  * @return Tool result
@@ -234,6 +781,21 @@ agent_tool_result_t agent_execute_tool(agent_state_t* state,
  */
 char* agent_truncate_text(agent_context_t* ctx, const char* text, size_t max_len);
 
+/**
+ * @brief Truncate a string view to at most max_len bytes
+ *
+ * Cuts fall on UTF-8 character boundaries and the marker counts towards
+ * max_len. Only the kept bytes are copied.
+ *
+ * @param ctx Arena context
+ * @param text Text to truncate (need not be NUL-terminated)
+ * @param max_len Maximum length in bytes, marker included
+ * @param mode Which part to keep
+ * @return NUL-terminated copy of the kept text, or NULL on allocation failure
+ */
+char* agent_truncate_sv(agent_context_t* ctx, agent_string_view_t text, size_t max_len,
+                        agent_truncation_t mode);
+
 /**
  * @brief Format tool call for display
  * @param ctx Arena context
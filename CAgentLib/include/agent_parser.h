@@ -25,6 +25,102 @@ typedef enum {
     PARSER_STATE_TAG_CLOSE = 4
 } agent_parser_state_t;
 
+/**
+ * @brief Tag roles recognized in model output
+ *
+ * Each closing role is numbered one past its opening role. The spellings
+ * in comments are the defaults; a dialect may assign others.
+ */
+typedef enum {
+    AGENT_TAG_TOOL_CALL_OPEN = 0,      /* <tool_call> */
+    AGENT_TAG_TOOL_CALL_CLOSE = 1,     /* </tool_call> */
+    AGENT_TAG_THINK_OPEN = 2,          /* <think> */
+    AGENT_TAG_THINK_CLOSE = 3,         /* </think> */
+    AGENT_TAG_THINKING_OPEN = 4,       /* <thinking> */
+    AGENT_TAG_THINKING_CLOSE = 5,      /* </thinking> */
+    AGENT_TAG_TOOL_CALL_ALT_OPEN = 6,  /* Unused by default */
+    AGENT_TAG_TOOL_CALL_ALT_CLOSE = 7,
+    AGENT_TAG_COUNT = 8
+} agent_tag_t;
+
+/**
+ * @brief Maximum tag length in a dialect, in bytes
+ */
+#define AGENT_TAG_MAX_LENGTH 32
+
+/**
+ * @brief Tool call and thinking tag spellings used by a model family
+ *
+ * NULL leaves a role unused. A tool call without a closing tag ends where
+ * the JSON value after its opening tag balances; that value may be one
+ * call object or an array of them. A tag may not contain the first byte
+ * of any tag except at its own start.
+ */
+typedef struct {
+    const char* tool_call_open;      /* Required */
+    const char* tool_call_close;
+    const char* tool_call_alt_open;  /* Second spelling, e.g. the Hermes tags */
+    const char* tool_call_alt_close;
+    const char* think_open;
+    const char* think_close;
+    const char* think_alt_open;
+    const char* think_alt_close;
+} agent_parser_dialect_t;
+
+/**
+ * @brief Built-in dialects
+ *
+ * Models are prompted with the Hermes format, so every built-in also
+ * accepts <tool_call> as its alternate spelling.
+ */
+typedef enum {
+    AGENT_DIALECT_HERMES = 0,   /* <tool_call>...</tool_call> (Qwen, default) */
+    AGENT_DIALECT_LLAMA3 = 1,   /* <|python_tag|>{...} */
+    AGENT_DIALECT_PHI4 = 2,     /* <|tool_call|>[...]<|/tool_call|> */
+    AGENT_DIALECT_MISTRAL = 3,  /* [TOOL_CALLS][...] */
+    AGENT_DIALECT_GRANITE = 4   /* <|tool_call|>[...] */
+} agent_dialect_id_t;
+
+/**
+ * @brief A dialect compiled for scanning
+ *
+ * Self-contained, so it can be copied and embedded.
+ */
+typedef struct {
+    char text[AGENT_TAG_COUNT][AGENT_TAG_MAX_LENGTH];
+    size_t length[AGENT_TAG_COUNT];     /* 0 = role unused */
+    bool lead[256];                     /* Bytes that start some tag */
+    int lead_byte;                      /* The only such byte, or -1 */
+} agent_tag_set_t;
+
+/**
+ * @brief Get a built-in dialect
+ * @param id Dialect identifier
+ * @return Dialect descriptor, or NULL if unknown
+ */
+const agent_parser_dialect_t* agent_parser_dialect_builtin(agent_dialect_id_t id);
+
+/**
+ * @brief Compile a dialect into a tag set
+ * @param set Output tag set
+ * @param dialect Dialect (NULL = Hermes)
+ * @return AGENT_OK, or AGENT_ERROR_INVALID_ARGUMENT for an unusable dialect
+ */
+agent_error_t agent_tag_set_compile(agent_tag_set_t* set, const agent_parser_dialect_t* dialect);
+
+/**
+ * @brief How the streaming parser batches on_text calls
+ *
+ * Pending text is released at the end of a feed once min_bytes have
+ * accumulated or it has waited max_feeds feeds, and always before a
+ * thinking or tool call block. Released text ends on a complete UTF-8
+ * character; a trailing partial sequence waits for the next feed.
+ */
+typedef struct {
+    size_t min_bytes;                /* Release once this much is pending (0 = every feed) */
+    size_t max_feeds;                /* Release after this many feeds regardless (0 = no limit) */
+} agent_text_coalescing_t;
+
 /**
  * @brief Streaming parser context
  */
@@ -41,11 +137,24 @@ typedef struct {
     bool in_tool_call;
     bool in_think;
     int brace_depth;                 /* For JSON brace matching */
+    agent_tag_t close_tag;           /* Tag that ends the current block */
+    size_t close_matched;            /* Bytes of close_tag matched so far */
+    agent_json_incremental_t tool_json;  /* Tool call JSON scanned as it arrives */
+    size_t tool_field_count;
+    bool tool_name_reported;
+
+    /* Options */
+    bool dispatch_on_json_close;     /* Fire on_tool_call once the JSON object balances */
+    agent_tag_set_t tags;            /* Dialect, Hermes by default */
+    bool coalesce_text;              /* Batch on_text per text_coalescing */
+    agent_text_coalescing_t text_coalescing;
+    size_t text_held_feeds;          /* Feeds the pending text has waited */
 
     /* Callbacks */
     void* user_data;
     void (*on_text)(const char* text, size_t len, void* user_data);
     void (*on_tool_call)(const char* name, const agent_json_value_t* args, void* user_data);
+    void (*on_tool_call_start)(const char* name, void* user_data);  /* Name known, arguments pending */
     void (*on_thinking)(const char* text, size_t len, void* user_data);
 } agent_streaming_parser_t;
 
@@ -77,6 +186,11 @@ typedef struct {
  * - <think>...</think> or <thinking>...</thinking> tags
  * - Bare JSON tool calls (fallback)
  *
+ * The response is scanned once and segments are emitted in order. Text and
+ * thinking items are trimmed views into response, so it must outlive the
+ * result; copy them with agent_context_string_view_n() when needed. Only
+ * tool call JSON is copied into the arena and parsed.
+ *
  * @param ctx Arena context
  * @param response Full response string
  * @param length Response length
@@ -85,6 +199,17 @@ typedef struct {
 agent_parse_result_t agent_parser_parse(agent_context_t* ctx,
                                         const char* response, size_t length);
 
+/**
+ * @brief Parse a complete LLM response written in a given dialect
+ * @param ctx Arena context
+ * @param tags Compiled dialect
+ * @param response Full response string
+ * @param length Response length
+ * @return Parse result with array of parsed content
+ */
+agent_parse_result_t agent_parser_parse_tags(agent_context_t* ctx, const agent_tag_set_t* tags,
+                                             const char* response, size_t length);
+
 /**
  * @brief Parse a complete response (C string version)
  */
@@ -106,6 +231,111 @@ bool agent_parser_has_tool_call(const char* response, size_t length);
  */
 bool agent_parser_has_incomplete_tool_call(const char* response, size_t length);
 
+/** Most whitespace bytes allowed between '{' and "name" in a bare JSON tool call */
+#define AGENT_BARE_JSON_WINDOW 32
+
+/** No bare JSON candidate seen */
+#define AGENT_BARE_JSON_NONE ((size_t)-1)
+
+/**
+ * @brief Cheap check for a possible bare JSON tool call
+ *
+ * True if some '{' is followed, within AGENT_BARE_JSON_WINDOW whitespace
+ * bytes, by "name". Plain prose is rejected without brace matching.
+ *
+ * @param response Response string
+ * @param length Response length
+ * @return true if agent_parser_find_bare_json() could succeed
+ */
+bool agent_parser_may_have_bare_json(const char* response, size_t length);
+
+/**
+ * @brief Incremental <tool_call> tag tracker for streamed output
+ *
+ * Only the length of a possible partial tag is carried between chunks, so
+ * each fed byte is examined once.
+ */
+typedef struct {
+    const agent_tag_set_t* tags;  /* Dialect (NULL = Hermes); set after reset */
+    size_t open_matched;          /* Bytes of the tool call open tag matched so far */
+    size_t alt_open_matched;      /* Same, for the alternate spelling */
+    size_t close_matched;         /* Bytes of the active close tag matched so far */
+    agent_tag_t close_tag;
+    bool in_tool_call;
+
+    /* Bare JSON tool call candidates ('{', whitespace, "name") */
+    size_t bytes_seen;            /* Total bytes fed */
+    size_t bare_json_at;          /* Offset of the first candidate, or AGENT_BARE_JSON_NONE */
+    size_t bare_json_start;       /* Offset of the '{' being matched */
+    size_t bare_json_matched;     /* 0 = idle, 1 = after '{', then 1 + bytes of "name" */
+} agent_tool_tag_scanner_t;
+
+/**
+ * @brief Reset a tag scanner
+ * @param scanner Scanner to reset
+ */
+void agent_tool_tag_scanner_reset(agent_tool_tag_scanner_t* scanner);
+
+/**
+ * @brief Feed the next chunk of output
+ * @param scanner Scanner
+ * @param data Chunk data
+ * @param length Chunk length
+ * @return true if the output now ends inside an unclosed tool call
+ */
+bool agent_tool_tag_scanner_feed(agent_tool_tag_scanner_t* scanner,
+                                 const char* data, size_t length);
+
+/**
+ * @brief Check if a bare JSON tool call candidate has been fed
+ * @param scanner Scanner
+ * @return true once '{', whitespace and "name" have appeared in the output
+ */
+bool agent_tool_tag_scanner_has_bare_json(const agent_tool_tag_scanner_t* scanner);
+
+/**
+ * @brief Parse a response that was fed through a tag scanner
+ *
+ * Uses the scanner's dialect, and its record of the first bare JSON
+ * candidate so the fallback neither rescans text before it nor runs at
+ * all when there was none. The response must be the bytes fed to the
+ * scanner since its reset, possibly truncated.
+ *
+ * @param ctx Arena context
+ * @param scanner Scanner that saw the response
+ * @param response Full response string
+ * @param length Response length
+ * @return Parse result with array of parsed content
+ */
+agent_parse_result_t agent_parser_parse_scanned(agent_context_t* ctx,
+                                               const agent_tool_tag_scanner_t* scanner,
+                                               const char* response, size_t length);
+
+/**
+ * @brief One tag occurrence
+ */
+typedef struct {
+    agent_tag_t tag;
+    size_t offset;   /* Offset of the leading '<' */
+    size_t length;   /* Tag length in bytes */
+} agent_tag_match_t;
+
+/**
+ * @brief Find every known tag in a response in one pass
+ *
+ * Candidates are located with memchr on '<' and then matched against the
+ * whole tag set at once, so the buffer is read a single time regardless
+ * of how many tags are looked for.
+ *
+ * @param response Response string
+ * @param length Response length
+ * @param out_matches Output array (may be NULL when max_matches is 0)
+ * @param max_matches Capacity of out_matches
+ * @return Total number of tags found; only the first max_matches are stored
+ */
+size_t agent_parser_find_tags(const char* response, size_t length,
+                              agent_tag_match_t* out_matches, size_t max_matches);
+
 /**
  * @brief Extract text before first tool call
  * @param ctx Arena context
@@ -126,6 +356,39 @@ agent_string_view_t agent_parser_text_before_tool_call(agent_context_t* ctx,
 agent_string_view_t agent_parser_text_after_tool_call(agent_context_t* ctx,
                                                       const char* response, size_t length);
 
+/*
+ * Borrowing variants: results are views into response and stay valid only
+ * as long as the caller keeps that buffer alive and unchanged. Nothing is
+ * copied except where noted.
+ */
+
+/**
+ * @brief Text before the first tool call, as a trimmed view into response
+ */
+agent_string_view_t agent_parser_text_before_tool_call_borrow(const char* response, size_t length);
+
+/**
+ * @brief Text after the first </tool_call>, as a trimmed view into response
+ */
+agent_string_view_t agent_parser_text_after_tool_call_borrow(const char* response, size_t length);
+
+/**
+ * @brief Split thinking from content without copying
+ *
+ * Content is a view into response unless text remains on both sides of
+ * the thinking block; only then are the two parts stitched into ctx.
+ *
+ * @param ctx Arena context (used only for stitched content)
+ * @param response Response string
+ * @param length Response length
+ * @param out_thinking Output: thinking content (may be empty)
+ * @param out_content Output: content with thinking removed
+ */
+void agent_parser_extract_thinking_borrow(agent_context_t* ctx,
+                                          const char* response, size_t length,
+                                          agent_string_view_t* out_thinking,
+                                          agent_string_view_t* out_content);
+
 /**
  * @brief Parse thinking content from response
  * @param ctx Arena context
@@ -162,6 +425,28 @@ void agent_streaming_parser_free(agent_streaming_parser_t* parser);
  */
 void agent_streaming_parser_reset(agent_streaming_parser_t* parser);
 
+/**
+ * @brief Batch text callbacks
+ *
+ * Text is held in the parser's buffer instead of being passed straight
+ * from each token. Disabling releases anything still pending.
+ *
+ * @param parser Parser
+ * @param policy Coalescing policy (NULL = emit every run as it arrives)
+ * @return AGENT_OK or AGENT_ERROR_INVALID_ARGUMENT
+ */
+agent_error_t agent_streaming_parser_set_text_coalescing(agent_streaming_parser_t* parser,
+                                                         const agent_text_coalescing_t* policy);
+
+/**
+ * @brief Select the dialect the streaming parser recognizes
+ * @param parser Parser (must be between responses)
+ * @param dialect Dialect (NULL = Hermes)
+ * @return AGENT_OK, or AGENT_ERROR_INVALID_ARGUMENT for an unusable dialect
+ */
+agent_error_t agent_streaming_parser_set_dialect(agent_streaming_parser_t* parser,
+                                                 const agent_parser_dialect_t* dialect);
+
 /**
  * @brief Feed tokens to streaming parser
  * @param parser Parser
@@ -201,6 +486,20 @@ bool agent_streaming_parser_in_tool_call(const agent_streaming_parser_t* parser)
 agent_parsed_tool_call_t* agent_parser_parse_tool_call_json(agent_context_t* ctx,
                                                             const char* json, size_t length);
 
+/**
+ * @brief Parse JSON tool call destructively in place
+ *
+ * Like agent_parser_parse_tool_call_json(), but strings are decoded inside
+ * json (see agent_json_parse_insitu()) and raw_json is left empty.
+ *
+ * @param ctx Arena context
+ * @param json Mutable JSON text, overwritten and referenced by the result
+ * @param length JSON length
+ * @return Parsed tool call or NULL on error
+ */
+agent_parsed_tool_call_t* agent_parser_parse_tool_call_json_insitu(agent_context_t* ctx,
+                                                                   char* json, size_t length);
+
 /**
  * @brief Find bare JSON tool call in response
  *
@@ -218,6 +517,16 @@ agent_parsed_tool_call_t* agent_parser_find_bare_json(agent_context_t* ctx,
                                                       agent_string_view_t* out_before,
                                                       agent_string_view_t* out_after);
 
+/**
+ * @brief Find bare JSON tool call, with before/after as views into response
+ *
+ * The tool call itself is parsed into ctx as with agent_parser_find_bare_json().
+ */
+agent_parsed_tool_call_t* agent_parser_find_bare_json_borrow(agent_context_t* ctx,
+                                                             const char* response, size_t length,
+                                                             agent_string_view_t* out_before,
+                                                             agent_string_view_t* out_after);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,91 @@
+/**
+ * @file agent_recall.h
+ * @brief Incremental BM25 index over conversation messages
+ *
+ * Documents are added in order and numbered from 0. Terms are runs of
+ * ASCII letters and digits, lowercased, plus overlapping pairs of
+ * characters in runs of other scripts, so Japanese text matches without a
+ * word segmenter. Terms are kept as 64-bit hashes. The index lives on the
+ * heap (agent_mem_*) and grows with each document.
+ */
+
+#ifndef AGENT_RECALL_H
+#define AGENT_RECALL_H
+
+#include "agent_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief One document's occurrences of a term
+ */
+typedef struct {
+    uint32_t doc;
+    uint32_t tf;
+} agent_recall_posting_t;
+
+/**
+ * @brief A term and the documents it occurs in (in document order)
+ */
+typedef struct {
+    uint64_t hash;                      /* 0 = empty slot */
+    agent_recall_posting_t* postings;   /* Heap */
+    uint32_t count;                     /* Documents containing the term */
+    uint32_t capacity;
+} agent_recall_term_t;
+
+/**
+ * @brief Inverted index; zero-initialized is an empty index
+ */
+typedef struct {
+    agent_recall_term_t* terms;         /* Open addressing, power-of-two capacity */
+    size_t term_count;
+    size_t term_capacity;
+    uint32_t* doc_lengths;              /* Terms per document */
+    size_t doc_count;
+    size_t doc_capacity;
+    uint64_t total_length;
+} agent_recall_index_t;
+
+/**
+ * @brief Release everything the index holds; it is empty afterwards
+ * @param index Index
+ */
+void agent_recall_free(agent_recall_index_t* index);
+
+/**
+ * @brief Append a document
+ * @param index Index
+ * @param text Document text (UTF-8)
+ * @return AGENT_OK, or AGENT_ERROR_OUT_OF_MEMORY (the document is then not added)
+ */
+agent_error_t agent_recall_add(agent_recall_index_t* index, agent_string_view_t text);
+
+/**
+ * @brief BM25 score of every document for a query
+ * @param index Index
+ * @param query Query text (UTF-8)
+ * @param out_scores Output: one score per document (index->doc_count), 0 for no match
+ * @return AGENT_OK, or AGENT_ERROR_OUT_OF_MEMORY
+ */
+agent_error_t agent_recall_score(const agent_recall_index_t* index, agent_string_view_t query,
+                                 float* out_scores);
+
+/**
+ * @brief The documents that best match a query
+ * @param index Index
+ * @param query Query text (UTF-8)
+ * @param k Most documents to return
+ * @param out_docs Output: document numbers, best first (ties in document order); room for k
+ * @return Number of matching documents returned (at most k)
+ */
+size_t agent_recall_search(const agent_recall_index_t* index, agent_string_view_t query,
+                           size_t k, size_t* out_docs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AGENT_RECALL_H */
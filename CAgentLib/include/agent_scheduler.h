@@ -0,0 +1,153 @@
+/**
+ * @file agent_scheduler.h
+ * @brief Several agent sessions sharing one model through batched decoding
+ *
+ * Each session is an agent_state_t driven through the step API
+ * (agent_run_begin() ... agent_run_end()). Every agent_scheduler_step()
+ * gathers the sessions that need a generation and advances them together
+ * with one call to the backend's batch decode, so a session waiting on a
+ * tool never holds up the others.
+ */
+
+#ifndef AGENT_SCHEDULER_H
+#define AGENT_SCHEDULER_H
+
+#include "agent_orchestrator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Default number of sequences decoded per step
+ */
+#define AGENT_SCHEDULER_MAX_BATCH 8
+
+/**
+ * @brief One sequence in a decode batch
+ */
+typedef struct {
+    size_t session;                    /* Index from agent_scheduler_add() */
+    bool prefill;                      /* First step of this generation: read the prompt */
+
+    /* Prompt, valid while the sequence is open */
+    const agent_message_t* messages;
+    size_t message_count;
+    const char* system_prompt;
+    agent_generation_info_t generation;
+    bool route;                        /* For the router model (agent_config_t.route_generate) */
+} agent_sequence_t;
+
+/**
+ * @brief What one decode step produced for a sequence
+ */
+typedef struct {
+    agent_error_t error;
+    const char* text;                  /* Token text; may be empty while prefilling */
+    size_t length;
+    bool finished;                     /* End of generation */
+} agent_decoded_token_t;
+
+/**
+ * @brief Batch decode callback - advance every sequence by one token
+ * @param sequences Sequences to decode, in no particular order
+ * @param count Number of sequences
+ * @param out One result per sequence, same order (zeroed on entry)
+ * @param user_data User-provided context
+ */
+typedef void (*agent_batch_decode_callback_t)(
+    const agent_sequence_t* sequences,
+    size_t count,
+    agent_decoded_token_t* out,
+    void* user_data
+);
+
+/**
+ * @brief Sequence end callback - the backend can free the session's slot
+ * @param session Index from agent_scheduler_add()
+ * @param user_data User-provided context
+ */
+typedef void (*agent_sequence_end_callback_t)(size_t session, void* user_data);
+
+/**
+ * @brief Scheduler configuration
+ */
+typedef struct {
+    agent_batch_decode_callback_t decode;        /* Required */
+    agent_sequence_end_callback_t end_sequence;  /* Optional */
+    void* user_data;
+    size_t max_batch;                            /* 0 = use default (8) */
+} agent_scheduler_config_t;
+
+/**
+ * @brief Scheduled session
+ */
+typedef struct {
+    agent_state_t* state;              /* NULL once removed */
+    bool decoding;                     /* A sequence is open in the backend */
+} agent_session_t;
+
+/**
+ * @brief Scheduler
+ */
+typedef struct {
+    agent_scheduler_config_t config;
+    agent_session_t* sessions;         /* Heap */
+    size_t session_count;
+    size_t session_capacity;
+    size_t next;                       /* Round-robin start when over max_batch */
+
+    /* Per-step scratch (heap, max_batch entries) */
+    agent_sequence_t* batch;
+    agent_decoded_token_t* tokens;
+} agent_scheduler_t;
+
+/**
+ * @brief Initialize a scheduler
+ * @param scheduler Scheduler to initialize
+ * @param config Configuration (copied)
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_scheduler_init(agent_scheduler_t* scheduler, const agent_scheduler_config_t* config);
+
+/**
+ * @brief Free a scheduler; the sessions' states are not touched
+ * @param scheduler Scheduler
+ */
+void agent_scheduler_free(agent_scheduler_t* scheduler);
+
+/**
+ * @brief Add a session
+ * @param scheduler Scheduler
+ * @param state Initialized agent state, owned by the caller
+ * @param out_session Index identifying the session in sequences
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_scheduler_add(agent_scheduler_t* scheduler, agent_state_t* state,
+                                  size_t* out_session);
+
+/**
+ * @brief Remove a session, ending its open sequence if any
+ * @param scheduler Scheduler
+ * @param session Index from agent_scheduler_add()
+ */
+void agent_scheduler_remove(agent_scheduler_t* scheduler, size_t session);
+
+/**
+ * @brief Decode one token for up to max_batch generating sessions
+ *
+ * Sessions with a finished generation are handed to
+ * agent_run_submit_generation(). Sessions waiting for tool results are
+ * skipped; answer them with agent_run_submit_tool_result() at any time,
+ * and collect finished runs with agent_run_end().
+ *
+ * @param scheduler Scheduler
+ * @return Number of sessions that decoded this step (0 = nothing to do)
+ */
+size_t agent_scheduler_step(agent_scheduler_t* scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AGENT_SCHEDULER_H */
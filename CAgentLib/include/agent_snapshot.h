@@ -0,0 +1,58 @@
+/**
+ * @file agent_snapshot.h
+ * @brief Binary snapshot and restore of an agent's conversation
+ *
+ * A snapshot is a header, fixed-size records for messages, tool calls and
+ * tool results, then every string NUL-terminated in one byte area. Records
+ * refer to strings by offset from the start of the snapshot, so a restored
+ * conversation points straight into the (typically mmapped) snapshot.
+ * Records use the host's byte order: snapshots are meant for the device
+ * that wrote them.
+ */
+
+#ifndef AGENT_SNAPSHOT_H
+#define AGENT_SNAPSHOT_H
+
+#include "agent_orchestrator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Snapshot format version
+ */
+#define AGENT_SNAPSHOT_VERSION 1
+
+/**
+ * @brief Serialize the conversation (messages and conversation id)
+ *
+ * Nothing from a run in progress is included.
+ *
+ * @param state Agent state
+ * @param out Output string (must be initialized); the snapshot is appended
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_state_save(const agent_state_t* state, agent_string_t* out);
+
+/**
+ * @brief Replace the conversation with a snapshot
+ *
+ * Content, thinking, tool names, results and images become views into
+ * data, which must stay mapped until the next agent_state_load,
+ * agent_reset or agent_free. Tool call arguments are parsed into the
+ * history arena. Fails without touching the state if data is malformed.
+ *
+ * @param state Initialized agent state with no run in progress
+ * @param data Snapshot bytes
+ * @param length Snapshot length
+ * @return AGENT_OK, AGENT_ERROR_PARSE_ERROR for a malformed or foreign
+ *         snapshot, or AGENT_ERROR_OUT_OF_MEMORY
+ */
+agent_error_t agent_state_load(agent_state_t* state, const void* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AGENT_SNAPSHOT_H */
@@ -78,6 +78,10 @@ bool agent_sv_ends_with(agent_string_view_t sv, agent_string_view_t suffix);
 
 /**
  * @brief Find first occurrence of substring
+ *
+ * Linear in sv.length for any input: short needles are filtered on their
+ * first and last byte (SIMD where available), long ones use Two-Way.
+ *
  * @param sv String view to search in
  * @param needle Substring to find
  * @return Index of first occurrence, or -1 if not found
@@ -92,6 +96,17 @@ ptrdiff_t agent_sv_find(agent_string_view_t sv, agent_string_view_t needle);
  */
 ptrdiff_t agent_sv_find_cstr(agent_string_view_t sv, const char* needle);
 
+/**
+ * @brief Find the first occurrence of any of several substrings
+ * @param sv String view to search in
+ * @param needles Substrings to find
+ * @param count Number of needles
+ * @param out_index Set to the needle found (the earliest in needles on a tie); may be NULL
+ * @return Index of the first occurrence, or -1 if none is found
+ */
+ptrdiff_t agent_sv_find_any(agent_string_view_t sv, const agent_string_view_t* needles,
+                            size_t count, size_t* out_index);
+
 /**
  * @brief Find first occurrence of character
  * @param sv String view to search in
@@ -149,6 +164,11 @@ size_t agent_utf8_char_length(uint8_t first_byte);
 
 /**
  * @brief Count UTF-8 characters in string
+ *
+ * Counts the bytes that start a character, leaving out a character cut
+ * short at the end. In malformed text, stray continuation bytes are not
+ * counted and other invalid bytes count as one character each.
+ *
  * @param data String data
  * @param length Length in bytes
  * @return Number of UTF-8 characters
@@ -186,6 +206,8 @@ size_t agent_utf8_extract_char(const char* buffer, size_t length,
  *
  * Returns the number of bytes that form complete UTF-8 characters.
  * Useful for streaming when you need to output only complete characters.
+ * Only the last character can be incomplete, so only the last 4 bytes
+ * are examined.
  *
  * @param data Buffer data
  * @param length Buffer length
@@ -198,14 +220,29 @@ size_t agent_utf8_complete_boundary(const char* data, size_t length);
 /**
  * @brief Initialize a mutable string
  * @param str String to initialize
- * @param initial_capacity Initial capacity (0 for default: 64)
+ * @param initial_capacity Initial capacity; up to AGENT_STRING_INLINE_CAPACITY
+ *        (and 0) use the inline buffer without allocating
  * @return AGENT_OK on success
  */
 agent_error_t agent_string_init(agent_string_t* str, size_t initial_capacity);
 
+/**
+ * @brief Initialize a mutable string that grows inside an arena
+ * @param str String to initialize
+ * @param ctx Arena context for the buffer
+ * @param initial_capacity Initial capacity (0 for default: 64)
+ * @return AGENT_OK on success
+ *
+ * The buffer lives until the arena is reset, so agent_string_view() of the
+ * final contents can be kept without copying. Growth extends the buffer in
+ * place while it is the arena's newest allocation.
+ */
+agent_error_t agent_string_init_arena(agent_string_t* str, agent_context_t* ctx,
+                                      size_t initial_capacity);
+
 /**
  * @brief Free a mutable string
- * @param str String to free
+ * @param str String to free (arena-backed buffers are only detached)
  */
 void agent_string_free(agent_string_t* str);
 
@@ -257,6 +294,43 @@ agent_error_t agent_string_append_char(agent_string_t* str, char c);
  */
 agent_error_t agent_string_append_fmt(agent_string_t* str, const char* fmt, ...);
 
+/**
+ * @brief Append an unsigned integer in decimal
+ * @param str Mutable string
+ * @param value Value
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_string_append_u64(agent_string_t* str, uint64_t value);
+
+/**
+ * @brief Append a signed integer in decimal
+ * @param str Mutable string
+ * @param value Value
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_string_append_i64(agent_string_t* str, int64_t value);
+
+/**
+ * @brief Append an unsigned integer in lowercase hex
+ * @param str Mutable string
+ * @param value Value
+ * @param min_digits Zero-pad to at least this many digits (at most 16)
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_string_append_hex(agent_string_t* str, uint64_t value, size_t min_digits);
+
+/**
+ * @brief Append text escaped for a JSON string body (no quotes added)
+ *
+ * '"', '\\' and control characters are escaped; everything else,
+ * including UTF-8, is copied as-is.
+ *
+ * @param str Mutable string
+ * @param sv Text
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_string_append_sv_escaped(agent_string_t* str, agent_string_view_t sv);
+
 /**
  * @brief Reserve capacity
  * @param str String
@@ -279,6 +353,105 @@ agent_string_view_t agent_string_view(const agent_string_t* str);
  */
 const char* agent_string_cstr(const agent_string_t* str);
 
+/* Templates */
+
+/**
+ * @brief Most literal and slot parts in a compiled template
+ */
+#define AGENT_TEMPLATE_MAX_PARTS 16
+
+/**
+ * @brief printf-style template split once into literals and %s slots
+ */
+typedef struct {
+    agent_string_view_t parts[AGENT_TEMPLATE_MAX_PARTS];   /* data NULL = next value */
+    size_t part_count;
+    size_t slot_count;
+} agent_template_t;
+
+/**
+ * @brief Compile a template
+ *
+ * Only %s and %% are understood. Literal parts point into text, which
+ * must outlive the template (typically a string literal).
+ *
+ * @param tpl Template to fill in
+ * @param text Template text
+ * @return AGENT_OK, or AGENT_ERROR_INVALID_ARGUMENT for another conversion
+ *         or more than AGENT_TEMPLATE_MAX_PARTS parts
+ */
+agent_error_t agent_template_compile(agent_template_t* tpl, const char* text);
+
+/**
+ * @brief Append a template with its slots filled in order
+ * @param str Mutable string
+ * @param tpl Compiled template
+ * @param values One value per slot
+ * @param count Number of values (must equal tpl->slot_count)
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_string_append_template(agent_string_t* str, const agent_template_t* tpl,
+                                           const agent_string_view_t* values, size_t count);
+
+/* Rope operations */
+
+/**
+ * @brief Initialize an empty rope; no chunk is allocated until the first append
+ * @param rope Rope to initialize
+ * @param ctx Arena for chunks, or NULL for the system heap
+ * @param chunk_size Bytes per chunk (0 for default: AGENT_ROPE_CHUNK_SIZE)
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_rope_init(agent_rope_t* rope, agent_context_t* ctx, size_t chunk_size);
+
+/**
+ * @brief Free a rope's heap chunks (arena chunks go with the arena)
+ * @param rope Rope
+ */
+void agent_rope_free(agent_rope_t* rope);
+
+/**
+ * @brief Empty a rope, keeping its chunks for reuse
+ * @param rope Rope
+ */
+void agent_rope_clear(agent_rope_t* rope);
+
+/**
+ * @brief Append bytes, filling the last chunk and adding chunks as needed
+ *
+ * Data may be split across chunks anywhere, including inside a UTF-8
+ * character.
+ *
+ * @param rope Rope
+ * @param data Bytes to append
+ * @param length Number of bytes
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_rope_append(agent_rope_t* rope, const char* data, size_t length);
+
+/**
+ * @brief Start iterating over a rope's chunks
+ * @param rope Rope
+ * @return Iterator before the first chunk
+ */
+agent_rope_iter_t agent_rope_iter(const agent_rope_t* rope);
+
+/**
+ * @brief Next non-empty chunk
+ * @param iter Iterator
+ * @param out_chunk Output: chunk contents (not NUL-terminated)
+ * @return false once every chunk has been returned
+ */
+bool agent_rope_iter_next(agent_rope_iter_t* iter, agent_string_view_t* out_chunk);
+
+/**
+ * @brief Append the rope's contents to a string
+ * @param rope Rope
+ * @param out String (must be initialized)
+ * @return AGENT_OK on success
+ */
+agent_error_t agent_rope_flatten(const agent_rope_t* rope, agent_string_t* out);
+
 /* UUID operations */
 
 /**
@@ -287,6 +460,16 @@ const char* agent_string_cstr(const agent_string_t* str);
  */
 agent_uuid_t agent_uuid_generate(void);
 
+/**
+ * @brief Generate a time-ordered UUID (version 7)
+ *
+ * 48-bit Unix milliseconds, then a 12-bit sequence, then random bits.
+ * Ids from one thread compare (as bytes) in the order they were made.
+ *
+ * @return New UUID
+ */
+agent_uuid_t agent_uuid_generate_ordered(void);
+
 /**
  * @brief Create UUID from string (36 chars: xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx)
  * @param str UUID string
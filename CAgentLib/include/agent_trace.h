@@ -0,0 +1,51 @@
+/**
+ * @file agent_trace.h
+ * @brief Compile-time tracing hooks for the library's hot paths
+ *
+ * AGENT_TRACE_BEGIN(name) and AGENT_TRACE_END(name) bracket an interval
+ * named by the identifier name; both must sit in the same block. They
+ * expand to nothing unless AGENT_TRACE is defined (the CMake option of
+ * the same name, or -DAGENT_TRACE=1 in the Xcode target). On Apple
+ * platforms they then emit os_signpost intervals in the Points of
+ * Interest category, so library time lines up with ggml and Metal
+ * activity in one Instruments timeline. Elsewhere they stay empty.
+ */
+
+#ifndef AGENT_TRACE_H
+#define AGENT_TRACE_H
+
+#if defined(AGENT_TRACE) && defined(__APPLE__)
+
+#include <os/log.h>
+#include <os/signpost.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Log handle the intervals are emitted on, created once
+ */
+os_log_t agent_trace_log(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define AGENT_TRACE_ENABLED 1
+
+#define AGENT_TRACE_BEGIN(name)                                                          \
+    os_signpost_id_t agent_trace_id_##name = os_signpost_id_generate(agent_trace_log()); \
+    os_signpost_interval_begin(agent_trace_log(), agent_trace_id_##name, #name, "")
+
+#define AGENT_TRACE_END(name) \
+    os_signpost_interval_end(agent_trace_log(), agent_trace_id_##name, #name, "")
+
+#else
+
+#define AGENT_TRACE_BEGIN(name) ((void)0)
+#define AGENT_TRACE_END(name) ((void)0)
+
+#endif
+
+#endif /* AGENT_TRACE_H */
@@ -9,6 +9,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,15 +27,61 @@ typedef struct {
     size_t length;
 } agent_string_view_t;
 
+/**
+ * @brief Capacity of a heap string's inline buffer
+ */
+#define AGENT_STRING_INLINE_CAPACITY 32
+
 /**
  * @brief Mutable string buffer
+ *
+ * Heap strings start in inline_data and move to the heap once they
+ * outgrow it, so data may point into the struct itself: don't copy an
+ * initialized string by value.
  */
 typedef struct {
     char* data;
     size_t length;
     size_t capacity;
+    agent_context_t* ctx;  /* Arena the buffer grows in (NULL = system heap) */
+    char inline_data[AGENT_STRING_INLINE_CAPACITY];
 } agent_string_t;
 
+/**
+ * @brief Default rope chunk size
+ */
+#define AGENT_ROPE_CHUNK_SIZE 4096
+
+/**
+ * @brief Fixed-size chunk of a rope
+ */
+typedef struct agent_rope_chunk_t {
+    struct agent_rope_chunk_t* next;
+    char* data;                        /* Follows the header in the same allocation */
+    size_t length;
+} agent_rope_chunk_t;
+
+/**
+ * @brief Append-only text in fixed-size chunks
+ *
+ * Appending never moves what is already there; read it chunk by chunk
+ * with agent_rope_iter_next() or copy it out with agent_rope_flatten().
+ */
+typedef struct {
+    agent_rope_chunk_t* head;
+    agent_rope_chunk_t* tail;          /* Chunk being filled */
+    size_t length;                     /* Total bytes */
+    size_t chunk_size;
+    agent_context_t* ctx;              /* Arena chunks come from (NULL = system heap) */
+} agent_rope_t;
+
+/**
+ * @brief Position in a rope, from agent_rope_iter()
+ */
+typedef struct {
+    const agent_rope_chunk_t* chunk;
+} agent_rope_iter_t;
+
 /**
  * @brief UUID representation (128-bit)
  */
@@ -100,16 +147,28 @@ typedef struct {
 
     agent_string_view_t thinking_content;
 
-    /* Image data (JPEG) */
+    /* Image data: encoded (JPEG) bytes, or with image_width set the RGB8
+       pixels image_preprocess decoded them to */
     const uint8_t* image_data;
     size_t image_data_size;
+    uint32_t image_width;
+    uint32_t image_height;
+
+    /* Cached by the orchestrator's context window (0 = not counted yet) */
+    size_t token_count;
 } agent_message_t;
 
 /**
  * @brief Message array
+ *
+ * roles mirrors messages[i].role one byte per message, so scans that only
+ * look for a role (the latest user or assistant message) don't pull whole
+ * messages through the cache. Both live in one allocation, roles starting
+ * at messages + capacity, so growing the array is a single realloc.
  */
 typedef struct {
     agent_message_t* messages;
+    uint8_t* roles;
     size_t count;
     size_t capacity;
 } agent_message_array_t;
@@ -191,6 +250,13 @@ typedef struct {
  */
 typedef bool (*agent_token_callback_t)(const char* token, size_t len, void* user_data);
 
+/**
+ * @brief Discard callback - text already streamed is void and comes again
+ * @param length Bytes of streamed text to take back, counted from the end
+ * @param user_data User-provided context
+ */
+typedef void (*agent_discard_callback_t)(size_t length, void* user_data);
+
 /**
  * @brief Tool call notification callback
  * @param tool_name The name of the tool being called
@@ -206,6 +272,44 @@ typedef void (*agent_tool_call_notify_t)(const char* tool_name, void* user_data)
  */
 typedef void (*agent_step_callback_t)(agent_step_t step, const char* tool_name, void* user_data);
 
+/**
+ * @brief Kind of coalesced event
+ */
+typedef enum {
+    AGENT_EVENT_TOKENS = 0,        /* Consecutive tokens, concatenated */
+    AGENT_EVENT_STEP,              /* Step change */
+    AGENT_EVENT_TOOL_CALL,         /* A tool is about to run */
+    AGENT_EVENT_DISCARD            /* Streamed text is void and comes again */
+} agent_event_type_t;
+
+/**
+ * @brief One coalesced event
+ */
+typedef struct {
+    agent_event_type_t type;
+    agent_step_t step;             /* STEP only */
+    agent_string_view_t text;      /* Token text, or the tool name (may be empty) */
+    size_t token_count;            /* TOKENS only: how many tokens text joins */
+    size_t discard_length;         /* DISCARD only: bytes of streamed text to take back */
+} agent_event_t;
+
+/**
+ * @brief Batched event callback - replaces on_token, on_step_change and on_tool_call
+ * @param events Events in the order they happened; valid during the call only
+ * @param count Number of events
+ * @param user_data User-provided context
+ * @return true to continue, false to stop generation
+ */
+typedef bool (*agent_events_callback_t)(const agent_event_t* events, size_t count, void* user_data);
+
+/**
+ * @brief Memory pressure callback - called when an arena crosses its soft limit
+ * @param footprint Bytes the arena currently holds from the system allocator
+ * @param soft_limit The soft limit that was crossed
+ * @param user_data User-provided context
+ */
+typedef void (*agent_memory_pressure_callback_t)(size_t footprint, size_t soft_limit, void* user_data);
+
 /**
  * @brief LLM generation result
  */
@@ -231,6 +335,53 @@ typedef agent_llm_result_t (*agent_llm_generate_callback_t)(
     void* user_data
 );
 
+/**
+ * @brief Cancellation token for a run
+ *
+ * Set by agent_stop() from any thread, or by the run's deadline passing.
+ * Long-running callbacks should poll agent_cancel_requested() and return
+ * early (AGENT_ERROR_CANCELLED) once it is true.
+ */
+typedef struct {
+    atomic_bool cancelled;
+    _Atomic int64_t deadline_ms;       /* Monotonic clock; 0 = no deadline */
+} agent_cancel_token_t;
+
+/**
+ * @brief What the previous generation already sent, for KV cache reuse
+ *
+ * The first stable_prefix_count messages are the same messages, in the
+ * same order and under the same system prompt, as in the previous call
+ * for this conversation_id. 0 means the whole prompt must be prefilled.
+ */
+typedef struct {
+    agent_uuid_t conversation_id;
+    size_t stable_prefix_count;
+    const agent_cancel_token_t* cancel;    /* Poll while decoding */
+
+    /* GBNF for tool calls, to apply once "<tool_call>" appears (NULL = none) */
+    const char* grammar;
+} agent_generation_info_t;
+
+/**
+ * @brief LLM generation callback with a stable-prefix hint
+ * @param messages Array of messages
+ * @param message_count Number of messages
+ * @param system_prompt System prompt (may be NULL)
+ * @param info Conversation id and how many leading messages are unchanged
+ * @param token_callback Callback for streaming tokens
+ * @param user_data User-provided context
+ * @return Generation result
+ */
+typedef agent_llm_result_t (*agent_llm_generate_prefix_callback_t)(
+    const agent_message_t* messages,
+    size_t message_count,
+    const char* system_prompt,
+    const agent_generation_info_t* info,
+    agent_token_callback_t token_callback,
+    void* user_data
+);
+
 /**
  * @brief Tool execution result
  */
@@ -253,6 +404,71 @@ typedef agent_tool_execute_result_t (*agent_tool_execute_callback_t)(
     void* user_data
 );
 
+/**
+ * @brief What a tool is given besides its arguments
+ *
+ * Results longer than the limits are cut by the orchestrator, so a tool
+ * that can stop early (reading a file, listing a directory) should not
+ * produce more than max_result_len bytes.
+ *
+ * Instead of returning content, a tool may append its result to output
+ * and leave content NULL; the bytes are then used where they are, with
+ * no further copy. output has room for max_result_len bytes up front.
+ */
+typedef struct {
+    const agent_cancel_token_t* cancel;  /* The run's token; poll while working */
+    size_t max_result_len;               /* Bytes kept of the result */
+    size_t max_result_tokens;            /* Tokens kept of the result (0 = no token limit) */
+    agent_string_t* output;              /* Arena-backed result sink */
+} agent_tool_invocation_t;
+
+/**
+ * @brief Tool execution callback that can be cancelled
+ * @param tool_name Full tool name (e.g., "filesystem.read_file")
+ * @param arguments JSON arguments
+ * @param invocation Cancellation token and result limits for this call
+ * @param user_data User-provided context
+ * @return Execution result
+ */
+typedef agent_tool_execute_result_t (*agent_tool_execute_cancellable_callback_t)(
+    const char* tool_name,
+    const agent_json_value_t* arguments,
+    const agent_tool_invocation_t* invocation,
+    void* user_data
+);
+
+/**
+ * @brief Batch tool execution callback
+ *
+ * Runs count independent tool calls, concurrently if the host can, and
+ * returns once every one has finished. results[i] answers tool_names[i].
+ *
+ * @param tool_names Full tool names
+ * @param arguments JSON arguments, one per call
+ * @param count Number of calls
+ * @param results Output: one result per call
+ * @param user_data User-provided context
+ */
+typedef void (*agent_tool_execute_batch_callback_t)(
+    const char* const* tool_names,
+    const agent_json_value_t* const* arguments,
+    size_t count,
+    agent_tool_execute_result_t* results,
+    void* user_data
+);
+
+/**
+ * @brief Speculative tool callback - a tool call seen before generation ended
+ * @param tool_name Full tool name
+ * @param arguments JSON arguments
+ * @param user_data User-provided context
+ */
+typedef void (*agent_tool_speculate_callback_t)(
+    const char* tool_name,
+    const agent_json_value_t* arguments,
+    void* user_data
+);
+
 /**
  * @brief Tools schema callback (returns JSON schema string)
  * @param user_data User-provided context
@@ -260,6 +476,36 @@ typedef agent_tool_execute_result_t (*agent_tool_execute_callback_t)(
  */
 typedef const char* (*agent_tools_schema_callback_t)(void* user_data);
 
+/**
+ * @brief Decoded image: RGB8 pixels, rows without padding
+ */
+typedef struct {
+    const uint8_t* pixels;   /* width * height * 3 bytes */
+    uint32_t width;
+    uint32_t height;
+} agent_image_t;
+
+/**
+ * @brief Image preprocess callback - decodes an image once, at the model's input size
+ * @param data Encoded image (JPEG)
+ * @param size Encoded size
+ * @param max_side Neither side of out may be longer, in pixels
+ * @param out Decoded pixels; must stay valid until the callback's caller returns
+ * @param user_data User data
+ * @return false to keep the encoded bytes
+ */
+typedef bool (*agent_image_preprocess_callback_t)(const uint8_t* data, size_t size, uint32_t max_side,
+                                                  agent_image_t* out, void* user_data);
+
+/**
+ * @brief Token count callback - measures text with the model's tokenizer
+ * @param text Text to measure (UTF-8, not NUL-terminated)
+ * @param len Text length in bytes
+ * @param user_data User-provided context
+ * @return Number of tokens
+ */
+typedef size_t (*agent_token_count_callback_t)(const char* text, size_t len, void* user_data);
+
 #ifdef __cplusplus
 }
 #endif
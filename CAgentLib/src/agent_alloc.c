@@ -0,0 +1,83 @@
+/**
+ * @file agent_alloc.c
+ * @brief Pluggable system allocator implementation
+ */
+
+#include "agent_alloc.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void* system_alloc(size_t size, void* user_data) {
+    (void)user_data;
+    return malloc(size);
+}
+
+static void* system_realloc(void* ptr, size_t size, void* user_data) {
+    (void)user_data;
+    return realloc(ptr, size);
+}
+
+static void system_free(void* ptr, void* user_data) {
+    (void)user_data;
+    free(ptr);
+}
+
+static const agent_allocator_t g_system_allocator = {
+    system_alloc,
+    system_realloc,
+    system_free,
+    NULL
+};
+
+static agent_allocator_t g_allocator = {
+    system_alloc,
+    system_realloc,
+    system_free,
+    NULL
+};
+
+agent_error_t agent_set_allocator(const agent_allocator_t* allocator) {
+    if (!allocator) {
+        g_allocator = g_system_allocator;
+        return AGENT_OK;
+    }
+
+    if (!allocator->alloc || !allocator->realloc || !allocator->free) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    g_allocator = *allocator;
+    return AGENT_OK;
+}
+
+const agent_allocator_t* agent_get_allocator(void) {
+    return &g_allocator;
+}
+
+void* agent_mem_alloc(size_t size) {
+    return g_allocator.alloc(size, g_allocator.user_data);
+}
+
+void* agent_mem_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    size_t total = count * size;
+    void* ptr = g_allocator.alloc(total, g_allocator.user_data);
+    if (ptr) {
+        memset(ptr, 0, total);
+    }
+    return ptr;
+}
+
+void* agent_mem_realloc(void* ptr, size_t size) {
+    return g_allocator.realloc(ptr, size, g_allocator.user_data);
+}
+
+void agent_mem_free(void* ptr) {
+    if (ptr) {
+        g_allocator.free(ptr, g_allocator.user_data);
+    }
+}
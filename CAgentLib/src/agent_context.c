@@ -4,11 +4,22 @@
  */
 
 #include "agent_context.h"
+#include "agent_alloc.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define AGENT_CONTEXT_HAS_MMAP 1
+#endif
+
 #define DEFAULT_ARENA_SIZE (64 * 1024)  /* 64KB */
+#define DEFAULT_RETAIN_LIMIT (4 * DEFAULT_ARENA_SIZE)  /* 256KB */
 #define ALIGNMENT 8
+#define COMMIT_GRANULARITY (64 * 1024)  /* Reserved arenas commit in 64KB steps */
+#define INTERN_INITIAL_CAPACITY 64
 
 /**
  * @brief Arena block structure
@@ -20,6 +31,15 @@ typedef struct arena_block_t {
     char data[];  /* Flexible array member */
 } arena_block_t;
 
+/**
+ * @brief Interned string slot (data == NULL = empty)
+ */
+typedef struct {
+    const char* data;
+    uint32_t length;
+    uint32_t hash;
+} intern_slot_t;
+
 /**
  * @brief Agent context with arena allocator
  */
@@ -28,6 +48,40 @@ struct agent_context_t {
     arena_block_t* current_block;
     size_t default_block_size;
     size_t total_allocated;
+
+    /* Blocks retired by agent_context_reset, kept for reuse */
+    arena_block_t* free_list;
+    size_t retained_bytes;
+    size_t retain_limit;
+
+    /* Instrumentation (see agent_context_stats) */
+    size_t used_bytes;
+    size_t peak_bytes;
+    size_t block_count;
+    size_t allocation_count;
+    size_t padding_bytes;
+    size_t histogram[AGENT_CONTEXT_STATS_BUCKETS];
+
+    /* Memory budget (0 = unlimited) */
+    size_t soft_limit;
+    size_t hard_limit;
+    bool over_soft_limit;
+    agent_memory_pressure_callback_t on_pressure;
+    void* pressure_user_data;
+
+    /* Reserved backend: first_block heads a virtual range of reserved_size
+       bytes, of which committed bytes (header included) are accessible */
+    bool reserved;
+    size_t reserved_size;
+    size_t committed;
+
+    /* Intern table (heap); the strings themselves live in the arena.
+       intern_mark is the arena position after the newest one, so a
+       restore below it drops the table */
+    intern_slot_t* interned;
+    size_t intern_count;
+    size_t intern_capacity;
+    size_t intern_mark;
 };
 
 /**
@@ -37,12 +91,61 @@ static inline size_t align_size(size_t size) {
     return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
 }
 
+/**
+ * @brief Histogram bucket for an allocation size (16, 64, 256, ... bytes)
+ */
+static inline size_t histogram_bucket(size_t size) {
+    size_t bucket = 0;
+    size_t limit = 16;
+    while (size > limit && bucket < AGENT_CONTEXT_STATS_BUCKETS - 1) {
+        limit <<= 2;
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * @brief Adjust the used byte counter and track the high-water mark
+ */
+static inline void track_used(agent_context_t* ctx, size_t used_bytes) {
+    ctx->used_bytes = used_bytes;
+    if (used_bytes > ctx->peak_bytes) {
+        ctx->peak_bytes = used_bytes;
+    }
+}
+
+/**
+ * @brief Bytes held from the system allocator (active chain and free-list)
+ */
+static inline size_t footprint(const agent_context_t* ctx) {
+    return ctx->total_allocated + ctx->retained_bytes;
+}
+
+/**
+ * @brief Fire the pressure callback when the footprint first crosses the soft limit
+ */
+static void check_soft_limit(agent_context_t* ctx) {
+    if (ctx->soft_limit == 0) {
+        return;
+    }
+
+    size_t held = footprint(ctx);
+    if (held <= ctx->soft_limit) {
+        ctx->over_soft_limit = false;
+    } else if (!ctx->over_soft_limit) {
+        ctx->over_soft_limit = true;
+        if (ctx->on_pressure) {
+            ctx->on_pressure(held, ctx->soft_limit, ctx->pressure_user_data);
+        }
+    }
+}
+
 /**
  * @brief Create a new arena block
  */
 static arena_block_t* arena_block_create(size_t min_size) {
     size_t block_size = min_size > DEFAULT_ARENA_SIZE ? min_size : DEFAULT_ARENA_SIZE;
-    arena_block_t* block = (arena_block_t*)malloc(sizeof(arena_block_t) + block_size);
+    arena_block_t* block = (arena_block_t*)agent_mem_alloc(sizeof(arena_block_t) + block_size);
     if (!block) {
         return NULL;
     }
@@ -52,24 +155,166 @@ static arena_block_t* arena_block_create(size_t min_size) {
     return block;
 }
 
+/**
+ * @brief Take a block of at least min_size from the free-list, or create one
+ */
+static arena_block_t* arena_block_acquire(agent_context_t* ctx, size_t min_size) {
+    arena_block_t** link = &ctx->free_list;
+    while (*link) {
+        arena_block_t* block = *link;
+        if (block->size >= min_size) {
+            *link = block->next;
+            ctx->retained_bytes -= sizeof(arena_block_t) + block->size;
+            block->next = NULL;
+            block->used = 0;
+            return block;
+        }
+        link = &block->next;
+    }
+
+    size_t block_size = min_size > ctx->default_block_size ? min_size : ctx->default_block_size;
+
+    /* Refuse to grow past the hard limit */
+    if (ctx->hard_limit > 0 &&
+        footprint(ctx) + sizeof(arena_block_t) + block_size > ctx->hard_limit) {
+        return NULL;
+    }
+    return arena_block_create(block_size);
+}
+
+/**
+ * @brief Make the reserved range accessible up to end bytes into the block data
+ */
+static bool arena_commit(agent_context_t* ctx, size_t end) {
+    if (!ctx->reserved) {
+        return true;
+    }
+
+    size_t needed = sizeof(arena_block_t) + end;
+    if (needed <= ctx->committed) {
+        return true;
+    }
+
+#ifdef AGENT_CONTEXT_HAS_MMAP
+    size_t new_committed = (needed + COMMIT_GRANULARITY - 1) & ~(size_t)(COMMIT_GRANULARITY - 1);
+    if (new_committed > ctx->reserved_size) {
+        new_committed = ctx->reserved_size;
+    }
+    if (ctx->hard_limit > 0 && new_committed > ctx->hard_limit) {
+        return false;
+    }
+    if (mprotect(ctx->first_block, new_committed, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    ctx->committed = new_committed;
+    ctx->total_allocated = new_committed;
+    check_soft_limit(ctx);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Initialize bookkeeping for a context whose first block is set up
+ */
+static void context_init(agent_context_t* ctx, arena_block_t* first_block, size_t block_size) {
+    ctx->first_block = first_block;
+    ctx->current_block = first_block;
+    ctx->default_block_size = block_size;
+    ctx->total_allocated = sizeof(arena_block_t) + first_block->size;
+    ctx->free_list = NULL;
+    ctx->retained_bytes = 0;
+    ctx->retain_limit = DEFAULT_RETAIN_LIMIT;
+    ctx->used_bytes = 0;
+    ctx->peak_bytes = 0;
+    ctx->block_count = 1;
+    ctx->allocation_count = 0;
+    ctx->padding_bytes = 0;
+    memset(ctx->histogram, 0, sizeof(ctx->histogram));
+    ctx->soft_limit = 0;
+    ctx->hard_limit = 0;
+    ctx->over_soft_limit = false;
+    ctx->on_pressure = NULL;
+    ctx->pressure_user_data = NULL;
+    ctx->reserved = false;
+    ctx->reserved_size = 0;
+    ctx->committed = 0;
+    ctx->interned = NULL;
+    ctx->intern_count = 0;
+    ctx->intern_capacity = 0;
+    ctx->intern_mark = 0;
+}
+
+/**
+ * @brief Forget every interned string (their memory is being released)
+ */
+static void intern_clear(agent_context_t* ctx) {
+    if (ctx->intern_count > 0) {
+        memset(ctx->interned, 0, ctx->intern_capacity * sizeof(intern_slot_t));
+        ctx->intern_count = 0;
+    }
+    ctx->intern_mark = 0;
+}
+
 agent_context_t* agent_context_create(size_t initial_size) {
-    agent_context_t* ctx = (agent_context_t*)malloc(sizeof(agent_context_t));
+    agent_context_t* ctx = (agent_context_t*)agent_mem_alloc(sizeof(agent_context_t));
     if (!ctx) {
         return NULL;
     }
 
     size_t block_size = initial_size > 0 ? initial_size : DEFAULT_ARENA_SIZE;
-    ctx->first_block = arena_block_create(block_size);
-    if (!ctx->first_block) {
-        free(ctx);
+    arena_block_t* first_block = arena_block_create(block_size);
+    if (!first_block) {
+        agent_mem_free(ctx);
         return NULL;
     }
 
-    ctx->current_block = ctx->first_block;
-    ctx->default_block_size = block_size;
-    ctx->total_allocated = sizeof(arena_block_t) + block_size;
+    context_init(ctx, first_block, block_size);
+    return ctx;
+}
+
+agent_context_t* agent_context_create_reserved(size_t reserve_size) {
+#ifdef AGENT_CONTEXT_HAS_MMAP
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t granularity = COMMIT_GRANULARITY > page ? COMMIT_GRANULARITY : page;
+    if (reserve_size < granularity) {
+        reserve_size = granularity;
+    }
+    reserve_size = (reserve_size + granularity - 1) & ~(granularity - 1);
 
+    agent_context_t* ctx = (agent_context_t*)agent_mem_alloc(sizeof(agent_context_t));
+    if (!ctx) {
+        return NULL;
+    }
+
+    /* Reserve address space only; pages are committed as the arena grows */
+    void* base = mmap(NULL, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (base == MAP_FAILED) {
+        agent_mem_free(ctx);
+        return NULL;
+    }
+    if (mprotect(base, granularity, PROT_READ | PROT_WRITE) != 0) {
+        munmap(base, reserve_size);
+        agent_mem_free(ctx);
+        return NULL;
+    }
+
+    arena_block_t* block = (arena_block_t*)base;
+    block->next = NULL;
+    block->size = reserve_size - sizeof(arena_block_t);
+    block->used = 0;
+
+    context_init(ctx, block, block->size);
+    ctx->reserved = true;
+    ctx->reserved_size = reserve_size;
+    ctx->committed = granularity;
+    ctx->total_allocated = granularity;
     return ctx;
+#else
+    (void)reserve_size;
+    return NULL;
+#endif
 }
 
 void agent_context_destroy(agent_context_t* ctx) {
@@ -77,47 +322,150 @@ void agent_context_destroy(agent_context_t* ctx) {
         return;
     }
 
+    agent_mem_free(ctx->interned);
+
+#ifdef AGENT_CONTEXT_HAS_MMAP
+    if (ctx->reserved) {
+        munmap(ctx->first_block, ctx->reserved_size);
+        agent_mem_free(ctx);
+        return;
+    }
+#endif
+
     arena_block_t* block = ctx->first_block;
     while (block) {
         arena_block_t* next = block->next;
-        free(block);
+        agent_mem_free(block);
         block = next;
     }
 
-    free(ctx);
+    block = ctx->free_list;
+    while (block) {
+        arena_block_t* next = block->next;
+        agent_mem_free(block);
+        block = next;
+    }
+
+    agent_mem_free(ctx);
 }
 
-void* agent_context_alloc(agent_context_t* ctx, size_t size) {
-    if (!ctx || size == 0) {
-        return NULL;
-    }
+/**
+ * @brief Bytes needed to bring ptr up to a multiple of align
+ */
+static inline size_t align_padding(const char* ptr, size_t align) {
+    return (size_t)(-(uintptr_t)ptr & (uintptr_t)(align - 1));
+}
 
+/**
+ * @brief Bump-allocate size bytes at the given power-of-two alignment
+ */
+static void* arena_alloc(agent_context_t* ctx, size_t size, size_t align) {
     size_t aligned_size = align_size(size);
     arena_block_t* block = ctx->current_block;
+    size_t padding = align_padding(block->data + block->used, align);
+    bool grew = false;
 
     /* Check if current block has space */
-    if (block->used + aligned_size > block->size) {
-        /* Need a new block */
-        size_t new_block_size = aligned_size > ctx->default_block_size
-            ? aligned_size
-            : ctx->default_block_size;
-
-        arena_block_t* new_block = arena_block_create(new_block_size);
-        if (!new_block) {
+    if (block->used + padding + aligned_size > block->size) {
+        /* A reserved arena is a single contiguous block */
+        if (ctx->reserved) {
             return NULL;
         }
 
-        block->next = new_block;
-        ctx->current_block = new_block;
-        ctx->total_allocated += sizeof(arena_block_t) + new_block_size;
-        block = new_block;
+        /* Block data is only ALIGNMENT-aligned, so reserve worst-case padding */
+        size_t worst_size = aligned_size + (align - ALIGNMENT);
+        arena_block_t* next = block->next;
+
+        if (next && next->size >= worst_size) {
+            /* Reuse a block retained by agent_context_restore */
+            block = next;
+        } else {
+            /* Need a new block (recycled from the free-list if possible) */
+            arena_block_t* new_block = arena_block_acquire(ctx, worst_size);
+            if (!new_block) {
+                return NULL;
+            }
+
+            /* Insert after the current block; any retained blocks follow it */
+            new_block->next = next;
+            block->next = new_block;
+            ctx->total_allocated += sizeof(arena_block_t) + new_block->size;
+            ctx->block_count++;
+            block = new_block;
+            grew = true;
+        }
+
+        ctx->current_block = block;
+        padding = align_padding(block->data + block->used, align);
     }
 
-    void* ptr = block->data + block->used;
-    block->used += aligned_size;
+    if (!arena_commit(ctx, block->used + padding + aligned_size)) {
+        return NULL;
+    }
+
+    void* ptr = block->data + block->used + padding;
+    block->used += padding + aligned_size;
+
+    ctx->allocation_count++;
+    ctx->padding_bytes += padding + (aligned_size - size);
+    ctx->histogram[histogram_bucket(size)]++;
+    track_used(ctx, ctx->used_bytes + padding + aligned_size);
+
+    if (grew) {
+        check_soft_limit(ctx);
+    }
     return ptr;
 }
 
+void* agent_context_alloc(agent_context_t* ctx, size_t size) {
+    if (!ctx || size == 0) {
+        return NULL;
+    }
+    return arena_alloc(ctx, size, ALIGNMENT);
+}
+
+void* agent_context_alloc_aligned(agent_context_t* ctx, size_t size, size_t align) {
+    if (!ctx || size == 0 || align == 0 || (align & (align - 1)) != 0) {
+        return NULL;
+    }
+    return arena_alloc(ctx, size, align < ALIGNMENT ? ALIGNMENT : align);
+}
+
+void* agent_context_realloc(agent_context_t* ctx, void* ptr, size_t old_size, size_t new_size) {
+    if (!ctx) {
+        return NULL;
+    }
+    if (!ptr || old_size == 0) {
+        return agent_context_alloc(ctx, new_size);
+    }
+    if (new_size == 0) {
+        return NULL;
+    }
+
+    arena_block_t* block = ctx->current_block;
+    size_t old_aligned = align_size(old_size);
+    size_t new_aligned = align_size(new_size);
+
+    /* Grow or shrink in place if ptr is the newest allocation */
+    if ((char*)ptr + old_aligned == block->data + block->used) {
+        size_t start = (size_t)((char*)ptr - block->data);
+        if (start + new_aligned <= block->size && arena_commit(ctx, start + new_aligned)) {
+            block->used = start + new_aligned;
+            track_used(ctx, ctx->used_bytes - old_aligned + new_aligned);
+            return ptr;
+        }
+    } else if (new_size <= old_size) {
+        return ptr;
+    }
+
+    void* new_ptr = agent_context_alloc(ctx, new_size);
+    if (!new_ptr) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    return new_ptr;
+}
+
 void* agent_context_calloc(agent_context_t* ctx, size_t count, size_t size) {
     size_t total = count * size;
     void* ptr = agent_context_alloc(ctx, total);
@@ -127,30 +475,81 @@ void* agent_context_calloc(agent_context_t* ctx, size_t count, size_t size) {
     return ptr;
 }
 
+void* agent_context_calloc_aligned(agent_context_t* ctx, size_t count, size_t size, size_t align) {
+    size_t total = count * size;
+    void* ptr = agent_context_alloc_aligned(ctx, total, align);
+    if (ptr) {
+        memset(ptr, 0, total);
+    }
+    return ptr;
+}
+
 void agent_context_reset(agent_context_t* ctx) {
     if (!ctx) {
         return;
     }
 
-    /* Free all blocks except the first one */
+    intern_clear(ctx);
+
+#ifdef AGENT_CONTEXT_HAS_MMAP
+    if (ctx->reserved) {
+        /* Keep the tail committed but let the kernel reclaim it under pressure */
+        if (ctx->committed > COMMIT_GRANULARITY) {
+#ifdef MADV_FREE
+            int advice = MADV_FREE;
+#else
+            int advice = MADV_DONTNEED;
+#endif
+            madvise((char*)ctx->first_block + COMMIT_GRANULARITY,
+                    ctx->committed - COMMIT_GRANULARITY, advice);
+        }
+        ctx->first_block->used = 0;
+        ctx->used_bytes = 0;
+        return;
+    }
+#endif
+
+    /* Retire all blocks except the first one to the free-list, up to the
+       retention limit; the rest go back to the system allocator */
     arena_block_t* block = ctx->first_block->next;
     while (block) {
         arena_block_t* next = block->next;
-        ctx->total_allocated -= sizeof(arena_block_t) + block->size;
-        free(block);
+        size_t block_bytes = sizeof(arena_block_t) + block->size;
+        ctx->total_allocated -= block_bytes;
+
+        if (ctx->retained_bytes + block_bytes <= ctx->retain_limit) {
+            block->next = ctx->free_list;
+            ctx->free_list = block;
+            ctx->retained_bytes += block_bytes;
+        } else {
+            agent_mem_free(block);
+        }
         block = next;
     }
 
     ctx->first_block->next = NULL;
     ctx->first_block->used = 0;
     ctx->current_block = ctx->first_block;
+    ctx->used_bytes = 0;
+    ctx->block_count = 1;
+    check_soft_limit(ctx);
 }
 
 size_t agent_context_savepoint(agent_context_t* ctx) {
     if (!ctx) {
         return 0;
     }
-    return ctx->current_block->used;
+
+    /* A savepoint is the logical offset into the block chain: the full size
+       of every block before the current one plus the current block's usage.
+       Blocks after the current block are always empty, so this is unique. */
+    size_t offset = 0;
+    arena_block_t* block = ctx->first_block;
+    while (block != ctx->current_block) {
+        offset += block->size;
+        block = block->next;
+    }
+    return offset + block->used;
 }
 
 void agent_context_restore(agent_context_t* ctx, size_t savepoint) {
@@ -158,11 +557,31 @@ void agent_context_restore(agent_context_t* ctx, size_t savepoint) {
         return;
     }
 
-    /* Simple restore: just reset the first block's used counter */
-    /* This only works correctly if savepoint was taken on the first block */
-    /* For a full implementation, we'd need to track which block the savepoint is in */
-    if (ctx->current_block == ctx->first_block && savepoint <= ctx->first_block->size) {
-        ctx->first_block->used = savepoint;
+    /* Find the block containing the savepoint */
+    arena_block_t* block = ctx->first_block;
+    size_t offset = savepoint;
+    size_t used_before = 0;
+    while (offset > block->size && block != ctx->current_block) {
+        offset -= block->size;
+        used_before += block->used;
+        block = block->next;
+    }
+
+    /* Savepoints beyond the current position are ignored */
+    if (block == ctx->current_block && offset > block->used) {
+        return;
+    }
+
+    if (savepoint < ctx->intern_mark) {
+        intern_clear(ctx);
+    }
+
+    /* Rewind, keeping later blocks in the chain for reuse */
+    block->used = offset;
+    ctx->current_block = block;
+    ctx->used_bytes = used_before + offset;
+    for (arena_block_t* next = block->next; next; next = next->next) {
+        next->used = 0;
     }
 }
 
@@ -171,13 +590,7 @@ size_t agent_context_used(agent_context_t* ctx) {
         return 0;
     }
 
-    size_t total = 0;
-    arena_block_t* block = ctx->first_block;
-    while (block) {
-        total += block->used;
-        block = block->next;
-    }
-    return total;
+    return ctx->used_bytes;
 }
 
 size_t agent_context_capacity(agent_context_t* ctx) {
@@ -187,6 +600,69 @@ size_t agent_context_capacity(agent_context_t* ctx) {
     return ctx->total_allocated;
 }
 
+agent_context_stats_t agent_context_stats(agent_context_t* ctx) {
+    agent_context_stats_t stats = {0};
+    if (!ctx) {
+        return stats;
+    }
+
+    stats.bytes_used = ctx->used_bytes;
+    stats.peak_bytes = ctx->peak_bytes;
+    stats.capacity = ctx->total_allocated;
+    stats.retained_bytes = ctx->retained_bytes;
+    stats.block_count = ctx->block_count;
+    stats.allocation_count = ctx->allocation_count;
+    stats.padding_bytes = ctx->padding_bytes;
+    memcpy(stats.histogram, ctx->histogram, sizeof(stats.histogram));
+    return stats;
+}
+
+size_t agent_context_retained(agent_context_t* ctx) {
+    if (!ctx) {
+        return 0;
+    }
+    return ctx->retained_bytes;
+}
+
+void agent_context_set_retain_limit(agent_context_t* ctx, size_t max_bytes) {
+    if (!ctx) {
+        return;
+    }
+
+    ctx->retain_limit = max_bytes;
+
+    /* Trim the free-list down to the new limit */
+    arena_block_t** link = &ctx->free_list;
+    size_t kept = 0;
+    while (*link) {
+        arena_block_t* block = *link;
+        size_t block_bytes = sizeof(arena_block_t) + block->size;
+        if (kept + block_bytes <= max_bytes) {
+            kept += block_bytes;
+            link = &block->next;
+        } else {
+            *link = block->next;
+            agent_mem_free(block);
+        }
+    }
+    ctx->retained_bytes = kept;
+    check_soft_limit(ctx);
+}
+
+void agent_context_set_budget(agent_context_t* ctx, size_t soft_limit, size_t hard_limit,
+                              agent_memory_pressure_callback_t on_pressure, void* user_data) {
+    if (!ctx) {
+        return;
+    }
+
+    ctx->soft_limit = soft_limit;
+    ctx->hard_limit = hard_limit;
+    ctx->on_pressure = on_pressure;
+    ctx->pressure_user_data = user_data;
+    ctx->over_soft_limit = false;
+    check_soft_limit(ctx);
+}
+
 char* agent_context_strdup(agent_context_t* ctx, const char* str) {
     if (!ctx || !str) {
         return NULL;
@@ -238,3 +714,87 @@ agent_string_view_t agent_context_string_view_n(agent_context_t* ctx, const char
     }
     return sv;
 }
+
+/* String interning */
+
+static inline uint32_t intern_hash(const char* str, size_t len) {
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Slot holding str, or the empty slot it would go in */
+static intern_slot_t* intern_find(intern_slot_t* slots, size_t capacity,
+                                  const char* str, size_t len, uint32_t hash) {
+    size_t mask = capacity - 1;
+    size_t i = hash & mask;
+    while (slots[i].data) {
+        if (slots[i].hash == hash && slots[i].length == len &&
+            memcmp(slots[i].data, str, len) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return &slots[i];
+}
+
+static bool intern_grow(agent_context_t* ctx) {
+    size_t capacity = ctx->intern_capacity > 0 ? ctx->intern_capacity * 2 : INTERN_INITIAL_CAPACITY;
+    intern_slot_t* slots = agent_mem_calloc(capacity, sizeof(intern_slot_t));
+    if (!slots) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ctx->intern_capacity; i++) {
+        const intern_slot_t* old = &ctx->interned[i];
+        if (old->data) {
+            *intern_find(slots, capacity, old->data, old->length, old->hash) = *old;
+        }
+    }
+
+    agent_mem_free(ctx->interned);
+    ctx->interned = slots;
+    ctx->intern_capacity = capacity;
+    return true;
+}
+
+agent_string_view_t agent_context_intern(agent_context_t* ctx, const char* str, size_t len) {
+    agent_string_view_t sv = {NULL, 0};
+    if (!ctx || !str) {
+        return sv;
+    }
+    if (len > AGENT_CONTEXT_INTERN_MAX_LENGTH) {
+        return agent_context_string_view_n(ctx, str, len);
+    }
+
+    /* Keep the table at most half full */
+    if ((ctx->intern_count + 1) * 2 > ctx->intern_capacity && !intern_grow(ctx)) {
+        return agent_context_string_view_n(ctx, str, len);
+    }
+
+    uint32_t hash = intern_hash(str, len);
+    intern_slot_t* slot = intern_find(ctx->interned, ctx->intern_capacity, str, len, hash);
+    if (!slot->data) {
+        char* copy = agent_context_strndup(ctx, str, len);
+        if (!copy) {
+            return sv;
+        }
+        slot->data = copy;
+        slot->length = (uint32_t)len;
+        slot->hash = hash;
+        ctx->intern_count++;
+        ctx->intern_mark = agent_context_savepoint(ctx);
+    }
+
+    sv.data = slot->data;
+    sv.length = len;
+    return sv;
+}
+
+size_t agent_context_intern_count(agent_context_t* ctx) {
+    return ctx ? ctx->intern_count : 0;
+}
@@ -4,11 +4,15 @@
  */
 
 #include "agent_json.h"
+#include "agent_alloc.h"
+#include "agent_mcp.h"
 #include "agent_string.h"
+#include "agent_trace.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include "agent_simd.h"
 
 #define DEFAULT_ARRAY_CAPACITY 8
 #define DEFAULT_OBJECT_CAPACITY 8
@@ -21,11 +25,29 @@ typedef struct {
     size_t pos;
     agent_error_t error;
     const char* error_message;
+
+    /* Mutable alias of json in in-situ mode: strings are decoded and
+       terminated in place instead of being copied into the arena */
+    char* insitu;
+
+    /* Schema-validated mode: schema of the value about to be parsed, and
+       the per-parameter slots filled in by the root object */
+    const agent_property_schema_t* schema;
+    agent_json_value_t** fields;
+    const char* error_field;
+
+    /* Scratch stack of parsed members; each array or object is copied out
+       at its exact size once its closing bracket is reached */
+    agent_json_entry_t* stack;
+    size_t stack_count;
+    size_t stack_capacity;
 } json_parser_t;
 
 /* Forward declarations */
 static agent_json_value_t* parse_value(json_parser_t* p);
 static void skip_whitespace(json_parser_t* p);
+static agent_json_entry_t* object_find(const agent_json_value_t* object,
+                                       const char* key, size_t len);
 
 /* Constructors */
 
@@ -95,6 +117,7 @@ agent_json_value_t* agent_json_array(agent_context_t* ctx, size_t initial_capaci
     val->type = AGENT_JSON_ARRAY;
     val->data.array_value.items = items;
     val->data.array_value.count = 0;
+    val->data.array_value.capacity = capacity;
     return val;
 }
 
@@ -113,9 +136,171 @@ agent_json_value_t* agent_json_object(agent_context_t* ctx, size_t initial_capac
     val->type = AGENT_JSON_OBJECT;
     val->data.object_value.entries = entries;
     val->data.object_value.count = 0;
+    val->data.object_value.capacity = capacity;
+    val->data.object_value.index = NULL;
+    val->data.object_value.index_capacity = 0;
     return val;
 }
 
+agent_json_value_t* agent_json_clone(agent_context_t* ctx, const agent_json_value_t* value) {
+    if (!ctx || !value) {
+        return NULL;
+    }
+
+    switch (value->type) {
+        case AGENT_JSON_NULL:
+            return agent_json_null(ctx);
+
+        case AGENT_JSON_BOOL:
+            return agent_json_bool(ctx, value->data.bool_value);
+
+        case AGENT_JSON_INT:
+            return agent_json_int(ctx, value->data.int_value);
+
+        case AGENT_JSON_DOUBLE:
+            return agent_json_double(ctx, value->data.double_value);
+
+        case AGENT_JSON_STRING:
+            return agent_json_string_n(ctx, value->data.string_value.data,
+                                       value->data.string_value.length);
+
+        case AGENT_JSON_ARRAY: {
+            size_t count = value->data.array_value.count;
+            agent_json_value_t* array = agent_json_array(ctx, count);
+            if (!array) return NULL;
+            for (size_t i = 0; i < count; i++) {
+                agent_json_value_t* item = agent_json_clone(ctx, value->data.array_value.items[i]);
+                if (!item || agent_json_array_append(ctx, array, item) != AGENT_OK) {
+                    return NULL;
+                }
+            }
+            return array;
+        }
+
+        case AGENT_JSON_OBJECT: {
+            size_t count = value->data.object_value.count;
+            agent_json_value_t* object = agent_json_object(ctx, count);
+            if (!object) return NULL;
+            for (size_t i = 0; i < count; i++) {
+                const agent_json_entry_t* entry = &value->data.object_value.entries[i];
+                agent_json_value_t* item = agent_json_clone(ctx, entry->value);
+                if (!item || agent_json_object_set_n(ctx, object, entry->key.data,
+                                                     entry->key.length, item) != AGENT_OK) {
+                    return NULL;
+                }
+            }
+            return object;
+        }
+    }
+
+    return NULL;
+}
+
+/* Object hash index */
+
+static inline uint32_t key_hash(const char* key, size_t len) {
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline bool key_equals(const agent_json_entry_t* entry, const char* key, size_t len) {
+    /* Interned keys usually match by pointer */
+    return entry->key.length == len &&
+           (entry->key.data == key || memcmp(entry->key.data, key, len) == 0);
+}
+
+/* Find the entry for key, or the empty slot it would go in (*out_slot) */
+static agent_json_entry_t* index_find_hashed(const agent_json_value_t* object, const char* key,
+                                             size_t len, uint32_t hash, size_t* out_slot) {
+    const uint32_t* index = object->data.object_value.index;
+    size_t mask = object->data.object_value.index_capacity - 1;
+    size_t slot = hash & mask;
+
+    while (index[slot] != 0) {
+        agent_json_entry_t* entry = &object->data.object_value.entries[index[slot] - 1];
+        if (key_equals(entry, key, len)) {
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (out_slot) {
+        *out_slot = slot;
+    }
+    return NULL;
+}
+
+static inline agent_json_entry_t* index_find(const agent_json_value_t* object,
+                                             const char* key, size_t len, size_t* out_slot) {
+    return index_find_hashed(object, key, len, key_hash(key, len), out_slot);
+}
+
+/* Linear search for objects below the index threshold */
+static agent_json_entry_t* object_scan(const agent_json_value_t* object,
+                                       const char* key, size_t len) {
+    for (size_t i = 0; i < object->data.object_value.count; i++) {
+        agent_json_entry_t* entry = &object->data.object_value.entries[i];
+        if (key_equals(entry, key, len)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Look up a key, using the index when the object has one */
+static agent_json_entry_t* object_find(const agent_json_value_t* object,
+                                       const char* key, size_t len) {
+    if (object->data.object_value.index) {
+        return index_find(object, key, len, NULL);
+    }
+    return object_scan(object, key, len);
+}
+
+/*
+ * (Re)build the index sized for at least min_count keys. Later duplicates
+ * of a key are folded into its first entry, so this also dedupes objects
+ * whose entries were filled in directly by the parser.
+ */
+static agent_error_t object_build_index(agent_context_t* ctx, agent_json_value_t* object,
+                                        size_t min_count) {
+    size_t index_capacity = 32;
+    while (index_capacity < min_count * 2) {
+        index_capacity <<= 1;
+    }
+
+    uint32_t* index = agent_context_calloc(ctx, index_capacity, sizeof(uint32_t));
+    if (!index) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    object->data.object_value.index = index;
+    object->data.object_value.index_capacity = index_capacity;
+
+    agent_json_entry_t* entries = object->data.object_value.entries;
+    size_t count = object->data.object_value.count;
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t slot;
+        object->data.object_value.count = kept;
+        agent_json_entry_t* existing = index_find(object, entries[i].key.data,
+                                                  entries[i].key.length, &slot);
+        if (existing) {
+            existing->value = entries[i].value;
+        } else {
+            entries[kept] = entries[i];
+            index[slot] = (uint32_t)(kept + 1);
+            kept++;
+        }
+    }
+    object->data.object_value.count = kept;
+    return AGENT_OK;
+}
+
 /* Array operations */
 
 agent_error_t agent_json_array_append(agent_context_t* ctx, agent_json_value_t* array,
@@ -124,20 +309,21 @@ agent_error_t agent_json_array_append(agent_context_t* ctx, agent_json_value_t*
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
 
-    /* Note: In an arena allocator, we can't resize in place easily.
-       For simplicity, we allocate a new larger array and copy. */
     size_t count = array->data.array_value.count;
-
-    /* Check if we have space (we don't track capacity, so estimate) */
-    agent_json_value_t** new_items = agent_context_calloc(ctx, count + 1, sizeof(agent_json_value_t*));
-    if (!new_items) {
-        return AGENT_ERROR_OUT_OF_MEMORY;
+    size_t capacity = array->data.array_value.capacity;
+    if (count >= capacity) {
+        /* Grows in place when the items array is the newest arena allocation */
+        size_t new_capacity = capacity > 0 ? capacity * 2 : DEFAULT_ARRAY_CAPACITY;
+        agent_json_value_t** new_items = agent_context_realloc(ctx, array->data.array_value.items,
+            capacity * sizeof(agent_json_value_t*), new_capacity * sizeof(agent_json_value_t*));
+        if (!new_items) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+        array->data.array_value.items = new_items;
+        array->data.array_value.capacity = new_capacity;
     }
 
-    memcpy(new_items, array->data.array_value.items, count * sizeof(agent_json_value_t*));
-    new_items[count] = value;
-
-    array->data.array_value.items = new_items;
+    array->data.array_value.items[count] = value;
     array->data.array_value.count = count + 1;
     return AGENT_OK;
 }
@@ -176,28 +362,50 @@ agent_error_t agent_json_object_set_n(agent_context_t* ctx, agent_json_value_t*
     }
 
     /* Check if key already exists */
-    for (size_t i = 0; i < object->data.object_value.count; i++) {
-        agent_json_entry_t* entry = &object->data.object_value.entries[i];
-        if (entry->key.length == key_len &&
-            memcmp(entry->key.data, key, key_len) == 0) {
-            entry->value = value;
-            return AGENT_OK;
-        }
+    agent_json_entry_t* existing = object_find(object, key, key_len);
+    if (existing) {
+        existing->value = value;
+        return AGENT_OK;
     }
 
     /* Add new entry */
     size_t count = object->data.object_value.count;
-    agent_json_entry_t* new_entries = agent_context_calloc(ctx, count + 1, sizeof(agent_json_entry_t));
-    if (!new_entries) {
-        return AGENT_ERROR_OUT_OF_MEMORY;
+    size_t capacity = object->data.object_value.capacity;
+    if (count >= capacity) {
+        size_t new_capacity = capacity > 0 ? capacity * 2 : DEFAULT_OBJECT_CAPACITY;
+        agent_json_entry_t* new_entries = agent_context_realloc(ctx, object->data.object_value.entries,
+            capacity * sizeof(agent_json_entry_t), new_capacity * sizeof(agent_json_entry_t));
+        if (!new_entries) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+        object->data.object_value.entries = new_entries;
+        object->data.object_value.capacity = new_capacity;
     }
 
-    memcpy(new_entries, object->data.object_value.entries, count * sizeof(agent_json_entry_t));
-    new_entries[count].key = agent_context_string_view_n(ctx, key, key_len);
-    new_entries[count].value = value;
+    agent_string_view_t key_copy = agent_context_intern(ctx, key, key_len);
+    if (!key_copy.data) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
 
-    object->data.object_value.entries = new_entries;
+    object->data.object_value.entries[count].key = key_copy;
+    object->data.object_value.entries[count].value = value;
     object->data.object_value.count = count + 1;
+
+    /* Keep the index at most half full; build it once the object is wide */
+    if (object->data.object_value.index) {
+        if ((count + 1) * 2 > object->data.object_value.index_capacity) {
+            return object_build_index(ctx, object, count + 1);
+        }
+        /* The key is new (replaced above otherwise), so this finds a free slot */
+        size_t slot = 0;
+        if (index_find(object, key, key_len, &slot)) {
+            object->data.object_value.count = count;
+            return AGENT_ERROR_INVALID_ARGUMENT;
+        }
+        object->data.object_value.index[slot] = (uint32_t)(count + 1);
+    } else if (count + 1 >= AGENT_JSON_INDEX_THRESHOLD) {
+        return object_build_index(ctx, object, count + 1);
+    }
     return AGENT_OK;
 }
 
@@ -214,14 +422,8 @@ agent_json_value_t* agent_json_object_get_n(const agent_json_value_t* object,
         return NULL;
     }
 
-    for (size_t i = 0; i < object->data.object_value.count; i++) {
-        const agent_json_entry_t* entry = &object->data.object_value.entries[i];
-        if (entry->key.length == key_len &&
-            memcmp(entry->key.data, key, key_len) == 0) {
-            return entry->value;
-        }
-    }
-    return NULL;
+    agent_json_entry_t* entry = object_find(object, key, key_len);
+    return entry ? entry->value : NULL;
 }
 
 bool agent_json_object_has(const agent_json_value_t* object, const char* key) {
@@ -235,6 +437,109 @@ size_t agent_json_object_length(const agent_json_value_t* object) {
     return object->data.object_value.count;
 }
 
+/* Compiled paths */
+
+agent_error_t agent_json_path_compile(agent_context_t* ctx, const char* expression,
+                                      agent_json_path_t* out_path) {
+    if (!ctx || !expression || !out_path) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    /* Every segment is introduced by a key or '[', so this bounds the count */
+    size_t capacity = 1;
+    for (const char* c = expression; *c; c++) {
+        if (*c == '.' || *c == '[') capacity++;
+    }
+
+    agent_json_path_segment_t* segments = agent_context_alloc(
+        ctx, capacity * sizeof(agent_json_path_segment_t));
+    if (!segments) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    size_t count = 0;
+    const char* c = expression;
+    bool expect_key = true;
+
+    while (*c) {
+        agent_json_path_segment_t* segment = &segments[count];
+        memset(segment, 0, sizeof(*segment));
+
+        if (*c == '[') {
+            c++;
+            if (*c < '0' || *c > '9') return AGENT_ERROR_PARSE_ERROR;
+            size_t index = 0;
+            while (*c >= '0' && *c <= '9') {
+                index = index * 10 + (size_t)(*c - '0');
+                c++;
+            }
+            if (*c != ']') return AGENT_ERROR_PARSE_ERROR;
+            c++;
+            segment->is_index = true;
+            segment->index = index;
+        } else {
+            if (!expect_key) return AGENT_ERROR_PARSE_ERROR;
+            const char* start = c;
+            while (*c && *c != '.' && *c != '[') {
+                c++;
+            }
+            size_t len = (size_t)(c - start);
+            if (len == 0) return AGENT_ERROR_PARSE_ERROR;
+
+            char* key = agent_context_strndup(ctx, start, len);
+            if (!key) return AGENT_ERROR_OUT_OF_MEMORY;
+            segment->key = key;
+            segment->key_length = len;
+            segment->hash = key_hash(key, len);
+        }
+        count++;
+
+        /* After a segment: end, '[', or '.' followed by a key */
+        expect_key = false;
+        if (*c == '.') {
+            c++;
+            if (*c == '\0' || *c == '.' || *c == '[') return AGENT_ERROR_PARSE_ERROR;
+            expect_key = true;
+        }
+    }
+
+    out_path->segments = segments;
+    out_path->count = count;
+    return AGENT_OK;
+}
+
+agent_json_value_t* agent_json_path_eval(const agent_json_path_t* path,
+                                         const agent_json_value_t* value) {
+    if (!path || !value) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < path->count && value; i++) {
+        const agent_json_path_segment_t* segment = &path->segments[i];
+
+        if (segment->is_index) {
+            if (value->type != AGENT_JSON_ARRAY ||
+                segment->index >= value->data.array_value.count) {
+                return NULL;
+            }
+            value = value->data.array_value.items[segment->index];
+            continue;
+        }
+
+        if (value->type != AGENT_JSON_OBJECT) {
+            return NULL;
+        }
+
+        /* Hash precomputed at compile time */
+        const agent_json_entry_t* entry = value->data.object_value.index
+            ? index_find_hashed(value, segment->key, segment->key_length, segment->hash, NULL)
+            : object_scan(value, segment->key, segment->key_length);
+        value = entry ? entry->value : NULL;
+    }
+
+    return (agent_json_value_t*)value;
+}
+
 /* Type accessors */
 
 agent_json_type_t agent_json_get_type(const agent_json_value_t* value) {
@@ -321,14 +626,12 @@ static inline bool match(json_parser_t* p, char expected) {
 }
 
 static void skip_whitespace(json_parser_t* p) {
-    while (!is_at_end(p)) {
-        char c = peek(p);
-        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
-            p->pos++;
-        } else {
-            break;
-        }
+    /* Most gaps are a single space or none; only vectorize longer runs */
+    if (is_at_end(p) || !agent_simd_is_json_space(p->json[p->pos])) {
+        return;
     }
+    p->pos++;
+    p->pos += agent_simd_skip_space(p->json + p->pos, p->length - p->pos);
 }
 
 static void set_error(json_parser_t* p, const char* message) {
@@ -338,50 +641,20 @@ static void set_error(json_parser_t* p, const char* message) {
     }
 }
 
-/* Parse string (handles escape sequences) */
-static agent_json_value_t* parse_string(json_parser_t* p) {
-    if (!match(p, '"')) {
-        set_error(p, "Expected '\"'");
-        return NULL;
-    }
-
-    size_t start = p->pos;
-    bool has_escapes = false;
-
-    while (!is_at_end(p) && peek(p) != '"') {
-        if (peek(p) == '\\') {
-            has_escapes = true;
-            p->pos++;  /* Skip backslash */
-            if (is_at_end(p)) {
-                set_error(p, "Unterminated string");
-                return NULL;
-            }
-            p->pos++;  /* Skip escaped character */
-        } else {
-            p->pos++;
-        }
-    }
-
-    if (!match(p, '"')) {
-        set_error(p, "Unterminated string");
-        return NULL;
-    }
-
-    size_t end = p->pos - 1;
-    const char* str = p->json + start;
-    size_t len = end - start;
-
-    if (!has_escapes) {
-        return agent_json_string_n(p->ctx, str, len);
-    }
-
-    /* Handle escape sequences */
-    char* buf = agent_context_alloc(p->ctx, len + 1);
-    if (!buf) {
-        set_error(p, "Out of memory");
-        return NULL;
+/* Report a schema violation for the value starting at position */
+static void schema_error(json_parser_t* p, const agent_property_schema_t* schema,
+                         size_t position, const char* message) {
+    if (p->error == AGENT_OK) {
+        p->error = AGENT_ERROR_INVALID_ARGUMENT;
+        p->error_message = message;
+        p->error_field = schema->name;
+        p->pos = position;
     }
+}
 
+/* Decode escape sequences from str into buf and return the decoded length;
+   buf may alias str since the output is never longer than the input */
+static size_t decode_escapes(const char* str, size_t len, char* buf) {
     size_t j = 0;
     for (size_t i = 0; i < len; i++) {
         if (str[i] == '\\' && i + 1 < len) {
@@ -444,6 +717,90 @@ static agent_json_value_t* parse_string(json_parser_t* p) {
             buf[j++] = str[i];
         }
     }
+    return j;
+}
+
+/* Scan a string literal and report the position and length of its raw
+   (still escaped) contents */
+static bool scan_string(json_parser_t* p, size_t* out_start, size_t* out_len, bool* out_escapes) {
+    if (!match(p, '"')) {
+        set_error(p, "Expected '\"'");
+        return false;
+    }
+
+    size_t start = p->pos;
+    bool has_escapes = false;
+
+    for (;;) {
+        /* Jump to the next quote or backslash */
+        p->pos += agent_simd_find_either(p->json + p->pos, p->length - p->pos, '"', '\\');
+        if (is_at_end(p) || peek(p) == '"') {
+            break;
+        }
+
+        has_escapes = true;
+        p->pos++;  /* Skip backslash */
+        if (is_at_end(p)) {
+            set_error(p, "Unterminated string");
+            return false;
+        }
+        p->pos++;  /* Skip escaped character */
+    }
+
+    if (!match(p, '"')) {
+        set_error(p, "Unterminated string");
+        return false;
+    }
+
+    *out_start = start;
+    *out_len = p->pos - 1 - start;
+    *out_escapes = has_escapes;
+    return true;
+}
+
+/* Parse string (handles escape sequences) */
+static agent_json_value_t* parse_string(json_parser_t* p) {
+    size_t start;
+    size_t len;
+    bool has_escapes;
+    if (!scan_string(p, &start, &len, &has_escapes)) {
+        return NULL;
+    }
+
+    const char* str = p->json + start;
+
+    if (p->insitu) {
+        /* Decoding never grows the text, so it fits over the source and
+           the closing quote leaves room for the terminator */
+        char* buf = p->insitu + start;
+        if (has_escapes) {
+            len = decode_escapes(str, len, buf);
+        }
+        buf[len] = '\0';
+
+        agent_json_value_t* val = agent_context_alloc(p->ctx, sizeof(agent_json_value_t));
+        if (!val) {
+            set_error(p, "Out of memory");
+            return NULL;
+        }
+        val->type = AGENT_JSON_STRING;
+        val->data.string_value.data = buf;
+        val->data.string_value.length = len;
+        return val;
+    }
+
+    if (!has_escapes) {
+        return agent_json_string_n(p->ctx, str, len);
+    }
+
+    /* Handle escape sequences */
+    char* buf = agent_context_alloc(p->ctx, len + 1);
+    if (!buf) {
+        set_error(p, "Out of memory");
+        return NULL;
+    }
+
+    size_t j = decode_escapes(str, len, buf);
     buf[j] = '\0';
 
     agent_json_value_t* val = agent_context_alloc(p->ctx, sizeof(agent_json_value_t));
@@ -456,13 +813,71 @@ static agent_json_value_t* parse_string(json_parser_t* p) {
     return val;
 }
 
-/* Parse number */
-static agent_json_value_t* parse_number(json_parser_t* p) {
+/* Parse an object key; plain keys are interned so repeats share one copy */
+static bool parse_key(json_parser_t* p, agent_string_view_t* out) {
+    size_t start;
+    size_t len;
+    bool has_escapes;
+    if (!scan_string(p, &start, &len, &has_escapes)) {
+        return false;
+    }
+
+    const char* str = p->json + start;
+    if (p->insitu) {
+        /* Decoded in place, as parse_string does */
+        char* buf = p->insitu + start;
+        if (has_escapes) {
+            len = decode_escapes(str, len, buf);
+        }
+        buf[len] = '\0';
+        out->data = buf;
+        out->length = len;
+        return true;
+    }
+
+    if (has_escapes) {
+        char* buf = agent_context_alloc(p->ctx, len + 1);
+        if (buf) {
+            len = decode_escapes(str, len, buf);
+            buf[len] = '\0';
+        }
+        out->data = buf;
+        out->length = len;
+    } else {
+        *out = agent_context_intern(p->ctx, str, len);
+    }
+
+    if (!out->data) {
+        set_error(p, "Out of memory");
+        return false;
+    }
+    return true;
+}
+
+/* Exactly representable powers of ten for the fast conversion path */
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define NUMBER_MAX_DIGITS 19
+#define NUMBER_MAX_EXPONENT 100000
+
+/* Scan and convert a number literal */
+static bool scan_number(json_parser_t* p, bool* out_is_double, int64_t* out_int, double* out_double) {
     size_t start = p->pos;
     bool is_double = false;
+    bool negative = false;
+
+    /* Decimal significand (first 19 significant digits) and exponent */
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool truncated = false;
 
     /* Optional minus */
     if (peek(p) == '-') {
+        negative = true;
         advance(p);
     }
 
@@ -471,11 +886,18 @@ static agent_json_value_t* parse_number(json_parser_t* p) {
         advance(p);
     } else if (peek(p) >= '1' && peek(p) <= '9') {
         while (peek(p) >= '0' && peek(p) <= '9') {
-            advance(p);
+            if (digits < NUMBER_MAX_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t)(advance(p) - '0');
+                digits++;
+            } else {
+                truncated = truncated || peek(p) != '0';
+                exponent++;
+                advance(p);
+            }
         }
     } else {
         set_error(p, "Invalid number");
-        return NULL;
+        return false;
     }
 
     /* Fractional part */
@@ -484,10 +906,17 @@ static agent_json_value_t* parse_number(json_parser_t* p) {
         advance(p);
         if (peek(p) < '0' || peek(p) > '9') {
             set_error(p, "Expected digit after decimal point");
-            return NULL;
+            return false;
         }
         while (peek(p) >= '0' && peek(p) <= '9') {
-            advance(p);
+            if (digits < NUMBER_MAX_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t)(advance(p) - '0');
+                if (mantissa) digits++;
+                exponent--;
+            } else {
+                truncated = truncated || peek(p) != '0';
+                advance(p);
+            }
         }
     }
 
@@ -495,62 +924,199 @@ static agent_json_value_t* parse_number(json_parser_t* p) {
     if (peek(p) == 'e' || peek(p) == 'E') {
         is_double = true;
         advance(p);
+        bool exp_negative = false;
         if (peek(p) == '+' || peek(p) == '-') {
-            advance(p);
+            exp_negative = advance(p) == '-';
         }
         if (peek(p) < '0' || peek(p) > '9') {
             set_error(p, "Expected digit in exponent");
-            return NULL;
+            return false;
         }
+        int exp_value = 0;
         while (peek(p) >= '0' && peek(p) <= '9') {
-            advance(p);
+            int d = advance(p) - '0';
+            if (exp_value < NUMBER_MAX_EXPONENT) {
+                exp_value = exp_value * 10 + d;
+            }
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    *out_is_double = is_double;
+
+    /* Fast paths: exact integer, or a significand and power of ten that are
+       both exactly representable so one IEEE operation rounds correctly */
+    if (!truncated) {
+        if (!is_double) {
+            if (exponent == 0 && mantissa <= (uint64_t)INT64_MAX + (negative ? 1 : 0)) {
+                *out_int = negative ? (int64_t)(0 - mantissa) : (int64_t)mantissa;
+                return true;
+            }
+        } else if (mantissa <= (UINT64_C(1) << 53) && exponent >= -22 && exponent <= 22) {
+            double d = (double)mantissa;
+            d = exponent < 0 ? d / exact_pow10[-exponent] : d * exact_pow10[exponent];
+            *out_double = negative ? -d : d;
+            return true;
         }
     }
 
+    /* Slow path: convert from a terminated copy */
     size_t len = p->pos - start;
-    char* num_str = agent_context_strndup(p->ctx, p->json + start, len);
-    if (!num_str) {
-        set_error(p, "Out of memory");
-        return NULL;
+    char local[64];
+    char* num_str = local;
+    if (len >= sizeof(local)) {
+        num_str = agent_context_strndup(p->ctx, p->json + start, len);
+        if (!num_str) {
+            set_error(p, "Out of memory");
+            return false;
+        }
+    } else {
+        memcpy(local, p->json + start, len);
+        local[len] = '\0';
     }
 
     if (is_double) {
-        double d = strtod(num_str, NULL);
-        return agent_json_double(p->ctx, d);
+        *out_double = strtod(num_str, NULL);
     } else {
-        int64_t i = strtoll(num_str, NULL, 10);
-        return agent_json_int(p->ctx, i);
+        *out_int = strtoll(num_str, NULL, 10);
     }
+    return true;
 }
 
-/* Parse array */
-static agent_json_value_t* parse_array(json_parser_t* p) {
-    if (!match(p, '[')) {
-        set_error(p, "Expected '['");
-        return NULL;
+/* Parse number */
+static agent_json_value_t* parse_number(json_parser_t* p) {
+    bool is_double;
+    int64_t i = 0;
+    double d = 0.0;
+    if (!scan_number(p, &is_double, &i, &d)) {
+        return NULL;
+    }
+    return is_double ? agent_json_double(p->ctx, d) : agent_json_int(p->ctx, i);
+}
+
+/* Push a parsed member onto the scratch stack */
+static bool stack_push(json_parser_t* p, agent_string_view_t key, agent_json_value_t* value) {
+    if (p->stack_count >= p->stack_capacity) {
+        size_t new_capacity = p->stack_capacity > 0 ? p->stack_capacity * 2 : 32;
+        agent_json_entry_t* new_stack = agent_mem_realloc(p->stack,
+            new_capacity * sizeof(agent_json_entry_t));
+        if (!new_stack) {
+            set_error(p, "Out of memory");
+            return false;
+        }
+        p->stack = new_stack;
+        p->stack_capacity = new_capacity;
+    }
+
+    p->stack[p->stack_count].key = key;
+    p->stack[p->stack_count].value = value;
+    p->stack_count++;
+    return true;
+}
+
+/* Schema checks (validated parsing) */
+
+static const agent_property_schema_t* schema_find_property(const agent_property_schema_t* schema,
+                                                           agent_string_view_t key, size_t* out_index) {
+    if (!schema || schema->type != AGENT_SCHEMA_OBJECT) {
+        return NULL;
+    }
+    for (size_t i = 0; i < schema->properties_count; i++) {
+        const char* name = schema->properties[i].name;
+        if (name && strlen(name) == key.length && memcmp(name, key.data, key.length) == 0) {
+            *out_index = i;
+            return &schema->properties[i];
+        }
+    }
+    return NULL;
+}
+
+/* Whether a value starting with c can satisfy the schema type */
+static bool schema_accepts(const agent_property_schema_t* schema, char c) {
+    if (c == 'n') {
+        return !schema->required;  /* Optional parameters may be null */
+    }
+    switch (schema->type) {
+        case AGENT_SCHEMA_STRING:  return c == '"';
+        case AGENT_SCHEMA_INTEGER:
+        case AGENT_SCHEMA_NUMBER:  return c == '-' || (c >= '0' && c <= '9');
+        case AGENT_SCHEMA_BOOLEAN: return c == 't' || c == 'f';
+        case AGENT_SCHEMA_ARRAY:   return c == '[';
+        case AGENT_SCHEMA_OBJECT:  return c == '{';
+    }
+    return false;
+}
+
+/* Checks that need the parsed scalar: integer vs. fraction, enum membership */
+static bool schema_check_value(json_parser_t* p, const agent_property_schema_t* schema,
+                               const agent_json_value_t* value, size_t start) {
+    if (schema->type == AGENT_SCHEMA_INTEGER && value->type == AGENT_JSON_DOUBLE) {
+        schema_error(p, schema, start, "Expected integer");
+        return false;
+    }
+
+    if (schema->enum_count > 0 && value->type == AGENT_JSON_STRING) {
+        agent_string_view_t str = value->data.string_value;
+        for (size_t i = 0; i < schema->enum_count; i++) {
+            const char* option = schema->enum_values[i];
+            if (strlen(option) == str.length && memcmp(option, str.data, str.length) == 0) {
+                return true;
+            }
+        }
+        schema_error(p, schema, start, "Value not in enum");
+        return false;
     }
+    return true;
+}
 
-    agent_json_value_t* array = agent_json_array(p->ctx, DEFAULT_ARRAY_CAPACITY);
+static bool schema_check_required(json_parser_t* p, const agent_property_schema_t* schema,
+                                  const agent_json_value_t* object) {
+    if (!schema || schema->type != AGENT_SCHEMA_OBJECT) {
+        return true;
+    }
+    for (size_t i = 0; i < schema->properties_count; i++) {
+        const agent_property_schema_t* prop = &schema->properties[i];
+        if (prop->required && !object_find(object, prop->name, strlen(prop->name))) {
+            schema_error(p, prop, p->pos - 1, "Missing required field");
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Parse array */
+static agent_json_value_t* parse_array(json_parser_t* p, const agent_property_schema_t* schema) {
+    if (!match(p, '[')) {
+        set_error(p, "Expected '['");
+        return NULL;
+    }
+
+    agent_json_value_t* array = agent_context_alloc(p->ctx, sizeof(agent_json_value_t));
     if (!array) {
         set_error(p, "Out of memory");
         return NULL;
     }
+    array->type = AGENT_JSON_ARRAY;
+    array->data.array_value.items = NULL;
+    array->data.array_value.count = 0;
+    array->data.array_value.capacity = 0;
 
     skip_whitespace(p);
     if (match(p, ']')) {
         return array;
     }
 
+    size_t base = p->stack_count;
     do {
         skip_whitespace(p);
+        p->schema = schema ? schema->items_schema : NULL;
         agent_json_value_t* element = parse_value(p);
         if (!element || p->error != AGENT_OK) {
             return NULL;
         }
 
-        agent_error_t err = agent_json_array_append(p->ctx, array, element);
-        if (err != AGENT_OK) {
-            set_error(p, "Out of memory");
+        agent_string_view_t no_key = {NULL, 0};
+        if (!stack_push(p, no_key, element)) {
             return NULL;
         }
 
@@ -562,27 +1128,53 @@ static agent_json_value_t* parse_array(json_parser_t* p) {
         return NULL;
     }
 
+    /* Copy the elements out at their exact count */
+    size_t count = p->stack_count - base;
+    agent_json_value_t** items = agent_context_alloc(p->ctx, count * sizeof(agent_json_value_t*));
+    if (!items) {
+        set_error(p, "Out of memory");
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        items[i] = p->stack[base + i].value;
+    }
+    p->stack_count = base;
+
+    array->data.array_value.items = items;
+    array->data.array_value.count = count;
+    array->data.array_value.capacity = count;
     return array;
 }
 
 /* Parse object */
-static agent_json_value_t* parse_object(json_parser_t* p) {
+static agent_json_value_t* parse_object(json_parser_t* p, const agent_property_schema_t* schema) {
     if (!match(p, '{')) {
         set_error(p, "Expected '{'");
         return NULL;
     }
 
-    agent_json_value_t* object = agent_json_object(p->ctx, DEFAULT_OBJECT_CAPACITY);
+    /* Only the root object fills the parameter slots */
+    agent_json_value_t** fields = p->fields;
+    p->fields = NULL;
+
+    agent_json_value_t* object = agent_context_alloc(p->ctx, sizeof(agent_json_value_t));
     if (!object) {
         set_error(p, "Out of memory");
         return NULL;
     }
+    object->type = AGENT_JSON_OBJECT;
+    object->data.object_value.entries = NULL;
+    object->data.object_value.count = 0;
+    object->data.object_value.capacity = 0;
+    object->data.object_value.index = NULL;
+    object->data.object_value.index_capacity = 0;
 
     skip_whitespace(p);
     if (match(p, '}')) {
-        return object;
+        return schema_check_required(p, schema, object) ? object : NULL;
     }
 
+    size_t base = p->stack_count;
     do {
         skip_whitespace(p);
 
@@ -591,8 +1183,8 @@ static agent_json_value_t* parse_object(json_parser_t* p) {
             set_error(p, "Expected string key");
             return NULL;
         }
-        agent_json_value_t* key_val = parse_string(p);
-        if (!key_val || p->error != AGENT_OK) {
+        agent_string_view_t key;
+        if (!parse_key(p, &key) || p->error != AGENT_OK) {
             return NULL;
         }
 
@@ -602,18 +1194,22 @@ static agent_json_value_t* parse_object(json_parser_t* p) {
             return NULL;
         }
 
+        size_t property = 0;
+        const agent_property_schema_t* prop = schema_find_property(
+            schema, key, &property);
+
         skip_whitespace(p);
+        p->schema = prop;
         agent_json_value_t* value = parse_value(p);
         if (!value || p->error != AGENT_OK) {
             return NULL;
         }
 
-        agent_error_t err = agent_json_object_set_n(p->ctx, object,
-            key_val->data.string_value.data,
-            key_val->data.string_value.length,
-            value);
-        if (err != AGENT_OK) {
-            set_error(p, "Out of memory");
+        if (fields && prop) {
+            fields[property] = value;
+        }
+
+        if (!stack_push(p, key, value)) {
             return NULL;
         }
 
@@ -625,7 +1221,41 @@ static agent_json_value_t* parse_object(json_parser_t* p) {
         return NULL;
     }
 
-    return object;
+    /* Copy the entries out at their exact count; keys already live in the arena */
+    size_t count = p->stack_count - base;
+    agent_json_entry_t* entries = agent_context_alloc(p->ctx, count * sizeof(agent_json_entry_t));
+    if (!entries) {
+        set_error(p, "Out of memory");
+        return NULL;
+    }
+    memcpy(entries, p->stack + base, count * sizeof(agent_json_entry_t));
+    p->stack_count = base;
+
+    object->data.object_value.entries = entries;
+    object->data.object_value.count = count;
+    object->data.object_value.capacity = count;
+
+    /* A repeated key replaces the earlier value, as agent_json_object_set does */
+    if (count >= AGENT_JSON_INDEX_THRESHOLD) {
+        if (object_build_index(p->ctx, object, count) != AGENT_OK) {
+            set_error(p, "Out of memory");
+            return NULL;
+        }
+    } else {
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            object->data.object_value.count = kept;
+            agent_json_entry_t* existing = object_find(object, entries[i].key.data,
+                                                       entries[i].key.length);
+            if (existing) {
+                existing->value = entries[i].value;
+            } else {
+                entries[kept++] = entries[i];
+            }
+        }
+        object->data.object_value.count = kept;
+    }
+    return schema_check_required(p, schema, object) ? object : NULL;
 }
 
 /* Parse any value */
@@ -639,6 +1269,25 @@ static agent_json_value_t* parse_value(json_parser_t* p) {
 
     char c = peek(p);
 
+    /* Schema-validated mode: reject a mismatched type before parsing it */
+    const agent_property_schema_t* schema = p->schema;
+    p->schema = NULL;
+    if (schema) {
+        size_t start = p->pos;
+        if (!schema_accepts(schema, c)) {
+            schema_error(p, schema, start, "Type mismatch");
+            return NULL;
+        }
+        if (c == '[') return parse_array(p, schema);
+        if (c == '{') return parse_object(p, schema);
+
+        agent_json_value_t* value = parse_value(p);
+        if (value && !schema_check_value(p, schema, value, start)) {
+            return NULL;
+        }
+        return value;
+    }
+
     if (c == 'n') {
         if (p->pos + 4 <= p->length && memcmp(p->json + p->pos, "null", 4) == 0) {
             p->pos += 4;
@@ -657,9 +1306,9 @@ static agent_json_value_t* parse_value(json_parser_t* p) {
     } else if (c == '"') {
         return parse_string(p);
     } else if (c == '[') {
-        return parse_array(p);
+        return parse_array(p, NULL);
     } else if (c == '{') {
-        return parse_object(p);
+        return parse_object(p, NULL);
     } else if (c == '-' || (c >= '0' && c <= '9')) {
         return parse_number(p);
     }
@@ -670,7 +1319,33 @@ static agent_json_value_t* parse_value(json_parser_t* p) {
 
 /* Public parsing functions */
 
-agent_json_parse_result_t agent_json_parse(agent_context_t* ctx, const char* json, size_t length) {
+static agent_json_parse_result_t run_parser(json_parser_t* parser) {
+    agent_json_parse_result_t result = {0};
+
+    AGENT_TRACE_BEGIN(agent_json_parse);
+    result.value = parse_value(parser);
+    agent_mem_free(parser->stack);
+    parser->stack = NULL;
+    result.error = parser->error;
+    result.error_message = parser->error_message;
+    result.error_position = parser->pos;
+
+    /* Check for trailing content */
+    if (result.error == AGENT_OK) {
+        skip_whitespace(parser);
+        if (!is_at_end(parser)) {
+            result.error = AGENT_ERROR_PARSE_ERROR;
+            result.error_message = "Unexpected content after JSON";
+            result.error_position = parser->pos;
+        }
+    }
+    AGENT_TRACE_END(agent_json_parse);
+
+    return result;
+}
+
+static agent_json_parse_result_t parse_document(agent_context_t* ctx, const char* json,
+                                                size_t length, char* insitu) {
     agent_json_parse_result_t result = {0};
 
     if (!ctx || !json) {
@@ -685,24 +1360,72 @@ agent_json_parse_result_t agent_json_parse(agent_context_t* ctx, const char* jso
         .length = length,
         .pos = 0,
         .error = AGENT_OK,
-        .error_message = NULL
+        .error_message = NULL,
+        .stack = NULL,
+        .stack_count = 0,
+        .stack_capacity = 0,
+        .insitu = insitu
     };
 
-    result.value = parse_value(&parser);
-    result.error = parser.error;
-    result.error_message = parser.error_message;
-    result.error_position = parser.pos;
+    return run_parser(&parser);
+}
 
-    /* Check for trailing content */
-    if (result.error == AGENT_OK) {
-        skip_whitespace(&parser);
-        if (!is_at_end(&parser)) {
-            result.error = AGENT_ERROR_PARSE_ERROR;
-            result.error_message = "Unexpected content after JSON";
-            result.error_position = parser.pos;
+agent_json_parse_result_t agent_json_parse(agent_context_t* ctx, const char* json, size_t length) {
+    return parse_document(ctx, json, length, NULL);
+}
+
+agent_json_parse_result_t agent_json_parse_insitu(agent_context_t* ctx, char* json, size_t length) {
+    return parse_document(ctx, json, length, json);
+}
+
+agent_json_validated_result_t agent_json_parse_validated(agent_context_t* ctx, const char* json,
+                                                         size_t length,
+                                                         const agent_tool_definition_t* tool) {
+    agent_json_validated_result_t result = {0};
+
+    if (!ctx || !json || !tool) {
+        result.error = AGENT_ERROR_INVALID_ARGUMENT;
+        result.error_message = "Invalid arguments";
+        return result;
+    }
+
+    agent_json_value_t** fields = NULL;
+    if (tool->parameters_count > 0) {
+        fields = agent_context_calloc(ctx, tool->parameters_count, sizeof(agent_json_value_t*));
+        if (!fields) {
+            result.error = AGENT_ERROR_OUT_OF_MEMORY;
+            result.error_message = "Out of memory";
+            return result;
         }
     }
 
+    /* The parameter list acts as the schema of the root object */
+    agent_property_schema_t root = {0};
+    root.type = AGENT_SCHEMA_OBJECT;
+    root.properties = tool->parameters;
+    root.properties_count = tool->parameters_count;
+
+    json_parser_t parser = {
+        .ctx = ctx,
+        .json = json,
+        .length = length,
+        .error = AGENT_OK,
+        .schema = &root,
+        .fields = fields
+    };
+
+    agent_json_parse_result_t parsed = run_parser(&parser);
+    result.error = parsed.error;
+    result.error_message = parsed.error_message;
+    result.error_position = parsed.error_position;
+    if (parsed.error != AGENT_OK) {
+        result.error_field = parser.error_field;
+        return result;
+    }
+
+    result.value = parsed.value;
+    result.fields = fields;
+    result.field_count = tool->parameters_count;
     return result;
 }
 
@@ -716,43 +1439,1076 @@ agent_json_parse_result_t agent_json_parse_cstr(agent_context_t* ctx, const char
     return agent_json_parse(ctx, json, strlen(json));
 }
 
-/* Serialization helpers */
+/* Tape representation
+ *
+ * Each slot is an 8-bit tag in the top byte and a 56-bit payload:
+ *   '{' '['  payload = index of the matching close slot | count << 32
+ *   '}' ']'  payload = index of the matching open slot
+ *   '"'      payload = offset into the string area; next slot = length
+ *   'l' 'd'  next slot = raw int64 / double bits
+ *   'n' 't' 'f'
+ * Object members are laid out as a key string followed by its value.
+ */
 
-static agent_error_t serialize_string(const char* str, size_t len, agent_string_t* out) {
-    agent_error_t err = agent_string_append_char(out, '"');
-    if (err != AGENT_OK) return err;
+#define TAPE_TAG_SHIFT 56
+#define TAPE_PAYLOAD_MASK ((UINT64_C(1) << TAPE_TAG_SHIFT) - 1)
+#define TAPE_COUNT_SHIFT 32
+#define TAPE_COUNT_MAX 0xFFFFFFu
+
+typedef struct {
+    json_parser_t base;
+    uint64_t* slots;
+    size_t slot_count;
+    size_t slot_capacity;
+    char* strings;
+    size_t strings_length;
+    size_t strings_capacity;
+} tape_parser_t;
+
+static inline uint64_t tape_slot(char tag, uint64_t payload) {
+    return ((uint64_t)(unsigned char)tag << TAPE_TAG_SHIFT) | (payload & TAPE_PAYLOAD_MASK);
+}
+
+static inline char tape_tag(uint64_t slot) {
+    return (char)(slot >> TAPE_TAG_SHIFT);
+}
+
+static bool tape_push(tape_parser_t* tp, uint64_t slot) {
+    if (tp->slot_count >= tp->slot_capacity) {
+        size_t new_capacity = tp->slot_capacity * 2;
+        uint64_t* slots = agent_mem_realloc(tp->slots, new_capacity * sizeof(uint64_t));
+        if (!slots) {
+            set_error(&tp->base, "Out of memory");
+            return false;
+        }
+        tp->slots = slots;
+        tp->slot_capacity = new_capacity;
+    }
+    tp->slots[tp->slot_count++] = slot;
+    return true;
+}
+
+static bool tape_string(tape_parser_t* tp) {
+    json_parser_t* p = &tp->base;
+    size_t start;
+    size_t len;
+    bool has_escapes;
+    if (!scan_string(p, &start, &len, &has_escapes)) {
+        return false;
+    }
+
+    if (tp->strings_length + len + 1 > tp->strings_capacity) {
+        size_t new_capacity = tp->strings_capacity * 2;
+        while (new_capacity < tp->strings_length + len + 1) {
+            new_capacity *= 2;
+        }
+        char* strings = agent_mem_realloc(tp->strings, new_capacity);
+        if (!strings) {
+            set_error(p, "Out of memory");
+            return false;
+        }
+        tp->strings = strings;
+        tp->strings_capacity = new_capacity;
+    }
+
+    size_t offset = tp->strings_length;
+    char* dst = tp->strings + offset;
+    if (has_escapes) {
+        len = decode_escapes(p->json + start, len, dst);
+    } else {
+        memcpy(dst, p->json + start, len);
+    }
+    dst[len] = '\0';
+    tp->strings_length += len + 1;
+
+    return tape_push(tp, tape_slot('"', offset)) && tape_push(tp, (uint64_t)len);
+}
+
+static bool tape_value(tape_parser_t* tp);
+
+static bool tape_container(tape_parser_t* tp, char open, char close) {
+    json_parser_t* p = &tp->base;
+    advance(p);
+
+    size_t open_index = tp->slot_count;
+    if (!tape_push(tp, 0)) return false;
+
+    size_t count = 0;
+    skip_whitespace(p);
+    if (!match(p, close)) {
+        for (;;) {
+            if (open == '{') {
+                skip_whitespace(p);
+                if (!tape_string(tp)) return false;
+                skip_whitespace(p);
+                if (!match(p, ':')) {
+                    set_error(p, "Expected ':'");
+                    return false;
+                }
+            }
+
+            if (!tape_value(tp)) return false;
+            count++;
+
+            skip_whitespace(p);
+            if (match(p, close)) break;
+            if (!match(p, ',')) {
+                set_error(p, open == '{' ? "Expected ',' or '}'" : "Expected ',' or ']'");
+                return false;
+            }
+        }
+    }
+
+    size_t close_index = tp->slot_count;
+    if (!tape_push(tp, tape_slot(close, open_index))) return false;
+
+    uint64_t stored_count = count < TAPE_COUNT_MAX ? count : TAPE_COUNT_MAX;
+    tp->slots[open_index] = tape_slot(open, (stored_count << TAPE_COUNT_SHIFT) | close_index);
+    return true;
+}
+
+static bool tape_value(tape_parser_t* tp) {
+    json_parser_t* p = &tp->base;
+    skip_whitespace(p);
+
+    if (is_at_end(p)) {
+        set_error(p, "Unexpected end of input");
+        return false;
+    }
+
+    char c = peek(p);
+
+    if (c == 'n') {
+        if (p->pos + 4 <= p->length && memcmp(p->json + p->pos, "null", 4) == 0) {
+            p->pos += 4;
+            return tape_push(tp, tape_slot('n', 0));
+        }
+    } else if (c == 't') {
+        if (p->pos + 4 <= p->length && memcmp(p->json + p->pos, "true", 4) == 0) {
+            p->pos += 4;
+            return tape_push(tp, tape_slot('t', 0));
+        }
+    } else if (c == 'f') {
+        if (p->pos + 5 <= p->length && memcmp(p->json + p->pos, "false", 5) == 0) {
+            p->pos += 5;
+            return tape_push(tp, tape_slot('f', 0));
+        }
+    } else if (c == '"') {
+        return tape_string(tp);
+    } else if (c == '[') {
+        return tape_container(tp, '[', ']');
+    } else if (c == '{') {
+        return tape_container(tp, '{', '}');
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+        bool is_double;
+        int64_t i = 0;
+        double d = 0.0;
+        if (!scan_number(p, &is_double, &i, &d)) return false;
+
+        uint64_t bits;
+        if (is_double) {
+            memcpy(&bits, &d, sizeof(bits));
+        } else {
+            bits = (uint64_t)i;
+        }
+        return tape_push(tp, tape_slot(is_double ? 'd' : 'l', 0)) && tape_push(tp, bits);
+    }
+
+    set_error(p, "Unexpected character");
+    return false;
+}
+
+agent_json_tape_parse_result_t agent_json_tape_parse(agent_context_t* ctx, const char* json,
+                                                     size_t length) {
+    agent_json_tape_parse_result_t result = {0};
+
+    if (!ctx || !json) {
+        result.error = AGENT_ERROR_INVALID_ARGUMENT;
+        result.error_message = "Invalid arguments";
+        return result;
+    }
+
+    tape_parser_t tp = {0};
+    tp.base.ctx = ctx;
+    tp.base.json = json;
+    tp.base.length = length;
+    tp.base.error = AGENT_OK;
+
+    /* Scratch buffers on the heap; the arena gets one exact-size copy */
+    tp.slot_capacity = length / 4 + 16;
+    tp.strings_capacity = length / 2 + 16;
+    tp.slots = agent_mem_alloc(tp.slot_capacity * sizeof(uint64_t));
+    tp.strings = agent_mem_alloc(tp.strings_capacity);
+
+    if (!tp.slots || !tp.strings) {
+        set_error(&tp.base, "Out of memory");
+    } else if (tape_value(&tp)) {
+        skip_whitespace(&tp.base);
+        if (!is_at_end(&tp.base)) {
+            set_error(&tp.base, "Unexpected content after JSON");
+        }
+    }
+
+    if (tp.base.error == AGENT_OK) {
+        agent_json_tape_t* tape = agent_context_alloc(ctx, sizeof(agent_json_tape_t));
+        uint64_t* slots = agent_context_alloc(ctx, tp.slot_count * sizeof(uint64_t));
+        char* strings = agent_context_alloc(ctx, tp.strings_length > 0 ? tp.strings_length : 1);
+        if (tape && slots && strings) {
+            memcpy(slots, tp.slots, tp.slot_count * sizeof(uint64_t));
+            memcpy(strings, tp.strings, tp.strings_length);
+            tape->slots = slots;
+            tape->slot_count = tp.slot_count;
+            tape->strings = strings;
+            tape->strings_length = tp.strings_length;
+            result.tape = tape;
+        } else {
+            set_error(&tp.base, "Out of memory");
+        }
+    }
+
+    agent_mem_free(tp.slots);
+    agent_mem_free(tp.strings);
+
+    result.error = tp.base.error;
+    result.error_message = tp.base.error_message;
+    result.error_position = tp.base.pos;
+    if (result.error != AGENT_OK) {
+        result.tape = NULL;
+    }
+    return result;
+}
+
+/* Tape accessors */
+
+static const agent_json_tape_ref_t tape_end = {NULL, 0};
+
+agent_json_tape_ref_t agent_json_tape_root(const agent_json_tape_t* tape) {
+    if (!tape || tape->slot_count == 0) return tape_end;
+    agent_json_tape_ref_t ref = {tape, 0};
+    return ref;
+}
+
+bool agent_json_tape_valid(agent_json_tape_ref_t ref) {
+    if (!ref.tape || ref.index >= ref.tape->slot_count) return false;
+    char tag = tape_tag(ref.tape->slots[ref.index]);
+    return tag != '}' && tag != ']';
+}
+
+agent_json_type_t agent_json_tape_type(agent_json_tape_ref_t ref) {
+    if (!agent_json_tape_valid(ref)) return AGENT_JSON_NULL;
+
+    switch (tape_tag(ref.tape->slots[ref.index])) {
+        case 't':
+        case 'f': return AGENT_JSON_BOOL;
+        case 'l': return AGENT_JSON_INT;
+        case 'd': return AGENT_JSON_DOUBLE;
+        case '"': return AGENT_JSON_STRING;
+        case '[': return AGENT_JSON_ARRAY;
+        case '{': return AGENT_JSON_OBJECT;
+        default:  return AGENT_JSON_NULL;
+    }
+}
+
+agent_error_t agent_json_tape_get_bool(agent_json_tape_ref_t ref, bool* out_value) {
+    if (!out_value || agent_json_tape_type(ref) != AGENT_JSON_BOOL) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    *out_value = tape_tag(ref.tape->slots[ref.index]) == 't';
+    return AGENT_OK;
+}
+
+agent_error_t agent_json_tape_get_int(agent_json_tape_ref_t ref, int64_t* out_value) {
+    if (!out_value || agent_json_tape_type(ref) != AGENT_JSON_INT) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    *out_value = (int64_t)ref.tape->slots[ref.index + 1];
+    return AGENT_OK;
+}
+
+agent_error_t agent_json_tape_get_double(agent_json_tape_ref_t ref, double* out_value) {
+    if (!out_value) return AGENT_ERROR_INVALID_ARGUMENT;
+
+    agent_json_type_t type = agent_json_tape_type(ref);
+    if (type == AGENT_JSON_INT) {
+        *out_value = (double)(int64_t)ref.tape->slots[ref.index + 1];
+        return AGENT_OK;
+    }
+    if (type == AGENT_JSON_DOUBLE) {
+        memcpy(out_value, &ref.tape->slots[ref.index + 1], sizeof(double));
+        return AGENT_OK;
+    }
+    return AGENT_ERROR_INVALID_ARGUMENT;
+}
+
+agent_error_t agent_json_tape_get_string(agent_json_tape_ref_t ref, agent_string_view_t* out_value) {
+    if (!out_value || agent_json_tape_type(ref) != AGENT_JSON_STRING) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    out_value->data = ref.tape->strings + (ref.tape->slots[ref.index] & TAPE_PAYLOAD_MASK);
+    out_value->length = (size_t)ref.tape->slots[ref.index + 1];
+    return AGENT_OK;
+}
+
+agent_json_tape_ref_t agent_json_tape_next(agent_json_tape_ref_t ref) {
+    if (!agent_json_tape_valid(ref)) return tape_end;
+
+    uint64_t slot = ref.tape->slots[ref.index];
+    switch (tape_tag(slot)) {
+        case '{':
+        case '[':
+            /* Skip the whole container via its close slot */
+            ref.index = (size_t)(slot & 0xFFFFFFFFu) + 1;
+            break;
+        case '"':
+        case 'l':
+        case 'd':
+            ref.index += 2;
+            break;
+        default:
+            ref.index += 1;
+            break;
+    }
+    return ref;
+}
+
+agent_json_tape_ref_t agent_json_tape_child(agent_json_tape_ref_t ref) {
+    agent_json_type_t type = agent_json_tape_type(ref);
+    if (type != AGENT_JSON_ARRAY && type != AGENT_JSON_OBJECT) return tape_end;
+    ref.index += 1;
+    return ref;
+}
+
+size_t agent_json_tape_length(agent_json_tape_ref_t ref) {
+    agent_json_type_t type = agent_json_tape_type(ref);
+    if (type != AGENT_JSON_ARRAY && type != AGENT_JSON_OBJECT) return 0;
+
+    size_t count = (size_t)((ref.tape->slots[ref.index] & TAPE_PAYLOAD_MASK) >> TAPE_COUNT_SHIFT);
+    if (count < TAPE_COUNT_MAX) return count;
+
+    /* Saturated count: walk the children */
+    count = 0;
+    for (agent_json_tape_ref_t child = agent_json_tape_child(ref); agent_json_tape_valid(child);
+         child = agent_json_tape_next(child)) {
+        if (type == AGENT_JSON_OBJECT) child = agent_json_tape_next(child);
+        count++;
+    }
+    return count;
+}
+
+agent_json_tape_ref_t agent_json_tape_array_get(agent_json_tape_ref_t array, size_t index) {
+    if (agent_json_tape_type(array) != AGENT_JSON_ARRAY) return tape_end;
+
+    agent_json_tape_ref_t item = agent_json_tape_child(array);
+    while (index > 0 && agent_json_tape_valid(item)) {
+        item = agent_json_tape_next(item);
+        index--;
+    }
+    return agent_json_tape_valid(item) ? item : tape_end;
+}
+
+agent_json_tape_ref_t agent_json_tape_object_get(agent_json_tape_ref_t object, const char* key) {
+    if (!key || agent_json_tape_type(object) != AGENT_JSON_OBJECT) return tape_end;
+
+    /* The last of duplicate keys wins, as in the DOM */
+    agent_json_tape_ref_t found = tape_end;
+    size_t key_len = strlen(key);
+    for (agent_json_tape_ref_t member = agent_json_tape_child(object); agent_json_tape_valid(member);
+         member = agent_json_tape_next(agent_json_tape_next(member))) {
+        agent_string_view_t name;
+        if (agent_json_tape_get_string(member, &name) != AGENT_OK) {
+            continue;
+        }
+        if (name.length == key_len && memcmp(name.data, key, key_len) == 0) {
+            found = agent_json_tape_next(member);
+        }
+    }
+    return found;
+}
+
+agent_json_value_t* agent_json_tape_to_value(agent_context_t* ctx, agent_json_tape_ref_t ref) {
+    if (!ctx || !agent_json_tape_valid(ref)) return NULL;
+
+    switch (agent_json_tape_type(ref)) {
+        case AGENT_JSON_NULL:
+            return agent_json_null(ctx);
+
+        case AGENT_JSON_BOOL: {
+            bool b = false;
+            agent_json_tape_get_bool(ref, &b);
+            return agent_json_bool(ctx, b);
+        }
+
+        case AGENT_JSON_INT: {
+            int64_t i = 0;
+            agent_json_tape_get_int(ref, &i);
+            return agent_json_int(ctx, i);
+        }
+
+        case AGENT_JSON_DOUBLE: {
+            double d = 0.0;
+            agent_json_tape_get_double(ref, &d);
+            return agent_json_double(ctx, d);
+        }
+
+        case AGENT_JSON_STRING: {
+            agent_string_view_t sv;
+            agent_json_tape_get_string(ref, &sv);
+            return agent_json_string_n(ctx, sv.data, sv.length);
+        }
+
+        case AGENT_JSON_ARRAY: {
+            /* Counts are known up front, so containers are sized exactly */
+            agent_json_value_t* array = agent_json_array(ctx, agent_json_tape_length(ref));
+            if (!array) return NULL;
+            for (agent_json_tape_ref_t item = agent_json_tape_child(ref); agent_json_tape_valid(item);
+                 item = agent_json_tape_next(item)) {
+                agent_json_value_t* value = agent_json_tape_to_value(ctx, item);
+                if (!value || agent_json_array_append(ctx, array, value) != AGENT_OK) {
+                    return NULL;
+                }
+            }
+            return array;
+        }
+
+        case AGENT_JSON_OBJECT: {
+            agent_json_value_t* object = agent_json_object(ctx, agent_json_tape_length(ref));
+            if (!object) return NULL;
+            for (agent_json_tape_ref_t member = agent_json_tape_child(ref); agent_json_tape_valid(member);
+                 member = agent_json_tape_next(agent_json_tape_next(member))) {
+                agent_string_view_t key;
+                agent_json_tape_get_string(member, &key);
+                agent_json_value_t* value = agent_json_tape_to_value(ctx, agent_json_tape_next(member));
+                if (!value || agent_json_object_set_n(ctx, object, key.data, key.length, value) != AGENT_OK) {
+                    return NULL;
+                }
+            }
+            return object;
+        }
+    }
+
+    return NULL;
+}
+
+/* Incremental parsing */
+
+enum {
+    MEMBER_EXPECT_KEY = 0,
+    MEMBER_IN_KEY,
+    MEMBER_EXPECT_COLON,
+    MEMBER_EXPECT_VALUE,
+    MEMBER_IN_VALUE
+};
+
+agent_error_t agent_json_incremental_init(agent_json_incremental_t* inc, agent_context_t* ctx) {
+    if (!inc || !ctx) return AGENT_ERROR_INVALID_ARGUMENT;
+
+    memset(inc, 0, sizeof(*inc));
+    inc->ctx = ctx;
+    return agent_string_init(&inc->buffer, 256);
+}
+
+void agent_json_incremental_free(agent_json_incremental_t* inc) {
+    if (!inc) return;
+    agent_string_free(&inc->buffer);
+    agent_mem_free(inc->fields);
+    inc->fields = NULL;
+    inc->field_count = 0;
+    inc->field_capacity = 0;
+}
+
+void agent_json_incremental_reset(agent_json_incremental_t* inc) {
+    if (!inc) return;
+    agent_string_clear(&inc->buffer);
+    inc->status = AGENT_JSON_INCREMENTAL_NEED_MORE;
+    inc->scan_pos = 0;
+    inc->depth = 0;
+    inc->in_string = false;
+    inc->escape = false;
+    inc->member_state = MEMBER_EXPECT_KEY;
+    inc->key_start = 0;
+    inc->key_end = 0;
+    inc->value_start = 0;
+    inc->field_count = 0;
+    inc->value = NULL;
+}
+
+static bool incremental_record_field(agent_json_incremental_t* inc, size_t value_end) {
+    const char* data = inc->buffer.data;
+
+    while (value_end > inc->value_start && agent_simd_is_json_space(data[value_end - 1])) {
+        value_end--;
+    }
+
+    if (inc->field_count >= inc->field_capacity) {
+        size_t new_capacity = inc->field_capacity ? inc->field_capacity * 2 : 8;
+        agent_json_incremental_field_t* fields = agent_mem_realloc(
+            inc->fields, new_capacity * sizeof(agent_json_incremental_field_t));
+        if (!fields) return false;
+        inc->fields = fields;
+        inc->field_capacity = new_capacity;
+    }
+
+    agent_json_incremental_field_t* field = &inc->fields[inc->field_count++];
+    field->key_start = inc->key_start;
+    field->key_length = inc->key_end - inc->key_start;
+    field->value_start = inc->value_start;
+    field->value_length = value_end - inc->value_start;
+    field->value = NULL;
+    return true;
+}
+
+/* Advance the structural scanner over one byte outside of a string */
+static agent_json_incremental_status_t incremental_step(agent_json_incremental_t* inc, size_t pos) {
+    char c = inc->buffer.data[pos];
+    bool top_object = inc->depth == 1 && inc->containers[0] == '{';
+
+    if (inc->depth == 0) {
+        if (agent_simd_is_json_space(c)) return AGENT_JSON_INCREMENTAL_NEED_MORE;
+        if (c != '{' && c != '[') return AGENT_JSON_INCREMENTAL_ERROR;
+        inc->containers[inc->depth++] = c;
+        inc->member_state = MEMBER_EXPECT_KEY;
+        return AGENT_JSON_INCREMENTAL_NEED_MORE;
+    }
+
+    if (top_object) {
+        switch (inc->member_state) {
+            case MEMBER_EXPECT_KEY:
+                if (agent_simd_is_json_space(c)) return AGENT_JSON_INCREMENTAL_NEED_MORE;
+                if (c == '}' && inc->field_count == 0) break;
+                if (c != '"') return AGENT_JSON_INCREMENTAL_ERROR;
+                inc->in_string = true;
+                inc->key_start = pos + 1;
+                inc->member_state = MEMBER_IN_KEY;
+                return AGENT_JSON_INCREMENTAL_NEED_MORE;
+
+            case MEMBER_EXPECT_COLON:
+                if (agent_simd_is_json_space(c)) return AGENT_JSON_INCREMENTAL_NEED_MORE;
+                if (c != ':') return AGENT_JSON_INCREMENTAL_ERROR;
+                inc->member_state = MEMBER_EXPECT_VALUE;
+                return AGENT_JSON_INCREMENTAL_NEED_MORE;
+
+            case MEMBER_EXPECT_VALUE:
+                if (agent_simd_is_json_space(c)) return AGENT_JSON_INCREMENTAL_NEED_MORE;
+                if (c == ',' || c == '}' || c == ':') return AGENT_JSON_INCREMENTAL_ERROR;
+                inc->value_start = pos;
+                inc->member_state = MEMBER_IN_VALUE;
+                break;
 
-    for (size_t i = 0; i < len; i++) {
-        unsigned char c = (unsigned char)str[i];
-        switch (c) {
-            case '"':  err = agent_string_append(out, "\\\""); break;
-            case '\\': err = agent_string_append(out, "\\\\"); break;
-            case '\b': err = agent_string_append(out, "\\b"); break;
-            case '\f': err = agent_string_append(out, "\\f"); break;
-            case '\n': err = agent_string_append(out, "\\n"); break;
-            case '\r': err = agent_string_append(out, "\\r"); break;
-            case '\t': err = agent_string_append(out, "\\t"); break;
             default:
-                if (c < 0x20) {
-                    err = agent_string_append_fmt(out, "\\u%04x", c);
-                } else {
-                    err = agent_string_append_char(out, (char)c);
+                if (c == ',' || c == '}') {
+                    if (!incremental_record_field(inc, pos)) return AGENT_JSON_INCREMENTAL_ERROR;
+                    inc->member_state = MEMBER_EXPECT_KEY;
+                    if (c == ',') return AGENT_JSON_INCREMENTAL_NEED_MORE;
                 }
                 break;
         }
-        if (err != AGENT_OK) return err;
     }
 
+    switch (c) {
+        case '"':
+            inc->in_string = true;
+            break;
+        case '{':
+        case '[':
+            if (inc->depth >= AGENT_JSON_INCREMENTAL_MAX_DEPTH) return AGENT_JSON_INCREMENTAL_ERROR;
+            inc->containers[inc->depth++] = c;
+            break;
+        case '}':
+        case ']':
+            if (inc->containers[inc->depth - 1] != (c == '}' ? '{' : '[')) {
+                return AGENT_JSON_INCREMENTAL_ERROR;
+            }
+            if (--inc->depth == 0) return AGENT_JSON_INCREMENTAL_COMPLETE;
+            break;
+        default:
+            break;
+    }
+
+    return AGENT_JSON_INCREMENTAL_NEED_MORE;
+}
+
+agent_json_incremental_status_t agent_json_incremental_feed(agent_json_incremental_t* inc,
+                                                            const char* data, size_t length) {
+    if (!inc || (!data && length > 0)) return AGENT_JSON_INCREMENTAL_ERROR;
+    if (inc->status != AGENT_JSON_INCREMENTAL_NEED_MORE || length == 0) return inc->status;
+
+    if (agent_string_append_n(&inc->buffer, data, length) != AGENT_OK) {
+        inc->status = AGENT_JSON_INCREMENTAL_ERROR;
+        return inc->status;
+    }
+
+    const char* buf = inc->buffer.data;
+    size_t end = inc->buffer.length;
+    size_t pos = inc->scan_pos;
+
+    while (pos < end) {
+        if (inc->in_string) {
+            /* Skip to the next quote or backslash */
+            if (inc->escape) {
+                inc->escape = false;
+                pos++;
+                continue;
+            }
+            pos += agent_simd_find_either(buf + pos, end - pos, '"', '\\');
+            if (pos >= end) break;
+            if (buf[pos] == '\\') {
+                inc->escape = true;
+            } else if (buf[pos] == '"') {
+                inc->in_string = false;
+                if (inc->depth == 1 && inc->containers[0] == '{' &&
+                    inc->member_state == MEMBER_IN_KEY) {
+                    inc->key_end = pos;
+                    inc->member_state = MEMBER_EXPECT_COLON;
+                }
+            }
+            pos++;
+            continue;
+        }
+
+        agent_json_incremental_status_t status = incremental_step(inc, pos);
+        pos++;
+        if (status != AGENT_JSON_INCREMENTAL_NEED_MORE) {
+            inc->status = status;
+            if (status == AGENT_JSON_INCREMENTAL_COMPLETE) {
+                /* Drop anything fed past the closing bracket */
+                inc->buffer.length = pos;
+                inc->buffer.data[pos] = '\0';
+            }
+            break;
+        }
+    }
+
+    inc->scan_pos = pos;
+    return inc->status;
+}
+
+agent_json_value_t* agent_json_incremental_value(agent_json_incremental_t* inc) {
+    if (!inc || inc->status != AGENT_JSON_INCREMENTAL_COMPLETE) return NULL;
+
+    if (!inc->value) {
+        agent_json_parse_result_t result = agent_json_parse(inc->ctx, inc->buffer.data,
+                                                            inc->buffer.length);
+        if (result.error != AGENT_OK) {
+            inc->status = AGENT_JSON_INCREMENTAL_ERROR;
+            return NULL;
+        }
+        inc->value = result.value;
+    }
+    return inc->value;
+}
+
+agent_json_value_t* agent_json_incremental_field(agent_json_incremental_t* inc, const char* key) {
+    if (!inc || !key || inc->status == AGENT_JSON_INCREMENTAL_ERROR) return NULL;
+
+    size_t key_length = strlen(key);
+    for (size_t i = 0; i < inc->field_count; i++) {
+        agent_json_incremental_field_t* field = &inc->fields[i];
+        if (field->key_length != key_length ||
+            memcmp(inc->buffer.data + field->key_start, key, key_length) != 0) {
+            continue;
+        }
+
+        if (!field->value) {
+            agent_json_parse_result_t result = agent_json_parse(
+                inc->ctx, inc->buffer.data + field->value_start, field->value_length);
+            if (result.error != AGENT_OK) return NULL;
+            field->value = result.value;
+        }
+        return field->value;
+    }
+    return NULL;
+}
+
+/* Serialization helpers */
+
+#define SERIALIZE_INDENT_WIDTH 2
+#define SERIALIZE_NUMBER_MAX 32
+
+/* Number formatting
+ *
+ * Doubles are printed with Grisu2 (Loitsch, "Printing Floating-Point Numbers
+ * Quickly and Accurately with Integers"): the shortest digit string that
+ * reads back to the same double, produced with integer arithmetic only.
+ */
+
+typedef struct {
+    uint64_t f;
+    int e;
+} diy_fp_t;
+
+/* Normalized 10^k for k = -348, -340, ..., 340 */
+static const diy_fp_t grisu_cached_powers[] = {
+    {UINT64_C(0xfa8fd5a0081c0288), -1220},
+    {UINT64_C(0xbaaee17fa23ebf76), -1193},
+    {UINT64_C(0x8b16fb203055ac76), -1166},
+    {UINT64_C(0xcf42894a5dce35ea), -1140},
+    {UINT64_C(0x9a6bb0aa55653b2d), -1113},
+    {UINT64_C(0xe61acf033d1a45df), -1087},
+    {UINT64_C(0xab70fe17c79ac6ca), -1060},
+    {UINT64_C(0xff77b1fcbebcdc4f), -1034},
+    {UINT64_C(0xbe5691ef416bd60c), -1007},
+    {UINT64_C(0x8dd01fad907ffc3c), -980},
+    {UINT64_C(0xd3515c2831559a83), -954},
+    {UINT64_C(0x9d71ac8fada6c9b5), -927},
+    {UINT64_C(0xea9c227723ee8bcb), -901},
+    {UINT64_C(0xaecc49914078536d), -874},
+    {UINT64_C(0x823c12795db6ce57), -847},
+    {UINT64_C(0xc21094364dfb5637), -821},
+    {UINT64_C(0x9096ea6f3848984f), -794},
+    {UINT64_C(0xd77485cb25823ac7), -768},
+    {UINT64_C(0xa086cfcd97bf97f4), -741},
+    {UINT64_C(0xef340a98172aace5), -715},
+    {UINT64_C(0xb23867fb2a35b28e), -688},
+    {UINT64_C(0x84c8d4dfd2c63f3b), -661},
+    {UINT64_C(0xc5dd44271ad3cdba), -635},
+    {UINT64_C(0x936b9fcebb25c996), -608},
+    {UINT64_C(0xdbac6c247d62a584), -582},
+    {UINT64_C(0xa3ab66580d5fdaf6), -555},
+    {UINT64_C(0xf3e2f893dec3f126), -529},
+    {UINT64_C(0xb5b5ada8aaff80b8), -502},
+    {UINT64_C(0x87625f056c7c4a8b), -475},
+    {UINT64_C(0xc9bcff6034c13053), -449},
+    {UINT64_C(0x964e858c91ba2655), -422},
+    {UINT64_C(0xdff9772470297ebd), -396},
+    {UINT64_C(0xa6dfbd9fb8e5b88f), -369},
+    {UINT64_C(0xf8a95fcf88747d94), -343},
+    {UINT64_C(0xb94470938fa89bcf), -316},
+    {UINT64_C(0x8a08f0f8bf0f156b), -289},
+    {UINT64_C(0xcdb02555653131b6), -263},
+    {UINT64_C(0x993fe2c6d07b7fac), -236},
+    {UINT64_C(0xe45c10c42a2b3b06), -210},
+    {UINT64_C(0xaa242499697392d3), -183},
+    {UINT64_C(0xfd87b5f28300ca0e), -157},
+    {UINT64_C(0xbce5086492111aeb), -130},
+    {UINT64_C(0x8cbccc096f5088cc), -103},
+    {UINT64_C(0xd1b71758e219652c), -77},
+    {UINT64_C(0x9c40000000000000), -50},
+    {UINT64_C(0xe8d4a51000000000), -24},
+    {UINT64_C(0xad78ebc5ac620000), 3},
+    {UINT64_C(0x813f3978f8940984), 30},
+    {UINT64_C(0xc097ce7bc90715b3), 56},
+    {UINT64_C(0x8f7e32ce7bea5c70), 83},
+    {UINT64_C(0xd5d238a4abe98068), 109},
+    {UINT64_C(0x9f4f2726179a2245), 136},
+    {UINT64_C(0xed63a231d4c4fb27), 162},
+    {UINT64_C(0xb0de65388cc8ada8), 189},
+    {UINT64_C(0x83c7088e1aab65db), 216},
+    {UINT64_C(0xc45d1df942711d9a), 242},
+    {UINT64_C(0x924d692ca61be758), 269},
+    {UINT64_C(0xda01ee641a708dea), 295},
+    {UINT64_C(0xa26da3999aef774a), 322},
+    {UINT64_C(0xf209787bb47d6b85), 348},
+    {UINT64_C(0xb454e4a179dd1877), 375},
+    {UINT64_C(0x865b86925b9bc5c2), 402},
+    {UINT64_C(0xc83553c5c8965d3d), 428},
+    {UINT64_C(0x952ab45cfa97a0b3), 455},
+    {UINT64_C(0xde469fbd99a05fe3), 481},
+    {UINT64_C(0xa59bc234db398c25), 508},
+    {UINT64_C(0xf6c69a72a3989f5c), 534},
+    {UINT64_C(0xb7dcbf5354e9bece), 561},
+    {UINT64_C(0x88fcf317f22241e2), 588},
+    {UINT64_C(0xcc20ce9bd35c78a5), 614},
+    {UINT64_C(0x98165af37b2153df), 641},
+    {UINT64_C(0xe2a0b5dc971f303a), 667},
+    {UINT64_C(0xa8d9d1535ce3b396), 694},
+    {UINT64_C(0xfb9b7cd9a4a7443c), 720},
+    {UINT64_C(0xbb764c4ca7a44410), 747},
+    {UINT64_C(0x8bab8eefb6409c1a), 774},
+    {UINT64_C(0xd01fef10a657842c), 800},
+    {UINT64_C(0x9b10a4e5e9913129), 827},
+    {UINT64_C(0xe7109bfba19c0c9d), 853},
+    {UINT64_C(0xac2820d9623bf429), 880},
+    {UINT64_C(0x80444b5e7aa7cf85), 907},
+    {UINT64_C(0xbf21e44003acdd2d), 933},
+    {UINT64_C(0x8e679c2f5e44ff8f), 960},
+    {UINT64_C(0xd433179d9c8cb841), 986},
+    {UINT64_C(0x9e19db92b4e31ba9), 1013},
+    {UINT64_C(0xeb96bf6ebadf77d9), 1039},
+    {UINT64_C(0xaf87023b9bf0ee6b), 1066}
+};
+
+static const uint64_t grisu_pow10[] = {
+    UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000),
+    UINT64_C(100000), UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000),
+    UINT64_C(1000000000), UINT64_C(10000000000), UINT64_C(100000000000),
+    UINT64_C(1000000000000), UINT64_C(10000000000000), UINT64_C(100000000000000),
+    UINT64_C(1000000000000000), UINT64_C(10000000000000000),
+    UINT64_C(100000000000000000), UINT64_C(1000000000000000000),
+    UINT64_C(10000000000000000000)
+};
+
+#define DP_SIGNIFICAND_BITS 52
+#define DP_HIDDEN_BIT (UINT64_C(1) << DP_SIGNIFICAND_BITS)
+#define DP_SIGNIFICAND_MASK (DP_HIDDEN_BIT - 1)
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_BITS)
+
+static diy_fp_t diy_fp_multiply(diy_fp_t x, diy_fp_t y) {
+    const uint64_t mask32 = 0xFFFFFFFFu;
+    uint64_t a = x.f >> 32, b = x.f & mask32;
+    uint64_t c = y.f >> 32, d = y.f & mask32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & mask32) + (bc & mask32);
+    tmp += UINT64_C(1) << 31;  /* Round */
+
+    diy_fp_t r = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+    return r;
+}
+
+static diy_fp_t diy_fp_normalize(diy_fp_t x) {
+    while (!(x.f & (UINT64_C(1) << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+static void grisu_round(char* buffer, int length, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_digits32(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= grisu_pow10[digits]) {
+        digits++;
+    }
+    return digits;
+}
+
+static void grisu_digit_gen(diy_fp_t w, diy_fp_t mp, uint64_t delta,
+                            char* buffer, int* length, int* k) {
+    diy_fp_t one = {UINT64_C(1) << -mp.e, mp.e};
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_digits32(p1);
+    *length = 0;
+
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)grisu_pow10[kappa - 1];
+        uint32_t d = p1 / divisor;
+        p1 %= divisor;
+        if (d || *length) {
+            buffer[(*length)++] = (char)('0' + d);
+        }
+        kappa--;
+
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(buffer, *length, delta, rest, grisu_pow10[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || *length) {
+            buffer[(*length)++] = (char)('0' + d);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+
+        if (p2 < delta) {
+            *k += kappa;
+            int index = -kappa;
+            grisu_round(buffer, *length, delta, p2, one.f,
+                        index < 20 ? wp_w * grisu_pow10[index] : 0);
+            return;
+        }
+    }
+}
+
+/* Shortest digits of a positive finite double: value = digits * 10^k */
+static void grisu2(double value, char* buffer, int* length, int* k) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int biased_e = (int)((bits >> DP_SIGNIFICAND_BITS) & 0x7FF);
+    uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+    diy_fp_t v;
+    if (biased_e != 0) {
+        v.f = significand + DP_HIDDEN_BIT;
+        v.e = biased_e - DP_EXPONENT_BIAS;
+    } else {
+        v.f = significand;
+        v.e = 1 - DP_EXPONENT_BIAS;
+    }
+
+    /* Boundaries halfway to the neighbouring doubles */
+    diy_fp_t plus = {(v.f << 1) + 1, v.e - 1};
+    while (!(plus.f & (DP_HIDDEN_BIT << 1))) {
+        plus.f <<= 1;
+        plus.e--;
+    }
+    plus.f <<= 64 - DP_SIGNIFICAND_BITS - 2;
+    plus.e -= 64 - DP_SIGNIFICAND_BITS - 2;
+
+    diy_fp_t minus;
+    if (v.f == DP_HIDDEN_BIT) {
+        minus.f = (v.f << 2) - 1;
+        minus.e = v.e - 2;
+    } else {
+        minus.f = (v.f << 1) - 1;
+        minus.e = v.e - 1;
+    }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    /* Pick the cached power that brings the exponent into [-60, -32] */
+    double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    int ck = (int)dk;
+    if (ck != dk) ck++;
+    unsigned index = (unsigned)((ck >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    diy_fp_t c_mk = grisu_cached_powers[index];
+
+    diy_fp_t w = diy_fp_multiply(diy_fp_normalize(v), c_mk);
+    diy_fp_t wp = diy_fp_multiply(plus, c_mk);
+    diy_fp_t wm = diy_fp_multiply(minus, c_mk);
+    wm.f++;
+    wp.f--;
+    grisu_digit_gen(w, wp, wp.f - wm.f, buffer, length, k);
+}
+
+static char* write_exponent(int k, char* out) {
+    if (k < 0) {
+        *out++ = '-';
+        k = -k;
+    }
+    if (k >= 100) {
+        *out++ = (char)('0' + k / 100);
+        k %= 100;
+        *out++ = (char)('0' + k / 10);
+    } else if (k >= 10) {
+        *out++ = (char)('0' + k / 10);
+    }
+    *out++ = (char)('0' + k % 10);
+    return out;
+}
+
+/* Lay out digits * 10^k as a JSON number; returns the end of the text */
+static char* format_digits(char* buffer, int length, int k) {
+    int kk = length + k;  /* 10^(kk-1) <= value < 10^kk */
+
+    if (length <= kk && kk <= 21) {
+        /* Whole number: 1234e5 -> 123400000 */
+        for (int i = length; i < kk; i++) {
+            buffer[i] = '0';
+        }
+        return buffer + kk;
+    }
+    if (0 < kk && kk <= 21) {
+        /* 1234e-2 -> 12.34 */
+        memmove(buffer + kk + 1, buffer + kk, (size_t)(length - kk));
+        buffer[kk] = '.';
+        return buffer + length + 1;
+    }
+    if (-6 < kk && kk <= 0) {
+        /* 1234e-6 -> 0.001234 */
+        int offset = 2 - kk;
+        memmove(buffer + offset, buffer, (size_t)length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for (int i = 2; i < offset; i++) {
+            buffer[i] = '0';
+        }
+        return buffer + length + offset;
+    }
+    if (length == 1) {
+        /* 1e30 */
+        buffer[1] = 'e';
+        return write_exponent(kk - 1, buffer + 2);
+    }
+    /* 1234e30 -> 1.234e33 */
+    memmove(buffer + 2, buffer + 1, (size_t)(length - 1));
+    buffer[1] = '.';
+    buffer[length + 1] = 'e';
+    return write_exponent(kk - 1, buffer + length + 2);
+}
+
+/* Format a finite double; buffer needs SERIALIZE_NUMBER_MAX bytes */
+static size_t format_double(double value, char* buffer) {
+    char* p = buffer;
+    if (value == 0.0) {
+        *p++ = '0';
+        return 1;
+    }
+    if (value < 0) {
+        *p++ = '-';
+        value = -value;
+    }
+
+    int length;
+    int k;
+    grisu2(value, p, &length, &k);
+    return (size_t)(format_digits(p, length, k) - buffer);
+}
+
+static agent_error_t serialize_string(const char* str, size_t len, agent_string_t* out) {
+    agent_error_t err = agent_string_append_char(out, '"');
+    if (err != AGENT_OK) return err;
+
+    err = agent_string_append_sv_escaped(out, agent_sv_from_parts(str, len));
+    if (err != AGENT_OK) return err;
+
     return agent_string_append_char(out, '"');
 }
 
+/* Upper bound on the serialized size, used to reserve the output once.
+   Strings are counted unescaped; escapes are rare and grow the buffer. */
+static size_t serialize_estimate(const agent_json_value_t* value, bool pretty, int depth) {
+    if (!value) return 4;
+
+    size_t size = 0;
+    size_t indent = pretty ? (size_t)(depth + 1) * SERIALIZE_INDENT_WIDTH + 1 : 0;
+
+    switch (value->type) {
+        case AGENT_JSON_NULL:
+            return 4;
+        case AGENT_JSON_BOOL:
+            return 5;
+        case AGENT_JSON_INT:
+        case AGENT_JSON_DOUBLE:
+            return SERIALIZE_NUMBER_MAX;
+        case AGENT_JSON_STRING:
+            return value->data.string_value.length + 2;
+        case AGENT_JSON_ARRAY:
+            size = 2 + indent;
+            for (size_t i = 0; i < value->data.array_value.count; i++) {
+                size += indent + 1 +
+                        serialize_estimate(value->data.array_value.items[i], pretty, depth + 1);
+            }
+            return size;
+        case AGENT_JSON_OBJECT:
+            size = 2 + indent;
+            for (size_t i = 0; i < value->data.object_value.count; i++) {
+                const agent_json_entry_t* entry = &value->data.object_value.entries[i];
+                size += indent + entry->key.length + 5 +
+                        serialize_estimate(entry->value, pretty, depth + 1);
+            }
+            return size;
+    }
+    return 0;
+}
+
 static agent_error_t serialize_value(const agent_json_value_t* value, agent_string_t* out,
                                      bool pretty, int depth);
 
 static agent_error_t serialize_indent(agent_string_t* out, int depth) {
-    for (int i = 0; i < depth; i++) {
-        agent_error_t err = agent_string_append(out, "  ");
+    static const char spaces[] = "                                ";
+    size_t remaining = (size_t)depth * SERIALIZE_INDENT_WIDTH;
+    while (remaining > 0) {
+        size_t chunk = remaining < sizeof(spaces) - 1 ? remaining : sizeof(spaces) - 1;
+        agent_error_t err = agent_string_append_n(out, spaces, chunk);
         if (err != AGENT_OK) return err;
+        remaining -= chunk;
     }
     return AGENT_OK;
 }
@@ -870,18 +2626,15 @@ static agent_error_t serialize_value(const agent_json_value_t* value, agent_stri
             return agent_string_append(out, value->data.bool_value ? "true" : "false");
 
         case AGENT_JSON_INT:
-            return agent_string_append_fmt(out, "%lld", (long long)value->data.int_value);
+            return agent_string_append_i64(out, value->data.int_value);
 
         case AGENT_JSON_DOUBLE: {
             double d = value->data.double_value;
             if (isnan(d) || isinf(d)) {
                 return agent_string_append(out, "null");
             }
-            /* Check if it's a whole number */
-            if (floor(d) == d && fabs(d) < 1e15) {
-                return agent_string_append_fmt(out, "%.0f", d);
-            }
-            return agent_string_append_fmt(out, "%.15g", d);
+            char buf[SERIALIZE_NUMBER_MAX];
+            return agent_string_append_n(out, buf, format_double(d, buf));
         }
 
         case AGENT_JSON_STRING:
@@ -902,27 +2655,100 @@ agent_error_t agent_json_serialize(const agent_json_value_t* value, agent_string
     if (!str) {
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
+
+    agent_error_t err = agent_string_reserve(str, str->length + serialize_estimate(value, pretty, 0) + 1);
+    if (err != AGENT_OK) return err;
+
     return serialize_value(value, str, pretty, 0);
 }
 
+/* Bytewise key order; shorter keys sort before keys they prefix */
+static int entry_key_compare(const agent_json_entry_t* a, const agent_json_entry_t* b) {
+    size_t n = a->key.length < b->key.length ? a->key.length : b->key.length;
+    int cmp = n > 0 ? memcmp(a->key.data, b->key.data, n) : 0;
+    if (cmp != 0) return cmp;
+    return (a->key.length > b->key.length) - (a->key.length < b->key.length);
+}
+
+static agent_error_t serialize_canonical(const agent_json_value_t* value, agent_string_t* out) {
+    if (value && value->type == AGENT_JSON_ARRAY) {
+        agent_error_t err = agent_string_append_char(out, '[');
+        for (size_t i = 0; err == AGENT_OK && i < value->data.array_value.count; i++) {
+            if (i > 0) {
+                err = agent_string_append_char(out, ',');
+            }
+            if (err == AGENT_OK) {
+                err = serialize_canonical(value->data.array_value.items[i], out);
+            }
+        }
+        return err == AGENT_OK ? agent_string_append_char(out, ']') : err;
+    }
+    if (!value || value->type != AGENT_JSON_OBJECT) {
+        return serialize_value(value, out, false, 0);
+    }
+
+    /* Sort entry pointers; objects are small, so insertion sort (stable for duplicates) */
+    size_t count = value->data.object_value.count;
+    const agent_json_entry_t** sorted = NULL;
+    if (count > 0) {
+        sorted = agent_mem_alloc(count * sizeof(agent_json_entry_t*));
+        if (!sorted) return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const agent_json_entry_t* entry = &value->data.object_value.entries[i];
+        size_t j = i;
+        while (j > 0 && entry_key_compare(sorted[j - 1], entry) > 0) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = entry;
+    }
+
+    agent_error_t err = agent_string_append_char(out, '{');
+    for (size_t i = 0; err == AGENT_OK && i < count; i++) {
+        if (i > 0) {
+            err = agent_string_append_char(out, ',');
+        }
+        if (err == AGENT_OK) {
+            err = serialize_string(sorted[i]->key.data, sorted[i]->key.length, out);
+        }
+        if (err == AGENT_OK) {
+            err = agent_string_append_char(out, ':');
+        }
+        if (err == AGENT_OK) {
+            err = serialize_canonical(sorted[i]->value, out);
+        }
+    }
+    agent_mem_free(sorted);
+    return err == AGENT_OK ? agent_string_append_char(out, '}') : err;
+}
+
+agent_error_t agent_json_serialize_canonical(const agent_json_value_t* value, agent_string_t* str) {
+    if (!str) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    agent_error_t err = agent_string_reserve(str, str->length + serialize_estimate(value, false, 0) + 1);
+    if (err != AGENT_OK) return err;
+
+    return serialize_canonical(value, str);
+}
+
 char* agent_json_to_string(agent_context_t* ctx, const agent_json_value_t* value, bool pretty) {
     if (!ctx) {
         return NULL;
     }
 
     agent_string_t str;
-    if (agent_string_init(&str, 256) != AGENT_OK) {
+    if (agent_string_init_arena(&str, ctx, serialize_estimate(value, pretty, 0) + 1) != AGENT_OK) {
         return NULL;
     }
 
-    agent_error_t err = agent_json_serialize(value, &str, pretty);
+    agent_error_t err = serialize_value(value, &str, pretty, 0);
     if (err != AGENT_OK) {
         agent_string_free(&str);
         return NULL;
     }
 
-    /* Copy to arena */
-    char* result = agent_context_strdup(ctx, str.data);
-    agent_string_free(&str);
-    return result;
+    return str.data;
 }
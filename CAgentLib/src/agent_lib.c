@@ -4,10 +4,30 @@
  */
 
 #include "agent_lib.h"
+#include "agent_trace.h"
 #include <stdbool.h>
 
+#ifdef AGENT_TRACE_ENABLED
+#include <dispatch/dispatch.h>
+#endif
+
 static bool g_initialized = false;
 
+#ifdef AGENT_TRACE_ENABLED
+static os_log_t g_trace_log;
+static dispatch_once_t g_trace_once;
+
+static void create_trace_log(void* context) {
+    (void)context;
+    g_trace_log = os_log_create("love.elio.app.agent", OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+}
+
+os_log_t agent_trace_log(void) {
+    dispatch_once_f(&g_trace_once, NULL, create_trace_log);
+    return g_trace_log;
+}
+#endif
+
 const char* agent_lib_version(void) {
     return "1.0.0";
 }
@@ -17,7 +37,19 @@ agent_error_t agent_lib_init(void) {
         return AGENT_OK;
     }
 
-    /* No global initialization needed currently */
+    g_initialized = true;
+    return AGENT_OK;
+}
+
+agent_error_t agent_lib_init_with_allocator(const agent_allocator_t* allocator) {
+    if (g_initialized) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    agent_error_t err = agent_set_allocator(allocator);
+    if (err != AGENT_OK) {
+        return err;
+    }
 
     g_initialized = true;
     return AGENT_OK;
@@ -28,7 +60,6 @@ void agent_lib_cleanup(void) {
         return;
     }
 
-    /* No global cleanup needed currently */
-
+    agent_set_allocator(NULL);
     g_initialized = false;
 }
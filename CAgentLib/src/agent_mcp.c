@@ -5,6 +5,7 @@
 
 #include "agent_mcp.h"
 #include "agent_string.h"
+#include "agent_alloc.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -12,41 +13,123 @@
 
 /* Tool registry */
 
+static uint64_t name_hash(const char* data, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool tool_name_equals(const agent_tool_definition_t* tool, agent_string_view_t name) {
+    return tool->name && strncmp(tool->name, name.data, name.length) == 0 &&
+           tool->name[name.length] == '\0';
+}
+
+/* Slot for name: the one holding it, or the empty slot it would go in */
+static size_t index_slot(const agent_tool_registry_t* registry, agent_string_view_t name) {
+    size_t mask = registry->index_capacity - 1;
+    size_t slot = (size_t)name_hash(name.data, name.length) & mask;
+    while (registry->index[slot] != 0 &&
+           !tool_name_equals(&registry->tools[registry->index[slot] - 1], name)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void index_insert(agent_tool_registry_t* registry, size_t tool) {
+    const char* name = registry->tools[tool].name;
+    if (!name) return;
+
+    size_t slot = index_slot(registry, agent_sv_from_cstr(name));
+    if (registry->index[slot] == 0) {
+        registry->index[slot] = (uint32_t)(tool + 1);
+    }
+}
+
+/* Keep the index at most half full */
+static agent_error_t index_reserve(agent_tool_registry_t* registry, size_t count) {
+    if (registry->index && count * 2 <= registry->index_capacity) {
+        return AGENT_OK;
+    }
+
+    size_t capacity = registry->index_capacity ? registry->index_capacity : 16;
+    while (count * 2 > capacity) {
+        capacity *= 2;
+    }
+    uint32_t* index = agent_mem_calloc(capacity, sizeof(uint32_t));
+    if (!index) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    agent_mem_free(registry->index);
+    registry->index = index;
+    registry->index_capacity = capacity;
+    for (size_t i = 0; i < registry->count; i++) {
+        index_insert(registry, i);
+    }
+    return AGENT_OK;
+}
+
 agent_error_t agent_tool_registry_init(agent_tool_registry_t* registry, size_t initial_capacity) {
     if (!registry) {
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
 
     size_t capacity = initial_capacity > 0 ? initial_capacity : DEFAULT_REGISTRY_CAPACITY;
-    registry->tools = (agent_tool_definition_t*)calloc(capacity, sizeof(agent_tool_definition_t));
+    registry->tools = (agent_tool_definition_t*)agent_mem_calloc(capacity, sizeof(agent_tool_definition_t));
     if (!registry->tools) {
         return AGENT_ERROR_OUT_OF_MEMORY;
     }
 
     registry->count = 0;
     registry->capacity = capacity;
+    registry->index = NULL;
+    registry->index_capacity = 0;
+    registry->version = 1;
+    memset(registry->schema_json, 0, sizeof(registry->schema_json));
+    registry->schema_compact = NULL;
+    registry->grammar = NULL;
+    memset(registry->description, 0, sizeof(registry->description));
+    registry->frozen = false;
     return AGENT_OK;
 }
 
 void agent_tool_registry_free(agent_tool_registry_t* registry) {
     if (!registry) return;
 
-    free(registry->tools);
+    if (registry->capacity > 0) {
+        agent_mem_free(registry->tools);
+    }
+    agent_mem_free(registry->index);
+    agent_mem_free(registry->schema_compact);
+    registry->schema_compact = NULL;
+    agent_mem_free(registry->grammar);
+    registry->grammar = NULL;
+    for (size_t i = 0; i < 2; i++) {
+        agent_mem_free(registry->schema_json[i]);
+        agent_mem_free(registry->description[i]);
+        registry->schema_json[i] = NULL;
+        registry->description[i] = NULL;
+    }
     registry->tools = NULL;
     registry->count = 0;
     registry->capacity = 0;
+    registry->index = NULL;
+    registry->index_capacity = 0;
 }
 
 agent_error_t agent_tool_registry_add(agent_tool_registry_t* registry,
                                       const agent_tool_definition_t* tool) {
-    if (!registry || !tool) {
+    if (!registry || !tool || registry->frozen) {
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
 
     /* Grow if needed */
     if (registry->count >= registry->capacity) {
         size_t new_capacity = registry->capacity * 2;
-        agent_tool_definition_t* new_tools = (agent_tool_definition_t*)realloc(
+        agent_tool_definition_t* new_tools = (agent_tool_definition_t*)agent_mem_realloc(
             registry->tools, new_capacity * sizeof(agent_tool_definition_t));
         if (!new_tools) {
             return AGENT_ERROR_OUT_OF_MEMORY;
@@ -55,22 +138,43 @@ agent_error_t agent_tool_registry_add(agent_tool_registry_t* registry,
         registry->capacity = new_capacity;
     }
 
-    registry->tools[registry->count++] = *tool;
+    if (index_reserve(registry, registry->count + 1) != AGENT_OK) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    registry->tools[registry->count] = *tool;
+    index_insert(registry, registry->count);
+    registry->count++;
+    registry->version++;
     return AGENT_OK;
 }
 
 const agent_tool_definition_t* agent_tool_registry_find(const agent_tool_registry_t* registry,
                                                         const char* name) {
-    if (!registry || !name) {
+    if (!name) {
         return NULL;
     }
+    return agent_tool_registry_find_sv(registry, agent_sv_from_cstr(name));
+}
 
-    for (size_t i = 0; i < registry->count; i++) {
-        if (strcmp(registry->tools[i].name, name) == 0) {
-            return &registry->tools[i];
+const agent_tool_definition_t* agent_tool_registry_find_sv(const agent_tool_registry_t* registry,
+                                                           agent_string_view_t name) {
+    if (!registry || !name.data) {
+        return NULL;
+    }
+
+    /* Registries filled in by hand have no index */
+    if (!registry->index) {
+        for (size_t i = 0; i < registry->count; i++) {
+            if (tool_name_equals(&registry->tools[i], name)) {
+                return &registry->tools[i];
+            }
         }
+        return NULL;
     }
-    return NULL;
+
+    uint32_t entry = registry->index[index_slot(registry, name)];
+    return entry ? &registry->tools[entry - 1] : NULL;
 }
 
 /* Helper to get type string */
@@ -247,6 +351,409 @@ char* agent_mcp_get_schema_json(agent_context_t* ctx,
     return agent_json_to_string(ctx, json, pretty);
 }
 
+char* agent_mcp_get_subset_schema_json(agent_context_t* ctx,
+                                       const agent_tool_registry_t* registry,
+                                       const size_t* indices,
+                                       size_t count,
+                                       bool pretty) {
+    if (!ctx || !registry || (!indices && count > 0)) {
+        return NULL;
+    }
+
+    agent_json_value_t* arr = agent_json_array(ctx, count);
+    if (!arr) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i] >= registry->count) continue;
+        agent_json_value_t* tool_json = agent_mcp_tool_to_json(ctx, &registry->tools[indices[i]]);
+        if (tool_json) {
+            agent_json_array_append(ctx, arr, tool_json);
+        }
+    }
+
+    return agent_json_to_string(ctx, arr, pretty);
+}
+
+/* Compact signatures */
+
+static void append_signature_type(agent_string_t* str, const agent_property_schema_t* prop) {
+    if (prop->enum_values && prop->enum_count > 0) {
+        for (size_t i = 0; i < prop->enum_count; i++) {
+            if (i > 0) agent_string_append_char(str, '|');
+            agent_string_append_char(str, '"');
+            agent_string_append(str, prop->enum_values[i]);
+            agent_string_append_char(str, '"');
+        }
+        return;
+    }
+
+    switch (prop->type) {
+        case AGENT_SCHEMA_INTEGER: agent_string_append(str, "int"); break;
+        case AGENT_SCHEMA_NUMBER:  agent_string_append(str, "num"); break;
+        case AGENT_SCHEMA_BOOLEAN: agent_string_append(str, "bool"); break;
+        case AGENT_SCHEMA_ARRAY:
+            agent_string_append_char(str, '[');
+            if (prop->items_schema) {
+                append_signature_type(str, prop->items_schema);
+            } else {
+                agent_string_append(str, "any");
+            }
+            agent_string_append_char(str, ']');
+            break;
+        case AGENT_SCHEMA_OBJECT:
+            if (!prop->properties || prop->properties_count == 0) {
+                agent_string_append(str, "obj");
+                break;
+            }
+            agent_string_append_char(str, '{');
+            for (size_t i = 0; i < prop->properties_count; i++) {
+                const agent_property_schema_t* field = &prop->properties[i];
+                if (i > 0) agent_string_append(str, ", ");
+                agent_string_append(str, field->name ? field->name : "");
+                agent_string_append(str, field->required ? ":" : "?:");
+                append_signature_type(str, field);
+            }
+            agent_string_append_char(str, '}');
+            break;
+        default:
+            agent_string_append(str, "str");
+            break;
+    }
+}
+
+static void append_signature(agent_string_t* str, const agent_tool_definition_t* tool) {
+    agent_string_append(str, tool->name ? tool->name : "");
+    agent_string_append_char(str, '(');
+    bool first = true;
+    for (size_t i = 0; i < tool->parameters_count; i++) {
+        const agent_property_schema_t* prop = &tool->parameters[i];
+        if (!prop->name) continue;
+        if (!first) agent_string_append(str, ", ");
+        first = false;
+        agent_string_append(str, prop->name);
+        agent_string_append(str, prop->required ? ":" : "?:");
+        append_signature_type(str, prop);
+    }
+    agent_string_append_char(str, ')');
+    if (tool->description && tool->description[0]) {
+        agent_string_append(str, " - ");
+        agent_string_append(str, tool->description);
+    }
+}
+
+char* agent_mcp_tool_signature(agent_context_t* ctx, const agent_tool_definition_t* tool) {
+    if (!ctx || !tool) {
+        return NULL;
+    }
+
+    agent_string_t str;
+    if (agent_string_init_arena(&str, ctx, 128) != AGENT_OK) {
+        return NULL;
+    }
+    append_signature(&str, tool);
+    return str.data;
+}
+
+char* agent_mcp_get_subset_schema_compact(agent_context_t* ctx,
+                                          const agent_tool_registry_t* registry,
+                                          const size_t* indices,
+                                          size_t count) {
+    if (!ctx || !registry || (!indices && count > 0)) {
+        return NULL;
+    }
+
+    agent_string_t str;
+    if (agent_string_init_arena(&str, ctx, 128 * (count + 1)) != AGENT_OK) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i] >= registry->count) continue;
+        append_signature(&str, &registry->tools[indices[i]]);
+        agent_string_append_char(&str, '\n');
+    }
+    return str.data;
+}
+
+char* agent_mcp_get_schema_compact(agent_context_t* ctx, const agent_tool_registry_t* registry) {
+    if (!ctx || !registry) {
+        return NULL;
+    }
+
+    agent_string_t str;
+    if (agent_string_init_arena(&str, ctx, 128 * (registry->count + 1)) != AGENT_OK) {
+        return NULL;
+    }
+    for (size_t i = 0; i < registry->count; i++) {
+        append_signature(&str, &registry->tools[i]);
+        agent_string_append_char(&str, '\n');
+    }
+    return str.data;
+}
+
+/* Tool call grammar */
+
+static const char* GRAMMAR_COMMON =
+    "ws ::= [ \\t\\n]*\n"
+    "string ::= \"\\\"\" ( [^\"\\\\\\x00-\\x1F] | \"\\\\\" ( [\"\\\\/bfnrt] | \"u\" hex hex hex hex ) )* \"\\\"\"\n"
+    "hex ::= [0-9a-fA-F]\n"
+    "integer ::= \"-\"? ( \"0\" | [1-9] [0-9]* )\n"
+    "number ::= integer ( \".\" [0-9]+ )? ( [eE] [-+]? [0-9]+ )?\n"
+    "boolean ::= \"true\" | \"false\"\n"
+    "value ::= object | array | string | number | boolean | \"null\"\n"
+    "object ::= \"{\" ws ( string ws \":\" ws value ( ws \",\" ws string ws \":\" ws value )* )? ws \"}\"\n"
+    "array ::= \"[\" ws ( value ( ws \",\" ws value )* )? ws \"]\"\n";
+
+/* Append a GBNF literal matching text as a JSON string */
+static void append_json_literal(agent_string_t* str, const char* text) {
+    agent_string_append(str, "\"\\\"");
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        if (*p == '"') {
+            agent_string_append(str, "\\\\\\\"");
+        } else if (*p == '\\') {
+            agent_string_append(str, "\\\\\\\\");
+        } else if (*p < 0x20) {
+            agent_string_append(str, "\\\\u");
+            agent_string_append_hex(str, *p, 4);
+        } else {
+            agent_string_append_char(str, (char)*p);
+        }
+    }
+    agent_string_append(str, "\\\"\"");
+}
+
+static void append_grammar_value(agent_string_t* str, const agent_property_schema_t* prop);
+
+static void append_grammar_member(agent_string_t* str, const agent_property_schema_t* prop) {
+    append_json_literal(str, prop->name);
+    agent_string_append(str, " ws \":\" ws ");
+    append_grammar_value(str, prop);
+}
+
+/* Object with these members in order; required ones always present */
+static void append_grammar_object(agent_string_t* str, const agent_property_schema_t* props,
+                                  size_t count) {
+    size_t named = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (props[i].name) named++;
+    }
+    if (named == 0) {
+        agent_string_append(str, "\"{\" ws \"}\"");
+        return;
+    }
+
+    agent_string_append(str, "\"{\" ws ");
+
+    bool any_required = false;
+    for (size_t i = 0; i < count; i++) {
+        if (!props[i].name || !props[i].required) continue;
+        if (any_required) agent_string_append(str, " ws \",\" ws ");
+        append_grammar_member(str, &props[i]);
+        any_required = true;
+    }
+
+    if (any_required) {
+        for (size_t i = 0; i < count; i++) {
+            if (!props[i].name || props[i].required) continue;
+            agent_string_append(str, " ( ws \",\" ws ");
+            append_grammar_member(str, &props[i]);
+            agent_string_append(str, " )?");
+        }
+    } else {
+        /* All optional: pick the first member present, the rest may follow */
+        bool any = false;
+        for (size_t i = 0; i < count; i++) {
+            if (!props[i].name) continue;
+            agent_string_append(str, any ? " | " : "( ");
+            any = true;
+            append_grammar_member(str, &props[i]);
+            for (size_t j = i + 1; j < count; j++) {
+                if (!props[j].name) continue;
+                agent_string_append(str, " ( ws \",\" ws ");
+                append_grammar_member(str, &props[j]);
+                agent_string_append(str, " )?");
+            }
+        }
+        if (any) agent_string_append(str, " )?");
+    }
+
+    agent_string_append(str, " ws \"}\"");
+}
+
+static void append_grammar_value(agent_string_t* str, const agent_property_schema_t* prop) {
+    if (prop->enum_values && prop->enum_count > 0) {
+        agent_string_append(str, "( ");
+        for (size_t i = 0; i < prop->enum_count; i++) {
+            if (i > 0) agent_string_append(str, " | ");
+            append_json_literal(str, prop->enum_values[i] ? prop->enum_values[i] : "");
+        }
+        agent_string_append(str, " )");
+        return;
+    }
+
+    switch (prop->type) {
+        case AGENT_SCHEMA_INTEGER: agent_string_append(str, "integer"); break;
+        case AGENT_SCHEMA_NUMBER:  agent_string_append(str, "number"); break;
+        case AGENT_SCHEMA_BOOLEAN: agent_string_append(str, "boolean"); break;
+        case AGENT_SCHEMA_ARRAY:
+            if (!prop->items_schema) {
+                agent_string_append(str, "array");
+                break;
+            }
+            agent_string_append(str, "( \"[\" ws ( ");
+            append_grammar_value(str, prop->items_schema);
+            agent_string_append(str, " ( ws \",\" ws ");
+            append_grammar_value(str, prop->items_schema);
+            agent_string_append(str, " )* )? ws \"]\" )");
+            break;
+        case AGENT_SCHEMA_OBJECT:
+            if (!prop->properties || prop->properties_count == 0) {
+                agent_string_append(str, "object");
+                break;
+            }
+            agent_string_append(str, "( ");
+            append_grammar_object(str, prop->properties, prop->properties_count);
+            agent_string_append(str, " )");
+            break;
+        default:
+            agent_string_append(str, "string");
+            break;
+    }
+}
+
+/* indices NULL = every tool */
+static char* build_tool_grammar(agent_context_t* ctx, const agent_tool_registry_t* registry,
+                                const size_t* indices, size_t count) {
+    agent_string_t str;
+    if (agent_string_init_arena(&str, ctx, 256 * (count + 2)) != AGENT_OK) {
+        return NULL;
+    }
+
+    agent_string_append(&str, "root ::= \"" AGENT_TOOL_GRAMMAR_TRIGGER "\" ws call ws \"</tool_call>\"\n");
+    agent_string_append(&str, "call ::= ");
+    size_t tool_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t index = indices ? indices[i] : i;
+        if (index >= registry->count || !registry->tools[index].name) continue;
+        agent_string_append(&str, tool_count > 0 ? " | tool-" : "tool-");
+        agent_string_append_u64(&str, index);
+        tool_count++;
+    }
+    if (tool_count == 0) {
+        return NULL;
+    }
+    agent_string_append_char(&str, '\n');
+
+    for (size_t i = 0; i < count; i++) {
+        size_t index = indices ? indices[i] : i;
+        if (index >= registry->count || !registry->tools[index].name) continue;
+        const agent_tool_definition_t* tool = &registry->tools[index];
+        agent_string_append(&str, "tool-");
+        agent_string_append_u64(&str, index);
+        agent_string_append(&str, " ::= \"{\" ws \"\\\"name\\\"\" ws \":\" ws ");
+        append_json_literal(&str, tool->name);
+        agent_string_append(&str, " ws \",\" ws \"\\\"arguments\\\"\" ws \":\" ws ");
+        append_grammar_object(&str, tool->parameters, tool->parameters ? tool->parameters_count : 0);
+        agent_string_append(&str, " ws \"}\"\n");
+    }
+
+    agent_string_append(&str, GRAMMAR_COMMON);
+    return str.data;
+}
+
+char* agent_mcp_get_tool_grammar(agent_context_t* ctx, const agent_tool_registry_t* registry) {
+    if (!ctx || !registry) {
+        return NULL;
+    }
+    return build_tool_grammar(ctx, registry, NULL, registry->count);
+}
+
+char* agent_mcp_get_subset_tool_grammar(agent_context_t* ctx,
+                                        const agent_tool_registry_t* registry,
+                                        const size_t* indices,
+                                        size_t count) {
+    if (!ctx || !registry || !indices) {
+        return NULL;
+    }
+    return build_tool_grammar(ctx, registry, indices, count);
+}
+
+/* Tool selection */
+
+static char ascii_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool query_contains(agent_string_view_t query, const char* term, size_t term_len) {
+    if (term_len == 0 || term_len > query.length) {
+        return false;
+    }
+    for (size_t i = 0; i + term_len <= query.length; i++) {
+        size_t j = 0;
+        while (j < term_len && ascii_lower(query.data[i + j]) == ascii_lower(term[j])) {
+            j++;
+        }
+        if (j == term_len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t tool_score(const agent_tool_definition_t* tool, agent_string_view_t query) {
+    size_t score = 0;
+    for (size_t k = 0; k < tool->keywords_count; k++) {
+        const char* keyword = tool->keywords[k];
+        if (keyword && query_contains(query, keyword, strlen(keyword))) {
+            score += 2;
+        }
+    }
+
+    /* "filesystem.read_file" -> "filesystem", "read", "file" */
+    const char* name = tool->name;
+    while (name && *name) {
+        size_t len = strcspn(name, "._");
+        if (len >= 3 && query_contains(query, name, len)) {
+            score++;
+        }
+        name += len;
+        if (*name) name++;
+    }
+    return score;
+}
+
+size_t agent_tool_registry_select(const agent_tool_registry_t* registry, agent_string_view_t query,
+                                  size_t top_k, size_t* out_indices) {
+    if (!registry || !out_indices || top_k == 0 || !query.data) {
+        return 0;
+    }
+
+    /* Insertion into a best-first list of at most top_k; scores alongside */
+    size_t* scores = agent_mem_alloc(top_k * sizeof(size_t));
+    if (!scores) {
+        return 0;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < registry->count; i++) {
+        size_t score = tool_score(&registry->tools[i], query);
+        if (score == 0 || (count == top_k && score <= scores[count - 1])) {
+            continue;
+        }
+
+        size_t pos = count < top_k ? count++ : count - 1;
+        while (pos > 0 && scores[pos - 1] < score) {
+            scores[pos] = scores[pos - 1];
+            out_indices[pos] = out_indices[pos - 1];
+            pos--;
+        }
+        scores[pos] = score;
+        out_indices[pos] = i;
+    }
+
+    agent_mem_free(scores);
+    return count;
+}
+
 /* Property schema helpers */
 
 agent_property_schema_t agent_mcp_string_property(const char* name,
@@ -331,14 +838,17 @@ char* agent_mcp_tool_description(agent_context_t* ctx,
     }
 
     agent_string_t str;
-    if (agent_string_init(&str, 512) != AGENT_OK) {
+    if (agent_string_init_arena(&str, ctx, 512) != AGENT_OK) {
         return NULL;
     }
 
     /* Tool name and description */
-    agent_string_append_fmt(&str, "### %s\n", tool->name);
+    agent_string_append(&str, "### ");
+    agent_string_append(&str, tool->name);
+    agent_string_append_char(&str, '\n');
     if (tool->description) {
-        agent_string_append_fmt(&str, "%s\n\n", tool->description);
+        agent_string_append(&str, tool->description);
+        agent_string_append(&str, "\n\n");
     }
 
     /* Parameters */
@@ -353,7 +863,11 @@ char* agent_mcp_tool_description(agent_context_t* ctx,
             agent_property_schema_t* prop = &tool->parameters[i];
             const char* type_str = schema_type_string(prop->type);
 
-            agent_string_append_fmt(&str, "- `%s` (%s)", prop->name, type_str);
+            agent_string_append(&str, "- `");
+            agent_string_append(&str, prop->name);
+            agent_string_append(&str, "` (");
+            agent_string_append(&str, type_str);
+            agent_string_append_char(&str, ')');
 
             if (prop->required) {
                 if (japanese) {
@@ -364,14 +878,17 @@ char* agent_mcp_tool_description(agent_context_t* ctx,
             }
 
             if (prop->description) {
-                agent_string_append_fmt(&str, ": %s", prop->description);
+                agent_string_append(&str, ": ");
+                agent_string_append(&str, prop->description);
             }
 
             if (prop->enum_values && prop->enum_count > 0) {
                 agent_string_append(&str, " [");
                 for (size_t j = 0; j < prop->enum_count; j++) {
                     if (j > 0) agent_string_append(&str, ", ");
-                    agent_string_append_fmt(&str, "\"%s\"", prop->enum_values[j]);
+                    agent_string_append_char(&str, '"');
+                    agent_string_append(&str, prop->enum_values[j]);
+                    agent_string_append_char(&str, '"');
                 }
                 agent_string_append(&str, "]");
             }
@@ -380,9 +897,7 @@ char* agent_mcp_tool_description(agent_context_t* ctx,
         }
     }
 
-    char* result = agent_context_strdup(ctx, str.data);
-    agent_string_free(&str);
-    return result;
+    return str.data;
 }
 
 char* agent_mcp_registry_description(agent_context_t* ctx,
@@ -393,7 +908,7 @@ char* agent_mcp_registry_description(agent_context_t* ctx,
     }
 
     agent_string_t str;
-    if (agent_string_init(&str, 2048) != AGENT_OK) {
+    if (agent_string_init_arena(&str, ctx, 2048) != AGENT_OK) {
         return NULL;
     }
 
@@ -411,7 +926,194 @@ char* agent_mcp_registry_description(agent_context_t* ctx,
         }
     }
 
-    char* result = agent_context_strdup(ctx, str.data);
-    agent_string_free(&str);
-    return result;
+    return str.data;
+}
+
+/* Memoized registry text */
+
+/* Keep a heap copy of text built in a scratch arena */
+static char* memo_store(char** slot, uint64_t* slot_version, uint64_t version, const char* text) {
+    if (!text) {
+        return NULL;
+    }
+
+    size_t len = strlen(text);
+    char* copy = agent_mem_alloc(len + 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, text, len + 1);
+
+    agent_mem_free(*slot);
+    *slot = copy;
+    *slot_version = version;
+    return copy;
+}
+
+const char* agent_tool_registry_schema_json(agent_tool_registry_t* registry, bool pretty) {
+    if (!registry) {
+        return NULL;
+    }
+
+    size_t variant = pretty ? 1 : 0;
+    if (registry->schema_json[variant] && registry->schema_json_version[variant] == registry->version) {
+        return registry->schema_json[variant];
+    }
+
+    agent_context_t* scratch = agent_context_create(0);
+    if (!scratch) {
+        return NULL;
+    }
+    char* json = memo_store(&registry->schema_json[variant], &registry->schema_json_version[variant],
+                            registry->version, agent_mcp_get_schema_json(scratch, registry, pretty));
+    agent_context_destroy(scratch);
+    return json;
+}
+
+const char* agent_tool_registry_schema_compact(agent_tool_registry_t* registry) {
+    if (!registry) {
+        return NULL;
+    }
+
+    if (registry->schema_compact && registry->schema_compact_version == registry->version) {
+        return registry->schema_compact;
+    }
+
+    agent_context_t* scratch = agent_context_create(0);
+    if (!scratch) {
+        return NULL;
+    }
+    char* text = memo_store(&registry->schema_compact, &registry->schema_compact_version,
+                            registry->version, agent_mcp_get_schema_compact(scratch, registry));
+    agent_context_destroy(scratch);
+    return text;
+}
+
+const char* agent_tool_registry_grammar(agent_tool_registry_t* registry) {
+    if (!registry) {
+        return NULL;
+    }
+
+    if (registry->grammar && registry->grammar_version == registry->version) {
+        return registry->grammar;
+    }
+
+    agent_context_t* scratch = agent_context_create(0);
+    if (!scratch) {
+        return NULL;
+    }
+    char* text = memo_store(&registry->grammar, &registry->grammar_version,
+                            registry->version, agent_mcp_get_tool_grammar(scratch, registry));
+    agent_context_destroy(scratch);
+    return text;
+}
+
+const char* agent_tool_registry_description(agent_tool_registry_t* registry, bool japanese) {
+    if (!registry) {
+        return NULL;
+    }
+
+    size_t variant = japanese ? 1 : 0;
+    if (registry->description[variant] && registry->description_version[variant] == registry->version) {
+        return registry->description[variant];
+    }
+
+    agent_context_t* scratch = agent_context_create(0);
+    if (!scratch) {
+        return NULL;
+    }
+    char* text = memo_store(&registry->description[variant], &registry->description_version[variant],
+                            registry->version, agent_mcp_registry_description(scratch, registry, japanese));
+    agent_context_destroy(scratch);
+    return text;
+}
+
+agent_error_t agent_tool_registry_freeze(agent_tool_registry_t* registry) {
+    if (!registry) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    registry->frozen = true;
+    if (index_reserve(registry, registry->count) != AGENT_OK) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    if (registry->count == 0) {
+        return AGENT_OK;
+    }
+
+    for (int variant = 0; variant < 2; variant++) {
+        if (!agent_tool_registry_schema_json(registry, variant) ||
+            !agent_tool_registry_description(registry, variant)) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    if (!agent_tool_registry_schema_compact(registry) || !agent_tool_registry_grammar(registry)) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    return AGENT_OK;
+}
+
+/* Flat tool arguments */
+
+static bool tool_arg_fill(const agent_property_schema_t* param, const agent_json_value_t* value,
+                          agent_tool_arg_t* out) {
+    switch (param->type) {
+        case AGENT_SCHEMA_STRING:
+            if (value->type != AGENT_JSON_STRING) return false;
+            out->data.string_value = value->data.string_value;
+            return true;
+        case AGENT_SCHEMA_INTEGER:
+            if (value->type != AGENT_JSON_INT) return false;
+            out->data.int_value = value->data.int_value;
+            return true;
+        case AGENT_SCHEMA_NUMBER:
+            if (value->type == AGENT_JSON_INT) {
+                out->data.number_value = (double)value->data.int_value;
+                return true;
+            }
+            if (value->type != AGENT_JSON_DOUBLE) return false;
+            out->data.number_value = value->data.double_value;
+            return true;
+        case AGENT_SCHEMA_BOOLEAN:
+            if (value->type != AGENT_JSON_BOOL) return false;
+            out->data.bool_value = value->data.bool_value;
+            return true;
+        case AGENT_SCHEMA_ARRAY:
+            return value->type == AGENT_JSON_ARRAY;
+        case AGENT_SCHEMA_OBJECT:
+            return value->type == AGENT_JSON_OBJECT;
+    }
+    return false;
+}
+
+agent_error_t agent_tool_args_flatten(const agent_tool_definition_t* tool,
+                                      const agent_json_value_t* arguments,
+                                      agent_tool_arg_t* out_args,
+                                      const char** out_error_field) {
+    if (out_error_field) *out_error_field = NULL;
+    if (!tool || (tool->parameters_count > 0 && !out_args) ||
+        (arguments && arguments->type != AGENT_JSON_OBJECT)) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    for (size_t i = 0; i < tool->parameters_count; i++) {
+        const agent_property_schema_t* param = &tool->parameters[i];
+        agent_tool_arg_t* arg = &out_args[i];
+        memset(arg, 0, sizeof(*arg));
+        arg->type = param->type;
+
+        const agent_json_value_t* value = arguments ? agent_json_object_get(arguments, param->name) : NULL;
+        if (value && value->type != AGENT_JSON_NULL) {
+            arg->value = value;
+            arg->present = tool_arg_fill(param, value, arg);
+            if (!arg->present) {
+                if (out_error_field) *out_error_field = param->name;
+                return AGENT_ERROR_INVALID_ARGUMENT;
+            }
+        } else if (param->required) {
+            if (out_error_field) *out_error_field = param->name;
+            return AGENT_ERROR_INVALID_ARGUMENT;
+        }
+    }
+    return AGENT_OK;
 }
@@ -4,7 +4,10 @@
  */
 
 #include "agent_orchestrator.h"
+#include "agent_alloc.h"
 #include "agent_string.h"
+#include "agent_trace.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -36,44 +39,210 @@ static int64_t current_time_ms(void) {
     return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-/* Helper to add message to array */
+/* For durations; message timestamps stay on the wall clock */
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int64_t monotonic_ms(void) {
+    return (int64_t)(monotonic_ns() / 1000000u);
+}
+
+/* Cancellation */
+
+bool agent_cancel_requested(const agent_cancel_token_t* token) {
+    if (!token) {
+        return false;
+    }
+    if (atomic_load(&token->cancelled)) {
+        return true;
+    }
+    int64_t deadline = atomic_load(&token->deadline_ms);
+    return deadline != 0 && monotonic_ms() >= deadline;
+}
+
+static void cancel_token_reset(agent_cancel_token_t* token, int64_t timeout_ms) {
+    atomic_store(&token->cancelled, false);
+    atomic_store(&token->deadline_ms, timeout_ms > 0 ? monotonic_ms() + timeout_ms : 0);
+}
+
+/* Why the run must stop, or NULL to carry on */
+static const char* cancel_reason(const agent_state_t* state) {
+    if (!agent_cancel_requested(&state->cancel)) {
+        return NULL;
+    }
+    return atomic_load(&state->cancel.cancelled) ? "Stopped" : "Deadline exceeded";
+}
+
+/* Id for a new message; with ordered_message_ids, ids sort by creation */
+static agent_uuid_t new_message_id(const agent_state_t* state) {
+    return state->config.ordered_message_ids ? agent_uuid_generate_ordered()
+                                             : agent_uuid_generate();
+}
+
+/* One block for both columns: capacity messages, then capacity role bytes */
+static agent_error_t message_array_alloc(agent_context_t* ctx, agent_message_array_t* arr,
+                                         size_t capacity) {
+    agent_message_t* messages = agent_context_calloc(ctx, capacity, sizeof(agent_message_t) + 1);
+    if (!messages) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    arr->messages = messages;
+    arr->roles = (uint8_t*)(messages + capacity);
+    arr->capacity = capacity;
+    return AGENT_OK;
+}
+
+static agent_error_t message_array_init(agent_context_t* ctx, agent_message_array_t* arr,
+                                        size_t capacity) {
+    arr->count = 0;
+    return message_array_alloc(ctx, arr, capacity);
+}
+
 static agent_error_t message_array_add(agent_context_t* ctx,
                                        agent_message_array_t* arr,
                                        agent_message_t* msg) {
     if (arr->count >= arr->capacity) {
+        /* The block grows in place while it is the arena's newest allocation;
+           the roles then move up past the new message slots */
         size_t new_capacity = arr->capacity * 2;
-        agent_message_t* new_messages = agent_context_calloc(ctx, new_capacity, sizeof(agent_message_t));
+        agent_message_t* new_messages = agent_context_realloc(ctx, arr->messages,
+            arr->capacity * (sizeof(agent_message_t) + 1), new_capacity * (sizeof(agent_message_t) + 1));
         if (!new_messages) {
             return AGENT_ERROR_OUT_OF_MEMORY;
         }
-        memcpy(new_messages, arr->messages, arr->count * sizeof(agent_message_t));
+        uint8_t* new_roles = (uint8_t*)(new_messages + new_capacity);
+        memmove(new_roles, new_messages + arr->capacity, arr->count);
         arr->messages = new_messages;
+        arr->roles = new_roles;
         arr->capacity = new_capacity;
     }
 
+    arr->roles[arr->count] = (uint8_t)msg->role;
     arr->messages[arr->count++] = *msg;
     return AGENT_OK;
 }
 
+/* Index of the latest message with role, or arr->count if there is none */
+static size_t message_array_find_last(const agent_message_array_t* arr, agent_role_t role) {
+    for (size_t i = arr->count; i > 0; i--) {
+        if (arr->roles[i - 1] == (uint8_t)role) {
+            return i - 1;
+        }
+    }
+    return arr->count;
+}
+
+/*
+ * The working history is a view: the conversation's messages followed by
+ * this run's assistant and tool messages, written into the spare slots
+ * past state->messages.count. Nothing is copied when a run starts.
+ */
+static void share_working_history(agent_state_t* state) {
+    state->working_history = state->messages;
+}
+
+static agent_error_t working_history_add(agent_state_t* state, agent_message_t* msg) {
+    if (state->working_history.messages != state->messages.messages) {
+        return message_array_add(state->run_ctx, &state->working_history, msg);
+    }
+
+    agent_error_t err = message_array_add(state->ctx, &state->working_history, msg);
+
+    /* Growing may have moved the shared array; the conversation follows it */
+    state->messages.messages = state->working_history.messages;
+    state->messages.roles = state->working_history.roles;
+    state->messages.capacity = state->working_history.capacity;
+    return err;
+}
+
+/* Give a running run its own copy before the conversation's tail slots are reused */
+static agent_error_t detach_working_history(agent_state_t* state) {
+    agent_message_array_t* history = &state->working_history;
+    if (!state->is_processing || history->messages != state->messages.messages) {
+        return AGENT_OK;
+    }
+
+    agent_message_array_t copy = *history;
+    if (message_array_alloc(state->run_ctx, &copy, history->count + DEFAULT_MESSAGE_CAPACITY) != AGENT_OK) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(copy.messages, history->messages, history->count * sizeof(agent_message_t));
+    memcpy(copy.roles, history->roles, history->count);
+    if (state->send_messages == history->messages) {
+        state->send_messages = copy.messages;
+    }
+    *history = copy;
+    return AGENT_OK;
+}
+
+/* Deep-copy tool calls into another arena */
+static agent_tool_call_t* copy_tool_calls(agent_context_t* ctx,
+                                          const agent_tool_call_t* src,
+                                          size_t count) {
+    if (!src || count == 0) {
+        return NULL;
+    }
+
+    agent_tool_call_t* copy = agent_context_calloc(ctx, count, sizeof(agent_tool_call_t));
+    if (!copy) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        copy[i].id = src[i].id;
+        copy[i].name = agent_context_string_view_n(ctx, src[i].name.data, src[i].name.length);
+        copy[i].arguments = agent_json_clone(ctx, src[i].arguments);
+    }
+    return copy;
+}
+
+static void destroy_arenas(agent_state_t* state) {
+    agent_context_destroy(state->iteration_ctx);
+    agent_context_destroy(state->run_ctx);
+    agent_context_destroy(state->ctx);
+}
+
+/* Bind the response and thinking buffers to a freshly reset run arena */
+static agent_error_t init_run_buffers(agent_state_t* state) {
+    agent_error_t err = agent_rope_init(&state->current_response, state->run_ctx, 0);
+    if (err != AGENT_OK) {
+        return err;
+    }
+    return agent_string_init_arena(&state->thinking_content, state->run_ctx, 256);
+}
+
 /* Initialize agent */
 agent_error_t agent_init(agent_state_t* state, const agent_config_t* config) {
     if (!state || !config) {
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
 
-    if (!config->generate || !config->execute_tool) {
+    if ((!config->generate && !config->generate_with_prefix) ||
+        (!config->execute_tool && !config->execute_tool_cancellable)) {
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
 
     memset(state, 0, sizeof(agent_state_t));
 
-    /* Create arena context */
+    /* Create arena contexts */
     state->ctx = agent_context_create(0);
-    if (!state->ctx) {
+    state->run_ctx = agent_context_create(0);
+    state->iteration_ctx = agent_context_create(0);
+    if (!state->ctx || !state->run_ctx || !state->iteration_ctx) {
+        destroy_arenas(state);
         return AGENT_ERROR_OUT_OF_MEMORY;
     }
 
     state->config = *config;
+    state->conversation_id = agent_uuid_generate();
+    agent_template_compile(&state->prompt_template[0], SYSTEM_PROMPT_EN);
+    agent_template_compile(&state->prompt_template[1], SYSTEM_PROMPT_JA);
+
+    agent_context_set_budget(state->ctx, config->memory_soft_limit, config->memory_hard_limit,
+                             config->on_memory_pressure, config->user_data);
 
     /* Set defaults */
     if (state->config.max_iterations <= 0) {
@@ -82,35 +251,51 @@ agent_error_t agent_init(agent_state_t* state, const agent_config_t* config) {
     if (state->config.max_tool_result_len == 0) {
         state->config.max_tool_result_len = AGENT_MAX_TOOL_RESULT_LENGTH;
     }
+    if (state->config.event_batch_interval_ms == 0) {
+        state->config.event_batch_interval_ms = AGENT_EVENT_BATCH_INTERVAL_MS;
+    }
+    if (state->config.tool_cache_capacity == 0) {
+        state->config.tool_cache_capacity = AGENT_TOOL_CACHE_CAPACITY;
+    }
+    if (state->config.context_tool_result_len < 4) {  /* Room for the ellipsis */
+        state->config.context_tool_result_len = AGENT_CONTEXT_TOOL_RESULT_LENGTH;
+    }
+    if (state->config.route_probe_length == 0) {
+        state->config.route_probe_length = AGENT_ROUTE_PROBE_LENGTH;
+    }
+    if (state->config.image_input_size == 0 || state->config.image_input_size > UINT16_MAX) {
+        state->config.image_input_size = AGENT_IMAGE_INPUT_SIZE;
+    }
+    if (state->config.image_cache_capacity == 0) {
+        state->config.image_cache_capacity = AGENT_IMAGE_CACHE_CAPACITY;
+    }
 
     /* Initialize message arrays */
-    state->messages.messages = agent_context_calloc(state->ctx, DEFAULT_MESSAGE_CAPACITY, sizeof(agent_message_t));
-    state->messages.capacity = DEFAULT_MESSAGE_CAPACITY;
-
-    state->working_history.messages = agent_context_calloc(state->ctx, DEFAULT_MESSAGE_CAPACITY, sizeof(agent_message_t));
-    state->working_history.capacity = DEFAULT_MESSAGE_CAPACITY;
+    if (message_array_init(state->ctx, &state->messages, DEFAULT_MESSAGE_CAPACITY) != AGENT_OK) {
+        destroy_arenas(state);
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    share_working_history(state);
 
     /* Initialize streaming parser */
-    agent_error_t err = agent_streaming_parser_init(&state->parser, state->ctx);
+    agent_error_t err = agent_streaming_parser_init(&state->parser, state->iteration_ctx);
     if (err != AGENT_OK) {
-        agent_context_destroy(state->ctx);
+        destroy_arenas(state);
         return err;
     }
 
-    /* Initialize response buffer */
-    err = agent_string_init(&state->current_response, 1024);
+    err = agent_streaming_parser_set_dialect(&state->parser, state->config.dialect);
     if (err != AGENT_OK) {
         agent_streaming_parser_free(&state->parser);
-        agent_context_destroy(state->ctx);
+        destroy_arenas(state);
         return err;
     }
 
-    /* Initialize thinking buffer */
-    err = agent_string_init(&state->thinking_content, 256);
+    /* Initialize response and thinking buffers (re-created with each run) */
+    err = init_run_buffers(state);
     if (err != AGENT_OK) {
-        agent_string_free(&state->current_response);
         agent_streaming_parser_free(&state->parser);
-        agent_context_destroy(state->ctx);
+        destroy_arenas(state);
         return err;
     }
 
@@ -120,242 +305,1505 @@ agent_error_t agent_init(agent_state_t* state, const agent_config_t* config) {
 void agent_free(agent_state_t* state) {
     if (!state) return;
 
-    agent_string_free(&state->current_response);
+    agent_rope_free(&state->current_response);
     agent_string_free(&state->thinking_content);
+    agent_string_free(&state->prompt_cache);
+    agent_mem_free(state->sent[0].messages);
+    agent_mem_free(state->sent[1].messages);
+    agent_tool_cache_clear(state);
+    agent_mem_free(state->tool_cache.entries);
+    agent_image_cache_clear(state);
+    agent_mem_free(state->image_cache.entries);
+    agent_mem_free(state->events);
+    agent_string_free(&state->event_text);
+    agent_mem_free(state->tool_subset);
+    agent_string_free(&state->tool_subset_schema);
+    agent_recall_free(&state->recall);
     agent_streaming_parser_free(&state->parser);
-    agent_context_destroy(state->ctx);
+    destroy_arenas(state);
 
     memset(state, 0, sizeof(agent_state_t));
 }
 
-void agent_reset(agent_state_t* state) {
-    if (!state) return;
+void agent_reset(agent_state_t* state) {
+    if (!state) return;
+
+    /* Reset arenas (keeps first blocks) */
+    agent_context_reset(state->ctx);
+    agent_context_reset(state->run_ctx);
+    agent_context_reset(state->iteration_ctx);
+
+    /* Reinitialize arrays (the first arena block always has room) */
+    message_array_init(state->ctx, &state->messages, DEFAULT_MESSAGE_CAPACITY);
+    share_working_history(state);
+
+    /* Reset state */
+    state->current_step = AGENT_STEP_NONE;
+    state->iteration_count = 0;
+    state->is_processing = false;
+    cancel_token_reset(&state->cancel, 0);
+    state->run_status = AGENT_RUN_IDLE;
+    state->has_pending_assistant = false;
+    state->pending_count = 0;
+    state->run_tool_calls = (agent_tool_call_array_t){0};
+    state->trace = NULL;
+    state->tool_latency_ns = NULL;
+    state->tool_latency_capacity = 0;
+    state->event_count = 0;
+    agent_string_clear(&state->event_text);
+
+    /* A new conversation shares no prefix with the old one */
+    state->conversation_id = agent_uuid_generate();
+    state->sent[0].count = 0;
+    state->sent[1].count = 0;
+    agent_recall_free(&state->recall);
+    state->recall_indexed = 0;
+
+    init_run_buffers(state);
+    agent_streaming_parser_reset(&state->parser);
+}
+
+agent_error_t agent_add_user_message(agent_state_t* state, const char* content) {
+    return agent_add_user_message_with_image(state, content, NULL, 0);
+}
+
+agent_error_t agent_add_user_message_with_image(agent_state_t* state,
+                                                const char* content,
+                                                const uint8_t* image_data,
+                                                size_t image_size) {
+    if (!state || !content) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    agent_message_t msg = {0};
+    msg.id = new_message_id(state);
+    msg.role = AGENT_ROLE_USER;
+    msg.content = agent_context_string_view(state->ctx, content);
+    msg.timestamp_ms = current_time_ms();
+    if (!msg.content.data) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    if (image_data && image_size > 0) {
+        /* Decoded once here rather than by the vision path on every generation */
+        agent_image_t decoded = {0};
+        uint32_t max_side = state->config.image_input_size;
+        if (state->config.image_preprocess &&
+            state->config.image_preprocess(image_data, image_size, max_side, &decoded,
+                                           state->config.user_data) &&
+            decoded.pixels && decoded.width > 0 && decoded.height > 0 &&
+            decoded.width <= max_side && decoded.height <= max_side) {
+            image_data = decoded.pixels;
+            image_size = (size_t)decoded.width * decoded.height * 3;
+            msg.image_width = decoded.width;
+            msg.image_height = decoded.height;
+        }
+
+        uint8_t* img_copy = agent_context_alloc_aligned(state->ctx, image_size,
+                                                        AGENT_CONTEXT_CACHE_LINE);
+        if (!img_copy) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+        memcpy(img_copy, image_data, image_size);
+        msg.image_data = img_copy;
+        msg.image_data_size = image_size;
+    }
+
+    agent_error_t err = detach_working_history(state);
+    if (err != AGENT_OK) {
+        return err;
+    }
+    return message_array_add(state->ctx, &state->messages, &msg);
+}
+
+agent_error_t agent_add_system_message(agent_state_t* state, const char* content) {
+    if (!state || !content) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    agent_message_t msg = {0};
+    msg.id = new_message_id(state);
+    msg.role = AGENT_ROLE_SYSTEM;
+    msg.content = agent_context_string_view(state->ctx, content);
+    msg.timestamp_ms = current_time_ms();
+    if (!msg.content.data) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    agent_error_t err = detach_working_history(state);
+    if (err != AGENT_OK) {
+        return err;
+    }
+    return message_array_add(state->ctx, &state->messages, &msg);
+}
+
+static char* build_system_prompt(agent_state_t* state) {
+    if (!state) return NULL;
+
+    const char* tools_schema = NULL;
+    if (state->tool_subset_active) {
+        tools_schema = state->tool_subset_schema.data;
+    } else if (state->config.get_tools_schema) {
+        tools_schema = state->config.get_tools_schema(state->config.user_data);
+    }
+
+    /* A registered tool changes the schema even if its text is reused in place */
+    uint64_t schema_version = state->config.tools_schema_version + state->tool_subset_version;
+    if (state->config.tool_registry) {
+        schema_version += state->config.tool_registry->version;
+    }
+
+    /* Reuse the last prompt while none of its inputs has changed */
+    if (state->prompt_valid &&
+        state->prompt_schema == tools_schema &&
+        state->prompt_schema_version == schema_version &&
+        state->prompt_custom == state->config.custom_system_prompt &&
+        state->prompt_japanese == state->config.use_japanese) {
+        return state->prompt_cache.data;
+    }
+
+    /* Heap-backed, so it outlives every arena reset */
+    agent_string_t* prompt = &state->prompt_cache;
+    if (!prompt->data && agent_string_init(prompt, 2048) != AGENT_OK) {
+        return NULL;
+    }
+    agent_string_clear(prompt);
+    state->prompt_valid = false;
+
+    agent_string_view_t schema = agent_sv_from_cstr(tools_schema ? tools_schema : "");
+    agent_error_t err = agent_string_append_template(
+        prompt, &state->prompt_template[state->config.use_japanese ? 1 : 0], &schema, 1);
+
+    if (err == AGENT_OK && state->config.custom_system_prompt) {
+        err = agent_string_append(prompt, "\n\n");
+        if (err == AGENT_OK) {
+            err = agent_string_append(prompt, state->config.custom_system_prompt);
+        }
+    }
+    if (err != AGENT_OK) {
+        return NULL;
+    }
+
+    state->prompt_valid = true;
+    state->prompt_generation++;
+    state->prompt_schema = tools_schema;
+    state->prompt_schema_version = schema_version;
+    state->prompt_custom = state->config.custom_system_prompt;
+    state->prompt_japanese = state->config.use_japanese;
+    return prompt->data;
+}
+
+char* agent_build_system_prompt(agent_state_t* state) {
+    AGENT_TRACE_BEGIN(agent_build_system_prompt);
+    char* prompt = build_system_prompt(state);
+    AGENT_TRACE_END(agent_build_system_prompt);
+    return prompt;
+}
+
+/* Batched events */
+
+bool agent_flush_events(agent_state_t* state) {
+    if (!state || state->event_count == 0 || !state->config.on_events) {
+        return true;
+    }
+
+    /* Texts sit back to back in event_text, which may have moved since */
+    size_t offset = 0;
+    for (size_t i = 0; i < state->event_count; i++) {
+        state->events[i].text.data = state->event_text.data + offset;
+        offset += state->events[i].text.length;
+    }
+
+    bool more = state->config.on_events(state->events, state->event_count, state->config.user_data);
+    state->event_count = 0;
+    agent_string_clear(&state->event_text);
+    state->events_due_ns = monotonic_ns() +
+                           (uint64_t)state->config.event_batch_interval_ms * 1000000u;
+    return more;
+}
+
+/* Queue an event, merging consecutive tokens (a DISCARD passes its length
+   without text); false = stop generating */
+static bool queue_event(agent_state_t* state, agent_event_type_t type, agent_step_t step,
+                        const char* text, size_t len) {
+    if (!state->event_text.data && agent_string_init(&state->event_text, 256) != AGENT_OK) {
+        return true;
+    }
+
+    agent_event_t* last = state->event_count > 0 ? &state->events[state->event_count - 1] : NULL;
+    if (type == AGENT_EVENT_TOKENS && last && last->type == AGENT_EVENT_TOKENS) {
+        if (agent_string_append_n(&state->event_text, text, len) == AGENT_OK) {
+            last->text.length += len;
+            last->token_count++;
+        }
+    } else {
+        if (state->event_count >= state->event_capacity) {
+            size_t capacity = state->event_capacity ? state->event_capacity * 2 : 16;
+            agent_event_t* events = agent_mem_realloc(state->events, capacity * sizeof(agent_event_t));
+            if (!events) {
+                return true;
+            }
+            state->events = events;
+            state->event_capacity = capacity;
+        }
+        if (text && agent_string_append_n(&state->event_text, text, len) != AGENT_OK) {
+            return true;
+        }
+        agent_event_t* event = &state->events[state->event_count++];
+        event->type = type;
+        event->step = step;
+        event->text = (agent_string_view_t){NULL, text ? len : 0};
+        event->token_count = type == AGENT_EVENT_TOKENS ? 1 : 0;
+        event->discard_length = type == AGENT_EVENT_DISCARD ? len : 0;
+    }
+
+    if (monotonic_ns() >= state->events_due_ns) {
+        return agent_flush_events(state);
+    }
+    return true;
+}
+
+static void set_step(agent_state_t* state, agent_step_t step, const char* tool_name) {
+    state->current_step = step;
+    if (state->config.on_events) {
+        queue_event(state, AGENT_EVENT_STEP, step, tool_name, tool_name ? strlen(tool_name) : 0);
+    } else if (state->config.on_step_change) {
+        state->config.on_step_change(step, tool_name, state->config.user_data);
+    }
+}
+
+/* Take back the text this iteration streamed, before it is generated again */
+static void discard_streamed(agent_state_t* state) {
+    size_t length = state->streamed_length;
+    state->streamed_length = 0;
+    if (length == 0) {
+        return;
+    }
+    if (state->config.on_events) {
+        queue_event(state, AGENT_EVENT_DISCARD, state->current_step, NULL, length);
+    } else if (state->config.on_discard) {
+        state->config.on_discard(length, state->config.user_data);
+    }
+}
+
+/* Tell the host a tool is about to run */
+static void notify_tool_call(agent_state_t* state, const char* tool_name) {
+    if (state->config.on_events) {
+        queue_event(state, AGENT_EVENT_TOOL_CALL, AGENT_STEP_CALLING_TOOL, tool_name, strlen(tool_name));
+    } else if (state->config.on_tool_call) {
+        state->config.on_tool_call(tool_name, state->config.user_data);
+    }
+}
+
+/* Truncation */
+
+typedef struct {
+    size_t head;                   /* Bytes kept from the start */
+    const char* marker;
+    size_t marker_len;
+    size_t tail;                   /* Bytes kept from the end */
+} truncation_plan_t;
+
+/* Where to cut text (longer than max_len) so both cuts fall on UTF-8
+   character boundaries and the marker fits within max_len */
+static truncation_plan_t plan_truncation(const char* text, size_t length, size_t max_len,
+                                         agent_truncation_t mode) {
+    truncation_plan_t plan = {0, mode == AGENT_TRUNCATE_HEAD_TAIL ? "\n...\n" : "...", 0, 0};
+    plan.marker_len = strlen(plan.marker);
+    size_t budget = max_len > plan.marker_len ? max_len - plan.marker_len : 0;
+    if (budget == 0) {
+        plan.marker = "";
+        plan.marker_len = 0;
+        budget = max_len;
+    }
+
+    /* Head ends before an incomplete character; tail starts on a character */
+    size_t head_len = mode == AGENT_TRUNCATE_HEAD_TAIL && plan.marker_len > 0 ? budget - budget / 2 : budget;
+    plan.head = agent_utf8_complete_boundary(text, head_len);
+    if (head_len < budget) {
+        size_t start = length - (budget - head_len);
+        size_t char_start = agent_utf8_char_start(text, length, start);
+        size_t next = char_start + agent_utf8_char_length((uint8_t)text[char_start]);
+        if (char_start < start && next > start) {
+            start = next;
+        }
+        plan.tail = start < length ? length - start : 0;
+    }
+    return plan;
+}
+
+/* Truncate a buffer the caller owns; returns the new length */
+static size_t truncate_in_place(char* data, size_t length, size_t max_len, agent_truncation_t mode) {
+    if (length <= max_len) {
+        return length;
+    }
+
+    truncation_plan_t plan = plan_truncation(data, length, max_len, mode);
+    memmove(data + plan.head + plan.marker_len, data + length - plan.tail, plan.tail);
+    memcpy(data + plan.head, plan.marker, plan.marker_len);
+    return plan.head + plan.marker_len + plan.tail;
+}
+
+/* Turn what the host returned into a result owned by the run arena.
+   output is the run-arena sink the tool may have written instead (or NULL) */
+static agent_tool_result_t tool_result_from_exec(agent_state_t* state,
+                                                 const agent_tool_call_t* tool_call,
+                                                 const agent_tool_execute_result_t* exec_result,
+                                                 agent_string_t* output) {
+    agent_tool_result_t result = {0};
+    result.id = agent_uuid_generate();
+    result.tool_call_id = tool_call->id;
+    result.is_error = exec_result->is_error;
+
+    /* Truncate result if needed; only the kept bytes are copied */
+    agent_string_view_t content = exec_result->content;
+    size_t limit = state->config.max_tool_result_len;
+    if (!content.data && output && output->length > 0) {
+        /* Already in the run arena: cut in place */
+        output->length = truncate_in_place(output->data, output->length, limit,
+                                           state->config.tool_result_truncation);
+        output->data[output->length] = '\0';
+        content = agent_string_view(output);
+        result.content = content;
+    } else if (content.length <= limit) {
+        result.content = agent_context_string_view_n(state->run_ctx, content.data, content.length);
+    } else {
+        result.content = agent_sv_from_cstr(agent_truncate_sv(state->run_ctx, content, limit,
+                                                              state->config.tool_result_truncation));
+    }
+
+    /* Token limit: shrink in proportion to the overshoot until it fits */
+    size_t max_tokens = state->config.max_tool_result_tokens;
+    if (max_tokens > 0 && state->config.count_tokens && result.content.data) {
+        size_t tokens = state->config.count_tokens(result.content.data, result.content.length,
+                                                   state->config.user_data);
+        for (int attempt = 0; tokens > max_tokens && attempt < 4; attempt++) {
+            limit = (size_t)((double)result.content.length * max_tokens / tokens * 0.95);
+            char* shorter = agent_truncate_sv(state->run_ctx, content, limit,
+                                              state->config.tool_result_truncation);
+            if (!shorter) break;
+            result.content = agent_sv_from_cstr(shorter);
+            tokens = state->config.count_tokens(result.content.data, result.content.length,
+                                                state->config.user_data);
+        }
+    }
+
+    return result;
+}
+
+/* Tool result cache */
+
+static uint64_t fnv1a_64(const char* data, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static void tool_cache_remove(agent_tool_cache_t* cache, size_t index) {
+    agent_mem_free(cache->entries[index].key);
+    agent_mem_free(cache->entries[index].content);
+    cache->entries[index] = cache->entries[--cache->count];
+}
+
+void agent_tool_cache_clear(agent_state_t* state) {
+    if (!state) return;
+
+    while (state->tool_cache.count > 0) {
+        tool_cache_remove(&state->tool_cache, state->tool_cache.count - 1);
+    }
+}
+
+static void image_cache_remove(agent_image_cache_t* cache, size_t index) {
+    agent_mem_free(cache->entries[index].embedding);
+    cache->entries[index] = cache->entries[--cache->count];
+}
+
+void agent_image_cache_clear(agent_state_t* state) {
+    if (!state) return;
+
+    while (state->image_cache.count > 0) {
+        image_cache_remove(&state->image_cache, state->image_cache.count - 1);
+    }
+}
+
+static agent_image_cache_entry_t* image_cache_find(agent_image_cache_t* cache, agent_uuid_t message_id) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (agent_uuid_equals(cache->entries[i].message_id, message_id)) {
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+agent_error_t agent_image_embedding_store(agent_state_t* state, agent_uuid_t message_id,
+                                          const float* embedding, size_t n_tokens, size_t n_embd) {
+    if (!state || !embedding || n_tokens == 0 || n_embd == 0 ||
+        n_tokens > SIZE_MAX / sizeof(float) / n_embd) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    agent_image_cache_t* cache = &state->image_cache;
+    if (!cache->entries) {
+        cache->entries = agent_mem_calloc(state->config.image_cache_capacity,
+                                          sizeof(agent_image_cache_entry_t));
+        if (!cache->entries) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+        cache->capacity = state->config.image_cache_capacity;
+    }
+
+    size_t bytes = n_tokens * n_embd * sizeof(float);
+    float* copy = agent_mem_alloc(bytes);
+    if (!copy) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(copy, embedding, bytes);
+
+    agent_image_cache_entry_t* entry = image_cache_find(cache, message_id);
+    if (entry) {
+        agent_mem_free(entry->embedding);
+    } else {
+        if (cache->count == cache->capacity) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < cache->count; i++) {
+                if (cache->entries[i].last_used < cache->entries[oldest].last_used) {
+                    oldest = i;
+                }
+            }
+            image_cache_remove(cache, oldest);
+        }
+        entry = &cache->entries[cache->count++];
+        entry->message_id = message_id;
+    }
+    entry->embedding = copy;
+    entry->n_tokens = n_tokens;
+    entry->n_embd = n_embd;
+    entry->last_used = ++cache->clock;
+    return AGENT_OK;
+}
+
+const float* agent_image_embedding_lookup(agent_state_t* state, agent_uuid_t message_id,
+                                          size_t* n_tokens, size_t* n_embd) {
+    if (!state) {
+        return NULL;
+    }
+
+    agent_image_cache_t* cache = &state->image_cache;
+    agent_image_cache_entry_t* entry = image_cache_find(cache, message_id);
+    if (!entry) {
+        cache->misses++;
+        return NULL;
+    }
+    entry->last_used = ++cache->clock;
+    cache->hits++;
+    if (n_tokens) *n_tokens = entry->n_tokens;
+    if (n_embd) *n_embd = entry->n_embd;
+    return entry->embedding;
+}
+
+/* A cacheable call's key and lifetime, worked out once per call */
+typedef struct {
+    agent_string_t key;   /* Empty when the call is not cacheable */
+    uint64_t hash;
+    int64_t ttl_ms;
+} tool_cache_key_t;
+
+/* Tool name, NUL, canonical arguments: equal for the same call however it was written */
+static bool tool_call_key(agent_state_t* state, agent_string_view_t name,
+                          const agent_json_value_t* arguments, agent_string_t* key) {
+    if (agent_string_init_arena(key, state->iteration_ctx, name.length + 64) != AGENT_OK ||
+        agent_string_append_sv(key, name) != AGENT_OK ||
+        agent_string_append_char(key, '\0') != AGENT_OK ||
+        agent_json_serialize_canonical(arguments, key) != AGENT_OK) {
+        key->length = 0;
+        return false;
+    }
+    return true;
+}
+
+static void tool_cache_key(agent_state_t* state, const agent_tool_call_t* call,
+                           tool_cache_key_t* out) {
+    memset(out, 0, sizeof(*out));
+    if (!state->config.tool_registry) {
+        return;
+    }
+
+    const agent_tool_definition_t* tool =
+        agent_tool_registry_find_sv(state->config.tool_registry, call->name);
+    if (!tool || tool->cache_ttl_ms == 0) {
+        return;
+    }
+
+    agent_string_t* key = &out->key;
+    if (!tool_call_key(state, call->name, call->arguments, key)) {
+        return;
+    }
+    out->hash = fnv1a_64(key->data, key->length);
+    out->ttl_ms = tool->cache_ttl_ms;
+}
+
+/* Answer a call from the cache; counts a hit or a miss for cacheable calls */
+static bool tool_cache_lookup(agent_state_t* state, const agent_tool_call_t* call,
+                              const tool_cache_key_t* key, agent_tool_result_t* out) {
+    if (key->key.length == 0) {
+        return false;
+    }
+
+    agent_tool_cache_t* cache = &state->tool_cache;
+    int64_t now = monotonic_ms();
+    for (size_t i = 0; i < cache->count; i++) {
+        agent_tool_cache_entry_t* entry = &cache->entries[i];
+        if (entry->hash != key->hash || entry->key_length != key->key.length ||
+            memcmp(entry->key, key->key.data, entry->key_length) != 0) {
+            continue;
+        }
+        if (entry->expires_ms <= now) {
+            tool_cache_remove(cache, i);
+            break;
+        }
+
+        memset(out, 0, sizeof(*out));
+        out->id = agent_uuid_generate();
+        out->tool_call_id = call->id;
+        out->content = agent_context_string_view_n(state->run_ctx, entry->content,
+                                                   entry->content_length);
+        if (!out->content.data) {
+            break;
+        }
+        entry->last_used = ++cache->clock;
+        cache->hits++;
+        return true;
+    }
+
+    cache->misses++;
+    return false;
+}
+
+/* Keep a successful result; the least recently used entry makes room */
+static void tool_cache_store(agent_state_t* state, const tool_cache_key_t* key,
+                             const agent_tool_result_t* result) {
+    if (key->key.length == 0 || result->is_error) {
+        return;
+    }
+
+    agent_tool_cache_t* cache = &state->tool_cache;
+    if (!cache->entries) {
+        cache->entries = agent_mem_calloc(state->config.tool_cache_capacity,
+                                          sizeof(agent_tool_cache_entry_t));
+        if (!cache->entries) {
+            return;
+        }
+        cache->capacity = state->config.tool_cache_capacity;
+    }
+    if (cache->count == cache->capacity) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].last_used < cache->entries[oldest].last_used) {
+                oldest = i;
+            }
+        }
+        tool_cache_remove(cache, oldest);
+    }
+
+    agent_tool_cache_entry_t entry = {0};
+    entry.key = agent_mem_alloc(key->key.length);
+    entry.content = agent_mem_alloc(result->content.length + 1);
+    if (!entry.key || !entry.content) {
+        agent_mem_free(entry.key);
+        agent_mem_free(entry.content);
+        return;
+    }
+    memcpy(entry.key, key->key.data, key->key.length);
+    memcpy(entry.content, result->content.data, result->content.length);
+    entry.content[result->content.length] = '\0';
+    entry.hash = key->hash;
+    entry.key_length = key->key.length;
+    entry.content_length = result->content.length;
+    entry.expires_ms = key->ttl_ms < 0 ? INT64_MAX : monotonic_ms() + key->ttl_ms;
+    entry.last_used = ++cache->clock;
+    cache->entries[cache->count++] = entry;
+}
+
+/* Run one call through execute_tool */
+static agent_tool_result_t call_tool(agent_state_t* state, const agent_tool_call_t* tool_call) {
+    /* Notify tool call */
+    notify_tool_call(state, tool_call->name.data);
+
+    /* A stopped run starts no more tools */
+    if (agent_cancel_requested(&state->cancel)) {
+        agent_tool_execute_result_t cancelled = {AGENT_ERROR_CANCELLED, agent_sv_from_cstr("Cancelled"), true};
+        return tool_result_from_exec(state, tool_call, &cancelled, NULL);
+    }
+
+    set_step(state, AGENT_STEP_CALLING_TOOL, tool_call->name.data);
+    agent_flush_events(state);   /* The tool may block for a while: show it first */
+
+    /* Execute via callback */
+    agent_tool_execute_result_t exec_result;
+    agent_string_t output = {0};
+    if (state->config.execute_tool_cancellable) {
+        /* Nothing else allocates in the run arena during the call, so an
+           unused sink is handed back */
+        size_t sp = agent_context_savepoint(state->run_ctx);
+        agent_string_init_arena(&output, state->run_ctx, state->config.max_tool_result_len + 1);
+        agent_tool_invocation_t invocation = {
+            &state->cancel,
+            state->config.max_tool_result_len,
+            state->config.count_tokens ? state->config.max_tool_result_tokens : 0,
+            output.data ? &output : NULL
+        };
+        exec_result = state->config.execute_tool_cancellable(
+            tool_call->name.data,
+            tool_call->arguments,
+            &invocation,
+            state->config.user_data
+        );
+        if (exec_result.content.data || output.length == 0) {
+            agent_context_restore(state->run_ctx, sp);
+            output = (agent_string_t){0};
+        }
+    } else {
+        exec_result = state->config.execute_tool(
+            tool_call->name.data,
+            tool_call->arguments,
+            state->config.user_data
+        );
+    }
+
+    agent_tool_result_t result = tool_result_from_exec(state, tool_call, &exec_result, &output);
+
+    set_step(state, AGENT_STEP_WAITING_FOR_RESULT, NULL);
+
+    return result;
+}
+
+agent_tool_result_t agent_execute_tool(agent_state_t* state,
+                                       const agent_tool_call_t* tool_call) {
+    if (!state || !tool_call) {
+        agent_tool_result_t result = {0};
+        result.id = agent_uuid_generate();
+        if (tool_call) result.tool_call_id = tool_call->id;
+        result.is_error = true;
+        result.content = agent_sv_from_cstr("Invalid tool call");
+        return result;
+    }
+
+    AGENT_TRACE_BEGIN(agent_execute_tool);
+    tool_cache_key_t key;
+    agent_tool_result_t result;
+    tool_cache_key(state, tool_call, &key);
+    if (!tool_cache_lookup(state, tool_call, &key, &result)) {
+        result = call_tool(state, tool_call);
+        tool_cache_store(state, &key, &result);
+    }
+    AGENT_TRACE_END(agent_execute_tool);
+    return result;
+}
+
+/* Run one iteration's tool calls, together through execute_tools when
+   several miss the cache; out[i] and latency_ns[i] belong to calls[i] */
+static agent_error_t execute_tool_calls(agent_state_t* state, const agent_tool_call_t* calls,
+                                        size_t count, agent_tool_result_t* out,
+                                        uint64_t* latency_ns) {
+    uint64_t started = monotonic_ns();
+    if (count < 2 || !state->config.execute_tools) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = agent_execute_tool(state, &calls[i]);
+            uint64_t now = monotonic_ns();
+            latency_ns[i] = now - started;
+            started = now;
+        }
+        return AGENT_OK;
+    }
+
+    tool_cache_key_t* keys = agent_context_alloc(state->iteration_ctx, count * sizeof(tool_cache_key_t));
+    size_t* missed = agent_context_alloc(state->iteration_ctx, count * sizeof(size_t));
+    const char** names = agent_context_alloc(state->iteration_ctx, count * sizeof(const char*));
+    const agent_json_value_t** args = agent_context_alloc(state->iteration_ctx,
+                                                          count * sizeof(const agent_json_value_t*));
+    agent_tool_execute_result_t* exec_results = agent_context_calloc(state->iteration_ctx, count,
+                                                                     sizeof(agent_tool_execute_result_t));
+    if (!keys || !missed || !names || !args || !exec_results) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    size_t miss_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        tool_cache_key(state, &calls[i], &keys[i]);
+        if (!tool_cache_lookup(state, &calls[i], &keys[i], &out[i])) {
+            missed[miss_count++] = i;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        latency_ns[i] = monotonic_ns() - started;
+    }
+    if (miss_count == 1) {
+        size_t i = missed[0];
+        out[i] = call_tool(state, &calls[i]);
+        tool_cache_store(state, &keys[i], &out[i]);
+        latency_ns[i] = monotonic_ns() - started;
+        return AGENT_OK;
+    }
+    if (miss_count == 0) {
+        return AGENT_OK;
+    }
+
+    for (size_t m = 0; m < miss_count; m++) {
+        const agent_tool_call_t* call = &calls[missed[m]];
+        names[m] = call->name.data;
+        args[m] = call->arguments;
+        notify_tool_call(state, call->name.data);
+    }
+
+    set_step(state, AGENT_STEP_CALLING_TOOL, NULL);
+    agent_flush_events(state);   /* Tools may block for a while: show them first */
+    state->config.execute_tools(names, args, miss_count, exec_results, state->config.user_data);
+
+    uint64_t latency = monotonic_ns() - started;
+    for (size_t m = 0; m < miss_count; m++) {
+        size_t i = missed[m];
+        out[i] = tool_result_from_exec(state, &calls[i], &exec_results[m], NULL);
+        tool_cache_store(state, &keys[i], &out[i]);
+        latency_ns[i] = latency;
+    }
+    set_step(state, AGENT_STEP_WAITING_FOR_RESULT, NULL);
+
+    return AGENT_OK;
+}
+
+/* Step-driven run */
+
+/* A tool call's JSON balanced while the model is still decoding */
+static void stream_tool_call_closed(const char* name, const agent_json_value_t* args,
+                                    void* user_data) {
+    agent_state_t* state = (agent_state_t*)user_data;
+    if (state->config.early_tool_dispatch) {
+        state->tool_call_closed = true;
+    }
+    if (!state->config.start_tool) {
+        return;
+    }
+
+    /* Remember it so the final parse can confirm or discard it */
+    agent_tool_speculation_t* list = &state->speculations;
+    if (list->count >= list->capacity) {
+        size_t new_capacity = list->capacity ? list->capacity * 2 : 4;
+        agent_speculated_call_t* items = agent_context_realloc(state->iteration_ctx, list->items,
+            list->capacity * sizeof(agent_speculated_call_t),
+            new_capacity * sizeof(agent_speculated_call_t));
+        if (!items) {
+            return;
+        }
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+
+    agent_speculated_call_t* call = &list->items[list->count];
+    memset(call, 0, sizeof(*call));
+    call->name = name;
+    call->arguments = args;
+    if (!tool_call_key(state, agent_sv_from_cstr(name), args, &call->key)) {
+        return;
+    }
+    list->count++;
+    state->config.start_tool(name, args, state->config.user_data);
+}
+
+/* Match started calls against the parsed ones; the rest are discarded */
+static void settle_speculations(agent_state_t* state, const agent_parse_result_t* parsed) {
+    agent_tool_speculation_t* list = &state->speculations;
+
+    for (size_t i = 0; parsed && i < parsed->count; i++) {
+        const agent_parsed_content_t* content = &parsed->contents[i];
+        if (content->type != AGENT_CONTENT_TOOL_CALL) {
+            continue;
+        }
+        agent_string_t key;
+        if (!tool_call_key(state, content->data.tool_call.name,
+                           content->data.tool_call.arguments, &key)) {
+            continue;
+        }
+        for (size_t s = 0; s < list->count; s++) {
+            agent_speculated_call_t* call = &list->items[s];
+            if (!call->confirmed && call->key.length == key.length &&
+                memcmp(call->key.data, key.data, key.length) == 0) {
+                call->confirmed = true;
+                break;
+            }
+        }
+    }
+
+    for (size_t s = 0; s < list->count; s++) {
+        agent_speculated_call_t* call = &list->items[s];
+        if (!call->confirmed && state->config.discard_tool) {
+            state->config.discard_tool(call->name, call->arguments, state->config.user_data);
+        }
+    }
+    list->count = 0;
+}
+
+/* Finish the run with an error; agent_run_end() reports it */
+static void run_fail(agent_state_t* state, agent_error_t err, const char* message) {
+    /* Nothing started during this generation will be asked for */
+    if (state->run_status == AGENT_RUN_NEEDS_GENERATION) {
+        settle_speculations(state, NULL);
+    }
+    state->run_error = err;
+    state->run_error_message = message;
+    state->run_status = AGENT_RUN_DONE;
+}
+
+static size_t count_tokens(const agent_state_t* state, agent_string_view_t text) {
+    if (text.length == 0) {
+        return 0;
+    }
+    return state->config.count_tokens(text.data, text.length, state->config.user_data);
+}
+
+/* Token cost of a message, counted once and kept in the message */
+static size_t message_tokens(agent_state_t* state, agent_message_t* msg) {
+    if (msg->token_count > 0) {
+        return msg->token_count;
+    }
+
+    size_t tokens = AGENT_MESSAGE_TOKEN_OVERHEAD;
+    tokens += count_tokens(state, msg->content);
+    tokens += count_tokens(state, msg->thinking_content);
+    for (size_t i = 0; i < msg->tool_calls_count; i++) {
+        const agent_tool_call_t* call = &msg->tool_calls[i];
+        tokens += count_tokens(state, call->name);
+        char* args = call->arguments
+            ? agent_json_to_string(state->iteration_ctx, call->arguments, false) : NULL;
+        if (args) {
+            tokens += count_tokens(state, agent_sv_from_cstr(args));
+        }
+    }
+
+    msg->token_count = tokens;
+    return tokens;
+}
+
+/* Replace a tool message's result with its first max_len bytes */
+static void shrink_tool_message(agent_state_t* state, agent_message_t* msg, size_t max_len) {
+    size_t keep = agent_utf8_complete_boundary(msg->content.data, max_len - 3);  /* -3 for "..." */
+    char* cut = agent_context_alloc(state->iteration_ctx, keep + 4);
+    agent_tool_result_t* results = NULL;
+    if (msg->tool_results_count > 0) {
+        results = agent_context_alloc(state->iteration_ctx,
+                                      msg->tool_results_count * sizeof(agent_tool_result_t));
+    }
+    if (!cut || (msg->tool_results_count > 0 && !results)) {
+        return;
+    }
+    memcpy(cut, msg->content.data, keep);
+    memcpy(cut + keep, "...", 4);  /* includes null terminator */
+    agent_string_view_t view = {cut, keep + 3};
+
+    for (size_t i = 0; i < msg->tool_results_count; i++) {
+        results[i] = msg->tool_results[i];
+        if (results[i].content.data == msg->content.data) {
+            results[i].content = view;
+        }
+    }
+    msg->content = view;
+    msg->tool_results = results;
+    msg->token_count = 0;
+}
+
+/* Add the conversation's new messages to the recall index (system messages as empty documents) */
+static bool recall_catch_up(agent_state_t* state) {
+    const agent_message_array_t* messages = &state->messages;
+    while (state->recall_indexed < messages->count) {
+        size_t i = state->recall_indexed;
+        agent_string_view_t text = messages->roles[i] == AGENT_ROLE_SYSTEM
+            ? (agent_string_view_t){0} : messages->messages[i].content;
+        if (agent_recall_add(&state->recall, text) != AGENT_OK) {
+            return false;
+        }
+        state->recall_indexed++;
+    }
+    return true;
+}
+
+/*
+ * Decide which turns before current stay in the window: up to
+ * context_recall_turns that best match the current user message, then
+ * the newest of the rest while they fit. Returns a flag per message, set
+ * at the user message starting each kept turn (and at current), or NULL
+ * to fall back to keeping the newest turns only.
+ */
+static bool* recall_turns(agent_state_t* state, const agent_message_t* window, size_t count,
+                          size_t current, size_t total, size_t budget) {
+    const uint8_t* roles = state->working_history.roles;
+    if (current >= count || !recall_catch_up(state)) {
+        return NULL;
+    }
+
+    size_t docs = state->recall.doc_count;
+    float* scores = agent_context_alloc(state->iteration_ctx, (docs + 1) * sizeof(float));
+    size_t* starts = agent_context_alloc(state->iteration_ctx, count * sizeof(size_t));
+    size_t* costs = agent_context_alloc(state->iteration_ctx, count * sizeof(size_t));
+    float* turn_scores = agent_context_alloc(state->iteration_ctx, count * sizeof(float));
+    size_t* order = agent_context_alloc(state->iteration_ctx, count * sizeof(size_t));
+    bool* keep = agent_context_alloc(state->iteration_ctx, count * sizeof(bool));
+    if (!scores || !starts || !costs || !turn_scores || !order || !keep ||
+        agent_recall_score(&state->recall, window[current].content, scores) != AGENT_OK) {
+        return NULL;
+    }
+    memset(keep, 0, count * sizeof(bool));
+    keep[current] = true;
+
+    /* Turns before current; base is what the window costs without any of them */
+    size_t turns = 0;
+    size_t base = total;
+    for (size_t i = 0; i < current; i++) {
+        if (roles[i] == AGENT_ROLE_USER) {
+            starts[turns] = i;
+            costs[turns] = 0;
+            turn_scores[turns] = 0;
+            turns++;
+        }
+        if (turns == 0 || roles[i] == AGENT_ROLE_SYSTEM) {
+            continue;
+        }
+        size_t turn = turns - 1;
+        costs[turn] += window[i].token_count;
+        base -= window[i].token_count;
+        if (i < docs && scores[i] > turn_scores[turn]) {
+            turn_scores[turn] = scores[i];
+        }
+    }
+
+    /* Best match first; among equals, the newer turn */
+    size_t ranked = 0;
+    for (size_t t = 0; t < turns; t++) {
+        if (turn_scores[t] <= 0) continue;
+        size_t pos = ranked++;
+        while (pos > 0 && turn_scores[order[pos - 1]] <= turn_scores[t]) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = t;
+    }
+
+    size_t recalled = 0;
+    for (size_t r = 0; r < ranked && recalled < state->config.context_recall_turns; r++) {
+        size_t t = order[r];
+        if (base + costs[t] <= budget) {
+            keep[starts[t]] = true;
+            base += costs[t];
+            recalled++;
+        }
+    }
+    for (size_t t = turns; t > 0; t--) {
+        if (keep[starts[t - 1]]) continue;
+        if (base + costs[t - 1] > budget) break;
+        keep[starts[t - 1]] = true;
+        base += costs[t - 1];
+    }
+    return keep;
+}
+
+/* Pick the messages the pending generation sends so the prompt fits the budget */
+static void select_context(agent_state_t* state) {
+    agent_message_array_t* history = &state->working_history;
+    state->send_messages = history->messages;
+    state->send_count = history->count;
 
-    /* Reset arena (keeps first block) */
-    agent_context_reset(state->ctx);
+    size_t budget = state->config.context_token_budget;
+    if (budget == 0 || !state->config.count_tokens) {
+        return;
+    }
 
-    /* Reinitialize arrays */
-    state->messages.messages = agent_context_calloc(state->ctx, DEFAULT_MESSAGE_CAPACITY, sizeof(agent_message_t));
-    state->messages.count = 0;
-    state->messages.capacity = DEFAULT_MESSAGE_CAPACITY;
+    /* The prompt only changes when it is rebuilt */
+    if (state->prompt_tokens_generation != state->prompt_generation) {
+        state->prompt_tokens = state->system_prompt
+            ? count_tokens(state, agent_sv_from_cstr(state->system_prompt)) : 0;
+        state->prompt_tokens_generation = state->prompt_generation;
+    }
 
-    state->working_history.messages = agent_context_calloc(state->ctx, DEFAULT_MESSAGE_CAPACITY, sizeof(agent_message_t));
-    state->working_history.count = 0;
-    state->working_history.capacity = DEFAULT_MESSAGE_CAPACITY;
+    size_t total = state->prompt_tokens;
+    for (size_t i = 0; i < history->count; i++) {
+        total += message_tokens(state, &history->messages[i]);
+    }
+    if (total <= budget) {
+        return;
+    }
 
-    /* Reset state */
-    state->current_step = AGENT_STEP_NONE;
-    state->iteration_count = 0;
-    state->is_processing = false;
-    state->should_stop = false;
+    /* Over budget: work on a copy, the history itself stays intact */
+    size_t count = history->count;
+    agent_message_t* window = agent_context_alloc(state->iteration_ctx, count * sizeof(agent_message_t));
+    if (!window) {
+        return;
+    }
+    memcpy(window, history->messages, count * sizeof(agent_message_t));
+    const uint8_t* roles = history->roles;
+
+    /* Cut older tool results first, oldest first; the latest round stays whole */
+    size_t latest = state->tool_round_start < count ? state->tool_round_start : count;
+    size_t max_len = state->config.context_tool_result_len;
+    for (size_t i = 0; i < latest && total > budget; i++) {
+        agent_message_t* msg = &window[i];
+        if (roles[i] != AGENT_ROLE_TOOL || msg->content.length <= max_len) {
+            continue;
+        }
+        size_t before = msg->token_count;
+        shrink_tool_message(state, msg, max_len);
+        total = total - before + message_tokens(state, msg);
+    }
 
-    agent_string_clear(&state->current_response);
-    agent_string_clear(&state->thinking_content);
-    agent_streaming_parser_reset(&state->parser);
-}
+    /*
+     * Then leave out earlier turns, keeping system messages and the
+     * current turn: the oldest first, or those recall_turns passes over
+     */
+    size_t current = message_array_find_last(history, AGENT_ROLE_USER);
+    const bool* keep = state->config.context_recall_turns > 0 && total > budget
+        ? recall_turns(state, window, count, current, total, budget) : NULL;
+
+    size_t kept = 0;
+    bool dropping = false;
+    for (size_t i = 0; i < count; i++) {
+        if (roles[i] == AGENT_ROLE_USER) {
+            dropping = keep ? !keep[i] : i < current && total > budget;
+        }
+        if (dropping && roles[i] != AGENT_ROLE_SYSTEM) {
+            total -= window[i].token_count;
+            continue;
+        }
+        window[kept++] = window[i];
+    }
 
-agent_error_t agent_add_user_message(agent_state_t* state, const char* content) {
-    return agent_add_user_message_with_image(state, content, NULL, 0);
+    state->send_messages = window;
+    state->send_count = kept;
 }
 
-agent_error_t agent_add_user_message_with_image(agent_state_t* state,
-                                                const char* content,
-                                                const uint8_t* image_data,
-                                                size_t image_size) {
-    if (!state || !content) {
-        return AGENT_ERROR_INVALID_ARGUMENT;
+/* Compare the pending generation's messages with the previous one's for the same model */
+static void update_generation_info(agent_state_t* state) {
+    const agent_message_t* messages = state->send_messages;
+    size_t count = state->send_count;
+    size_t stable = 0;
+    agent_sent_prompt_t* sent = &state->sent[state->routed];
+
+    if (state->system_prompt && sent->prompt_generation == state->prompt_generation) {
+        size_t limit = sent->count < count ? sent->count : count;
+        while (stable < limit &&
+               agent_uuid_equals(sent->messages[stable].id, messages[stable].id) &&
+               sent->messages[stable].content_length == messages[stable].content.length) {
+            stable++;
+        }
+    }
+    state->generation.conversation_id = state->conversation_id;
+    state->generation.stable_prefix_count = stable;
+    state->generation.cancel = &state->cancel;
+    state->generation.grammar = NULL;
+    const agent_tool_registry_t* registry = state->config.tool_registry;
+    if (state->config.constrain_tool_calls && registry) {
+        if (state->tool_subset_active) {
+            state->generation.grammar = agent_mcp_get_subset_tool_grammar(
+                state->iteration_ctx, registry, state->tool_subset, state->tool_subset_count);
+        } else if (registry->grammar && registry->grammar_version == registry->version) {
+            state->generation.grammar = registry->grammar;    /* Frozen or memoized */
+        } else {
+            state->generation.grammar = agent_mcp_get_tool_grammar(state->iteration_ctx, registry);
+        }
     }
 
-    agent_message_t msg = {0};
-    msg.id = agent_uuid_generate();
-    msg.role = AGENT_ROLE_USER;
-    msg.content = agent_context_string_view(state->ctx, content);
-    msg.timestamp_ms = current_time_ms();
-
-    if (image_data && image_size > 0) {
-        uint8_t* img_copy = agent_context_alloc(state->ctx, image_size);
-        if (img_copy) {
-            memcpy(img_copy, image_data, image_size);
-            msg.image_data = img_copy;
-            msg.image_data_size = image_size;
+    /* Remember what this generation sends; on failure the next hint is 0 */
+    sent->count = 0;
+    if (count > sent->capacity) {
+        size_t capacity = count * 2;
+        agent_sent_message_t* grown = agent_mem_realloc(sent->messages, capacity * sizeof(agent_sent_message_t));
+        if (!grown) {
+            return;
         }
+        sent->messages = grown;
+        sent->capacity = capacity;
     }
+    for (size_t i = 0; i < count; i++) {
+        sent->messages[i].id = messages[i].id;
+        sent->messages[i].content_length = messages[i].content.length;
+    }
+    sent->count = count;
+    sent->prompt_generation = state->prompt_generation;
+}
 
-    return message_array_add(state->ctx, &state->messages, &msg);
+static agent_iteration_trace_t* current_trace(agent_state_t* state) {
+    return &state->trace[state->iteration_count - 1];
 }
 
-agent_error_t agent_add_system_message(agent_state_t* state, const char* content) {
-    if (!state || !content) {
-        return AGENT_ERROR_INVALID_ARGUMENT;
+/* Record what the finished iteration left in the arenas */
+static void finish_trace(agent_state_t* state) {
+    if (state->iteration_count > 0) {
+        agent_iteration_trace_t* trace = current_trace(state);
+        trace->iteration_arena_bytes = agent_context_used(state->iteration_ctx);
+        trace->run_arena_bytes = agent_context_used(state->run_ctx);
     }
-
-    agent_message_t msg = {0};
-    msg.id = agent_uuid_generate();
-    msg.role = AGENT_ROLE_SYSTEM;
-    msg.content = agent_context_string_view(state->ctx, content);
-    msg.timestamp_ms = current_time_ms();
-
-    return message_array_add(state->ctx, &state->messages, &msg);
 }
 
-char* agent_build_system_prompt(agent_state_t* state) {
-    if (!state) return NULL;
-
-    const char* tools_schema = "";
-    if (state->config.get_tools_schema) {
-        tools_schema = state->config.get_tools_schema(state->config.user_data);
-        if (!tools_schema) tools_schema = "";
+/* Offer only the tools the latest user message calls for */
+static void select_tools(agent_state_t* state) {
+    state->tool_subset_active = false;
+    const agent_tool_registry_t* registry = state->config.tool_registry;
+    size_t top_k = state->config.tool_selection_top_k;
+    if (!registry || top_k == 0 || registry->count <= top_k) {
+        return;
     }
 
-    const char* template = state->config.use_japanese ? SYSTEM_PROMPT_JA : SYSTEM_PROMPT_EN;
+    agent_string_view_t query = {NULL, 0};
+    size_t latest = message_array_find_last(&state->messages, AGENT_ROLE_USER);
+    if (latest < state->messages.count) {
+        query = state->messages.messages[latest].content;
+    }
 
-    agent_string_t prompt;
-    if (agent_string_init(&prompt, 2048) != AGENT_OK) {
-        return NULL;
+    size_t* picked = agent_context_alloc(state->iteration_ctx, top_k * sizeof(size_t));
+    size_t count = picked ? agent_tool_registry_select(registry, query, top_k, picked) : 0;
+    if (count == 0) {
+        return;
     }
 
-    agent_string_append_fmt(&prompt, template, tools_schema);
+    /* Same tools as last run: keep the schema text, and with it the prompt */
+    if (state->tool_subset_schema.data && count == state->tool_subset_count &&
+        state->tool_subset_registry_version == registry->version &&
+        memcmp(picked, state->tool_subset, count * sizeof(size_t)) == 0) {
+        state->tool_subset_active = true;
+        return;
+    }
 
-    if (state->config.custom_system_prompt) {
-        agent_string_append(&prompt, "\n\n");
-        agent_string_append(&prompt, state->config.custom_system_prompt);
+    char* json = state->config.compact_tool_schema
+        ? agent_mcp_get_subset_schema_compact(state->iteration_ctx, registry, picked, count)
+        : agent_mcp_get_subset_schema_json(state->iteration_ctx, registry, picked, count, false);
+    if (!json) {
+        return;
+    }
+    if (count > state->tool_subset_capacity) {
+        size_t* subset = agent_mem_realloc(state->tool_subset, top_k * sizeof(size_t));
+        if (!subset) {
+            return;
+        }
+        state->tool_subset = subset;
+        state->tool_subset_capacity = top_k;
+    }
+    agent_string_t* schema = &state->tool_subset_schema;
+    if (!schema->data && agent_string_init(schema, strlen(json) + 1) != AGENT_OK) {
+        return;
+    }
+    agent_string_clear(schema);
+    if (agent_string_append(schema, json) != AGENT_OK) {
+        return;
     }
 
-    char* result = agent_context_strdup(state->ctx, prompt.data);
-    agent_string_free(&prompt);
-    return result;
+    memcpy(state->tool_subset, picked, count * sizeof(size_t));
+    state->tool_subset_count = count;
+    state->tool_subset_registry_version = registry->version;
+    state->tool_subset_version++;
+    state->tool_subset_active = true;
 }
 
-/* Set step and notify callback */
-static void set_step(agent_state_t* state, agent_step_t step, const char* tool_name) {
-    state->current_step = step;
-    if (state->config.on_step_change) {
-        state->config.on_step_change(step, tool_name, state->config.user_data);
+static bool has_tool_call_content(const agent_parse_result_t* parsed) {
+    for (size_t i = 0; i < parsed->count; i++) {
+        if (parsed->contents[i].type == AGENT_CONTENT_TOOL_CALL) {
+            return true;
+        }
     }
+    return false;
 }
 
-/* Execute tool */
-agent_tool_result_t agent_execute_tool(agent_state_t* state,
-                                       const agent_tool_call_t* tool_call) {
-    agent_tool_result_t result = {0};
-    result.id = agent_uuid_generate();
-    result.tool_call_id = tool_call->id;
-
-    if (!state || !tool_call) {
-        result.is_error = true;
-        result.content = agent_sv_from_cstr("Invalid tool call");
-        return result;
+/* Whether the model called a tool the selected subset left out */
+static bool calls_unoffered_tool(const agent_state_t* state, const agent_parse_result_t* parsed) {
+    const agent_tool_registry_t* registry = state->config.tool_registry;
+    for (size_t i = 0; i < parsed->count; i++) {
+        if (parsed->contents[i].type != AGENT_CONTENT_TOOL_CALL) continue;
+
+        const agent_tool_definition_t* tool =
+            agent_tool_registry_find_sv(registry, parsed->contents[i].data.tool_call.name);
+        bool offered = false;
+        for (size_t k = 0; tool && k < state->tool_subset_count; k++) {
+            offered = offered || state->tool_subset[k] == (size_t)(tool - registry->tools);
+        }
+        if (!offered) {
+            return true;
+        }
     }
+    return false;
+}
 
-    /* Notify tool call */
-    if (state->config.on_tool_call) {
-        state->config.on_tool_call(tool_call->name.data, state->config.user_data);
+/* Start the next loop iteration, or finish if the budget is spent
+   (routed = the router model generates it) */
+static void start_iteration(agent_state_t* state, bool routed) {
+    /* Everything the last iteration kept has been copied to the run arena */
+    finish_trace(state);
+    agent_context_reset(state->iteration_ctx);
+
+    if (state->iteration_count >= state->config.max_iterations) {
+        run_fail(state, AGENT_ERROR_MAX_ITERATIONS, "Maximum iterations reached");
+        return;
+    }
+    state->iteration_count++;
+    state->routed = routed;
+
+    uint64_t started = monotonic_ns();
+    state->system_prompt = agent_build_system_prompt(state);
+    select_context(state);
+    update_generation_info(state);
+    current_trace(state)->prompt_build_ns = monotonic_ns() - started;
+    current_trace(state)->routed = routed;
+
+    agent_tool_tag_scanner_reset(&state->tag_scanner);
+    state->tag_scanner.tags = &state->parser.tags;
+    state->detected_tool_call = false;
+    state->tool_call_closed = false;
+    state->streamed_length = 0;
+    state->speculations = (agent_tool_speculation_t){0};
+
+    if (state->config.early_tool_dispatch || state->config.start_tool) {
+        agent_streaming_parser_reset(&state->parser);
+        state->parser.dispatch_on_json_close = true;
+        state->parser.on_tool_call = stream_tool_call_closed;
+        state->parser.user_data = state;
     }
 
-    set_step(state, AGENT_STEP_CALLING_TOOL, tool_call->name.data);
+    set_step(state, AGENT_STEP_GENERATING, NULL);
+    agent_rope_clear(&state->current_response);
+    state->run_status = AGENT_RUN_NEEDS_GENERATION;
+    state->generation_started_ns = monotonic_ns();
+}
 
-    /* Execute via callback */
-    agent_tool_execute_result_t exec_result = state->config.execute_tool(
-        tool_call->name.data,
-        tool_call->arguments,
-        state->config.user_data
-    );
+static void begin_iteration(agent_state_t* state) {
+    start_iteration(state, state->config.route_generate != NULL);
+}
 
-    result.is_error = exec_result.is_error;
+agent_error_t agent_run_begin(agent_state_t* state) {
+    if (!state) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    if (state->is_processing) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
 
-    /* Truncate result if needed */
-    if (exec_result.content.length > state->config.max_tool_result_len) {
-        char* truncated = agent_truncate_text(state->ctx, exec_result.content.data,
-                                              state->config.max_tool_result_len);
-        result.content = agent_sv_from_cstr(truncated);
-    } else {
-        result.content = agent_context_string_view_n(state->ctx,
-            exec_result.content.data, exec_result.content.length);
+    cancel_token_reset(&state->cancel, state->config.run_timeout_ms);
+    state->events_due_ns = monotonic_ns() + (uint64_t)state->config.event_batch_interval_ms * 1000000u;
+    state->iteration_count = 0;
+    state->run_error = AGENT_OK;
+    state->run_error_message = NULL;
+    state->has_pending_assistant = false;
+    state->pending_count = 0;
+
+    /* Release the previous run's working data */
+    agent_context_reset(state->run_ctx);
+    agent_context_reset(state->iteration_ctx);
+    if (init_run_buffers(state) != AGENT_OK) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
     }
 
-    set_step(state, AGENT_STEP_WAITING_FOR_RESULT, NULL);
+    /* The run appends after the conversation instead of copying it */
+    share_working_history(state);
+    state->tool_round_start = state->working_history.count;
 
-    return result;
+    /* Track all tool calls */
+    state->run_tool_calls.items = agent_context_calloc(state->run_ctx, DEFAULT_TOOL_CALLS_CAPACITY, sizeof(agent_tool_call_t));
+    state->run_tool_calls.capacity = DEFAULT_TOOL_CALLS_CAPACITY;
+    state->run_tool_calls.count = 0;
+
+    state->trace = agent_context_calloc(state->run_ctx, (size_t)state->config.max_iterations,
+                                        sizeof(agent_iteration_trace_t));
+    state->tool_latency_ns = NULL;
+    state->tool_latency_capacity = 0;
+    if (!state->working_history.messages || !state->run_tool_calls.items || !state->trace) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    state->is_processing = true;
+    select_tools(state);
+    begin_iteration(state);
+    return AGENT_OK;
 }
 
-/* Streaming token callback wrapper */
-typedef struct {
-    agent_state_t* state;
-    bool detected_tool_call;
-} stream_context_t;
+agent_run_status_t agent_run_poll(agent_state_t* state, agent_run_request_t* out_request) {
+    if (out_request) {
+        memset(out_request, 0, sizeof(agent_run_request_t));
+    }
+    if (!state) {
+        return AGENT_RUN_IDLE;
+    }
+
+    if (state->run_status != AGENT_RUN_DONE && state->run_status != AGENT_RUN_IDLE) {
+        const char* reason = cancel_reason(state);
+        if (reason) {
+            run_fail(state, AGENT_ERROR_CANCELLED, reason);
+        }
+    }
 
-static bool streaming_token_callback(const char* token, size_t len, void* user_data) {
-    stream_context_t* ctx = (stream_context_t*)user_data;
-    agent_state_t* state = ctx->state;
+    if (out_request) {
+        if (state->run_status == AGENT_RUN_NEEDS_GENERATION) {
+            out_request->messages = state->send_messages;
+            out_request->message_count = state->send_count;
+            out_request->system_prompt = state->system_prompt;
+            out_request->generation = state->generation;
+            out_request->route = state->routed;
+        } else if (state->run_status == AGENT_RUN_NEEDS_TOOL_RESULTS) {
+            out_request->tool_calls = state->run_tool_calls.items + state->pending_first;
+            out_request->tool_call_count = state->pending_count;
+            out_request->tool_args = state->pending_args;
+        }
+    }
+    return state->run_status;
+}
 
-    if (state->should_stop) {
+bool agent_run_feed_token(agent_state_t* state, const char* token, size_t len) {
+    if (!state || state->run_status != AGENT_RUN_NEEDS_GENERATION ||
+        agent_cancel_requested(&state->cancel)) {
         return false;
     }
 
+    agent_iteration_trace_t* trace = current_trace(state);
+    if (trace->decode_tokens++ == 0) {
+        trace->first_token_ns = monotonic_ns() - state->generation_started_ns;
+    }
+
     /* Append to current response */
-    agent_string_append_n(&state->current_response, token, len);
+    agent_rope_append(&state->current_response, token, len);
 
-    /* Check for tool call start */
-    if (!ctx->detected_tool_call && agent_parser_has_incomplete_tool_call(
-            state->current_response.data, state->current_response.length)) {
-        ctx->detected_tool_call = true;
+    /* Check for tool call start (scans only the new token) */
+    if (agent_tool_tag_scanner_feed(&state->tag_scanner, token, len) && !state->detected_tool_call) {
+        state->detected_tool_call = true;
         set_step(state, AGENT_STEP_THINKING, NULL);
     }
 
+    /* Stop decoding as soon as the tool call is complete; whitespace and
+       the closing tag would only cost more tokens */
+    if (state->config.early_tool_dispatch || state->config.start_tool) {
+        agent_streaming_parser_feed(&state->parser, token, len);
+        if (state->tool_call_closed) {
+            return false;
+        }
+    }
+
+    /* The router's text is never shown; too much of it and the main model takes over */
+    if (state->routed && !state->detected_tool_call) {
+        return state->current_response.length < state->config.route_probe_length;
+    }
+
     /* Pass through to user callback if not in tool call */
-    if (!ctx->detected_tool_call && state->config.on_token) {
+    if (!state->detected_tool_call && state->config.on_events) {
+        state->streamed_length += len;
+        return queue_event(state, AGENT_EVENT_TOKENS, AGENT_STEP_GENERATING, token, len);
+    }
+    if (!state->detected_tool_call && state->config.on_token) {
+        state->streamed_length += len;
         return state->config.on_token(token, len, state->config.user_data);
     }
 
     return true;
 }
 
-/* Process a single iteration */
-static agent_error_t process_iteration(agent_state_t* state,
-                                       agent_tool_call_array_t* all_tool_calls,
-                                       bool* has_tool_call) {
-    *has_tool_call = false;
-
-    /* Build system prompt */
-    char* system_prompt = agent_build_system_prompt(state);
+/* Record the assistant message for the iteration that just finished */
+static void add_assistant_message(agent_state_t* state) {
+    if (state->has_pending_assistant) {
+        working_history_add(state, &state->pending_assistant);
+        state->has_pending_assistant = false;
+    }
+}
 
-    /* Set up streaming context */
-    stream_context_t stream_ctx = {
-        .state = state,
-        .detected_tool_call = false
-    };
+/* Schema-ordered arguments for the pending calls of registry tools */
+static agent_error_t flatten_pending_args(agent_state_t* state) {
+    state->pending_args = NULL;
+    if (!state->config.flat_tool_arguments || !state->config.tool_registry) {
+        return AGENT_OK;
+    }
 
-    set_step(state, AGENT_STEP_GENERATING, NULL);
-    agent_string_clear(&state->current_response);
-
-    /* Call LLM */
-    agent_llm_result_t llm_result = state->config.generate(
-        state->working_history.messages,
-        state->working_history.count,
-        system_prompt,
-        streaming_token_callback,
-        &stream_ctx
-    );
+    agent_tool_args_t* pending = agent_context_calloc(state->iteration_ctx, state->pending_count,
+                                                      sizeof(agent_tool_args_t));
+    if (!pending) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    for (size_t i = 0; i < state->pending_count; i++) {
+        const agent_tool_call_t* call = &state->run_tool_calls.items[state->pending_first + i];
+        const agent_tool_definition_t* tool =
+            agent_tool_registry_find_sv(state->config.tool_registry, call->name);
+        pending[i].tool = tool;
+        if (!tool) continue;
+
+        agent_tool_arg_t* args = NULL;
+        if (tool->parameters_count > 0) {
+            args = agent_context_alloc(state->iteration_ctx, tool->parameters_count * sizeof(agent_tool_arg_t));
+            if (!args) {
+                return AGENT_ERROR_OUT_OF_MEMORY;
+            }
+        }
+        if (agent_tool_args_flatten(tool, call->arguments, args, &pending[i].error_field) == AGENT_OK) {
+            pending[i].args = args;
+            pending[i].count = tool->parameters_count;
+        }
+    }
+    state->pending_args = pending;
+    return AGENT_OK;
+}
 
-    if (llm_result.error != AGENT_OK) {
-        return llm_result.error;
+/* Parse the finished response; tool calls are queued for results */
+static agent_error_t process_response(agent_state_t* state) {
+    /* The parser wants the response in one piece */
+    const agent_tag_set_t* tags = &state->parser.tags;
+    agent_tag_t close_tag = state->tag_scanner.close_tag;
+    agent_string_t flat;
+    agent_string_t* response = &flat;
+    if (agent_string_init_arena(response, state->iteration_ctx,
+                                state->current_response.length + tags->length[close_tag] + 1) != AGENT_OK ||
+        agent_rope_flatten(&state->current_response, response) != AGENT_OK) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
     }
 
-    if (state->should_stop) {
-        return AGENT_ERROR_CANCELLED;
+    /* Generation stopped inside a tool call block that has a closing tag:
+       drop any partial tag after the final brace and complete it */
+    if (state->tool_call_closed && state->tag_scanner.in_tool_call &&
+        tags->length[close_tag] > 0) {
+        while (response->length > 0 && response->data[response->length - 1] != '}' &&
+               response->data[response->length - 1] != ']') {
+            response->length--;
+        }
+        response->data[response->length] = '\0';
+        agent_string_append_n(response, tags->text[close_tag], tags->length[close_tag]);
     }
 
-    /* Parse response */
-    agent_parse_result_t parse_result = agent_parser_parse(
-        state->ctx,
-        state->current_response.data,
-        state->current_response.length
+    /* Parse response, reusing what the scanner learned while streaming */
+    agent_parse_result_t parse_result = agent_parser_parse_scanned(
+        state->iteration_ctx,
+        &state->tag_scanner,
+        response->data,
+        response->length
     );
 
+    /* It was not shown that tool: offer every tool and generate again,
+       after the host drops the text it was sent */
+    if (state->tool_subset_active && calls_unoffered_tool(state, &parse_result)) {
+        agent_parse_result_t none = {0};
+        settle_speculations(state, &none);
+        discard_streamed(state);
+        state->tool_subset_active = false;
+        begin_iteration(state);
+        return AGENT_OK;
+    }
+
+    /* The router answered, or its tool call did not parse: the main model redoes the iteration */
+    if (state->routed && !has_tool_call_content(&parse_result)) {
+        agent_parse_result_t none = {0};
+        settle_speculations(state, &none);
+        start_iteration(state, false);
+        return AGENT_OK;
+    }
+    settle_speculations(state, &parse_result);
+
     /* Process parsed content */
+    agent_tool_call_array_t* all_tool_calls = &state->run_tool_calls;
+    size_t first_call = all_tool_calls->count;
+    bool has_tool_call = false;
     agent_string_t text_content;
-    agent_string_init(&text_content, 256);
-
+    if (agent_string_init_arena(&text_content, state->run_ctx, 256) != AGENT_OK) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
     for (size_t i = 0; i < parse_result.count; i++) {
         agent_parsed_content_t* content = &parse_result.contents[i];
 
@@ -370,184 +1818,334 @@ static agent_error_t process_iteration(agent_state_t* state,
                 break;
 
             case AGENT_CONTENT_TOOL_CALL: {
-                *has_tool_call = true;
+                has_tool_call = true;
 
-                /* Create tool call */
+                /* Create tool call (copied out of the iteration arena) */
                 agent_tool_call_t tc = {0};
                 tc.id = agent_uuid_generate();
-                tc.name = content->data.tool_call.name;
-                tc.arguments = content->data.tool_call.arguments;
+                tc.name = agent_context_string_view_n(state->run_ctx,
+                    content->data.tool_call.name.data, content->data.tool_call.name.length);
+                tc.arguments = agent_json_clone(state->run_ctx, content->data.tool_call.arguments);
 
                 /* Add to array */
                 if (all_tool_calls->count >= all_tool_calls->capacity) {
                     size_t new_cap = all_tool_calls->capacity * 2;
-                    agent_tool_call_t* new_items = agent_context_calloc(
-                        state->ctx, new_cap, sizeof(agent_tool_call_t));
+                    agent_tool_call_t* new_items = agent_context_realloc(state->run_ctx,
+                        all_tool_calls->items,
+                        all_tool_calls->capacity * sizeof(agent_tool_call_t),
+                        new_cap * sizeof(agent_tool_call_t));
                     if (!new_items) {
-                        agent_string_free(&text_content);
                         return AGENT_ERROR_OUT_OF_MEMORY;
                     }
-                    memcpy(new_items, all_tool_calls->items,
-                           all_tool_calls->count * sizeof(agent_tool_call_t));
                     all_tool_calls->items = new_items;
                     all_tool_calls->capacity = new_cap;
                 }
                 all_tool_calls->items[all_tool_calls->count++] = tc;
-
-                /* Execute tool */
-                agent_tool_result_t result = agent_execute_tool(state, &tc);
-
-                /* Add tool message to working history */
-                agent_message_t tool_msg = {0};
-                tool_msg.id = agent_uuid_generate();
-                tool_msg.role = AGENT_ROLE_TOOL;
-                tool_msg.content = result.content;
-                tool_msg.timestamp_ms = current_time_ms();
-                tool_msg.tool_results = agent_context_alloc(state->ctx, sizeof(agent_tool_result_t));
-                if (tool_msg.tool_results) {
-                    tool_msg.tool_results[0] = result;
-                    tool_msg.tool_results_count = 1;
-                }
-
-                message_array_add(state->ctx, &state->working_history, &tool_msg);
                 break;
             }
         }
     }
 
-    /* Add assistant message to working history */
-    if (text_content.length > 0 || !*has_tool_call) {
-        agent_message_t assistant_msg = {0};
-        assistant_msg.id = agent_uuid_generate();
-        assistant_msg.role = AGENT_ROLE_ASSISTANT;
-        assistant_msg.content = agent_context_string_view(state->ctx, text_content.data);
-        assistant_msg.timestamp_ms = current_time_ms();
+    /* The assistant message follows this iteration's tool results */
+    state->has_pending_assistant = false;
+    if (text_content.length > 0 || !has_tool_call) {
+        agent_message_t* assistant_msg = &state->pending_assistant;
+        memset(assistant_msg, 0, sizeof(agent_message_t));
+        assistant_msg->id = new_message_id(state);
+        assistant_msg->role = AGENT_ROLE_ASSISTANT;
+        assistant_msg->content = agent_string_view(&text_content);
+        assistant_msg->timestamp_ms = current_time_ms();
 
         if (state->thinking_content.length > 0) {
-            assistant_msg.thinking_content = agent_context_string_view(
-                state->ctx, state->thinking_content.data);
+            assistant_msg->thinking_content = agent_context_string_view(
+                state->run_ctx, state->thinking_content.data);
         }
 
         /* Attach tool calls if any in this iteration */
-        if (*has_tool_call) {
-            assistant_msg.tool_calls = all_tool_calls->items + (all_tool_calls->count - 1);
-            assistant_msg.tool_calls_count = 1;  /* Just the latest one for this message */
+        if (has_tool_call) {
+            assistant_msg->tool_calls = all_tool_calls->items + (all_tool_calls->count - 1);
+            assistant_msg->tool_calls_count = 1;  /* Just the latest one for this message */
         }
+        state->has_pending_assistant = true;
+    }
 
-        message_array_add(state->ctx, &state->working_history, &assistant_msg);
+    if (!has_tool_call) {
+        add_assistant_message(state);
+        state->run_status = AGENT_RUN_DONE;
+        return AGENT_OK;
     }
 
-    agent_string_free(&text_content);
+    /* Wait for a result per call */
+    state->pending_first = first_call;
+    state->pending_count = all_tool_calls->count - first_call;
+    state->pending_submitted = 0;
+    state->pending_results = agent_context_calloc(state->iteration_ctx, state->pending_count,
+                                                  sizeof(agent_tool_result_t));
+    state->pending_done = agent_context_calloc(state->iteration_ctx, state->pending_count, sizeof(bool));
+    if (!state->pending_results || !state->pending_done) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    agent_error_t err = flatten_pending_args(state);
+    if (err != AGENT_OK) {
+        return err;
+    }
+
+    /* One latency slot per call made during the run */
+    if (all_tool_calls->count > state->tool_latency_capacity) {
+        size_t capacity = all_tool_calls->capacity;
+        uint64_t* latency = agent_context_realloc(state->run_ctx, state->tool_latency_ns,
+            state->tool_latency_capacity * sizeof(uint64_t), capacity * sizeof(uint64_t));
+        if (!latency) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+        memset(latency + state->tool_latency_capacity, 0,
+               (capacity - state->tool_latency_capacity) * sizeof(uint64_t));
+        state->tool_latency_ns = latency;
+        state->tool_latency_capacity = capacity;
+    }
+    current_trace(state)->tool_first = first_call;
+    current_trace(state)->tool_count = state->pending_count;
+    state->tools_started_ns = monotonic_ns();
+
+    set_step(state, AGENT_STEP_CALLING_TOOL, all_tool_calls->items[first_call].name.data);
+    state->run_status = AGENT_RUN_NEEDS_TOOL_RESULTS;
     return AGENT_OK;
 }
 
-agent_run_result_t agent_run(agent_state_t* state) {
-    return agent_run_streaming(state);
-}
+agent_error_t agent_run_submit_generation(agent_state_t* state, const agent_llm_result_t* result) {
+    if (!state || !result || state->run_status != AGENT_RUN_NEEDS_GENERATION) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
 
-agent_run_result_t agent_run_streaming(agent_state_t* state) {
-    agent_run_result_t result = {0};
+    if (result->error != AGENT_OK) {
+        run_fail(state, result->error,
+                 result->error == AGENT_ERROR_CANCELLED ? "Cancelled" : "Processing error");
+        return AGENT_OK;
+    }
 
-    if (!state) {
-        result.error = AGENT_ERROR_INVALID_ARGUMENT;
-        result.error_message = "Invalid state";
-        return result;
+    /* A host that did not stream hands over the whole response at once */
+    if (state->current_response.length == 0 && result->text.data && result->text.length > 0) {
+        agent_run_feed_token(state, result->text.data, result->text.length);
     }
 
-    if (state->is_processing) {
-        result.error = AGENT_ERROR_INVALID_ARGUMENT;
-        result.error_message = "Already processing";
-        return result;
+    const char* reason = cancel_reason(state);
+    if (reason) {
+        run_fail(state, AGENT_ERROR_CANCELLED, reason);
+        return AGENT_OK;
     }
 
-    state->is_processing = true;
-    state->should_stop = false;
-    state->iteration_count = 0;
-    agent_string_clear(&state->thinking_content);
+    agent_iteration_trace_t* trace = current_trace(state);
+    uint64_t parse_started = monotonic_ns();
+    trace->decode_ns = parse_started - state->generation_started_ns;
+    if (trace->decode_ns > 0) {
+        trace->tokens_per_second = (double)trace->decode_tokens * 1e9 / (double)trace->decode_ns;
+    }
 
-    /* Copy messages to working history */
-    state->working_history.count = 0;
-    for (size_t i = 0; i < state->messages.count; i++) {
-        message_array_add(state->ctx, &state->working_history, &state->messages.messages[i]);
+    AGENT_TRACE_BEGIN(process_response);
+    agent_error_t err = process_response(state);
+    AGENT_TRACE_END(process_response);
+    trace->parse_ns = monotonic_ns() - parse_started;
+    if (err != AGENT_OK) {
+        run_fail(state, err, "Processing error");
     }
+    return AGENT_OK;
+}
 
-    /* Track all tool calls */
-    agent_tool_call_array_t tool_calls = {0};
-    tool_calls.items = agent_context_calloc(state->ctx, DEFAULT_TOOL_CALLS_CAPACITY, sizeof(agent_tool_call_t));
-    tool_calls.capacity = DEFAULT_TOOL_CALLS_CAPACITY;
-
-    /* Main loop */
-    bool has_tool_call = true;
-    while (has_tool_call && state->iteration_count < state->config.max_iterations) {
-        state->iteration_count++;
-
-        agent_error_t err = process_iteration(state, &tool_calls, &has_tool_call);
-        if (err != AGENT_OK) {
-            result.error = err;
-            if (err == AGENT_ERROR_CANCELLED) {
-                result.error_message = "Cancelled";
-            } else {
-                result.error_message = "Processing error";
-            }
-            break;
+/* All results are in: record them in call order and move on */
+static void complete_tool_results(agent_state_t* state) {
+    current_trace(state)->tools_ns = monotonic_ns() - state->tools_started_ns;
+    state->tool_round_start = state->working_history.count;
+    for (size_t i = 0; i < state->pending_count; i++) {
+        agent_message_t tool_msg = {0};
+        tool_msg.id = new_message_id(state);
+        tool_msg.role = AGENT_ROLE_TOOL;
+        tool_msg.content = state->pending_results[i].content;
+        tool_msg.timestamp_ms = current_time_ms();
+        tool_msg.tool_results = agent_context_alloc(state->run_ctx, sizeof(agent_tool_result_t));
+        if (tool_msg.tool_results) {
+            tool_msg.tool_results[0] = state->pending_results[i];
+            tool_msg.tool_results_count = 1;
         }
 
-        if (state->should_stop) {
-            result.error = AGENT_ERROR_CANCELLED;
-            result.error_message = "Stopped";
-            break;
-        }
+        working_history_add(state, &tool_msg);
+    }
+    add_assistant_message(state);
+    state->pending_count = 0;
+
+    set_step(state, AGENT_STEP_WAITING_FOR_RESULT, NULL);
+
+    const char* reason = cancel_reason(state);
+    if (reason) {
+        run_fail(state, AGENT_ERROR_CANCELLED, reason);
+        return;
+    }
+    begin_iteration(state);
+}
+
+agent_error_t agent_run_submit_tool_result(agent_state_t* state, size_t index,
+                                           const agent_tool_execute_result_t* result) {
+    if (!state || !result || state->run_status != AGENT_RUN_NEEDS_TOOL_RESULTS ||
+        index >= state->pending_count || state->pending_done[index]) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    const agent_tool_call_t* call = &state->run_tool_calls.items[state->pending_first + index];
+    state->pending_results[index] = tool_result_from_exec(state, call, result, NULL);
+    state->pending_done[index] = true;
+    state->tool_latency_ns[state->pending_first + index] = monotonic_ns() - state->tools_started_ns;
+
+    if (++state->pending_submitted == state->pending_count) {
+        complete_tool_results(state);
     }
+    return AGENT_OK;
+}
+
+agent_run_result_t agent_run_end(agent_state_t* state) {
+    agent_run_result_t result = {0};
 
-    /* Check if max iterations reached */
-    if (has_tool_call && state->iteration_count >= state->config.max_iterations) {
-        result.error = AGENT_ERROR_MAX_ITERATIONS;
-        result.error_message = "Maximum iterations reached";
+    if (!state || state->run_status != AGENT_RUN_DONE) {
+        result.error = AGENT_ERROR_INVALID_ARGUMENT;
+        result.error_message = state && state->is_processing ? "Run not finished" : "No run in progress";
+        return result;
     }
 
+    result.error = state->run_error;
+    result.error_message = state->run_error_message;
+
     /* Build result */
     if (result.error == AGENT_OK || result.error == AGENT_ERROR_MAX_ITERATIONS) {
         /* Find last assistant message */
-        for (size_t i = state->working_history.count; i > 0; i--) {
-            agent_message_t* msg = &state->working_history.messages[i - 1];
-            if (msg->role == AGENT_ROLE_ASSISTANT) {
-                result.response = msg->content;
-                break;
-            }
+        size_t last = message_array_find_last(&state->working_history, AGENT_ROLE_ASSISTANT);
+        if (last < state->working_history.count) {
+            result.response = state->working_history.messages[last].content;
         }
 
-        result.tool_calls = tool_calls.items;
-        result.tool_calls_count = tool_calls.count;
+        result.tool_calls = state->run_tool_calls.items;
+        result.tool_calls_count = state->run_tool_calls.count;
 
         if (state->thinking_content.length > 0) {
-            result.thinking = agent_context_string_view(state->ctx, state->thinking_content.data);
+            result.thinking = agent_string_view(&state->thinking_content);
         }
     }
 
     result.iterations = state->iteration_count;
+    finish_trace(state);
+    result.trace = state->trace;
+    result.trace_count = (size_t)state->iteration_count;
+    result.tool_latency_ns = state->tool_latency_ns;
     state->is_processing = false;
+    state->run_status = AGENT_RUN_IDLE;
+    agent_context_reset(state->iteration_ctx);
     set_step(state, AGENT_STEP_NONE, NULL);
+    agent_flush_events(state);
 
-    /* Add final message to main history */
+    /* Add final message to main history (copied into the history arena) */
     if (result.response.length > 0) {
         agent_message_t final_msg = {0};
-        final_msg.id = agent_uuid_generate();
+        final_msg.id = new_message_id(state);
         final_msg.role = AGENT_ROLE_ASSISTANT;
-        final_msg.content = result.response;
+        final_msg.content = agent_context_string_view_n(state->ctx,
+            result.response.data, result.response.length);
         final_msg.timestamp_ms = current_time_ms();
-        final_msg.thinking_content = result.thinking;
-        final_msg.tool_calls = result.tool_calls;
-        final_msg.tool_calls_count = result.tool_calls_count;
-
-        message_array_add(state->ctx, &state->messages, &final_msg);
+        if (result.thinking.length > 0) {
+            final_msg.thinking_content = agent_context_string_view_n(state->ctx,
+                result.thinking.data, result.thinking.length);
+        }
+        final_msg.tool_calls = copy_tool_calls(state->ctx, result.tool_calls, result.tool_calls_count);
+        final_msg.tool_calls_count = final_msg.tool_calls ? result.tool_calls_count : 0;
+
+        /* The history arena may be at its hard limit */
+        if (!final_msg.content.data ||
+            message_array_add(state->ctx, &state->messages, &final_msg) != AGENT_OK) {
+            if (result.error == AGENT_OK) {
+                result.error = AGENT_ERROR_OUT_OF_MEMORY;
+                result.error_message = "Failed to store response in history";
+            }
+        }
     }
 
+    /* The final message took over the run's first slot */
+    share_working_history(state);
     return result;
 }
 
+static bool driver_token_callback(const char* token, size_t len, void* user_data) {
+    return agent_run_feed_token((agent_state_t*)user_data, token, len);
+}
+
+agent_run_result_t agent_run(agent_state_t* state) {
+    return agent_run_streaming(state);
+}
+
+agent_run_result_t agent_run_streaming(agent_state_t* state) {
+    agent_run_result_t result = {0};
+
+    if (!state) {
+        result.error = AGENT_ERROR_INVALID_ARGUMENT;
+        result.error_message = "Invalid state";
+        return result;
+    }
+
+    agent_error_t err = agent_run_begin(state);
+    if (err != AGENT_OK) {
+        result.error = err;
+        result.error_message = err == AGENT_ERROR_OUT_OF_MEMORY ? "Out of memory" : "Already processing";
+        return result;
+    }
+
+    /* Answer the run's requests with the configured callbacks */
+    agent_run_request_t request;
+    agent_run_status_t status;
+    while ((status = agent_run_poll(state, &request)) != AGENT_RUN_DONE) {
+        if (status == AGENT_RUN_NEEDS_GENERATION) {
+            agent_llm_result_t llm_result;
+            if (request.route) {
+                llm_result = state->config.route_generate(
+                    request.messages,
+                    request.message_count,
+                    request.system_prompt,
+                    driver_token_callback,
+                    state
+                );
+            } else if (state->config.generate_with_prefix) {
+                llm_result = state->config.generate_with_prefix(
+                    request.messages,
+                    request.message_count,
+                    request.system_prompt,
+                    &request.generation,
+                    driver_token_callback,
+                    state
+                );
+            } else {
+                llm_result = state->config.generate(
+                    request.messages,
+                    request.message_count,
+                    request.system_prompt,
+                    driver_token_callback,
+                    state
+                );
+            }
+            agent_run_submit_generation(state, &llm_result);
+        } else if (status == AGENT_RUN_NEEDS_TOOL_RESULTS) {
+            if (execute_tool_calls(state, request.tool_calls, request.tool_call_count,
+                                   state->pending_results,
+                                   state->tool_latency_ns + state->pending_first) != AGENT_OK) {
+                run_fail(state, AGENT_ERROR_OUT_OF_MEMORY, "Processing error");
+                continue;
+            }
+            state->pending_submitted = state->pending_count;
+            complete_tool_results(state);
+        } else {
+            break;
+        }
+    }
+
+    return agent_run_end(state);
+}
+
 void agent_stop(agent_state_t* state) {
     if (state) {
-        state->should_stop = true;
+        atomic_store(&state->cancel.cancelled, true);
     }
 }
 
@@ -577,19 +2175,25 @@ void agent_get_messages(const agent_state_t* state,
 char* agent_truncate_text(agent_context_t* ctx, const char* text, size_t max_len) {
     if (!ctx || !text) return NULL;
 
-    size_t len = strlen(text);
-    if (len <= max_len) {
-        return agent_context_strdup(ctx, text);
-    }
+    return agent_truncate_sv(ctx, agent_sv_from_cstr(text), max_len, AGENT_TRUNCATE_HEAD);
+}
+
+char* agent_truncate_sv(agent_context_t* ctx, agent_string_view_t text, size_t max_len,
+                        agent_truncation_t mode) {
+    if (!ctx || (!text.data && text.length > 0)) return NULL;
 
-    /* Find UTF-8 boundary */
-    size_t boundary = agent_utf8_complete_boundary(text, max_len - 3);  /* -3 for "..." */
+    if (text.length <= max_len) {
+        return agent_context_strndup(ctx, text.data ? text.data : "", text.length);
+    }
 
-    char* result = agent_context_alloc(ctx, boundary + 4);
+    truncation_plan_t plan = plan_truncation(text.data, text.length, max_len, mode);
+    char* result = agent_context_alloc(ctx, plan.head + plan.marker_len + plan.tail + 1);
     if (!result) return NULL;
 
-    memcpy(result, text, boundary);
-    memcpy(result + boundary, "...", 4);  /* includes null terminator */
+    memcpy(result, text.data, plan.head);
+    memcpy(result + plan.head, plan.marker, plan.marker_len);
+    memcpy(result + plan.head + plan.marker_len, text.data + text.length - plan.tail, plan.tail);
+    result[plan.head + plan.marker_len + plan.tail] = '\0';
 
     return result;
 }
@@ -600,7 +2204,7 @@ char* agent_format_tool_call(agent_context_t* ctx,
     if (!ctx || !tool_call) return NULL;
 
     agent_string_t str;
-    if (agent_string_init(&str, 256) != AGENT_OK) {
+    if (agent_string_init_arena(&str, ctx, 256) != AGENT_OK) {
         return NULL;
     }
 
@@ -636,7 +2240,5 @@ char* agent_format_tool_call(agent_context_t* ctx,
         }
     }
 
-    char* result = agent_context_strdup(ctx, str.data);
-    agent_string_free(&str);
-    return result;
+    return str.data;
 }
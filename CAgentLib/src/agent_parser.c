@@ -5,17 +5,12 @@
 
 #include "agent_parser.h"
 #include "agent_string.h"
+#include "agent_simd.h"
+#include "agent_trace.h"
 #include <string.h>
 #include <stdlib.h>
 
-/* Tag constants */
-static const char* TAG_TOOL_CALL_OPEN = "<tool_call>";
-static const char* TAG_TOOL_CALL_CLOSE = "</tool_call>";
-static const char* TAG_THINK_OPEN = "<think>";
-static const char* TAG_THINK_CLOSE = "</think>";
-static const char* TAG_THINKING_OPEN = "<thinking>";
-static const char* TAG_THINKING_CLOSE = "</thinking>";
-
+/* Tag lengths */
 #define TAG_TOOL_CALL_OPEN_LEN 11
 #define TAG_TOOL_CALL_CLOSE_LEN 12
 #define TAG_THINK_OPEN_LEN 7
@@ -23,86 +18,253 @@ static const char* TAG_THINKING_CLOSE = "</thinking>";
 #define TAG_THINKING_OPEN_LEN 10
 #define TAG_THINKING_CLOSE_LEN 11
 
-/* Helper: find substring in buffer */
-static const char* find_substr(const char* haystack, size_t haystack_len,
-                               const char* needle, size_t needle_len) {
-    if (needle_len == 0) return haystack;
-    if (needle_len > haystack_len) return NULL;
+#define TAG_BIT(tag) (1u << (tag))
+#define TAG_MASK_THINKING (TAG_BIT(AGENT_TAG_THINK_OPEN) | TAG_BIT(AGENT_TAG_THINK_CLOSE) | \
+                           TAG_BIT(AGENT_TAG_THINKING_OPEN) | TAG_BIT(AGENT_TAG_THINKING_CLOSE))
+#define TAG_MASK_ALL ((1u << AGENT_TAG_COUNT) - 1)
+
+static const agent_parser_dialect_t builtin_dialects[] = {
+    /* AGENT_DIALECT_HERMES */
+    {"<tool_call>", "</tool_call>", NULL, NULL,
+     "<think>", "</think>", "<thinking>", "</thinking>"},
+    /* AGENT_DIALECT_LLAMA3 */
+    {"<|python_tag|>", NULL, "<tool_call>", "</tool_call>",
+     "<think>", "</think>", "<thinking>", "</thinking>"},
+    /* AGENT_DIALECT_PHI4 */
+    {"<|tool_call|>", "<|/tool_call|>", "<tool_call>", "</tool_call>",
+     "<think>", "</think>", "<thinking>", "</thinking>"},
+    /* AGENT_DIALECT_MISTRAL */
+    {"[TOOL_CALLS]", NULL, "<tool_call>", "</tool_call>",
+     "<think>", "</think>", "<thinking>", "</thinking>"},
+    /* AGENT_DIALECT_GRANITE */
+    {"<|tool_call|>", NULL, "<tool_call>", "</tool_call>",
+     "<think>", "</think>", "<thinking>", "</thinking>"}
+};
+
+/* The Hermes dialect, precompiled */
+static const agent_tag_set_t default_tags = {
+    .text = {"<tool_call>", "</tool_call>", "<think>", "</think>", "<thinking>", "</thinking>"},
+    .length = {
+        TAG_TOOL_CALL_OPEN_LEN, TAG_TOOL_CALL_CLOSE_LEN,
+        TAG_THINK_OPEN_LEN, TAG_THINK_CLOSE_LEN,
+        TAG_THINKING_OPEN_LEN, TAG_THINKING_CLOSE_LEN
+    },
+    .lead = {['<'] = true},
+    .lead_byte = '<'
+};
+
+static bool is_tool_call_open(agent_tag_t tag) {
+    return tag == AGENT_TAG_TOOL_CALL_OPEN || tag == AGENT_TAG_TOOL_CALL_ALT_OPEN;
+}
 
-    const char* end = haystack + haystack_len - needle_len + 1;
-    for (const char* p = haystack; p < end; p++) {
-        if (memcmp(p, needle, needle_len) == 0) {
-            return p;
-        }
+const agent_parser_dialect_t* agent_parser_dialect_builtin(agent_dialect_id_t id) {
+    if ((size_t)id >= sizeof(builtin_dialects) / sizeof(builtin_dialects[0])) {
+        return NULL;
     }
-    return NULL;
+    return &builtin_dialects[id];
 }
 
-/* Helper: find matching brace */
-static const char* find_matching_brace(const char* start, size_t length) {
-    if (length == 0 || *start != '{') return NULL;
+agent_error_t agent_tag_set_compile(agent_tag_set_t* set, const agent_parser_dialect_t* dialect) {
+    if (!set) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    if (!dialect) {
+        dialect = &builtin_dialects[AGENT_DIALECT_HERMES];
+    }
 
-    int depth = 0;
-    bool in_string = false;
-    bool escape = false;
+    const char* spellings[AGENT_TAG_COUNT] = {
+        dialect->tool_call_open, dialect->tool_call_close,
+        dialect->think_open, dialect->think_close,
+        dialect->think_alt_open, dialect->think_alt_close,
+        dialect->tool_call_alt_open, dialect->tool_call_alt_close
+    };
 
-    for (size_t i = 0; i < length; i++) {
-        char c = start[i];
+    agent_tag_set_t compiled;
+    memset(&compiled, 0, sizeof(compiled));
 
-        if (escape) {
-            escape = false;
-            continue;
+    for (int tag = 0; tag < AGENT_TAG_COUNT; tag++) {
+        size_t len = spellings[tag] ? strlen(spellings[tag]) : 0;
+        if (len >= AGENT_TAG_MAX_LENGTH) {
+            return AGENT_ERROR_INVALID_ARGUMENT;
         }
-
-        if (c == '\\' && in_string) {
-            escape = true;
-            continue;
+        if (len > 0) {
+            memcpy(compiled.text[tag], spellings[tag], len);
+            compiled.lead[(unsigned char)spellings[tag][0]] = true;
         }
+        compiled.length[tag] = len;
+    }
 
-        if (c == '"') {
-            in_string = !in_string;
-            continue;
+    /* A close needs its open; thinking blocks also need their close */
+    if (compiled.length[AGENT_TAG_TOOL_CALL_OPEN] == 0) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    for (int tag = 0; tag < AGENT_TAG_COUNT; tag += 2) {
+        if (compiled.length[tag + 1] > 0 && compiled.length[tag] == 0) {
+            return AGENT_ERROR_INVALID_ARGUMENT;
+        }
+        if (!is_tool_call_open((agent_tag_t)tag) && compiled.length[tag] > 0 &&
+            compiled.length[tag + 1] == 0) {
+            return AGENT_ERROR_INVALID_ARGUMENT;
         }
+    }
 
-        if (!in_string) {
-            if (c == '{') {
-                depth++;
-            } else if (c == '}') {
-                depth--;
-                if (depth == 0) {
-                    return start + i;
-                }
+    /* Candidates restart at any lead byte, so none may occur inside a tag */
+    int leads = 0;
+    for (int tag = 0; tag < AGENT_TAG_COUNT; tag++) {
+        for (size_t i = 1; i < compiled.length[tag]; i++) {
+            if (compiled.lead[(unsigned char)compiled.text[tag][i]]) {
+                return AGENT_ERROR_INVALID_ARGUMENT;
             }
         }
     }
+    compiled.lead_byte = -1;
+    for (int c = 0; c < 256; c++) {
+        if (compiled.lead[c]) {
+            compiled.lead_byte = c;
+            leads++;
+        }
+    }
+    if (leads != 1) {
+        compiled.lead_byte = -1;
+    }
+
+    *set = compiled;
+    return AGENT_OK;
+}
+
+/* Match the tag set at p, which points at a lead byte. Returns the longest
+   tag starting here, or -1. */
+static int match_tag(const agent_tag_set_t* tags, const char* p, size_t avail) {
+    int best = -1;
+    for (int tag = 0; tag < AGENT_TAG_COUNT; tag++) {
+        size_t len = tags->length[tag];
+        if (len > 0 && len <= avail && tags->text[tag][0] == *p &&
+            memcmp(p, tags->text[tag], len) == 0 &&
+            (best < 0 || len > tags->length[best])) {
+            best = tag;
+        }
+    }
+    return best;
+}
 
+/* Helper: find the next byte that can start a tag */
+static const char* find_lead(const agent_tag_set_t* tags, const char* p, const char* end) {
+    if (tags->lead_byte >= 0) {
+        return memchr(p, tags->lead_byte, (size_t)(end - p));
+    }
+    for (; p < end; p++) {
+        if (tags->lead[(unsigned char)*p]) return p;
+    }
     return NULL;
 }
 
-/* Parse tool call JSON */
-agent_parsed_tool_call_t* agent_parser_parse_tool_call_json(agent_context_t* ctx,
-                                                            const char* json, size_t length) {
-    if (!ctx || !json || length == 0) {
-        return NULL;
+/* Helper: find the next tag in mask. memchr skips to each lead byte
+   candidate, and no tag contains a lead byte past its start, so resuming
+   one byte past a rejected candidate never misses an occurrence. */
+static const char* next_tag(const agent_tag_set_t* tags, const char* p, const char* end,
+                            unsigned mask, agent_tag_t* out_tag) {
+    while (p < end) {
+        const char* lead = find_lead(tags, p, end);
+        if (!lead) return NULL;
+
+        int tag = match_tag(tags, lead, (size_t)(end - lead));
+        if (tag >= 0 && (mask & TAG_BIT(tag))) {
+            if (out_tag) *out_tag = (agent_tag_t)tag;
+            return lead;
+        }
+        p = lead + 1;
     }
+    return NULL;
+}
 
-    agent_json_parse_result_t result = agent_json_parse(ctx, json, length);
-    if (result.error != AGENT_OK || !result.value) {
-        return NULL;
+static const char* find_tag(const agent_tag_set_t* tags, const char* haystack,
+                            size_t haystack_len, agent_tag_t tag) {
+    return next_tag(tags, haystack, haystack + haystack_len, TAG_BIT(tag), NULL);
+}
+
+/* Brace matching state; escaped is the offset a backslash protects */
+typedef struct {
+    int depth;
+    bool in_string;
+    size_t escaped;
+} brace_state_t;
+
+/* Feed the structural byte at offset i; true when it closes the value */
+static inline bool brace_step(brace_state_t* st, char c, size_t i) {
+    if (st->in_string) {
+        if (i == st->escaped) {
+            return false;
+        }
+        if (c == '\\') {
+            st->escaped = i + 1;
+        } else if (c == '"') {
+            st->in_string = false;
+        }
+        return false;
     }
 
-    if (result.value->type != AGENT_JSON_OBJECT) {
+    if (c == '"') {
+        st->in_string = true;
+    } else if (c == '{' || c == '[') {
+        st->depth++;
+    } else if (c == '}' || c == ']') {
+        return --st->depth == 0;
+    }
+    return false;
+}
+
+static inline bool is_structural(char c) {
+    return c == '{' || c == '}' || c == '[' || c == ']' || c == '"' || c == '\\';
+}
+
+/* Helper: find the brace or bracket closing the JSON value at start. Only
+   structural bytes matter, so whole blocks without one are skipped. */
+static const char* find_matching_brace(const char* start, size_t length) {
+    if (length == 0 || (*start != '{' && *start != '[')) return NULL;
+
+    brace_state_t st = {0, false, SIZE_MAX};
+    size_t i = 0;
+
+#if defined(AGENT_SIMD_NEON) || defined(AGENT_SIMD_SSE2)
+    for (; i + AGENT_SIMD_BLOCK <= length; i += AGENT_SIMD_BLOCK) {
+        uint64_t bits = agent_simd_structural_bits(start + i);
+        while (bits) {
+            size_t at = i + agent_simd_first_lane(bits);
+            if (brace_step(&st, start[at], at)) {
+                return start + at;
+            }
+            bits = agent_simd_clear_lane(bits);
+        }
+    }
+#endif
+
+    for (; i < length; i++) {
+        if (is_structural(start[i]) && brace_step(&st, start[i], i)) {
+            return start + i;
+        }
+    }
+    return NULL;
+}
+
+/* Build a tool call from a parsed {"name": ..., "arguments": ...} object */
+static agent_parsed_tool_call_t* tool_call_from_value(agent_context_t* ctx,
+                                                      agent_json_value_t* value,
+                                                      const char* json, size_t length) {
+    if (!value || value->type != AGENT_JSON_OBJECT) {
         return NULL;
     }
 
     /* Get "name" field */
-    agent_json_value_t* name_val = agent_json_object_get(result.value, "name");
+    agent_json_value_t* name_val = agent_json_object_get(value, "name");
     if (!name_val || name_val->type != AGENT_JSON_STRING) {
         return NULL;
     }
 
-    /* Get "arguments" field */
-    agent_json_value_t* args_val = agent_json_object_get(result.value, "arguments");
+    /* Get "arguments" field ("parameters" in the Llama 3 format) */
+    agent_json_value_t* args_val = agent_json_object_get(value, "arguments");
+    if (!args_val) {
+        args_val = agent_json_object_get(value, "parameters");
+    }
     if (!args_val) {
         /* Create empty object if no arguments */
         args_val = agent_json_object(ctx, 0);
@@ -115,92 +277,200 @@ agent_parsed_tool_call_t* agent_parser_parse_tool_call_json(agent_context_t* ctx
 
     tc->name = name_val->data.string_value;
     tc->arguments = args_val;
-    tc->raw_json = agent_context_string_view_n(ctx, json, length);
+    tc->raw_json = json ? agent_context_string_view_n(ctx, json, length) : (agent_string_view_t){NULL, 0};
 
     return tc;
 }
 
-/* Find bare JSON tool call */
-agent_parsed_tool_call_t* agent_parser_find_bare_json(agent_context_t* ctx,
-                                                      const char* response, size_t length,
-                                                      agent_string_view_t* out_before,
-                                                      agent_string_view_t* out_after) {
-    if (!ctx || !response || length == 0) {
+/* Parse tool call JSON */
+agent_parsed_tool_call_t* agent_parser_parse_tool_call_json(agent_context_t* ctx,
+                                                            const char* json, size_t length) {
+    if (!ctx || !json || length == 0) {
         return NULL;
     }
 
-    /* Search for "name" pattern followed by colon */
-    const char* name_pattern = "\"name\"";
-    const char* found = find_substr(response, length, name_pattern, 6);
-    if (!found) {
+    /* Roll back partial parse trees when the JSON is not a tool call */
+    size_t savepoint = agent_context_savepoint(ctx);
+
+    agent_json_parse_result_t result = agent_json_parse(ctx, json, length);
+    if (result.error != AGENT_OK || !result.value) {
+        agent_context_restore(ctx, savepoint);
         return NULL;
     }
 
-    /* Scan backward to find opening brace */
-    const char* json_start = NULL;
-    for (const char* p = found - 1; p >= response; p--) {
-        if (*p == '{') {
-            json_start = p;
-            break;
-        } else if (*p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
-            /* Found non-whitespace before "name" - not a bare JSON */
-            break;
-        }
+    agent_parsed_tool_call_t* tc = tool_call_from_value(ctx, result.value, json, length);
+    if (!tc) {
+        agent_context_restore(ctx, savepoint);
+        return NULL;
     }
 
-    if (!json_start) {
+    return tc;
+}
+
+/* Parse tool call JSON in place */
+agent_parsed_tool_call_t* agent_parser_parse_tool_call_json_insitu(agent_context_t* ctx,
+                                                                   char* json, size_t length) {
+    if (!ctx || !json || length == 0) {
         return NULL;
     }
 
-    /* Find matching closing brace */
-    size_t remaining = length - (size_t)(json_start - response);
-    const char* json_end = find_matching_brace(json_start, remaining);
-    if (!json_end) {
+    size_t savepoint = agent_context_savepoint(ctx);
+
+    agent_json_parse_result_t result = agent_json_parse_insitu(ctx, json, length);
+    if (result.error != AGENT_OK || !result.value) {
+        agent_context_restore(ctx, savepoint);
+        return NULL;
+    }
+
+    /* The source text has been decoded over, so there is no raw JSON to keep */
+    agent_parsed_tool_call_t* tc = tool_call_from_value(ctx, result.value, NULL, 0);
+    if (!tc) {
+        agent_context_restore(ctx, savepoint);
         return NULL;
     }
 
-    size_t json_len = (size_t)(json_end - json_start) + 1;
+    return tc;
+}
+
+/* Parse a tool call span of a const response: one bulk copy into the arena,
+   then decode in place so no string inside it is copied again */
+static agent_parsed_tool_call_t* parse_tool_call_span(agent_context_t* ctx,
+                                                      const char* json, size_t length) {
+    size_t savepoint = agent_context_savepoint(ctx);
+
+    char* copy = agent_context_alloc(ctx, length + 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, json, length);
+    copy[length] = '\0';
+
+    agent_parsed_tool_call_t* tc = agent_parser_parse_tool_call_json_insitu(ctx, copy, length);
+    if (!tc) {
+        agent_context_restore(ctx, savepoint);
+    }
+    return tc;
+}
+
+/* Helper: locate a bare {"name": ..., "arguments": ...} object. Each '{'
+   is checked for a "name" key in first position, then brace-matched. */
+
+/* First '{' at or after p that opens with "name" within the whitespace window */
+static const char* bare_json_candidate(const char* p, const char* end) {
+    while (p < end) {
+        const char* brace = memchr(p, '{', (size_t)(end - p));
+        if (!brace) return NULL;
+
+        const char* key = brace + 1;
+        while (key < end && (size_t)(key - brace) <= AGENT_BARE_JSON_WINDOW && agent_simd_is_json_space(*key)) {
+            key++;
+        }
+        if ((size_t)(end - key) >= 6 && memcmp(key, "\"name\"", 6) == 0) {
+            return brace;
+        }
+        p = brace + 1;
+    }
+    return NULL;
+}
+
+bool agent_parser_may_have_bare_json(const char* response, size_t length) {
+    return response && bare_json_candidate(response, response + length) != NULL;
+}
+
+static bool find_bare_json_span(const char* text, size_t length,
+                                const char** out_start, const char** out_end) {
+    const char* end = text + length;
+    const char* p = text;
+
+    while (p < end) {
+        const char* brace = bare_json_candidate(p, end);
+        if (!brace) return false;
+
+        const char* close = find_matching_brace(brace, (size_t)(end - brace));
+        if (!close) return false;
+
+        size_t json_len = (size_t)(close - brace) + 1;
+        if (agent_sv_find(agent_sv_from_parts(brace, json_len),
+                          agent_sv_from_parts("\"arguments\"", 11)) >= 0) {
+            *out_start = brace;
+            *out_end = close + 1;
+            return true;
+        }
+        p = brace + 1;
+    }
+    return false;
+}
+
+/* Copy a view that borrows from response into the arena. Views that
+   already live elsewhere, such as stitched content, are returned as-is. */
+static agent_string_view_t own_view(agent_context_t* ctx, agent_string_view_t view,
+                                    const char* response, size_t length) {
+    if (view.data && view.data >= response && view.data <= response + length) {
+        return agent_context_string_view_n(ctx, view.data, view.length);
+    }
+    return view;
+}
 
-    /* Check for "arguments" field */
-    const char* args_pattern = "\"arguments\"";
-    if (!find_substr(json_start, json_len, args_pattern, 11)) {
+/* Find bare JSON tool call */
+agent_parsed_tool_call_t* agent_parser_find_bare_json_borrow(agent_context_t* ctx,
+                                                             const char* response, size_t length,
+                                                             agent_string_view_t* out_before,
+                                                             agent_string_view_t* out_after) {
+    if (!ctx || !response || length == 0) {
+        return NULL;
+    }
+
+    const char* json_start;
+    const char* json_end;
+    if (!find_bare_json_span(response, length, &json_start, &json_end)) {
         return NULL;
     }
 
     /* Parse the JSON */
-    agent_parsed_tool_call_t* tc = agent_parser_parse_tool_call_json(ctx, json_start, json_len);
+    agent_parsed_tool_call_t* tc = agent_parser_parse_tool_call_json(ctx, json_start,
+                                                                     (size_t)(json_end - json_start));
     if (!tc) {
         return NULL;
     }
 
     /* Set before/after if requested */
     if (out_before) {
-        size_t before_len = (size_t)(json_start - response);
-        *out_before = agent_context_string_view_n(ctx, response, before_len);
+        *out_before = agent_sv_from_parts(response, (size_t)(json_start - response));
     }
 
     if (out_after) {
-        const char* after_start = json_end + 1;
-        size_t after_len = length - (size_t)(after_start - response);
-        *out_after = agent_context_string_view_n(ctx, after_start, after_len);
+        *out_after = agent_sv_from_parts(json_end, length - (size_t)(json_end - response));
     }
 
     return tc;
 }
 
+agent_parsed_tool_call_t* agent_parser_find_bare_json(agent_context_t* ctx,
+                                                      const char* response, size_t length,
+                                                      agent_string_view_t* out_before,
+                                                      agent_string_view_t* out_after) {
+    agent_parsed_tool_call_t* tc = agent_parser_find_bare_json_borrow(ctx, response, length,
+                                                                      out_before, out_after);
+    if (tc) {
+        if (out_before) *out_before = own_view(ctx, *out_before, response, length);
+        if (out_after) *out_after = own_view(ctx, *out_after, response, length);
+    }
+    return tc;
+}
+
 /* Check for tool call tag */
 bool agent_parser_has_tool_call(const char* response, size_t length) {
     if (!response || length == 0) {
         return false;
     }
 
-    const char* open = find_substr(response, length, TAG_TOOL_CALL_OPEN, TAG_TOOL_CALL_OPEN_LEN);
+    const char* open = find_tag(&default_tags, response, length, AGENT_TAG_TOOL_CALL_OPEN);
     if (!open) {
         return false;
     }
 
     size_t remaining = length - (size_t)(open - response);
-    const char* close = find_substr(open, remaining, TAG_TOOL_CALL_CLOSE, TAG_TOOL_CALL_CLOSE_LEN);
+    const char* close = find_tag(&default_tags, open, remaining, AGENT_TAG_TOOL_CALL_CLOSE);
     return close != NULL;
 }
 
@@ -209,113 +479,264 @@ bool agent_parser_has_incomplete_tool_call(const char* response, size_t length)
         return false;
     }
 
-    const char* open = find_substr(response, length, TAG_TOOL_CALL_OPEN, TAG_TOOL_CALL_OPEN_LEN);
+    const char* open = find_tag(&default_tags, response, length, AGENT_TAG_TOOL_CALL_OPEN);
     if (!open) {
         return false;
     }
 
     size_t remaining = length - (size_t)(open - response);
-    const char* close = find_substr(open, remaining, TAG_TOOL_CALL_CLOSE, TAG_TOOL_CALL_CLOSE_LEN);
+    const char* close = find_tag(&default_tags, open, remaining, AGENT_TAG_TOOL_CALL_CLOSE);
     return close == NULL;
 }
 
-agent_string_view_t agent_parser_text_before_tool_call(agent_context_t* ctx,
-                                                       const char* response, size_t length) {
-    agent_string_view_t result = {NULL, 0};
+void agent_tool_tag_scanner_reset(agent_tool_tag_scanner_t* scanner) {
+    if (!scanner) return;
+    scanner->tags = NULL;
+    scanner->open_matched = 0;
+    scanner->alt_open_matched = 0;
+    scanner->close_matched = 0;
+    scanner->close_tag = AGENT_TAG_TOOL_CALL_CLOSE;
+    scanner->in_tool_call = false;
+    scanner->bytes_seen = 0;
+    scanner->bare_json_at = AGENT_BARE_JSON_NONE;
+    scanner->bare_json_start = 0;
+    scanner->bare_json_matched = 0;
+}
 
-    if (!ctx || !response) {
-        return result;
-    }
+/* Advance a partial match of tag by one byte. No tag repeats a lead byte,
+   so a mismatch can only restart at the tag's first byte. */
+static size_t tag_match_step(const char* tag, size_t matched, char c) {
+    if (tag[matched] == c) return matched + 1;
+    return c == tag[0] ? 1 : 0;
+}
+
+/* Advance the bare JSON candidate match by the byte c at stream offset pos;
+   accepts the same candidates as bare_json_candidate() */
+static void bare_json_step(agent_tool_tag_scanner_t* scanner, char c, size_t pos) {
+    static const char key[] = "\"name\"";
+    size_t matched = scanner->bare_json_matched;
 
-    const char* tag = find_substr(response, length, TAG_TOOL_CALL_OPEN, TAG_TOOL_CALL_OPEN_LEN);
-    if (tag) {
-        size_t before_len = (size_t)(tag - response);
-        result = agent_context_string_view_n(ctx, response, before_len);
-        result = agent_sv_trim(result);
+    if (matched == 1 && agent_simd_is_json_space(c) && pos - scanner->bare_json_start <= AGENT_BARE_JSON_WINDOW) {
+        return;
+    }
+    if (matched >= 1 && key[matched - 1] == c) {
+        if (matched == sizeof(key) - 1) {
+            scanner->bare_json_at = scanner->bare_json_start;
+        }
+        scanner->bare_json_matched = matched + 1;
+        return;
+    }
+    if (c == '{') {
+        scanner->bare_json_start = pos;
+        scanner->bare_json_matched = 1;
     } else {
-        result = agent_context_string_view_n(ctx, response, length);
-        result = agent_sv_trim(result);
+        scanner->bare_json_matched = 0;
     }
+}
 
-    return result;
+bool agent_tool_tag_scanner_feed(agent_tool_tag_scanner_t* scanner,
+                                 const char* data, size_t length) {
+    if (!scanner || !data) {
+        return scanner ? scanner->in_tool_call : false;
+    }
+
+    const agent_tag_set_t* tags = scanner->tags ? scanner->tags : &default_tags;
+    const char* open = tags->text[AGENT_TAG_TOOL_CALL_OPEN];
+    const char* alt_open = tags->text[AGENT_TAG_TOOL_CALL_ALT_OPEN];
+    bool has_alt = tags->length[AGENT_TAG_TOOL_CALL_ALT_OPEN] > 0;
+
+    for (size_t i = 0; i < length; i++) {
+        char c = data[i];
+        if (!scanner->in_tool_call) {
+            agent_tag_t opened = AGENT_TAG_COUNT;
+            scanner->open_matched = tag_match_step(open, scanner->open_matched, c);
+            if (scanner->open_matched == tags->length[AGENT_TAG_TOOL_CALL_OPEN]) {
+                opened = AGENT_TAG_TOOL_CALL_OPEN;
+            } else if (has_alt) {
+                scanner->alt_open_matched = tag_match_step(alt_open, scanner->alt_open_matched, c);
+                if (scanner->alt_open_matched == tags->length[AGENT_TAG_TOOL_CALL_ALT_OPEN]) {
+                    opened = AGENT_TAG_TOOL_CALL_ALT_OPEN;
+                }
+            }
+
+            if (opened != AGENT_TAG_COUNT) {
+                scanner->open_matched = 0;
+                scanner->alt_open_matched = 0;
+                scanner->close_tag = (agent_tag_t)(opened + 1);
+                scanner->in_tool_call = true;
+            }
+        } else if (tags->length[scanner->close_tag] > 0) {
+            /* A call without a closing tag stays open until reset */
+            scanner->close_matched = tag_match_step(tags->text[scanner->close_tag],
+                                                    scanner->close_matched, c);
+            if (scanner->close_matched == tags->length[scanner->close_tag]) {
+                scanner->close_matched = 0;
+                scanner->in_tool_call = false;
+            }
+        }
+
+        if (scanner->bare_json_at == AGENT_BARE_JSON_NONE) {
+            bare_json_step(scanner, c, scanner->bytes_seen + i);
+        }
+    }
+
+    scanner->bytes_seen += length;
+    return scanner->in_tool_call;
 }
 
-agent_string_view_t agent_parser_text_after_tool_call(agent_context_t* ctx,
-                                                      const char* response, size_t length) {
-    agent_string_view_t result = {NULL, 0};
+bool agent_tool_tag_scanner_has_bare_json(const agent_tool_tag_scanner_t* scanner) {
+    return scanner && scanner->bare_json_at != AGENT_BARE_JSON_NONE;
+}
 
-    if (!ctx || !response) {
-        return result;
+size_t agent_parser_find_tags(const char* response, size_t length,
+                              agent_tag_match_t* out_matches, size_t max_matches) {
+    if (!response) {
+        return 0;
     }
 
-    const char* close = find_substr(response, length, TAG_TOOL_CALL_CLOSE, TAG_TOOL_CALL_CLOSE_LEN);
-    if (close) {
-        const char* after_start = close + TAG_TOOL_CALL_CLOSE_LEN;
-        size_t after_len = length - (size_t)(after_start - response);
-        result = agent_context_string_view_n(ctx, after_start, after_len);
-        result = agent_sv_trim(result);
+    const char* end = response + length;
+    size_t count = 0;
+    agent_tag_t tag;
+
+    const char* p = next_tag(&default_tags, response, end, TAG_MASK_ALL, &tag);
+    while (p) {
+        if (out_matches && count < max_matches) {
+            out_matches[count].tag = tag;
+            out_matches[count].offset = (size_t)(p - response);
+            out_matches[count].length = default_tags.length[tag];
+        }
+        count++;
+        p = next_tag(&default_tags, p + default_tags.length[tag], end, TAG_MASK_ALL, &tag);
     }
 
-    return result;
+    return count;
+}
+
+agent_string_view_t agent_parser_text_before_tool_call_borrow(const char* response, size_t length) {
+    if (!response) {
+        return (agent_string_view_t){NULL, 0};
+    }
+
+    const char* tag = find_tag(&default_tags, response, length, AGENT_TAG_TOOL_CALL_OPEN);
+    size_t before_len = tag ? (size_t)(tag - response) : length;
+    return agent_sv_trim(agent_sv_from_parts(response, before_len));
+}
+
+agent_string_view_t agent_parser_text_after_tool_call_borrow(const char* response, size_t length) {
+    if (!response) {
+        return (agent_string_view_t){NULL, 0};
+    }
+
+    const char* close = find_tag(&default_tags, response, length, AGENT_TAG_TOOL_CALL_CLOSE);
+    if (!close) {
+        return (agent_string_view_t){NULL, 0};
+    }
+
+    const char* after_start = close + TAG_TOOL_CALL_CLOSE_LEN;
+    size_t after_len = length - (size_t)(after_start - response);
+    return agent_sv_trim(agent_sv_from_parts(after_start, after_len));
+}
+
+agent_string_view_t agent_parser_text_before_tool_call(agent_context_t* ctx,
+                                                       const char* response, size_t length) {
+    if (!ctx || !response) {
+        return (agent_string_view_t){NULL, 0};
+    }
+    return own_view(ctx, agent_parser_text_before_tool_call_borrow(response, length),
+                    response, length);
+}
+
+agent_string_view_t agent_parser_text_after_tool_call(agent_context_t* ctx,
+                                                      const char* response, size_t length) {
+    if (!ctx || !response) {
+        return (agent_string_view_t){NULL, 0};
+    }
+    return own_view(ctx, agent_parser_text_after_tool_call_borrow(response, length),
+                    response, length);
 }
 
 /* Extract thinking content */
-void agent_parser_extract_thinking(agent_context_t* ctx,
-                                   const char* response, size_t length,
-                                   agent_string_view_t* out_thinking,
-                                   agent_string_view_t* out_content) {
+void agent_parser_extract_thinking_borrow(agent_context_t* ctx,
+                                          const char* response, size_t length,
+                                          agent_string_view_t* out_thinking,
+                                          agent_string_view_t* out_content) {
     if (!ctx || !response) {
         if (out_thinking) *out_thinking = (agent_string_view_t){NULL, 0};
         if (out_content) *out_content = (agent_string_view_t){NULL, 0};
         return;
     }
 
-    /* Try <think> first, then <thinking> */
+    /* Locate every thinking tag in one pass. <think> takes precedence over
+       <thinking>; each pairs with the first matching close after it. */
+    const char* end = response + length;
+    const char* think_open = NULL;
+    const char* think_close = NULL;
+    const char* thinking_open = NULL;
+    const char* thinking_close = NULL;
+    const char* first_think_close = NULL;
+    const char* first_thinking_close = NULL;
+    agent_tag_t tag;
+
+    for (const char* p = next_tag(&default_tags, response, end, TAG_MASK_THINKING, &tag);
+         p && !(think_open && think_close);
+         p = next_tag(&default_tags, p + 1, end, TAG_MASK_THINKING, &tag)) {
+        switch (tag) {
+            case AGENT_TAG_THINK_OPEN:
+                if (!think_open) think_open = p;
+                break;
+            case AGENT_TAG_THINK_CLOSE:
+                if (!first_think_close) first_think_close = p;
+                if (think_open && !think_close) think_close = p;
+                break;
+            case AGENT_TAG_THINKING_OPEN:
+                if (!thinking_open) thinking_open = p;
+                break;
+            case AGENT_TAG_THINKING_CLOSE:
+                if (!first_thinking_close) first_thinking_close = p;
+                if (thinking_open && !thinking_close) thinking_close = p;
+                break;
+            default:
+                break;
+        }
+    }
+
     const char* open_tag = NULL;
     const char* close_tag = NULL;
     size_t open_len = 0;
     size_t close_len = 0;
 
-    open_tag = find_substr(response, length, TAG_THINK_OPEN, TAG_THINK_OPEN_LEN);
-    if (open_tag) {
+    if (think_open) {
+        open_tag = think_open;
         open_len = TAG_THINK_OPEN_LEN;
-        size_t remaining = length - (size_t)(open_tag - response);
-        close_tag = find_substr(open_tag, remaining, TAG_THINK_CLOSE, TAG_THINK_CLOSE_LEN);
+        close_tag = think_close;
         close_len = TAG_THINK_CLOSE_LEN;
-    }
-
-    if (!open_tag) {
-        open_tag = find_substr(response, length, TAG_THINKING_OPEN, TAG_THINKING_OPEN_LEN);
-        if (open_tag) {
-            open_len = TAG_THINKING_OPEN_LEN;
-            size_t remaining = length - (size_t)(open_tag - response);
-            close_tag = find_substr(open_tag, remaining, TAG_THINKING_CLOSE, TAG_THINKING_CLOSE_LEN);
-            close_len = TAG_THINKING_CLOSE_LEN;
-        }
+    } else if (thinking_open) {
+        open_tag = thinking_open;
+        open_len = TAG_THINKING_OPEN_LEN;
+        close_tag = thinking_close;
+        close_len = TAG_THINKING_CLOSE_LEN;
     }
 
     /* Handle case where only closing tag is present (thinking was in prompt) */
     if (!open_tag) {
-        close_tag = find_substr(response, length, TAG_THINK_CLOSE, TAG_THINK_CLOSE_LEN);
-        if (!close_tag) {
-            close_tag = find_substr(response, length, TAG_THINKING_CLOSE, TAG_THINKING_CLOSE_LEN);
-            close_len = TAG_THINKING_CLOSE_LEN;
-        } else {
+        if (first_think_close) {
+            close_tag = first_think_close;
             close_len = TAG_THINK_CLOSE_LEN;
+        } else {
+            close_tag = first_thinking_close;
+            close_len = TAG_THINKING_CLOSE_LEN;
         }
 
         if (close_tag) {
             /* Everything before close tag is thinking */
             if (out_thinking) {
                 size_t think_len = (size_t)(close_tag - response);
-                *out_thinking = agent_context_string_view_n(ctx, response, think_len);
-                *out_thinking = agent_sv_trim(*out_thinking);
+                *out_thinking = agent_sv_trim(agent_sv_from_parts(response, think_len));
             }
             if (out_content) {
                 const char* after = close_tag + close_len;
                 size_t after_len = length - (size_t)(after - response);
-                *out_content = agent_context_string_view_n(ctx, after, after_len);
-                *out_content = agent_sv_trim(*out_content);
+                *out_content = agent_sv_trim(agent_sv_from_parts(after, after_len));
             }
             return;
         }
@@ -326,15 +747,25 @@ void agent_parser_extract_thinking(agent_context_t* ctx,
         if (out_thinking) {
             const char* think_start = open_tag + open_len;
             size_t think_len = (size_t)(close_tag - think_start);
-            *out_thinking = agent_context_string_view_n(ctx, think_start, think_len);
-            *out_thinking = agent_sv_trim(*out_thinking);
+            *out_thinking = agent_sv_trim(agent_sv_from_parts(think_start, think_len));
         }
 
-        /* Build content without thinking */
+        /* Build content without thinking; stitch only when both sides have text */
         if (out_content) {
             size_t before_len = (size_t)(open_tag - response);
             const char* after = close_tag + close_len;
             size_t after_len = length - (size_t)(after - response);
+            agent_string_view_t before_sv = agent_sv_trim(agent_sv_from_parts(response, before_len));
+            agent_string_view_t after_sv = agent_sv_trim(agent_sv_from_parts(after, after_len));
+
+            if (before_sv.length == 0) {
+                *out_content = after_sv;
+                return;
+            }
+            if (after_sv.length == 0) {
+                *out_content = before_sv;
+                return;
+            }
 
             size_t total_len = before_len + after_len;
             char* content = agent_context_alloc(ctx, total_len + 1);
@@ -356,17 +787,131 @@ void agent_parser_extract_thinking(agent_context_t* ctx,
             *out_thinking = (agent_string_view_t){NULL, 0};
         }
         if (out_content) {
-            *out_content = agent_context_string_view_n(ctx, response, length);
+            *out_content = agent_sv_from_parts(response, length);
         }
     }
 }
 
+void agent_parser_extract_thinking(agent_context_t* ctx,
+                                   const char* response, size_t length,
+                                   agent_string_view_t* out_thinking,
+                                   agent_string_view_t* out_content) {
+    agent_parser_extract_thinking_borrow(ctx, response, length, out_thinking, out_content);
+    if (!ctx || !response) {
+        return;
+    }
+    if (out_thinking) *out_thinking = own_view(ctx, *out_thinking, response, length);
+    if (out_content) *out_content = own_view(ctx, *out_content, response, length);
+}
+
+/* Ensure room for one more parsed content item */
+static bool content_array_reserve(agent_context_t* ctx, agent_parse_result_t* result) {
+    if (result->count < result->capacity) {
+        return true;
+    }
+    size_t new_cap = result->capacity * 2;
+    agent_parsed_content_t* new_arr = agent_context_realloc(ctx, result->contents,
+        result->capacity * sizeof(agent_parsed_content_t), new_cap * sizeof(agent_parsed_content_t));
+    if (!new_arr) {
+        return false;
+    }
+    result->contents = new_arr;
+    result->capacity = new_cap;
+    return true;
+}
+
+/* Append a trimmed text or thinking view; empty runs are dropped */
+static bool content_push_view(agent_context_t* ctx, agent_parse_result_t* result,
+                              agent_content_type_t type, const char* start, const char* end) {
+    agent_string_view_t view = agent_sv_trim(agent_sv_from_parts(start, (size_t)(end - start)));
+    if (view.length == 0) {
+        return true;
+    }
+    if (!content_array_reserve(ctx, result)) {
+        return false;
+    }
+
+    agent_parsed_content_t* item = &result->contents[result->count++];
+    item->type = type;
+    if (type == AGENT_CONTENT_THINKING) {
+        item->data.thinking = view;
+    } else {
+        item->data.text = view;
+    }
+    return true;
+}
+
+static bool content_push_tool_call(agent_context_t* ctx, agent_parse_result_t* result,
+                                   const agent_parsed_tool_call_t* tc) {
+    if (!content_array_reserve(ctx, result)) {
+        return false;
+    }
+
+    agent_parsed_content_t* item = &result->contents[result->count++];
+    item->type = AGENT_CONTENT_TOOL_CALL;
+    item->data.tool_call.name = tc->name;
+    item->data.tool_call.arguments = tc->arguments;
+    return true;
+}
+
+/* Parse a tool call body with one bulk copy into the arena, decoded in
+   place. The body is one call object or, in some dialects, an array of
+   them. Bodies that are not tool calls are dropped. */
+static bool content_push_tool_calls(agent_context_t* ctx, agent_parse_result_t* result,
+                                    const char* json, size_t length) {
+    size_t savepoint = agent_context_savepoint(ctx);
+
+    char* copy = agent_context_alloc(ctx, length + 1);
+    if (!copy) {
+        return false;
+    }
+    memcpy(copy, json, length);
+    copy[length] = '\0';
+
+    agent_json_parse_result_t parsed = agent_json_parse_insitu(ctx, copy, length);
+    if (parsed.error != AGENT_OK || !parsed.value) {
+        agent_context_restore(ctx, savepoint);
+        return true;
+    }
+
+    if (parsed.value->type == AGENT_JSON_ARRAY) {
+        for (size_t i = 0; i < parsed.value->data.array_value.count; i++) {
+            agent_parsed_tool_call_t* tc = tool_call_from_value(
+                ctx, parsed.value->data.array_value.items[i], NULL, 0);
+            if (tc && !content_push_tool_call(ctx, result, tc)) return false;
+        }
+        return true;
+    }
+
+    agent_parsed_tool_call_t* tc = tool_call_from_value(ctx, parsed.value, NULL, 0);
+    if (!tc) {
+        agent_context_restore(ctx, savepoint);
+        return true;
+    }
+    return content_push_tool_call(ctx, result, tc);
+}
+
+/* Helper: end of the JSON value at the start of a tool call body, for
+   dialects whose calls have no closing tag */
+static const char* json_value_end(const char* body, const char* end) {
+    body += agent_simd_skip_space(body, (size_t)(end - body));
+    const char* close = find_matching_brace(body, (size_t)(end - body));
+    return close ? close + 1 : NULL;
+}
+
 /* Parse complete response */
 agent_parse_result_t agent_parser_parse(agent_context_t* ctx,
                                         const char* response, size_t length) {
+    return agent_parser_parse_tags(ctx, &default_tags, response, length);
+}
+
+/* Full parse; the bare JSON fallback only looks at offsets from bare_json_from */
+static agent_parse_result_t parse_response_untraced(agent_context_t* ctx, const agent_tag_set_t* tags,
+                                                    const char* response, size_t length,
+                                                    size_t bare_json_from) {
     agent_parse_result_t result = {NULL, 0, 0};
 
-    if (!ctx || !response || length == 0) {
+    if (!ctx || !tags || !response || length == 0) {
         return result;
     }
 
@@ -377,182 +922,110 @@ agent_parse_result_t agent_parser_parse(agent_context_t* ctx,
         return result;
     }
 
-    /* First, try to find <tool_call> tags */
+    /* Single pass over the tags. pos marks the start of the pending text
+       run; a block whose closing tag is missing leaves the rest as text. */
+    const char* end = response + length;
     const char* pos = response;
-    size_t remaining = length;
-
-    while (remaining > 0) {
-        const char* tool_open = find_substr(pos, remaining, TAG_TOOL_CALL_OPEN, TAG_TOOL_CALL_OPEN_LEN);
-
-        if (!tool_open) {
-            /* No more tool calls - check for bare JSON */
-            agent_string_view_t before, after;
-            agent_parsed_tool_call_t* bare_tc = agent_parser_find_bare_json(ctx, pos, remaining, &before, &after);
-
-            if (bare_tc) {
-                /* Add text before */
-                if (before.length > 0) {
-                    agent_string_view_t trimmed = agent_sv_trim(before);
-                    if (trimmed.length > 0) {
-                        if (result.count >= result.capacity) {
-                            /* Expand array */
-                            size_t new_cap = result.capacity * 2;
-                            agent_parsed_content_t* new_arr = agent_context_calloc(ctx, new_cap, sizeof(agent_parsed_content_t));
-                            if (!new_arr) return result;
-                            memcpy(new_arr, result.contents, result.count * sizeof(agent_parsed_content_t));
-                            result.contents = new_arr;
-                            result.capacity = new_cap;
-                        }
-                        result.contents[result.count].type = AGENT_CONTENT_TEXT;
-                        result.contents[result.count].data.text = trimmed;
-                        result.count++;
-                    }
-                }
-
-                /* Add tool call */
-                if (result.count >= result.capacity) {
-                    size_t new_cap = result.capacity * 2;
-                    agent_parsed_content_t* new_arr = agent_context_calloc(ctx, new_cap, sizeof(agent_parsed_content_t));
-                    if (!new_arr) return result;
-                    memcpy(new_arr, result.contents, result.count * sizeof(agent_parsed_content_t));
-                    result.contents = new_arr;
-                    result.capacity = new_cap;
-                }
-                result.contents[result.count].type = AGENT_CONTENT_TOOL_CALL;
-                result.contents[result.count].data.tool_call.name = bare_tc->name;
-                result.contents[result.count].data.tool_call.arguments = bare_tc->arguments;
-                result.count++;
-
-                /* Continue with text after */
-                if (after.length > 0) {
-                    agent_string_view_t trimmed = agent_sv_trim(after);
-                    if (trimmed.length > 0) {
-                        if (result.count >= result.capacity) {
-                            size_t new_cap = result.capacity * 2;
-                            agent_parsed_content_t* new_arr = agent_context_calloc(ctx, new_cap, sizeof(agent_parsed_content_t));
-                            if (!new_arr) return result;
-                            memcpy(new_arr, result.contents, result.count * sizeof(agent_parsed_content_t));
-                            result.contents = new_arr;
-                            result.capacity = new_cap;
-                        }
-                        result.contents[result.count].type = AGENT_CONTENT_TEXT;
-                        result.contents[result.count].data.text = trimmed;
-                        result.count++;
-                    }
+    agent_tag_t tag;
+    const char* p = next_tag(tags, pos, end, TAG_MASK_ALL, &tag);
+
+    while (p) {
+        const char* body = p + tags->length[tag];
+
+        switch (tag) {
+            case AGENT_TAG_TOOL_CALL_OPEN:
+            case AGENT_TAG_TOOL_CALL_ALT_OPEN:
+            case AGENT_TAG_THINK_OPEN:
+            case AGENT_TAG_THINKING_OPEN: {
+                agent_tag_t close_tag = (agent_tag_t)(tag + 1);
+                const char* close;
+                const char* after;
+                if (tags->length[close_tag] > 0) {
+                    close = find_tag(tags, body, (size_t)(end - body), close_tag);
+                    after = close ? close + tags->length[close_tag] : NULL;
+                } else {
+                    close = json_value_end(body, end);
+                    after = close;
                 }
-            } else {
-                /* Just text */
-                agent_string_view_t text = agent_sv_from_parts(pos, remaining);
-                text = agent_sv_trim(text);
-                if (text.length > 0) {
-                    if (result.count >= result.capacity) {
-                        size_t new_cap = result.capacity * 2;
-                        agent_parsed_content_t* new_arr = agent_context_calloc(ctx, new_cap, sizeof(agent_parsed_content_t));
-                        if (!new_arr) return result;
-                        memcpy(new_arr, result.contents, result.count * sizeof(agent_parsed_content_t));
-                        result.contents = new_arr;
-                        result.capacity = new_cap;
-                    }
-                    result.contents[result.count].type = AGENT_CONTENT_TEXT;
-                    result.contents[result.count].data.text = agent_context_string_view_n(ctx, text.data, text.length);
-                    result.count++;
+                if (!close) {
+                    p = NULL;
+                    continue;
                 }
-            }
-            break;
-        }
 
-        /* Add text before tool call */
-        if (tool_open > pos) {
-            agent_string_view_t text = agent_sv_from_parts(pos, (size_t)(tool_open - pos));
-            text = agent_sv_trim(text);
-            if (text.length > 0) {
-                if (result.count >= result.capacity) {
-                    size_t new_cap = result.capacity * 2;
-                    agent_parsed_content_t* new_arr = agent_context_calloc(ctx, new_cap, sizeof(agent_parsed_content_t));
-                    if (!new_arr) return result;
-                    memcpy(new_arr, result.contents, result.count * sizeof(agent_parsed_content_t));
-                    result.contents = new_arr;
-                    result.capacity = new_cap;
+                if (!content_push_view(ctx, &result, AGENT_CONTENT_TEXT, pos, p)) return result;
+
+                if (is_tool_call_open(tag)) {
+                    if (!content_push_tool_calls(ctx, &result, body, (size_t)(close - body))) return result;
+                } else {
+                    if (!content_push_view(ctx, &result, AGENT_CONTENT_THINKING, body, close)) return result;
                 }
-                result.contents[result.count].type = AGENT_CONTENT_TEXT;
-                result.contents[result.count].data.text = agent_context_string_view_n(ctx, text.data, text.length);
-                result.count++;
+
+                pos = after;
+                p = next_tag(tags, pos, end, TAG_MASK_ALL, &tag);
+                continue;
             }
-        }
 
-        /* Find closing tag */
-        const char* content_start = tool_open + TAG_TOOL_CALL_OPEN_LEN;
-        size_t content_remaining = remaining - (size_t)(content_start - pos);
-        const char* tool_close = find_substr(content_start, content_remaining, TAG_TOOL_CALL_CLOSE, TAG_TOOL_CALL_CLOSE_LEN);
+            case AGENT_TAG_THINK_CLOSE:
+            case AGENT_TAG_THINKING_CLOSE:
+                /* A close before anything else: the thinking was opened in the prompt */
+                if (pos == response && result.count == 0) {
+                    if (!content_push_view(ctx, &result, AGENT_CONTENT_THINKING, response, p)) return result;
+                    pos = body;
+                }
+                break;
 
-        if (!tool_close) {
-            /* Incomplete tag - treat rest as text */
-            break;
+            default:
+                /* Stray closing tool tag stays part of the text */
+                break;
         }
 
-        /* Parse tool call JSON */
-        size_t json_len = (size_t)(tool_close - content_start);
-        agent_parsed_tool_call_t* tc = agent_parser_parse_tool_call_json(ctx, content_start, json_len);
+        p = next_tag(tags, body, end, TAG_MASK_ALL, &tag);
+    }
 
+    /* Trailing text, with a bare JSON tool call as the fallback */
+    const char* json_start;
+    const char* json_end;
+    const char* json_from = bare_json_from < length ? response + bare_json_from : end;
+    if (json_from < pos) {
+        json_from = pos;
+    }
+    if (json_from < end && find_bare_json_span(json_from, (size_t)(end - json_from),
+                                               &json_start, &json_end)) {
+        agent_parsed_tool_call_t* tc = parse_tool_call_span(ctx, json_start,
+                                                            (size_t)(json_end - json_start));
         if (tc) {
-            if (result.count >= result.capacity) {
-                size_t new_cap = result.capacity * 2;
-                agent_parsed_content_t* new_arr = agent_context_calloc(ctx, new_cap, sizeof(agent_parsed_content_t));
-                if (!new_arr) return result;
-                memcpy(new_arr, result.contents, result.count * sizeof(agent_parsed_content_t));
-                result.contents = new_arr;
-                result.capacity = new_cap;
-            }
-            result.contents[result.count].type = AGENT_CONTENT_TOOL_CALL;
-            result.contents[result.count].data.tool_call.name = tc->name;
-            result.contents[result.count].data.tool_call.arguments = tc->arguments;
-            result.count++;
-        }
-
-        /* Move past this tool call */
-        pos = tool_close + TAG_TOOL_CALL_CLOSE_LEN;
-        remaining = length - (size_t)(pos - response);
-    }
-
-    /* Extract thinking content from any text items */
-    for (size_t i = 0; i < result.count; i++) {
-        if (result.contents[i].type == AGENT_CONTENT_TEXT) {
-            agent_string_view_t thinking, content;
-            agent_parser_extract_thinking(ctx,
-                result.contents[i].data.text.data,
-                result.contents[i].data.text.length,
-                &thinking, &content);
-
-            if (thinking.length > 0) {
-                /* Insert thinking content before this text */
-                if (result.count >= result.capacity) {
-                    size_t new_cap = result.capacity * 2;
-                    agent_parsed_content_t* new_arr = agent_context_calloc(ctx, new_cap, sizeof(agent_parsed_content_t));
-                    if (!new_arr) return result;
-                    memcpy(new_arr, result.contents, result.count * sizeof(agent_parsed_content_t));
-                    result.contents = new_arr;
-                    result.capacity = new_cap;
-                }
+            if (!content_push_view(ctx, &result, AGENT_CONTENT_TEXT, pos, json_start)) return result;
+            if (!content_push_tool_call(ctx, &result, tc)) return result;
+            pos = json_end;
+        }
+    }
+    content_push_view(ctx, &result, AGENT_CONTENT_TEXT, pos, end);
 
-                /* Shift items after i */
-                memmove(&result.contents[i + 2], &result.contents[i + 1],
-                        (result.count - i - 1) * sizeof(agent_parsed_content_t));
+    return result;
+}
 
-                /* Insert thinking */
-                result.contents[i].type = AGENT_CONTENT_THINKING;
-                result.contents[i].data.thinking = thinking;
+static agent_parse_result_t parse_response(agent_context_t* ctx, const agent_tag_set_t* tags,
+                                           const char* response, size_t length,
+                                           size_t bare_json_from) {
+    AGENT_TRACE_BEGIN(agent_parser_parse);
+    agent_parse_result_t result = parse_response_untraced(ctx, tags, response, length, bare_json_from);
+    AGENT_TRACE_END(agent_parser_parse);
+    return result;
+}
 
-                /* Update text */
-                result.contents[i + 1].type = AGENT_CONTENT_TEXT;
-                result.contents[i + 1].data.text = content;
+agent_parse_result_t agent_parser_parse_tags(agent_context_t* ctx, const agent_tag_set_t* tags,
+                                             const char* response, size_t length) {
+    return parse_response(ctx, tags, response, length, 0);
+}
 
-                result.count++;
-                i++;  /* Skip the newly inserted item */
-            }
-        }
+agent_parse_result_t agent_parser_parse_scanned(agent_context_t* ctx,
+                                               const agent_tool_tag_scanner_t* scanner,
+                                               const char* response, size_t length) {
+    if (!scanner) {
+        return agent_parser_parse_tags(ctx, &default_tags, response, length);
     }
-
-    return result;
+    return parse_response(ctx, scanner->tags ? scanner->tags : &default_tags,
+                          response, length, scanner->bare_json_at);
 }
 
 agent_parse_result_t agent_parser_parse_cstr(agent_context_t* ctx, const char* response) {
@@ -574,6 +1047,7 @@ agent_error_t agent_streaming_parser_init(agent_streaming_parser_t* parser,
     memset(parser, 0, sizeof(agent_streaming_parser_t));
     parser->ctx = ctx;
     parser->state = PARSER_STATE_TEXT;
+    parser->tags = default_tags;
 
     agent_error_t err;
     err = agent_string_init(&parser->buffer, 256);
@@ -592,6 +1066,14 @@ agent_error_t agent_streaming_parser_init(agent_streaming_parser_t* parser,
         return err;
     }
 
+    err = agent_json_incremental_init(&parser->tool_json, ctx);
+    if (err != AGENT_OK) {
+        agent_string_free(&parser->buffer);
+        agent_string_free(&parser->tag_buffer);
+        agent_string_free(&parser->content_buffer);
+        return err;
+    }
+
     return AGENT_OK;
 }
 
@@ -601,6 +1083,7 @@ void agent_streaming_parser_free(agent_streaming_parser_t* parser) {
     agent_string_free(&parser->buffer);
     agent_string_free(&parser->tag_buffer);
     agent_string_free(&parser->content_buffer);
+    agent_json_incremental_free(&parser->tool_json);
 }
 
 void agent_streaming_parser_reset(agent_streaming_parser_t* parser) {
@@ -610,9 +1093,271 @@ void agent_streaming_parser_reset(agent_streaming_parser_t* parser) {
     agent_string_clear(&parser->buffer);
     agent_string_clear(&parser->tag_buffer);
     agent_string_clear(&parser->content_buffer);
+    parser->text_held_feeds = 0;
     parser->in_tool_call = false;
     parser->in_think = false;
     parser->brace_depth = 0;
+    parser->close_matched = 0;
+    agent_json_incremental_reset(&parser->tool_json);
+    parser->tool_field_count = 0;
+    parser->tool_name_reported = false;
+}
+
+agent_error_t agent_streaming_parser_set_dialect(agent_streaming_parser_t* parser,
+                                                 const agent_parser_dialect_t* dialect) {
+    if (!parser) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    return agent_tag_set_compile(&parser->tags, dialect);
+}
+
+/* Hand text to on_text, or queue it in buffer when coalescing */
+static void emit_text(agent_streaming_parser_t* parser, const char* text, size_t len) {
+    if (len == 0 || !parser->on_text) {
+        return;
+    }
+    if (parser->coalesce_text) {
+        agent_string_append_n(&parser->buffer, text, len);
+        return;
+    }
+    parser->on_text(text, len, parser->user_data);
+}
+
+/* Pass queued text on. Unless forced, wait until the policy says so and
+   keep a trailing partial UTF-8 sequence for the next feed. */
+static void release_text(agent_streaming_parser_t* parser, bool force) {
+    agent_string_t* pending = &parser->buffer;
+    if (pending->length == 0) {
+        parser->text_held_feeds = 0;
+        return;
+    }
+
+    if (!force) {
+        const agent_text_coalescing_t* policy = &parser->text_coalescing;
+        parser->text_held_feeds++;
+        if (pending->length < policy->min_bytes &&
+            (policy->max_feeds == 0 || parser->text_held_feeds < policy->max_feeds)) {
+            return;
+        }
+    }
+
+    size_t n = force ? pending->length : agent_utf8_complete_boundary(pending->data, pending->length);
+    if (n == 0) {
+        return;
+    }
+    if (parser->on_text) {
+        parser->on_text(pending->data, n, parser->user_data);
+    }
+
+    pending->length -= n;
+    memmove(pending->data, pending->data + n, pending->length);
+    pending->data[pending->length] = '\0';
+    parser->text_held_feeds = 0;
+}
+
+agent_error_t agent_streaming_parser_set_text_coalescing(agent_streaming_parser_t* parser,
+                                                         const agent_text_coalescing_t* policy) {
+    if (!parser) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    if (!policy) {
+        release_text(parser, true);
+        parser->coalesce_text = false;
+        return AGENT_OK;
+    }
+    parser->coalesce_text = true;
+    parser->text_coalescing = *policy;
+    return AGENT_OK;
+}
+
+/* Classify a candidate opening tag: the tag once complete, -1 while it is
+   still a prefix of one, -2 when no opening tag can match */
+static int match_open_tag_prefix(const agent_tag_set_t* tags, const char* buf, size_t len) {
+    bool partial = false;
+
+    /* Opening roles are the even ones */
+    for (int tag = 0; tag < AGENT_TAG_COUNT; tag += 2) {
+        size_t tag_len = tags->length[tag];
+        if (tag_len > 0 && len <= tag_len && memcmp(buf, tags->text[tag], len) == 0) {
+            if (len == tag_len) return tag;
+            partial = true;
+        }
+    }
+    return partial ? -1 : -2;
+}
+
+static void begin_block(agent_streaming_parser_t* parser, agent_tag_t open_tag) {
+    /* Text before the block reaches on_text ahead of the block's callbacks */
+    release_text(parser, true);
+    parser->close_tag = (agent_tag_t)(open_tag + 1);
+    parser->close_matched = 0;
+    agent_string_clear(&parser->content_buffer);
+
+    if (is_tool_call_open(open_tag)) {
+        parser->state = PARSER_STATE_TOOL_CALL;
+        parser->in_tool_call = true;
+        agent_json_incremental_reset(&parser->tool_json);
+        parser->tool_field_count = 0;
+        parser->tool_name_reported = false;
+    } else {
+        parser->state = PARSER_STATE_THINK;
+        parser->in_think = true;
+    }
+}
+
+/* Whether the tool call ends when its JSON balances: always for dialects
+   without a closing tag, otherwise with dispatch_on_json_close */
+static bool tool_call_ends_with_json(const agent_streaming_parser_t* parser) {
+    return parser->dispatch_on_json_close || parser->tags.length[parser->close_tag] == 0;
+}
+
+/* Append a run of block content; tool call JSON is scanned as it grows.
+   When the call ends with its JSON the run is cut at the closing brace.
+   Returns the number of bytes taken. */
+static size_t block_append(agent_streaming_parser_t* parser, const char* data, size_t len) {
+    if (len == 0) return 0;
+
+    if (parser->state != PARSER_STATE_TOOL_CALL) {
+        agent_string_append_n(&parser->content_buffer, data, len);
+        return len;
+    }
+
+    size_t scanned = parser->tool_json.buffer.length;
+    agent_json_incremental_status_t status = agent_json_incremental_feed(&parser->tool_json, data, len);
+    if (tool_call_ends_with_json(parser) && status == AGENT_JSON_INCREMENTAL_COMPLETE) {
+        /* The scanner drops whatever followed the closing brace */
+        len = parser->tool_json.buffer.length - scanned;
+    }
+    agent_string_append_n(&parser->content_buffer, data, len);
+
+    /* Report the tool name as soon as its member is complete */
+    if (parser->tool_json.field_count != parser->tool_field_count) {
+        parser->tool_field_count = parser->tool_json.field_count;
+        if (!parser->tool_name_reported && parser->on_tool_call_start) {
+            agent_json_value_t* name = agent_json_incremental_field(&parser->tool_json, "name");
+            if (name && name->type == AGENT_JSON_STRING) {
+                parser->tool_name_reported = true;
+                parser->on_tool_call_start(name->data.string_value.data, parser->user_data);
+            }
+        }
+    }
+    return len;
+}
+
+/* Whether the tool call JSON has balanced and should be dispatched now */
+static bool tool_json_closed(const agent_streaming_parser_t* parser) {
+    return parser->state == PARSER_STATE_TOOL_CALL && tool_call_ends_with_json(parser) &&
+           parser->tool_json.status == AGENT_JSON_INCREMENTAL_COMPLETE;
+}
+
+static void finish_block(agent_streaming_parser_t* parser) {
+    if (parser->state == PARSER_STATE_TOOL_CALL) {
+        agent_json_value_t* value = agent_json_incremental_value(&parser->tool_json);
+
+        if (value && value->type == AGENT_JSON_ARRAY) {
+            /* Several calls in one block */
+            for (size_t i = 0; i < value->data.array_value.count; i++) {
+                agent_parsed_tool_call_t* tc = tool_call_from_value(
+                    parser->ctx, value->data.array_value.items[i], NULL, 0);
+                if (tc && parser->on_tool_call) {
+                    parser->on_tool_call(tc->name.data, tc->arguments, parser->user_data);
+                }
+            }
+        } else {
+            agent_parsed_tool_call_t* tc = tool_call_from_value(
+                parser->ctx, value, parser->content_buffer.data, parser->content_buffer.length);
+            if (!tc) {
+                tc = agent_parser_parse_tool_call_json(
+                    parser->ctx, parser->content_buffer.data, parser->content_buffer.length);
+            }
+
+            if (tc && parser->on_tool_call) {
+                parser->on_tool_call(tc->name.data, tc->arguments, parser->user_data);
+            }
+        }
+        parser->in_tool_call = false;
+    } else {
+        if (parser->on_thinking) {
+            parser->on_thinking(parser->content_buffer.data, parser->content_buffer.length,
+                                parser->user_data);
+        }
+        parser->in_think = false;
+    }
+
+    agent_string_clear(&parser->content_buffer);
+    parser->state = PARSER_STATE_TEXT;
+}
+
+/* Consume block content up to and including its closing tag. Runs between
+   close tag candidates are appended in bulk; a partial close match is
+   carried as a length, since its bytes are a prefix of the tag text.
+   Returns the number of bytes consumed. */
+static size_t feed_block(agent_streaming_parser_t* parser, const char* data, size_t length) {
+    const char* close = parser->tags.text[parser->close_tag];
+    size_t close_len = parser->tags.length[parser->close_tag];
+    size_t i = 0;
+
+    while (i < length) {
+        if (parser->close_matched == 0) {
+            const char* lt = close_len > 0 ? memchr(data + i, close[0], length - i) : NULL;
+            size_t run_end = lt ? (size_t)(lt - data) : length;
+            i += block_append(parser, data + i, run_end - i);
+            if (tool_json_closed(parser)) {
+                /* Dispatch now; a closing tag may still follow */
+                finish_block(parser);
+                if (close_len > 0) {
+                    parser->state = PARSER_STATE_TAG_CLOSE;
+                }
+                break;
+            }
+            if (!lt) break;
+            parser->close_matched = 1;
+            i++;
+        } else if (data[i] == close[parser->close_matched]) {
+            i++;
+            if (++parser->close_matched == close_len) {
+                parser->close_matched = 0;
+                finish_block(parser);
+                break;
+            }
+        } else {
+            /* False start: the matched bytes were content after all */
+            block_append(parser, close, parser->close_matched);
+            parser->close_matched = 0;
+        }
+    }
+
+    return i;
+}
+
+/* After an early dispatch, swallow whitespace and the closing tag the
+   model may still send; anything else resumes as text */
+static size_t feed_dispatched_close(agent_streaming_parser_t* parser,
+                                    const char* data, size_t length) {
+    const char* close = parser->tags.text[parser->close_tag];
+    size_t close_len = parser->tags.length[parser->close_tag];
+    size_t i = 0;
+
+    while (i < length) {
+        char c = data[i];
+        if (parser->close_matched == 0 && (c == ' ' || c == '\t' || c == '\n' || c == '\r')) {
+            i++;
+        } else if (c == close[parser->close_matched]) {
+            i++;
+            if (++parser->close_matched == close_len) {
+                parser->close_matched = 0;
+                parser->state = PARSER_STATE_TEXT;
+                break;
+            }
+        } else {
+            emit_text(parser, close, parser->close_matched);
+            parser->close_matched = 0;
+            parser->state = PARSER_STATE_TEXT;
+            break;
+        }
+    }
+
+    return i;
 }
 
 agent_error_t agent_streaming_parser_feed(agent_streaming_parser_t* parser,
@@ -621,114 +1366,54 @@ agent_error_t agent_streaming_parser_feed(agent_streaming_parser_t* parser,
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
 
-    for (size_t i = 0; i < length; i++) {
-        char c = token[i];
-
+    size_t i = 0;
+    while (i < length) {
         switch (parser->state) {
-            case PARSER_STATE_TEXT:
-                if (c == '<') {
-                    parser->state = PARSER_STATE_TAG_OPEN;
+            case PARSER_STATE_TEXT: {
+                /* Emit the run before the next tag candidate straight from the token */
+                const char* lt = find_lead(&parser->tags, token + i, token + length);
+                size_t run_end = lt ? (size_t)(lt - token) : length;
+                emit_text(parser, token + i, run_end - i);
+                i = run_end;
+                if (lt) {
                     agent_string_clear(&parser->tag_buffer);
-                    agent_string_append_char(&parser->tag_buffer, c);
-                } else {
-                    agent_string_append_char(&parser->buffer, c);
+                    parser->state = PARSER_STATE_TAG_OPEN;
                 }
                 break;
+            }
 
-            case PARSER_STATE_TAG_OPEN:
-                agent_string_append_char(&parser->tag_buffer, c);
+            case PARSER_STATE_TAG_OPEN: {
+                char c = token[i];
 
-                if (c == '>') {
-                    /* Check what tag we have */
-                    const char* tag = agent_string_cstr(&parser->tag_buffer);
-
-                    if (strcmp(tag, TAG_TOOL_CALL_OPEN) == 0) {
-                        /* Emit buffered text */
-                        if (parser->buffer.length > 0 && parser->on_text) {
-                            parser->on_text(parser->buffer.data, parser->buffer.length, parser->user_data);
-                        }
-                        agent_string_clear(&parser->buffer);
-                        parser->state = PARSER_STATE_TOOL_CALL;
-                        parser->in_tool_call = true;
-                        agent_string_clear(&parser->content_buffer);
-                    } else if (strcmp(tag, TAG_THINK_OPEN) == 0 ||
-                               strcmp(tag, TAG_THINKING_OPEN) == 0) {
-                        /* Emit buffered text */
-                        if (parser->buffer.length > 0 && parser->on_text) {
-                            parser->on_text(parser->buffer.data, parser->buffer.length, parser->user_data);
-                        }
-                        agent_string_clear(&parser->buffer);
-                        parser->state = PARSER_STATE_THINK;
-                        parser->in_think = true;
-                        agent_string_clear(&parser->content_buffer);
-                    } else {
-                        /* Not a recognized tag - add to buffer */
-                        agent_string_append(&parser->buffer, tag);
-                        parser->state = PARSER_STATE_TEXT;
-                    }
+                /* No tag contains a lead byte past its start, so one restarts the candidate */
+                if (parser->tags.lead[(unsigned char)c] && parser->tag_buffer.length > 0) {
+                    emit_text(parser, parser->tag_buffer.data, parser->tag_buffer.length);
                     agent_string_clear(&parser->tag_buffer);
-                } else if (parser->tag_buffer.length > 15) {
-                    /* Tag too long - not a valid tag */
-                    agent_string_append_sv(&parser->buffer, agent_string_view(&parser->tag_buffer));
+                }
+                agent_string_append_char(&parser->tag_buffer, c);
+                i++;
+
+                int tag = match_open_tag_prefix(&parser->tags, parser->tag_buffer.data,
+                                                parser->tag_buffer.length);
+                if (tag == -2) {
+                    /* Not a recognized tag - pass it through as text */
+                    emit_text(parser, parser->tag_buffer.data, parser->tag_buffer.length);
                     agent_string_clear(&parser->tag_buffer);
                     parser->state = PARSER_STATE_TEXT;
+                } else if (tag >= 0) {
+                    agent_string_clear(&parser->tag_buffer);
+                    begin_block(parser, (agent_tag_t)tag);
                 }
                 break;
+            }
 
             case PARSER_STATE_TOOL_CALL:
-                agent_string_append_char(&parser->content_buffer, c);
-
-                /* Check for closing tag */
-                if (parser->content_buffer.length >= TAG_TOOL_CALL_CLOSE_LEN) {
-                    const char* end = parser->content_buffer.data + parser->content_buffer.length - TAG_TOOL_CALL_CLOSE_LEN;
-                    if (memcmp(end, TAG_TOOL_CALL_CLOSE, TAG_TOOL_CALL_CLOSE_LEN) == 0) {
-                        /* Found closing tag - parse tool call */
-                        size_t json_len = parser->content_buffer.length - TAG_TOOL_CALL_CLOSE_LEN;
-                        agent_parsed_tool_call_t* tc = agent_parser_parse_tool_call_json(
-                            parser->ctx, parser->content_buffer.data, json_len);
-
-                        if (tc && parser->on_tool_call) {
-                            parser->on_tool_call(tc->name.data, tc->arguments, parser->user_data);
-                        }
-
-                        agent_string_clear(&parser->content_buffer);
-                        parser->state = PARSER_STATE_TEXT;
-                        parser->in_tool_call = false;
-                    }
-                }
+            case PARSER_STATE_THINK:
+                i += feed_block(parser, token + i, length - i);
                 break;
 
-            case PARSER_STATE_THINK:
-                agent_string_append_char(&parser->content_buffer, c);
-
-                /* Check for closing tags */
-                if (parser->content_buffer.length >= TAG_THINK_CLOSE_LEN) {
-                    const char* end = parser->content_buffer.data + parser->content_buffer.length - TAG_THINK_CLOSE_LEN;
-                    bool closed = false;
-
-                    if (memcmp(end, TAG_THINK_CLOSE, TAG_THINK_CLOSE_LEN) == 0) {
-                        size_t think_len = parser->content_buffer.length - TAG_THINK_CLOSE_LEN;
-                        if (parser->on_thinking) {
-                            parser->on_thinking(parser->content_buffer.data, think_len, parser->user_data);
-                        }
-                        closed = true;
-                    } else if (parser->content_buffer.length >= TAG_THINKING_CLOSE_LEN) {
-                        end = parser->content_buffer.data + parser->content_buffer.length - TAG_THINKING_CLOSE_LEN;
-                        if (memcmp(end, TAG_THINKING_CLOSE, TAG_THINKING_CLOSE_LEN) == 0) {
-                            size_t think_len = parser->content_buffer.length - TAG_THINKING_CLOSE_LEN;
-                            if (parser->on_thinking) {
-                                parser->on_thinking(parser->content_buffer.data, think_len, parser->user_data);
-                            }
-                            closed = true;
-                        }
-                    }
-
-                    if (closed) {
-                        agent_string_clear(&parser->content_buffer);
-                        parser->state = PARSER_STATE_TEXT;
-                        parser->in_think = false;
-                    }
-                }
+            case PARSER_STATE_TAG_CLOSE:
+                i += feed_dispatched_close(parser, token + i, length - i);
                 break;
 
             default:
@@ -737,14 +1422,8 @@ agent_error_t agent_streaming_parser_feed(agent_streaming_parser_t* parser,
         }
     }
 
-    /* If in TEXT state, emit buffered text incrementally */
-    if (parser->state == PARSER_STATE_TEXT && parser->buffer.length > 0) {
-        /* Keep some buffer in case we're mid-tag */
-        size_t emit_len = parser->buffer.length;
-        if (emit_len > 0 && parser->on_text) {
-            parser->on_text(parser->buffer.data, emit_len, parser->user_data);
-        }
-        agent_string_clear(&parser->buffer);
+    if (parser->coalesce_text) {
+        release_text(parser, false);
     }
 
     return AGENT_OK;
@@ -756,9 +1435,7 @@ agent_error_t agent_streaming_parser_flush(agent_streaming_parser_t* parser) {
     }
 
     /* Emit any remaining buffered content */
-    if (parser->buffer.length > 0 && parser->on_text) {
-        parser->on_text(parser->buffer.data, parser->buffer.length, parser->user_data);
-    }
+    release_text(parser, true);
 
     if (parser->tag_buffer.length > 0 && parser->on_text) {
         parser->on_text(parser->tag_buffer.data, parser->tag_buffer.length, parser->user_data);
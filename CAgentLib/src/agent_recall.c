@@ -0,0 +1,367 @@
+/**
+ * @file agent_recall.c
+ * @brief Incremental BM25 index implementation
+ */
+
+#include "agent_recall.h"
+#include "agent_alloc.h"
+#include "agent_string.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECALL_K1 1.2f
+#define RECALL_B 0.75f
+#define RECALL_MIN_TERM_CAPACITY 256
+#define RECALL_MIN_DOC_CAPACITY 32
+
+/* Terms */
+
+typedef struct {
+    uint64_t* hashes;   /* Heap */
+    size_t count;
+    size_t capacity;
+} recall_terms_t;
+
+static uint64_t fnv1a(uint64_t hash, const char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static bool terms_push(recall_terms_t* terms, uint64_t hash) {
+    if (terms->count == terms->capacity) {
+        size_t capacity = terms->capacity ? terms->capacity * 2 : 64;
+        uint64_t* hashes = agent_mem_realloc(terms->hashes, capacity * sizeof(uint64_t));
+        if (!hashes) {
+            return false;
+        }
+        terms->hashes = hashes;
+        terms->capacity = capacity;
+    }
+    terms->hashes[terms->count++] = hash ? hash : 1;  /* 0 marks an empty slot */
+    return true;
+}
+
+static bool is_ascii_alnum(uint8_t c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/* CJK symbols and punctuation, fullwidth punctuation: separators like ASCII punctuation */
+static bool is_wide_separator(uint32_t cp) {
+    return (cp >= 0x3000 && cp <= 0x303F) || (cp >= 0xFF00 && cp <= 0xFF0F) ||
+           (cp >= 0xFF1A && cp <= 0xFF20);
+}
+
+/* Codepoint of a complete multi-byte character */
+static uint32_t decode_char(const uint8_t* p, size_t length) {
+    uint32_t cp = p[0] & (0x7F >> length);
+    for (size_t i = 1; i < length; i++) {
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    return cp;
+}
+
+/* Lowercased ASCII words, and character pairs within runs of other characters */
+static bool extract_terms(agent_string_view_t text, recall_terms_t* terms) {
+    const uint8_t* data = (const uint8_t*)text.data;
+    size_t length = text.data ? text.length : 0;
+    size_t i = 0;
+
+    while (i < length) {
+        if (is_ascii_alnum(data[i])) {
+            uint64_t hash = 0xcbf29ce484222325ULL;
+            while (i < length && is_ascii_alnum(data[i])) {
+                char c = (char)data[i];
+                char lower = c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+                hash = fnv1a(hash, &lower, 1);
+                i++;
+            }
+            if (!terms_push(terms, hash)) {
+                return false;
+            }
+            continue;
+        }
+
+        /* A run of non-ASCII characters */
+        size_t prev = 0;
+        size_t prev_len = 0;
+        size_t run = 0;
+        while (i < length && data[i] >= 0x80) {
+            size_t char_len = agent_utf8_char_length(data[i]);
+            if (char_len < 2 || i + char_len > length ||
+                is_wide_separator(decode_char(data + i, char_len))) {
+                break;
+            }
+            if (run > 0) {
+                uint64_t hash = fnv1a(0xcbf29ce484222325ULL, text.data + prev, prev_len + char_len);
+                if (!terms_push(terms, hash)) {
+                    return false;
+                }
+            }
+            prev = i;
+            prev_len = char_len;
+            run++;
+            i += char_len;
+        }
+        if (run == 1 && !terms_push(terms, fnv1a(0xcbf29ce484222325ULL, text.data + prev, prev_len))) {
+            return false;
+        }
+        if (run == 0) {
+            /* Separator: ASCII punctuation, CJK punctuation or a malformed byte */
+            size_t char_len = data[i] >= 0x80 ? agent_utf8_char_length(data[i]) : 1;
+            i += char_len > 0 && i + char_len <= length ? char_len : 1;
+        }
+    }
+    return true;
+}
+
+static int compare_hashes(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Term table */
+
+static agent_recall_term_t* find_term(const agent_recall_index_t* index, uint64_t hash) {
+    if (index->term_capacity == 0) {
+        return NULL;
+    }
+    size_t mask = index->term_capacity - 1;
+    for (size_t slot = (size_t)hash & mask;; slot = (slot + 1) & mask) {
+        agent_recall_term_t* term = &index->terms[slot];
+        if (term->hash == hash) {
+            return term;
+        }
+        if (term->hash == 0) {
+            return NULL;
+        }
+    }
+}
+
+/* Make room for extra more terms at a load factor of at most one half */
+static bool reserve_terms(agent_recall_index_t* index, size_t extra) {
+    size_t needed = (index->term_count + extra) * 2;
+    if (needed <= index->term_capacity) {
+        return true;
+    }
+    size_t capacity = index->term_capacity ? index->term_capacity : RECALL_MIN_TERM_CAPACITY;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    agent_recall_term_t* terms = agent_mem_calloc(capacity, sizeof(agent_recall_term_t));
+    if (!terms) {
+        return false;
+    }
+    for (size_t i = 0; i < index->term_capacity; i++) {
+        const agent_recall_term_t* term = &index->terms[i];
+        if (term->hash == 0) continue;
+        size_t slot = (size_t)term->hash & (capacity - 1);
+        while (terms[slot].hash != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        terms[slot] = *term;
+    }
+    agent_mem_free(index->terms);
+    index->terms = terms;
+    index->term_capacity = capacity;
+    return true;
+}
+
+static agent_recall_term_t* insert_term(agent_recall_index_t* index, uint64_t hash) {
+    size_t mask = index->term_capacity - 1;
+    size_t slot = (size_t)hash & mask;
+    while (index->terms[slot].hash != 0 && index->terms[slot].hash != hash) {
+        slot = (slot + 1) & mask;
+    }
+    agent_recall_term_t* term = &index->terms[slot];
+    if (term->hash == 0) {
+        term->hash = hash;
+        index->term_count++;
+    }
+    return term;
+}
+
+static bool add_posting(agent_recall_term_t* term, uint32_t doc, uint32_t tf) {
+    if (term->count == term->capacity) {
+        uint32_t capacity = term->capacity ? term->capacity * 2 : 4;
+        agent_recall_posting_t* postings =
+            agent_mem_realloc(term->postings, capacity * sizeof(agent_recall_posting_t));
+        if (!postings) {
+            return false;
+        }
+        term->postings = postings;
+        term->capacity = capacity;
+    }
+    term->postings[term->count].doc = doc;
+    term->postings[term->count].tf = tf;
+    term->count++;
+    return true;
+}
+
+/* Public API */
+
+void agent_recall_free(agent_recall_index_t* index) {
+    if (!index) return;
+
+    for (size_t i = 0; i < index->term_capacity; i++) {
+        agent_mem_free(index->terms[i].postings);
+    }
+    agent_mem_free(index->terms);
+    agent_mem_free(index->doc_lengths);
+    memset(index, 0, sizeof(agent_recall_index_t));
+}
+
+agent_error_t agent_recall_add(agent_recall_index_t* index, agent_string_view_t text) {
+    if (!index) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (index->doc_count == index->doc_capacity) {
+        size_t capacity = index->doc_capacity ? index->doc_capacity * 2 : RECALL_MIN_DOC_CAPACITY;
+        uint32_t* lengths = agent_mem_realloc(index->doc_lengths, capacity * sizeof(uint32_t));
+        if (!lengths) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+        index->doc_lengths = lengths;
+        index->doc_capacity = capacity;
+    }
+
+    recall_terms_t terms = {0};
+    if (!extract_terms(text, &terms)) {
+        agent_mem_free(terms.hashes);
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    if (terms.count > 1) {  /* hashes is NULL when there are no terms */
+        qsort(terms.hashes, terms.count, sizeof(uint64_t), compare_hashes);
+    }
+
+    /* Collapse runs of the same hash into (term, tf) pairs, in place */
+    size_t distinct = 0;
+    uint32_t* tfs = terms.count > 0 ? agent_mem_alloc(terms.count * sizeof(uint32_t)) : NULL;
+    if (terms.count > 0 && !tfs) {
+        agent_mem_free(terms.hashes);
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    for (size_t i = 0; i < terms.count; i++) {
+        if (distinct > 0 && terms.hashes[distinct - 1] == terms.hashes[i]) {
+            tfs[distinct - 1]++;
+            continue;
+        }
+        terms.hashes[distinct] = terms.hashes[i];
+        tfs[distinct++] = 1;
+    }
+
+    agent_error_t err = AGENT_OK;
+    uint32_t doc = (uint32_t)index->doc_count;
+    size_t posted = 0;
+    if (!reserve_terms(index, distinct)) {
+        err = AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    for (; err == AGENT_OK && posted < distinct; posted++) {
+        if (!add_posting(insert_term(index, terms.hashes[posted]), doc, tfs[posted])) {
+            err = AGENT_ERROR_OUT_OF_MEMORY;
+            break;
+        }
+    }
+
+    if (err != AGENT_OK) {
+        /* Take back the postings already made; emptied terms stay with df 0 */
+        for (size_t i = 0; i < posted; i++) {
+            find_term(index, terms.hashes[i])->count--;
+        }
+    } else {
+        index->doc_lengths[index->doc_count++] = (uint32_t)terms.count;
+        index->total_length += terms.count;
+    }
+
+    agent_mem_free(tfs);
+    agent_mem_free(terms.hashes);
+    return err;
+}
+
+agent_error_t agent_recall_score(const agent_recall_index_t* index, agent_string_view_t query,
+                                 float* out_scores) {
+    if (!index || (!out_scores && index->doc_count > 0)) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    if (index->doc_count == 0) {
+        return AGENT_OK;
+    }
+    memset(out_scores, 0, index->doc_count * sizeof(float));
+
+    recall_terms_t terms = {0};
+    if (!extract_terms(query, &terms)) {
+        agent_mem_free(terms.hashes);
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    if (terms.count > 1) {  /* hashes is NULL when there are no terms */
+        qsort(terms.hashes, terms.count, sizeof(uint64_t), compare_hashes);
+    }
+
+    float n = (float)index->doc_count;
+    float average_length = (float)index->total_length / n;
+    if (average_length <= 0) {
+        average_length = 1;
+    }
+    for (size_t i = 0; i < terms.count; i++) {
+        if (i > 0 && terms.hashes[i] == terms.hashes[i - 1]) {
+            continue;
+        }
+        const agent_recall_term_t* term = find_term(index, terms.hashes[i]);
+        if (!term || term->count == 0) {
+            continue;
+        }
+
+        float df = (float)term->count;
+        float idf = logf(1.0f + (n - df + 0.5f) / (df + 0.5f));
+        for (uint32_t p = 0; p < term->count; p++) {
+            const agent_recall_posting_t* posting = &term->postings[p];
+            float tf = (float)posting->tf;
+            float norm = 1.0f - RECALL_B + RECALL_B * (float)index->doc_lengths[posting->doc] / average_length;
+            out_scores[posting->doc] += idf * tf * (RECALL_K1 + 1.0f) / (tf + RECALL_K1 * norm);
+        }
+    }
+
+    agent_mem_free(terms.hashes);
+    return AGENT_OK;
+}
+
+size_t agent_recall_search(const agent_recall_index_t* index, agent_string_view_t query,
+                           size_t k, size_t* out_docs) {
+    if (!index || !out_docs || k == 0 || index->doc_count == 0) {
+        return 0;
+    }
+
+    float* scores = agent_mem_alloc(index->doc_count * sizeof(float));
+    if (!scores) {
+        return 0;
+    }
+    if (agent_recall_score(index, query, scores) != AGENT_OK) {
+        agent_mem_free(scores);
+        return 0;
+    }
+
+    /* Insertion into a best-first list of at most k */
+    size_t count = 0;
+    for (size_t doc = 0; doc < index->doc_count; doc++) {
+        float score = scores[doc];
+        if (score <= 0 || (count == k && score <= scores[out_docs[count - 1]])) {
+            continue;
+        }
+
+        size_t pos = count < k ? count++ : count - 1;
+        while (pos > 0 && scores[out_docs[pos - 1]] < score) {
+            out_docs[pos] = out_docs[pos - 1];
+            pos--;
+        }
+        out_docs[pos] = doc;
+    }
+
+    agent_mem_free(scores);
+    return count;
+}
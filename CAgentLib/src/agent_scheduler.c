@@ -0,0 +1,149 @@
+/**
+ * @file agent_scheduler.c
+ * @brief Multi-session scheduler implementation
+ */
+
+#include "agent_scheduler.h"
+#include "agent_alloc.h"
+#include <string.h>
+
+#define DEFAULT_SESSION_CAPACITY 4
+
+agent_error_t agent_scheduler_init(agent_scheduler_t* scheduler, const agent_scheduler_config_t* config) {
+    if (!scheduler || !config || !config->decode) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    memset(scheduler, 0, sizeof(agent_scheduler_t));
+    scheduler->config = *config;
+    if (scheduler->config.max_batch == 0) {
+        scheduler->config.max_batch = AGENT_SCHEDULER_MAX_BATCH;
+    }
+
+    size_t max_batch = scheduler->config.max_batch;
+    scheduler->sessions = agent_mem_calloc(DEFAULT_SESSION_CAPACITY, sizeof(agent_session_t));
+    scheduler->batch = agent_mem_calloc(max_batch, sizeof(agent_sequence_t));
+    scheduler->tokens = agent_mem_calloc(max_batch, sizeof(agent_decoded_token_t));
+    if (!scheduler->sessions || !scheduler->batch || !scheduler->tokens) {
+        agent_scheduler_free(scheduler);
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    scheduler->session_capacity = DEFAULT_SESSION_CAPACITY;
+
+    return AGENT_OK;
+}
+
+void agent_scheduler_free(agent_scheduler_t* scheduler) {
+    if (!scheduler) return;
+
+    agent_mem_free(scheduler->sessions);
+    agent_mem_free(scheduler->batch);
+    agent_mem_free(scheduler->tokens);
+    memset(scheduler, 0, sizeof(agent_scheduler_t));
+}
+
+agent_error_t agent_scheduler_add(agent_scheduler_t* scheduler, agent_state_t* state,
+                                  size_t* out_session) {
+    if (!scheduler || !state) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (scheduler->session_count >= scheduler->session_capacity) {
+        size_t new_capacity = scheduler->session_capacity * 2;
+        agent_session_t* sessions = agent_mem_realloc(scheduler->sessions,
+                                                      new_capacity * sizeof(agent_session_t));
+        if (!sessions) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+        scheduler->sessions = sessions;
+        scheduler->session_capacity = new_capacity;
+    }
+
+    size_t index = scheduler->session_count++;
+    scheduler->sessions[index].state = state;
+    scheduler->sessions[index].decoding = false;
+    if (out_session) {
+        *out_session = index;
+    }
+    return AGENT_OK;
+}
+
+static void end_sequence(agent_scheduler_t* scheduler, size_t index) {
+    agent_session_t* session = &scheduler->sessions[index];
+    if (!session->decoding) {
+        return;
+    }
+    session->decoding = false;
+    if (scheduler->config.end_sequence) {
+        scheduler->config.end_sequence(index, scheduler->config.user_data);
+    }
+}
+
+void agent_scheduler_remove(agent_scheduler_t* scheduler, size_t session) {
+    if (!scheduler || session >= scheduler->session_count) return;
+
+    end_sequence(scheduler, session);
+    scheduler->sessions[session].state = NULL;
+}
+
+size_t agent_scheduler_step(agent_scheduler_t* scheduler) {
+    if (!scheduler || scheduler->session_count == 0) {
+        return 0;
+    }
+
+    /* Gather generating sessions, starting after the last one served */
+    size_t session_count = scheduler->session_count;
+    size_t count = 0;
+    size_t last = scheduler->next;
+    for (size_t k = 0; k < session_count && count < scheduler->config.max_batch; k++) {
+        size_t index = (scheduler->next + k) % session_count;
+        agent_session_t* session = &scheduler->sessions[index];
+        if (!session->state) {
+            continue;
+        }
+
+        agent_run_request_t request;
+        if (agent_run_poll(session->state, &request) != AGENT_RUN_NEEDS_GENERATION) {
+            /* Stopped or reset since the last step */
+            end_sequence(scheduler, index);
+            continue;
+        }
+
+        agent_sequence_t* sequence = &scheduler->batch[count++];
+        sequence->session = index;
+        sequence->prefill = !session->decoding;
+        sequence->messages = request.messages;
+        sequence->message_count = request.message_count;
+        sequence->system_prompt = request.system_prompt;
+        sequence->generation = request.generation;
+        sequence->route = request.route;
+        session->decoding = true;
+        last = index;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    scheduler->next = (last + 1) % session_count;
+
+    memset(scheduler->tokens, 0, count * sizeof(agent_decoded_token_t));
+    scheduler->config.decode(scheduler->batch, count, scheduler->tokens, scheduler->config.user_data);
+
+    /* Hand each token to its session; finished generations move the run on */
+    for (size_t i = 0; i < count; i++) {
+        size_t index = scheduler->batch[i].session;
+        agent_state_t* state = scheduler->sessions[index].state;
+        const agent_decoded_token_t* token = &scheduler->tokens[i];
+
+        agent_llm_result_t result = {token->error, {NULL, 0}};
+        bool more = token->error == AGENT_OK;
+        if (more && token->length > 0) {
+            more = agent_run_feed_token(state, token->text, token->length);
+        }
+        if (!more || token->finished) {
+            end_sequence(scheduler, index);
+            agent_run_submit_generation(state, &result);
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,231 @@
+/**
+ * @file agent_simd.h
+ * @brief Byte-scanning kernels shared by the string, JSON and parser modules
+ *
+ * Internal header. The instruction set is chosen at compile time: NEON,
+ * SSE2 (with SSSE3 shuffles when enabled), or plain C. Block functions
+ * look at AGENT_SIMD_BLOCK bytes and return a lane mask with
+ * AGENT_SIMD_LANE_BITS bits per byte; walk it with agent_simd_first_lane()
+ * and agent_simd_clear_lane(). Scanning functions return an offset, or len
+ * when nothing stops the scan.
+ */
+
+#ifndef AGENT_SIMD_H
+#define AGENT_SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AGENT_SIMD_NEON 1
+#if defined(__aarch64__)
+#define AGENT_SIMD_NEON64 1   /* Table lookups and across-vector adds */
+#endif
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AGENT_SIMD_SSE2 1
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define AGENT_SIMD_SSSE3 1    /* Byte shuffle */
+#endif
+#endif
+
+#define AGENT_SIMD_BLOCK 16
+
+#if defined(AGENT_SIMD_NEON)
+#define AGENT_SIMD_LANE_BITS 4
+#define AGENT_SIMD_LANE_MASK 0xFull
+#else
+#define AGENT_SIMD_LANE_BITS 1
+#define AGENT_SIMD_LANE_MASK 0x1ull
+#endif
+
+/* Lane masks */
+
+static inline size_t agent_simd_first_lane(uint64_t bits) {
+    return (size_t)__builtin_ctzll(bits) / AGENT_SIMD_LANE_BITS;
+}
+
+static inline uint64_t agent_simd_clear_lane(uint64_t bits) {
+    return bits & ~(AGENT_SIMD_LANE_MASK << __builtin_ctzll(bits));
+}
+
+#if defined(AGENT_SIMD_NEON)
+
+static inline uint64_t agent_simd_bits(uint8x16_t mask) {
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(mask), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+
+#define SIMD_LOAD(s) vld1q_u8((const uint8_t*)(s))
+#define SIMD_EQ(v, c) vceqq_u8((v), vdupq_n_u8((uint8_t)(c)))
+#define SIMD_OR(a, b) vorrq_u8((a), (b))
+#define SIMD_AND(a, b) vandq_u8((a), (b))
+#define SIMD_LT(v, c) vcltq_u8((v), vdupq_n_u8((uint8_t)(c)))
+#define SIMD_BITS(m) agent_simd_bits(m)
+typedef uint8x16_t agent_simd_vec_t;
+
+#elif defined(AGENT_SIMD_SSE2)
+
+#define SIMD_LOAD(s) _mm_loadu_si128((const __m128i*)(const void*)(s))
+#define SIMD_EQ(v, c) _mm_cmpeq_epi8((v), _mm_set1_epi8((char)(c)))
+#define SIMD_OR(a, b) _mm_or_si128((a), (b))
+#define SIMD_AND(a, b) _mm_and_si128((a), (b))
+/* Unsigned v < c: flipping the top bit maps unsigned order onto signed */
+#define SIMD_LT(v, c) _mm_cmpgt_epi8(_mm_set1_epi8((char)((c) ^ 0x80)), \
+                                     _mm_xor_si128((v), _mm_set1_epi8((char)0x80)))
+#define SIMD_BITS(m) ((uint64_t)(unsigned)_mm_movemask_epi8(m))
+typedef __m128i agent_simd_vec_t;
+
+#endif
+
+/* Block masks (need AGENT_SIMD_BLOCK readable bytes) */
+
+#if defined(AGENT_SIMD_NEON) || defined(AGENT_SIMD_SSE2)
+
+/* Bytes equal to c */
+static inline uint64_t agent_simd_eq_bits(const char* s, char c) {
+    return SIMD_BITS(SIMD_EQ(SIMD_LOAD(s), c));
+}
+
+/* JSON structure: { } [ ] " and backslash */
+static inline uint64_t agent_simd_structural_bits(const char* s) {
+    agent_simd_vec_t v = SIMD_LOAD(s);
+    agent_simd_vec_t m = SIMD_OR(SIMD_OR(SIMD_EQ(v, '{'), SIMD_EQ(v, '}')),
+                                 SIMD_OR(SIMD_EQ(v, '['), SIMD_EQ(v, ']')));
+    return SIMD_BITS(SIMD_OR(m, SIMD_OR(SIMD_EQ(v, '"'), SIMD_EQ(v, '\\'))));
+}
+
+#endif
+
+/* Scanning kernels */
+
+static inline bool agent_simd_is_json_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* Offset of the first byte equal to a or b (a byte set of two) */
+static inline size_t agent_simd_find_either(const char* s, size_t len, char a, char b) {
+    size_t i = 0;
+#if defined(AGENT_SIMD_NEON) || defined(AGENT_SIMD_SSE2)
+    for (; i + AGENT_SIMD_BLOCK <= len; i += AGENT_SIMD_BLOCK) {
+        agent_simd_vec_t v = SIMD_LOAD(s + i);
+        uint64_t bits = SIMD_BITS(SIMD_OR(SIMD_EQ(v, a), SIMD_EQ(v, b)));
+        if (bits) {
+            return i + agent_simd_first_lane(bits);
+        }
+    }
+#endif
+    while (i < len && s[i] != a && s[i] != b) {
+        i++;
+    }
+    return i;
+}
+
+/* Offset of the first byte that is not JSON whitespace */
+static inline size_t agent_simd_skip_space(const char* s, size_t len) {
+    size_t i = 0;
+#if defined(AGENT_SIMD_NEON) || defined(AGENT_SIMD_SSE2)
+    for (; i + AGENT_SIMD_BLOCK <= len; i += AGENT_SIMD_BLOCK) {
+        agent_simd_vec_t v = SIMD_LOAD(s + i);
+        agent_simd_vec_t space = SIMD_OR(SIMD_OR(SIMD_EQ(v, ' '), SIMD_EQ(v, '\t')),
+                                         SIMD_OR(SIMD_EQ(v, '\n'), SIMD_EQ(v, '\r')));
+        uint64_t bits = ~SIMD_BITS(space) & (AGENT_SIMD_LANE_BITS == 4 ? ~0ull : 0xFFFFull);
+        if (bits) {
+            return i + agent_simd_first_lane(bits);
+        }
+    }
+#endif
+    while (i < len && agent_simd_is_json_space(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+/* Offset of the first byte a JSON string must escape: " \ or below 0x20 */
+static inline size_t agent_simd_find_escape(const char* s, size_t len) {
+    size_t i = 0;
+#if defined(AGENT_SIMD_NEON) || defined(AGENT_SIMD_SSE2)
+    for (; i + AGENT_SIMD_BLOCK <= len; i += AGENT_SIMD_BLOCK) {
+        agent_simd_vec_t v = SIMD_LOAD(s + i);
+        uint64_t bits = SIMD_BITS(SIMD_OR(SIMD_LT(v, 0x20),
+                                          SIMD_OR(SIMD_EQ(v, '"'), SIMD_EQ(v, '\\'))));
+        if (bits) {
+            return i + agent_simd_first_lane(bits);
+        }
+    }
+#endif
+    while (i < len && (unsigned char)s[i] >= 0x20 && s[i] != '"' && s[i] != '\\') {
+        i++;
+    }
+    return i;
+}
+
+/* Number of bytes that are not UTF-8 continuation bytes (10xxxxxx) */
+static inline size_t agent_simd_count_char_starts(const char* s, size_t len) {
+    const uint8_t* p = (const uint8_t*)s;
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(AGENT_SIMD_NEON64)
+    while (i + 16 <= len) {
+        /* Byte lanes count up to 255 blocks before they are summed */
+        uint8x16_t acc = vdupq_n_u8(0);
+        for (size_t blocks = 0; i + 16 <= len && blocks < 255; i += 16, blocks++) {
+            int8x16_t chunk = vreinterpretq_s8_u8(vld1q_u8(p + i));
+            acc = vsubq_u8(acc, vcgtq_s8(chunk, vdupq_n_s8((int8_t)0xBF)));
+        }
+        count += vaddlvq_u8(acc);
+    }
+#elif defined(AGENT_SIMD_SSE2)
+    while (i + 16 <= len) {
+        __m128i acc = _mm_setzero_si128();
+        for (size_t blocks = 0; i + 16 <= len && blocks < 255; i += 16, blocks++) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)(p + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(chunk, _mm_set1_epi8((char)0xBF)));
+        }
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_extract_epi16(sums, 4);
+    }
+#endif
+
+    for (; i < len; i++) {
+        count += (p[i] & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+/* Offset of the first byte >= 0x80 */
+static inline size_t agent_simd_skip_ascii(const char* s, size_t len) {
+    size_t i = 0;
+#if defined(AGENT_SIMD_NEON64)
+    for (; i + AGENT_SIMD_BLOCK <= len; i += AGENT_SIMD_BLOCK) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)s + i);
+        if (vmaxvq_u8(v) >= 0x80) {
+            break;
+        }
+    }
+#elif defined(AGENT_SIMD_SSE2)
+    for (; i + AGENT_SIMD_BLOCK <= len; i += AGENT_SIMD_BLOCK) {
+        unsigned bits = (unsigned)_mm_movemask_epi8(SIMD_LOAD(s + i));
+        if (bits) {
+            return i + (size_t)__builtin_ctz(bits);
+        }
+    }
+#endif
+    while (i < len && (unsigned char)s[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+#undef SIMD_LOAD
+#undef SIMD_EQ
+#undef SIMD_OR
+#undef SIMD_AND
+#undef SIMD_LT
+#undef SIMD_BITS
+
+#endif /* AGENT_SIMD_H */
@@ -0,0 +1,363 @@
+/**
+ * @file agent_snapshot.c
+ * @brief Conversation snapshot implementation
+ */
+
+#include "agent_snapshot.h"
+#include "agent_alloc.h"
+#include "agent_string.h"
+#include <string.h>
+
+#define DEFAULT_MESSAGE_CAPACITY 32
+
+static const char SNAPSHOT_MAGIC[4] = {'C', 'A', 'G', 'S'};
+
+/* Offset from the start of the snapshot; {0, 0} stands for a NULL view */
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} snapshot_span_t;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t message_count;
+    uint64_t tool_call_count;
+    uint64_t tool_result_count;
+    agent_uuid_t conversation_id;
+} snapshot_header_t;
+
+typedef struct {
+    agent_uuid_t id;
+    uint32_t role;
+    uint32_t image_dims;           /* Decoded pixels: width << 16 | height; 0 = encoded */
+    int64_t timestamp_ms;
+    snapshot_span_t content;
+    snapshot_span_t thinking;
+    snapshot_span_t image;
+    uint64_t first_tool_call;
+    uint64_t tool_call_count;
+    uint64_t first_tool_result;
+    uint64_t tool_result_count;
+} snapshot_message_t;
+
+typedef struct {
+    agent_uuid_t id;
+    snapshot_span_t name;
+    snapshot_span_t arguments;     /* Compact JSON */
+} snapshot_tool_call_t;
+
+typedef struct {
+    agent_uuid_t id;
+    agent_uuid_t tool_call_id;
+    snapshot_span_t content;
+    uint32_t is_error;
+    uint32_t reserved;
+} snapshot_tool_result_t;
+
+/* Save */
+
+typedef struct {
+    agent_string_t* out;
+    size_t base;                   /* Where the snapshot starts in out */
+} snapshot_writer_t;
+
+/* Append bytes plus a NUL so loaded views can be used as C strings */
+static agent_error_t write_bytes(snapshot_writer_t* writer, const void* data, size_t length,
+                                 snapshot_span_t* span) {
+    span->offset = 0;
+    span->length = 0;
+    if (!data) {
+        return AGENT_OK;
+    }
+
+    span->offset = writer->out->length - writer->base;
+    span->length = length;
+    agent_error_t err = agent_string_append_n(writer->out, data, length);
+    return err == AGENT_OK ? agent_string_append_char(writer->out, '\0') : err;
+}
+
+static agent_error_t write_json(snapshot_writer_t* writer, const agent_json_value_t* value,
+                                snapshot_span_t* span) {
+    span->offset = 0;
+    span->length = 0;
+    if (!value) {
+        return AGENT_OK;
+    }
+
+    size_t start = writer->out->length;
+    agent_error_t err = agent_json_serialize(value, writer->out, false);
+    if (err != AGENT_OK) return err;
+    span->offset = start - writer->base;
+    span->length = writer->out->length - start;
+    return agent_string_append_char(writer->out, '\0');
+}
+
+agent_error_t agent_state_save(const agent_state_t* state, agent_string_t* out) {
+    if (!state || !out) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    const agent_message_array_t* messages = &state->messages;
+    snapshot_header_t header = {0};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = AGENT_SNAPSHOT_VERSION;
+    header.message_count = messages->count;
+    header.conversation_id = state->conversation_id;
+    for (size_t i = 0; i < messages->count; i++) {
+        header.tool_call_count += messages->messages[i].tool_calls_count;
+        header.tool_result_count += messages->messages[i].tool_results_count;
+    }
+
+    /* Records are filled in while the strings are appended, then copied in */
+    size_t records_size = sizeof(snapshot_header_t) +
+                          header.message_count * sizeof(snapshot_message_t) +
+                          header.tool_call_count * sizeof(snapshot_tool_call_t) +
+                          header.tool_result_count * sizeof(snapshot_tool_result_t);
+    uint8_t* records = agent_mem_calloc(1, records_size);
+    if (!records) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    snapshot_message_t* message_records = (snapshot_message_t*)(records + sizeof(snapshot_header_t));
+    snapshot_tool_call_t* call_records = (snapshot_tool_call_t*)(message_records + header.message_count);
+    snapshot_tool_result_t* result_records = (snapshot_tool_result_t*)(call_records + header.tool_call_count);
+    memcpy(records, &header, sizeof(header));
+
+    snapshot_writer_t writer = {out, out->length};
+    agent_error_t err = agent_string_append_n(out, (const char*)records, records_size);
+
+    size_t call_index = 0;
+    size_t result_index = 0;
+    for (size_t i = 0; err == AGENT_OK && i < messages->count; i++) {
+        const agent_message_t* msg = &messages->messages[i];
+        snapshot_message_t* record = &message_records[i];
+        record->id = msg->id;
+        record->role = (uint32_t)msg->role;
+        record->image_dims = msg->image_width << 16 | msg->image_height;
+        record->timestamp_ms = msg->timestamp_ms;
+        record->first_tool_call = call_index;
+        record->tool_call_count = msg->tool_calls_count;
+        record->first_tool_result = result_index;
+        record->tool_result_count = msg->tool_results_count;
+
+        err = write_bytes(&writer, msg->content.data, msg->content.length, &record->content);
+        if (err == AGENT_OK) {
+            err = write_bytes(&writer, msg->thinking_content.data, msg->thinking_content.length,
+                              &record->thinking);
+        }
+        if (err == AGENT_OK) {
+            err = write_bytes(&writer, msg->image_data, msg->image_data_size, &record->image);
+        }
+
+        for (size_t c = 0; err == AGENT_OK && c < msg->tool_calls_count; c++) {
+            const agent_tool_call_t* call = &msg->tool_calls[c];
+            snapshot_tool_call_t* call_record = &call_records[call_index++];
+            call_record->id = call->id;
+            err = write_bytes(&writer, call->name.data, call->name.length, &call_record->name);
+            if (err == AGENT_OK) {
+                err = write_json(&writer, call->arguments, &call_record->arguments);
+            }
+        }
+
+        for (size_t r = 0; err == AGENT_OK && r < msg->tool_results_count; r++) {
+            const agent_tool_result_t* result = &msg->tool_results[r];
+            snapshot_tool_result_t* result_record = &result_records[result_index++];
+            result_record->id = result->id;
+            result_record->tool_call_id = result->tool_call_id;
+            result_record->is_error = result->is_error ? 1 : 0;
+            err = write_bytes(&writer, result->content.data, result->content.length,
+                              &result_record->content);
+        }
+    }
+
+    if (err == AGENT_OK) {
+        memcpy(out->data + writer.base, records, records_size);
+    } else {
+        out->length = writer.base;
+        out->data[out->length] = '\0';
+    }
+    agent_mem_free(records);
+    return err;
+}
+
+/* Load */
+
+typedef struct {
+    const uint8_t* data;
+    size_t length;
+    size_t strings_start;
+} snapshot_reader_t;
+
+static bool span_valid(const snapshot_reader_t* reader, snapshot_span_t span) {
+    if (span.offset == 0 && span.length == 0) {
+        return true;
+    }
+    return span.offset >= reader->strings_start && span.offset < reader->length &&
+           span.length < reader->length - span.offset &&
+           reader->data[span.offset + span.length] == '\0';
+}
+
+static agent_string_view_t span_view(const snapshot_reader_t* reader, snapshot_span_t span) {
+    agent_string_view_t view = {NULL, 0};
+    if (span.offset != 0 || span.length != 0) {
+        view.data = (const char*)reader->data + span.offset;
+        view.length = (size_t)span.length;
+    }
+    return view;
+}
+
+static bool range_valid(uint64_t first, uint64_t count, uint64_t total) {
+    return first <= total && count <= total - first;
+}
+
+/* Records may sit at any alignment in a mapped file, so they are copied out */
+static void read_record(const snapshot_reader_t* reader, size_t offset, void* record, size_t size) {
+    memcpy(record, reader->data + offset, size);
+}
+
+agent_error_t agent_state_load(agent_state_t* state, const void* data, size_t length) {
+    if (!state || !data || state->is_processing) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    snapshot_reader_t reader = {data, length, 0};
+    snapshot_header_t header;
+    if (length < sizeof(header)) {
+        return AGENT_ERROR_PARSE_ERROR;
+    }
+    read_record(&reader, 0, &header, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header.version != AGENT_SNAPSHOT_VERSION) {
+        return AGENT_ERROR_PARSE_ERROR;
+    }
+
+    /* Each count is bounded by what the file could hold, so the sums cannot overflow */
+    size_t available = length - sizeof(header);
+    if (header.message_count > available / sizeof(snapshot_message_t) ||
+        header.tool_call_count > available / sizeof(snapshot_tool_call_t) ||
+        header.tool_result_count > available / sizeof(snapshot_tool_result_t)) {
+        return AGENT_ERROR_PARSE_ERROR;
+    }
+    size_t messages_at = sizeof(header);
+    size_t calls_at = messages_at + header.message_count * sizeof(snapshot_message_t);
+    size_t results_at = calls_at + header.tool_call_count * sizeof(snapshot_tool_call_t);
+    reader.strings_start = results_at + header.tool_result_count * sizeof(snapshot_tool_result_t);
+    if (reader.strings_start > length) {
+        return AGENT_ERROR_PARSE_ERROR;
+    }
+
+    /* Check everything before the current conversation is dropped */
+    for (size_t i = 0; i < header.message_count; i++) {
+        snapshot_message_t record;
+        read_record(&reader, messages_at + i * sizeof(record), &record, sizeof(record));
+        if (record.role > AGENT_ROLE_TOOL ||
+            !span_valid(&reader, record.content) || !span_valid(&reader, record.thinking) ||
+            !span_valid(&reader, record.image) ||
+            (record.image_dims != 0 &&
+             record.image.length != (uint64_t)(record.image_dims >> 16) * (record.image_dims & 0xFFFF) * 3) ||
+            !range_valid(record.first_tool_call, record.tool_call_count, header.tool_call_count) ||
+            !range_valid(record.first_tool_result, record.tool_result_count, header.tool_result_count)) {
+            return AGENT_ERROR_PARSE_ERROR;
+        }
+    }
+    size_t sp = agent_context_savepoint(state->iteration_ctx);
+    for (size_t i = 0; i < header.tool_call_count; i++) {
+        snapshot_tool_call_t record;
+        read_record(&reader, calls_at + i * sizeof(record), &record, sizeof(record));
+        if (!span_valid(&reader, record.name) || !span_valid(&reader, record.arguments) ||
+            record.name.length == 0) {
+            return AGENT_ERROR_PARSE_ERROR;
+        }
+        agent_string_view_t json = span_view(&reader, record.arguments);
+        if (json.data) {
+            agent_json_parse_result_t parsed = agent_json_parse(state->iteration_ctx, json.data, json.length);
+            agent_context_restore(state->iteration_ctx, sp);
+            if (parsed.error != AGENT_OK) {
+                return AGENT_ERROR_PARSE_ERROR;
+            }
+        }
+    }
+    for (size_t i = 0; i < header.tool_result_count; i++) {
+        snapshot_tool_result_t record;
+        read_record(&reader, results_at + i * sizeof(record), &record, sizeof(record));
+        if (!span_valid(&reader, record.content)) {
+            return AGENT_ERROR_PARSE_ERROR;
+        }
+    }
+
+    agent_reset(state);
+    agent_context_t* ctx = state->ctx;
+
+    size_t capacity = (size_t)header.message_count + DEFAULT_MESSAGE_CAPACITY;
+    /* Same layout as the orchestrator's message arrays: roles after the messages */
+    agent_message_t* messages = agent_context_calloc(ctx, capacity, sizeof(agent_message_t) + 1);
+    uint8_t* roles = messages ? (uint8_t*)(messages + capacity) : NULL;
+    agent_tool_call_t* calls = NULL;
+    agent_tool_result_t* results = NULL;
+    if (header.tool_call_count > 0) {
+        calls = agent_context_calloc(ctx, (size_t)header.tool_call_count, sizeof(agent_tool_call_t));
+    }
+    if (header.tool_result_count > 0) {
+        results = agent_context_calloc(ctx, (size_t)header.tool_result_count, sizeof(agent_tool_result_t));
+    }
+    if (!messages || !roles || (header.tool_call_count > 0 && !calls) ||
+        (header.tool_result_count > 0 && !results)) {
+        agent_reset(state);
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < header.tool_call_count; i++) {
+        snapshot_tool_call_t record;
+        read_record(&reader, calls_at + i * sizeof(record), &record, sizeof(record));
+        calls[i].id = record.id;
+        calls[i].name = span_view(&reader, record.name);
+        agent_string_view_t json = span_view(&reader, record.arguments);
+        if (json.data) {
+            calls[i].arguments = agent_json_parse(ctx, json.data, json.length).value;
+            if (!calls[i].arguments) {
+                agent_reset(state);
+                return AGENT_ERROR_OUT_OF_MEMORY;
+            }
+        }
+    }
+    for (size_t i = 0; i < header.tool_result_count; i++) {
+        snapshot_tool_result_t record;
+        read_record(&reader, results_at + i * sizeof(record), &record, sizeof(record));
+        results[i].id = record.id;
+        results[i].tool_call_id = record.tool_call_id;
+        results[i].content = span_view(&reader, record.content);
+        results[i].is_error = record.is_error != 0;
+    }
+    for (size_t i = 0; i < header.message_count; i++) {
+        snapshot_message_t record;
+        read_record(&reader, messages_at + i * sizeof(record), &record, sizeof(record));
+        agent_message_t* msg = &messages[i];
+        msg->id = record.id;
+        msg->role = (agent_role_t)record.role;
+        roles[i] = (uint8_t)record.role;
+        msg->timestamp_ms = record.timestamp_ms;
+        msg->content = span_view(&reader, record.content);
+        msg->thinking_content = span_view(&reader, record.thinking);
+        agent_string_view_t image = span_view(&reader, record.image);
+        msg->image_data = (const uint8_t*)image.data;
+        msg->image_data_size = image.length;
+        msg->image_width = record.image_dims >> 16;
+        msg->image_height = record.image_dims & 0xFFFF;
+        if (record.tool_call_count > 0) {
+            msg->tool_calls = calls + record.first_tool_call;
+            msg->tool_calls_count = (size_t)record.tool_call_count;
+        }
+        if (record.tool_result_count > 0) {
+            msg->tool_results = results + record.first_tool_result;
+            msg->tool_results_count = (size_t)record.tool_result_count;
+        }
+    }
+
+    state->messages.messages = messages;
+    state->messages.roles = roles;
+    state->messages.count = (size_t)header.message_count;
+    state->messages.capacity = capacity;
+    state->working_history = state->messages;
+    state->conversation_id = header.conversation_id;
+    return AGENT_OK;
+}
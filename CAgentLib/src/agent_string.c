@@ -4,11 +4,15 @@
  */
 
 #include "agent_string.h"
+#include "agent_context.h"
+#include "agent_alloc.h"
+#include "agent_simd.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <time.h>
 
 #if defined(__APPLE__)
 #include <CommonCrypto/CommonRandom.h>
@@ -16,6 +20,12 @@
 #include <sys/random.h>
 #endif
 
+/* Lookup-table UTF-8 validation needs a byte shuffle (tbl / pshufb);
+   plain SSE2 only skips ASCII */
+#if defined(AGENT_SIMD_NEON64) || defined(AGENT_SIMD_SSSE3)
+#define UTF8_SIMD_TABLES 1
+#endif
+
 #define DEFAULT_STRING_CAPACITY 64
 
 /* String view operations */
@@ -89,6 +99,150 @@ bool agent_sv_ends_with(agent_string_view_t sv, agent_string_view_t suffix) {
     return memcmp(sv.data + sv.length - suffix.length, suffix.data, suffix.length) == 0;
 }
 
+/*
+ * Substring search. Needles up to SEARCH_SHORT_NEEDLE bytes are found by
+ * filtering candidates on their first and last byte (16 positions at a
+ * time where SIMD is available) and verifying with memcmp, which costs at
+ * most O(n * SEARCH_SHORT_NEEDLE). Longer needles use Two-Way
+ * (Crochemore-Perrin), linear in the haystack whatever its contents.
+ */
+#define SEARCH_SHORT_NEEDLE 32
+
+/* Candidate scan from position i on, one byte at a time */
+static ptrdiff_t find_short_scalar(const char* h, size_t hlen, const char* n, size_t nlen, size_t i) {
+    const char* end = h + hlen - nlen + 1;
+    const char* p = h + i;
+    while (p < end) {
+        p = memchr(p, n[0], (size_t)(end - p));
+        if (!p) {
+            return -1;
+        }
+        if (p[nlen - 1] == n[nlen - 1] && memcmp(p + 1, n + 1, nlen - 2) == 0) {
+            return p - h;
+        }
+        p++;
+    }
+    return -1;
+}
+
+/* nlen >= 2 and nlen <= hlen */
+static ptrdiff_t find_short(const char* h, size_t hlen, const char* n, size_t nlen) {
+    size_t i = 0;
+
+#if defined(AGENT_SIMD_NEON) || defined(AGENT_SIMD_SSE2)
+    for (; i + nlen - 1 + AGENT_SIMD_BLOCK <= hlen; i += AGENT_SIMD_BLOCK) {
+        uint64_t bits = agent_simd_eq_bits(h + i, n[0]) &
+                        agent_simd_eq_bits(h + i + nlen - 1, n[nlen - 1]);
+        while (bits) {
+            size_t lane = agent_simd_first_lane(bits);
+            if (memcmp(h + i + lane + 1, n + 1, nlen - 2) == 0) {
+                return (ptrdiff_t)(i + lane);
+            }
+            bits = agent_simd_clear_lane(bits);
+        }
+    }
+#endif
+
+    return find_short_scalar(h, hlen, n, nlen, i);
+}
+
+/* Maximal suffix of n under < (reverse = false) or > (reverse = true).
+   Returns its start - 1 (SIZE_MAX for the whole needle) and its period. */
+static size_t maximal_suffix(const uint8_t* n, size_t nlen, bool reverse, size_t* out_period) {
+    size_t ip = SIZE_MAX;  /* Candidate suffix start - 1 */
+    size_t jp = 0;
+    size_t k = 1;
+    size_t p = 1;
+    while (jp + k < nlen) {
+        uint8_t a = n[ip + k];
+        uint8_t b = n[jp + k];
+        if (a == b) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (reverse ? a < b : a > b) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    *out_period = p;
+    return ip;
+}
+
+static ptrdiff_t find_two_way(const char* haystack, size_t hlen, const char* needle, size_t nlen) {
+    const uint8_t* h = (const uint8_t*)haystack;
+    const uint8_t* n = (const uint8_t*)needle;
+
+    /* Critical factorization: the later of the two maximal suffixes */
+    size_t period;
+    size_t period_reverse;
+    size_t ms = maximal_suffix(n, nlen, false, &period);
+    size_t ms_reverse = maximal_suffix(n, nlen, true, &period_reverse);
+    if (ms_reverse + 1 > ms + 1) {
+        ms = ms_reverse;
+        period = period_reverse;
+    }
+
+    /* Bad-character shift on the window's last byte */
+    size_t shift[256];
+    for (size_t i = 0; i < 256; i++) {
+        shift[i] = nlen;
+    }
+    for (size_t i = 0; i < nlen; i++) {
+        shift[n[i]] = nlen - 1 - i;
+    }
+
+    /* A periodic needle remembers how much of the window already matched */
+    size_t memory_after_shift;
+    if (memcmp(n, n + period, ms + 1) == 0) {
+        memory_after_shift = nlen - period;
+    } else {
+        memory_after_shift = 0;
+        period = (ms > nlen - ms - 1 ? ms : nlen - ms - 1) + 1;
+    }
+
+    size_t memory = 0;
+    size_t pos = 0;
+    while (pos <= hlen - nlen) {
+        const uint8_t* w = h + pos;
+
+        size_t skip = shift[w[nlen - 1]];
+        if (skip > 0) {
+            pos += skip > memory ? skip : memory;
+            memory = 0;
+            continue;
+        }
+
+        /* Right half, then left half */
+        size_t k = ms + 1 > memory ? ms + 1 : memory;
+        while (k < nlen && n[k] == w[k]) {
+            k++;
+        }
+        if (k < nlen) {
+            pos += k - ms;
+            memory = 0;
+            continue;
+        }
+        k = ms + 1;
+        while (k > memory && n[k - 1] == w[k - 1]) {
+            k--;
+        }
+        if (k <= memory) {
+            return (ptrdiff_t)pos;
+        }
+        pos += period;
+        memory = memory_after_shift;
+    }
+    return -1;
+}
+
 ptrdiff_t agent_sv_find(agent_string_view_t sv, agent_string_view_t needle) {
     if (needle.length == 0) {
         return 0;
@@ -97,13 +251,13 @@ ptrdiff_t agent_sv_find(agent_string_view_t sv, agent_string_view_t needle) {
         return -1;
     }
 
-    const char* end = sv.data + sv.length - needle.length + 1;
-    for (const char* p = sv.data; p < end; p++) {
-        if (memcmp(p, needle.data, needle.length) == 0) {
-            return p - sv.data;
-        }
+    if (needle.length == 1) {
+        return agent_sv_find_char(sv, needle.data[0]);
     }
-    return -1;
+    if (needle.length <= SEARCH_SHORT_NEEDLE) {
+        return find_short(sv.data, sv.length, needle.data, needle.length);
+    }
+    return find_two_way(sv.data, sv.length, needle.data, needle.length);
 }
 
 ptrdiff_t agent_sv_find_cstr(agent_string_view_t sv, const char* needle) {
@@ -113,13 +267,42 @@ ptrdiff_t agent_sv_find_cstr(agent_string_view_t sv, const char* needle) {
     return agent_sv_find(sv, agent_sv_from_cstr(needle));
 }
 
-ptrdiff_t agent_sv_find_char(agent_string_view_t sv, char c) {
-    for (size_t i = 0; i < sv.length; i++) {
-        if (sv.data[i] == c) {
-            return (ptrdiff_t)i;
+ptrdiff_t agent_sv_find_any(agent_string_view_t sv, const agent_string_view_t* needles,
+                            size_t count, size_t* out_index) {
+    ptrdiff_t best = -1;
+    if (!needles) {
+        return -1;
+    }
+
+    /* Each needle only searches up to where it could still beat the best
+       match so far, so the whole search stays O(count * sv.length) */
+    for (size_t i = 0; i < count; i++) {
+        agent_string_view_t window = sv;
+        if (best >= 0) {
+            size_t limit = (size_t)best + needles[i].length;
+            if (limit == 0 || best == 0) {
+                break;
+            }
+            window.length = limit - 1 < sv.length ? limit - 1 : sv.length;
+        }
+
+        ptrdiff_t pos = agent_sv_find(window, needles[i]);
+        if (pos >= 0 && (best < 0 || pos < best)) {
+            best = pos;
+            if (out_index) {
+                *out_index = i;
+            }
         }
     }
-    return -1;
+    return best;
+}
+
+ptrdiff_t agent_sv_find_char(agent_string_view_t sv, char c) {
+    if (sv.length == 0) {
+        return -1;
+    }
+    const char* p = memchr(sv.data, c, sv.length);
+    return p ? p - sv.data : -1;
 }
 
 agent_string_view_t agent_sv_substr(agent_string_view_t sv, size_t start, size_t length) {
@@ -160,6 +343,244 @@ agent_string_view_t agent_sv_trim_end(agent_string_view_t sv) {
 
 /* UTF-8 operations */
 
+/* Length of the valid sequence at p, or 0 if it is malformed or cut short */
+static size_t utf8_sequence_length(const uint8_t* p, const uint8_t* end) {
+    uint8_t byte = *p;
+
+    if (byte < 0x80) {
+        /* ASCII */
+        return 1;
+    } else if ((byte & 0xE0) == 0xC0) {
+        /* 2-byte sequence */
+        if (p + 1 >= end) return 0;
+        if ((p[1] & 0xC0) != 0x80) return 0;
+        /* Check for overlong encoding */
+        if (byte < 0xC2) return 0;
+        return 2;
+    } else if ((byte & 0xF0) == 0xE0) {
+        /* 3-byte sequence */
+        if (p + 2 >= end) return 0;
+        if ((p[1] & 0xC0) != 0x80) return 0;
+        if ((p[2] & 0xC0) != 0x80) return 0;
+        /* Check for overlong encoding and surrogates */
+        uint32_t cp = ((byte & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+        if (cp < 0x800) return 0;
+        if (cp >= 0xD800 && cp <= 0xDFFF) return 0;
+        return 3;
+    } else if ((byte & 0xF8) == 0xF0) {
+        /* 4-byte sequence */
+        if (p + 3 >= end) return 0;
+        if ((p[1] & 0xC0) != 0x80) return 0;
+        if ((p[2] & 0xC0) != 0x80) return 0;
+        if ((p[3] & 0xC0) != 0x80) return 0;
+        /* Check for overlong encoding and valid range */
+        uint32_t cp = ((byte & 0x07) << 18) | ((p[1] & 0x3F) << 12) |
+                      ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+        if (cp < 0x10000 || cp > 0x10FFFF) return 0;
+        return 4;
+    }
+
+    /* Invalid byte */
+    return 0;
+}
+
+static bool utf8_validate_scalar(const uint8_t* p, const uint8_t* end) {
+    while (p < end) {
+        size_t len = utf8_sequence_length(p, end);
+        if (len == 0) return false;
+        p += len;
+    }
+    return true;
+}
+
+#if defined(UTF8_SIMD_TABLES)
+
+/*
+ * Lookup-table validation (Keiser & Lemire, "Validating UTF-8 In Less Than
+ * One Instruction Per Byte"): each byte is classified by the high nibble
+ * of its predecessor, the low nibble of its predecessor and its own high
+ * nibble; the three table entries share an error bit only for an invalid
+ * pair. Three- and four-byte sequences additionally need continuations two
+ * and three bytes after their lead.
+ */
+
+#define UTF8_TOO_SHORT   (1 << 0)   /* Lead or ASCII after a lead */
+#define UTF8_TOO_LONG    (1 << 1)   /* Continuation after ASCII */
+#define UTF8_OVERLONG_3  (1 << 2)
+#define UTF8_TOO_LARGE   (1 << 3)
+#define UTF8_SURROGATE   (1 << 4)
+#define UTF8_OVERLONG_2  (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4  (1 << 6)
+#define UTF8_TWO_CONTS   (1 << 7)   /* Continuation after continuation */
+#define UTF8_CARRY       (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+static const uint8_t UTF8_BYTE_1_HIGH[16] = {
+    /* 0_______: ASCII */
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    /* 10______: continuation */
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    /* 1100____, 1101____: two-byte lead */
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    /* 1110____: three-byte lead */
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    /* 1111____: four-byte lead */
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+};
+
+static const uint8_t UTF8_BYTE_1_LOW[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,   /* ____0000 */
+    UTF8_CARRY | UTF8_OVERLONG_2,                                       /* ____0001 */
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,                                        /* ____0100 */
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE, /* ____1101 */
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+};
+
+static const uint8_t UTF8_BYTE_2_HIGH[16] = {
+    /* ________ 0_______: ASCII */
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    /* ________ 1000____ */
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    /* ________ 1001____ */
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    /* ________ 101_____ */
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    /* ________ 11______: lead */
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+};
+
+/* A lead this close to the end of a block continues into the next one */
+static const uint8_t UTF8_INCOMPLETE_MAX[16] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+#if defined(AGENT_SIMD_NEON64)
+
+typedef uint8x16_t utf8_vec_t;
+
+#define utf8_load(p)          vld1q_u8(p)
+#define utf8_splat(b)         vdupq_n_u8(b)
+#define utf8_or(a, b)         vorrq_u8(a, b)
+#define utf8_and(a, b)        vandq_u8(a, b)
+#define utf8_xor(a, b)        veorq_u8(a, b)
+#define utf8_subs(a, b)       vqsubq_u8(a, b)
+#define utf8_high_nibble(v)   vshrq_n_u8(v, 4)
+#define utf8_lookup(t, i)     vqtbl1q_u8(t, i)
+#define utf8_prev(v, prev, n) vextq_u8(prev, v, 16 - (n))   /* Bytes shifted in from prev */
+
+static inline bool utf8_any(utf8_vec_t v) { return vmaxvq_u8(v) != 0; }
+static inline bool utf8_is_ascii(utf8_vec_t v) { return vmaxvq_u8(v) < 0x80; }
+
+#else
+
+typedef __m128i utf8_vec_t;
+
+#define utf8_load(p)          _mm_loadu_si128((const __m128i*)(p))
+#define utf8_splat(b)         _mm_set1_epi8((char)(b))
+#define utf8_or(a, b)         _mm_or_si128(a, b)
+#define utf8_and(a, b)        _mm_and_si128(a, b)
+#define utf8_xor(a, b)        _mm_xor_si128(a, b)
+#define utf8_subs(a, b)       _mm_subs_epu8(a, b)
+#define utf8_high_nibble(v)   _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F))
+#define utf8_lookup(t, i)     _mm_shuffle_epi8(t, i)
+#define utf8_prev(v, prev, n) _mm_alignr_epi8(v, prev, 16 - (n))
+
+static inline bool utf8_any(utf8_vec_t v) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF;
+}
+static inline bool utf8_is_ascii(utf8_vec_t v) { return _mm_movemask_epi8(v) == 0; }
+
+#endif
+
+/*
+ * Validate whole 16-byte blocks. Returns false on an error, otherwise the
+ * offset the scalar tail must resume from: the start of the character
+ * that the last block may have cut short.
+ */
+static bool utf8_validate_blocks(const uint8_t* p, size_t length, size_t* out_resume) {
+    const utf8_vec_t byte_1_high = utf8_load(UTF8_BYTE_1_HIGH);
+    const utf8_vec_t byte_1_low = utf8_load(UTF8_BYTE_1_LOW);
+    const utf8_vec_t byte_2_high = utf8_load(UTF8_BYTE_2_HIGH);
+    const utf8_vec_t incomplete_max = utf8_load(UTF8_INCOMPLETE_MAX);
+    const utf8_vec_t low_nibble = utf8_splat(0x0F);
+
+    utf8_vec_t prev = utf8_splat(0);
+    utf8_vec_t error = utf8_splat(0);
+    utf8_vec_t prev_incomplete = utf8_splat(0);
+    size_t i = 0;
+
+    while (i + 16 <= length) {
+        /* ASCII fast path, 32 bytes at a time */
+        if (i + 32 <= length) {
+            utf8_vec_t a = utf8_load(p + i);
+            utf8_vec_t b = utf8_load(p + i + 16);
+            if (utf8_is_ascii(utf8_or(a, b))) {
+                error = utf8_or(error, prev_incomplete);
+                prev_incomplete = utf8_splat(0);
+                prev = b;
+                i += 32;
+                continue;
+            }
+        }
+
+        utf8_vec_t input = utf8_load(p + i);
+        if (utf8_is_ascii(input)) {
+            error = utf8_or(error, prev_incomplete);
+            prev_incomplete = utf8_splat(0);
+        } else {
+            utf8_vec_t prev1 = utf8_prev(input, prev, 1);
+            utf8_vec_t special = utf8_and(
+                utf8_and(utf8_lookup(byte_1_high, utf8_high_nibble(prev1)),
+                         utf8_lookup(byte_1_low, utf8_and(prev1, low_nibble))),
+                utf8_lookup(byte_2_high, utf8_high_nibble(input)));
+
+            /* Bytes two after a 111_____ or three after a 1111____ lead */
+            utf8_vec_t third = utf8_subs(utf8_prev(input, prev, 2), utf8_splat(0xE0 - 0x80));
+            utf8_vec_t fourth = utf8_subs(utf8_prev(input, prev, 3), utf8_splat(0xF0 - 0x80));
+            utf8_vec_t must_continue = utf8_and(utf8_or(third, fourth), utf8_splat(0x80));
+
+            error = utf8_or(error, utf8_xor(must_continue, special));
+            prev_incomplete = utf8_subs(input, incomplete_max);
+        }
+        prev = input;
+        i += 16;
+    }
+
+    if (utf8_any(error)) {
+        return false;
+    }
+
+    /* Recheck a trailing lead whose sequence may run past the blocks */
+    size_t resume = i;
+    size_t k = i;
+    while (k > 0 && i - k < 3 && (p[k - 1] & 0xC0) == 0x80) {
+        k--;
+    }
+    if (k > 0 && p[k - 1] >= 0xC0) {
+        resume = k - 1;
+    }
+    *out_resume = resume;
+    return true;
+}
+
+#endif
+
 bool agent_utf8_validate(const char* data, size_t length) {
     if (!data) {
         return length == 0;
@@ -168,47 +589,26 @@ bool agent_utf8_validate(const char* data, size_t length) {
     const uint8_t* p = (const uint8_t*)data;
     const uint8_t* end = p + length;
 
+#if defined(UTF8_SIMD_TABLES)
+    size_t resume;
+    if (!utf8_validate_blocks(p, length, &resume)) {
+        return false;
+    }
+    p += resume;
+#elif defined(AGENT_SIMD_SSE2) || defined(AGENT_SIMD_NEON)
+    /* Skip runs of ASCII, decode the rest */
     while (p < end) {
-        uint8_t byte = *p;
-
-        if (byte < 0x80) {
-            /* ASCII */
-            p++;
-        } else if ((byte & 0xE0) == 0xC0) {
-            /* 2-byte sequence */
-            if (p + 1 >= end) return false;
-            if ((p[1] & 0xC0) != 0x80) return false;
-            /* Check for overlong encoding */
-            if (byte < 0xC2) return false;
-            p += 2;
-        } else if ((byte & 0xF0) == 0xE0) {
-            /* 3-byte sequence */
-            if (p + 2 >= end) return false;
-            if ((p[1] & 0xC0) != 0x80) return false;
-            if ((p[2] & 0xC0) != 0x80) return false;
-            /* Check for overlong encoding and surrogates */
-            uint32_t cp = ((byte & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
-            if (cp < 0x800) return false;
-            if (cp >= 0xD800 && cp <= 0xDFFF) return false;
-            p += 3;
-        } else if ((byte & 0xF8) == 0xF0) {
-            /* 4-byte sequence */
-            if (p + 3 >= end) return false;
-            if ((p[1] & 0xC0) != 0x80) return false;
-            if ((p[2] & 0xC0) != 0x80) return false;
-            if ((p[3] & 0xC0) != 0x80) return false;
-            /* Check for overlong encoding and valid range */
-            uint32_t cp = ((byte & 0x07) << 18) | ((p[1] & 0x3F) << 12) |
-                          ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
-            if (cp < 0x10000 || cp > 0x10FFFF) return false;
-            p += 4;
-        } else {
-            /* Invalid byte */
-            return false;
+        if (*p < 0x80) {
+            p += agent_simd_skip_ascii((const char*)p, (size_t)(end - p));
+            continue;
         }
+        size_t len = utf8_sequence_length(p, end);
+        if (len == 0) return false;
+        p += len;
     }
+#endif
 
-    return true;
+    return utf8_validate_scalar(p, end);
 }
 
 size_t agent_utf8_char_length(uint8_t first_byte) {
@@ -229,20 +629,8 @@ size_t agent_utf8_char_count(const char* data, size_t length) {
         return 0;
     }
 
-    size_t count = 0;
-    const uint8_t* p = (const uint8_t*)data;
-    const uint8_t* end = p + length;
-
-    while (p < end) {
-        size_t char_len = agent_utf8_char_length(*p);
-        if (char_len == 0 || p + char_len > end) {
-            break;
-        }
-        count++;
-        p += char_len;
-    }
-
-    return count;
+    /* A character cut short at the end is not counted */
+    return agent_simd_count_char_starts(data, agent_utf8_complete_boundary(data, length));
 }
 
 size_t agent_utf8_char_start(const char* data, size_t length, size_t pos) {
@@ -301,27 +689,19 @@ size_t agent_utf8_complete_boundary(const char* data, size_t length) {
         return 0;
     }
 
+    /* Only the last character can be cut short: find its lead byte */
     const uint8_t* p = (const uint8_t*)data;
-    size_t pos = 0;
-
-    while (pos < length) {
-        size_t char_len = agent_utf8_char_length(p[pos]);
-
-        if (char_len == 0) {
-            /* Invalid byte - include it */
-            pos++;
-            continue;
-        }
-
-        if (pos + char_len > length) {
-            /* Incomplete character at end */
-            break;
-        }
-
-        pos += char_len;
+    size_t start = length - 1;
+    size_t limit = length > 4 ? length - 4 : 0;
+    while (start > limit && (p[start] & 0xC0) == 0x80) {
+        start--;
     }
 
-    return pos;
+    size_t char_len = agent_utf8_char_length(p[start]);
+    if (char_len > 1 && start + char_len > length) {
+        return start;
+    }
+    return length;
 }
 
 /* Mutable string operations */
@@ -331,8 +711,33 @@ agent_error_t agent_string_init(agent_string_t* str, size_t initial_capacity) {
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
 
+    /* Small strings need no allocation until they grow */
+    size_t capacity = initial_capacity;
+    if (capacity <= AGENT_STRING_INLINE_CAPACITY) {
+        str->data = str->inline_data;
+        capacity = AGENT_STRING_INLINE_CAPACITY;
+    } else {
+        str->data = (char*)agent_mem_alloc(capacity);
+        if (!str->data) {
+            return AGENT_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    str->data[0] = '\0';
+    str->length = 0;
+    str->capacity = capacity;
+    str->ctx = NULL;
+    return AGENT_OK;
+}
+
+agent_error_t agent_string_init_arena(agent_string_t* str, agent_context_t* ctx,
+                                      size_t initial_capacity) {
+    if (!str || !ctx) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
     size_t capacity = initial_capacity > 0 ? initial_capacity : DEFAULT_STRING_CAPACITY;
-    str->data = (char*)malloc(capacity);
+    str->data = (char*)agent_context_alloc(ctx, capacity);
     if (!str->data) {
         return AGENT_ERROR_OUT_OF_MEMORY;
     }
@@ -340,12 +745,16 @@ agent_error_t agent_string_init(agent_string_t* str, size_t initial_capacity) {
     str->data[0] = '\0';
     str->length = 0;
     str->capacity = capacity;
+    str->ctx = ctx;
     return AGENT_OK;
 }
 
 void agent_string_free(agent_string_t* str) {
     if (str && str->data) {
-        free(str->data);
+        /* Arena buffers are released when the arena resets */
+        if (!str->ctx && str->data != str->inline_data) {
+            agent_mem_free(str->data);
+        }
         str->data = NULL;
         str->length = 0;
         str->capacity = 0;
@@ -374,7 +783,21 @@ agent_error_t agent_string_reserve(agent_string_t* str, size_t capacity) {
         new_capacity = capacity;
     }
 
-    char* new_data = (char*)realloc(str->data, new_capacity);
+    char* new_data;
+    if (str->ctx) {
+        new_data = (char*)agent_context_realloc(str->ctx, str->data, str->capacity, new_capacity);
+    } else if (str->data == str->inline_data) {
+        /* Spill the inline buffer */
+        if (new_capacity < DEFAULT_STRING_CAPACITY) {
+            new_capacity = DEFAULT_STRING_CAPACITY;
+        }
+        new_data = (char*)agent_mem_alloc(new_capacity);
+        if (new_data) {
+            memcpy(new_data, str->data, str->length + 1);
+        }
+    } else {
+        new_data = (char*)agent_mem_realloc(str->data, new_capacity);
+    }
     if (!new_data) {
         return AGENT_ERROR_OUT_OF_MEMORY;
     }
@@ -430,32 +853,124 @@ agent_error_t agent_string_append_fmt(agent_string_t* str, const char* fmt, ...)
     va_start(args, fmt);
     va_copy(args_copy, args);
 
-    /* First, determine the required size */
-    int needed = vsnprintf(NULL, 0, fmt, args);
+    /* Format straight into the spare capacity; only a miss formats twice */
+    size_t spare = str->capacity - str->length;
+    int needed = vsnprintf(str->data + str->length, spare, fmt, args);
     va_end(args);
 
     if (needed < 0) {
         va_end(args_copy);
+        str->data[str->length] = '\0';
         return AGENT_ERROR_INVALID_ARGUMENT;
     }
 
-    size_t required = str->length + (size_t)needed + 1;
-    if (required > str->capacity) {
-        agent_error_t err = agent_string_reserve(str, required);
+    if ((size_t)needed >= spare) {
+        agent_error_t err = agent_string_reserve(str, str->length + (size_t)needed + 1);
         if (err != AGENT_OK) {
             va_end(args_copy);
+            str->data[str->length] = '\0';
             return err;
         }
+        vsnprintf(str->data + str->length, (size_t)needed + 1, fmt, args_copy);
     }
-
-    /* Now format into the buffer */
-    vsnprintf(str->data + str->length, (size_t)needed + 1, fmt, args_copy);
     va_end(args_copy);
 
     str->length += (size_t)needed;
     return AGENT_OK;
 }
 
+agent_error_t agent_string_append_u64(agent_string_t* str, uint64_t value) {
+    char buf[20];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    do {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    return agent_string_append_n(str, p, (size_t)(end - p));
+}
+
+agent_error_t agent_string_append_i64(agent_string_t* str, int64_t value) {
+    if (value >= 0) {
+        return agent_string_append_u64(str, (uint64_t)value);
+    }
+
+    /* Work on the magnitude as unsigned so INT64_MIN does not overflow */
+    agent_error_t err = agent_string_append_char(str, '-');
+    if (err != AGENT_OK) {
+        return err;
+    }
+    return agent_string_append_u64(str, 0 - (uint64_t)value);
+}
+
+agent_error_t agent_string_append_hex(agent_string_t* str, uint64_t value, size_t min_digits) {
+    static const char hex[] = "0123456789abcdef";
+    char buf[16];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    if (min_digits > sizeof(buf)) {
+        min_digits = sizeof(buf);
+    }
+    do {
+        *--p = hex[value & 0xF];
+        value >>= 4;
+    } while (value > 0);
+    while ((size_t)(end - p) < min_digits) {
+        *--p = '0';
+    }
+    return agent_string_append_n(str, p, (size_t)(end - p));
+}
+
+/* Escape character for each byte: 0 = copy as-is, 'u' = \u00XX */
+static const char json_escape_table[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+agent_error_t agent_string_append_sv_escaped(agent_string_t* str, agent_string_view_t sv) {
+    if (!str || !str->data) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    agent_error_t err;
+    size_t run_start = 0;
+    for (size_t i = 0; i < sv.length; i++) {
+        i += agent_simd_find_escape(sv.data + i, sv.length - i);
+        if (i == sv.length) break;
+        char escape = json_escape_table[(unsigned char)sv.data[i]];
+
+        /* Flush the run of safe bytes before this one */
+        if (i > run_start) {
+            err = agent_string_append_n(str, sv.data + run_start, i - run_start);
+            if (err != AGENT_OK) return err;
+        }
+        run_start = i + 1;
+
+        char seq[6] = {'\\', escape};
+        size_t seq_len = 2;
+        if (escape == 'u') {
+            static const char hex[] = "0123456789abcdef";
+            unsigned char c = (unsigned char)sv.data[i];
+            seq[2] = '0';
+            seq[3] = '0';
+            seq[4] = hex[c >> 4];
+            seq[5] = hex[c & 0xF];
+            seq_len = 6;
+        }
+        err = agent_string_append_n(str, seq, seq_len);
+        if (err != AGENT_OK) return err;
+    }
+
+    if (sv.length > run_start) {
+        return agent_string_append_n(str, sv.data + run_start, sv.length - run_start);
+    }
+    return AGENT_OK;
+}
+
 agent_string_view_t agent_string_view(const agent_string_t* str) {
     agent_string_view_t sv = {NULL, 0};
     if (str && str->data) {
@@ -472,21 +987,261 @@ const char* agent_string_cstr(const agent_string_t* str) {
     return "";
 }
 
+/* Templates */
+
+static agent_error_t template_push(agent_template_t* tpl, const char* data, size_t length) {
+    if (tpl->part_count >= AGENT_TEMPLATE_MAX_PARTS) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+    tpl->parts[tpl->part_count].data = data;
+    tpl->parts[tpl->part_count].length = length;
+    tpl->part_count++;
+    return AGENT_OK;
+}
+
+agent_error_t agent_template_compile(agent_template_t* tpl, const char* text) {
+    if (!tpl || !text) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    tpl->part_count = 0;
+    tpl->slot_count = 0;
+    const char* literal = text;
+    for (const char* p = text; *p; p++) {
+        if (*p != '%') continue;
+
+        if (p[1] == 's') {
+            if ((p > literal && template_push(tpl, literal, (size_t)(p - literal)) != AGENT_OK) ||
+                template_push(tpl, NULL, 0) != AGENT_OK) {
+                return AGENT_ERROR_INVALID_ARGUMENT;
+            }
+            tpl->slot_count++;
+        } else if (p[1] == '%') {
+            /* Keep the first '%' with the literal before it */
+            if (template_push(tpl, literal, (size_t)(p - literal) + 1) != AGENT_OK) {
+                return AGENT_ERROR_INVALID_ARGUMENT;
+            }
+        } else {
+            return AGENT_ERROR_INVALID_ARGUMENT;
+        }
+        p++;
+        literal = p + 1;
+    }
+
+    size_t tail = strlen(literal);
+    if (tail > 0) {
+        return template_push(tpl, literal, tail);
+    }
+    return AGENT_OK;
+}
+
+agent_error_t agent_string_append_template(agent_string_t* str, const agent_template_t* tpl,
+                                           const agent_string_view_t* values, size_t count) {
+    if (!str || !tpl || count != tpl->slot_count || (count > 0 && !values)) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    /* Size it once */
+    size_t total = 0;
+    size_t slot = 0;
+    for (size_t i = 0; i < tpl->part_count; i++) {
+        total += tpl->parts[i].data ? tpl->parts[i].length : values[slot++].length;
+    }
+    agent_error_t err = agent_string_reserve(str, str->length + total + 1);
+    if (err != AGENT_OK) {
+        return err;
+    }
+
+    slot = 0;
+    for (size_t i = 0; i < tpl->part_count; i++) {
+        err = agent_string_append_sv(str, tpl->parts[i].data ? tpl->parts[i] : values[slot++]);
+        if (err != AGENT_OK) {
+            return err;
+        }
+    }
+    return AGENT_OK;
+}
+
+/* Rope operations */
+
+agent_error_t agent_rope_init(agent_rope_t* rope, agent_context_t* ctx, size_t chunk_size) {
+    if (!rope) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    rope->head = NULL;
+    rope->tail = NULL;
+    rope->length = 0;
+    rope->chunk_size = chunk_size > 0 ? chunk_size : AGENT_ROPE_CHUNK_SIZE;
+    rope->ctx = ctx;
+    return AGENT_OK;
+}
+
+void agent_rope_free(agent_rope_t* rope) {
+    if (!rope) return;
+
+    if (!rope->ctx) {
+        agent_rope_chunk_t* chunk = rope->head;
+        while (chunk) {
+            agent_rope_chunk_t* next = chunk->next;
+            agent_mem_free(chunk);
+            chunk = next;
+        }
+    }
+    rope->head = NULL;
+    rope->tail = NULL;
+    rope->length = 0;
+}
+
+void agent_rope_clear(agent_rope_t* rope) {
+    if (!rope) return;
+
+    for (agent_rope_chunk_t* chunk = rope->head; chunk; chunk = chunk->next) {
+        chunk->length = 0;
+    }
+    rope->tail = rope->head;
+    rope->length = 0;
+}
+
+/* Chunk after the tail: a kept one, or a new one */
+static agent_rope_chunk_t* rope_next_chunk(agent_rope_t* rope) {
+    if (rope->tail && rope->tail->next) {
+        return rope->tail->next;
+    }
+
+    size_t size = sizeof(agent_rope_chunk_t) + rope->chunk_size;
+    agent_rope_chunk_t* chunk = rope->ctx ? agent_context_alloc(rope->ctx, size) : agent_mem_alloc(size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->data = (char*)(chunk + 1);
+    chunk->length = 0;
+
+    if (rope->tail) {
+        rope->tail->next = chunk;
+    } else {
+        rope->head = chunk;
+    }
+    return chunk;
+}
+
+agent_error_t agent_rope_append(agent_rope_t* rope, const char* data, size_t length) {
+    if (!rope) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    while (length > 0) {
+        if (!rope->tail || rope->tail->length == rope->chunk_size) {
+            agent_rope_chunk_t* chunk = rope_next_chunk(rope);
+            if (!chunk) {
+                return AGENT_ERROR_OUT_OF_MEMORY;
+            }
+            rope->tail = chunk;
+        }
+
+        agent_rope_chunk_t* tail = rope->tail;
+        size_t n = rope->chunk_size - tail->length;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(tail->data + tail->length, data, n);
+        tail->length += n;
+        rope->length += n;
+        data += n;
+        length -= n;
+    }
+    return AGENT_OK;
+}
+
+agent_rope_iter_t agent_rope_iter(const agent_rope_t* rope) {
+    agent_rope_iter_t iter = {rope ? rope->head : NULL};
+    return iter;
+}
+
+bool agent_rope_iter_next(agent_rope_iter_t* iter, agent_string_view_t* out_chunk) {
+    if (!iter || !out_chunk) {
+        return false;
+    }
+
+    /* Chunks kept past the tail by agent_rope_clear are empty */
+    while (iter->chunk && iter->chunk->length == 0) {
+        iter->chunk = iter->chunk->next;
+    }
+    if (!iter->chunk) {
+        return false;
+    }
+    out_chunk->data = iter->chunk->data;
+    out_chunk->length = iter->chunk->length;
+    iter->chunk = iter->chunk->next;
+    return true;
+}
+
+agent_error_t agent_rope_flatten(const agent_rope_t* rope, agent_string_t* out) {
+    if (!rope || !out || !out->data) {
+        return AGENT_ERROR_INVALID_ARGUMENT;
+    }
+
+    agent_error_t err = agent_string_reserve(out, out->length + rope->length + 1);
+    if (err != AGENT_OK) {
+        return err;
+    }
+
+    agent_rope_iter_t iter = agent_rope_iter(rope);
+    agent_string_view_t chunk;
+    while (agent_rope_iter_next(&iter, &chunk)) {
+        agent_string_append_sv(out, chunk);
+    }
+    return AGENT_OK;
+}
+
 /* UUID operations */
 
-agent_uuid_t agent_uuid_generate(void) {
-    agent_uuid_t uuid;
+/* Random bytes fetched from the system in bulk, one pool per thread.
+   A forked child inherits its parent's unused bytes: forking processes
+   should not generate ids before exec. */
+#define UUID_POOL_SIZE 256
 
+typedef struct {
+    uint8_t bytes[UUID_POOL_SIZE];
+    size_t pos;
+} uuid_pool_t;
+
+static _Thread_local uuid_pool_t uuid_pool = {{0}, UUID_POOL_SIZE};
+
+static void uuid_pool_refill(uuid_pool_t* pool) {
 #if defined(__APPLE__)
-    CCRandomGenerateBytes(uuid.bytes, 16);
+    CCRandomGenerateBytes(pool->bytes, UUID_POOL_SIZE);
 #elif defined(__linux__)
-    getrandom(uuid.bytes, 16, 0);
+    size_t filled = 0;
+    while (filled < UUID_POOL_SIZE) {
+        ssize_t n = getrandom(pool->bytes + filled, UUID_POOL_SIZE - filled, 0);
+        if (n <= 0) break;
+        filled += (size_t)n;
+    }
 #else
     /* Fallback - not cryptographically secure */
-    for (int i = 0; i < 16; i++) {
-        uuid.bytes[i] = (uint8_t)(rand() & 0xFF);
+    for (int i = 0; i < UUID_POOL_SIZE; i++) {
+        pool->bytes[i] = (uint8_t)(rand() & 0xFF);
     }
 #endif
+    pool->pos = 0;
+}
+
+static void uuid_random_bytes(uint8_t* out, size_t count) {
+    uuid_pool_t* pool = &uuid_pool;
+    if (pool->pos + count > UUID_POOL_SIZE) {
+        uuid_pool_refill(pool);
+    }
+    memcpy(out, pool->bytes + pool->pos, count);
+    /* Don't leave handed-out bytes lying around */
+    memset(pool->bytes + pool->pos, 0, count);
+    pool->pos += count;
+}
+
+agent_uuid_t agent_uuid_generate(void) {
+    agent_uuid_t uuid;
+    uuid_random_bytes(uuid.bytes, 16);
 
     /* Set version (4) and variant (RFC 4122) bits */
     uuid.bytes[6] = (uuid.bytes[6] & 0x0F) | 0x40;  /* Version 4 */
@@ -495,6 +1250,39 @@ agent_uuid_t agent_uuid_generate(void) {
     return uuid;
 }
 
+/* Last timestamp and sequence handed out on this thread, for ordering */
+static _Thread_local uint64_t uuid_v7_last_ms;
+static _Thread_local uint16_t uuid_v7_seq;
+
+agent_uuid_t agent_uuid_generate_ordered(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ms = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+
+    agent_uuid_t uuid;
+    uuid_random_bytes(uuid.bytes + 6, 10);
+
+    /* 12-bit sequence in rand_a: random start each millisecond, then
+       counting up; running out borrows the next millisecond */
+    if (ms > uuid_v7_last_ms) {
+        uuid_v7_last_ms = ms;
+        uuid_v7_seq = (uint16_t)(((uuid.bytes[6] << 8) | uuid.bytes[7]) & 0x7FF);
+    } else if (++uuid_v7_seq > 0xFFF) {
+        uuid_v7_last_ms++;
+        uuid_v7_seq = 0;
+    }
+    ms = uuid_v7_last_ms;
+
+    for (int i = 0; i < 6; i++) {
+        uuid.bytes[i] = (uint8_t)(ms >> (40 - 8 * i));
+    }
+    uuid.bytes[6] = (uint8_t)(0x70 | (uuid_v7_seq >> 8));  /* Version 7 */
+    uuid.bytes[7] = (uint8_t)uuid_v7_seq;
+    uuid.bytes[8] = (uuid.bytes[8] & 0x3F) | 0x80;         /* Variant */
+
+    return uuid;
+}
+
 static int hex_to_int(char c) {
     if (c >= '0' && c <= '9') return c - '0';
     if (c >= 'a' && c <= 'f') return c - 'a' + 10;
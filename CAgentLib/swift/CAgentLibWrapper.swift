@@ -6,6 +6,7 @@
  */
 
 import Foundation
+import ImageIO
 
 // MARK: - Error Types
 
@@ -67,9 +68,19 @@ public enum AgentError: Error, LocalizedError {
 // MARK: - String View Extension
 
 extension agent_string_view_t {
+    /// The viewed bytes, valid as long as the storage they point into
+    var bytes: UnsafeBufferPointer<UInt8> {
+        guard let data = self.data, self.length > 0 else {
+            return UnsafeBufferPointer(start: nil, count: 0)
+        }
+        return UnsafeBufferPointer(start: UnsafeRawPointer(data).assumingMemoryBound(to: UInt8.self),
+                                   count: self.length)
+    }
+
+    /// Views need not be NUL-terminated, so decode exactly length bytes
     var string: String? {
-        guard let data = self.data, self.length > 0 else { return nil }
-        return String(cString: data)
+        guard self.data != nil, self.length > 0 else { return nil }
+        return String(decoding: bytes, as: UTF8.self)
     }
 
     var stringValue: String {
@@ -151,6 +162,12 @@ public class CJSONValue {
         return CJSONValue(value)
     }
 
+    subscript(path: CJSONPath) -> CJSONValue? {
+        return withUnsafePointer(to: &path.path) { compiled in
+            agent_json_path_eval(compiled, ptr).map { CJSONValue($0) }
+        }
+    }
+
     /// Convert to Swift Any type
     func toAny() -> Any {
         switch type {
@@ -186,6 +203,76 @@ public class CJSONValue {
     }
 }
 
+// MARK: - Compiled JSON Path
+
+/// Path such as "arguments.options[0].limit", compiled once for repeated lookups
+public final class CJSONPath {
+    var path = agent_json_path_t()
+    private let context: CAgentContext
+
+    public init(_ expression: String, using context: CAgentContext) throws {
+        self.context = context
+        let err = agent_json_path_compile(context.ctx, expression, &path)
+        guard err == AGENT_OK else {
+            throw AgentError(from: err)
+        }
+    }
+}
+
+// MARK: - Flat Tool Arguments
+
+/// A tool call's arguments in schema order (flat_tool_arguments): index i is the
+/// tool's i-th parameter, read straight from the C slots without converting the JSON.
+/// Valid until the tool request is answered.
+public struct CToolArguments {
+    let slots: UnsafeBufferPointer<agent_tool_arg_t>
+
+    init?(_ args: agent_tool_args_t) {
+        guard let tool = args.tool, args.args != nil || tool.pointee.parameters_count == 0 else {
+            return nil
+        }
+        slots = UnsafeBufferPointer(start: args.args, count: args.count)
+    }
+
+    public var count: Int { slots.count }
+
+    /// False for parameters the model left out or set to null
+    public func isPresent(_ index: Int) -> Bool {
+        return index >= 0 && index < slots.count && slots[index].present
+    }
+
+    public func bool(_ index: Int) -> Bool? {
+        guard isPresent(index), slots[index].type == AGENT_SCHEMA_BOOLEAN else { return nil }
+        return slots[index].data.bool_value
+    }
+
+    public func int(_ index: Int) -> Int64? {
+        guard isPresent(index), slots[index].type == AGENT_SCHEMA_INTEGER else { return nil }
+        return slots[index].data.int_value
+    }
+
+    public func number(_ index: Int) -> Double? {
+        guard isPresent(index), slots[index].type == AGENT_SCHEMA_NUMBER else { return nil }
+        return slots[index].data.number_value
+    }
+
+    /// UTF-8 bytes of a string argument, pointing into the parsed JSON
+    public func stringBytes(_ index: Int) -> UnsafeBufferPointer<UInt8>? {
+        guard isPresent(index), slots[index].type == AGENT_SCHEMA_STRING else { return nil }
+        return slots[index].data.string_value.bytes
+    }
+
+    public func string(_ index: Int) -> String? {
+        return stringBytes(index).map { String(decoding: $0, as: UTF8.self) }
+    }
+
+    /// Array and object arguments (or any present one) as JSON
+    public func json(_ index: Int) -> CJSONValue? {
+        guard isPresent(index), let value = slots[index].value else { return nil }
+        return CJSONValue(UnsafeMutablePointer(mutating: value))
+    }
+}
+
 // MARK: - Agent Context Wrapper
 
 public class CAgentContext {
@@ -198,6 +285,14 @@ public class CAgentContext {
         self.ctx = context
     }
 
+    /// Create a context backed by one reserved virtual memory range
+    public init(reservedSize: Int) throws {
+        guard let context = agent_context_create_reserved(reservedSize) else {
+            throw AgentError.outOfMemory
+        }
+        self.ctx = context
+    }
+
     deinit {
         agent_context_destroy(ctx)
     }
@@ -206,6 +301,14 @@ public class CAgentContext {
         agent_context_reset(ctx)
     }
 
+    public func savepoint() -> Int {
+        return agent_context_savepoint(ctx)
+    }
+
+    public func restore(to savepoint: Int) {
+        agent_context_restore(ctx, savepoint)
+    }
+
     public var used: Int {
         return agent_context_used(ctx)
     }
@@ -213,6 +316,26 @@ public class CAgentContext {
     public var capacity: Int {
         return agent_context_capacity(ctx)
     }
+
+    public var retained: Int {
+        return agent_context_retained(ctx)
+    }
+
+    public func setRetainLimit(_ maxBytes: Int) {
+        agent_context_set_retain_limit(ctx, maxBytes)
+    }
+
+    public var stats: agent_context_stats_t {
+        return agent_context_stats(ctx)
+    }
+}
+
+extension agent_context_stats_t {
+    /// Allocation counts per size bucket (16, 64, 256, ... bytes, then larger)
+    public var histogramBuckets: [Int] {
+        var histogram = self.histogram
+        return withUnsafeBytes(of: &histogram) { Array($0.bindMemory(to: Int.self)) }
+    }
 }
 
 // MARK: - Agent State Wrapper
@@ -228,21 +351,27 @@ public class CAgentState {
     private var toolCallNotifyCallback: ((String) -> Void)?
     private var stepChangeCallback: ((agent_step_t, String?) -> Void)?
     private var toolsSchemaCallback: (() -> String)?
+    private var countTokensCallback: ((String) -> Int)?
 
     // User data for callbacks
     private var userData: UnsafeMutableRawPointer?
 
+    // Pixels of the latest image_preprocess call; the library copies them
+    // before agent_add_user_message_with_image returns
+    private var preprocessedPixels: UnsafeMutableBufferPointer<UInt8>?
+
     public init() {
         state = agent_state_t()
     }
 
     deinit {
         agent_free(&state)
+        preprocessedPixels?.deallocate()
     }
 
     /// Configure the agent with callbacks
     public func configure(
-        generate: @escaping ([Message], String?) -> AsyncStream<String>,
+        generate: @escaping (UnsafeBufferPointer<agent_message_t>, String?) -> AsyncStream<String>,
         executeTool: @escaping (String, [String: Any]) async -> (String, Bool),
         onToken: ((String) -> Bool)? = nil,
         onToolCall: ((String) -> Void)? = nil,
@@ -250,12 +379,23 @@ public class CAgentState {
         getToolsSchema: @escaping () -> String,
         maxIterations: Int = 10,
         useJapanese: Bool = true,
-        customSystemPrompt: String? = nil
+        customSystemPrompt: String? = nil,
+        memorySoftLimit: Int = 0,
+        memoryHardLimit: Int = 0,
+        earlyToolDispatch: Bool = false,
+        toolCallDialect: ToolCallDialect = .hermes,
+        contextTokenBudget: Int = 0,
+        countTokens: ((String) -> Int)? = nil,
+        toolRegistry: UnsafePointer<agent_tool_registry_t>? = nil,
+        flatToolArguments: Bool = false,
+        modelRouting: Bool = false,
+        imageInputSize: Int = 0
     ) throws {
         // Store Swift callbacks
         self.tokenCallback = onToken
         self.toolCallNotifyCallback = onToolCall
         self.toolsSchemaCallback = getToolsSchema
+        self.countTokensCallback = countTokens
 
         // Convert step callback
         if let stepChange = onStepChange {
@@ -281,6 +421,40 @@ public class CAgentState {
         var config = agent_config_t()
         config.max_iterations = Int32(maxIterations)
         config.use_japanese = useJapanese
+        config.memory_soft_limit = memorySoftLimit
+        config.memory_hard_limit = memoryHardLimit
+        config.early_tool_dispatch = earlyToolDispatch
+        config.dialect = toolCallDialect.cDialect
+        // The prompt budget applies only with the model's tokenizer to measure it
+        config.context_token_budget = contextTokenBudget
+        if countTokens != nil {
+            config.count_tokens = { text, length, userData in
+                guard let userData = userData else { return 0 }
+                let owner = Unmanaged<CAgentState>.fromOpaque(userData).takeUnretainedValue()
+                let bytes = UnsafeRawBufferPointer(start: text, count: length)
+                return max(0, owner.countTokensCallback?(String(decoding: bytes, as: UTF8.self)) ?? 0)
+            }
+        }
+        config.tool_registry = toolRegistry
+        config.flat_tool_arguments = flatToolArguments
+        if modelRouting {
+            // Step-driven runs only: .generate(useRouter:) says which model to run
+            config.route_generate = { _, _, _, _, _ in
+                var result = agent_llm_result_t()
+                result.error = AGENT_ERROR_CALLBACK_FAILED
+                return result
+            }
+        }
+
+        // Images are decoded once, at the vision model's input size, when
+        // their message is added (0 = the library's default of 448)
+        config.user_data = Unmanaged.passUnretained(self).toOpaque()
+        config.image_input_size = UInt32(imageInputSize)
+        config.image_preprocess = { data, size, maxSide, out, userData in
+            guard let data = data, let out = out, let userData = userData else { return false }
+            let owner = Unmanaged<CAgentState>.fromOpaque(userData).takeUnretainedValue()
+            return owner.decodeImage(UnsafeBufferPointer(start: data, count: size), maxSide: Int(maxSide), into: out)
+        }
 
         // For a real implementation, you would need to:
         // 1. Create C function pointer wrappers
@@ -318,6 +492,86 @@ public class CAgentState {
         }
     }
 
+    /// Decodes an image with ImageIO (orientation applied), downsampled so
+    /// neither side exceeds maxSide, into RGB8 pixels
+    private func decodeImage(_ data: UnsafeBufferPointer<UInt8>, maxSide: Int,
+                             into out: UnsafeMutablePointer<agent_image_t>) -> Bool {
+        let encoded = Data(bytesNoCopy: UnsafeMutableRawPointer(mutating: data.baseAddress!),
+                           count: data.count, deallocator: .none)
+        let options: [CFString: Any] = [
+            kCGImageSourceCreateThumbnailFromImageAlways: true,
+            kCGImageSourceCreateThumbnailWithTransform: true,
+            kCGImageSourceThumbnailMaxPixelSize: maxSide,
+            kCGImageSourceShouldCacheImmediately: true
+        ]
+        guard let source = CGImageSourceCreateWithData(encoded as CFData, nil),
+              let image = CGImageSourceCreateThumbnailAtIndex(source, 0, options as CFDictionary),
+              image.width <= maxSide, image.height <= maxSide else {
+            return false
+        }
+
+        // CoreGraphics draws 32-bit pixels; the alpha byte is dropped after
+        let width = image.width
+        let height = image.height
+        var rgbx = [UInt8](repeating: 0, count: width * height * 4)
+        let drawn = rgbx.withUnsafeMutableBytes { buffer -> Bool in
+            guard let context = CGContext(data: buffer.baseAddress, width: width, height: height,
+                                          bitsPerComponent: 8, bytesPerRow: width * 4,
+                                          space: CGColorSpaceCreateDeviceRGB(),
+                                          bitmapInfo: CGImageAlphaInfo.noneSkipLast.rawValue) else {
+                return false
+            }
+            context.draw(image, in: CGRect(x: 0, y: 0, width: width, height: height))
+            return true
+        }
+        guard drawn else { return false }
+
+        preprocessedPixels?.deallocate()
+        let pixels = UnsafeMutableBufferPointer<UInt8>.allocate(capacity: width * height * 3)
+        for i in 0..<(width * height) {
+            pixels[i * 3] = rgbx[i * 4]
+            pixels[i * 3 + 1] = rgbx[i * 4 + 1]
+            pixels[i * 3 + 2] = rgbx[i * 4 + 2]
+        }
+        preprocessedPixels = pixels
+
+        out.pointee.pixels = UnsafePointer(pixels.baseAddress)
+        out.pointee.width = UInt32(width)
+        out.pointee.height = UInt32(height)
+        return true
+    }
+
+    // MARK: Image embeddings
+
+    /// Keep the vision encoder's output for a message's image, so later
+    /// iterations and turns skip the encoder (tokens rows of embedding.count / tokens)
+    public func storeImageEmbedding(_ embedding: [Float], tokens: Int, for messageId: agent_uuid_t) throws {
+        guard tokens > 0, embedding.count % tokens == 0 else {
+            throw AgentError.invalidArgument
+        }
+        let result = embedding.withUnsafeBufferPointer { buffer in
+            agent_image_embedding_store(&state, messageId, buffer.baseAddress, tokens, embedding.count / tokens)
+        }
+        guard result == AGENT_OK else {
+            throw AgentError(from: result)
+        }
+    }
+
+    /// The stored embedding for a message's image, valid until the next
+    /// store or clearImageEmbeddings()
+    public func imageEmbedding(for messageId: agent_uuid_t) -> (values: UnsafeBufferPointer<Float>, tokens: Int)? {
+        var tokens = 0
+        var embd = 0
+        guard let values = agent_image_embedding_lookup(&state, messageId, &tokens, &embd) else {
+            return nil
+        }
+        return (UnsafeBufferPointer(start: values, count: tokens * embd), tokens)
+    }
+
+    public func clearImageEmbeddings() {
+        agent_image_cache_clear(&state)
+    }
+
     public func stop() {
         agent_stop(&state)
     }
@@ -337,82 +591,135 @@ public class CAgentState {
         default: return .none
         }
     }
-}
 
-// MARK: - Swift Types
+    // MARK: Step-driven runs
 
-public enum AgentStep {
-    case none
-    case thinking
-    case callingTool(String)
-    case waitingForResult
-    case generating
-}
+    /// What a step-driven run needs from the host next
+    public enum RunRequest {
+        case idle
+        /// The first stablePrefixCount messages were sent, unchanged, in the previous
+        /// generation for this conversation on the same model; their KV cache can be kept.
+        /// With modelRouting, useRouter picks the small tool-calling model over the main one
+        case generate(messages: UnsafeBufferPointer<agent_message_t>, systemPrompt: String?,
+                      stablePrefixCount: Int, useRouter: Bool)
+        /// flatArguments is set for registry tools when configured with flatToolArguments
+        case toolCalls([(index: Int, name: String, arguments: CJSONValue?, flatArguments: CToolArguments?)])
+        case done
+    }
 
-public struct Message {
-    public let id: UUID
-    public let role: MessageRole
-    public let content: String
-    public let timestamp: Date
-    public var toolCalls: [ToolCall]?
-    public var toolResults: [ToolResult]?
-    public var thinkingContent: String?
-    public var imageData: Data?
-
-    public init(
-        id: UUID = UUID(),
-        role: MessageRole,
-        content: String,
-        timestamp: Date = Date(),
-        toolCalls: [ToolCall]? = nil,
-        toolResults: [ToolResult]? = nil,
-        thinkingContent: String? = nil,
-        imageData: Data? = nil
-    ) {
-        self.id = id
-        self.role = role
-        self.content = content
-        self.timestamp = timestamp
-        self.toolCalls = toolCalls
-        self.toolResults = toolResults
-        self.thinkingContent = thinkingContent
-        self.imageData = imageData
+    /// Start a run without blocking; answer pollRun() until it reports .done
+    public func beginRun() throws {
+        let result = agent_run_begin(&state)
+        guard result == AGENT_OK else {
+            throw AgentError(from: result)
+        }
     }
-}
 
-public enum MessageRole {
-    case user
-    case assistant
-    case system
-    case tool
-}
+    public func pollRun() -> RunRequest {
+        var request = agent_run_request_t()
+        switch agent_run_poll(&state, &request) {
+        case AGENT_RUN_NEEDS_GENERATION:
+            let messages = UnsafeBufferPointer(start: request.messages, count: request.message_count)
+            return .generate(messages: messages,
+                             systemPrompt: request.system_prompt.map { String(cString: $0) },
+                             stablePrefixCount: request.generation.stable_prefix_count,
+                             useRouter: request.route)
+        case AGENT_RUN_NEEDS_TOOL_RESULTS:
+            let calls = UnsafeBufferPointer(start: request.tool_calls, count: request.tool_call_count)
+            let flat = request.tool_args.map { UnsafeBufferPointer(start: $0, count: request.tool_call_count) }
+            return .toolCalls(calls.enumerated().map { index, call in
+                (index, call.name.stringValue, call.arguments.map { CJSONValue(UnsafeMutablePointer(mutating: $0)) },
+                 flat.flatMap { CToolArguments($0[index]) })
+            })
+        case AGENT_RUN_DONE:
+            return .done
+        default:
+            return .idle
+        }
+    }
 
-public struct ToolCall {
-    public let id: UUID
-    public let name: String
-    public let arguments: [String: Any]
+    /// Returns false when generation should stop
+    public func feedToken(_ token: String) -> Bool {
+        return token.withCString { cstr in
+            agent_run_feed_token(&state, cstr, strlen(cstr))
+        }
+    }
 
-    public init(id: UUID = UUID(), name: String, arguments: [String: Any]) {
-        self.id = id
-        self.name = name
-        self.arguments = arguments
+    /// Finish the pending generation; pass the full text only if tokens were not fed
+    public func submitGeneration(text: String? = nil, error: agent_error_t = AGENT_OK) throws {
+        let result: agent_error_t = (text ?? "").withCString { cstr in
+            var generation = agent_llm_result_t()
+            generation.error = error
+            generation.text = agent_sv_from_parts(cstr, strlen(cstr))
+            return agent_run_submit_generation(&state, &generation)
+        }
+        guard result == AGENT_OK else {
+            throw AgentError(from: result)
+        }
+    }
+
+    public func submitToolResult(index: Int, content: String, isError: Bool = false) throws {
+        let result: agent_error_t = content.withCString { cstr in
+            var toolResult = agent_tool_execute_result_t()
+            toolResult.error = AGENT_OK
+            toolResult.content = agent_sv_from_parts(cstr, strlen(cstr))
+            toolResult.is_error = isError
+            return agent_run_submit_tool_result(&state, index, &toolResult)
+        }
+        guard result == AGENT_OK else {
+            throw AgentError(from: result)
+        }
+    }
+
+    /// Collect a finished run; returns the final response
+    public func endRun() throws -> String {
+        let result = agent_run_end(&state)
+        guard result.error == AGENT_OK else {
+            throw AgentError(from: result.error)
+        }
+        return result.response.stringValue
     }
 }
 
-public struct ToolResult {
-    public let id: UUID
-    public let toolCallId: UUID
-    public let content: String
-    public let isError: Bool
+// MARK: - Swift Types
 
-    public init(id: UUID = UUID(), toolCallId: UUID, content: String, isError: Bool = false) {
-        self.id = id
-        self.toolCallId = toolCallId
-        self.content = content
-        self.isError = isError
+/// Tool call tag format a model emits (the Hermes <tool_call> tags are always accepted)
+public enum ToolCallDialect {
+    case hermes
+    case llama3
+    case phi4
+    case mistral
+    case granite
+
+    /// Dialect for a ModelLoader model id
+    public static func forModel(id: String) -> ToolCallDialect {
+        let id = id.lowercased()
+        if id.contains("llama") || id.hasPrefix("swallow") { return .llama3 }
+        if id.hasPrefix("phi-4") { return .phi4 }
+        if id.hasPrefix("mistral") || id.hasPrefix("ministral") { return .mistral }
+        if id.hasPrefix("granite") { return .granite }
+        return .hermes
+    }
+
+    var cDialect: UnsafePointer<agent_parser_dialect_t>? {
+        switch self {
+        case .hermes: return agent_parser_dialect_builtin(AGENT_DIALECT_HERMES)
+        case .llama3: return agent_parser_dialect_builtin(AGENT_DIALECT_LLAMA3)
+        case .phi4: return agent_parser_dialect_builtin(AGENT_DIALECT_PHI4)
+        case .mistral: return agent_parser_dialect_builtin(AGENT_DIALECT_MISTRAL)
+        case .granite: return agent_parser_dialect_builtin(AGENT_DIALECT_GRANITE)
+        }
     }
 }
 
+public enum AgentStep {
+    case none
+    case thinking
+    case callingTool(String)
+    case waitingForResult
+    case generating
+}
+
 // MARK: - JSON Parsing Utility
 
 public struct CJSONParser {
@@ -434,6 +741,63 @@ public struct CJSONParser {
         }
         return String(cString: str)
     }
+
+    /// Parse straight to Swift values through the flat tape, skipping the DOM
+    public static func parseToAny(_ json: String, using context: CAgentContext) throws -> Any {
+        let result = json.withCString { cstr in
+            agent_json_tape_parse(context.ctx, cstr, strlen(cstr))
+        }
+
+        guard result.error == AGENT_OK, let tape = result.tape else {
+            throw AgentError.parseError(result.error_message.map { String(cString: $0) })
+        }
+
+        return tapeToAny(agent_json_tape_root(tape))
+    }
+
+    private static func tapeToAny(_ ref: agent_json_tape_ref_t) -> Any {
+        switch agent_json_tape_type(ref) {
+        case AGENT_JSON_BOOL:
+            var value = false
+            agent_json_tape_get_bool(ref, &value)
+            return value
+        case AGENT_JSON_INT:
+            var value: Int64 = 0
+            agent_json_tape_get_int(ref, &value)
+            return value
+        case AGENT_JSON_DOUBLE:
+            var value = 0.0
+            agent_json_tape_get_double(ref, &value)
+            return value
+        case AGENT_JSON_STRING:
+            var sv = agent_string_view_t()
+            agent_json_tape_get_string(ref, &sv)
+            return sv.string ?? ""
+        case AGENT_JSON_ARRAY:
+            var arr: [Any] = []
+            arr.reserveCapacity(agent_json_tape_length(ref))
+            var item = agent_json_tape_child(ref)
+            while agent_json_tape_valid(item) {
+                arr.append(tapeToAny(item))
+                item = agent_json_tape_next(item)
+            }
+            return arr
+        case AGENT_JSON_OBJECT:
+            var dict: [String: Any] = [:]
+            dict.reserveCapacity(agent_json_tape_length(ref))
+            var member = agent_json_tape_child(ref)
+            while agent_json_tape_valid(member) {
+                var key = agent_string_view_t()
+                agent_json_tape_get_string(member, &key)
+                let value = agent_json_tape_next(member)
+                dict[key.stringValue] = tapeToAny(value)
+                member = agent_json_tape_next(value)
+            }
+            return dict
+        default:
+            return NSNull()
+        }
+    }
 }
 
 // MARK: - Response Parser Utility
@@ -453,10 +817,175 @@ public struct CResponseParser {
 
     public static func textBeforeToolCall(in response: String, using context: CAgentContext) -> String {
         return response.withCString { cstr in
-            let sv = agent_parser_text_before_tool_call(context.ctx, cstr, strlen(cstr))
+            // The view is copied into a String before cstr goes away, so borrowing is safe
+            let sv = agent_parser_text_before_tool_call_borrow(cstr, strlen(cstr))
             return sv.stringValue
         }
     }
+
+    /// Cheap check for a possible bare {"name": ..., "arguments": ...} call
+    public static func mayHaveBareJSON(in response: String) -> Bool {
+        var response = response
+        return response.withUTF8 { utf8 in
+            agent_parser_may_have_bare_json(utf8.cChars, utf8.count)
+        }
+    }
+
+    /// One segment of a parsed response
+    public enum Segment {
+        /// Views into the response, valid only inside the parse body
+        case text(UnsafeBufferPointer<UInt8>)
+        case thinking(UnsafeBufferPointer<UInt8>)
+        /// Arguments live in the context until the parse body returns
+        case toolCall(name: String, arguments: CJSONValue?)
+    }
+
+    /// Parse a complete response in one pass, including a thinking block
+    /// opened in the prompt and the bare JSON fallback. Only tool call JSON
+    /// is copied; the context is rewound when body returns.
+    public static func parse(_ response: String, dialect: ToolCallDialect = .hermes,
+                             using context: CAgentContext, _ body: (Segment) -> Void) {
+        var tags = agent_tag_set_t()
+        guard agent_tag_set_compile(&tags, dialect.cDialect) == AGENT_OK else { return }
+
+        var response = response
+        response.withUTF8 { utf8 in
+            guard utf8.count > 0 else { return }
+            let savepoint = context.savepoint()
+            defer { context.restore(to: savepoint) }
+
+            let result = agent_parser_parse_tags(context.ctx, &tags, utf8.cChars, utf8.count)
+            for i in 0..<result.count {
+                let content = result.contents[i]
+                switch content.type {
+                case AGENT_CONTENT_TEXT:
+                    body(.text(content.data.text.bytes))
+                case AGENT_CONTENT_THINKING:
+                    body(.thinking(content.data.thinking.bytes))
+                case AGENT_CONTENT_TOOL_CALL:
+                    body(.toolCall(name: content.data.tool_call.name.stringValue,
+                                   arguments: content.data.tool_call.arguments.map { CJSONValue($0) }))
+                default:
+                    break
+                }
+            }
+        }
+    }
+}
+
+// MARK: - Streaming Response Parser
+
+/// agent_streaming_parser_t for output that arrives token by token.
+/// Events fire from inside feed() and flush(); text and thinking are views
+/// into the parser's buffers, valid only until onEvent returns.
+public final class CStreamingParser {
+    public enum Event {
+        case text(UnsafeBufferPointer<UInt8>)
+        case thinking(UnsafeBufferPointer<UInt8>)
+        /// The call's name is known; its arguments are still arriving
+        case toolCallStarted(name: String)
+        /// Arguments live in the context until it is reset
+        case toolCall(name: String, arguments: CJSONValue?)
+    }
+
+    private var parser = agent_streaming_parser_t()
+    /// Sees only the text events, for bare JSON tool call candidates
+    private var textScanner = agent_tool_tag_scanner_t()
+    private let context: CAgentContext
+    private let onEvent: (Event) -> Void
+
+    public init(dialect: ToolCallDialect = .hermes,
+                textCoalescing: agent_text_coalescing_t? = nil,
+                using context: CAgentContext,
+                onEvent: @escaping (Event) -> Void) throws {
+        self.context = context
+        self.onEvent = onEvent
+
+        var err = agent_streaming_parser_init(&parser, context.ctx)
+        guard err == AGENT_OK else {
+            throw AgentError(from: err)
+        }
+        err = agent_streaming_parser_set_dialect(&parser, dialect.cDialect)
+        if err == AGENT_OK, var policy = textCoalescing {
+            err = agent_streaming_parser_set_text_coalescing(&parser, &policy)
+        }
+        guard err == AGENT_OK else {
+            agent_streaming_parser_free(&parser)
+            throw AgentError(from: err)
+        }
+
+        agent_tool_tag_scanner_reset(&textScanner)
+        parser.user_data = Unmanaged.passUnretained(self).toOpaque()
+        parser.on_text = { text, length, userData in
+            let streamingParser = CStreamingParser.from(userData)
+            _ = agent_tool_tag_scanner_feed(&streamingParser.textScanner, text, length)
+            streamingParser.emit(.text(CStreamingParser.bytes(text, length)))
+        }
+        parser.on_thinking = { text, length, userData in
+            CStreamingParser.from(userData).emit(.thinking(CStreamingParser.bytes(text, length)))
+        }
+        parser.on_tool_call_start = { name, userData in
+            CStreamingParser.from(userData).emit(.toolCallStarted(name: name.map { String(cString: $0) } ?? ""))
+        }
+        parser.on_tool_call = { name, arguments, userData in
+            let value = arguments.map { CJSONValue(UnsafeMutablePointer(mutating: $0)) }
+            CStreamingParser.from(userData).emit(.toolCall(name: name.map { String(cString: $0) } ?? "",
+                                                           arguments: value))
+        }
+    }
+
+    deinit {
+        agent_streaming_parser_free(&parser)
+    }
+
+    public func feed(_ token: String) {
+        var token = token
+        token.withUTF8 { utf8 in
+            guard utf8.count > 0 else { return }
+            _ = agent_streaming_parser_feed(&parser, utf8.cChars, utf8.count)
+        }
+    }
+
+    /// Release held text and any unfinished tag as text
+    public func flush() {
+        _ = agent_streaming_parser_flush(&parser)
+    }
+
+    /// Start over for the next response
+    public func reset() {
+        agent_streaming_parser_reset(&parser)
+        agent_tool_tag_scanner_reset(&textScanner)
+    }
+
+    public var inToolCall: Bool {
+        return agent_streaming_parser_in_tool_call(&parser)
+    }
+
+    /// A bare {"name": ...} tool call may have started in the text so far
+    /// (outside thinking and tool call blocks); each text byte is scanned once
+    public var hasBareJSONCandidate: Bool {
+        return agent_tool_tag_scanner_has_bare_json(&textScanner)
+    }
+
+    private func emit(_ event: Event) {
+        onEvent(event)
+    }
+
+    private static func from(_ userData: UnsafeMutableRawPointer?) -> CStreamingParser {
+        return Unmanaged<CStreamingParser>.fromOpaque(userData!).takeUnretainedValue()
+    }
+
+    private static func bytes(_ text: UnsafePointer<CChar>?, _ length: Int) -> UnsafeBufferPointer<UInt8> {
+        guard let text = text else { return UnsafeBufferPointer(start: nil, count: 0) }
+        return UnsafeBufferPointer(start: UnsafeRawPointer(text).assumingMemoryBound(to: UInt8.self), count: length)
+    }
+}
+
+extension UnsafeBufferPointer where Element == UInt8 {
+    /// The bytes as the C strings the library takes
+    var cChars: UnsafePointer<CChar>? {
+        return baseAddress.map { UnsafeRawPointer($0).assumingMemoryBound(to: CChar.self) }
+    }
 }
 
 // MARK: - Library Initialization
@@ -468,6 +997,15 @@ public func initializeAgentLib() throws {
     }
 }
 
+/// Initialize with a custom allocator (for zone accounting or leak tracking)
+public func initializeAgentLib(allocator: agent_allocator_t) throws {
+    var allocator = allocator
+    let result = agent_lib_init_with_allocator(&allocator)
+    guard result == AGENT_OK else {
+        throw AgentError(from: result)
+    }
+}
+
 public func cleanupAgentLib() {
     agent_lib_cleanup()
 }
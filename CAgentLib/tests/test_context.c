@@ -0,0 +1,626 @@
+/**
+ * @file test_context.c
+ * @brief Unit tests for the arena allocator
+ */
+
+#include "agent_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define TEST(name) static void test_##name(void)
+#define RUN_TEST(name) do { printf("  " #name "..."); test_##name(); printf(" OK\n"); } while(0)
+
+/* Basic allocation tests */
+
+TEST(create_destroy) {
+    agent_context_t* ctx = agent_context_create(0);
+    assert(ctx != NULL);
+    assert(agent_context_used(ctx) == 0);
+    assert(agent_context_capacity(ctx) > 0);
+    agent_context_destroy(ctx);
+}
+
+TEST(alloc_basic) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    char* a = agent_context_alloc(ctx, 10);
+    char* b = agent_context_alloc(ctx, 10);
+    assert(a != NULL && b != NULL);
+    assert(a != b);
+    assert(((uintptr_t)b & 7) == 0);  /* 8-byte aligned */
+
+    char* s = agent_context_strdup(ctx, "hello");
+    assert(strcmp(s, "hello") == 0);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(alloc_grows_blocks) {
+    agent_context_t* ctx = agent_context_create(1024);
+    size_t initial_capacity = agent_context_capacity(ctx);
+
+    for (int i = 0; i < 100; i++) {
+        void* p = agent_context_alloc(ctx, 4096);
+        assert(p != NULL);
+        memset(p, i, 4096);
+    }
+
+    assert(agent_context_used(ctx) == 100 * 4096);
+    assert(agent_context_capacity(ctx) > initial_capacity);
+
+    agent_context_destroy(ctx);
+}
+
+/* Savepoint tests */
+
+TEST(savepoint_single_block) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    agent_context_alloc(ctx, 100);
+    size_t used = agent_context_used(ctx);
+    size_t sp = agent_context_savepoint(ctx);
+
+    agent_context_alloc(ctx, 200);
+    assert(agent_context_used(ctx) > used);
+
+    agent_context_restore(ctx, sp);
+    assert(agent_context_used(ctx) == used);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(savepoint_across_blocks) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    char* keep = agent_context_strdup(ctx, "persistent");
+    size_t used = agent_context_used(ctx);
+    size_t sp = agent_context_savepoint(ctx);
+
+    /* Spill well past the first 64KB block */
+    for (int i = 0; i < 10; i++) {
+        assert(agent_context_alloc(ctx, 30000) != NULL);
+    }
+    assert(agent_context_used(ctx) >= 300000);
+
+    agent_context_restore(ctx, sp);
+    assert(agent_context_used(ctx) == used);
+    assert(strcmp(keep, "persistent") == 0);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(savepoint_reuses_blocks) {
+    agent_context_t* ctx = agent_context_create(0);
+    size_t sp = agent_context_savepoint(ctx);
+
+    for (int i = 0; i < 10; i++) {
+        agent_context_alloc(ctx, 30000);
+    }
+    size_t capacity = agent_context_capacity(ctx);
+
+    /* Repeating the same work after a restore must not grow the arena */
+    for (int round = 0; round < 5; round++) {
+        agent_context_restore(ctx, sp);
+        for (int i = 0; i < 10; i++) {
+            assert(agent_context_alloc(ctx, 30000) != NULL);
+        }
+        assert(agent_context_capacity(ctx) == capacity);
+    }
+
+    agent_context_destroy(ctx);
+}
+
+TEST(savepoint_nested) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    size_t outer = agent_context_savepoint(ctx);
+    agent_context_alloc(ctx, 50000);
+    size_t middle_used = agent_context_used(ctx);
+    size_t inner = agent_context_savepoint(ctx);
+    agent_context_alloc(ctx, 50000);
+    agent_context_alloc(ctx, 50000);
+
+    agent_context_restore(ctx, inner);
+    assert(agent_context_used(ctx) == middle_used);
+
+    agent_context_restore(ctx, outer);
+    assert(agent_context_used(ctx) == 0);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(savepoint_inside_later_block) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    agent_context_alloc(ctx, 60000);
+    agent_context_alloc(ctx, 10000);  /* Forces a second block */
+    size_t used = agent_context_used(ctx);
+    size_t sp = agent_context_savepoint(ctx);
+
+    agent_context_alloc(ctx, 1000);
+    agent_context_alloc(ctx, 70000);
+
+    agent_context_restore(ctx, sp);
+    assert(agent_context_used(ctx) == used);
+
+    agent_context_destroy(ctx);
+}
+
+/* Free-list tests */
+
+TEST(reset_retains_blocks) {
+    agent_context_t* ctx = agent_context_create(0);
+    size_t base_capacity = agent_context_capacity(ctx);
+
+    for (int i = 0; i < 3; i++) {
+        agent_context_alloc(ctx, 60000);
+    }
+    size_t grown = agent_context_capacity(ctx);
+    assert(grown > base_capacity);
+
+    agent_context_reset(ctx);
+    assert(agent_context_used(ctx) == 0);
+    assert(agent_context_capacity(ctx) == base_capacity);
+    assert(agent_context_retained(ctx) == grown - base_capacity);
+
+    /* The next turn reuses retained blocks */
+    for (int i = 0; i < 3; i++) {
+        assert(agent_context_alloc(ctx, 60000) != NULL);
+    }
+    assert(agent_context_capacity(ctx) == grown);
+    assert(agent_context_retained(ctx) == 0);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(retain_limit) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    for (int i = 0; i < 20; i++) {
+        agent_context_alloc(ctx, 60000);
+    }
+    agent_context_reset(ctx);
+    assert(agent_context_retained(ctx) > 0);
+    assert(agent_context_retained(ctx) <= 256 * 1024);
+
+    agent_context_set_retain_limit(ctx, 100000);
+    assert(agent_context_retained(ctx) <= 100000);
+
+    agent_context_set_retain_limit(ctx, 0);
+    assert(agent_context_retained(ctx) == 0);
+
+    for (int i = 0; i < 3; i++) {
+        agent_context_alloc(ctx, 60000);
+    }
+    agent_context_reset(ctx);
+    assert(agent_context_retained(ctx) == 0);
+
+    agent_context_destroy(ctx);
+}
+
+/* Aligned allocation tests */
+
+TEST(alloc_aligned) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    size_t aligns[] = {16, 64, 4096};
+    for (size_t i = 0; i < sizeof(aligns) / sizeof(aligns[0]); i++) {
+        agent_context_alloc(ctx, 3);  /* Knock the bump pointer off alignment */
+        void* p = agent_context_alloc_aligned(ctx, 100, aligns[i]);
+        assert(p != NULL);
+        assert(((uintptr_t)p & (aligns[i] - 1)) == 0);
+        memset(p, 0xAB, 100);
+    }
+
+    /* Small alignments are rounded up to the default */
+    void* p = agent_context_alloc_aligned(ctx, 1, 2);
+    assert(p != NULL && ((uintptr_t)p & 7) == 0);
+
+    /* Non power-of-two alignment is rejected */
+    assert(agent_context_alloc_aligned(ctx, 16, 24) == NULL);
+    assert(agent_context_alloc_aligned(ctx, 16, 0) == NULL);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(alloc_aligned_new_block) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    agent_context_alloc(ctx, 65000);
+    uint8_t* p = agent_context_calloc_aligned(ctx, 4096, 1, 4096);
+    assert(p != NULL);
+    assert(((uintptr_t)p & 4095) == 0);
+    for (int i = 0; i < 4096; i++) {
+        assert(p[i] == 0);
+    }
+
+    /* Larger than a default block */
+    p = agent_context_alloc_aligned(ctx, 100000, 64);
+    assert(p != NULL && ((uintptr_t)p & 63) == 0);
+    memset(p, 1, 100000);
+
+    agent_context_destroy(ctx);
+}
+
+/* Realloc tests */
+
+TEST(realloc_grows_in_place) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    char* p = agent_context_alloc(ctx, 16);
+    memcpy(p, "0123456789abcdef", 16);
+    size_t used = agent_context_used(ctx);
+
+    char* q = agent_context_realloc(ctx, p, 16, 64);
+    assert(q == p);
+    assert(memcmp(q, "0123456789abcdef", 16) == 0);
+    assert(agent_context_used(ctx) == used + 48);
+
+    /* Shrinking the newest allocation gives the tail back */
+    q = agent_context_realloc(ctx, q, 64, 8);
+    assert(q == p);
+    assert(agent_context_used(ctx) == used - 8);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(realloc_copies_when_not_last) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    char* p = agent_context_alloc(ctx, 16);
+    memcpy(p, "0123456789abcdef", 16);
+    agent_context_alloc(ctx, 8);
+
+    char* q = agent_context_realloc(ctx, p, 16, 32);
+    assert(q != NULL && q != p);
+    assert(memcmp(q, "0123456789abcdef", 16) == 0);
+
+    /* Shrinking an older allocation keeps it where it is */
+    size_t used = agent_context_used(ctx);
+    assert(agent_context_realloc(ctx, p, 16, 4) == p);
+    assert(agent_context_used(ctx) == used);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(realloc_moves_to_new_block) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    char* p = agent_context_alloc(ctx, 60000);
+    memset(p, 'x', 60000);
+
+    char* q = agent_context_realloc(ctx, p, 60000, 70000);
+    assert(q != NULL && q != p);
+    for (int i = 0; i < 60000; i++) {
+        assert(q[i] == 'x');
+    }
+
+    assert(agent_context_realloc(ctx, NULL, 0, 32) != NULL);
+
+    agent_context_destroy(ctx);
+}
+
+/* Stats tests */
+
+TEST(stats_counters) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    agent_context_stats_t stats = agent_context_stats(ctx);
+    assert(stats.bytes_used == 0);
+    assert(stats.block_count == 1);
+    assert(stats.allocation_count == 0);
+
+    agent_context_alloc(ctx, 10);      /* 6 bytes of padding */
+    agent_context_alloc(ctx, 100);     /* 4 bytes of padding */
+    agent_context_alloc(ctx, 70000);   /* Forces a second block */
+
+    stats = agent_context_stats(ctx);
+    assert(stats.bytes_used == 16 + 104 + 70000);
+    assert(stats.bytes_used == agent_context_used(ctx));
+    assert(stats.peak_bytes == stats.bytes_used);
+    assert(stats.block_count == 2);
+    assert(stats.allocation_count == 3);
+    assert(stats.padding_bytes == 10);
+    assert(stats.capacity == agent_context_capacity(ctx));
+    assert(stats.histogram[0] == 1);
+    assert(stats.histogram[2] == 1);
+    assert(stats.histogram[AGENT_CONTEXT_STATS_BUCKETS - 1] == 1);
+
+    agent_context_reset(ctx);
+    stats = agent_context_stats(ctx);
+    assert(stats.bytes_used == 0);
+    assert(stats.peak_bytes == 16 + 104 + 70000);
+    assert(stats.block_count == 1);
+    assert(stats.allocation_count == 3);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(stats_across_restore) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    agent_context_alloc(ctx, 60000);
+    size_t sp = agent_context_savepoint(ctx);
+    agent_context_alloc(ctx, 60000);
+    agent_context_alloc(ctx, 64);
+    assert(agent_context_used(ctx) == 120064);
+
+    agent_context_restore(ctx, sp);
+    assert(agent_context_used(ctx) == 60000);
+
+    void* p = agent_context_alloc(ctx, 32);
+    agent_context_realloc(ctx, p, 32, 64);
+    assert(agent_context_used(ctx) == 60064);
+    assert(agent_context_stats(ctx).peak_bytes == 120064);
+
+    agent_context_destroy(ctx);
+}
+
+/* Budget tests */
+
+static size_t last_footprint = 0;
+static int pressure_count = 0;
+
+static void on_pressure(size_t footprint, size_t soft_limit, void* user_data) {
+    assert(footprint > soft_limit);
+    assert(user_data == &pressure_count);
+    last_footprint = footprint;
+    pressure_count++;
+}
+
+TEST(budget_soft_limit) {
+    agent_context_t* ctx = agent_context_create(0);
+    agent_context_set_budget(ctx, 150 * 1024, 0, on_pressure, &pressure_count);
+
+    pressure_count = 0;
+    agent_context_alloc(ctx, 60000);
+    agent_context_alloc(ctx, 60000);
+    assert(pressure_count == 0);
+
+    /* Third block crosses the soft limit, fourth does not fire again */
+    agent_context_alloc(ctx, 60000);
+    assert(pressure_count == 1);
+    assert(last_footprint > 150 * 1024);
+    agent_context_alloc(ctx, 60000);
+    assert(pressure_count == 1);
+
+    /* Dropping below re-arms the callback */
+    agent_context_set_retain_limit(ctx, 0);
+    agent_context_reset(ctx);
+    for (int i = 0; i < 4; i++) {
+        agent_context_alloc(ctx, 60000);
+    }
+    assert(pressure_count == 2);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(budget_hard_limit) {
+    agent_context_t* ctx = agent_context_create(0);
+    agent_context_set_budget(ctx, 0, 200 * 1024, NULL, NULL);
+
+    assert(agent_context_alloc(ctx, 60000) != NULL);
+    assert(agent_context_alloc(ctx, 60000) != NULL);
+    assert(agent_context_alloc(ctx, 60000) != NULL);
+    assert(agent_context_alloc(ctx, 60000) == NULL);
+    assert(agent_context_capacity(ctx) <= 200 * 1024);
+
+    /* Space left in the current block is still usable */
+    assert(agent_context_alloc(ctx, 1024) != NULL);
+
+    /* Recycled blocks don't count twice */
+    agent_context_reset(ctx);
+    assert(agent_context_alloc(ctx, 60000) != NULL);
+    assert(agent_context_alloc(ctx, 60000) != NULL);
+    assert(agent_context_alloc(ctx, 60000) != NULL);
+
+    agent_context_destroy(ctx);
+}
+
+/* Reserved backend tests */
+
+TEST(reserved_contiguous) {
+    agent_context_t* ctx = agent_context_create_reserved(4 * 1024 * 1024);
+    if (!ctx) {
+        printf(" (skipped: no mmap)");
+        return;
+    }
+    size_t initial_capacity = agent_context_capacity(ctx);
+
+    /* Allocations stay contiguous across what would be block boundaries */
+    char* first = agent_context_alloc(ctx, 60000);
+    char* second = agent_context_alloc(ctx, 60000);
+    assert(first != NULL && second == first + 60000);
+    memset(first, 1, 120000);
+    assert(agent_context_capacity(ctx) > initial_capacity);
+    assert(agent_context_stats(ctx).block_count == 1);
+
+    size_t sp = agent_context_savepoint(ctx);
+    char* big = agent_context_alloc(ctx, 1024 * 1024);
+    assert(big == second + 60000);
+    memset(big, 2, 1024 * 1024);
+    agent_context_restore(ctx, sp);
+    assert(agent_context_used(ctx) == 120000);
+    assert(agent_context_alloc(ctx, 8) == big);
+
+    /* Exhausting the reservation fails cleanly */
+    assert(agent_context_alloc(ctx, 8 * 1024 * 1024) == NULL);
+
+    agent_context_reset(ctx);
+    assert(agent_context_used(ctx) == 0);
+    char* again = agent_context_alloc(ctx, 200000);
+    assert(again == first);
+    memset(again, 3, 200000);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(reserved_hard_limit) {
+    agent_context_t* ctx = agent_context_create_reserved(4 * 1024 * 1024);
+    if (!ctx) {
+        printf(" (skipped: no mmap)");
+        return;
+    }
+    agent_context_set_budget(ctx, 0, 256 * 1024, NULL, NULL);
+
+    assert(agent_context_alloc(ctx, 200 * 1024) != NULL);
+    assert(agent_context_alloc(ctx, 100 * 1024) == NULL);
+    assert(agent_context_capacity(ctx) <= 256 * 1024);
+
+    agent_context_destroy(ctx);
+}
+
+/* Allocator hook tests */
+
+typedef struct {
+    int allocs;
+    int frees;
+} tracking_stats_t;
+
+static void* tracking_alloc(size_t size, void* user_data) {
+    ((tracking_stats_t*)user_data)->allocs++;
+    return malloc(size);
+}
+
+static void* tracking_realloc(void* ptr, size_t size, void* user_data) {
+    if (!ptr) {
+        ((tracking_stats_t*)user_data)->allocs++;
+    }
+    return realloc(ptr, size);
+}
+
+static void tracking_free(void* ptr, void* user_data) {
+    ((tracking_stats_t*)user_data)->frees++;
+    free(ptr);
+}
+
+TEST(intern_shares_copies) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    char key[] = "path";
+    agent_string_view_t a = agent_context_intern(ctx, key, 4);
+    key[0] = 'm';
+    agent_string_view_t b = agent_context_intern(ctx, "path", 4);
+    agent_string_view_t c = agent_context_intern(ctx, "pat", 3);
+    assert(a.data == b.data && a.length == 4);
+    assert(strcmp(a.data, "path") == 0);
+    assert(c.data != a.data && strcmp(c.data, "pat") == 0);
+    assert(agent_context_intern_count(ctx) == 2);
+
+    /* Grows past the initial table */
+    char name[16];
+    for (int i = 0; i < 200; i++) {
+        snprintf(name, sizeof(name), "key%d", i);
+        agent_context_intern(ctx, name, strlen(name));
+    }
+    assert(agent_context_intern_count(ctx) == 202);
+    assert(agent_context_intern(ctx, "path", 4).data == a.data);
+
+    /* Restoring below an interned string drops the table */
+    size_t sp = agent_context_savepoint(ctx);
+    agent_string_view_t kept = agent_context_intern(ctx, "query", 5);
+    agent_context_restore(ctx, agent_context_savepoint(ctx));
+    assert(agent_context_intern(ctx, "query", 5).data == kept.data);
+    agent_context_restore(ctx, sp);
+    assert(agent_context_intern_count(ctx) == 0);
+    agent_string_view_t again = agent_context_intern(ctx, "query", 5);
+    assert(strcmp(again.data, "query") == 0);
+
+    agent_context_reset(ctx);
+    assert(agent_context_intern_count(ctx) == 0);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(allocator_hooks) {
+    tracking_stats_t stats = {0, 0};
+    agent_allocator_t allocator = {tracking_alloc, tracking_realloc, tracking_free, &stats};
+
+    agent_allocator_t incomplete = allocator;
+    incomplete.free = NULL;
+    assert(agent_lib_init_with_allocator(&incomplete) == AGENT_ERROR_INVALID_ARGUMENT);
+
+    assert(agent_lib_init_with_allocator(&allocator) == AGENT_OK);
+    assert(agent_lib_init_with_allocator(&allocator) == AGENT_ERROR_INVALID_ARGUMENT);
+
+    agent_context_t* ctx = agent_context_create(0);
+    for (int i = 0; i < 4; i++) {
+        agent_context_alloc(ctx, 60000);
+    }
+
+    agent_string_t str;
+    agent_string_init(&str, 8);
+    agent_string_append(&str, "grown through the hook, past the inline buffer");
+
+    agent_tool_registry_t registry;
+    agent_tool_registry_init(&registry, 1);
+
+    assert(stats.allocs >= 7);  /* context, 4 blocks, string, registry */
+
+    agent_tool_registry_free(&registry);
+    agent_string_free(&str);
+    agent_context_destroy(ctx);
+    assert(stats.allocs == stats.frees);
+
+    agent_lib_cleanup();
+    assert(agent_get_allocator()->user_data == NULL);
+}
+
+int main(void) {
+    printf("Running basic allocation tests...\n");
+
+    RUN_TEST(create_destroy);
+    RUN_TEST(alloc_basic);
+    RUN_TEST(alloc_grows_blocks);
+
+    printf("\nRunning savepoint tests...\n");
+
+    RUN_TEST(savepoint_single_block);
+    RUN_TEST(savepoint_across_blocks);
+    RUN_TEST(savepoint_reuses_blocks);
+    RUN_TEST(savepoint_nested);
+    RUN_TEST(savepoint_inside_later_block);
+
+    printf("\nRunning free-list tests...\n");
+
+    RUN_TEST(reset_retains_blocks);
+    RUN_TEST(retain_limit);
+
+    printf("\nRunning aligned allocation tests...\n");
+
+    RUN_TEST(alloc_aligned);
+    RUN_TEST(alloc_aligned_new_block);
+
+    printf("\nRunning realloc tests...\n");
+
+    RUN_TEST(realloc_grows_in_place);
+    RUN_TEST(realloc_copies_when_not_last);
+    RUN_TEST(realloc_moves_to_new_block);
+
+    printf("\nRunning stats tests...\n");
+
+    RUN_TEST(stats_counters);
+    RUN_TEST(stats_across_restore);
+
+    printf("\nRunning budget tests...\n");
+
+    RUN_TEST(budget_soft_limit);
+    RUN_TEST(budget_hard_limit);
+
+    printf("\nRunning reserved backend tests...\n");
+
+    RUN_TEST(reserved_contiguous);
+    RUN_TEST(reserved_hard_limit);
+
+    printf("\nRunning intern tests...\n");
+    RUN_TEST(intern_shares_copies);
+
+    printf("\nRunning allocator hook tests...\n");
+
+    RUN_TEST(allocator_hooks);
+
+    printf("\nAll context tests passed!\n");
+    return 0;
+}
@@ -74,6 +74,33 @@ TEST(parse_double) {
     assert(result.value->type == AGENT_JSON_DOUBLE);
 }
 
+TEST(parse_number_paths) {
+    agent_json_parse_result_t result;
+
+    /* Fast path: short significand, small exponent */
+    result = agent_json_parse_cstr(ctx, "-0.0625");
+    assert(result.value->type == AGENT_JSON_DOUBLE);
+    assert(result.value->data.double_value == -0.0625);
+
+    result = agent_json_parse_cstr(ctx, "12.5e3");
+    assert(result.value->data.double_value == 12500.0);
+
+    /* Slow path: long significand or large exponent */
+    result = agent_json_parse_cstr(ctx, "3.14159265358979323846264338327950288");
+    assert(result.value->data.double_value == 3.141592653589793);
+
+    result = agent_json_parse_cstr(ctx, "1e300");
+    assert(result.value->data.double_value == 1e300);
+
+    /* Integer limits */
+    result = agent_json_parse_cstr(ctx, "-9223372036854775808");
+    assert(result.value->type == AGENT_JSON_INT);
+    assert(result.value->data.int_value == INT64_MIN);
+
+    result = agent_json_parse_cstr(ctx, "9223372036854775807");
+    assert(result.value->data.int_value == INT64_MAX);
+}
+
 TEST(parse_string) {
     agent_json_parse_result_t result;
 
@@ -108,6 +135,37 @@ TEST(parse_string_escapes) {
     assert(result.value->data.string_value.data[0] == 'A');
 }
 
+TEST(parse_insitu) {
+    char json[] = "{\"path\": \"/tmp/\\u65e5\\u672c.txt\", \"note\": \"a\\\"b\\nc\", \"n\": [1, \"plain\"]}";
+
+    size_t used_before = agent_context_used(ctx);
+    assert(agent_json_parse_cstr(ctx, json).error == AGENT_OK);
+    size_t copying_bytes = agent_context_used(ctx) - used_before;
+
+    used_before = agent_context_used(ctx);
+
+    agent_json_parse_result_t result = agent_json_parse_insitu(ctx, json, strlen(json));
+    assert(result.error == AGENT_OK);
+
+    agent_json_value_t* path = agent_json_object_get(result.value, "path");
+    assert(path != NULL);
+    assert(strcmp(path->data.string_value.data, "/tmp/\xe6\x97\xa5\xe6\x9c\xac.txt") == 0);
+    assert(path->data.string_value.length == 15);
+
+    agent_json_value_t* note = agent_json_object_get(result.value, "note");
+    assert(strcmp(note->data.string_value.data, "a\"b\nc") == 0);
+
+    /* Strings and keys point into the caller's buffer */
+    assert(path->data.string_value.data >= json && path->data.string_value.data < json + sizeof(json));
+    assert(result.value->data.object_value.entries[0].key.data > json);
+    agent_json_value_t* plain = agent_json_array_get(agent_json_object_get(result.value, "n"), 1);
+    assert(plain->data.string_value.data > json && plain->data.string_value.data < json + sizeof(json));
+    assert(strcmp(plain->data.string_value.data, "plain") == 0);
+
+    /* Only nodes and containers come from the arena */
+    assert(agent_context_used(ctx) - used_before < copying_bytes);
+}
+
 TEST(parse_array) {
     agent_json_parse_result_t result;
 
@@ -136,6 +194,28 @@ TEST(parse_array) {
     assert(result.value->data.array_value.items[3]->type == AGENT_JSON_NULL);
 }
 
+TEST(parse_interned_keys) {
+    agent_json_parse_result_t result = agent_json_parse_cstr(ctx,
+        "[{\"path\": \"a\", \"mode\": 1}, {\"path\": \"b\", \"p\\u0061th\": 2}]");
+    assert(result.error == AGENT_OK);
+
+    agent_json_value_t* first = agent_json_array_get(result.value, 0);
+    agent_json_value_t* second = agent_json_array_get(result.value, 1);
+    const agent_json_entry_t* a = &first->data.object_value.entries[0];
+    const agent_json_entry_t* b = &second->data.object_value.entries[0];
+    assert(a->key.data == b->key.data);
+
+    /* The escaped spelling is the same key */
+    assert(second->data.object_value.count == 1);
+    assert(agent_json_object_get(second, "path")->data.int_value == 2);
+
+    /* Keys set later share the parsed copy */
+    agent_json_value_t* object = agent_json_object(ctx, 0);
+    assert(agent_json_object_set(ctx, object, "mode", agent_json_int(ctx, 3)) == AGENT_OK);
+    assert(object->data.object_value.entries[0].key.data ==
+           first->data.object_value.entries[1].key.data);
+}
+
 TEST(parse_object) {
     agent_json_parse_result_t result;
 
@@ -191,6 +271,43 @@ TEST(parse_whitespace) {
     assert(result.value->type == AGENT_JSON_OBJECT);
 }
 
+TEST(parse_long_runs) {
+    /* Quotes and escapes at every offset around the 16-byte scan width */
+    for (size_t prefix = 0; prefix < 40; prefix++) {
+        char json[128];
+        size_t n = 0;
+        json[n++] = '"';
+        for (size_t i = 0; i < prefix; i++) json[n++] = 'a';
+        json[n++] = '\\';
+        json[n++] = 'n';
+        for (size_t i = 0; i < 17; i++) json[n++] = 'b';
+        json[n++] = '"';
+
+        agent_json_parse_result_t result = agent_json_parse(ctx, json, n);
+        assert(result.error == AGENT_OK);
+        assert(result.value->data.string_value.length == prefix + 1 + 17);
+        assert(result.value->data.string_value.data[prefix] == '\n');
+    }
+
+    /* Long whitespace runs */
+    char json[256];
+    size_t n = 0;
+    json[n++] = '[';
+    for (int i = 0; i < 37; i++) json[n++] = (i % 3 == 0) ? '\n' : ' ';
+    json[n++] = '1';
+    for (int i = 0; i < 21; i++) json[n++] = '\t';
+    json[n++] = ']';
+    agent_json_parse_result_t result = agent_json_parse(ctx, json, n);
+    assert(result.error == AGENT_OK);
+    assert(result.value->data.array_value.count == 1);
+
+    /* Unterminated long string */
+    result = agent_json_parse_cstr(ctx, "\"abcdefghijklmnopqrstuvwxyz0123456789");
+    assert(result.error == AGENT_ERROR_PARSE_ERROR);
+    result = agent_json_parse_cstr(ctx, "\"abcdefghijklmnopqrstuvwxyz\\");
+    assert(result.error == AGENT_ERROR_PARSE_ERROR);
+}
+
 TEST(parse_errors) {
     agent_json_parse_result_t result;
 
@@ -247,6 +364,138 @@ TEST(construct_array) {
     assert(arr->data.array_value.items[2]->data.int_value == 3);
 }
 
+TEST(construct_array_growth) {
+    agent_json_value_t* arr = agent_json_array(ctx, 2);
+    assert(arr->data.array_value.capacity == 2);
+
+    for (int i = 0; i < 500; i++) {
+        assert(agent_json_array_append(ctx, arr, agent_json_int(ctx, i)) == AGENT_OK);
+    }
+
+    assert(arr->data.array_value.count == 500);
+    assert(arr->data.array_value.capacity >= 500);
+    assert(arr->data.array_value.capacity < 1024);
+    for (int i = 0; i < 500; i++) {
+        assert(arr->data.array_value.items[i]->data.int_value == i);
+    }
+
+    agent_json_value_t* obj = agent_json_object(ctx, 1);
+    char key[16];
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        assert(agent_json_object_set(ctx, obj, key, agent_json_int(ctx, i)) == AGENT_OK);
+    }
+    assert(obj->data.object_value.count == 100);
+    assert(agent_json_object_get(obj, "k99")->data.int_value == 99);
+}
+
+TEST(parse_exact_capacity) {
+    agent_json_parse_result_t result = agent_json_parse_cstr(ctx,
+        "{\"a\": [1, [2, 3], {\"b\": 4, \"b\": 5}], \"c\": []}");
+    assert(result.error == AGENT_OK);
+    assert(result.value->data.object_value.count == 2);
+    assert(result.value->data.object_value.capacity == 2);
+
+    agent_json_value_t* a = agent_json_object_get(result.value, "a");
+    assert(a->data.array_value.count == 3);
+    assert(a->data.array_value.capacity == 3);
+    assert(a->data.array_value.items[1]->data.array_value.capacity == 2);
+
+    /* Duplicate keys keep the last value */
+    agent_json_value_t* inner = a->data.array_value.items[2];
+    assert(inner->data.object_value.count == 1);
+    assert(agent_json_object_get(inner, "b")->data.int_value == 5);
+
+    /* Appending to a parsed array still works */
+    agent_json_value_t* c = agent_json_object_get(result.value, "c");
+    assert(c->data.array_value.capacity == 0);
+    assert(agent_json_array_append(ctx, c, agent_json_int(ctx, 7)) == AGENT_OK);
+    assert(agent_json_array_append(ctx, a, agent_json_int(ctx, 8)) == AGENT_OK);
+    assert(a->data.array_value.count == 4);
+    assert(a->data.array_value.items[3]->data.int_value == 8);
+}
+
+TEST(wide_object_index) {
+    /* Parsed wide object with a duplicate key */
+    agent_string_t json;
+    agent_string_init(&json, 0);
+    agent_string_append(&json, "{");
+    for (int i = 0; i < 100; i++) {
+        agent_string_append_fmt(&json, "\"key%d\": %d, ", i, i);
+    }
+    agent_string_append(&json, "\"key7\": 700}");
+
+    agent_json_parse_result_t result = agent_json_parse(ctx, json.data, json.length);
+    agent_string_free(&json);
+    assert(result.error == AGENT_OK);
+
+    agent_json_value_t* obj = result.value;
+    assert(obj->data.object_value.index != NULL);
+    assert(agent_json_object_length(obj) == 100);
+    assert(agent_json_object_get(obj, "key7")->data.int_value == 700);
+    assert(agent_json_object_get(obj, "key99")->data.int_value == 99);
+    assert(agent_json_object_get(obj, "key100") == NULL);
+
+    /* Insertion order is preserved */
+    assert(agent_sv_equals_cstr(obj->data.object_value.entries[0].key, "key0"));
+    assert(agent_sv_equals_cstr(obj->data.object_value.entries[7].key, "key7"));
+    assert(agent_sv_equals_cstr(obj->data.object_value.entries[99].key, "key99"));
+
+    /* Mutations keep the index in sync */
+    assert(agent_json_object_set(ctx, obj, "key3", agent_json_int(ctx, 300)) == AGENT_OK);
+    assert(agent_json_object_length(obj) == 100);
+    for (int i = 100; i < 200; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        assert(agent_json_object_set(ctx, obj, key, agent_json_int(ctx, i)) == AGENT_OK);
+    }
+    assert(agent_json_object_length(obj) == 200);
+    assert(agent_json_object_get(obj, "key3")->data.int_value == 300);
+    assert(agent_json_object_get(obj, "key150")->data.int_value == 150);
+
+    /* Small objects stay unindexed */
+    agent_json_value_t* small = agent_json_object(ctx, 0);
+    agent_json_object_set(ctx, small, "a", agent_json_int(ctx, 1));
+    assert(small->data.object_value.index == NULL);
+}
+
+TEST(compiled_path) {
+    const char* json = "{\"arguments\": {\"options\": [{\"limit\": 5}, {\"limit\": 7}], \"path\": \"/x\"}}";
+    agent_json_parse_result_t result = agent_json_parse_cstr(ctx, json);
+    assert(result.error == AGENT_OK);
+
+    agent_json_path_t path;
+    assert(agent_json_path_compile(ctx, "arguments.options[1].limit", &path) == AGENT_OK);
+    assert(path.count == 4);
+    agent_json_value_t* limit = agent_json_path_eval(&path, result.value);
+    assert(limit != NULL);
+    assert(limit->data.int_value == 7);
+
+    assert(agent_json_path_compile(ctx, "arguments.options[2].limit", &path) == AGENT_OK);
+    assert(agent_json_path_eval(&path, result.value) == NULL);
+    assert(agent_json_path_compile(ctx, "arguments.path.x", &path) == AGENT_OK);
+    assert(agent_json_path_eval(&path, result.value) == NULL);
+
+    assert(agent_json_path_compile(ctx, "", &path) == AGENT_OK);
+    assert(agent_json_path_eval(&path, result.value) == result.value);
+
+    /* Indexed objects are probed with the precomputed hash */
+    agent_json_value_t* wide = agent_json_object(ctx, 0);
+    for (int i = 0; i < AGENT_JSON_INDEX_THRESHOLD * 2; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "k%d", i);
+        agent_json_object_set(ctx, wide, key, agent_json_int(ctx, i));
+    }
+    assert(wide->data.object_value.index != NULL);
+    assert(agent_json_path_compile(ctx, "k21", &path) == AGENT_OK);
+    assert(agent_json_path_eval(&path, wide)->data.int_value == 21);
+
+    assert(agent_json_path_compile(ctx, "a..b", &path) == AGENT_ERROR_PARSE_ERROR);
+    assert(agent_json_path_compile(ctx, "a.", &path) == AGENT_ERROR_PARSE_ERROR);
+    assert(agent_json_path_compile(ctx, "a[x]", &path) == AGENT_ERROR_PARSE_ERROR);
+    assert(agent_json_path_compile(ctx, "a[0]b", &path) == AGENT_ERROR_PARSE_ERROR);
+}
+
 TEST(construct_object) {
     agent_json_value_t* obj = agent_json_object(ctx, 4);
     assert(obj->type == AGENT_JSON_OBJECT);
@@ -269,6 +518,29 @@ TEST(construct_object) {
     assert(agent_json_object_get(obj, "value")->data.int_value == 100);
 }
 
+TEST(clone_value) {
+    const char* json = "{\"name\":\"test\",\"values\":[1,2.5,null],\"nested\":{\"flag\":true}}";
+    agent_json_parse_result_t result = agent_json_parse_cstr(ctx, json);
+    assert(result.error == AGENT_OK);
+
+    agent_context_t* other = agent_context_create(0);
+    agent_json_value_t* copy = agent_json_clone(other, result.value);
+    assert(copy != NULL);
+    assert(copy != result.value);
+
+    agent_json_value_t* name = agent_json_object_get(copy, "name");
+    assert(name != NULL);
+    assert(name->data.string_value.data != agent_json_object_get(result.value, "name")->data.string_value.data);
+    assert(agent_sv_equals_cstr(name->data.string_value, "test"));
+
+    char* a = agent_json_to_string(ctx, result.value, false);
+    char* b = agent_json_to_string(ctx, copy, false);
+    assert(strcmp(a, b) == 0);
+
+    assert(agent_json_clone(other, NULL) == NULL);
+    agent_context_destroy(other);
+}
+
 /* Serialization tests */
 
 TEST(serialize_primitives) {
@@ -337,6 +609,76 @@ TEST(serialize_escapes) {
     agent_string_free(&str);
 }
 
+TEST(serialize_escape_table) {
+    const char raw[] = "a\"b\\c\x01\x1f\r\b\f/\xe6\x97\xa5";
+    agent_json_value_t* str_val = agent_json_string_n(ctx, raw, sizeof(raw) - 1);
+
+    char* json = agent_json_to_string(ctx, str_val, false);
+    assert(json != NULL);
+    assert(strcmp(json, "\"a\\\"b\\\\c\\u0001\\u001f\\r\\b\\f/\xe6\x97\xa5\"") == 0);
+
+    agent_json_value_t* ints = agent_json_array(ctx, 3);
+    agent_json_array_append(ctx, ints, agent_json_int(ctx, 0));
+    agent_json_array_append(ctx, ints, agent_json_int(ctx, INT64_MIN));
+    agent_json_array_append(ctx, ints, agent_json_int(ctx, INT64_MAX));
+    json = agent_json_to_string(ctx, ints, false);
+    assert(strcmp(json, "[0,-9223372036854775808,9223372036854775807]") == 0);
+}
+
+TEST(serialize_doubles_shortest) {
+    static const struct {
+        double value;
+        const char* text;
+    } cases[] = {
+        {0.1, "0.1"},
+        {0.1 + 0.2, "0.30000000000000004"},
+        {-72.5, "-72.5"},
+        {3.0, "3"},
+        {1e21, "1e21"},
+        {1e-7, "1e-7"},
+        {0.000001, "0.000001"},
+        {123456.789, "123456.789"},
+        {5e-324, "5e-324"},
+        {1.7976931348623157e308, "1.7976931348623157e308"},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char* json = agent_json_to_string(ctx, agent_json_double(ctx, cases[i].value), false);
+        assert(strcmp(json, cases[i].text) == 0);
+
+        /* Reads back to the identical double */
+        agent_json_parse_result_t result = agent_json_parse_cstr(ctx, json);
+        assert(result.error == AGENT_OK);
+        double back = 0.0;
+        assert(agent_json_get_double(result.value, &back) == AGENT_OK);
+        assert(back == cases[i].value);
+    }
+}
+
+TEST(serialize_reserves_once) {
+    agent_json_value_t* obj = agent_json_object(ctx, 0);
+    for (int i = 0; i < 40; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key_%d", i);
+        agent_json_value_t* inner = agent_json_array(ctx, 0);
+        agent_json_array_append(ctx, inner, agent_json_int(ctx, i * 1000));
+        agent_json_array_append(ctx, inner, agent_json_double(ctx, i + 0.25));
+        agent_json_array_append(ctx, inner, agent_json_string(ctx, "some text value"));
+        agent_json_object_set(ctx, obj, key, inner);
+    }
+
+    agent_string_t str;
+    agent_string_init(&str, 16);
+    assert(agent_json_serialize(obj, &str, true) == AGENT_OK);
+    assert(strncmp(str.data, "{\n  \"key_0\": [\n    0,\n    0.25,\n", 32) == 0);
+
+    /* One up-front reservation covers the document without gross overshoot */
+    assert(str.capacity > str.length);
+    assert(str.capacity < 2 * str.length);
+
+    agent_string_free(&str);
+}
+
 TEST(serialize_pretty) {
     agent_json_value_t* obj = agent_json_object(ctx, 2);
     agent_json_object_set(ctx, obj, "key", agent_json_string(ctx, "value"));
@@ -351,6 +693,27 @@ TEST(serialize_pretty) {
     agent_string_free(&str);
 }
 
+TEST(serialize_canonical) {
+    const char* a = "{\"b\": 1, \"a\": {\"d\": [1, {\"z\": 0, \"y\": 1}], \"c\": true}, \"ab\": null}";
+    const char* b = "{\"ab\":null,\"a\":{\"c\":true,\"d\":[1,{\"y\":1,\"z\":0}]},\"b\":1}";
+    agent_json_parse_result_t ra = agent_json_parse_cstr(ctx, a);
+    agent_json_parse_result_t rb = agent_json_parse_cstr(ctx, b);
+    assert(ra.error == AGENT_OK && rb.error == AGENT_OK);
+
+    agent_string_t sa, sb;
+    agent_string_init(&sa, 16);
+    agent_string_init(&sb, 16);
+    assert(agent_json_serialize_canonical(ra.value, &sa) == AGENT_OK);
+    assert(agent_json_serialize_canonical(rb.value, &sb) == AGENT_OK);
+
+    /* Key order no longer matters; a key sorts before keys it prefixes */
+    assert(strcmp(sa.data, "{\"a\":{\"c\":true,\"d\":[1,{\"y\":1,\"z\":0}]},\"ab\":null,\"b\":1}") == 0);
+    assert(strcmp(sa.data, sb.data) == 0);
+
+    agent_string_free(&sa);
+    agent_string_free(&sb);
+}
+
 TEST(roundtrip) {
     const char* json = "{\"name\":\"test\",\"values\":[1,2,3],\"nested\":{\"flag\":true}}";
     agent_json_parse_result_t result = agent_json_parse_cstr(ctx, json);
@@ -373,6 +736,333 @@ TEST(roundtrip) {
     assert(values->data.array_value.count == 3);
 }
 
+/* Tape tests */
+
+TEST(tape_parse) {
+    const char* json = "{\"name\": \"grep\", \"arguments\": {\"pattern\": \"a\\\"b\", "
+                       "\"paths\": [\"x\", [1, 2, {\"deep\": null}], \"y\"], \"limit\": 10, "
+                       "\"ratio\": 0.5, \"all\": true}}";
+    agent_json_tape_parse_result_t result = agent_json_tape_parse(ctx, json, strlen(json));
+    assert(result.error == AGENT_OK);
+    assert(result.tape != NULL);
+
+    agent_json_tape_ref_t root = agent_json_tape_root(result.tape);
+    assert(agent_json_tape_type(root) == AGENT_JSON_OBJECT);
+    assert(agent_json_tape_length(root) == 2);
+
+    agent_string_view_t sv;
+    assert(agent_json_tape_get_string(agent_json_tape_object_get(root, "name"), &sv) == AGENT_OK);
+    assert(agent_sv_equals_cstr(sv, "grep"));
+
+    agent_json_tape_ref_t args = agent_json_tape_object_get(root, "arguments");
+    assert(agent_json_tape_length(args) == 5);
+    assert(agent_json_tape_get_string(agent_json_tape_object_get(args, "pattern"), &sv) == AGENT_OK);
+    assert(strcmp(sv.data, "a\"b") == 0);
+
+    /* Siblings after a nested container are reached by skipping it */
+    agent_json_tape_ref_t paths = agent_json_tape_object_get(args, "paths");
+    assert(agent_json_tape_length(paths) == 3);
+    assert(agent_json_tape_get_string(agent_json_tape_array_get(paths, 2), &sv) == AGENT_OK);
+    assert(agent_sv_equals_cstr(sv, "y"));
+    assert(!agent_json_tape_valid(agent_json_tape_array_get(paths, 3)));
+
+    int64_t limit = 0;
+    assert(agent_json_tape_get_int(agent_json_tape_object_get(args, "limit"), &limit) == AGENT_OK);
+    assert(limit == 10);
+    double ratio = 0.0;
+    assert(agent_json_tape_get_double(agent_json_tape_object_get(args, "ratio"), &ratio) == AGENT_OK);
+    assert(ratio == 0.5);
+    bool all = false;
+    assert(agent_json_tape_get_bool(agent_json_tape_object_get(args, "all"), &all) == AGENT_OK);
+    assert(all);
+    assert(!agent_json_tape_valid(agent_json_tape_object_get(args, "missing")));
+
+    /* Iterate an array without lookups */
+    agent_json_tape_ref_t inner = agent_json_tape_array_get(paths, 1);
+    size_t seen = 0;
+    for (agent_json_tape_ref_t item = agent_json_tape_child(inner); agent_json_tape_valid(item);
+         item = agent_json_tape_next(item)) {
+        seen++;
+    }
+    assert(seen == 3);
+}
+
+/* Duplicate keys resolve like the DOM does (last wins), narrow or indexed */
+TEST(tape_duplicate_keys) {
+    static const size_t widths[] = {2, 21, 40};
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        agent_string_t json;
+        agent_string_init(&json, 512);
+        agent_string_append(&json, "{\"dup\": 1");
+        for (size_t i = 2; i < widths[w]; i++) {
+            char member[64];
+            snprintf(member, sizeof(member), ", \"k%zu\": %zu", i, i);
+            agent_string_append(&json, member);
+        }
+        agent_string_append(&json, ", \"dup\": 2}");
+
+        agent_json_tape_parse_result_t tape = agent_json_tape_parse(ctx, json.data, json.length);
+        assert(tape.error == AGENT_OK);
+        int64_t value = 0;
+        assert(agent_json_tape_get_int(agent_json_tape_object_get(agent_json_tape_root(tape.tape), "dup"),
+                                       &value) == AGENT_OK);
+        assert(value == 2);
+
+        agent_json_parse_result_t dom = agent_json_parse(ctx, json.data, json.length);
+        assert(dom.error == AGENT_OK);
+        assert(agent_json_get_int(agent_json_object_get(dom.value, "dup"), &value) == AGENT_OK);
+        assert(value == 2);
+
+        agent_string_free(&json);
+    }
+}
+
+TEST(tape_to_value) {
+    const char* json = "{\"a\": [1, 2.5, \"s\", false, null], \"b\": {}, \"c\": []}";
+    agent_json_tape_parse_result_t result = agent_json_tape_parse(ctx, json, strlen(json));
+    assert(result.error == AGENT_OK);
+
+    agent_json_value_t* value = agent_json_tape_to_value(ctx, agent_json_tape_root(result.tape));
+    assert(value != NULL);
+    char* serialized = agent_json_to_string(ctx, value, false);
+    assert(strcmp(serialized, "{\"a\":[1,2.5,\"s\",false,null],\"b\":{},\"c\":[]}") == 0);
+
+    /* The copy is a normal mutable DOM */
+    assert(agent_json_object_set(ctx, value, "d", agent_json_int(ctx, 4)) == AGENT_OK);
+    assert(agent_json_object_length(value) == 4);
+}
+
+TEST(tape_errors) {
+    agent_json_tape_parse_result_t result;
+
+    result = agent_json_tape_parse(ctx, "[1, 2", 5);
+    assert(result.error != AGENT_OK);
+    assert(result.tape == NULL);
+
+    result = agent_json_tape_parse(ctx, "{\"a\" 1}", 8);
+    assert(result.error != AGENT_OK);
+
+    result = agent_json_tape_parse(ctx, "[] x", 4);
+    assert(result.error != AGENT_OK);
+
+    /* Scalar roots are allowed */
+    result = agent_json_tape_parse(ctx, " 42 ", 4);
+    assert(result.error == AGENT_OK);
+    int64_t i = 0;
+    assert(agent_json_tape_get_int(agent_json_tape_root(result.tape), &i) == AGENT_OK);
+    assert(i == 42);
+}
+
+/* Validated parsing tests */
+
+static const char* g_mode_values[] = {"fast", "exact"};
+
+static agent_property_schema_t g_limit_props[] = {
+    {.name = "max", .type = AGENT_SCHEMA_INTEGER, .required = true},
+};
+
+static agent_property_schema_t g_tag_item = {.name = "tag", .type = AGENT_SCHEMA_STRING};
+
+static agent_property_schema_t g_search_params[] = {
+    {.name = "query", .type = AGENT_SCHEMA_STRING, .required = true},
+    {.name = "mode", .type = AGENT_SCHEMA_STRING, .enum_values = g_mode_values, .enum_count = 2},
+    {.name = "limit", .type = AGENT_SCHEMA_OBJECT, .properties = g_limit_props, .properties_count = 1},
+    {.name = "tags", .type = AGENT_SCHEMA_ARRAY, .items_schema = &g_tag_item},
+    {.name = "ratio", .type = AGENT_SCHEMA_NUMBER},
+};
+
+static const agent_tool_definition_t g_search_tool = {
+    .name = "search",
+    .parameters = g_search_params,
+    .parameters_count = 5,
+};
+
+static agent_json_validated_result_t parse_search(const char* json) {
+    return agent_json_parse_validated(ctx, json, strlen(json), &g_search_tool);
+}
+
+TEST(validated_fields) {
+    agent_json_validated_result_t result = parse_search(
+        "{\"ratio\": 2, \"query\": \"\u6771\u4eac\", \"tags\": [\"a\", \"b\"], \"extra\": 1}");
+    assert(result.error == AGENT_OK);
+    assert(result.field_count == 5);
+
+    /* Fields are indexed by parameter position, not document order */
+    assert(result.fields[0] != NULL);
+    assert(strcmp(result.fields[0]->data.string_value.data, "\xe6\x9d\xb1\xe4\xba\xac") == 0);
+    assert(result.fields[1] == NULL);
+    assert(result.fields[2] == NULL);
+    assert(agent_json_array_length(result.fields[3]) == 2);
+    assert(result.fields[4]->type == AGENT_JSON_INT);
+    assert(agent_json_object_get(result.value, "extra") != NULL);
+
+    /* Optional parameters may be null */
+    result = parse_search("{\"query\": \"x\", \"mode\": null}");
+    assert(result.error == AGENT_OK);
+    assert(result.fields[1]->type == AGENT_JSON_NULL);
+}
+
+TEST(validated_errors) {
+    agent_json_validated_result_t result;
+
+    /* Type mismatch is reported at the offending value */
+    const char* json = "{\"query\": 42}";
+    result = parse_search(json);
+    assert(result.error == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(strcmp(result.error_field, "query") == 0);
+    assert(result.error_position == (size_t)(strstr(json, "42") - json));
+
+    json = "{\"query\": \"x\", \"mode\": \"slow\"}";
+    result = parse_search(json);
+    assert(result.error == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(strcmp(result.error_field, "mode") == 0);
+    assert(strcmp(result.error_message, "Value not in enum") == 0);
+    assert(result.error_position == (size_t)(strstr(json, "\"slow") - json));
+
+    result = parse_search("{\"mode\": \"fast\"}");
+    assert(result.error == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(strcmp(result.error_field, "query") == 0);
+    assert(strcmp(result.error_message, "Missing required field") == 0);
+
+    /* Nested schemas */
+    result = parse_search("{\"query\": \"x\", \"limit\": {\"max\": 1.5}}");
+    assert(result.error == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(strcmp(result.error_field, "max") == 0);
+
+    result = parse_search("{\"query\": \"x\", \"limit\": {}}");
+    assert(strcmp(result.error_field, "max") == 0);
+
+    result = parse_search("{\"query\": \"x\", \"tags\": [\"a\", 3]}");
+    assert(strcmp(result.error_field, "tag") == 0);
+
+    result = parse_search("{\"query\": null}");
+    assert(result.error == AGENT_ERROR_INVALID_ARGUMENT);
+
+    /* Syntax errors keep their usual code */
+    result = parse_search("{\"query\": \"x\"");
+    assert(result.error == AGENT_ERROR_PARSE_ERROR);
+    assert(result.fields == NULL);
+}
+
+TEST(tool_args_flatten) {
+    agent_json_validated_result_t parsed = parse_search(
+        "{\"tags\": [\"a\"], \"ratio\": 2, \"query\": \"x\", \"mode\": null}");
+    assert(parsed.error == AGENT_OK);
+
+    /* Slots follow the parameter order, typed by the schema */
+    agent_tool_arg_t args[5];
+    const char* field = "unset";
+    assert(agent_tool_args_flatten(&g_search_tool, parsed.value, args, &field) == AGENT_OK);
+    assert(field == NULL);
+    assert(args[0].present && args[0].type == AGENT_SCHEMA_STRING);
+    assert(agent_sv_equals_cstr(args[0].data.string_value, "x"));
+    assert(!args[1].present && !args[2].present);
+    assert(args[3].present && agent_json_array_length(args[3].value) == 1);
+    assert(args[4].present && args[4].data.number_value == 2.0);
+
+    /* Wrong types and missing required parameters name the parameter */
+    agent_json_parse_result_t bad = agent_json_parse_cstr(ctx, "{\"query\": \"x\", \"ratio\": \"2\"}");
+    assert(agent_tool_args_flatten(&g_search_tool, bad.value, args, &field) == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(strcmp(field, "ratio") == 0);
+    bad = agent_json_parse_cstr(ctx, "{\"query\": null}");
+    assert(agent_tool_args_flatten(&g_search_tool, bad.value, args, &field) == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(strcmp(field, "query") == 0);
+    assert(agent_tool_args_flatten(&g_search_tool, NULL, args, NULL) == AGENT_ERROR_INVALID_ARGUMENT);
+
+    /* Integers must not have a fraction */
+    static agent_property_schema_t count_param = {.name = "count", .type = AGENT_SCHEMA_INTEGER};
+    static const agent_tool_definition_t count_tool = {.name = "count", .parameters = &count_param,
+                                                      .parameters_count = 1};
+    bad = agent_json_parse_cstr(ctx, "{\"count\": 1.5}");
+    assert(agent_tool_args_flatten(&count_tool, bad.value, args, NULL) == AGENT_ERROR_INVALID_ARGUMENT);
+    bad = agent_json_parse_cstr(ctx, "{\"count\": -3}");
+    assert(agent_tool_args_flatten(&count_tool, bad.value, args, NULL) == AGENT_OK);
+    assert(args[0].data.int_value == -3);
+}
+
+/* Incremental parsing tests */
+
+static agent_json_incremental_status_t feed_str(agent_json_incremental_t* inc, const char* text) {
+    return agent_json_incremental_feed(inc, text, strlen(text));
+}
+
+TEST(incremental_chunks) {
+    const char* json = "{\"name\": \"read_file\", \"arguments\": {\"path\": \"/a}b\\\"c\", \"n\": [1, 2]}}";
+    agent_json_incremental_t inc;
+    assert(agent_json_incremental_init(&inc, ctx) == AGENT_OK);
+
+    /* Feed one byte at a time */
+    size_t len = strlen(json);
+    for (size_t i = 0; i + 1 < len; i++) {
+        assert(agent_json_incremental_feed(&inc, json + i, 1) == AGENT_JSON_INCREMENTAL_NEED_MORE);
+        assert(agent_json_incremental_value(&inc) == NULL);
+    }
+    assert(agent_json_incremental_feed(&inc, json + len - 1, 1) == AGENT_JSON_INCREMENTAL_COMPLETE);
+
+    agent_json_value_t* value = agent_json_incremental_value(&inc);
+    assert(value != NULL);
+    agent_json_value_t* args = agent_json_object_get(value, "arguments");
+    assert(args != NULL);
+    agent_json_value_t* path = agent_json_object_get(args, "path");
+    assert(path != NULL);
+    assert(strcmp(path->data.string_value.data, "/a}b\"c") == 0);
+
+    agent_json_incremental_free(&inc);
+}
+
+TEST(incremental_early_field) {
+    agent_json_incremental_t inc;
+    assert(agent_json_incremental_init(&inc, ctx) == AGENT_OK);
+
+    feed_str(&inc, "  {\"name\":\"sea");
+    assert(agent_json_incremental_field(&inc, "name") == NULL);
+
+    feed_str(&inc, "rch\" , \"arguments\": {\"q\": ");
+    agent_json_value_t* name = agent_json_incremental_field(&inc, "name");
+    assert(name != NULL);
+    assert(name->type == AGENT_JSON_STRING);
+    assert(strcmp(name->data.string_value.data, "search") == 0);
+    assert(agent_json_incremental_field(&inc, "arguments") == NULL);
+
+    /* Trailing bytes after the document are ignored */
+    assert(feed_str(&inc, "\"x\"}} tail") == AGENT_JSON_INCREMENTAL_COMPLETE);
+    assert(strcmp(inc.buffer.data + inc.buffer.length - 3, "\"}}") == 0);
+
+    agent_json_value_t* args = agent_json_incremental_field(&inc, "arguments");
+    assert(args != NULL);
+    assert(args->type == AGENT_JSON_OBJECT);
+
+    /* Reset for a new document */
+    agent_json_incremental_reset(&inc);
+    assert(feed_str(&inc, "[1,{},2]") == AGENT_JSON_INCREMENTAL_COMPLETE);
+    agent_json_value_t* value = agent_json_incremental_value(&inc);
+    assert(value != NULL);
+    assert(value->type == AGENT_JSON_ARRAY);
+
+    agent_json_incremental_free(&inc);
+}
+
+TEST(incremental_errors) {
+    agent_json_incremental_t inc;
+    assert(agent_json_incremental_init(&inc, ctx) == AGENT_OK);
+
+    assert(feed_str(&inc, "42") == AGENT_JSON_INCREMENTAL_ERROR);
+
+    agent_json_incremental_reset(&inc);
+    assert(feed_str(&inc, "{\"a\": [1}") == AGENT_JSON_INCREMENTAL_ERROR);
+
+    agent_json_incremental_reset(&inc);
+    assert(feed_str(&inc, "{\"a\" 1}") == AGENT_JSON_INCREMENTAL_ERROR);
+
+    /* Structurally balanced but invalid scalars surface on parse */
+    agent_json_incremental_reset(&inc);
+    assert(feed_str(&inc, "{\"a\": nope}") == AGENT_JSON_INCREMENTAL_COMPLETE);
+    assert(agent_json_incremental_value(&inc) == NULL);
+    assert(inc.status == AGENT_JSON_INCREMENTAL_ERROR);
+
+    agent_json_incremental_free(&inc);
+}
+
 int main(void) {
     ctx = agent_context_create(0);
     assert(ctx != NULL);
@@ -383,12 +1073,16 @@ int main(void) {
     RUN_TEST(parse_bool);
     RUN_TEST(parse_int);
     RUN_TEST(parse_double);
+    RUN_TEST(parse_number_paths);
     RUN_TEST(parse_string);
     RUN_TEST(parse_string_escapes);
+    RUN_TEST(parse_insitu);
     RUN_TEST(parse_array);
     RUN_TEST(parse_object);
+    RUN_TEST(parse_interned_keys);
     RUN_TEST(parse_nested);
     RUN_TEST(parse_whitespace);
+    RUN_TEST(parse_long_runs);
     RUN_TEST(parse_errors);
 
     agent_context_reset(ctx);
@@ -397,7 +1091,12 @@ int main(void) {
 
     RUN_TEST(construct_values);
     RUN_TEST(construct_array);
+    RUN_TEST(construct_array_growth);
+    RUN_TEST(parse_exact_capacity);
+    RUN_TEST(wide_object_index);
     RUN_TEST(construct_object);
+    RUN_TEST(compiled_path);
+    RUN_TEST(clone_value);
 
     agent_context_reset(ctx);
 
@@ -407,9 +1106,38 @@ int main(void) {
     RUN_TEST(serialize_array);
     RUN_TEST(serialize_object);
     RUN_TEST(serialize_escapes);
+    RUN_TEST(serialize_escape_table);
+    RUN_TEST(serialize_doubles_shortest);
+    RUN_TEST(serialize_reserves_once);
     RUN_TEST(serialize_pretty);
+    RUN_TEST(serialize_canonical);
     RUN_TEST(roundtrip);
 
+    agent_context_reset(ctx);
+
+    printf("\nRunning validated parsing tests...\n");
+
+    RUN_TEST(validated_fields);
+    RUN_TEST(validated_errors);
+    RUN_TEST(tool_args_flatten);
+
+    agent_context_reset(ctx);
+
+    printf("\nRunning JSON tape tests...\n");
+
+    RUN_TEST(tape_parse);
+    RUN_TEST(tape_duplicate_keys);
+    RUN_TEST(tape_to_value);
+    RUN_TEST(tape_errors);
+
+    agent_context_reset(ctx);
+
+    printf("\nRunning incremental JSON tests...\n");
+
+    RUN_TEST(incremental_chunks);
+    RUN_TEST(incremental_early_field);
+    RUN_TEST(incremental_errors);
+
     agent_context_destroy(ctx);
 
     printf("\nAll JSON tests passed!\n");
@@ -50,6 +50,88 @@ static agent_llm_result_t mock_generate(
     return result;
 }
 
+/* Streams the response in small chunks and stops when the callback says so */
+static size_t mock_streamed_bytes = 0;
+
+static agent_llm_result_t mock_generate_chunked(
+    const agent_message_t* messages,
+    size_t message_count,
+    const char* system_prompt,
+    agent_token_callback_t token_callback,
+    void* user_data
+) {
+    (void)messages;
+    (void)message_count;
+    (void)system_prompt;
+
+    generate_call_count++;
+
+    agent_llm_result_t result = {0};
+    result.error = AGENT_OK;
+
+    const char* response = mock_responses[mock_response_index++];
+    if (!response) {
+        response = "Default response";
+    }
+
+    size_t length = strlen(response);
+    size_t pos = 0;
+    while (pos < length) {
+        size_t chunk = length - pos < 4 ? length - pos : 4;
+        mock_streamed_bytes += chunk;
+        bool more = token_callback(response + pos, chunk, user_data);
+        pos += chunk;
+        if (!more) break;
+    }
+
+    result.text.data = response;
+    result.text.length = pos;
+
+    return result;
+}
+
+/* Records the stable-prefix hint of every call */
+static size_t prefix_hints[10];
+static size_t prefix_message_counts[10];
+static agent_uuid_t prefix_conversations[10];
+
+static agent_llm_result_t mock_generate_with_prefix(
+    const agent_message_t* messages,
+    size_t message_count,
+    const char* system_prompt,
+    const agent_generation_info_t* info,
+    agent_token_callback_t token_callback,
+    void* user_data
+) {
+    prefix_hints[generate_call_count] = info->stable_prefix_count;
+    prefix_message_counts[generate_call_count] = message_count;
+    prefix_conversations[generate_call_count] = info->conversation_id;
+    return mock_generate(messages, message_count, system_prompt, token_callback, user_data);
+}
+
+/* Keeps a copy of the messages sent to the latest generation */
+static agent_message_t sent_messages[32];
+static size_t sent_count = 0;
+
+static agent_llm_result_t mock_generate_recording(
+    const agent_message_t* messages,
+    size_t message_count,
+    const char* system_prompt,
+    agent_token_callback_t token_callback,
+    void* user_data
+) {
+    sent_count = message_count < 32 ? message_count : 32;
+    memcpy(sent_messages, messages, sent_count * sizeof(agent_message_t));
+    return mock_generate(messages, message_count, system_prompt, token_callback, user_data);
+}
+
+/* One token per byte keeps budgets easy to reason about */
+static size_t count_bytes(const char* text, size_t len, void* user_data) {
+    (void)text;
+    (void)user_data;
+    return len;
+}
+
 static agent_tool_execute_result_t mock_execute_tool(
     const char* tool_name,
     const agent_json_value_t* arguments,
@@ -93,6 +175,61 @@ static void reset_mocks(void) {
     }
 }
 
+/* Scripted batch backend: each session streams its next response in 4-byte tokens */
+#define MAX_SCHEDULED 4
+
+static const char* scheduled_responses[MAX_SCHEDULED][4];
+static size_t scheduled_turn[MAX_SCHEDULED];
+static size_t scheduled_pos[MAX_SCHEDULED];
+static size_t decode_steps = 0;
+static size_t decode_sizes[64];
+static size_t decode_first_session[64];
+static size_t prefill_count = 0;
+static size_t ended_sequences = 0;
+
+static void mock_decode_batch(const agent_sequence_t* sequences, size_t count,
+                              agent_decoded_token_t* out, void* user_data) {
+    (void)user_data;
+    assert(decode_steps < 64);
+    decode_sizes[decode_steps] = count;
+    decode_first_session[decode_steps] = sequences[0].session;
+    decode_steps++;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t s = sequences[i].session;
+        if (sequences[i].prefill) {
+            assert(sequences[i].message_count > 0 && sequences[i].system_prompt != NULL);
+            prefill_count++;
+            scheduled_pos[s] = 0;
+        }
+
+        const char* response = scheduled_responses[s][scheduled_turn[s]];
+        size_t length = strlen(response);
+        size_t chunk = length - scheduled_pos[s] < 4 ? length - scheduled_pos[s] : 4;
+        out[i].text = response + scheduled_pos[s];
+        out[i].length = chunk;
+        scheduled_pos[s] += chunk;
+        if (scheduled_pos[s] == length) {
+            out[i].finished = true;
+            scheduled_turn[s]++;
+        }
+    }
+}
+
+static void mock_end_sequence(size_t session, void* user_data) {
+    (void)session;
+    (void)user_data;
+    ended_sequences++;
+}
+
+static void reset_scheduled(void) {
+    memset(scheduled_responses, 0, sizeof(scheduled_responses));
+    memset(scheduled_turn, 0, sizeof(scheduled_turn));
+    decode_steps = 0;
+    prefill_count = 0;
+    ended_sequences = 0;
+}
+
 /* Tests */
 
 TEST(init_free) {
@@ -142,6 +279,13 @@ TEST(init_requires_callbacks) {
     config.execute_tool = mock_execute_tool;
     err = agent_init(&state, &config);
     assert(err == AGENT_OK);
+    agent_free(&state);
+
+    /* The prefix-aware callback stands in for generate */
+    config.generate = NULL;
+    config.generate_with_prefix = mock_generate_with_prefix;
+    err = agent_init(&state, &config);
+    assert(err == AGENT_OK);
 
     agent_free(&state);
 }
@@ -169,6 +313,134 @@ TEST(add_messages) {
     assert(messages[0].role == AGENT_ROLE_USER);
     assert(messages[1].role == AGENT_ROLE_SYSTEM);
 
+    /* Roles move with the messages as the array grows */
+    for (int i = 0; i < 100; i++) {
+        err = i % 3 == 0 ? agent_add_system_message(&state, "Note")
+                         : agent_add_user_message(&state, "More");
+        assert(err == AGENT_OK);
+    }
+    agent_get_messages(&state, &messages, &count);
+    assert(count == 102);
+    assert(state.messages.capacity >= count);
+    for (size_t i = 0; i < count; i++) {
+        assert(state.messages.roles[i] == (uint8_t)messages[i].role);
+    }
+
+    agent_free(&state);
+}
+
+static int pressure_calls = 0;
+
+static void count_pressure(size_t footprint, size_t soft_limit, void* user_data) {
+    (void)user_data;
+    assert(footprint > soft_limit);
+    pressure_calls++;
+}
+
+TEST(memory_budget) {
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.memory_soft_limit = 100 * 1024;
+    config.memory_hard_limit = 200 * 1024;
+    config.on_memory_pressure = count_pressure;
+    agent_init(&state, &config);
+
+    static char big[16 * 1024];
+    memset(big, 'a', sizeof(big) - 1);
+
+    pressure_calls = 0;
+    agent_error_t err = AGENT_OK;
+    int added = 0;
+    while (err == AGENT_OK && added < 100) {
+        err = agent_add_user_message(&state, big);
+        if (err == AGENT_OK) added++;
+    }
+
+    assert(err == AGENT_ERROR_OUT_OF_MEMORY);
+    assert(added > 0 && added < 100);
+    assert(pressure_calls == 1);
+
+    /* Existing history is untouched */
+    const agent_message_t* messages;
+    size_t count;
+    agent_get_messages(&state, &messages, &count);
+    assert(count == (size_t)added);
+
+    /* Reset brings the footprint back under the budget */
+    agent_reset(&state);
+    assert(agent_add_user_message(&state, big) == AGENT_OK);
+
+    agent_free(&state);
+}
+
+/* Decodes to a 4x2 image whose pixels count up; "bad" images fail */
+static int preprocess_calls = 0;
+static uint32_t preprocess_max_side = 0;
+
+static bool mock_preprocess(const uint8_t* data, size_t size, uint32_t max_side,
+                            agent_image_t* out, void* user_data) {
+    (void)user_data;
+    static uint8_t pixels[4 * 2 * 3];
+    preprocess_calls++;
+    preprocess_max_side = max_side;
+    if (size == 3 && memcmp(data, "bad", 3) == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(pixels); i++) {
+        pixels[i] = (uint8_t)i;
+    }
+    out->pixels = pixels;
+    out->width = 4;
+    out->height = 2;
+    return true;
+}
+
+TEST(image_preprocess) {
+    static const uint8_t jpeg[] = {0xFF, 0xD8, 0x00, 0x01, 0x02, 0xFF, 0xD9};
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.image_preprocess = mock_preprocess;
+    agent_init(&state, &config);
+
+    preprocess_calls = 0;
+    assert(agent_add_user_message_with_image(&state, "What is this?", jpeg, sizeof(jpeg)) == AGENT_OK);
+    assert(agent_add_user_message_with_image(&state, "And this?", (const uint8_t*)"bad", 3) == AGENT_OK);
+    assert(agent_add_user_message(&state, "No image") == AGENT_OK);
+    assert(preprocess_calls == 2);
+    assert(preprocess_max_side == AGENT_IMAGE_INPUT_SIZE);
+
+    const agent_message_t* messages;
+    size_t count;
+    agent_get_messages(&state, &messages, &count);
+    assert(count == 3);
+
+    /* Decoded pixels replace the JPEG */
+    assert(messages[0].image_width == 4 && messages[0].image_height == 2);
+    assert(messages[0].image_data_size == 4 * 2 * 3);
+    assert(messages[0].image_data[5] == 5);
+
+    /* A failed decode keeps the encoded bytes */
+    assert(messages[1].image_width == 0 && messages[1].image_height == 0);
+    assert(messages[1].image_data_size == 3 && memcmp(messages[1].image_data, "bad", 3) == 0);
+    assert(messages[2].image_data == NULL);
+
+    /* The size survives a snapshot */
+    agent_string_t snapshot;
+    agent_string_init(&snapshot, 256);
+    assert(agent_state_save(&state, &snapshot) == AGENT_OK);
+    agent_reset(&state);
+    assert(agent_state_load(&state, snapshot.data, snapshot.length) == AGENT_OK);
+    agent_get_messages(&state, &messages, &count);
+    assert(count == 3);
+    assert(messages[0].image_width == 4 && messages[0].image_height == 2);
+    assert(messages[0].image_data_size == 4 * 2 * 3 && messages[0].image_data[5] == 5);
+    assert(messages[1].image_width == 0);
+    agent_string_free(&snapshot);
+
     agent_free(&state);
 }
 
@@ -245,151 +517,1989 @@ TEST(multiple_tool_calls) {
     agent_free(&state);
 }
 
-TEST(max_iterations) {
-    reset_mocks();
-    /* Always return tool call - will hit max iterations */
-    for (int i = 0; i < 10; i++) {
-        mock_responses[i] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+/* Batch executor: answers every call through the single-call mock */
+static int batch_call_count = 0;
+static size_t batch_size = 0;
+
+static void mock_execute_tools(const char* const* tool_names,
+                               const agent_json_value_t* const* arguments,
+                               size_t count, agent_tool_execute_result_t* results,
+                               void* user_data) {
+    batch_call_count++;
+    batch_size = count;
+    /* Fill back to front, as completions from a pool might arrive */
+    for (size_t i = count; i-- > 0;) {
+        results[i] = mock_execute_tool(tool_names[i], arguments[i], user_data);
     }
+}
+
+TEST(batched_tool_calls) {
+    reset_mocks();
+    batch_call_count = 0;
+    mock_responses[0] =
+        "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>"
+        "<tool_call>{\"name\": \"error_tool\", \"arguments\": {}}</tool_call>"
+        "<tool_call>{\"name\": \"other_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[2] = "All done!";
 
     agent_state_t state;
     agent_config_t config = {0};
-    config.generate = mock_generate;
+    config.generate = mock_generate_recording;
     config.execute_tool = mock_execute_tool;
-    config.max_iterations = 3;
+    config.execute_tools = mock_execute_tools;
     agent_init(&state, &config);
 
-    agent_add_user_message(&state, "Loop forever");
-
+    agent_add_user_message(&state, "Use tools");
     agent_run_result_t result = agent_run(&state);
 
-    assert(result.error == AGENT_ERROR_MAX_ITERATIONS);
-    assert(result.iterations == 3);
-    assert(tool_call_count == 3);
+    assert(result.error == AGENT_OK);
+    assert(result.tool_calls_count == 4);
+
+    /* Three calls went out together; the lone call used execute_tool */
+    assert(batch_call_count == 1);
+    assert(batch_size == 3);
+    assert(tool_call_count == 4);
+
+    /* Tool messages reach the model in call order and answer the matching call */
+    const char* expected[] = {"Tool result: success", "Error: something went wrong",
+                              "Unknown tool", "Tool result: success"};
+    size_t seen = 0;
+    for (size_t i = 0; i < sent_count; i++) {
+        const agent_message_t* msg = &sent_messages[i];
+        if (msg->role != AGENT_ROLE_TOOL) continue;
+        assert(seen < 4);
+        assert(agent_sv_equals_cstr(msg->content, expected[seen]));
+        assert(agent_uuid_equals(msg->tool_results[0].tool_call_id, result.tool_calls[seen].id));
+        assert(msg->tool_results[0].is_error == (seen == 1));
+        seen++;
+    }
+    assert(seen == 4);
 
     agent_free(&state);
 }
 
-TEST(reset) {
+TEST(tool_result_cache) {
     reset_mocks();
-    mock_responses[0] = "Response 1";
+    batch_call_count = 0;
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {\"a\": 1, \"b\": [2]}}</tool_call>";
+    mock_responses[1] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {\"b\": [2], \"a\": 1}}</tool_call>"
+                        "<tool_call>{\"name\": \"error_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[2] = "<tool_call>{\"name\": \"error_tool\", \"arguments\": {}}</tool_call>"
+                        "<tool_call>{\"name\": \"other_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[3] = "Done";
+
+    agent_tool_registry_t registry;
+    agent_tool_registry_init(&registry, 4);
+    agent_tool_definition_t pure = {"test_tool", "Pure", NULL, 0, AGENT_TOOL_CACHE_FOREVER, NULL, 0};
+    agent_tool_definition_t flaky = {"error_tool", "Fails", NULL, 0, 60000, NULL, 0};
+    agent_tool_definition_t side_effect = {"other_tool", "Writes", NULL, 0, 0, NULL, 0};
+    agent_tool_registry_add(&registry, &pure);
+    agent_tool_registry_add(&registry, &flaky);
+    agent_tool_registry_add(&registry, &side_effect);
 
     agent_state_t state;
     agent_config_t config = {0};
     config.generate = mock_generate;
     config.execute_tool = mock_execute_tool;
+    config.execute_tools = mock_execute_tools;
+    config.tool_registry = &registry;
     agent_init(&state, &config);
 
-    agent_add_user_message(&state, "First");
-    agent_run(&state);
-
-    /* Reset and run again */
+    /* Same arguments in another key order hit; error results are never kept */
+    agent_add_user_message(&state, "Go");
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK && result.tool_calls_count == 5);
+    assert(tool_call_count == 4);
+    assert(batch_call_count == 1);
+    assert(state.tool_cache.hits == 1);
+    assert(state.tool_cache.misses == 3);
+    assert(state.tool_cache.count == 1);
+
+    /* Expired entries run again */
+    reset_mocks();
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {\"b\": [2], \"a\": 1}}</tool_call>";
+    state.tool_cache.entries[0].expires_ms = 0;
+    agent_add_user_message(&state, "Again");
+    result = agent_run(&state);
+    assert(result.error == AGENT_OK && tool_call_count == 1);
+    assert(state.tool_cache.hits == 1 && state.tool_cache.misses == 4);
+
+    /* Survives a reset until cleared */
     agent_reset(&state);
-    mock_response_index = 0;
-    mock_responses[0] = "Response 2";
+    agent_tool_call_t call = {0};
+    call.name = agent_sv_from_cstr("test_tool");
+    call.arguments = agent_json_parse_cstr(state.iteration_ctx, "{\"a\": 1, \"b\": [2]}").value;
+    agent_tool_result_t cached = agent_execute_tool(&state, &call);
+    assert(agent_sv_equals_cstr(cached.content, "Tool result: success"));
+    assert(tool_call_count == 1 && state.tool_cache.hits == 2);
+    agent_tool_cache_clear(&state);
+    agent_execute_tool(&state, &call);
+    assert(tool_call_count == 2 && state.tool_cache.count == 1);
 
-    const agent_message_t* messages;
-    size_t count;
-    agent_get_messages(&state, &messages, &count);
-    assert(count == 0);  /* Messages cleared */
+    agent_free(&state);
+    agent_tool_registry_free(&registry);
+}
 
-    agent_add_user_message(&state, "Second");
-    agent_run_result_t result = agent_run(&state);
+TEST(image_embedding_cache) {
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.image_cache_capacity = 2;
+    agent_init(&state, &config);
 
-    assert(result.error == AGENT_OK);
-    assert(strstr(result.response.data, "Response 2") != NULL);
+    agent_uuid_t ids[3];
+    for (int i = 0; i < 3; i++) {
+        ids[i] = agent_uuid_generate();
+    }
+    float embedding[2 * 3] = {1, 2, 3, 4, 5, 6};
+    size_t n_tokens = 0, n_embd = 0;
+
+    assert(agent_image_embedding_lookup(&state, ids[0], &n_tokens, &n_embd) == NULL);
+    assert(agent_image_embedding_store(&state, ids[0], embedding, 0, 3) == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(agent_image_embedding_store(&state, ids[0], embedding, 2, 3) == AGENT_OK);
+
+    /* A copy is kept */
+    embedding[0] = 9;
+    const float* found = agent_image_embedding_lookup(&state, ids[0], &n_tokens, &n_embd);
+    assert(found && found[0] == 1 && found[5] == 6);
+    assert(n_tokens == 2 && n_embd == 3);
+
+    /* Storing again replaces the entry */
+    assert(agent_image_embedding_store(&state, ids[0], embedding, 1, 3) == AGENT_OK);
+    found = agent_image_embedding_lookup(&state, ids[0], &n_tokens, &n_embd);
+    assert(found && found[0] == 9 && n_tokens == 1);
+    assert(state.image_cache.count == 1);
+
+    /* Full: the least recently used entry makes room */
+    assert(agent_image_embedding_store(&state, ids[1], embedding, 2, 3) == AGENT_OK);
+    assert(agent_image_embedding_lookup(&state, ids[0], NULL, NULL) != NULL);
+    assert(agent_image_embedding_store(&state, ids[2], embedding, 2, 3) == AGENT_OK);
+    assert(agent_image_embedding_lookup(&state, ids[1], NULL, NULL) == NULL);
+    assert(agent_image_embedding_lookup(&state, ids[0], NULL, NULL) != NULL);
+    assert(agent_image_embedding_lookup(&state, ids[2], NULL, NULL) != NULL);
+
+    /* Kept across agent_reset, like the tool cache */
+    agent_reset(&state);
+    assert(agent_image_embedding_lookup(&state, ids[2], NULL, NULL) != NULL);
+    assert(state.image_cache.hits == 6 && state.image_cache.misses == 2);
+
+    agent_image_cache_clear(&state);
+    assert(state.image_cache.count == 0);
+    assert(agent_image_embedding_lookup(&state, ids[2], NULL, NULL) == NULL);
 
     agent_free(&state);
 }
 
-TEST(stop) {
+TEST(early_tool_dispatch) {
     reset_mocks();
-    mock_responses[0] = "Starting...";
+    mock_responses[0] = "Let me check. <tool_call>{\"name\": \"test_tool\", \"arguments\": {\"x\": 1}}"
+                        "\n\n\n</tool_call>\n";
+    mock_responses[1] = "Done.";
+    mock_streamed_bytes = 0;
 
     agent_state_t state;
     agent_config_t config = {0};
-    config.generate = mock_generate;
+    config.generate = mock_generate_chunked;
     config.execute_tool = mock_execute_tool;
+    config.early_tool_dispatch = true;
     agent_init(&state, &config);
 
-    agent_add_user_message(&state, "Test");
+    agent_add_user_message(&state, "Use a tool");
 
-    /* Stop before running - should cancel immediately */
-    agent_stop(&state);
+    agent_run_result_t result = agent_run(&state);
 
-    /* Note: In a real async scenario, we'd test stopping mid-execution */
+    assert(result.error == AGENT_OK);
+    assert(tool_call_count == 1);
+    assert(result.tool_calls_count == 1);
+    int64_t x = 0;
+    assert(agent_json_get_int(agent_json_object_get(result.tool_calls[0].arguments, "x"), &x) == AGENT_OK);
+    assert(x == 1);
+
+    /* Generation stopped in the chunk holding the closing brace, before the
+       16 bytes of whitespace and closing tag that follow it */
+    assert(mock_streamed_bytes <= strlen(mock_responses[0]) - 16 + 3 + strlen(mock_responses[1]));
 
     agent_free(&state);
 }
 
-TEST(build_system_prompt) {
+static int speculated_count = 0;
+static int discarded_count = 0;
+static size_t speculated_at_bytes = 0;
+static int executed_at_speculation = 0;
+
+static void mock_start_tool(const char* tool_name, const agent_json_value_t* arguments,
+                            void* user_data) {
+    (void)tool_name;
+    (void)arguments;
+    (void)user_data;
+    speculated_count++;
+    speculated_at_bytes = mock_streamed_bytes;
+    executed_at_speculation = tool_call_count;
+}
+
+static void mock_discard_tool(const char* tool_name, const agent_json_value_t* arguments,
+                              void* user_data) {
+    (void)arguments;
+    (void)user_data;
+    assert(strcmp(tool_name, "test_tool") == 0);
+    discarded_count++;
+}
+
+TEST(speculative_tool_calls) {
+    reset_mocks();
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {\"x\": 1}}</tool_call>"
+                        " and some more text the model keeps decoding";
+    mock_responses[1] = "Done.";
+    mock_streamed_bytes = 0;
+    speculated_count = 0;
+    discarded_count = 0;
+
     agent_state_t state;
     agent_config_t config = {0};
-    config.generate = mock_generate;
+    config.generate = mock_generate_chunked;
     config.execute_tool = mock_execute_tool;
-    config.get_tools_schema = mock_get_tools_schema;
-    config.use_japanese = false;
-    config.custom_system_prompt = "Custom instruction here.";
+    config.start_tool = mock_start_tool;
+    config.discard_tool = mock_discard_tool;
     agent_init(&state, &config);
 
-    char* prompt = agent_build_system_prompt(&state);
-
-    assert(prompt != NULL);
-    assert(strstr(prompt, "helpful") != NULL);  /* Default prompt text */
-    assert(strstr(prompt, "tool_call") != NULL);  /* Tool call format */
-    assert(strstr(prompt, "Custom instruction") != NULL);  /* Custom prompt */
+    /* Started mid-decode, confirmed by the final parse, then executed */
+    agent_add_user_message(&state, "Use a tool");
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK && result.tool_calls_count == 1);
+    assert(speculated_count == 1 && discarded_count == 0);
+    assert(speculated_at_bytes < strlen(mock_responses[0]));
+    assert(executed_at_speculation == 0 && tool_call_count == 1);
+
+    /* A generation that fails never asks for what it started */
+    const char* call = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}";
+    agent_add_user_message(&state, "Again");
+    assert(agent_run_begin(&state) == AGENT_OK);
+    assert(agent_run_feed_token(&state, call, strlen(call)));
+    assert(speculated_count == 2);
+    agent_llm_result_t failed = {AGENT_ERROR_CANCELLED, {NULL, 0}};
+    assert(agent_run_submit_generation(&state, &failed) == AGENT_OK);
+    assert(discarded_count == 1);
+    assert(agent_run_end(&state).error == AGENT_ERROR_CANCELLED);
+    assert(tool_call_count == 1);
 
     agent_free(&state);
 }
 
-TEST(build_system_prompt_japanese) {
+TEST(dialect_tool_call) {
+    reset_mocks();
+    mock_responses[0] = "[TOOL_CALLS][{\"name\": \"test_tool\", \"arguments\": {}}]";
+    mock_responses[1] = "Done.";
+
     agent_state_t state;
     agent_config_t config = {0};
     config.generate = mock_generate;
     config.execute_tool = mock_execute_tool;
-    config.use_japanese = true;
-    agent_init(&state, &config);
+    config.dialect = agent_parser_dialect_builtin(AGENT_DIALECT_MISTRAL);
+    assert(agent_init(&state, &config) == AGENT_OK);
 
-    char* prompt = agent_build_system_prompt(&state);
+    agent_add_user_message(&state, "Use a tool");
 
-    assert(prompt != NULL);
-    /* Should contain Japanese text */
-    assert(strstr(prompt, "アシスタント") != NULL ||
-           strstr(prompt, "ツール") != NULL);
+    agent_run_result_t result = agent_run(&state);
+
+    assert(result.error == AGENT_OK);
+    assert(tool_call_count == 1);
+    assert(result.iterations == 2);
 
     agent_free(&state);
+
+    /* Unusable dialects are rejected up front */
+    agent_parser_dialect_t bad = {0};
+    config.dialect = &bad;
+    assert(agent_init(&state, &config) == AGENT_ERROR_INVALID_ARGUMENT);
 }
 
-TEST(truncate_text) {
-    agent_context_t* ctx = agent_context_create(0);
+TEST(step_driven_run) {
+    reset_mocks();
 
-    const char* long_text = "This is a very long text that should be truncated";
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "Use tools");
 
-    char* truncated = agent_truncate_text(ctx, long_text, 20);
-    assert(truncated != NULL);
-    assert(strlen(truncated) <= 20);
-    assert(strstr(truncated, "...") != NULL);
+    assert(agent_run_poll(&state, NULL) == AGENT_RUN_IDLE);
+    assert(agent_run_begin(&state) == AGENT_OK);
+    assert(agent_run_begin(&state) == AGENT_ERROR_INVALID_ARGUMENT);
+
+    agent_run_request_t request;
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.system_prompt != NULL);
+    assert(request.message_count == 1);
+
+    /* Streamed in pieces */
+    const char* tokens[] = {
+        "<tool_call>{\"name\": \"test_tool\", ", "\"arguments\": {}}</tool_call>",
+        "<tool_call>{\"name\": \"error_tool\", \"arguments\": {}}</tool_call>"
+    };
+    for (size_t i = 0; i < 3; i++) {
+        assert(agent_run_feed_token(&state, tokens[i], strlen(tokens[i])));
+    }
+    agent_llm_result_t generation = {AGENT_OK, {NULL, 0}};
+    assert(agent_run_submit_generation(&state, &generation) == AGENT_OK);
+
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_TOOL_RESULTS);
+    assert(request.tool_call_count == 2);
+    assert(agent_sv_equals_cstr(request.tool_calls[1].name, "error_tool"));
+
+    /* Answered out of order; each call answered once */
+    agent_tool_execute_result_t second = {AGENT_OK, agent_sv_from_cstr("second"), true};
+    agent_tool_execute_result_t first = {AGENT_OK, agent_sv_from_cstr("first"), false};
+    assert(agent_run_submit_tool_result(&state, 1, &second) == AGENT_OK);
+    assert(agent_run_submit_tool_result(&state, 1, &second) == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(agent_run_submit_tool_result(&state, 2, &second) == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(agent_run_submit_tool_result(&state, 0, &first) == AGENT_OK);
+
+    /* History has the results in call order */
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.message_count == 3);
+    assert(agent_sv_equals_cstr(request.messages[1].content, "first"));
+    assert(agent_sv_equals_cstr(request.messages[2].content, "second"));
+    assert(request.messages[2].tool_results[0].is_error);
+
+    /* Not streamed: the whole text is the response */
+    generation.text = agent_sv_from_cstr("All done");
+    assert(agent_run_submit_generation(&state, &generation) == AGENT_OK);
+    assert(agent_run_poll(&state, NULL) == AGENT_RUN_DONE);
+
+    agent_run_result_t result = agent_run_end(&state);
+    assert(result.error == AGENT_OK);
+    assert(agent_sv_equals_cstr(agent_sv_trim(result.response), "All done"));
+    assert(result.tool_calls_count == 2);
+    assert(result.iterations == 2);
+    assert(!agent_is_processing(&state));
+    assert(agent_run_end(&state).error == AGENT_ERROR_INVALID_ARGUMENT);
 
-    /* Short text should not be truncated */
-    char* short_result = agent_truncate_text(ctx, "Short", 100);
-    assert(strcmp(short_result, "Short") == 0);
+    /* The role column mirrors the stored messages */
+    assert(state.messages.count == 2);
+    for (size_t i = 0; i < state.messages.count; i++) {
+        assert(state.messages.roles[i] == (uint8_t)state.messages.messages[i].role);
+    }
 
-    agent_context_destroy(ctx);
-}
+    /* The host drove everything; no callbacks were used */
+    assert(generate_call_count == 0);
+    assert(tool_call_count == 0);
 
-TEST(format_tool_call) {
-    agent_context_t* ctx = agent_context_create(0);
+    /* Stopping while results are outstanding ends the run */
+    assert(agent_run_begin(&state) == AGENT_OK);
+    agent_run_feed_token(&state, tokens[0], strlen(tokens[0]));
+    agent_run_feed_token(&state, tokens[1], strlen(tokens[1]));
+    agent_run_submit_generation(&state, &generation);
+    assert(agent_run_poll(&state, NULL) == AGENT_RUN_NEEDS_TOOL_RESULTS);
+    agent_stop(&state);
+    assert(agent_run_poll(&state, NULL) == AGENT_RUN_DONE);
+    assert(agent_run_end(&state).error == AGENT_ERROR_CANCELLED);
 
-    agent_tool_call_t tc = {0};
-    tc.name.data = "my_tool";
-    tc.name.length = 7;
-    tc.arguments = agent_json_object(ctx, 2);
-    agent_json_object_set(ctx, tc.arguments, "param1", agent_json_string(ctx, "value1"));
+    agent_free(&state);
+}
 
-    char* formatted = agent_format_tool_call(ctx, &tc, false);
-    assert(formatted != NULL);
-    assert(strstr(formatted, "my_tool") != NULL);
-    assert(strstr(formatted, "param1") != NULL);
+TEST(working_history_view) {
+    reset_mocks();
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "One");
+    agent_add_user_message(&state, "Two");
+
+    /* The run sends the conversation's own array */
+    agent_run_request_t request;
+    assert(agent_run_begin(&state) == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.messages == state.messages.messages && request.message_count == 2);
+
+    const char* call = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    agent_llm_result_t generation = {AGENT_OK, agent_sv_from_cstr(call)};
+    assert(agent_run_submit_generation(&state, &generation) == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_TOOL_RESULTS);
+    agent_tool_execute_result_t exec = {AGENT_OK, agent_sv_from_cstr("result"), false};
+    assert(agent_run_submit_tool_result(&state, 0, &exec) == AGENT_OK);
+
+    /* The run's messages follow the conversation, which has not grown */
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.messages == state.messages.messages && request.message_count == 3);
+    assert(state.messages.count == 2);
+
+    /* A message added mid-run must not overwrite them */
+    assert(agent_add_user_message(&state, "Three") == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.messages != state.messages.messages && request.message_count == 3);
+    assert(request.messages[2].role == AGENT_ROLE_TOOL);
+    assert(agent_sv_equals_cstr(state.messages.messages[2].content, "Three"));
+
+    generation.text = agent_sv_from_cstr("Done");
+    assert(agent_run_submit_generation(&state, &generation) == AGENT_OK);
+    agent_run_result_t result = agent_run_end(&state);
+    assert(result.error == AGENT_OK && agent_sv_equals_cstr(agent_sv_trim(result.response), "Done"));
+    assert(state.messages.count == 4);
+    assert(state.working_history.messages == state.messages.messages);
+    assert(state.working_history.count == 4);
+
+    agent_free(&state);
+}
+
+TEST(context_token_budget) {
+    reset_mocks();
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate_recording;
+    config.execute_tool = mock_execute_tool;
+    config.count_tokens = count_bytes;
+    agent_init(&state, &config);
+    size_t prompt_tokens = strlen(agent_build_system_prompt(&state));
+
+    /* Room for the system message and two of the three turns */
+    char turn[101];
+    memset(turn, 'a', 100);
+    turn[100] = '\0';
+    agent_add_system_message(&state, "Rules");
+    for (char c = '1'; c <= '3'; c++) {
+        turn[0] = c;
+        agent_add_user_message(&state, turn);
+    }
+    state.config.context_token_budget = prompt_tokens + 9 + 2 * 104;
+
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK);
+    assert(sent_count == 3);
+    assert(agent_sv_equals_cstr(sent_messages[0].content, "Rules"));
+    assert(sent_messages[1].content.data[0] == '2');
+    assert(sent_messages[2].content.data[0] == '3');
+    assert(state.messages.count == 5);
+
+    /* Older tool results are cut before anything is left out */
+    agent_reset(&state);
+    agent_add_user_message(&state, "Go");
+    state.config.context_token_budget = prompt_tokens + 1500;
+
+    char long_result[1001];
+    memset(long_result, 'x', 1000);
+    long_result[1000] = '\0';
+    const char* call = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    agent_llm_result_t generation = {AGENT_OK, agent_sv_from_cstr(call)};
+    agent_tool_execute_result_t exec = {AGENT_OK, agent_sv_from_cstr(long_result), false};
+    agent_run_request_t request;
+
+    assert(agent_run_begin(&state) == AGENT_OK);
+    for (int round = 0; round < 2; round++) {
+        assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+        assert(agent_run_submit_generation(&state, &generation) == AGENT_OK);
+        assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_TOOL_RESULTS);
+        assert(agent_run_submit_tool_result(&state, 0, &exec) == AGENT_OK);
+    }
+
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.message_count == 3);
+    assert(request.messages[1].content.length == AGENT_CONTEXT_TOOL_RESULT_LENGTH);
+    assert(request.messages[1].tool_results[0].content.length == AGENT_CONTEXT_TOOL_RESULT_LENGTH);
+    assert(request.messages[2].content.length == 1000);
+    assert(state.working_history.messages[1].content.length == 1000);
+
+    generation.text = agent_sv_from_cstr("Done");
+    assert(agent_run_submit_generation(&state, &generation) == AGENT_OK);
+    assert(agent_run_end(&state).error == AGENT_OK);
+
+    agent_free(&state);
+}
+
+TEST(recall_index) {
+    agent_recall_index_t index = {0};
+    const char* docs[] = {
+        "Remember my locker code is 4711.",
+        "東京の天気を教えて",
+        "Tell me about cooking pasta",
+        "LOCKER: the blue one, not the locker by the door",
+    };
+    for (size_t i = 0; i < 4; i++) {
+        assert(agent_recall_add(&index, agent_sv_from_cstr(docs[i])) == AGENT_OK);
+    }
+    assert(index.doc_count == 4);
+
+    /* Case folded; more occurrences rank higher; unmatched documents are left out */
+    size_t found[4];
+    assert(agent_recall_search(&index, agent_sv_from_cstr("locker?"), 4, found) == 2);
+    assert(found[0] == 3);
+    assert(found[1] == 0);
+    assert(agent_recall_search(&index, agent_sv_from_cstr("locker"), 1, found) == 1);
+    assert(found[0] == 3);
+
+    /* Character pairs match Japanese without spaces; CJK punctuation separates */
+    assert(agent_recall_search(&index, agent_sv_from_cstr("明日の東京の天気は？"), 4, found) == 1);
+    assert(found[0] == 1);
+    assert(agent_recall_search(&index, agent_sv_from_cstr("、。"), 4, found) == 0);
+    assert(agent_recall_search(&index, agent_sv_from_cstr("trains"), 4, found) == 0);
+
+    float scores[4];
+    assert(agent_recall_score(&index, agent_sv_from_cstr("pasta"), scores) == AGENT_OK);
+    assert(scores[2] > 0 && scores[0] == 0 && scores[1] == 0 && scores[3] == 0);
+
+    /* Documents and queries without terms match nothing */
+    assert(agent_recall_add(&index, agent_sv_from_cstr("")) == AGENT_OK);
+    assert(agent_recall_add(&index, agent_sv_from_cstr("?! ...")) == AGENT_OK);
+    assert(index.doc_count == 6);
+    float more_scores[6];
+    assert(agent_recall_score(&index, agent_sv_from_cstr(""), more_scores) == AGENT_OK);
+    assert(agent_recall_score(&index, agent_sv_from_cstr("、。?"), more_scores) == AGENT_OK);
+    for (size_t i = 0; i < 6; i++) {
+        assert(more_scores[i] == 0);
+    }
+    assert(agent_recall_search(&index, agent_sv_from_cstr(" "), 4, found) == 0);
+
+    agent_recall_free(&index);
+    assert(index.doc_count == 0);
+    assert(agent_recall_search(&index, agent_sv_from_cstr("pasta"), 4, found) == 0);
+}
+
+/* User message padded with spaces to 80 bytes, so every turn costs the same */
+static void add_padded_user_message(agent_state_t* state, const char* text) {
+    char padded[81];
+    size_t length = strlen(text);
+    memcpy(padded, text, length);
+    memset(padded + length, ' ', 80 - length);
+    padded[80] = '\0';
+    agent_add_user_message(state, padded);
+}
+
+TEST(context_recall) {
+    reset_mocks();
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate_recording;
+    config.execute_tool = mock_execute_tool;
+    config.count_tokens = count_bytes;
+    config.context_recall_turns = 1;
+    agent_init(&state, &config);
+    size_t prompt_tokens = strlen(agent_build_system_prompt(&state));
+
+    /* Room for the system message, the current turn and two earlier ones */
+    const char* questions[2][5] = {
+        {"Remember my locker code is 4711", "Recommend a good book", "Tell me about cooking pasta",
+         "Which train goes to the airport", "What is my locker code?"},
+        {"東京の天気を教えて", "Recommend a good book", "Tell me about cooking pasta",
+         "Which train goes to the airport", "明日の東京の天気は？"},
+    };
+    for (int round = 0; round < 2; round++) {
+        agent_reset(&state);
+        agent_add_system_message(&state, "Rules");
+        for (int i = 0; i < 5; i++) {
+            add_padded_user_message(&state, questions[round][i]);
+        }
+        state.config.context_token_budget = prompt_tokens + 9 + 3 * 84;
+
+        /* The matching first turn is recalled, then the newest earlier turn fills the rest */
+        assert(agent_run(&state).error == AGENT_OK);
+        assert(sent_count == 4);
+        assert(agent_sv_equals_cstr(sent_messages[0].content, "Rules"));
+        assert(strncmp(sent_messages[1].content.data, questions[round][0],
+                       strlen(questions[round][0])) == 0);
+        assert(strncmp(sent_messages[2].content.data, questions[round][3],
+                       strlen(questions[round][3])) == 0);
+        assert(strncmp(sent_messages[3].content.data, questions[round][4],
+                       strlen(questions[round][4])) == 0);
+        assert(state.recall_indexed == 6);
+    }
+
+    /* Without recall, the newest turns are kept */
+    state.config.context_recall_turns = 0;
+    agent_add_user_message(&state, "Thanks");
+    state.config.context_token_budget = prompt_tokens + 9 + 10 + 2 * 84;
+    assert(agent_run(&state).error == AGENT_OK);
+    assert(sent_count == 4);
+    assert(strncmp(sent_messages[1].content.data, questions[1][4], strlen(questions[1][4])) == 0);
+    assert(agent_sv_equals_cstr(sent_messages[3].content, "Thanks"));
+
+    agent_free(&state);
+}
+
+/* Router model for two-tier routing: its own script, streamed in 4-byte chunks */
+static const char* router_responses[4];
+static int router_call_count = 0;
+static size_t router_streamed_bytes = 0;
+
+static agent_llm_result_t mock_route_generate(
+    const agent_message_t* messages,
+    size_t message_count,
+    const char* system_prompt,
+    agent_token_callback_t token_callback,
+    void* user_data
+) {
+    (void)messages;
+    (void)message_count;
+    (void)system_prompt;
+
+    const char* response = router_responses[router_call_count++];
+    agent_llm_result_t result = {0};
+    result.error = AGENT_OK;
+    size_t length = strlen(response);
+    size_t pos = 0;
+    while (pos < length) {
+        size_t chunk = length - pos < 4 ? length - pos : 4;
+        router_streamed_bytes += chunk;
+        bool more = token_callback(response + pos, chunk, user_data);
+        pos += chunk;
+        if (!more) break;
+    }
+    result.text.data = response;
+    result.text.length = pos;
+    return result;
+}
+
+static char shown_text[256];
+static size_t shown_length = 0;
+
+static bool record_token(const char* token, size_t len, void* user_data) {
+    (void)user_data;
+    if (shown_length + len < sizeof(shown_text)) {
+        memcpy(shown_text + shown_length, token, len);
+        shown_length += len;
+        shown_text[shown_length] = '\0';
+    }
+    return true;
+}
+
+TEST(model_routing) {
+    reset_mocks();
+    router_call_count = 0;
+    router_streamed_bytes = 0;
+    shown_length = 0;
+
+    /* The router picks the tool, then its answer is thrown away for the main model's */
+    router_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    router_responses[1] = "Router answer";
+    mock_responses[0] = "Main answer";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.route_generate = mock_route_generate;
+    config.execute_tool = mock_execute_tool;
+    config.on_token = record_token;
+    agent_init(&state, &config);
+
+    agent_add_user_message(&state, "Use the tool");
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK);
+    assert(strncmp(result.response.data, "Main answer", 11) == 0);
+    assert(router_call_count == 2);
+    assert(generate_call_count == 1);
+    assert(tool_call_count == 1);
+    assert(strcmp(shown_text, "Main answer") == 0);
+    assert(result.iterations == 3);
+    assert(result.trace[0].routed && result.trace[1].routed && !result.trace[2].routed);
+
+    /* A call that does not parse escalates; so does a long answer, cut at the probe length */
+    reset_mocks();
+    router_call_count = 0;
+    router_streamed_bytes = 0;
+    router_responses[0] = "<tool_call>{\"name\": \"test_tool\", </tool_call>";
+    router_responses[1] = "This answer goes on for a good deal longer than the probe allows.";
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "Done";
+    state.config.route_probe_length = 16;
+
+    agent_add_user_message(&state, "Again");
+    result = agent_run(&state);
+    assert(result.error == AGENT_OK);
+    assert(strncmp(result.response.data, "Done", 4) == 0);
+    assert(router_call_count == 2);
+    assert(generate_call_count == 2);
+    assert(tool_call_count == 1);
+    assert(router_streamed_bytes == strlen(router_responses[0]) + 16);
+
+    /* Step-driven hosts are told which model to use */
+    reset_mocks();
+    agent_add_user_message(&state, "Step");
+    agent_run_request_t request;
+    assert(agent_run_begin(&state) == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.route);
+    agent_llm_result_t generation = {AGENT_OK, agent_sv_from_cstr("Hi")};
+    assert(agent_run_submit_generation(&state, &generation) == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(!request.route);
+    assert(agent_run_submit_generation(&state, &generation) == AGENT_OK);
+    assert(agent_run_end(&state).error == AGENT_OK);
+
+    agent_free(&state);
+}
+
+TEST(generation_prefix_hint) {
+    reset_mocks();
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "First answer";
+    mock_responses[2] = "Second answer";
+    mock_responses[3] = "Third answer";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate_with_prefix = mock_generate_with_prefix;
+    config.execute_tool = mock_execute_tool;
+    agent_init(&state, &config);
+
+    /* Nothing has been sent yet, then the tool round extends the first prompt */
+    agent_add_user_message(&state, "Go");
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK && generate_call_count == 2);
+    assert(prefix_hints[0] == 0);
+    assert(prefix_hints[1] == prefix_message_counts[0]);
+    assert(prefix_message_counts[1] > prefix_message_counts[0]);
+
+    /* Next turn: the user message is shared, the tool round is not */
+    agent_add_user_message(&state, "Again");
+    result = agent_run(&state);
+    assert(result.error == AGENT_OK && generate_call_count == 3);
+    assert(prefix_hints[2] == 1);
+    assert(agent_uuid_equals(prefix_conversations[2], prefix_conversations[0]));
+
+    /* A changed system prompt invalidates everything */
+    state.config.custom_system_prompt = "Be brief.";
+    agent_add_user_message(&state, "Once more");
+    result = agent_run(&state);
+    assert(result.error == AGENT_OK && prefix_hints[3] == 0);
+
+    /* A new conversation gets a new id */
+    agent_reset(&state);
+    mock_responses[mock_response_index] = "Fresh";
+    agent_add_user_message(&state, "Hello");
+    result = agent_run(&state);
+    assert(result.error == AGENT_OK && prefix_hints[4] == 0);
+    assert(!agent_uuid_equals(prefix_conversations[4], prefix_conversations[0]));
+
+    agent_free(&state);
+}
+
+TEST(run_trace) {
+    reset_mocks();
+    mock_responses[0] = "Checking. <tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "All done here.";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate_chunked;
+    config.execute_tool = mock_execute_tool;
+    agent_init(&state, &config);
+
+    agent_add_user_message(&state, "Go");
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK);
+    assert(result.trace_count == 2 && result.trace != NULL);
+
+    /* 4-byte chunks: one token fed per chunk */
+    const agent_iteration_trace_t* first = &result.trace[0];
+    assert(first->decode_tokens == (strlen(mock_responses[0]) + 3) / 4);
+    assert(first->first_token_ns <= first->decode_ns);
+    assert(first->tool_first == 0 && first->tool_count == 1);
+    assert(first->iteration_arena_bytes > 0 && first->run_arena_bytes > 0);
+    assert(result.tool_latency_ns != NULL);
+    assert(result.tool_latency_ns[0] <= first->tools_ns);
+
+    const agent_iteration_trace_t* second = &result.trace[1];
+    assert(second->decode_tokens == (strlen(mock_responses[1]) + 3) / 4);
+    assert(second->tool_count == 0 && second->tools_ns == 0);
+
+    agent_free(&state);
+}
+
+TEST(arenas_survive_iterations) {
+    reset_mocks();
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {\"path\": \"/tmp/a\"}}</tool_call>";
+    mock_responses[1] = "Finished.";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.get_tools_schema = mock_get_tools_schema;
+    agent_init(&state, &config);
+
+    agent_add_user_message(&state, "Read a file");
+    agent_run_result_t result = agent_run(&state);
+
+    assert(result.error == AGENT_OK);
+    assert(result.tool_calls_count == 1);
+    assert(agent_sv_equals_cstr(result.tool_calls[0].name, "test_tool"));
+    agent_json_value_t* path = agent_json_object_get(result.tool_calls[0].arguments, "path");
+    assert(path != NULL);
+    assert(agent_sv_equals_cstr(path->data.string_value, "/tmp/a"));
+
+    /* Scratch is released after every iteration */
+    assert(agent_context_used(state.iteration_ctx) == 0);
+
+    /* History survives the next run resetting the run arena */
+    mock_response_index = 0;
+    mock_responses[0] = "Second answer";
+    agent_add_user_message(&state, "Again");
+    agent_run(&state);
+
+    const agent_message_t* messages;
+    size_t count;
+    agent_get_messages(&state, &messages, &count);
+    assert(count == 4);
+    assert(agent_sv_equals_cstr(agent_sv_trim(messages[1].content), "Finished."));
+    assert(messages[1].tool_calls_count == 1);
+    assert(agent_sv_equals_cstr(messages[1].tool_calls[0].name, "test_tool"));
+    assert(agent_json_object_get(messages[1].tool_calls[0].arguments, "path") != NULL);
+
+    agent_free(&state);
+}
+
+TEST(max_iterations) {
+    reset_mocks();
+    /* Always return tool call - will hit max iterations */
+    for (int i = 0; i < 10; i++) {
+        mock_responses[i] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    }
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.max_iterations = 3;
+    agent_init(&state, &config);
+
+    agent_add_user_message(&state, "Loop forever");
+
+    agent_run_result_t result = agent_run(&state);
+
+    assert(result.error == AGENT_ERROR_MAX_ITERATIONS);
+    assert(result.iterations == 3);
+    assert(tool_call_count == 3);
+
+    agent_free(&state);
+}
+
+TEST(scheduler_batches_sessions) {
+    reset_mocks();
+    reset_scheduled();
+    scheduled_responses[0][0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    scheduled_responses[0][1] = "Tool says success.";
+    scheduled_responses[1][0] = "Hello from the second session, no tools needed.";
+
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    agent_state_t a, b;
+    agent_init(&a, &config);
+    agent_init(&b, &config);
+
+    agent_scheduler_config_t scheduler_config = {mock_decode_batch, mock_end_sequence, NULL, 0};
+    agent_scheduler_t scheduler;
+    assert(agent_scheduler_init(&scheduler, &scheduler_config) == AGENT_OK);
+    size_t session_a, session_b;
+    assert(agent_scheduler_add(&scheduler, &a, &session_a) == AGENT_OK && session_a == 0);
+    assert(agent_scheduler_add(&scheduler, &b, &session_b) == AGENT_OK && session_b == 1);
+
+    /* Nothing to decode until a run starts */
+    assert(agent_scheduler_step(&scheduler) == 0);
+
+    agent_add_user_message(&a, "Use a tool");
+    agent_add_user_message(&b, "Say hello");
+    assert(agent_run_begin(&a) == AGENT_OK);
+    assert(agent_run_begin(&b) == AGENT_OK);
+
+    /* Both decode together until A stops for its tool; B goes on alone */
+    assert(agent_scheduler_step(&scheduler) == 2);
+    assert(prefill_count == 2);
+    while (agent_run_poll(&a, NULL) == AGENT_RUN_NEEDS_GENERATION) {
+        agent_scheduler_step(&scheduler);
+    }
+    assert(agent_run_poll(&a, NULL) == AGENT_RUN_NEEDS_TOOL_RESULTS);
+    while (agent_scheduler_step(&scheduler) > 0) {
+        assert(decode_sizes[decode_steps - 1] == 1);
+    }
+
+    agent_run_result_t result = agent_run_end(&b);
+    assert(result.error == AGENT_OK);
+    assert(strstr(result.response.data, "second session") != NULL);
+
+    /* A's tool result arrives later; its next generation prefills again */
+    agent_tool_execute_result_t exec = {AGENT_OK, agent_sv_from_cstr("success"), false};
+    assert(agent_run_submit_tool_result(&a, 0, &exec) == AGENT_OK);
+    while (agent_scheduler_step(&scheduler) > 0) {
+    }
+    result = agent_run_end(&a);
+    assert(result.error == AGENT_OK && result.tool_calls_count == 1);
+    assert(prefill_count == 3 && ended_sequences == 3);
+
+    agent_scheduler_free(&scheduler);
+    agent_free(&a);
+    agent_free(&b);
+}
+
+TEST(scheduler_round_robin) {
+    reset_mocks();
+    reset_scheduled();
+    scheduled_responses[0][0] = "First session answer";
+    scheduled_responses[1][0] = "Second session answer";
+    scheduled_responses[2][0] = "Third session answer";
+
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    agent_state_t states[3];
+
+    agent_scheduler_config_t scheduler_config = {mock_decode_batch, NULL, NULL, 1};
+    agent_scheduler_t scheduler;
+    assert(agent_scheduler_init(&scheduler, &scheduler_config) == AGENT_OK);
+    for (size_t i = 0; i < 3; i++) {
+        agent_init(&states[i], &config);
+        agent_scheduler_add(&scheduler, &states[i], NULL);
+        agent_add_user_message(&states[i], "Hi");
+        agent_run_begin(&states[i]);
+    }
+
+    /* One sequence per step, taking turns */
+    for (size_t step = 0; step < 6; step++) {
+        assert(agent_scheduler_step(&scheduler) == 1);
+        assert(decode_first_session[step] == step % 3);
+    }
+
+    /* A removed session drops out of the rotation */
+    agent_scheduler_remove(&scheduler, 1);
+    assert(agent_scheduler_step(&scheduler) == 1);
+    assert(decode_first_session[6] == 0);
+    assert(agent_scheduler_step(&scheduler) == 1);
+    assert(decode_first_session[7] == 2);
+
+    agent_scheduler_free(&scheduler);
+    for (size_t i = 0; i < 3; i++) {
+        agent_free(&states[i]);
+    }
+}
+
+TEST(snapshot_round_trip) {
+    reset_mocks();
+    mock_responses[0] = "<think>Look it up</think><tool_call>{\"name\": \"test_tool\", \"arguments\": {\"q\": \"x\"}}</tool_call>";
+    mock_responses[1] = "Found it";
+
+    static const uint8_t image[] = {0xFF, 0xD8, 0x00, 0xFF, 0xD9};
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    agent_init(&state, &config);
+    agent_add_system_message(&state, "Be brief");
+    agent_add_user_message_with_image(&state, "What is this?", image, sizeof(image));
+    assert(agent_run(&state).error == AGENT_OK);
+
+    agent_string_t snapshot;
+    agent_string_init(&snapshot, 256);
+    assert(agent_state_save(&state, &snapshot) == AGENT_OK);
+
+    agent_state_t restored;
+    agent_init(&restored, &config);
+    agent_add_user_message(&restored, "Replaced by the snapshot");
+    assert(agent_state_load(&restored, snapshot.data, snapshot.length) == AGENT_OK);
+    assert(agent_uuid_equals(restored.conversation_id, state.conversation_id));
+
+    const agent_message_t* original;
+    const agent_message_t* loaded;
+    size_t original_count, loaded_count;
+    agent_get_messages(&state, &original, &original_count);
+    agent_get_messages(&restored, &loaded, &loaded_count);
+    assert(loaded_count == original_count);
+
+    const char* start = snapshot.data;
+    const char* end = snapshot.data + snapshot.length;
+    bool saw_tool_call = false;
+    for (size_t i = 0; i < loaded_count; i++) {
+        assert(agent_uuid_equals(loaded[i].id, original[i].id));
+        assert(loaded[i].role == original[i].role);
+        assert(loaded[i].timestamp_ms == original[i].timestamp_ms);
+        assert(agent_sv_equals(loaded[i].content, original[i].content));
+        assert(agent_sv_equals(loaded[i].thinking_content, original[i].thinking_content));
+        assert(loaded[i].image_data_size == original[i].image_data_size);
+        if (loaded[i].content.data) {
+            /* Views point into the snapshot itself */
+            assert(loaded[i].content.data >= start && loaded[i].content.data < end);
+        }
+        if (loaded[i].image_data_size > 0) {
+            assert(memcmp(loaded[i].image_data, image, sizeof(image)) == 0);
+        }
+
+        assert(loaded[i].tool_calls_count == original[i].tool_calls_count);
+        for (size_t c = 0; c < loaded[i].tool_calls_count; c++) {
+            const agent_tool_call_t* call = &loaded[i].tool_calls[c];
+            assert(agent_sv_equals_cstr(call->name, "test_tool"));
+            agent_string_view_t q;
+            assert(agent_json_get_string(agent_json_object_get(call->arguments, "q"), &q) == AGENT_OK);
+            assert(agent_sv_equals_cstr(q, "x"));
+            saw_tool_call = true;
+        }
+        assert(loaded[i].tool_results_count == original[i].tool_results_count);
+        for (size_t r = 0; r < loaded[i].tool_results_count; r++) {
+            assert(agent_uuid_equals(loaded[i].tool_results[r].tool_call_id,
+                                     original[i].tool_results[r].tool_call_id));
+            assert(agent_sv_equals(loaded[i].tool_results[r].content, original[i].tool_results[r].content));
+        }
+    }
+    assert(saw_tool_call);
+
+    /* The restored conversation carries on */
+    mock_response_index = 0;
+    mock_responses[0] = "Next answer";
+    agent_add_user_message(&restored, "And then?");
+    assert(agent_run(&restored).error == AGENT_OK);
+    agent_get_messages(&restored, &loaded, &loaded_count);
+    assert(loaded_count == original_count + 2);
+
+    agent_free(&restored);
+    agent_string_free(&snapshot);
+    agent_free(&state);
+}
+
+TEST(snapshot_rejects_corruption) {
+    reset_mocks();
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "Keep me");
+
+    agent_string_t snapshot;
+    agent_string_init(&snapshot, 256);
+    assert(agent_state_save(&state, &snapshot) == AGENT_OK);
+
+    /* Truncated: the string area no longer holds the content */
+    assert(agent_state_load(&state, snapshot.data, snapshot.length - 2) == AGENT_ERROR_PARSE_ERROR);
+    /* Too short for a header */
+    assert(agent_state_load(&state, snapshot.data, 8) == AGENT_ERROR_PARSE_ERROR);
+    /* Foreign data */
+    snapshot.data[0] = 'X';
+    assert(agent_state_load(&state, snapshot.data, snapshot.length) == AGENT_ERROR_PARSE_ERROR);
+
+    /* The conversation is untouched */
+    const agent_message_t* messages;
+    size_t count;
+    agent_get_messages(&state, &messages, &count);
+    assert(count == 1);
+    assert(agent_sv_equals_cstr(messages[0].content, "Keep me"));
+
+    agent_string_free(&snapshot);
+    agent_free(&state);
+}
+
+TEST(tool_registry_index) {
+    static char names[40][32];
+    agent_tool_registry_t registry;
+    assert(agent_tool_registry_init(&registry, 2) == AGENT_OK);
+    for (int i = 0; i < 40; i++) {
+        snprintf(names[i], sizeof(names[i]), "server%d.tool_%d", i % 5, i);
+        agent_tool_definition_t tool = {0};
+        tool.name = names[i];
+        assert(agent_tool_registry_add(&registry, &tool) == AGENT_OK);
+    }
+    assert(registry.index_capacity >= 80);
+
+    for (int i = 0; i < 40; i++) {
+        assert(agent_tool_registry_find(&registry, names[i]) == &registry.tools[i]);
+    }
+    assert(agent_tool_registry_find(&registry, "server0.tool_") == NULL);
+    assert(agent_tool_registry_find(&registry, "missing") == NULL);
+
+    /* Views need no terminator: "server1.tool_1" out of "server1.tool_11" */
+    agent_string_view_t prefix = {names[11], 14};
+    assert(agent_tool_registry_find_sv(&registry, prefix) == &registry.tools[1]);
+
+    /* The first registration of a name wins */
+    agent_tool_definition_t duplicate = {0};
+    duplicate.name = "server2.tool_7";
+    agent_tool_registry_add(&registry, &duplicate);
+    assert(agent_tool_registry_find(&registry, "server2.tool_7") == &registry.tools[7]);
+
+    /* A registry filled in by hand is scanned */
+    agent_tool_registry_t manual = {0};
+    manual.tools = registry.tools;
+    manual.count = registry.count;
+    assert(agent_tool_registry_find_sv(&manual, prefix) == &registry.tools[1]);
+
+    agent_tool_registry_free(&registry);
+}
+
+static const char* registry_schema(void* user_data) {
+    return agent_tool_registry_schema_json((agent_tool_registry_t*)user_data, false);
+}
+
+TEST(tool_registry_memo) {
+    agent_tool_registry_t registry;
+    agent_tool_registry_init(&registry, 4);
+    agent_property_schema_t path = agent_mcp_string_property("path", "File path", true);
+    agent_tool_definition_t read = {"filesystem.read_file", "Read a file", &path, 1, 0, NULL, 0};
+    agent_tool_registry_add(&registry, &read);
+
+    /* Built once per version and variant */
+    const char* schema = agent_tool_registry_schema_json(&registry, false);
+    assert(schema && strstr(schema, "filesystem.read_file"));
+    assert(agent_tool_registry_schema_json(&registry, false) == schema);
+    const char* pretty = agent_tool_registry_schema_json(&registry, true);
+    assert(pretty != schema && strchr(pretty, '\n'));
+    const char* description = agent_tool_registry_description(&registry, false);
+    assert(strstr(description, "Available Tools"));
+    assert(agent_tool_registry_description(&registry, false) == description);
+    assert(strstr(agent_tool_registry_description(&registry, true), "利用可能なツール"));
+
+    /* The system prompt follows the registry without rebuilding otherwise */
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.get_tools_schema = registry_schema;
+    config.tool_registry = &registry;
+    config.user_data = &registry;
+    agent_init(&state, &config);
+    char* prompt = agent_build_system_prompt(&state);
+    uint64_t generation = state.prompt_generation;
+    assert(agent_build_system_prompt(&state) == prompt);
+    assert(state.prompt_generation == generation);
+
+    agent_tool_definition_t write = {"filesystem.write_file", "Write a file", &path, 1, 0, NULL, 0};
+    agent_tool_registry_add(&registry, &write);
+    prompt = agent_build_system_prompt(&state);
+    assert(state.prompt_generation == generation + 1);
+    assert(strstr(prompt, "filesystem.write_file"));
+
+    agent_free(&state);
+    agent_tool_registry_free(&registry);
+}
+
+TEST(tool_signature) {
+    agent_context_t* ctx = agent_context_create(0);
+    const char* repeats[] = {"daily", "weekly"};
+    agent_property_schema_t tag = agent_mcp_string_property(NULL, NULL, false);
+    agent_property_schema_t params[] = {
+        agent_mcp_string_property("title", "Event title", true),
+        agent_mcp_string_property("date", "ISO date", true),
+        agent_mcp_string_property("note", NULL, false),
+        agent_mcp_array_property("tags", NULL, false, &tag),
+        agent_mcp_enum_property("repeat", NULL, false, repeats, 2),
+        agent_mcp_int_property("minutes", NULL, false),
+    };
+    agent_tool_definition_t add = {"calendar.add", "Add an event", params, 6, 0, NULL, 0};
+    assert(strcmp(agent_mcp_tool_signature(ctx, &add),
+                  "calendar.add(title:str, date:str, note?:str, tags?:[str], "
+                  "repeat?:\"daily\"|\"weekly\", minutes?:int) - Add an event") == 0);
+
+    agent_tool_definition_t now = {"clock.now", NULL, NULL, 0, 0, NULL, 0};
+    assert(strcmp(agent_mcp_tool_signature(ctx, &now), "clock.now()") == 0);
+
+    /* One line per tool, memoized like the JSON schema */
+    agent_tool_registry_t registry;
+    agent_tool_registry_init(&registry, 4);
+    agent_tool_registry_add(&registry, &add);
+    agent_tool_registry_add(&registry, &now);
+    const char* compact = agent_tool_registry_schema_compact(&registry);
+    assert(strstr(compact, "- Add an event\nclock.now()\n"));
+    assert(agent_tool_registry_schema_compact(&registry) == compact);
+    assert(strlen(compact) < strlen(agent_tool_registry_schema_json(&registry, false)));
+
+    agent_tool_registry_free(&registry);
+    agent_context_destroy(ctx);
+}
+
+TEST(tool_grammar) {
+    agent_context_t* ctx = agent_context_create(0);
+    const char* units[] = {"c", "f"};
+    agent_property_schema_t params[] = {
+        agent_mcp_string_property("city", NULL, true),
+        agent_mcp_enum_property("unit", NULL, false, units, 2),
+    };
+    agent_property_schema_t flags[] = {
+        agent_mcp_int_property("limit", NULL, false),
+        agent_mcp_bool_property("all", NULL, false),
+    };
+    agent_tool_definition_t forecast = {"weather.forecast", "Forecast", params, 2, 0, NULL, 0};
+    agent_tool_definition_t now = {"clock.now", "Time", NULL, 0, 0, NULL, 0};
+    agent_tool_definition_t list = {"tasks.list", "Tasks", flags, 2, 0, NULL, 0};
+
+    agent_tool_registry_t registry;
+    agent_tool_registry_init(&registry, 4);
+    assert(agent_mcp_get_tool_grammar(ctx, &registry) == NULL);
+    agent_tool_registry_add(&registry, &forecast);
+    agent_tool_registry_add(&registry, &now);
+    agent_tool_registry_add(&registry, &list);
+
+    const char* grammar = agent_mcp_get_tool_grammar(ctx, &registry);
+    assert(strncmp(grammar, "root ::= \"<tool_call>\" ws call ws \"</tool_call>\"\n", 49) == 0);
+    assert(strstr(grammar, "call ::= tool-0 | tool-1 | tool-2\n"));
+    /* Required members first and always there, enums as literals */
+    assert(strstr(grammar, "\"\\\"city\\\"\" ws \":\" ws string ( ws \",\" ws \"\\\"unit\\\"\" ws \":\" ws "
+                           "( \"\\\"c\\\"\" | \"\\\"f\\\"\" ) )? ws \"}\""));
+    assert(strstr(grammar, "\"\\\"clock.now\\\"\" ws \",\" ws \"\\\"arguments\\\"\" ws \":\" ws \"{\" ws \"}\""));
+    /* All optional: any one of them may come first */
+    assert(strstr(grammar, "( \"\\\"limit\\\"\" ws \":\" ws integer ( ws \",\" ws \"\\\"all\\\"\" ws \":\" ws boolean )?"
+                           " | \"\\\"all\\\"\" ws \":\" ws boolean )?"));
+    assert(strstr(grammar, "\nstring ::= "));
+    assert(agent_tool_registry_grammar(&registry) == agent_tool_registry_grammar(&registry));
+
+    size_t picked[] = {1};
+    const char* subset = agent_mcp_get_subset_tool_grammar(ctx, &registry, picked, 1);
+    assert(strstr(subset, "call ::= tool-1\n") && !strstr(subset, "weather.forecast"));
+
+    /* Handed to the backend with each generation when asked for */
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.tool_registry = &registry;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "What time is it?");
+    agent_run_request_t request;
+    assert(agent_run_begin(&state) == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.generation.grammar == NULL);
+    agent_llm_result_t done = {AGENT_OK, {NULL, 0}};
+    agent_run_feed_token(&state, "Noon.", 5);
+    agent_run_submit_generation(&state, &done);
+    agent_run_end(&state);
+
+    state.config.constrain_tool_calls = true;
+    agent_add_user_message(&state, "And now?");
+    assert(agent_run_begin(&state) == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.generation.grammar && strstr(request.generation.grammar, "tasks.list"));
+    agent_run_feed_token(&state, "Later.", 6);
+    agent_run_submit_generation(&state, &done);
+    agent_run_end(&state);
+
+    agent_free(&state);
+    agent_tool_registry_free(&registry);
+    agent_context_destroy(ctx);
+}
+
+static agent_property_schema_t static_path[] = {
+    {"path", AGENT_SCHEMA_STRING, "File path", true, NULL, 0, NULL, NULL, 0},
+};
+static agent_tool_definition_t static_tools[] = {
+    {"filesystem.read_file", "Read a file", static_path, 1, 0, NULL, 0},
+    {"filesystem.list_dir", "List a directory", static_path, 1, 0, NULL, 0},
+};
+
+TEST(tool_registry_static) {
+    agent_tool_registry_t registry = AGENT_TOOL_REGISTRY_STATIC(static_tools);
+    assert(registry.count == 2 && registry.frozen && !registry.index);
+    assert(agent_tool_registry_find(&registry, "filesystem.list_dir") == &static_tools[1]);
+    assert(agent_tool_registry_add(&registry, &static_tools[0]) == AGENT_ERROR_INVALID_ARGUMENT);
+
+    /* Freezing builds everything up front; lookups then only return it */
+    assert(agent_tool_registry_freeze(&registry) == AGENT_OK);
+    assert(registry.index && registry.tools == static_tools);
+    assert(agent_tool_registry_find(&registry, "filesystem.read_file") == &static_tools[0]);
+    const char* schema = registry.schema_json[0];
+    const char* grammar = registry.grammar;
+    assert(schema && grammar && registry.schema_compact && registry.description[1]);
+    assert(agent_tool_registry_schema_json(&registry, false) == schema);
+    assert(agent_tool_registry_grammar(&registry) == grammar);
+
+    /* The orchestrator passes the frozen grammar as is */
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.tool_registry = &registry;
+    config.constrain_tool_calls = true;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "List it");
+    agent_run_request_t request;
+    assert(agent_run_begin(&state) == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.generation.grammar == grammar);
+    agent_llm_result_t done = {AGENT_OK, {NULL, 0}};
+    agent_run_submit_generation(&state, &done);
+    agent_run_end(&state);
+    agent_free(&state);
+
+    /* Heap registries freeze too */
+    agent_tool_registry_t heap;
+    agent_tool_registry_init(&heap, 2);
+    agent_tool_registry_add(&heap, &static_tools[0]);
+    assert(agent_tool_registry_freeze(&heap) == AGENT_OK);
+    assert(agent_tool_registry_add(&heap, &static_tools[1]) == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(heap.count == 1);
+
+    agent_tool_registry_free(&heap);
+    agent_tool_registry_free(&registry);
+    assert(static_tools[0].name != NULL);
+}
+
+static agent_property_schema_t flat_read_params[] = {
+    {"path", AGENT_SCHEMA_STRING, "File path", true, NULL, 0, NULL, NULL, 0},
+    {"max_bytes", AGENT_SCHEMA_INTEGER, "Most bytes to read", false, NULL, 0, NULL, NULL, 0},
+};
+static agent_tool_definition_t flat_tools[] = {
+    {"filesystem.read_file", "Read a file", flat_read_params, 2, 0, NULL, 0},
+};
+
+TEST(flat_tool_arguments) {
+    agent_tool_registry_t registry = AGENT_TOOL_REGISTRY_STATIC(flat_tools);
+    reset_mocks();
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.tool_registry = &registry;
+    config.flat_tool_arguments = true;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "Read it");
+
+    agent_run_request_t request;
+    assert(agent_run_begin(&state) == AGENT_OK);
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    const char* response =
+        "<tool_call>{\"name\": \"filesystem.read_file\", \"arguments\": {\"max_bytes\": 64, \"path\": \"/a\"}}</tool_call>"
+        "<tool_call>{\"name\": \"filesystem.read_file\", \"arguments\": {\"path\": 7}}</tool_call>"
+        "<tool_call>{\"name\": \"clock.now\", \"arguments\": {}}</tool_call>";
+    agent_run_feed_token(&state, response, strlen(response));
+    agent_llm_result_t done = {AGENT_OK, {NULL, 0}};
+    assert(agent_run_submit_generation(&state, &done) == AGENT_OK);
+
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_TOOL_RESULTS);
+    assert(request.tool_call_count == 3 && request.tool_args != NULL);
+
+    /* Schema order, whatever order the model wrote */
+    const agent_tool_args_t* read = &request.tool_args[0];
+    assert(read->tool == &flat_tools[0] && read->count == 2);
+    assert(agent_sv_equals_cstr(read->args[0].data.string_value, "/a"));
+    assert(read->args[1].present && read->args[1].data.int_value == 64);
+
+    /* Arguments that do not fit, and tools outside the registry, keep only the JSON */
+    assert(request.tool_args[1].args == NULL);
+    assert(strcmp(request.tool_args[1].error_field, "path") == 0);
+    assert(request.tool_args[2].tool == NULL && request.tool_args[2].args == NULL);
+
+    agent_tool_execute_result_t ok = {AGENT_OK, agent_sv_from_cstr("ok"), false};
+    for (size_t i = 0; i < 3; i++) {
+        assert(agent_run_submit_tool_result(&state, i, &ok) == AGENT_OK);
+    }
+    assert(agent_run_poll(&state, &request) == AGENT_RUN_NEEDS_GENERATION);
+    assert(request.tool_args == NULL);
+    agent_run_feed_token(&state, "Done.", 5);
+    agent_run_submit_generation(&state, &done);
+    assert(agent_run_end(&state).error == AGENT_OK);
+
+    agent_free(&state);
+    agent_tool_registry_free(&registry);
+}
+
+static bool prompt_had_weather[4];
+static bool prompt_had_email[4];
+
+static agent_llm_result_t mock_generate_prompt_tools(
+    const agent_message_t* messages,
+    size_t message_count,
+    const char* system_prompt,
+    agent_token_callback_t token_callback,
+    void* user_data
+) {
+    prompt_had_weather[generate_call_count] = strstr(system_prompt, "weather.forecast") != NULL;
+    prompt_had_email[generate_call_count] = strstr(system_prompt, "email.send") != NULL;
+    return mock_generate_chunked(messages, message_count, system_prompt, token_callback, user_data);
+}
+
+/* What the host shows: streamed text less what it was told to discard */
+static char shown_text[256];
+
+static bool mock_on_token_shown(const char* token, size_t len, void* user_data) {
+    (void)user_data;
+    strncat(shown_text, token, len);
+    return true;
+}
+
+static void mock_on_discard(size_t length, void* user_data) {
+    (void)user_data;
+    assert(length <= strlen(shown_text));
+    shown_text[strlen(shown_text) - length] = '\0';
+}
+
+static const char* full_registry_schema(void* user_data) {
+    return agent_tool_registry_schema_json((agent_tool_registry_t*)user_data, false);
+}
+
+TEST(tool_selection) {
+    static const char* const weather_words[] = {"weather", "天気", "rain"};
+    static const char* const email_words[] = {"mail", "send"};
+    agent_tool_definition_t tools[] = {
+        {"email.send", "Send an email", NULL, 0, 0, email_words, 2},
+        {"calendar.add_event", "Add an event", NULL, 0, 0, NULL, 0},
+        {"weather.forecast", "Get the forecast", NULL, 0, 0, weather_words, 3},
+        {"filesystem.read_file", "Read a file", NULL, 0, 0, NULL, 0},
+    };
+    agent_tool_registry_t registry;
+    agent_tool_registry_init(&registry, 4);
+    for (size_t i = 0; i < 4; i++) {
+        agent_tool_registry_add(&registry, &tools[i]);
+    }
+
+    /* Keywords outrank name parts; unmatched tools are left out */
+    size_t picked[2];
+    assert(agent_tool_registry_select(&registry, agent_sv_from_cstr("Will it RAIN? Check the weather"), 2, picked) == 1);
+    assert(picked[0] == 2);
+    assert(agent_tool_registry_select(&registry, agent_sv_from_cstr("明日の天気を送って、calendar too"), 2, picked) == 2);
+    assert(picked[0] == 2 && picked[1] == 1);
+    assert(agent_tool_registry_select(&registry, agent_sv_from_cstr("hello"), 2, picked) == 0);
+
+    reset_mocks();
+    memset(prompt_had_weather, 0, sizeof(prompt_had_weather));
+    memset(prompt_had_email, 0, sizeof(prompt_had_email));
+    mock_responses[0] = "Sunny tomorrow.";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate_prompt_tools;
+    config.execute_tool = mock_execute_tool;
+    config.get_tools_schema = full_registry_schema;
+    config.tool_registry = &registry;
+    config.tool_selection_top_k = 2;
+    config.on_token = mock_on_token_shown;
+    config.on_discard = mock_on_discard;
+    config.user_data = &registry;
+    agent_init(&state, &config);
+
+    agent_add_user_message(&state, "What's the weather tomorrow?");
+    assert(agent_run(&state).error == AGENT_OK);
+    assert(prompt_had_weather[0] && !prompt_had_email[0]);
+
+    /* A call to a tool it was not shown redoes the generation with all tools */
+    reset_mocks();
+    shown_text[0] = '\0';
+    mock_responses[0] = "Sending it. <tool_call>{\"name\": \"email.send\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "I can't send that.";
+    agent_add_user_message(&state, "Any rain today? Tell Bob.");
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK);
+    assert(generate_call_count == 2);
+    assert(tool_call_count == 0);
+    assert(prompt_had_weather[0] && !prompt_had_email[0]);
+    assert(prompt_had_weather[1] && prompt_had_email[1]);
+    /* The first answer's streamed text was taken back */
+    assert(strcmp(shown_text, "I can't send that.") == 0);
+
+    agent_free(&state);
+    agent_tool_registry_free(&registry);
+}
+
+TEST(reset) {
+    reset_mocks();
+    mock_responses[0] = "Response 1";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    agent_init(&state, &config);
+
+    agent_add_user_message(&state, "First");
+    agent_run(&state);
+
+    /* Reset and run again */
+    agent_reset(&state);
+    mock_response_index = 0;
+    mock_responses[0] = "Response 2";
+
+    const agent_message_t* messages;
+    size_t count;
+    agent_get_messages(&state, &messages, &count);
+    assert(count == 0);  /* Messages cleared */
+
+    agent_add_user_message(&state, "Second");
+    agent_run_result_t result = agent_run(&state);
+
+    assert(result.error == AGENT_OK);
+    assert(strstr(result.response.data, "Response 2") != NULL);
+
+    agent_free(&state);
+}
+
+TEST(stop) {
+    reset_mocks();
+    mock_responses[0] = "Starting...";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    agent_init(&state, &config);
+
+    agent_add_user_message(&state, "Test");
+
+    /* Stop before running - should cancel immediately */
+    agent_stop(&state);
+
+    /* Note: In a real async scenario, we'd test stopping mid-execution */
+
+    agent_free(&state);
+}
+
+/* Stops the run from inside the first tool, as a UI thread would */
+static agent_tool_execute_result_t mock_execute_tool_stopping(
+    const char* tool_name,
+    const agent_json_value_t* arguments,
+    const agent_tool_invocation_t* invocation,
+    void* user_data
+) {
+    (void)tool_name;
+    (void)arguments;
+    tool_call_count++;
+
+    agent_stop((agent_state_t*)user_data);
+    agent_tool_execute_result_t result = {0};
+    if (agent_cancel_requested(invocation->cancel)) {
+        result.error = AGENT_ERROR_CANCELLED;
+        result.content = agent_sv_from_cstr("Interrupted");
+        result.is_error = true;
+    }
+    return result;
+}
+
+TEST(stop_reaches_tools) {
+    reset_mocks();
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>"
+                        "<tool_call>{\"name\": \"test_tool\", \"arguments\": {\"n\": 2}}</tool_call>";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool_cancellable = mock_execute_tool_stopping;
+    config.user_data = &state;
+    assert(agent_init(&state, &config) == AGENT_OK);
+    agent_add_user_message(&state, "Use tools");
+
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_ERROR_CANCELLED);
+    assert(strcmp(result.error_message, "Stopped") == 0);
+    assert(tool_call_count == 1);      /* The second call never starts */
+    assert(generate_call_count == 1);
+
+    /* The next run starts with a fresh token */
+    mock_responses[1] = "Fine";
+    agent_add_user_message(&state, "Again");
+    assert(agent_run(&state).error == AGENT_OK);
+
+    agent_free(&state);
+}
+
+static bool deadline_seen = false;
+
+/* Decodes until the run's token says to stop */
+static agent_llm_result_t mock_generate_until_cancelled(
+    const agent_message_t* messages,
+    size_t message_count,
+    const char* system_prompt,
+    const agent_generation_info_t* info,
+    agent_token_callback_t token_callback,
+    void* user_data
+) {
+    (void)messages;
+    (void)message_count;
+    (void)system_prompt;
+    generate_call_count++;
+
+    agent_llm_result_t result = {AGENT_OK, {NULL, 0}};
+    while (token_callback("tok ", 4, user_data)) {
+        /* Keep going */
+    }
+    deadline_seen = agent_cancel_requested(info->cancel);
+    result.error = AGENT_ERROR_CANCELLED;
+    return result;
+}
+
+TEST(run_deadline) {
+    reset_mocks();
+    deadline_seen = false;
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate_with_prefix = mock_generate_until_cancelled;
+    config.execute_tool = mock_execute_tool;
+    config.run_timeout_ms = 5;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "Think forever");
+
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_ERROR_CANCELLED);
+    assert(deadline_seen);
+    assert(generate_call_count == 1);
+    assert(!atomic_load(&state.cancel.cancelled));   /* Ran out of time, not stopped */
+
+    agent_free(&state);
+}
+
+static int event_deliveries = 0;
+static size_t event_tokens = 0;      /* Most tokens merged into one event */
+static char event_text[256];
+static int event_tool_calls = 0;
+static int event_calling_tool_steps = 0;
+static bool on_token_called = false;
+
+static bool mock_on_events(const agent_event_t* events, size_t count, void* user_data) {
+    (void)user_data;
+    event_deliveries++;
+    for (size_t i = 0; i < count; i++) {
+        switch (events[i].type) {
+        case AGENT_EVENT_TOKENS:
+            if (events[i].token_count > event_tokens) event_tokens = events[i].token_count;
+            strncat(event_text, events[i].text.data, events[i].text.length);
+            break;
+        case AGENT_EVENT_TOOL_CALL:
+            assert(agent_sv_equals_cstr(events[i].text, "test_tool"));
+            event_tool_calls++;
+            break;
+        case AGENT_EVENT_STEP:
+            if (events[i].step == AGENT_STEP_CALLING_TOOL) event_calling_tool_steps++;
+            break;
+        case AGENT_EVENT_DISCARD:
+            assert(events[i].discard_length <= strlen(event_text));
+            event_text[strlen(event_text) - events[i].discard_length] = '\0';
+            break;
+        }
+    }
+    return true;
+}
+
+static bool mock_on_token_flag(const char* token, size_t len, void* user_data) {
+    (void)token;
+    (void)len;
+    (void)user_data;
+    on_token_called = true;
+    return true;
+}
+
+TEST(batched_events) {
+    reset_mocks();
+    event_deliveries = 0;
+    event_tokens = 0;
+    event_text[0] = '\0';
+    event_tool_calls = 0;
+    event_calling_tool_steps = 0;
+    on_token_called = false;
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "Twelve bytes of answer";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate_chunked;
+    config.execute_tool = mock_execute_tool;
+    config.on_token = mock_on_token_flag;
+    config.on_events = mock_on_events;
+    config.event_batch_interval_ms = 60000;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "Go");
+
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK);
+    assert(!on_token_called);
+
+    /* Once before the tool ran, once when the run ended */
+    assert(event_deliveries == 2);
+    assert(event_tool_calls == 1);
+    assert(event_calling_tool_steps >= 1);
+    /* Text before the tool tag was recognized streams too, as with on_token */
+    size_t text_len = strlen(event_text);
+    assert(text_len > 22 && strcmp(event_text + text_len - 22, "Twelve bytes of answer") == 0);
+    assert(event_tokens == 6);     /* The answer's 4-byte chunks, merged into one event */
+
+    agent_free(&state);
+}
+
+TEST(build_system_prompt) {
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.get_tools_schema = mock_get_tools_schema;
+    config.use_japanese = false;
+    config.custom_system_prompt = "Custom instruction here.";
+    agent_init(&state, &config);
+
+    char* prompt = agent_build_system_prompt(&state);
+
+    assert(prompt != NULL);
+    assert(strstr(prompt, "helpful") != NULL);  /* Default prompt text */
+    assert(strstr(prompt, "tool_call") != NULL);  /* Tool call format */
+    assert(strstr(prompt, "Custom instruction") != NULL);  /* Custom prompt */
+
+    agent_free(&state);
+}
+
+TEST(build_system_prompt_japanese) {
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.use_japanese = true;
+    agent_init(&state, &config);
+
+    char* prompt = agent_build_system_prompt(&state);
+
+    assert(prompt != NULL);
+    /* Should contain Japanese text */
+    assert(strstr(prompt, "アシスタント") != NULL ||
+           strstr(prompt, "ツール") != NULL);
+
+    agent_free(&state);
+}
+
+static int schema_calls = 0;
+static const char* current_schema = "[]";
+
+static const char* counting_tools_schema(void* user_data) {
+    (void)user_data;
+    schema_calls++;
+    return current_schema;
+}
+
+TEST(system_prompt_cache) {
+    reset_mocks();
+    mock_responses[0] = "<tool_call>{\"name\": \"test_tool\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "Done";
+
+    static char schema_a[] = "[{\"name\": \"a\"}]";
+    static const char schema_b[] = "[{\"name\": \"b\"}]";
+    current_schema = schema_a;
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool = mock_execute_tool;
+    config.get_tools_schema = counting_tools_schema;
+    agent_init(&state, &config);
+
+    /* Same inputs: same pointer, nothing rebuilt */
+    char* first = agent_build_system_prompt(&state);
+    assert(first != NULL && strstr(first, "\"a\"") != NULL);
+    assert(agent_build_system_prompt(&state) == first);
+
+    /* Survives runs and their arena resets */
+    agent_add_user_message(&state, "Go");
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK && result.iterations == 2);
+    assert(agent_build_system_prompt(&state) == first);
+    assert(schema_calls == 5);
+
+    /* Edited in place: stale until the version is bumped */
+    schema_a[11] = 'z';
+    assert(strstr(agent_build_system_prompt(&state), "\"a\"") != NULL);
+    state.config.tools_schema_version++;
+    assert(strstr(agent_build_system_prompt(&state), "\"z\"") != NULL);
+
+    /* A new schema pointer or language rebuilds it */
+    current_schema = schema_b;
+    assert(strstr(agent_build_system_prompt(&state), "\"b\"") != NULL);
+    state.config.use_japanese = true;
+    assert(strstr(agent_build_system_prompt(&state), "ツール") != NULL);
+
+    agent_free(&state);
+}
+
+TEST(truncate_text) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    const char* long_text = "This is a very long text that should be truncated";
+
+    char* truncated = agent_truncate_text(ctx, long_text, 20);
+    assert(truncated != NULL);
+    assert(strlen(truncated) <= 20);
+    assert(strstr(truncated, "...") != NULL);
+
+    /* Short text should not be truncated */
+    char* short_result = agent_truncate_text(ctx, "Short", 100);
+    assert(strcmp(short_result, "Short") == 0);
+
+    agent_context_destroy(ctx);
+}
+
+TEST(truncate_sv) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    /* "日本語" is three 3-byte characters; no cut may split one */
+    agent_string_view_t text = agent_sv_from_cstr("日本語テキストの長い結果です");
+    for (size_t max_len = 0; max_len < text.length; max_len++) {
+        char* head = agent_truncate_sv(ctx, text, max_len, AGENT_TRUNCATE_HEAD);
+        assert(head && strlen(head) <= max_len);
+        assert(agent_utf8_validate(head, strlen(head)));
+
+        char* both = agent_truncate_sv(ctx, text, max_len, AGENT_TRUNCATE_HEAD_TAIL);
+        assert(both && strlen(both) <= max_len);
+        assert(agent_utf8_validate(both, strlen(both)));
+    }
+
+    /* Head and tail both survive; the view need not be NUL-terminated */
+    agent_string_view_t log = {"BEGIN middle middle middle END trailing", 30};
+    char* kept = agent_truncate_sv(ctx, log, 16, AGENT_TRUNCATE_HEAD_TAIL);
+    assert(strncmp(kept, "BEGIN", 5) == 0);
+    assert(strlen(kept) == 16);
+    assert(strstr(kept, "\n...\n") != NULL);
+    assert(strcmp(kept + strlen(kept) - 3, "END") == 0);
+
+    agent_context_destroy(ctx);
+}
+
+static agent_tool_invocation_t seen_invocation;
+static char big_result[4096];
+
+static agent_tool_execute_result_t mock_execute_tool_big(
+    const char* tool_name,
+    const agent_json_value_t* arguments,
+    const agent_tool_invocation_t* invocation,
+    void* user_data
+) {
+    (void)tool_name;
+    (void)arguments;
+    (void)user_data;
+    tool_call_count++;
+    seen_invocation = *invocation;
+
+    agent_tool_execute_result_t result = {0};
+    result.content.data = big_result;
+    result.content.length = sizeof(big_result);
+    return result;
+}
+
+/* Roughly one token per four bytes */
+static size_t count_quarter_bytes(const char* text, size_t len, void* user_data) {
+    (void)text;
+    (void)user_data;
+    return (len + 3) / 4;
+}
+
+TEST(tool_result_limits) {
+    reset_mocks();
+    memset(big_result, 'a', sizeof(big_result));
+    memcpy(big_result + sizeof(big_result) - 4, "TAIL", 4);
+    mock_responses[0] = "<tool_call>{\"name\": \"read_file\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "Read it";
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate_recording;
+    config.execute_tool_cancellable = mock_execute_tool_big;
+    config.max_tool_result_len = 1000;
+    config.tool_result_truncation = AGENT_TRUNCATE_HEAD_TAIL;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "Read");
+
+    agent_run_result_t result = agent_run(&state);
+    assert(result.error == AGENT_OK);
+    assert(seen_invocation.max_result_len == 1000);
+    assert(seen_invocation.max_result_tokens == 0);   /* No tokenizer configured */
+    assert(seen_invocation.cancel == &state.cancel);
+
+    /* The tool message the second generation saw holds head and tail */
+    const agent_message_t* tool_msg = NULL;
+    for (size_t i = 0; i < sent_count; i++) {
+        if (sent_messages[i].role == AGENT_ROLE_TOOL) tool_msg = &sent_messages[i];
+    }
+    assert(tool_msg && tool_msg->content.length == 1000);
+    assert(tool_msg->content.data[0] == 'a');
+    assert(memcmp(tool_msg->content.data + 996, "TAIL", 4) == 0);
+    agent_free(&state);
+
+    /* With a tokenizer the token limit applies too */
+    reset_mocks();
+    mock_responses[0] = "<tool_call>{\"name\": \"read_file\", \"arguments\": {}}</tool_call>";
+    mock_responses[1] = "Read it";
+    config.count_tokens = count_quarter_bytes;
+    config.max_tool_result_tokens = 100;
+    agent_init(&state, &config);
+
+    agent_tool_call_t call = {0};
+    call.id = agent_uuid_generate();
+    call.name = agent_sv_from_cstr("read_file");
+    agent_tool_result_t tool_result = agent_execute_tool(&state, &call);
+    assert(seen_invocation.max_result_tokens == 100);
+    assert(count_quarter_bytes(tool_result.content.data, tool_result.content.length, NULL) <= 100);
+    assert(tool_result.content.length > 300);
+    assert(strcmp(tool_result.content.data + tool_result.content.length - 4, "TAIL") == 0);
+
+    agent_free(&state);
+}
+
+static const char* sink_data = NULL;
+
+/* Streams its result straight into the orchestrator's buffer */
+static agent_tool_execute_result_t mock_execute_tool_sink(
+    const char* tool_name,
+    const agent_json_value_t* arguments,
+    const agent_tool_invocation_t* invocation,
+    void* user_data
+) {
+    (void)arguments;
+    (void)user_data;
+    tool_call_count++;
+
+    agent_tool_execute_result_t result = {0};
+    if (strcmp(tool_name, "returns_content") == 0) {
+        result.content = agent_sv_from_cstr("Returned");
+        return result;
+    }
+
+    assert(invocation->output->capacity > invocation->max_result_len);
+    for (int i = 0; i < 100; i++) {
+        agent_string_append(invocation->output, "日本");
+    }
+    sink_data = invocation->output->data;
+    return result;
+}
+
+TEST(tool_result_sink) {
+    reset_mocks();
+    sink_data = NULL;
+
+    agent_state_t state;
+    agent_config_t config = {0};
+    config.generate = mock_generate;
+    config.execute_tool_cancellable = mock_execute_tool_sink;
+    config.max_tool_result_len = 100;
+    agent_init(&state, &config);
+    agent_add_user_message(&state, "Go");
+    agent_run_begin(&state);
+
+    /* The result is the sink's own buffer, cut in place on a character boundary */
+    agent_tool_call_t call = {0};
+    call.id = agent_uuid_generate();
+    call.name = agent_sv_from_cstr("writes_sink");
+    agent_tool_result_t result = agent_execute_tool(&state, &call);
+    assert(sink_data && result.content.data == sink_data);
+    assert(result.content.length <= 100);
+    assert(agent_utf8_validate(result.content.data, result.content.length));
+    assert(agent_sv_ends_with(result.content, agent_sv_from_cstr("...")));
+    assert(result.content.data[result.content.length] == '\0');
+
+    /* Returned content still works; the unused sink is given back */
+    size_t used = agent_context_used(state.run_ctx);
+    call.name = agent_sv_from_cstr("returns_content");
+    result = agent_execute_tool(&state, &call);
+    assert(agent_sv_equals_cstr(result.content, "Returned"));
+    assert(agent_context_used(state.run_ctx) - used < 100);
+
+    agent_free(&state);
+}
+
+TEST(format_tool_call) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    agent_tool_call_t tc = {0};
+    tc.name.data = "my_tool";
+    tc.name.length = 7;
+    tc.arguments = agent_json_object(ctx, 2);
+    agent_json_object_set(ctx, tc.arguments, "param1", agent_json_string(ctx, "value1"));
+
+    char* formatted = agent_format_tool_call(ctx, &tc, false);
+    assert(formatted != NULL);
+    assert(strstr(formatted, "my_tool") != NULL);
+    assert(strstr(formatted, "param1") != NULL);
 
     char* formatted_ja = agent_format_tool_call(ctx, &tc, true);
     assert(formatted_ja != NULL);
@@ -408,24 +2518,68 @@ int main(void) {
     printf("\nRunning message tests...\n");
 
     RUN_TEST(add_messages);
+    RUN_TEST(memory_budget);
+    RUN_TEST(image_preprocess);
 
     printf("\nRunning execution tests...\n");
 
     RUN_TEST(simple_response);
     RUN_TEST(tool_call_response);
     RUN_TEST(multiple_tool_calls);
+    RUN_TEST(batched_tool_calls);
+    RUN_TEST(tool_result_cache);
+    RUN_TEST(image_embedding_cache);
+    RUN_TEST(early_tool_dispatch);
+    RUN_TEST(speculative_tool_calls);
+    RUN_TEST(dialect_tool_call);
+    RUN_TEST(step_driven_run);
+    RUN_TEST(working_history_view);
+    RUN_TEST(context_token_budget);
+    RUN_TEST(recall_index);
+    RUN_TEST(context_recall);
+    RUN_TEST(model_routing);
+    RUN_TEST(generation_prefix_hint);
+    RUN_TEST(run_trace);
+    RUN_TEST(arenas_survive_iterations);
     RUN_TEST(max_iterations);
 
     printf("\nRunning state management tests...\n");
 
     RUN_TEST(reset);
     RUN_TEST(stop);
+    RUN_TEST(stop_reaches_tools);
+    RUN_TEST(run_deadline);
+    RUN_TEST(batched_events);
+
+    printf("\nRunning scheduler tests...\n");
+
+    RUN_TEST(scheduler_batches_sessions);
+    RUN_TEST(scheduler_round_robin);
+
+    printf("\nRunning tool registry tests...\n");
+
+    RUN_TEST(tool_registry_index);
+    RUN_TEST(tool_registry_memo);
+    RUN_TEST(tool_signature);
+    RUN_TEST(tool_grammar);
+    RUN_TEST(tool_registry_static);
+    RUN_TEST(flat_tool_arguments);
+    RUN_TEST(tool_selection);
+
+    printf("\nRunning snapshot tests...\n");
+
+    RUN_TEST(snapshot_round_trip);
+    RUN_TEST(snapshot_rejects_corruption);
 
     printf("\nRunning utility tests...\n");
 
     RUN_TEST(build_system_prompt);
     RUN_TEST(build_system_prompt_japanese);
+    RUN_TEST(system_prompt_cache);
     RUN_TEST(truncate_text);
+    RUN_TEST(truncate_sv);
+    RUN_TEST(tool_result_limits);
+    RUN_TEST(tool_result_sink);
     RUN_TEST(format_tool_call);
 
     printf("\nAll orchestrator tests passed!\n");
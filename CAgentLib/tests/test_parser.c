@@ -28,6 +28,43 @@ TEST(has_incomplete_tool_call) {
     assert(!agent_parser_has_incomplete_tool_call("no tool call", 12));
 }
 
+TEST(tool_tag_scanner) {
+    agent_tool_tag_scanner_t scanner;
+    agent_tool_tag_scanner_reset(&scanner);
+
+    /* Tag split across chunks, with a false start */
+    assert(!agent_tool_tag_scanner_feed(&scanner, "a < b <<to", 10));
+    assert(!agent_tool_tag_scanner_feed(&scanner, "ol_ca", 5));
+    assert(agent_tool_tag_scanner_feed(&scanner, "ll>{\"name\"", 10));
+    assert(agent_tool_tag_scanner_feed(&scanner, ": \"x\"}</tool", 12));
+    assert(!agent_tool_tag_scanner_feed(&scanner, "_call> done", 11));
+
+    /* Whole call in one chunk, then a second one left open */
+    agent_tool_tag_scanner_reset(&scanner);
+    assert(!agent_tool_tag_scanner_feed(&scanner, "<tool_call>{}</tool_call>", 25));
+    assert(agent_tool_tag_scanner_feed(&scanner, "<tool_call>", 11));
+}
+
+TEST(find_tags) {
+    const char* response = "<think>a<b</think> <thinkin <tool_call>{}</tool_call></thinking";
+    agent_tag_match_t matches[8];
+
+    size_t count = agent_parser_find_tags(response, strlen(response), matches, 8);
+    assert(count == 4);
+    assert(matches[0].tag == AGENT_TAG_THINK_OPEN && matches[0].offset == 0 && matches[0].length == 7);
+    assert(matches[1].tag == AGENT_TAG_THINK_CLOSE && matches[1].offset == 10);
+    assert(matches[2].tag == AGENT_TAG_TOOL_CALL_OPEN && matches[2].offset == 28);
+    assert(matches[3].tag == AGENT_TAG_TOOL_CALL_CLOSE && matches[3].offset == 41);
+
+    /* Count is reported even past the output capacity */
+    assert(agent_parser_find_tags(response, strlen(response), matches, 1) == 4);
+    assert(agent_parser_find_tags(response, strlen(response), NULL, 0) == 4);
+
+    const char* thinking = "x</thinking>";
+    assert(agent_parser_find_tags(thinking, strlen(thinking), matches, 8) == 1);
+    assert(matches[0].tag == AGENT_TAG_THINKING_CLOSE && matches[0].offset == 1);
+}
+
 /* Tag extraction tests */
 
 TEST(text_before_tool_call) {
@@ -100,6 +137,53 @@ TEST(extract_thinking_none) {
     assert(content.length == strlen(response));
 }
 
+#define POINTS_INTO(sv, buf, len) \
+    ((sv).data >= (buf) && (sv).data + (sv).length <= (buf) + (len))
+
+TEST(borrowed_views) {
+    const char* response = " <think>plan</think> Answer <tool_call>{\"name\": \"x\", \"arguments\": {}}</tool_call> tail ";
+    size_t len = strlen(response);
+
+    agent_string_view_t before = agent_parser_text_before_tool_call_borrow(response, len);
+    assert(POINTS_INTO(before, response, len));
+    assert(agent_sv_equals_cstr(before, "<think>plan</think> Answer"));
+
+    agent_string_view_t after = agent_parser_text_after_tool_call_borrow(response, len);
+    assert(POINTS_INTO(after, response, len));
+    assert(agent_sv_equals_cstr(after, "tail"));
+
+    /* One-sided content is a view; thinking always is */
+    const char* single = "<think>plan</think> Answer ";
+    agent_string_view_t thinking, content;
+    agent_parser_extract_thinking_borrow(ctx, single, strlen(single), &thinking, &content);
+    assert(POINTS_INTO(thinking, single, strlen(single)));
+    assert(agent_sv_equals_cstr(thinking, "plan"));
+    assert(POINTS_INTO(content, single, strlen(single)));
+    assert(agent_sv_equals_cstr(content, "Answer"));
+
+    /* Text on both sides has to be stitched into the arena */
+    const char* both = "Before <think>plan</think> after";
+    agent_parser_extract_thinking_borrow(ctx, both, strlen(both), &thinking, &content);
+    assert(!POINTS_INTO(content, both, strlen(both)));
+    assert(agent_sv_equals_cstr(content, "Before  after"));
+
+    /* The copying variant never hands back pointers into the response */
+    agent_parser_extract_thinking(ctx, single, strlen(single), &thinking, &content);
+    assert(!POINTS_INTO(thinking, single, strlen(single)));
+    assert(!POINTS_INTO(content, single, strlen(single)));
+    assert(agent_sv_equals_cstr(content, "Answer"));
+
+    const char* bare = "Calling {\"name\": \"x\", \"arguments\": {}} now";
+    agent_string_view_t bare_before, bare_after;
+    agent_parsed_tool_call_t* tc = agent_parser_find_bare_json_borrow(ctx, bare, strlen(bare),
+                                                                      &bare_before, &bare_after);
+    assert(tc != NULL);
+    assert(POINTS_INTO(bare_before, bare, strlen(bare)));
+    assert(POINTS_INTO(bare_after, bare, strlen(bare)));
+    assert(agent_sv_equals_cstr(bare_before, "Calling "));
+    assert(agent_sv_equals_cstr(bare_after, " now"));
+}
+
 /* Tool call JSON parsing tests */
 
 TEST(parse_tool_call_json) {
@@ -132,6 +216,20 @@ TEST(parse_tool_call_json_minimal) {
     assert(tc->arguments->data.object_value.count == 0);
 }
 
+TEST(parse_tool_call_json_insitu) {
+    char json[] = "{\"name\": \"write\", \"arguments\": {\"text\": \"\\u3053\\u3093\"}}";
+    agent_parsed_tool_call_t* tc = agent_parser_parse_tool_call_json_insitu(ctx, json, strlen(json));
+
+    assert(tc != NULL);
+    assert(agent_sv_equals_cstr(tc->name, "write"));
+    assert(tc->raw_json.length == 0);
+
+    agent_json_value_t* text = agent_json_object_get(tc->arguments, "text");
+    assert(text != NULL);
+    assert(strcmp(text->data.string_value.data, "\xe3\x81\x93\xe3\x82\x93") == 0);
+    assert(text->data.string_value.data > json && text->data.string_value.data < json + sizeof(json));
+}
+
 TEST(parse_tool_call_json_invalid) {
     /* Missing name */
     const char* json1 = "{\"arguments\": {}}";
@@ -173,6 +271,46 @@ TEST(find_bare_json_not_found) {
     assert(tc == NULL);
 }
 
+TEST(bare_json_prefilter) {
+    const char* prose = "Use {braces} and \"name\" freely";
+    assert(!agent_parser_may_have_bare_json(prose, strlen(prose)));
+
+    const char* spaced = "{\n    \"name\": \"x\", \"arguments\": {}}";
+    assert(agent_parser_may_have_bare_json(spaced, strlen(spaced)));
+
+    /* Whitespace past the window is not a candidate */
+    char wide[128];
+    snprintf(wide, sizeof(wide), "{%*s\"name\": \"x\", \"arguments\": {}}", AGENT_BARE_JSON_WINDOW + 1, "");
+    assert(!agent_parser_may_have_bare_json(wide, strlen(wide)));
+    assert(agent_parser_find_bare_json(ctx, wide, strlen(wide), NULL, NULL) == NULL);
+
+    /* The scanner finds the same candidate across chunk boundaries */
+    const char* chunks[] = {"Sure. {x} { ", "\"na", "me\": \"t\", \"argu", "ments\": {}} done"};
+    char response[128] = "";
+    agent_tool_tag_scanner_t scanner;
+    agent_tool_tag_scanner_reset(&scanner);
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        agent_tool_tag_scanner_feed(&scanner, chunks[i], strlen(chunks[i]));
+        strcat(response, chunks[i]);
+    }
+    assert(scanner.bare_json_at == 10);
+    assert(agent_tool_tag_scanner_has_bare_json(&scanner));
+
+    agent_parse_result_t result = agent_parser_parse_scanned(ctx, &scanner, response, strlen(response));
+    assert(result.count == 3);
+    assert(result.contents[0].type == AGENT_CONTENT_TEXT);
+    assert(result.contents[1].type == AGENT_CONTENT_TOOL_CALL);
+    assert(agent_sv_equals_cstr(result.contents[2].data.text, "done"));
+
+    /* No candidate while streaming: the fallback is skipped */
+    agent_tool_tag_scanner_reset(&scanner);
+    agent_tool_tag_scanner_feed(&scanner, prose, strlen(prose));
+    assert(scanner.bare_json_at == AGENT_BARE_JSON_NONE);
+    assert(!agent_tool_tag_scanner_has_bare_json(&scanner));
+    result = agent_parser_parse_scanned(ctx, &scanner, prose, strlen(prose));
+    assert(result.count == 1);
+}
+
 /* Full parse tests */
 
 TEST(parse_simple_text) {
@@ -243,6 +381,110 @@ TEST(parse_with_thinking) {
     assert(found_text);
 }
 
+TEST(parse_single_pass_order) {
+    const char* response =
+        "Intro <think> plan </think>Middle"
+        "<tool_call>{\"name\": \"a\", \"arguments\": {}}</tool_call>"
+        "<thinking>more</thinking> Tail";
+    agent_parse_result_t result = agent_parser_parse(ctx, response, strlen(response));
+
+    assert(result.count == 6);
+    assert(result.contents[0].type == AGENT_CONTENT_TEXT);
+    assert(agent_sv_equals_cstr(result.contents[0].data.text, "Intro"));
+    assert(result.contents[1].type == AGENT_CONTENT_THINKING);
+    assert(agent_sv_equals_cstr(result.contents[1].data.thinking, "plan"));
+    assert(result.contents[2].type == AGENT_CONTENT_TEXT);
+    assert(result.contents[3].type == AGENT_CONTENT_TOOL_CALL);
+    assert(agent_sv_equals_cstr(result.contents[3].data.tool_call.name, "a"));
+    assert(result.contents[4].type == AGENT_CONTENT_THINKING);
+    assert(result.contents[5].type == AGENT_CONTENT_TEXT);
+
+    /* Text and thinking are views into the response, not copies */
+    assert(result.contents[0].data.text.data == response);
+    assert(result.contents[5].data.text.data == response + strlen(response) - 4);
+
+    /* Thinking opened in the prompt */
+    const char* closed = "reasoning</think>answer";
+    result = agent_parser_parse(ctx, closed, strlen(closed));
+    assert(result.count == 2);
+    assert(result.contents[0].type == AGENT_CONTENT_THINKING);
+    assert(agent_sv_equals_cstr(result.contents[1].data.text, "answer"));
+
+    /* Unclosed tool call is kept as text */
+    const char* open = "Hi <tool_call>{\"name\"";
+    result = agent_parser_parse(ctx, open, strlen(open));
+    assert(result.count == 1);
+    assert(result.contents[0].data.text.length == strlen(open));
+
+    /* Bare JSON after the last tag */
+    const char* bare = "<think>x</think>Run {\"name\": \"b\", \"arguments\": {\"n\": 1}} now";
+    result = agent_parser_parse(ctx, bare, strlen(bare));
+    assert(result.count == 4);
+    assert(result.contents[2].type == AGENT_CONTENT_TOOL_CALL);
+    assert(agent_sv_equals_cstr(result.contents[2].data.tool_call.name, "b"));
+    assert(agent_sv_equals_cstr(result.contents[3].data.text, "now"));
+}
+
+TEST(dialect_compile) {
+    agent_tag_set_t tags;
+
+    assert(agent_tag_set_compile(&tags, NULL) == AGENT_OK);
+    assert(tags.lead_byte == '<');
+    assert(tags.length[AGENT_TAG_TOOL_CALL_ALT_OPEN] == 0);
+
+    assert(agent_tag_set_compile(&tags, agent_parser_dialect_builtin(AGENT_DIALECT_MISTRAL)) == AGENT_OK);
+    assert(tags.lead_byte == -1);
+    assert(tags.lead['['] && tags.lead['<']);
+    assert(agent_parser_dialect_builtin((agent_dialect_id_t)99) == NULL);
+
+    /* Missing tool call tag, unpaired think tag, inner lead byte */
+    agent_parser_dialect_t bad = {0};
+    assert(agent_tag_set_compile(&tags, &bad) == AGENT_ERROR_INVALID_ARGUMENT);
+    bad.tool_call_open = "<call>";
+    bad.think_open = "<t>";
+    assert(agent_tag_set_compile(&tags, &bad) == AGENT_ERROR_INVALID_ARGUMENT);
+    bad.think_open = NULL;
+    bad.tool_call_close = "</c<all>";
+    assert(agent_tag_set_compile(&tags, &bad) == AGENT_ERROR_INVALID_ARGUMENT);
+    bad.tool_call_close = NULL;
+    assert(agent_tag_set_compile(&tags, &bad) == AGENT_OK);
+}
+
+TEST(parse_dialects) {
+    agent_tag_set_t tags;
+
+    /* Mistral: an array after the tag, no closing tag */
+    assert(agent_tag_set_compile(&tags, agent_parser_dialect_builtin(AGENT_DIALECT_MISTRAL)) == AGENT_OK);
+    const char* mistral = "Sure [TOOL_CALLS] [{\"name\": \"a\", \"arguments\": {}}, "
+                          "{\"name\": \"b\", \"arguments\": {\"s\": \"]\"}}] after";
+    agent_parse_result_t result = agent_parser_parse_tags(ctx, &tags, mistral, strlen(mistral));
+    assert(result.count == 4);
+    assert(agent_sv_equals_cstr(result.contents[0].data.text, "Sure"));
+    assert(agent_sv_equals_cstr(result.contents[1].data.tool_call.name, "a"));
+    assert(agent_sv_equals_cstr(result.contents[2].data.tool_call.name, "b"));
+    assert(agent_sv_equals_cstr(result.contents[3].data.text, "after"));
+
+    /* Llama 3: "parameters" holds the arguments */
+    assert(agent_tag_set_compile(&tags, agent_parser_dialect_builtin(AGENT_DIALECT_LLAMA3)) == AGENT_OK);
+    const char* llama = "<|python_tag|>{\"name\": \"search\", \"parameters\": {\"q\": \"x\"}}";
+    result = agent_parser_parse_tags(ctx, &tags, llama, strlen(llama));
+    assert(result.count == 1);
+    assert(result.contents[0].type == AGENT_CONTENT_TOOL_CALL);
+    assert(agent_json_object_get(result.contents[0].data.tool_call.arguments, "q") != NULL);
+
+    /* Phi-4: native and Hermes spellings in one response */
+    assert(agent_tag_set_compile(&tags, agent_parser_dialect_builtin(AGENT_DIALECT_PHI4)) == AGENT_OK);
+    const char* phi = "<|tool_call|>[{\"name\": \"a\", \"arguments\": {}}]<|/tool_call|>"
+                      "<tool_call>{\"name\": \"b\", \"arguments\": {}}</tool_call>";
+    result = agent_parser_parse_tags(ctx, &tags, phi, strlen(phi));
+    assert(result.count == 2);
+    assert(agent_sv_equals_cstr(result.contents[1].data.tool_call.name, "b"));
+
+    /* The default parser leaves dialect tags as text */
+    result = agent_parser_parse(ctx, llama, strlen(llama));
+    assert(result.count == 1 && result.contents[0].type == AGENT_CONTENT_TEXT);
+}
+
 /* Streaming parser tests */
 
 /* Helper for streaming_basic test */
@@ -292,6 +534,237 @@ TEST(streaming_tool_call_detection) {
     agent_streaming_parser_free(&parser);
 }
 
+/* Helpers for streaming_tool_call_early_name test */
+static agent_error_t feed_str(agent_streaming_parser_t* parser, const char* text) {
+    return agent_streaming_parser_feed(parser, text, strlen(text));
+}
+
+static char g_started_name[64];
+static char g_called_name[64];
+static bool g_name_before_call;
+
+static void streaming_tool_start_callback(const char* name, void* user_data) {
+    (void)user_data;
+    snprintf(g_started_name, sizeof(g_started_name), "%s", name);
+    g_name_before_call = g_called_name[0] == '\0';
+}
+
+static void streaming_tool_call_callback(const char* name, const agent_json_value_t* args,
+                                         void* user_data) {
+    (void)user_data;
+    assert(args != NULL);
+    assert(agent_json_object_get(args, "path") != NULL);
+    snprintf(g_called_name, sizeof(g_called_name), "%s", name);
+}
+
+TEST(streaming_tool_call_early_name) {
+    agent_streaming_parser_t parser;
+    agent_streaming_parser_init(&parser, ctx);
+
+    g_started_name[0] = '\0';
+    g_called_name[0] = '\0';
+    g_name_before_call = false;
+
+    parser.on_tool_call_start = streaming_tool_start_callback;
+    parser.on_tool_call = streaming_tool_call_callback;
+
+    feed_str(&parser, "<tool_call>{\"name\": \"read_");
+    assert(g_started_name[0] == '\0');
+
+    feed_str(&parser, "file\", \"arguments\": {\"pa");
+    assert(strcmp(g_started_name, "read_file") == 0);
+    assert(g_called_name[0] == '\0');
+
+    feed_str(&parser, "th\": \"/tmp\"}}</tool_call>");
+    assert(strcmp(g_called_name, "read_file") == 0);
+    assert(g_name_before_call);
+    assert(!agent_streaming_parser_in_tool_call(&parser));
+
+    agent_streaming_parser_free(&parser);
+}
+
+TEST(streaming_early_dispatch) {
+    agent_streaming_parser_t parser;
+    agent_streaming_parser_init(&parser, ctx);
+
+    memset(g_received_text, 0, sizeof(g_received_text));
+    g_received_len = 0;
+    g_called_name[0] = '\0';
+
+    parser.dispatch_on_json_close = true;
+    parser.on_text = streaming_text_callback;
+    parser.on_tool_call = streaming_tool_call_callback;
+
+    feed_str(&parser, "<tool_call>{\"name\": \"ls\", \"arguments\": {\"path\": \"}\"}}");
+    assert(strcmp(g_called_name, "ls") == 0);
+    assert(!agent_streaming_parser_in_tool_call(&parser));
+
+    /* The late closing tag and whitespace are swallowed */
+    feed_str(&parser, " \n</tool_");
+    feed_str(&parser, "call>Next");
+    assert(strcmp(g_received_text, "Next") == 0);
+
+    /* Without the tag, following text resumes straight away */
+    g_called_name[0] = '\0';
+    feed_str(&parser, "<tool_call>{\"name\": \"cat\", \"arguments\": {\"path\": \"a\"}}</b>");
+    assert(strcmp(g_called_name, "cat") == 0);
+    agent_streaming_parser_flush(&parser);
+    assert(strcmp(g_received_text, "Next</b>") == 0);
+
+    agent_streaming_parser_free(&parser);
+}
+
+/* Helper for streaming_dialect test */
+static int g_dialect_calls;
+
+static void streaming_count_tool_call(const char* name, const agent_json_value_t* args,
+                                      void* user_data) {
+    (void)name;
+    (void)args;
+    (void)user_data;
+    g_dialect_calls++;
+}
+
+TEST(streaming_dialect) {
+    agent_streaming_parser_t parser;
+    agent_streaming_parser_init(&parser, ctx);
+    assert(agent_streaming_parser_set_dialect(&parser,
+        agent_parser_dialect_builtin(AGENT_DIALECT_MISTRAL)) == AGENT_OK);
+
+    memset(g_received_text, 0, sizeof(g_received_text));
+    g_received_len = 0;
+    g_dialect_calls = 0;
+    parser.on_text = streaming_text_callback;
+    parser.on_tool_call = streaming_count_tool_call;
+
+    feed_str(&parser, "Ok [TOOL_");
+    feed_str(&parser, "CALLS] [{\"name\": \"a\", \"arguments\": {}}, {\"name\": \"b\",");
+    assert(agent_streaming_parser_in_tool_call(&parser));
+    feed_str(&parser, " \"arguments\": {}}] [x]");
+    assert(g_dialect_calls == 2);
+    assert(!agent_streaming_parser_in_tool_call(&parser));
+    agent_streaming_parser_flush(&parser);
+    assert(strcmp(g_received_text, "Ok  [x]") == 0);
+
+    /* The scanner follows the same dialect */
+    agent_tool_tag_scanner_t scanner;
+    agent_tool_tag_scanner_reset(&scanner);
+    scanner.tags = &parser.tags;
+    assert(!agent_tool_tag_scanner_feed(&scanner, "[TOOL", 5));
+    assert(agent_tool_tag_scanner_feed(&scanner, "_CALLS][", 8));
+
+    agent_streaming_parser_free(&parser);
+}
+
+/* Helpers for streaming_spans test */
+static char g_thinking[64];
+static const char* g_last_text_ptr;
+
+static void streaming_span_text_callback(const char* text, size_t len, void* user_data) {
+    (void)user_data;
+    g_last_text_ptr = text;
+    streaming_text_callback(text, len, NULL);
+}
+
+static void streaming_thinking_callback(const char* text, size_t len, void* user_data) {
+    (void)user_data;
+    snprintf(g_thinking, sizeof(g_thinking), "%.*s", (int)len, text);
+}
+
+TEST(streaming_spans) {
+    agent_streaming_parser_t parser;
+    agent_streaming_parser_init(&parser, ctx);
+
+    memset(g_received_text, 0, sizeof(g_received_text));
+    g_received_len = 0;
+    g_thinking[0] = '\0';
+
+    parser.on_text = streaming_span_text_callback;
+    parser.on_thinking = streaming_thinking_callback;
+
+    /* Plain runs are passed through from the caller's buffer */
+    const char* token = "a < b";
+    feed_str(&parser, token);
+    assert(g_last_text_ptr == token + 4);
+
+    /* Rejected tag candidates, one restarting at a second '<' */
+    feed_str(&parser, " <ta <<thi");
+    feed_str(&parser, "nk>x </th");
+    assert(parser.in_think);
+    feed_str(&parser, "ey </thin");
+    feed_str(&parser, "k> done");
+    assert(!parser.in_think);
+    assert(strcmp(g_thinking, "x </they ") == 0);
+
+    agent_streaming_parser_flush(&parser);
+    assert(strcmp(g_received_text, "a < b <ta < done") == 0);
+
+    agent_streaming_parser_free(&parser);
+}
+
+static int g_text_calls;
+static bool g_text_whole_chars;
+
+static void streaming_coalesced_text_callback(const char* text, size_t len, void* user_data) {
+    g_text_calls++;
+    if (agent_utf8_complete_boundary(text, len) != len) {
+        g_text_whole_chars = false;
+    }
+    streaming_text_callback(text, len, user_data);
+}
+
+TEST(streaming_text_coalescing) {
+    agent_streaming_parser_t parser;
+    agent_streaming_parser_init(&parser, ctx);
+
+    memset(g_received_text, 0, sizeof(g_received_text));
+    g_received_len = 0;
+    g_text_calls = 0;
+    g_text_whole_chars = true;
+    g_dialect_calls = 0;
+    parser.on_text = streaming_coalesced_text_callback;
+    parser.on_tool_call = streaming_count_tool_call;
+
+    agent_text_coalescing_t policy = {8, 0};
+    assert(agent_streaming_parser_set_text_coalescing(&parser, &policy) == AGENT_OK);
+
+    /* Byte-at-a-time multibyte text comes out in whole characters */
+    const char* japanese = "\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81\xaf";
+    for (size_t i = 0; i < strlen(japanese); i++) {
+        agent_streaming_parser_feed(&parser, japanese + i, 1);
+    }
+    assert(g_text_calls == 2);
+    assert(g_text_whole_chars);
+
+    /* Short runs wait at most max_feeds feeds */
+    agent_streaming_parser_flush(&parser);
+    assert(g_text_calls == 3);
+    g_text_calls = 0;
+    policy.max_feeds = 3;
+    agent_streaming_parser_set_text_coalescing(&parser, &policy);
+    feed_str(&parser, "a");
+    feed_str(&parser, "b");
+    assert(g_text_calls == 0);
+    feed_str(&parser, "c");
+    assert(g_text_calls == 1);
+
+    /* Pending text is released before a block starts */
+    feed_str(&parser, " x <tool_");
+    size_t before_block = g_received_len;
+    feed_str(&parser, "call>");
+    assert(g_received_len == before_block + 3);
+    feed_str(&parser, "{\"name\": \"t\", \"arguments\": {}}</tool_call> end");
+    assert(g_dialect_calls == 1);
+
+    /* Disabling releases what is still held */
+    assert(agent_streaming_parser_set_text_coalescing(&parser, NULL) == AGENT_OK);
+    assert(g_received_len == strlen(japanese) + 10);
+    assert(memcmp(g_received_text, japanese, strlen(japanese)) == 0);
+    assert(strcmp(g_received_text + strlen(japanese), "abc x  end") == 0);
+
+    agent_streaming_parser_free(&parser);
+}
+
 int main(void) {
     ctx = agent_context_create(0);
     assert(ctx != NULL);
@@ -300,6 +773,8 @@ int main(void) {
 
     RUN_TEST(has_tool_call);
     RUN_TEST(has_incomplete_tool_call);
+    RUN_TEST(tool_tag_scanner);
+    RUN_TEST(find_tags);
 
     agent_context_reset(ctx);
 
@@ -316,6 +791,7 @@ int main(void) {
     RUN_TEST(extract_thinking_tag);
     RUN_TEST(extract_thinking_only_close);
     RUN_TEST(extract_thinking_none);
+    RUN_TEST(borrowed_views);
 
     agent_context_reset(ctx);
 
@@ -324,6 +800,7 @@ int main(void) {
     RUN_TEST(parse_tool_call_json);
     RUN_TEST(parse_tool_call_json_minimal);
     RUN_TEST(parse_tool_call_json_invalid);
+    RUN_TEST(parse_tool_call_json_insitu);
 
     agent_context_reset(ctx);
 
@@ -331,6 +808,7 @@ int main(void) {
 
     RUN_TEST(find_bare_json);
     RUN_TEST(find_bare_json_not_found);
+    RUN_TEST(bare_json_prefilter);
 
     agent_context_reset(ctx);
 
@@ -340,6 +818,9 @@ int main(void) {
     RUN_TEST(parse_tool_call_tag);
     RUN_TEST(parse_multiple_tool_calls);
     RUN_TEST(parse_with_thinking);
+    RUN_TEST(parse_single_pass_order);
+    RUN_TEST(dialect_compile);
+    RUN_TEST(parse_dialects);
 
     agent_context_reset(ctx);
 
@@ -347,6 +828,11 @@ int main(void) {
 
     RUN_TEST(streaming_basic);
     RUN_TEST(streaming_tool_call_detection);
+    RUN_TEST(streaming_tool_call_early_name);
+    RUN_TEST(streaming_spans);
+    RUN_TEST(streaming_early_dispatch);
+    RUN_TEST(streaming_dialect);
+    RUN_TEST(streaming_text_coalescing);
 
     agent_context_destroy(ctx);
 
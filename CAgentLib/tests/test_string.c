@@ -49,6 +49,53 @@ TEST(sv_find) {
     assert(agent_sv_find_char(sv, 'o') == 4);
 }
 
+TEST(sv_find_long) {
+    /* Adversarial haystack: many near matches */
+    static char haystack[8192];
+    memset(haystack, 'a', sizeof(haystack));
+    agent_string_view_t sv = {haystack, sizeof(haystack)};
+
+    char needle[64];
+    memset(needle, 'a', sizeof(needle));
+    needle[sizeof(needle) - 1] = 'b';
+    agent_string_view_t long_needle = {needle, sizeof(needle)};
+    agent_string_view_t short_needle = {needle + 48, 16};
+    assert(agent_sv_find(sv, long_needle) == -1);
+    assert(agent_sv_find(sv, short_needle) == -1);
+
+    haystack[sizeof(haystack) - 1] = 'b';
+    assert(agent_sv_find(sv, long_needle) == (ptrdiff_t)(sizeof(haystack) - sizeof(needle)));
+    assert(agent_sv_find(sv, short_needle) == (ptrdiff_t)(sizeof(haystack) - 16));
+
+    /* Periodic needle */
+    agent_string_view_t text = agent_sv_from_cstr(
+        "abcabcabcabcabcabcabcabcabcabcabcabcabxabcabcabcabcabcabcabcabcabcabcabcabcabcabc!");
+    assert(agent_sv_find_cstr(text, "abcabcabcabcabcabcabcabcabcabcabcabcabcabc!") == 39);
+    assert(agent_sv_find_cstr(text, "cabcabcabcabcabcabcabcabcabcabcabcabxabca") == 2);
+    assert(agent_sv_find_cstr(text, "abcabcabcabcabcabcabcabcabcabcabcabcabcabcabcabc") == -1);
+}
+
+TEST(sv_find_any) {
+    agent_string_view_t sv = agent_sv_from_cstr("text <tool_call>{} </think>");
+    agent_string_view_t needles[] = {
+        agent_sv_from_cstr("</think>"),
+        agent_sv_from_cstr("<tool_call>"),
+        agent_sv_from_cstr("<tool"),
+    };
+    size_t which = 99;
+    assert(agent_sv_find_any(sv, needles, 3, &which) == 5);
+    assert(which == 1);
+    assert(agent_sv_find_any(sv, needles, 1, &which) == 19);
+    assert(which == 0);
+    assert(agent_sv_find_any(sv, needles + 2, 1, NULL) == 5);
+
+    agent_string_view_t missing[] = {agent_sv_from_cstr("<result>")};
+    which = 99;
+    assert(agent_sv_find_any(sv, missing, 1, &which) == -1);
+    assert(which == 99);
+    assert(agent_sv_find_any(sv, needles, 0, NULL) == -1);
+}
+
 TEST(sv_substr) {
     agent_string_view_t sv = agent_sv_from_cstr("hello world");
 
@@ -83,6 +130,54 @@ TEST(utf8_validate) {
     assert(!agent_utf8_validate(invalid2, 2));
 }
 
+TEST(utf8_validate_blocks) {
+    /* Every sequence at every offset of ASCII long enough for whole blocks */
+    static const struct {
+        const char* bytes;
+        bool valid;
+    } cases[] = {
+        {"\xC3\xA9", true},
+        {"\xE3\x81\x82", true},
+        {"\xF0\x9F\x98\x80", true},
+        {"\xEF\xBF\xBF", true},
+        {"\xF4\x8F\xBF\xBF", true},
+        {"\xED\x9F\xBF", true},
+        {"\x80", false},               /* Stray continuation */
+        {"\xC1\xBF", false},           /* Overlong 2-byte */
+        {"\xE0\x9F\xBF", false},       /* Overlong 3-byte */
+        {"\xF0\x8F\xBF\xBF", false},   /* Overlong 4-byte */
+        {"\xED\xA0\x80", false},       /* Surrogate */
+        {"\xF4\x90\x80\x80", false},   /* Above U+10FFFF */
+        {"\xE3\x81", false},           /* Cut short */
+        {"\xC3\xA9\xA9", false},       /* Too long */
+        {"\xFF", false},
+    };
+
+    char buf[96];
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        size_t len = strlen(cases[c].bytes);
+        for (size_t offset = 0; offset + len <= sizeof(buf); offset++) {
+            memset(buf, 'a', sizeof(buf));
+            memcpy(buf + offset, cases[c].bytes, len);
+            assert(agent_utf8_validate(buf, sizeof(buf)) == cases[c].valid);
+            /* Ending right after the sequence, and inside it */
+            assert(agent_utf8_validate(buf, offset + len) == cases[c].valid);
+            if (len > 1 && cases[c].valid) {
+                assert(!agent_utf8_validate(buf, offset + len - 1));
+            }
+        }
+    }
+
+    /* Mostly multibyte text spanning many blocks */
+    char text[3 * 40 + 1] = {0};
+    for (size_t i = 0; i < 40; i++) {
+        memcpy(text + 3 * i, "あ", 3);
+    }
+    assert(agent_utf8_validate(text, strlen(text)));
+    text[61] = 'x';
+    assert(!agent_utf8_validate(text, strlen(text)));
+}
+
 TEST(utf8_char_length) {
     assert(agent_utf8_char_length('A') == 1);
     assert(agent_utf8_char_length(0xC0) == 2);
@@ -95,6 +190,16 @@ TEST(utf8_char_count) {
     assert(agent_utf8_char_count("hello", 5) == 5);
     assert(agent_utf8_char_count("日本語", 9) == 3);
     assert(agent_utf8_char_count("a日b", 5) == 3);
+    assert(agent_utf8_char_count("日本", 5) == 1);  /* Second character cut short */
+
+    /* Long enough for whole blocks, and for lane counts past 255 */
+    char text[3 * 400 + 7];
+    for (size_t i = 0; i < 400; i++) {
+        memcpy(text + 3 * i, "あ", 3);
+    }
+    memcpy(text + 1200, "abc😀", 7);
+    assert(agent_utf8_char_count(text, sizeof(text)) == 404);
+    assert(agent_utf8_char_count(text, sizeof(text) - 1) == 403);
 }
 
 TEST(utf8_complete_boundary) {
@@ -105,6 +210,13 @@ TEST(utf8_complete_boundary) {
     const char* s = "日";  /* 3 bytes */
     assert(agent_utf8_complete_boundary(s, 2) == 0);  /* Only 2 bytes available */
     assert(agent_utf8_complete_boundary(s, 3) == 3);  /* All 3 bytes */
+
+    /* Only the trailing character matters */
+    const char* mixed = "ab日😀";  /* 2 + 3 + 4 bytes */
+    for (size_t len = 0; len <= 9; len++) {
+        size_t expected = len < 2 ? len : len < 5 ? 2 : len < 9 ? 5 : 9;
+        assert(agent_utf8_complete_boundary(mixed, len) == expected);
+    }
 }
 
 /* Mutable string tests */
@@ -118,6 +230,26 @@ TEST(string_init_free) {
     agent_string_free(&str);
 }
 
+TEST(string_inline) {
+    agent_string_t str;
+    agent_string_init(&str, 8);
+    assert(str.data == str.inline_data && str.capacity == AGENT_STRING_INLINE_CAPACITY);
+
+    /* Fills the inline buffer exactly, then spills with the contents */
+    agent_string_append(&str, "0123456789012345678901234567890");
+    assert(str.data == str.inline_data);
+    agent_string_append_char(&str, '!');
+    assert(str.data != str.inline_data && str.capacity > AGENT_STRING_INLINE_CAPACITY);
+    assert(strcmp(str.data, "0123456789012345678901234567890!") == 0);
+    agent_string_free(&str);
+    assert(str.data == NULL);
+
+    /* Asking for more goes straight to the heap */
+    agent_string_init(&str, 100);
+    assert(str.data != str.inline_data && str.capacity == 100);
+    agent_string_free(&str);
+}
+
 TEST(string_append) {
     agent_string_t str;
     agent_string_init(&str, 16);
@@ -146,6 +278,58 @@ TEST(string_append_fmt) {
     agent_string_free(&str);
 }
 
+TEST(string_append_typed) {
+    agent_string_t str;
+    agent_string_init(&str, 0);
+
+    agent_string_append_u64(&str, 0);
+    agent_string_append_char(&str, ' ');
+    agent_string_append_u64(&str, UINT64_MAX);
+    agent_string_append_char(&str, ' ');
+    agent_string_append_i64(&str, INT64_MIN);
+    agent_string_append_char(&str, ' ');
+    agent_string_append_i64(&str, 42);
+    assert(strcmp(str.data, "0 18446744073709551615 -9223372036854775808 42") == 0);
+
+    agent_string_clear(&str);
+    agent_string_append_hex(&str, 0x1f, 4);
+    agent_string_append_char(&str, ' ');
+    agent_string_append_hex(&str, 0xdeadbeef, 0);
+    agent_string_append_char(&str, ' ');
+    agent_string_append_hex(&str, 0, 0);
+    assert(strcmp(str.data, "001f deadbeef 0") == 0);
+
+    agent_string_clear(&str);
+    const char raw[] = "a\"b\\c\n\x01日本";
+    agent_string_append_sv_escaped(&str, agent_sv_from_parts(raw, sizeof(raw) - 1));
+    assert(strcmp(str.data, "a\\\"b\\\\c\\n\\u0001日本") == 0);
+
+    /* Escapes found past whole blocks of plain and high bytes */
+    agent_string_clear(&str);
+    const char long_raw[] = "日本語のテキストとASCII text, then\x1f and \x7f\xff\"";
+    agent_string_append_sv_escaped(&str, agent_sv_from_parts(long_raw, sizeof(long_raw) - 1));
+    assert(strcmp(str.data, "日本語のテキストとASCII text, then\\u001f and \x7f\xff\\\"") == 0);
+
+    agent_string_free(&str);
+}
+
+TEST(string_template) {
+    agent_template_t tpl;
+    assert(agent_template_compile(&tpl, "Tools:\n%s\n100%% %s.") == AGENT_OK);
+    assert(tpl.slot_count == 2);
+
+    agent_string_t str;
+    agent_string_init(&str, 0);
+    agent_string_view_t values[] = {agent_sv_from_cstr("calendar.add"), agent_sv_from_cstr("done")};
+    assert(agent_string_append_template(&str, &tpl, values, 2) == AGENT_OK);
+    assert(strcmp(str.data, "Tools:\ncalendar.add\n100% done.") == 0);
+    assert(agent_string_append_template(&str, &tpl, values, 1) == AGENT_ERROR_INVALID_ARGUMENT);
+    agent_string_free(&str);
+
+    assert(agent_template_compile(&tpl, "%d items") == AGENT_ERROR_INVALID_ARGUMENT);
+    assert(agent_template_compile(&tpl, "") == AGENT_OK && tpl.part_count == 0);
+}
+
 TEST(string_reserve) {
     agent_string_t str;
     agent_string_init(&str, 8);
@@ -163,6 +347,82 @@ TEST(string_reserve) {
     agent_string_free(&str);
 }
 
+TEST(string_arena) {
+    agent_context_t* ctx = agent_context_create(0);
+
+    agent_string_t str;
+    assert(agent_string_init_arena(&str, ctx, 8) == AGENT_OK);
+    char* initial = str.data;
+
+    /* Newest allocation grows in place */
+    agent_string_append(&str, "hello world, this is longer than eight");
+    assert(str.data == initial);
+    assert(strcmp(str.data, "hello world, this is longer than eight") == 0);
+
+    /* Interleaved allocation forces a copy; the old contents stay intact */
+    agent_context_alloc(ctx, 16);
+    agent_string_append_fmt(&str, " %d", 123456789);
+    assert(strcmp(str.data, "hello world, this is longer than eight 123456789") == 0);
+
+    agent_string_free(&str);
+    assert(str.data == NULL);
+
+    agent_context_destroy(ctx);
+}
+
+/* Rope tests */
+
+TEST(rope_append) {
+    agent_context_t* ctx = agent_context_create(0);
+    agent_context_t* arenas[] = {NULL, ctx};
+
+    for (size_t a = 0; a < 2; a++) {
+        agent_rope_t rope;
+        assert(agent_rope_init(&rope, arenas[a], 4) == AGENT_OK);
+        assert(rope.head == NULL);
+
+        /* Appends split across fixed-size chunks; earlier chunks never move */
+        agent_rope_append(&rope, "hel", 3);
+        agent_rope_chunk_t* first = rope.head;
+        agent_rope_append(&rope, "lo, world", 9);
+        assert(rope.head == first && rope.length == 12);
+
+        agent_rope_iter_t iter = agent_rope_iter(&rope);
+        agent_string_view_t chunk;
+        const char* expected[] = {"hell", "o, w", "orld"};
+        size_t chunks = 0;
+        while (agent_rope_iter_next(&iter, &chunk)) {
+            assert(agent_sv_equals_cstr(chunk, expected[chunks]));
+            chunks++;
+        }
+        assert(chunks == 3);
+
+        agent_string_t flat;
+        agent_string_init(&flat, 0);
+        agent_string_append(&flat, ">");
+        assert(agent_rope_flatten(&rope, &flat) == AGENT_OK);
+        assert(strcmp(flat.data, ">hello, world") == 0);
+        agent_string_free(&flat);
+
+        /* Clearing keeps the chunks for the next text */
+        agent_rope_clear(&rope);
+        assert(rope.length == 0);
+        iter = agent_rope_iter(&rope);
+        assert(!agent_rope_iter_next(&iter, &chunk));
+        agent_rope_append(&rope, "again", 5);
+        assert(rope.head == first && rope.length == 5);
+        iter = agent_rope_iter(&rope);
+        assert(agent_rope_iter_next(&iter, &chunk) && agent_sv_equals_cstr(chunk, "agai"));
+        assert(agent_rope_iter_next(&iter, &chunk) && agent_sv_equals_cstr(chunk, "n"));
+        assert(!agent_rope_iter_next(&iter, &chunk));
+
+        agent_rope_free(&rope);
+        assert(rope.head == NULL && rope.length == 0);
+    }
+
+    agent_context_destroy(ctx);
+}
+
 /* UUID tests */
 
 TEST(uuid_generate) {
@@ -202,6 +462,32 @@ TEST(uuid_nil) {
     assert(!agent_uuid_is_nil(uuid));
 }
 
+TEST(uuid_generate_many) {
+    /* Crosses several pool refills */
+    agent_uuid_t previous = agent_uuid_generate();
+    for (int i = 0; i < 100; i++) {
+        agent_uuid_t uuid = agent_uuid_generate();
+        assert(!agent_uuid_equals(uuid, previous));
+        assert((uuid.bytes[6] & 0xF0) == 0x40);
+        assert((uuid.bytes[8] & 0xC0) == 0x80);
+        previous = uuid;
+    }
+}
+
+TEST(uuid_generate_ordered) {
+    agent_uuid_t previous = agent_uuid_generate_ordered();
+    assert((previous.bytes[6] & 0xF0) == 0x70);  /* Version 7 */
+    assert((previous.bytes[8] & 0xC0) == 0x80);  /* Variant */
+
+    /* Strictly increasing, even many per millisecond */
+    for (int i = 0; i < 10000; i++) {
+        agent_uuid_t uuid = agent_uuid_generate_ordered();
+        assert(memcmp(previous.bytes, uuid.bytes, 16) < 0);
+        assert((uuid.bytes[6] & 0xF0) == 0x70);
+        previous = uuid;
+    }
+}
+
 int main(void) {
     printf("Running string tests...\n");
 
@@ -209,12 +495,15 @@ int main(void) {
     RUN_TEST(sv_equals);
     RUN_TEST(sv_starts_with);
     RUN_TEST(sv_find);
+    RUN_TEST(sv_find_long);
+    RUN_TEST(sv_find_any);
     RUN_TEST(sv_substr);
     RUN_TEST(sv_trim);
 
     printf("\nRunning UTF-8 tests...\n");
 
     RUN_TEST(utf8_validate);
+    RUN_TEST(utf8_validate_blocks);
     RUN_TEST(utf8_char_length);
     RUN_TEST(utf8_char_count);
     RUN_TEST(utf8_complete_boundary);
@@ -222,15 +511,25 @@ int main(void) {
     printf("\nRunning mutable string tests...\n");
 
     RUN_TEST(string_init_free);
+    RUN_TEST(string_inline);
     RUN_TEST(string_append);
     RUN_TEST(string_append_fmt);
+    RUN_TEST(string_append_typed);
+    RUN_TEST(string_template);
     RUN_TEST(string_reserve);
+    RUN_TEST(string_arena);
+
+    printf("\nRunning rope tests...\n");
+
+    RUN_TEST(rope_append);
 
     printf("\nRunning UUID tests...\n");
 
     RUN_TEST(uuid_generate);
     RUN_TEST(uuid_string);
     RUN_TEST(uuid_nil);
+    RUN_TEST(uuid_generate_many);
+    RUN_TEST(uuid_generate_ordered);
 
     printf("\nAll string tests passed!\n");
     return 0;
@@ -561,35 +561,39 @@ extension AgentOrchestrator {
 
             var toolCallDetected = false
 
+            // Tags are recognized incrementally as tokens arrive (either format)
+            let tagContext = try CAgentContext(initialSize: 4096)
+            let tagParser = try CStreamingParser(dialect: .llama3, using: tagContext) { event in
+                switch event {
+                case .toolCallStarted, .toolCall:
+                    toolCallDetected = true
+                case .text, .thinking:
+                    break
+                }
+            }
+
             _ = try await llm.generateWithMessages(
                 messages: workingHistory,
                 systemPrompt: systemPrompt,
                 settings: settings
             ) { token in
                 buffer += token
+                if toolCallDetected { return }
 
-                // Stop streaming to UI if tool call is detected (either format)
-                if buffer.contains("<tool_call>") || buffer.contains("<|python_tag|>") {
+                // Stop streaming to UI if tool call is detected
+                tagParser.feed(token)
+                if toolCallDetected || tagParser.inToolCall {
                     toolCallDetected = true
                     return
                 }
 
-                // Also detect bare JSON tool calls (for smaller models)
-                // Look for pattern like {"name": "...", "arguments": ...}
-                if buffer.contains("\"name\"") && buffer.contains("\"arguments\"") && buffer.contains("}") {
-                    // Check if we have a complete JSON object
-                    if buffer.lastIndex(of: "}") != nil {
-                        let afterThink = buffer.range(of: "</think>").map { String(buffer[$0.upperBound...]) } ?? buffer
-                        if afterThink.contains("{") && afterThink.contains("}") {
-                            toolCallDetected = true
-                            return
-                        }
-                    }
+                // Also detect bare JSON tool calls (for smaller models), once an object may have closed
+                if token.contains("}") && tagParser.hasBareJSONCandidate {
+                    toolCallDetected = true
+                    return
                 }
 
-                if !toolCallDetected {
-                    onToken(token)
-                }
+                onToken(token)
             }
 
             // Debug: Log raw model output to check if tool calls are being generated
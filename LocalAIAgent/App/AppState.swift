@@ -137,6 +137,19 @@ final class AppState: ObservableObject {
         return japaneseCount * 2 + Int(Double(otherCount) * 0.3) + 20
     }
 
+    /// Token count of text: exact from the loaded vocab when there is one
+    private func countTokens(_ text: String) -> Int {
+        return llmEngine?.tokenCounter?.tokens(in: text) ?? estimateTokens(text)
+    }
+
+    /// Token count of a message, memoized per message id by the engine's counter
+    private func countTokens(_ message: Message) -> Int {
+        if let tokens = llmEngine?.tokenCounter?.tokens(in: message) {
+            return tokens
+        }
+        return estimateTokens(message.content) + (message.thinkingContent.map { estimateTokens($0) } ?? 0)
+    }
+
     /// Trim conversation history to fit within context window.
     /// Uses LLM-generated summary for older messages when available.
     /// Optimized: collects messages in reverse then reverses once (O(n) vs O(n^2) insert-at-0).
@@ -159,7 +172,7 @@ final class AppState: ObservableObject {
 
         // Calculate available tokens (reserve space for summary if exists)
         let availableTokens = hasSummary
-            ? maxContextTokens - estimateTokens(summaryContent)
+            ? maxContextTokens - countTokens(summaryContent)
             : maxContextTokens
 
         // Collect messages newest-first then reverse at the end (avoids O(n^2) insert-at-0)
@@ -175,9 +188,7 @@ final class AppState: ObservableObject {
                 continue
             }
 
-            let messageTokens = estimateTokens(message.content)
-            let thinkingTokens = message.thinkingContent.map { estimateTokens($0) } ?? 0
-            let totalMessageTokens = messageTokens + thinkingTokens
+            let totalMessageTokens = countTokens(message)
 
             if estimatedTokens + totalMessageTokens > availableTokens {
                 trimStartIndex = index + 1
@@ -207,7 +218,7 @@ final class AppState: ObservableObject {
             )
             result.insert(summaryMessage, at: 0)
             logInfo("Context", "Using cached summary", [
-                "summaryTokens": "\(estimateTokens(summaryContent))",
+                "summaryTokens": "\(countTokens(summaryContent))",
                 "recentMessages": "\(result.count - 1)"
             ])
         }
@@ -409,8 +420,19 @@ final class AppState: ObservableObject {
         #endif
     }
 
-    /// Handle memory warning by unloading model and freeing resources
+    /// Handle memory warning by shrinking the KV cache, or unloading the model
+    /// when it cannot shrink further
     private func handleMemoryWarning() {
+        Task { @MainActor in
+            if let engine = llmEngine, await engine.reduceMemoryUsage() {
+                logWarning("AppState", "⚠️ Memory warning received - reduced KV cache")
+                return
+            }
+            unloadAfterMemoryWarning()
+        }
+    }
+
+    private func unloadAfterMemoryWarning() {
         logWarning("AppState", "⚠️ Memory warning received - unloading model to prevent crash")
 
         // Unload model to free memory
@@ -555,6 +577,7 @@ final class AppState: ObservableObject {
 
             // Save as last used model for next startup
             lastUsedModel = modelName
+            OnDemandResourceManager.shared.recordModelUse(modelName)
 
             if let llm = llmEngine, let mcp = mcpClient {
                 orchestrator = AgentOrchestrator(llm: llm, mcpClient: mcp, modelId: modelName)
@@ -36,6 +36,8 @@ struct LocalAIAgentApp: App {
                 .onAppear {
                     // Start monitoring for server auto-start
                     startServerMonitoring()
+                    // Fetch likely models ahead of time on Wi-Fi and power
+                    OnDemandResourceManager.shared.startPrefetchScheduling()
                     #if !targetEnvironment(macCatalyst)
                     // iPhone: start Bonjour browsing to discover Mac peers
                     ChatModeManager.shared.p2p?.startBrowsing()
@@ -16,10 +16,16 @@ final class BitNetInference: ObservableObject {
     @Published private(set) var isModelLoaded = false
     @Published private(set) var isGenerating = false
     @Published private(set) var currentModelName: String?
+    /// Progress of the post-load warmup, from 0 to 1
+    @Published private(set) var warmupProgress: Double = 0
 
     private var model: OpaquePointer?
     private var context: OpaquePointer?
+    // Calibrated (or default) thread counts; the thermal budget scales them
+    private var threads: (decode: UInt32, prefill: UInt32) = (0, 0)
     private var generationTask: Task<Void, Never>?
+    private var warmupTask: Task<Void, Never>?
+    private var warmupSink: BitNetProgressSink?
 
     private init() {
         bitnet_backend_init()
@@ -32,7 +38,9 @@ final class BitNetInference: ObservableObject {
 
     // MARK: - Model Loading
 
-    func loadModel(path: String, gpuLayers: Int32 = 99) async throws {
+    /// Loads the model and, with `warmup`, prefetches its weights and runs a
+    /// dummy decode in the background; generation waits for it to finish.
+    func loadModel(path: String, gpuLayers: Int32 = 99, warmup: Bool = true) async throws {
         unloadModel()
 
         return try await withCheckedThrowingContinuation { continuation in
@@ -48,7 +56,11 @@ final class BitNetInference: ObservableObject {
                 var ctxParams = bitnet_context_default_params()
                 ctxParams.n_ctx = 4096
                 ctxParams.n_batch = 512
-                ctxParams.n_threads = UInt32(ProcessInfo.processInfo.activeProcessorCount)
+                let tuned = ThreadSettings.load()
+                if let tuned = tuned {
+                    ctxParams.n_threads = tuned.decode
+                    ctxParams.n_threads_batch = tuned.prefill
+                }
 
                 guard let ctx = bitnet_new_context(model, ctxParams) else {
                     bitnet_free_model(model)
@@ -56,11 +68,27 @@ final class BitNetInference: ObservableObject {
                     return
                 }
 
+                // Calibrate once per device; the defaults use performance cores
+                var threads = (decode: ctxParams.n_threads, prefill: ctxParams.n_threads_batch)
+                if tuned == nil {
+                    let maxThreads = UInt32(ProcessInfo.processInfo.activeProcessorCount)
+                    var decode: UInt32 = 0
+                    var prefill: UInt32 = 0
+                    if bitnet_calibrate_threads(ctx, maxThreads, &decode, &prefill) {
+                        ThreadSettings(decode: decode, prefill: prefill).save()
+                        threads = (decode, prefill)
+                    }
+                }
+
                 DispatchQueue.main.async {
                     self?.model = model
                     self?.context = ctx
+                    self?.threads = threads
                     self?.isModelLoaded = true
                     self?.currentModelName = URL(fileURLWithPath: path).deletingPathExtension().lastPathComponent
+                    if warmup {
+                        self?.startWarmup(context: ctx)
+                    }
                     continuation.resume()
                 }
             }
@@ -71,14 +99,32 @@ final class BitNetInference: ObservableObject {
         generationTask?.cancel()
         generationTask = nil
 
-        if let ctx = context {
-            bitnet_free_context(ctx)
-            context = nil
+        // A running warmup still uses the context: free after it stops
+        let warmup = warmupTask
+        warmupSink?.cancel()
+        warmupTask = nil
+        warmupSink = nil
+        warmupProgress = 0
+
+        let ctx = context
+        let model = self.model
+        context = nil
+        self.model = nil
+        let free = {
+            if let ctx = ctx {
+                bitnet_free_context(ctx)
+            }
+            if let model = model {
+                bitnet_free_model(model)
+            }
         }
-
-        if let model = model {
-            bitnet_free_model(model)
-            self.model = nil
+        if let warmup = warmup {
+            Task.detached {
+                await warmup.value
+                free()
+            }
+        } else {
+            free()
         }
 
         isModelLoaded = false
@@ -93,6 +139,7 @@ final class BitNetInference: ObservableObject {
         temperature: Float = 0.7,
         topP: Float = 0.9,
         topK: Int32 = 40,
+        repeatPenalty: Float = 1.1,
         onToken: @escaping (String) -> Void
     ) async throws {
         guard let model = model, let context = context else {
@@ -102,64 +149,58 @@ final class BitNetInference: ObservableObject {
         isGenerating = true
         defer { isGenerating = false }
 
+        await warmupTask?.value
+
+        // Threads and prefill chunk follow the thermal budget from turn to turn
+        let budget = InferenceScheduler.shared.budget
+        bitnet_set_threads(context, UInt32(budget.threads(Int32(threads.decode))),
+                           UInt32(budget.threads(Int32(threads.prefill))))
+        bitnet_set_prefill_chunk(context, Int32(budget.prefillChunk))
+
+        let sink = BitNetTextSink(onToken: onToken)
+
         try await withTaskCancellationHandler {
             try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
                 DispatchQueue.global(qos: .userInitiated).async {
-                    // Tokenize input
-                    var tokens = [bitnet_token](repeating: 0, count: 4096)
-                    let nTokens = bitnet_tokenize(model, prompt, &tokens, Int32(tokens.count), true)
-
-                    if nTokens < 0 {
+                    guard let tokens = Self.tokenize(prompt, model: model) else {
                         continuation.resume(throwing: BitNetError.tokenizationFailed)
                         return
                     }
-
-                    // Initial evaluation
-                    if !bitnet_eval(context, tokens, nTokens, 0) {
-                        continuation.resume(throwing: BitNetError.evaluationFailed)
-                        return
-                    }
+                    let nTokens = Int32(tokens.count)
 
                     var samplingParams = bitnet_sampling_default_params()
                     samplingParams.temperature = temperature
                     samplingParams.top_p = topP
                     samplingParams.top_k = topK
-
-                    let eosToken = bitnet_token_eos(model)
-                    var nPast = nTokens
-                    var generatedTokens = 0
-
-                    // Generation loop
-                    while generatedTokens < maxTokens && !Task.isCancelled {
-                        let token = bitnet_sample(context, samplingParams)
-
-                        if token == eosToken || token < 0 {
-                            break
-                        }
-
-                        // Convert token to text
-                        if let piece = bitnet_token_to_piece(model, token) {
-                            let text = String(cString: piece)
+                    samplingParams.repeat_penalty = repeatPenalty
+
+                    // The whole loop runs in the wrapper; text arrives in batches.
+                    // The sink outlives the call, so it is passed unretained.
+                    let generated = bitnet_generate(
+                        context, tokens, nTokens, samplingParams, Int32(maxTokens), nil, 0,
+                        { text, length, userData in
+                            let sink = Unmanaged<BitNetTextSink>.fromOpaque(userData!).takeUnretainedValue()
+                            guard let text = text else { return !sink.isCancelled }
+                            let bytes = UnsafeRawBufferPointer(start: text, count: length)
+                            let chunk = String(decoding: bytes, as: UTF8.self)
+                            let onToken = sink.onToken
                             DispatchQueue.main.async {
-                                onToken(text)
+                                onToken(chunk)
                             }
-                        }
-
-                        // Evaluate next token
-                        var nextToken = token
-                        if !bitnet_eval(context, &nextToken, 1, nPast) {
-                            break
-                        }
+                            return !sink.isCancelled
+                        },
+                        Unmanaged.passUnretained(sink).toOpaque())
 
-                        nPast += 1
-                        generatedTokens += 1
+                    if generated < 0 {
+                        continuation.resume(throwing: BitNetError.evaluationFailed)
+                        return
                     }
 
                     continuation.resume()
                 }
             }
         } onCancel: {
-            // Handle cancellation
+            sink.cancel()
         }
     }
 
@@ -167,6 +208,171 @@ final class BitNetInference: ObservableObject {
         generationTask?.cancel()
         generationTask = nil
     }
+
+    // MARK: - Warmup
+
+    private func startWarmup(context: OpaquePointer) {
+        warmupProgress = 0
+        let sink = BitNetProgressSink { [weak self] progress in
+            DispatchQueue.main.async {
+                self?.warmupProgress = Double(progress)
+            }
+        }
+        warmupSink = sink
+        warmupTask = Task.detached(priority: .utility) {
+            _ = bitnet_warmup(context, { progress, userData in
+                let sink = Unmanaged<BitNetProgressSink>.fromOpaque(userData!).takeUnretainedValue()
+                sink.onProgress(progress)
+                return !sink.isCancelled
+            }, Unmanaged.passUnretained(sink).toOpaque())
+            // Keeps the sink alive until bitnet_warmup returns
+            withExtendedLifetime(sink) {}
+        }
+    }
+
+    // MARK: - Warm Start
+
+    /// Restores the KV cache for `systemPrompt` from `cacheDirectory`, or
+    /// prefills it and saves it there for the next launch. Prompts that
+    /// start with the same tokens then skip that prefill.
+    /// Returns true when the cache was restored from disk.
+    @discardableResult
+    func warmStart(systemPrompt: String, cacheDirectory: URL) async throws -> Bool {
+        guard let model = model, let context = context else {
+            throw BitNetError.modelNotLoaded
+        }
+        // The warmup clears the cache this restores
+        await warmupTask?.value
+
+        return try await withCheckedThrowingContinuation { continuation in
+            DispatchQueue.global(qos: .userInitiated).async {
+                guard let tokens = Self.tokenize(systemPrompt, model: model) else {
+                    continuation.resume(throwing: BitNetError.tokenizationFailed)
+                    return
+                }
+
+                let key = bitnet_state_key(context, tokens, Int32(tokens.count))
+                let stateURL = cacheDirectory.appendingPathComponent(String(format: "bitnet-%016llx.kvstate", key))
+                if bitnet_state_load(context, stateURL.path) == Int32(tokens.count) {
+                    continuation.resume(returning: true)
+                    return
+                }
+
+                guard bitnet_eval_prompt(context, tokens, Int32(tokens.count)) else {
+                    continuation.resume(throwing: BitNetError.evaluationFailed)
+                    return
+                }
+                try? FileManager.default.createDirectory(at: cacheDirectory, withIntermediateDirectories: true)
+                _ = bitnet_state_save(context, stateURL.path, Int32(tokens.count))
+                continuation.resume(returning: false)
+            }
+        }
+    }
+
+    // MARK: - Tokenization
+
+    /// Tokens text takes in the loaded vocab, for context budgeting
+    func countTokens(_ text: String) -> Int? {
+        guard let model = model else { return nil }
+        let n = text.withCString { bitnet_count_tokens(model, $0, text.utf8.count, false) }
+        return n < 0 ? nil : Int(n)
+    }
+
+    /// Tokenizes text, growing the buffer to the size the tokenizer asks for
+    private nonisolated static func tokenize(_ text: String, model: OpaquePointer) -> [bitnet_token]? {
+        let byteCount = text.utf8.count
+        var tokens = [bitnet_token](repeating: 0, count: byteCount + 2)
+        var nTokens = text.withCString {
+            bitnet_tokenize_n(model, $0, byteCount, &tokens, Int32(tokens.count), true)
+        }
+        if nTokens < 0 && nTokens != Int32.min {
+            tokens = [bitnet_token](repeating: 0, count: Int(-nTokens))
+            nTokens = text.withCString {
+                bitnet_tokenize_n(model, $0, byteCount, &tokens, Int32(tokens.count), true)
+            }
+        }
+        guard nTokens >= 0 else { return nil }
+        return Array(tokens.prefix(Int(nTokens)))
+    }
+}
+
+// MARK: - Thread Settings
+
+/// Thread counts found by bitnet_calibrate_threads, stored per device model
+private struct ThreadSettings {
+    let decode: UInt32
+    let prefill: UInt32
+
+    private static var key: String {
+        var systemInfo = utsname()
+        uname(&systemInfo)
+        let machine = withUnsafeBytes(of: &systemInfo.machine) { bytes in
+            String(decoding: bytes.prefix { $0 != 0 }, as: UTF8.self)
+        }
+        return "bitnet_threads_\(machine)"
+    }
+
+    static func load() -> ThreadSettings? {
+        guard let values = UserDefaults.standard.array(forKey: key) as? [Int], values.count == 2,
+              values[0] > 0, values[1] > 0 else {
+            return nil
+        }
+        return ThreadSettings(decode: UInt32(values[0]), prefill: UInt32(values[1]))
+    }
+
+    func save() {
+        UserDefaults.standard.set([Int(decode), Int(prefill)], forKey: Self.key)
+    }
+}
+
+// MARK: - Streaming
+
+/// Receives bitnet_generate's text on the decoding thread
+private final class BitNetTextSink: @unchecked Sendable {
+    let onToken: (String) -> Void
+    private let lock = NSLock()
+    private var cancelled = false
+
+    init(onToken: @escaping (String) -> Void) {
+        self.onToken = onToken
+    }
+
+    var isCancelled: Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return cancelled
+    }
+
+    func cancel() {
+        lock.lock()
+        cancelled = true
+        lock.unlock()
+    }
+}
+
+// MARK: - Warmup Progress
+
+/// Receives bitnet_warmup's progress on the warmup thread
+private final class BitNetProgressSink: @unchecked Sendable {
+    let onProgress: (Float) -> Void
+    private let lock = NSLock()
+    private var cancelled = false
+
+    init(onProgress: @escaping (Float) -> Void) {
+        self.onProgress = onProgress
+    }
+
+    var isCancelled: Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return cancelled
+    }
+
+    func cancel() {
+        lock.lock()
+        cancelled = true
+        lock.unlock()
+    }
 }
 
 // MARK: - Errors
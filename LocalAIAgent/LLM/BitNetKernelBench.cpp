@@ -0,0 +1,125 @@
+//
+//  BitNetKernelBench.cpp
+//  LocalAIAgent
+//
+//  Times ggml_mul_mat on ternary (TL1) weights, which dispatches to the
+//  LUT kernels exactly as model inference does
+//
+
+#include "BitNetKernelBench.h"
+#include "ggml.h"
+#include "ggml-bitnet.h"
+#include "gemm-config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Kept in step with the shapes bitnet-lut-kernels.h generates
+static const bitnet_kernel_shape KERNEL_SHAPES[] = {
+    {1536, 4096},
+    {1536, 1536},
+    {4096, 1536},
+};
+
+const bitnet_kernel_shape* bitnet_kernel_shapes(int32_t* n_shapes) {
+    if (n_shapes) {
+        *n_shapes = (int32_t)(sizeof(KERNEL_SHAPES) / sizeof(KERNEL_SHAPES[0]));
+    }
+    return KERNEL_SHAPES;
+}
+
+bitnet_kernel_config bitnet_kernel_compiled_config(void) {
+    bitnet_kernel_config config = {};
+#if defined(ROW_BLOCK_SIZE)
+    config.row_block_size = ROW_BLOCK_SIZE;
+    config.col_block_size = COL_BLOCK_SIZE;
+    config.parallel_size = PARALLEL_SIZE;
+#endif
+#if defined(ACT_PARALLEL)
+    config.act_parallel = true;
+#endif
+    return config;
+}
+
+static bool has_kernel(bitnet_kernel_shape shape) {
+    for (const bitnet_kernel_shape& known : KERNEL_SHAPES) {
+        if (known.m == shape.m && known.k == shape.k) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool bitnet_kernel_bench(bitnet_kernel_shape shape, int32_t n, int32_t n_threads,
+                         int32_t iterations, bitnet_kernel_result* result) {
+    if (!result || n <= 0 || n_threads <= 0 || iterations <= 0 || !has_kernel(shape)) {
+        return false;
+    }
+    ggml_bitnet_init();
+    ggml_bitnet_set_n_threads(n_threads);
+
+    // Two bits per weight, then the per-tensor scale the transform reads
+    size_t weight_bytes = (size_t)shape.m * shape.k / 4;
+    std::vector<uint8_t> weights(weight_bytes + 64);
+    std::mt19937 rng(42);
+    std::generate(weights.begin(), weights.begin() + weight_bytes, [&] { return (uint8_t)rng(); });
+    float scale = 1.0f;
+    memcpy(weights.data() + weight_bytes, &scale, sizeof(scale));
+
+    size_t activation_bytes = (size_t)shape.k * n * sizeof(float);
+    size_t output_bytes = (size_t)shape.m * n * sizeof(float);
+    ggml_init_params params = {};
+    params.mem_size = ggml_tensor_overhead() * 4 + ggml_graph_overhead() +
+                      ggml_row_size(GGML_TYPE_TL1, shape.k) * shape.m +
+                      activation_bytes + output_bytes + 1024;
+    params.no_alloc = false;
+    ggml_context* ctx = ggml_init(params);
+    if (!ctx) {
+        return false;
+    }
+
+    ggml_tensor* w = ggml_new_tensor_2d(ctx, GGML_TYPE_TL1, shape.k, shape.m);
+    ggml_tensor* x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, shape.k, n);
+    w->data = weights.data();
+    // Takes one of ggml-bitnet's tensor slots, as loading a model's weights does
+    ggml_bitnet_transform_tensor(w);
+
+    std::uniform_real_distribution<float> values(-1.0f, 1.0f);
+    float* activations = (float*)x->data;
+    for (size_t i = 0; i < (size_t)shape.k * n; i++) {
+        activations[i] = values(rng);
+    }
+
+    ggml_tensor* y = ggml_mul_mat(ctx, w, x);
+    ggml_cgraph* graph = ggml_new_graph(ctx);
+    ggml_build_forward_expand(graph, y);
+    ggml_cplan plan = ggml_graph_plan(graph, n_threads, nullptr);
+    std::vector<uint8_t> work(plan.work_size);
+    plan.work_data = work.data();
+
+    using clock = std::chrono::steady_clock;
+    bool ok = ggml_graph_compute(graph, &plan) == GGML_STATUS_SUCCESS;
+    std::vector<double> times;
+    for (int32_t i = 0; ok && i < iterations; i++) {
+        clock::time_point start = clock::now();
+        ok = ggml_graph_compute(graph, &plan) == GGML_STATUS_SUCCESS;
+        times.push_back(std::chrono::duration<double>(clock::now() - start).count());
+    }
+    ggml_free(ctx);
+    if (!ok) {
+        return false;
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    double seconds = times[times.size() / 2];
+    result->shape = shape;
+    result->n = n;
+    result->n_threads = n_threads;
+    result->seconds = seconds;
+    result->gb_per_s = seconds > 0 ? (double)weight_bytes / seconds / 1e9 : 0;
+    result->tokens_per_s = seconds > 0 ? n / seconds : 0;
+    return true;
+}
@@ -0,0 +1,58 @@
+//
+//  BitNetKernelBench.h
+//  LocalAIAgent
+//
+//  Micro-benchmark for the BitNet ternary LUT kernels on the running device
+//
+
+#ifndef BitNetKernelBench_h
+#define BitNetKernelBench_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A weight matrix the kernels are generated for: m rows of k ternary weights
+typedef struct {
+    int32_t m;
+    int32_t k;
+} bitnet_kernel_shape;
+
+// Timing of one m x k weight times k x n activation multiplication
+typedef struct {
+    bitnet_kernel_shape shape;
+    int32_t n;                 // Activation columns: 1 is the decode GEMV
+    int32_t n_threads;
+    double seconds;            // Median over the timed iterations
+    double gb_per_s;           // Packed weight bytes streamed per second
+    double tokens_per_s;       // Activation columns per second through this matrix
+} bitnet_kernel_result;
+
+// Tile parameters the app was compiled with (gemm-config.h)
+typedef struct {
+    int32_t row_block_size;
+    int32_t col_block_size;
+    int32_t parallel_size;
+    bool act_parallel;
+} bitnet_kernel_config;
+
+// Shapes bitnet-lut-kernels.h has kernels for
+const bitnet_kernel_shape* bitnet_kernel_shapes(int32_t* n_shapes);
+
+bitnet_kernel_config bitnet_kernel_compiled_config(void);
+
+// Time shape against n activation columns: one warm-up run, then the
+// median of iterations runs. Returns false if the shape has no kernel or
+// the buffers cannot be allocated.
+bool bitnet_kernel_bench(bitnet_kernel_shape shape, int32_t n, int32_t n_threads,
+                         int32_t iterations, bitnet_kernel_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BitNetKernelBench_h */
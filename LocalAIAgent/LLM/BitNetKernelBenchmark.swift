@@ -0,0 +1,107 @@
+#if !targetEnvironment(macCatalyst)
+//
+//  BitNetKernelBenchmark.swift
+//  LocalAIAgent
+//
+//  Runs the BitNet LUT kernel micro-benchmark and reports it per device
+//
+
+import Foundation
+
+/// Times the ternary GEMV/GEMM kernels for every generated shape
+enum BitNetKernelBenchmark {
+    struct Row {
+        let m: Int
+        let k: Int
+        let columns: Int
+        let threads: Int
+        let milliseconds: Double
+        let gigabytesPerSecond: Double
+        let tokensPerSecond: Double
+    }
+
+    struct Report {
+        let device: String
+        let config: bitnet_kernel_config
+        let rows: [Row]
+        /// Decode speed of the 24-layer 1536/4096 model implied by the GEMV timings
+        let estimatedDecodeTokensPerSecond: Double?
+
+        var text: String {
+            var lines = [
+                "BitNet kernels on \(device)",
+                "gemm-config: ROW_BLOCK_SIZE=\(config.row_block_size) COL_BLOCK_SIZE=\(config.col_block_size) " +
+                    "PARALLEL_SIZE=\(config.parallel_size) ACT_PARALLEL=\(config.act_parallel)",
+                "m      k      n    threads  ms        GB/s    tokens/s",
+            ]
+            for row in rows {
+                lines.append(String(format: "%-6d %-6d %-4d %-8d %-9.3f %-7.2f %.1f",
+                                    row.m, row.k, row.columns, row.threads,
+                                    row.milliseconds, row.gigabytesPerSecond, row.tokensPerSecond))
+            }
+            if let estimate = estimatedDecodeTokensPerSecond {
+                lines.append(String(format: "estimated decode: %.1f tokens/s (weights only)", estimate))
+            }
+            return lines.joined(separator: "\n")
+        }
+    }
+
+    /// Matrices per layer: q, k, v and o are 1536x1536, gate and up 4096x1536, down 1536x4096
+    private static let layerMix: [(m: Int32, k: Int32, count: Double)] = [
+        (1536, 1536, 4), (4096, 1536, 2), (1536, 4096, 1),
+    ]
+    private static let layerCount = 24.0
+
+    /// Runs on the calling thread; takes a few seconds. Tile parameters are
+    /// fixed when the xcframework is built, so compare configurations by
+    /// rebuilding it with another gemm-config.h and running this again.
+    static func run(columns: [Int32] = [1, 32, 128],
+                    threads: [Int32]? = nil,
+                    iterations: Int32 = 20) -> Report {
+        let threadCounts = threads ?? [Int32(bitnet_performance_cores())]
+        var count: Int32 = 0
+        let shapes = bitnet_kernel_shapes(&count)
+
+        var rows: [Row] = []
+        var gemvSeconds: [String: Double] = [:]
+        for index in 0..<Int(count) {
+            let shape = shapes![index]
+            for n in columns {
+                for nThreads in threadCounts {
+                    var result = bitnet_kernel_result()
+                    guard bitnet_kernel_bench(shape, n, nThreads, iterations, &result) else { continue }
+                    rows.append(Row(m: Int(shape.m), k: Int(shape.k), columns: Int(n), threads: Int(nThreads),
+                                    milliseconds: result.seconds * 1000,
+                                    gigabytesPerSecond: result.gb_per_s,
+                                    tokensPerSecond: result.tokens_per_s))
+                    if n == 1 {
+                        let key = "\(shape.m)x\(shape.k)"
+                        gemvSeconds[key] = min(gemvSeconds[key] ?? .infinity, result.seconds)
+                    }
+                }
+            }
+        }
+
+        var layerSeconds = 0.0
+        for entry in layerMix {
+            guard let seconds = gemvSeconds["\(entry.m)x\(entry.k)"] else {
+                layerSeconds = 0
+                break
+            }
+            layerSeconds += seconds * entry.count
+        }
+        let estimate = layerSeconds > 0 ? 1 / (layerSeconds * layerCount) : nil
+
+        return Report(device: deviceIdentifier, config: bitnet_kernel_compiled_config(),
+                      rows: rows, estimatedDecodeTokensPerSecond: estimate)
+    }
+
+    private static var deviceIdentifier: String {
+        var systemInfo = utsname()
+        uname(&systemInfo)
+        return withUnsafeBytes(of: &systemInfo.machine) { bytes in
+            String(decoding: bytes.prefix { $0 != 0 }, as: UTF8.self)
+        }
+    }
+}
+#endif  // !targetEnvironment(macCatalyst)
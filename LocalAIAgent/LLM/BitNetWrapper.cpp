@@ -6,22 +6,76 @@
 //
 
 #include "BitNetWrapper.h"
+#include "agent_trace.h"
 #include "llama.h"
 #include "ggml.h"
 
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
 #include <vector>
 #include <string>
+#include <cstring>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
 
 // Model wrapper
 struct bitnet_model {
     llama_model* model;
+    std::string path;
+    bool use_mmap;
+
+    // Every token's piece, NUL-terminated, in one blob: token t spans
+    // piece_offsets[t] .. piece_offsets[t + 1] - 1
+    std::string pieces;
+    std::vector<uint32_t> piece_offsets;
+
+    // Tokens of recently used segments, keyed by text, oldest first
+    std::mutex segment_mutex;
+    std::deque<std::pair<std::string, std::vector<llama_token>>> segments;
+
+    // Identifies the weights and vocabulary saved states belong to
+    uint64_t fingerprint;
 };
 
+// Segments kept per model
+static const size_t SEGMENT_CACHE_CAPACITY = 8;
+
 // Context wrapper
 struct bitnet_context {
     llama_context* ctx;
     llama_model* model;
-    std::vector<llama_token> tokens;
+    const bitnet_model* owner;
+    std::vector<llama_token> tokens;  // Tokens in the KV cache, by position
+
+    // Decode batch of n_batch tokens, reused by every bitnet_eval
+    llama_batch batch;
+    int32_t n_batch;
+    // Tokens per prefill decode, at most n_batch (bitnet_set_prefill_chunk)
+    int32_t n_chunk;
+
+    // Sampler chain, built on first use and rebuilt when the params change.
+    // When stale (new prompt, restored state) its history is refilled from
+    // tokens before the next sample.
+    llama_sampler* sampler;
+    bitnet_sampling_params sampler_params;
+    bool sampler_stale;
+
+    // Per-sequence state for bitnet_eval_batch / bitnet_sample_seq
+    struct sequence {
+        llama_sampler* sampler = nullptr;
+        bitnet_sampling_params sampler_params;
+        int32_t logits_index = -1;     // Batch index of its last evaluated token
+    };
+    std::vector<sequence> sequences;   // Indexed by seq_id, n_seq_max entries
 };
 
 // Default parameters
@@ -33,12 +87,30 @@ bitnet_model_params bitnet_model_default_params(void) {
     return params;
 }
 
+int32_t bitnet_performance_cores(void) {
+    int32_t cores = 0;
+#if defined(__APPLE__)
+    // Efficiency cores slow the ternary kernels down, so count only the
+    // top performance level (absent on single-level chips)
+    size_t size = sizeof(cores);
+    if (sysctlbyname("hw.perflevel0.physicalcpu", &cores, &size, nullptr, 0) != 0) {
+        cores = 0;
+    }
+#endif
+    if (cores <= 0) {
+        cores = (int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    return cores > 0 ? cores : 1;
+}
+
 bitnet_context_params bitnet_context_default_params(void) {
     bitnet_context_params params;
     params.n_ctx = 4096;
     params.n_batch = 512;
-    params.n_threads = 4;
+    params.n_threads = (uint32_t)bitnet_performance_cores();
+    params.n_threads_batch = params.n_threads;
     params.flash_attn = true;
+    params.n_seq_max = 1;
     return params;
 }
 
@@ -61,6 +133,61 @@ void bitnet_backend_free(void) {
     llama_backend_free();
 }
 
+// Convert every token once, so lookups never copy or truncate
+static void build_piece_table(bitnet_model* wrapper) {
+    int32_t n_vocab = llama_n_vocab(wrapper->model);
+    wrapper->piece_offsets.resize((size_t)n_vocab + 1);
+    wrapper->pieces.reserve((size_t)n_vocab * 8);
+
+    std::vector<char> buffer(256);
+    for (int32_t token = 0; token < n_vocab; token++) {
+        wrapper->piece_offsets[token] = (uint32_t)wrapper->pieces.size();
+        int32_t n = llama_token_to_piece(wrapper->model, token, buffer.data(), (int32_t)buffer.size(), 0, false);
+        if (n < 0) {
+            // -n is the size the piece needs
+            buffer.resize((size_t)-n);
+            n = llama_token_to_piece(wrapper->model, token, buffer.data(), (int32_t)buffer.size(), 0, false);
+        }
+        if (n > 0) {
+            wrapper->pieces.append(buffer.data(), (size_t)n);
+        }
+        wrapper->pieces.push_back('\0');
+    }
+    wrapper->piece_offsets[n_vocab] = (uint32_t)wrapper->pieces.size();
+}
+
+static const char* piece_for(const bitnet_model* model, llama_token token, size_t* out_length) {
+    if (token < 0 || (size_t)token + 1 >= model->piece_offsets.size()) {
+        if (out_length) *out_length = 0;
+        return "";
+    }
+    uint32_t start = model->piece_offsets[token];
+    if (out_length) *out_length = model->piece_offsets[token + 1] - start - 1;
+    return model->pieces.data() + start;
+}
+
+// 64-bit FNV-1a, continued from h
+static uint64_t fnv1a(uint64_t h, const void* data, size_t length) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+
+static uint64_t model_fingerprint(const bitnet_model* wrapper) {
+    char desc[128];
+    int32_t desc_length = llama_model_desc(wrapper->model, desc, sizeof(desc));
+    uint64_t sizes[2] = {llama_model_size(wrapper->model), llama_model_n_params(wrapper->model)};
+
+    size_t desc_used = desc_length > 0 ? std::min((size_t)desc_length, sizeof(desc) - 1) : 0;
+    uint64_t h = fnv1a(FNV_OFFSET, desc, desc_used);
+    h = fnv1a(h, sizes, sizeof(sizes));
+    return fnv1a(h, wrapper->pieces.data(), wrapper->pieces.size());
+}
+
 // Model loading
 bitnet_model* bitnet_load_model(const char* path, bitnet_model_params params) {
     llama_model_params model_params = llama_model_default_params();
@@ -75,6 +202,10 @@ bitnet_model* bitnet_load_model(const char* path, bitnet_model_params params) {
 
     bitnet_model* wrapper = new bitnet_model;
     wrapper->model = model;
+    wrapper->path = path;
+    wrapper->use_mmap = params.use_mmap;
+    build_piece_table(wrapper);
+    wrapper->fingerprint = model_fingerprint(wrapper);
     return wrapper;
 }
 
@@ -97,7 +228,9 @@ bitnet_context* bitnet_new_context(bitnet_model* model, bitnet_context_params pa
     ctx_params.n_ctx = params.n_ctx;
     ctx_params.n_batch = params.n_batch;
     ctx_params.n_threads = params.n_threads;
+    ctx_params.n_threads_batch = params.n_threads_batch > 0 ? params.n_threads_batch : params.n_threads;
     ctx_params.flash_attn = params.flash_attn;
+    ctx_params.n_seq_max = params.n_seq_max > 0 ? params.n_seq_max : 1;
 
     llama_context* ctx = llama_new_context_with_model(model->model, ctx_params);
     if (!ctx) {
@@ -107,11 +240,27 @@ bitnet_context* bitnet_new_context(bitnet_model* model, bitnet_context_params pa
     bitnet_context* wrapper = new bitnet_context;
     wrapper->ctx = ctx;
     wrapper->model = model->model;
+    wrapper->owner = model;
+    wrapper->n_batch = (int32_t)llama_n_batch(ctx);
+    wrapper->batch = llama_batch_init(wrapper->n_batch, 0, 1);
+    wrapper->n_chunk = wrapper->n_batch;
+    wrapper->sampler = nullptr;
+    wrapper->sampler_stale = false;
+    wrapper->sequences.resize(ctx_params.n_seq_max);
     return wrapper;
 }
 
 void bitnet_free_context(bitnet_context* ctx) {
     if (ctx) {
+        if (ctx->sampler) {
+            llama_sampler_free(ctx->sampler);
+        }
+        for (auto& seq : ctx->sequences) {
+            if (seq.sampler) {
+                llama_sampler_free(seq.sampler);
+            }
+        }
+        llama_batch_free(ctx->batch);
         if (ctx->ctx) {
             llama_free(ctx->ctx);
         }
@@ -125,39 +274,212 @@ int32_t bitnet_tokenize(bitnet_model* model, const char* text, bitnet_token* tok
         return -1;
     }
 
-    return llama_tokenize(model->model, text, strlen(text), tokens, n_max_tokens, add_bos, false);
+    return bitnet_tokenize_n(model, text, strlen(text), tokens, n_max_tokens, add_bos);
 }
 
-const char* bitnet_token_to_piece(bitnet_model* model, bitnet_token token) {
-    static thread_local char buffer[256];
-    if (!model || !model->model) {
-        return "";
+int32_t bitnet_tokenize_n(bitnet_model* model, const char* text, size_t text_len,
+                          bitnet_token* tokens, int32_t n_max_tokens, bool add_bos) {
+    if (!model || !model->model || (!text && text_len > 0) || (!tokens && n_max_tokens > 0)) {
+        return INT32_MIN;
+    }
+
+    // Negative = -(tokens needed) when n_max_tokens is too small
+    return llama_tokenize(model->model, text, (int32_t)text_len, tokens, n_max_tokens, add_bos, false);
+}
+
+int32_t bitnet_count_tokens(bitnet_model* model, const char* text, size_t text_len, bool add_bos) {
+    if (text_len == 0) {
+        return add_bos ? 1 : 0;
+    }
+    int32_t n = bitnet_tokenize_n(model, text, text_len, nullptr, 0, add_bos);
+    if (n == INT32_MIN) {
+        return -1;
+    }
+    return n < 0 ? -n : n;
+}
+
+int32_t bitnet_tokenize_segment(bitnet_model* model, const char* text, size_t text_len,
+                                bitnet_token* tokens, int32_t n_max_tokens, bool add_bos) {
+    if (!model || !model->model || (!text && text_len > 0) || (!tokens && n_max_tokens > 0)) {
+        return INT32_MIN;
+    }
+
+    std::string key(1, add_bos ? '\1' : '\0');
+    key.append(text, text_len);
+
+    std::lock_guard<std::mutex> lock(model->segment_mutex);
+    auto it = std::find_if(model->segments.begin(), model->segments.end(),
+                           [&](const auto& entry) { return entry.first == key; });
+    if (it == model->segments.end()) {
+        std::vector<llama_token> segment(text_len + 2);
+        int32_t n = bitnet_tokenize_n(model, text, text_len, segment.data(), (int32_t)segment.size(), add_bos);
+        if (n < 0) {
+            segment.resize((size_t)-n);
+            n = bitnet_tokenize_n(model, text, text_len, segment.data(), (int32_t)segment.size(), add_bos);
+            if (n < 0) {
+                return INT32_MIN;
+            }
+        }
+        segment.resize((size_t)n);
+
+        if (model->segments.size() >= SEGMENT_CACHE_CAPACITY) {
+            model->segments.pop_front();
+        }
+        model->segments.emplace_back(std::move(key), std::move(segment));
+        it = model->segments.end() - 1;
     }
 
-    int32_t n = llama_token_to_piece(model->model, token, buffer, sizeof(buffer) - 1, 0, false);
-    if (n < 0) {
+    const std::vector<llama_token>& segment = it->second;
+    int32_t count = (int32_t)segment.size();
+    // As bitnet_tokenize_n: a size query (no buffer) or a short buffer gets -count
+    if (!tokens || count > n_max_tokens) {
+        return -count;
+    }
+    std::copy(segment.begin(), segment.end(), tokens);
+    return count;
+}
+
+const char* bitnet_token_to_piece(bitnet_model* model, bitnet_token token) {
+    return bitnet_token_piece(model, token, nullptr);
+}
+
+const char* bitnet_token_piece(const bitnet_model* model, bitnet_token token, size_t* out_length) {
+    if (!model) {
+        if (out_length) *out_length = 0;
         return "";
     }
-    buffer[n] = '\0';
-    return buffer;
+    return piece_for(model, token, out_length);
+}
+
+// Batch filling. The bundled llama.h has no llama_batch_clear/llama_batch_add
+// (those live in llama.cpp's common library), so the fields are set here.
+static void batch_clear(llama_batch& batch) {
+    batch.n_tokens = 0;
+}
+
+static void batch_add(llama_batch& batch, llama_token token, llama_pos pos, llama_seq_id seq_id, bool logits) {
+    int32_t i = batch.n_tokens++;
+    batch.token[i] = token;
+    batch.pos[i] = pos;
+    batch.n_seq_id[i] = 1;
+    batch.seq_id[i][0] = seq_id;
+    batch.logits[i] = logits;
 }
 
 // Generation
+// Decode tokens into sequence 0 at n_past. Logits are kept for the last
+// token, or for every token when all_logits (then n_tokens <= n_batch).
+static bool eval_tokens(bitnet_context* ctx, const llama_token* tokens, int32_t n_tokens,
+                        int32_t n_past, bool all_logits) {
+    if (!ctx || !ctx->ctx || !tokens || n_tokens <= 0) {
+        return false;
+    }
+
+    // A new sequence starts with fresh sampler state
+    if (n_past == 0) {
+        ctx->sampler_stale = true;
+    }
+
+    // Anything cached past n_past is overwritten
+    if ((size_t)n_past < ctx->tokens.size()) {
+        llama_kv_cache_seq_rm(ctx->ctx, 0, n_past, -1);
+        ctx->tokens.resize(n_past);
+    }
+
+    // Prompts longer than a chunk are decoded in pieces; only the last
+    // token of the last chunk needs logits
+    int32_t chunk = all_logits ? ctx->n_batch : ctx->n_chunk;
+    for (int32_t start = 0; start < n_tokens; start += chunk) {
+        int32_t end = start + chunk < n_tokens ? start + chunk : n_tokens;
+
+        batch_clear(ctx->batch);
+        for (int32_t i = start; i < end; i++) {
+            batch_add(ctx->batch, tokens[i], n_past + i, 0, all_logits || i == n_tokens - 1);
+        }
+
+        if (llama_decode(ctx->ctx, ctx->batch) != 0) {
+            return false;
+        }
+        ctx->tokens.insert(ctx->tokens.end(), tokens + start, tokens + end);
+    }
+
+    ctx->sequences[0].logits_index = ctx->batch.n_tokens - 1;
+    return true;
+}
+
 bool bitnet_eval(bitnet_context* ctx, const bitnet_token* tokens, int32_t n_tokens, int32_t n_past) {
+    AGENT_TRACE_BEGIN(bitnet_eval);
+    bool ok = eval_tokens(ctx, tokens, n_tokens, n_past, false);
+    AGENT_TRACE_END(bitnet_eval);
+    return ok;
+}
+
+bool bitnet_eval_prompt(bitnet_context* ctx, const bitnet_token* tokens, int32_t n_tokens) {
     if (!ctx || !ctx->ctx || !tokens || n_tokens <= 0) {
         return false;
     }
 
-    llama_batch batch = llama_batch_init(n_tokens, 0, 1);
+    // Longest prefix already in the cache; the last prompt token is always
+    // decoded again so its logits are fresh for sampling
+    size_t common = 0;
+    size_t limit = std::min(ctx->tokens.size(), (size_t)n_tokens - 1);
+    while (common < limit && ctx->tokens[common] == tokens[common]) {
+        common++;
+    }
+
+    ctx->sampler_stale = true;
+    return bitnet_eval(ctx, tokens + common, n_tokens - (int32_t)common, (int32_t)common);
+}
 
-    for (int32_t i = 0; i < n_tokens; i++) {
-        llama_batch_add(batch, tokens[i], n_past + i, {0}, i == n_tokens - 1);
+static bool same_sampling_params(const bitnet_sampling_params& a, const bitnet_sampling_params& b) {
+    return a.temperature == b.temperature && a.top_p == b.top_p && a.top_k == b.top_k &&
+           a.repeat_penalty == b.repeat_penalty && a.repeat_last_n == b.repeat_last_n;
+}
+
+// Sampler chain for params in slot, (re)built when missing or different
+static llama_sampler* sampler_for(const llama_model* model, llama_sampler*& slot,
+                                  bitnet_sampling_params& slot_params,
+                                  const bitnet_sampling_params& params) {
+    if (slot && !same_sampling_params(slot_params, params)) {
+        llama_sampler_free(slot);
+        slot = nullptr;
     }
 
-    int result = llama_decode(ctx->ctx, batch);
-    llama_batch_free(batch);
+    if (!slot) {
+        llama_sampler* sampler = llama_sampler_chain_init(llama_sampler_chain_default_params());
+        // The penalties sampler keeps the last repeat_last_n accepted tokens
+        // in a ring buffer sized once, here
+        if (params.repeat_penalty != 1.0f && params.repeat_last_n != 0) {
+            llama_sampler_chain_add(sampler, llama_sampler_init_penalties(
+                llama_n_vocab(model), llama_token_eos(model), llama_token_nl(model),
+                params.repeat_last_n, params.repeat_penalty, 0.0f, 0.0f, false, false));
+        }
+        llama_sampler_chain_add(sampler, llama_sampler_init_temp(params.temperature));
+        llama_sampler_chain_add(sampler, llama_sampler_init_top_k(params.top_k));
+        llama_sampler_chain_add(sampler, llama_sampler_init_top_p(params.top_p, 1));
+        // Seeded once, so the RNG advances from token to token
+        llama_sampler_chain_add(sampler, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
+        slot = sampler;
+        slot_params = params;
+    }
+    return slot;
+}
 
-    return result == 0;
+// Sequence 0's chain, with the penalty history of a new or rebuilt chain
+// taken from the cached tokens
+static llama_sampler* context_sampler(bitnet_context* ctx, const bitnet_sampling_params& params) {
+    llama_sampler* previous = ctx->sampler;
+    llama_sampler* sampler = sampler_for(ctx->model, ctx->sampler, ctx->sampler_params, params);
+    if (sampler != previous || ctx->sampler_stale) {
+        llama_sampler_reset(sampler);
+        size_t window = params.repeat_last_n < 0 ? ctx->tokens.size() : (size_t)params.repeat_last_n;
+        size_t start = ctx->tokens.size() - std::min(window, ctx->tokens.size());
+        for (size_t i = start; i < ctx->tokens.size(); i++) {
+            llama_sampler_accept(sampler, ctx->tokens[i]);
+        }
+        ctx->sampler_stale = false;
+    }
+    return sampler;
 }
 
 bitnet_token bitnet_sample(bitnet_context* ctx, bitnet_sampling_params params) {
@@ -165,27 +487,611 @@ bitnet_token bitnet_sample(bitnet_context* ctx, bitnet_sampling_params params) {
         return -1;
     }
 
-    // Get logits
-    float* logits = llama_get_logits(ctx->ctx);
-    int n_vocab = llama_n_vocab(ctx->model);
+    // Samples and accepts the token into the chain's state
+    AGENT_TRACE_BEGIN(bitnet_sample);
+    bitnet_token token = llama_sampler_sample(context_sampler(ctx, params), ctx->ctx, -1);
+    AGENT_TRACE_END(bitnet_sample);
+    return token;
+}
+
+// Multi-sequence decoding
+
+static bool eval_batch(bitnet_context* ctx, const bitnet_sequence_input* inputs, int32_t n_inputs) {
+    if (!ctx || !ctx->ctx || !inputs || n_inputs <= 0 || n_inputs > ctx->n_batch) {
+        return false;
+    }
+    for (int32_t k = 0; k < n_inputs; k++) {
+        const bitnet_sequence_input& in = inputs[k];
+        if (in.seq_id < 0 || (size_t)in.seq_id >= ctx->sequences.size() || !in.tokens || in.n_tokens <= 0) {
+            return false;
+        }
+    }
+
+    for (int32_t k = 0; k < n_inputs; k++) {
+        const bitnet_sequence_input& in = inputs[k];
+        auto& seq = ctx->sequences[in.seq_id];
+        seq.logits_index = -1;
+        if (in.n_past == 0 && seq.sampler) {
+            llama_sampler_reset(seq.sampler);
+        }
+
+        // Anything cached past n_past is overwritten
+        llama_kv_cache_seq_rm(ctx->ctx, in.seq_id, in.n_past, -1);
+        if (in.seq_id == 0 && (size_t)in.n_past < ctx->tokens.size()) {
+            ctx->tokens.resize(in.n_past);
+        }
+    }
+
+    // Earlier tokens are prefilled in full n_batch chunks; every sequence's
+    // last token goes in the final decode, where the logits are read
+    batch_clear(ctx->batch);
+    for (int32_t k = 0; k < n_inputs; k++) {
+        const bitnet_sequence_input& in = inputs[k];
+        for (int32_t i = 0; i < in.n_tokens - 1; i++) {
+            if (ctx->batch.n_tokens == ctx->n_batch) {
+                if (llama_decode(ctx->ctx, ctx->batch) != 0) {
+                    return false;
+                }
+                batch_clear(ctx->batch);
+            }
+            batch_add(ctx->batch, in.tokens[i], in.n_past + i, in.seq_id, false);
+        }
+    }
+    if (ctx->batch.n_tokens + n_inputs > ctx->n_batch) {
+        if (llama_decode(ctx->ctx, ctx->batch) != 0) {
+            return false;
+        }
+        batch_clear(ctx->batch);
+    }
 
-    // Create sampler chain
-    llama_sampler* sampler = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    for (int32_t j = 0; j < n_inputs; j++) {
+        const bitnet_sequence_input& in = inputs[j];
+        ctx->sequences[in.seq_id].logits_index = ctx->batch.n_tokens;
+        batch_add(ctx->batch, in.tokens[in.n_tokens - 1], in.n_past + in.n_tokens - 1, in.seq_id, true);
+    }
+    if (llama_decode(ctx->ctx, ctx->batch) != 0) {
+        return false;
+    }
 
-    // Add samplers
-    llama_sampler_chain_add(sampler, llama_sampler_init_temp(params.temperature));
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_k(params.top_k));
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_p(params.top_p, 1));
-    llama_sampler_chain_add(sampler, llama_sampler_init_dist(0));
+    for (int32_t j = 0; j < n_inputs; j++) {
+        const bitnet_sequence_input& in = inputs[j];
+        if (in.seq_id == 0) {
+            ctx->tokens.insert(ctx->tokens.end(), in.tokens, in.tokens + in.n_tokens);
+        }
+    }
+    return true;
+}
 
-    // Sample
-    llama_token token = llama_sampler_sample(sampler, ctx->ctx, -1);
+bool bitnet_eval_batch(bitnet_context* ctx, const bitnet_sequence_input* inputs, int32_t n_inputs) {
+    AGENT_TRACE_BEGIN(bitnet_eval_batch);
+    bool ok = eval_batch(ctx, inputs, n_inputs);
+    AGENT_TRACE_END(bitnet_eval_batch);
+    return ok;
+}
 
-    llama_sampler_free(sampler);
+bitnet_token bitnet_sample_seq(bitnet_context* ctx, int32_t seq_id, bitnet_sampling_params params) {
+    if (!ctx || !ctx->ctx || seq_id < 0 || (size_t)seq_id >= ctx->sequences.size()) {
+        return -1;
+    }
+    auto& seq = ctx->sequences[seq_id];
+    if (seq.logits_index < 0) {
+        return -1;
+    }
 
+    AGENT_TRACE_BEGIN(bitnet_sample);
+    llama_sampler* sampler = sampler_for(ctx->model, seq.sampler, seq.sampler_params, params);
+    bitnet_token token = llama_sampler_sample(sampler, ctx->ctx, seq.logits_index);
+    AGENT_TRACE_END(bitnet_sample);
     return token;
 }
 
+void bitnet_seq_clear(bitnet_context* ctx, int32_t seq_id) {
+    if (!ctx || !ctx->ctx || seq_id < 0 || (size_t)seq_id >= ctx->sequences.size()) {
+        return;
+    }
+    llama_kv_cache_seq_rm(ctx->ctx, seq_id, -1, -1);
+    auto& seq = ctx->sequences[seq_id];
+    seq.logits_index = -1;
+    if (seq.sampler) {
+        llama_sampler_reset(seq.sampler);
+    }
+    if (seq_id == 0) {
+        ctx->tokens.clear();
+        ctx->sampler_stale = true;
+    }
+}
+
+// Bytes of complete text gathered before the callback is invoked
+static const size_t GENERATE_FLUSH_BYTES = 16;
+
+// Length of the longest prefix of text that ends on a UTF-8 character boundary
+static size_t utf8_complete_prefix(const std::string& text) {
+    size_t n = text.size();
+    size_t back = 0;
+    while (back < 4 && back < n && ((unsigned char)text[n - 1 - back] & 0xC0) == 0x80) {
+        back++;
+    }
+    if (back == n) {
+        return n;
+    }
+    unsigned char lead = (unsigned char)text[n - 1 - back];
+    size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    return back + 1 >= need ? n : n - 1 - back;
+}
+
+// Gathers pieces and hands whole UTF-8 characters to the callback
+struct text_stream {
+    bitnet_text_callback callback;
+    void* user_data;
+    std::string pending;
+    bool stopped = false;
+
+    text_stream(bitnet_text_callback callback, void* user_data)
+        : callback(callback), user_data(user_data) {}
+
+    void push(const char* piece, size_t length) {
+        pending.append(piece, length);
+
+        // Hand over whole characters once enough text has gathered
+        size_t ready = utf8_complete_prefix(pending);
+        if (callback && ready >= GENERATE_FLUSH_BYTES) {
+            stopped = !callback(pending.data(), ready, user_data);
+            pending.erase(0, ready);
+        }
+    }
+
+    void finish() {
+        if (callback && !stopped && !pending.empty()) {
+            callback(pending.data(), pending.size(), user_data);
+        }
+        pending.clear();
+    }
+};
+
+static bool is_stop_token(const bitnet_context* ctx, llama_token token,
+                          const bitnet_token* stop_tokens, int32_t n_stop) {
+    return token < 0 || token == llama_token_eos(ctx->model) ||
+           (stop_tokens && std::find(stop_tokens, stop_tokens + n_stop, token) != stop_tokens + n_stop);
+}
+
+int32_t bitnet_generate(bitnet_context* ctx, const bitnet_token* prompt_tokens, int32_t n_prompt,
+                        bitnet_sampling_params params, int32_t max_tokens,
+                        const bitnet_token* stop_tokens, int32_t n_stop,
+                        bitnet_text_callback callback, void* user_data) {
+    if (!bitnet_eval_prompt(ctx, prompt_tokens, n_prompt)) {
+        return -1;
+    }
+
+    text_stream out(callback, user_data);
+    int32_t n_past = n_prompt;
+    int32_t generated = 0;
+
+    while (generated < max_tokens && !out.stopped) {
+        llama_token token = bitnet_sample(ctx, params);
+        if (is_stop_token(ctx, token, stop_tokens, n_stop)) {
+            break;
+        }
+
+        size_t piece_length;
+        const char* piece = piece_for(ctx->owner, token, &piece_length);
+        out.push(piece, piece_length);
+
+        generated++;
+        if (!out.stopped && !bitnet_eval(ctx, &token, 1, n_past)) {
+            break;
+        }
+        n_past++;
+    }
+
+    out.finish();
+    return generated;
+}
+
+// Speculative decoding
+
+struct bitnet_speculative_context {
+    bitnet_context* target;
+    bitnet_context* draft;
+    int32_t n_draft;
+    llama_sampler* draft_sampler;      // Greedy: drafts are the draft model's best guesses
+    std::vector<llama_token> drafts;
+    std::vector<llama_token> verify;   // Last accepted token followed by the drafts
+    std::vector<llama_token> catch_up; // Accepted tokens the draft has not decoded, then last
+};
+
+bitnet_speculative_context* bitnet_speculative_new(bitnet_context* target, bitnet_context* draft,
+                                                   int32_t n_draft) {
+    if (!target || !draft || n_draft <= 0) {
+        return nullptr;
+    }
+    // Drafts are compared token for token, so the vocabularies must agree
+    if (llama_n_vocab(target->model) != llama_n_vocab(draft->model) ||
+        llama_token_eos(target->model) != llama_token_eos(draft->model)) {
+        return nullptr;
+    }
+
+    bitnet_speculative_context* spec = new bitnet_speculative_context;
+    spec->target = target;
+    spec->draft = draft;
+    spec->n_draft = std::min(n_draft, target->n_batch - 1);
+    spec->draft_sampler = llama_sampler_init_greedy();
+    return spec;
+}
+
+void bitnet_speculative_free(bitnet_speculative_context* spec) {
+    if (spec) {
+        llama_sampler_free(spec->draft_sampler);
+        delete spec;
+    }
+}
+
+int32_t bitnet_speculative_generate(bitnet_speculative_context* spec,
+                                    const bitnet_token* prompt_tokens, int32_t n_prompt,
+                                    bitnet_sampling_params params, int32_t max_tokens,
+                                    const bitnet_token* stop_tokens, int32_t n_stop,
+                                    bitnet_text_callback callback, void* user_data) {
+    if (!spec || !bitnet_eval_prompt(spec->target, prompt_tokens, n_prompt)) {
+        return -1;
+    }
+    bitnet_context* target = spec->target;
+    bitnet_context* draft = spec->draft;
+
+    // The draft holds the whole prompt; draft_valid counts the positions
+    // of its cache known to match the target's
+    if (!bitnet_eval_prompt(draft, prompt_tokens, n_prompt)) {
+        return -1;
+    }
+    int32_t draft_valid = n_prompt;
+
+    text_stream out(callback, user_data);
+    llama_sampler* sampler = context_sampler(target, params);
+    llama_token last = llama_sampler_sample(sampler, target->ctx, -1);
+    int32_t n_past = n_prompt;         // Position of last
+    int32_t generated = 0;
+
+    while (!out.stopped && !is_stop_token(target, last, stop_tokens, n_stop)) {
+        size_t piece_length;
+        const char* piece = piece_for(target->owner, last, &piece_length);
+        out.push(piece, piece_length);
+        if (++generated >= max_tokens || out.stopped) {
+            break;
+        }
+
+        // Bring the draft up to last: drafts it decoded that the target
+        // accepted stay, and whatever it lacks before last is fed with it
+        // (the last draft of a fully accepted round was never decoded)
+        while (draft_valid < n_past && (size_t)draft_valid < draft->tokens.size() &&
+               draft->tokens[(size_t)draft_valid] == target->tokens[(size_t)draft_valid]) {
+            draft_valid++;
+        }
+        spec->catch_up.assign(target->tokens.begin() + draft_valid, target->tokens.begin() + n_past);
+        spec->catch_up.push_back(last);
+        if (!bitnet_eval(draft, spec->catch_up.data(), (int32_t)spec->catch_up.size(), draft_valid)) {
+            break;
+        }
+        draft_valid = n_past + 1;
+
+        // Draft up to n_draft tokens after last
+        int32_t budget = std::min(spec->n_draft, max_tokens - generated);
+        spec->drafts.clear();
+        for (int32_t i = 0; i < budget; i++) {
+            llama_token guess = llama_sampler_sample(spec->draft_sampler, draft->ctx, -1);
+            spec->drafts.push_back(guess);
+            if (i + 1 < budget && !bitnet_eval(draft, &guess, 1, n_past + 1 + i)) {
+                break;
+            }
+        }
+
+        // The target scores last and every draft in one decode
+        spec->verify.assign(1, last);
+        spec->verify.insert(spec->verify.end(), spec->drafts.begin(), spec->drafts.end());
+        if (!eval_tokens(target, spec->verify.data(), (int32_t)spec->verify.size(), n_past, true)) {
+            break;
+        }
+
+        // Keep drafts while the target's sampler picks the same token; its
+        // first disagreement (or the token after every draft) comes next
+        size_t accepted = 0;
+        for (;;) {
+            llama_token token = llama_sampler_sample(sampler, target->ctx, (int32_t)accepted);
+            if (accepted < spec->drafts.size() && token == spec->drafts[accepted] &&
+                !is_stop_token(target, token, stop_tokens, n_stop)) {
+                piece = piece_for(target->owner, token, &piece_length);
+                out.push(piece, piece_length);
+                accepted++;
+                generated++;
+                if (out.stopped || generated >= max_tokens) {
+                    break;
+                }
+                continue;
+            }
+            last = token;
+            break;
+        }
+        if (out.stopped || generated >= max_tokens) {
+            break;
+        }
+
+        // Cache past the accepted tokens is dropped by the next evals
+        n_past += 1 + (int32_t)accepted;
+    }
+
+    out.finish();
+    return generated;
+}
+
+// State files
+
+// Header of a state file, followed by the n_tokens cached tokens and the
+// sequence state llama produced for them
+struct state_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t model_fingerprint;
+    uint64_t prompt_hash;              // fnv1a of the tokens
+    uint64_t state_size;
+    uint32_t n_tokens;
+    uint32_t reserved;
+};
+
+static const uint32_t STATE_MAGIC = 0x564b4e42;  // "BNKV"
+static const uint32_t STATE_VERSION = 1;
+
+uint64_t bitnet_state_key(bitnet_context* ctx, const bitnet_token* tokens, int32_t n_tokens) {
+    if (!ctx || !tokens || n_tokens <= 0) {
+        return 0;
+    }
+    uint64_t h = fnv1a(FNV_OFFSET, &ctx->owner->fingerprint, sizeof(uint64_t));
+    return fnv1a(h, tokens, (size_t)n_tokens * sizeof(bitnet_token));
+}
+
+bool bitnet_state_save(bitnet_context* ctx, const char* path, int32_t n_tokens) {
+    if (!ctx || !ctx->ctx || !path || n_tokens <= 0 || (size_t)n_tokens > ctx->tokens.size()) {
+        return false;
+    }
+    if ((size_t)n_tokens < ctx->tokens.size()) {
+        llama_kv_cache_seq_rm(ctx->ctx, 0, n_tokens, -1);
+        ctx->tokens.resize((size_t)n_tokens);
+    }
+
+    std::vector<uint8_t> state(llama_state_seq_get_size(ctx->ctx, 0));
+    size_t state_size = llama_state_seq_get_data(ctx->ctx, state.data(), state.size(), 0);
+    if (state_size == 0) {
+        return false;
+    }
+
+    state_header header = {};
+    header.magic = STATE_MAGIC;
+    header.version = STATE_VERSION;
+    header.model_fingerprint = ctx->owner->fingerprint;
+    header.prompt_hash = fnv1a(FNV_OFFSET, ctx->tokens.data(), ctx->tokens.size() * sizeof(llama_token));
+    header.state_size = state_size;
+    header.n_tokens = (uint32_t)n_tokens;
+
+    // Written aside and renamed, so a reader never maps a partial file
+    std::string temp_path = std::string(path) + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(ctx->tokens.data(), sizeof(llama_token), ctx->tokens.size(), file) == ctx->tokens.size() &&
+              fwrite(state.data(), 1, state_size, file) == state_size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp_path.c_str(), path) != 0) {
+        remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+int32_t bitnet_state_load(bitnet_context* ctx, const char* path) {
+    if (!ctx || !ctx->ctx || !path) {
+        return 0;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(state_header)) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return 0;
+    }
+
+    const uint8_t* data = (const uint8_t*)mapped;
+    state_header header;
+    memcpy(&header, data, sizeof(header));
+    const llama_token* tokens = (const llama_token*)(data + sizeof(header));
+    size_t tokens_size = (size_t)header.n_tokens * sizeof(llama_token);
+
+    bool valid = header.magic == STATE_MAGIC && header.version == STATE_VERSION &&
+                 header.model_fingerprint == ctx->owner->fingerprint &&
+                 header.n_tokens > 0 && header.n_tokens <= llama_n_ctx(ctx->ctx) &&
+                 header.state_size > 0 &&
+                 size == sizeof(header) + tokens_size + header.state_size &&
+                 header.prompt_hash == fnv1a(FNV_OFFSET, tokens, tokens_size);
+
+    int32_t restored = 0;
+    if (valid) {
+        bitnet_seq_clear(ctx, 0);
+        if (llama_state_seq_set_data(ctx->ctx, data + sizeof(header) + tokens_size,
+                                     (size_t)header.state_size, 0) != 0) {
+            ctx->tokens.assign(tokens, tokens + header.n_tokens);
+            restored = (int32_t)header.n_tokens;
+        } else {
+            llama_kv_cache_seq_rm(ctx->ctx, 0, -1, -1);
+        }
+        ctx->sampler_stale = true;
+    }
+
+    munmap(mapped, size);
+    return restored;
+}
+
+// Warmup
+
+// Bytes of the model file touched between progress reports
+static const size_t PREFETCH_CHUNK = (size_t)16 << 20;
+
+// Share of the progress taken by the prefetch; the decode is the rest
+static const float PREFETCH_PROGRESS = 0.9f;
+
+// Read the model file through a mapping of our own. The pages land in the
+// shared page cache, so llama's mapping of the same file then finds them
+// without I/O.
+static bool prefetch_file(const std::string& path, bitnet_progress_callback callback, void* user_data) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return true;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return true;
+    }
+    size_t size = (size_t)st.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return true;
+    }
+
+    madvise(mapped, size, MADV_WILLNEED);
+    const volatile uint8_t* bytes = (const volatile uint8_t*)mapped;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t touched = 0;
+    bool keep_going = true;
+    for (size_t offset = 0; offset < size && keep_going; offset += PREFETCH_CHUNK) {
+        size_t end = std::min(size, offset + PREFETCH_CHUNK);
+        for (size_t p = offset; p < end; p += page) {
+            touched ^= bytes[p];
+        }
+        if (callback) {
+            keep_going = callback(PREFETCH_PROGRESS * (float)end / (float)size, user_data);
+        }
+    }
+    (void)touched;
+
+    munmap(mapped, size);
+    return keep_going;
+}
+
+bool bitnet_warmup(bitnet_context* ctx, bitnet_progress_callback callback, void* user_data) {
+    if (!ctx || !ctx->ctx) {
+        return false;
+    }
+    // Without mmap llama has already read the whole file
+    if (ctx->owner->use_mmap && !prefetch_file(ctx->owner->path, callback, user_data)) {
+        return false;
+    }
+
+    // One decode sets up the compute buffers and GPU pipelines
+    llama_token bos = llama_token_bos(ctx->model);
+    bool ok = bitnet_eval(ctx, &bos, 1, 0);
+    bitnet_seq_clear(ctx, 0);
+    if (callback) {
+        callback(1.0f, user_data);
+    }
+    return ok;
+}
+
+// Thread tuning
+
+void bitnet_set_threads(bitnet_context* ctx, uint32_t n_threads, uint32_t n_threads_batch) {
+    if (ctx && ctx->ctx && n_threads > 0) {
+        llama_set_n_threads(ctx->ctx, n_threads, n_threads_batch > 0 ? n_threads_batch : n_threads);
+    }
+}
+
+void bitnet_set_prefill_chunk(bitnet_context* ctx, int32_t n_tokens) {
+    if (ctx) {
+        ctx->n_chunk = n_tokens > 0 && n_tokens < ctx->n_batch ? n_tokens : ctx->n_batch;
+    }
+}
+
+// Calibration workload: a prefill of this many tokens, then single-token decodes
+static const int32_t CALIBRATE_PREFILL_TOKENS = 64;
+static const int32_t CALIBRATE_DECODE_TOKENS = 8;
+
+// Seconds spent prefilling and decoding the calibration workload
+static bool time_workload(bitnet_context* ctx, const std::vector<llama_token>& tokens,
+                          double* prefill_seconds, double* decode_seconds) {
+    using clock = std::chrono::steady_clock;
+    int32_t n_prefill = (int32_t)tokens.size() - CALIBRATE_DECODE_TOKENS;
+    bitnet_seq_clear(ctx, 0);
+
+    clock::time_point start = clock::now();
+    if (!bitnet_eval(ctx, tokens.data(), n_prefill, 0)) {
+        return false;
+    }
+    clock::time_point prefilled = clock::now();
+    for (int32_t i = n_prefill; i < (int32_t)tokens.size(); i++) {
+        if (!bitnet_eval(ctx, &tokens[(size_t)i], 1, i)) {
+            return false;
+        }
+    }
+    clock::time_point decoded = clock::now();
+
+    *prefill_seconds = std::chrono::duration<double>(prefilled - start).count();
+    *decode_seconds = std::chrono::duration<double>(decoded - prefilled).count();
+    return true;
+}
+
+bool bitnet_calibrate_threads(bitnet_context* ctx, uint32_t max_threads,
+                              uint32_t* out_threads, uint32_t* out_threads_batch) {
+    if (!ctx || !ctx->ctx || max_threads == 0 || !out_threads || !out_threads_batch) {
+        return false;
+    }
+
+    int32_t n_prefill = std::min(CALIBRATE_PREFILL_TOKENS, ctx->n_batch);
+    int32_t n_total = n_prefill + CALIBRATE_DECODE_TOKENS;
+    if ((uint32_t)n_total > llama_n_ctx(ctx->ctx)) {
+        return false;
+    }
+    // Any tokens will do; spread them over the vocabulary
+    int32_t n_vocab = llama_n_vocab(ctx->model);
+    std::vector<llama_token> tokens((size_t)n_total);
+    for (int32_t i = 0; i < n_total; i++) {
+        tokens[(size_t)i] = (llama_token)(((int64_t)i * 7919) % n_vocab);
+    }
+
+    // The first run pays for kernel and buffer setup
+    double prefill, decode;
+    bitnet_set_threads(ctx, max_threads, max_threads);
+    bool ok = time_workload(ctx, tokens, &prefill, &decode);
+
+    uint32_t best_threads = max_threads, best_batch = max_threads;
+    double best_decode = 0, best_prefill = 0;
+    for (uint32_t n = 1; ok && n <= max_threads; n++) {
+        bitnet_set_threads(ctx, n, n);
+        ok = time_workload(ctx, tokens, &prefill, &decode);
+        if (ok && (n == 1 || decode < best_decode)) {
+            best_decode = decode;
+            best_threads = n;
+        }
+        if (ok && (n == 1 || prefill < best_prefill)) {
+            best_prefill = prefill;
+            best_batch = n;
+        }
+    }
+
+    bitnet_seq_clear(ctx, 0);
+    bitnet_set_threads(ctx, best_threads, best_batch);
+    if (ok) {
+        *out_threads = best_threads;
+        *out_threads_batch = best_batch;
+    }
+    return ok;
+}
+
 // Special tokens
 bitnet_token bitnet_token_bos(bitnet_model* model) {
     if (!model || !model->model) {
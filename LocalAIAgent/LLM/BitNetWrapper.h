@@ -19,6 +19,7 @@ extern "C" {
 // Opaque types
 typedef struct bitnet_model bitnet_model;
 typedef struct bitnet_context bitnet_context;
+typedef struct bitnet_speculative_context bitnet_speculative_context;
 typedef int32_t bitnet_token;
 
 // Model parameters
@@ -32,8 +33,10 @@ typedef struct {
 typedef struct {
     uint32_t n_ctx;
     uint32_t n_batch;
-    uint32_t n_threads;
+    uint32_t n_threads;        // Decode threads (default: performance cores)
+    uint32_t n_threads_batch;  // Prefill threads (0: same as n_threads)
     bool flash_attn;
+    uint32_t n_seq_max;      // Sequences bitnet_eval_batch may use (default 1)
 } bitnet_context_params;
 
 // Sampling parameters
@@ -41,8 +44,8 @@ typedef struct {
     float temperature;
     float top_p;
     int32_t top_k;
-    float repeat_penalty;
-    int32_t repeat_last_n;
+    float repeat_penalty;    // 1.0 disables the penalty
+    int32_t repeat_last_n;   // Recent tokens penalized (-1: the whole cache)
 } bitnet_sampling_params;
 
 // Initialize default parameters
@@ -60,12 +63,121 @@ void bitnet_free_context(bitnet_context* ctx);
 
 // Tokenization
 int32_t bitnet_tokenize(bitnet_model* model, const char* text, bitnet_token* tokens, int32_t n_max_tokens, bool add_bos);
+
+// Tokenize text_len bytes. Returns the token count, or -(count needed)
+// when n_max_tokens is too small (INT32_MIN on invalid arguments).
+int32_t bitnet_tokenize_n(bitnet_model* model, const char* text, size_t text_len,
+                          bitnet_token* tokens, int32_t n_max_tokens, bool add_bos);
+
+// Tokens text_len bytes take, without a token buffer; -1 on invalid arguments
+int32_t bitnet_count_tokens(bitnet_model* model, const char* text, size_t text_len, bool add_bos);
+
+// bitnet_tokenize_n for text that recurs, such as the system prompt:
+// the tokens of the last few segments are kept on the model. Tokenizing a
+// prompt segment by segment only matches tokenizing it whole when each
+// segment ends at a token boundary (a newline or a special token).
+int32_t bitnet_tokenize_segment(bitnet_model* model, const char* text, size_t text_len,
+                                bitnet_token* tokens, int32_t n_max_tokens, bool add_bos);
+// Pieces come from a table built at load time: the pointer stays valid
+// until the model is freed, and is NUL-terminated
 const char* bitnet_token_to_piece(bitnet_model* model, bitnet_token token);
+const char* bitnet_token_piece(const bitnet_model* model, bitnet_token token, size_t* out_length);
 
 // Generation
 bool bitnet_eval(bitnet_context* ctx, const bitnet_token* tokens, int32_t n_tokens, int32_t n_past);
+// Evaluate a whole prompt, reusing the KV cache for the prefix it shares
+// with what is already cached; generation continues at n_past = n_tokens
+bool bitnet_eval_prompt(bitnet_context* ctx, const bitnet_token* tokens, int32_t n_tokens);
 bitnet_token bitnet_sample(bitnet_context* ctx, bitnet_sampling_params params);
 
+// One sequence's tokens for bitnet_eval_batch
+typedef struct {
+    int32_t seq_id;                  // 0 ..< n_seq_max; sequence 0 is the one bitnet_eval uses
+    const bitnet_token* tokens;
+    int32_t n_tokens;
+    int32_t n_past;                  // Position of tokens[0]; cache past it is dropped
+} bitnet_sequence_input;
+
+// Decode several independent sequences together (at most n_batch of them).
+// Afterwards bitnet_sample_seq samples each one from its last token.
+bool bitnet_eval_batch(bitnet_context* ctx, const bitnet_sequence_input* inputs, int32_t n_inputs);
+bitnet_token bitnet_sample_seq(bitnet_context* ctx, int32_t seq_id, bitnet_sampling_params params);
+
+// Drop a sequence's cache and sampler state
+void bitnet_seq_clear(bitnet_context* ctx, int32_t seq_id);
+
+// Streaming callback for bitnet_generate: text is whole UTF-8 characters
+// (not NUL-terminated). Return false to stop generating.
+typedef bool (*bitnet_text_callback)(const char* text, size_t length, void* user_data);
+
+// Evaluate the prompt (reusing the cached prefix), then sample and decode
+// up to max_tokens tokens, stopping at EOS or any of stop_tokens. Returns
+// the number of tokens generated, or -1 if the prompt fails to evaluate.
+int32_t bitnet_generate(bitnet_context* ctx, const bitnet_token* prompt_tokens, int32_t n_prompt,
+                        bitnet_sampling_params params, int32_t max_tokens,
+                        const bitnet_token* stop_tokens, int32_t n_stop,
+                        bitnet_text_callback callback, void* user_data);
+
+// Speculative decoding: the draft model guesses up to n_draft tokens
+// ahead, greedily, and the target checks them all in one decode. Both
+// contexts must come from models sharing a vocabulary; NULL otherwise.
+// n_draft is capped at the target's batch size minus one.
+bitnet_speculative_context* bitnet_speculative_new(bitnet_context* target, bitnet_context* draft,
+                                                   int32_t n_draft);
+void bitnet_speculative_free(bitnet_speculative_context* spec);
+
+// Same contract as bitnet_generate on the target context. Drafts are kept
+// while the target's sampler picks the same token, so the output follows
+// the target's sampling.
+int32_t bitnet_speculative_generate(bitnet_speculative_context* spec,
+                                    const bitnet_token* prompt_tokens, int32_t n_prompt,
+                                    bitnet_sampling_params params, int32_t max_tokens,
+                                    const bitnet_token* stop_tokens, int32_t n_stop,
+                                    bitnet_text_callback callback, void* user_data);
+
+// Warm start: save the KV cache of sequence 0 (such as a prefilled system
+// prompt) and map it back in on a later launch. bitnet_state_key hashes the
+// model with a prompt's tokens, for naming state files.
+uint64_t bitnet_state_key(bitnet_context* ctx, const bitnet_token* tokens, int32_t n_tokens);
+
+// Save the first n_tokens cached tokens; the cache past them is dropped.
+// The file is replaced atomically.
+bool bitnet_state_save(bitnet_context* ctx, const char* path, int32_t n_tokens);
+
+// Restore a saved cache into sequence 0 and return its token count, or 0
+// when the file is missing, corrupt or from another model. bitnet_eval_prompt
+// then reuses the restored tokens as a cached prefix.
+int32_t bitnet_state_load(bitnet_context* ctx, const char* path);
+
+// Warmup
+
+// Progress from 0 to 1. Return false to stop.
+typedef bool (*bitnet_progress_callback)(float progress, void* user_data);
+
+// Read the model's weights into the page cache (when mapped) and run one
+// dummy decode, so the first real query does not pay for page faults and
+// setup. Clears sequence 0's cache, so call it before restoring state or
+// evaluating a prompt. Returns false if stopped or the decode fails.
+bool bitnet_warmup(bitnet_context* ctx, bitnet_progress_callback callback, void* user_data);
+
+// Thread tuning
+
+// Performance cores on Apple chips, otherwise online cores
+int32_t bitnet_performance_cores(void);
+
+// Change decode and prefill thread counts (0 n_threads_batch: the same)
+void bitnet_set_threads(bitnet_context* ctx, uint32_t n_threads, uint32_t n_threads_batch);
+
+// Tokens per decode when prefilling (0 or more than n_batch: n_batch).
+// Smaller chunks spread a long prefill out so a hot device throttles less.
+void bitnet_set_prefill_chunk(bitnet_context* ctx, int32_t n_tokens);
+
+// Time a short prefill and decode at 1..max_threads threads and apply the
+// fastest decode and prefill counts. Clears sequence 0's cache; takes a
+// few seconds, so callers should persist the result per device.
+bool bitnet_calibrate_threads(bitnet_context* ctx, uint32_t max_threads,
+                              uint32_t* out_threads, uint32_t* out_threads_batch);
+
 // Special tokens
 bitnet_token bitnet_token_bos(bitnet_model* model);
 bitnet_token bitnet_token_eos(bitnet_model* model);
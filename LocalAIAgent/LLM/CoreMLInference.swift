@@ -12,8 +12,16 @@ final class CoreMLInference: ObservableObject {
     private var tokenizer: Tokenizer?
     private var config: ModelConfig
     private var isGGUFModel = false
+    /// The CoreML model carries its KV cache in MLState (iOS 18 stateful models)
+    private var isStateful = false
     private var llamaInference: LlamaInference?
 
+    /// Exact token counts from the loaded GGUF vocab; nil for other models
+    private(set) var tokenCounter: TokenCounter?
+
+    /// Sampling buffers, reused across tokens
+    private let sampler = LogitSampler()
+
     struct ModelConfig {
         let name: String
         let maxContextLength: Int
@@ -59,13 +67,21 @@ final class CoreMLInference: ObservableObject {
     func unload() {
         llamaInference?.unload()
         llamaInference = nil
+        tokenCounter = nil
         model = nil
         tokenizer = nil
         isLoaded = false
         isGGUFModel = false
+        isStateful = false
         ggufModelPath = nil
     }
 
+    /// Shrinks the GGUF engine's KV cache; false when it cannot shrink further
+    func reduceMemoryUsage() async -> Bool {
+        guard let llamaInference = llamaInference else { return false }
+        return await llamaInference.reduceMemoryUsage()
+    }
+
     /// Set the inference acceleration mode
     func setInferenceMode(_ mode: InferenceMode) {
         llamaInference?.inferenceMode = mode
@@ -77,10 +93,15 @@ final class CoreMLInference: ObservableObject {
         let configuration = MLModelConfiguration()
         configuration.computeUnits = .cpuAndNeuralEngine
 
-        model = try await MLModel.load(contentsOf: compiledURL, configuration: configuration)
+        let loaded = try await MLModel.load(contentsOf: compiledURL, configuration: configuration)
+        model = loaded
 
         tokenizer = try await Tokenizer.load(for: config.name)
 
+        isStateful = false
+        if #available(iOS 18.0, macCatalyst 18.0, *) {
+            isStateful = !loaded.modelDescription.stateDescriptionsByName.isEmpty
+        }
         isGGUFModel = false
         isLoaded = true
     }
@@ -118,6 +139,10 @@ final class CoreMLInference: ObservableObject {
         // Initialize and load the llama.cpp model
         llamaInference = LlamaInference(config: llamaConfig)
         try await llamaInference?.loadModel(from: url)
+        let inference = llamaInference
+        tokenCounter = TokenCounter { [weak inference] text in
+            inference?.countTokens(text)
+        }
 
         isGGUFModel = true
         isLoaded = true
@@ -177,6 +202,19 @@ final class CoreMLInference: ObservableObject {
             inputIds = Array(inputIds.suffix(config.maxContextLength - maxTokens))
         }
 
+        if #available(iOS 18.0, macCatalyst 18.0, *), isStateful {
+            return try await generateStateful(
+                promptIds: inputIds,
+                maxTokens: maxTokens,
+                temperature: temperature,
+                topP: topP,
+                stopSequences: stopSequences,
+                tokenizer: tokenizer,
+                onToken: onToken
+            )
+        }
+
+        // Stateless models see the whole sequence again every step
         var generatedTokens: [Int] = []
         var generatedText = ""
 
@@ -234,83 +272,182 @@ final class CoreMLInference: ObservableObject {
         return nextTokenId
     }
 
-    /// Optimized sampling using Accelerate framework for vectorized math operations.
-    /// Avoids per-element loops for temperature scaling, softmax, and sorting.
-    private func sampleFromLogits(_ logits: MLMultiArray, temperature: Float, topP: Float) -> Int {
-        guard let vocabSizeNumber = logits.shape.last else {
-            logError("CoreMLInference", "Invalid logits shape - no last dimension")
-            return 0
+    // MARK: - Stateful CoreML Inference
+
+    /// Prefill the prompt in one call, then decode one token per call against
+    /// the KV cache the model keeps in MLState: per-token work no longer
+    /// grows with the sequence
+    @available(iOS 18.0, macCatalyst 18.0, *)
+    private func generateStateful(
+        promptIds: [Int],
+        maxTokens: Int,
+        temperature: Float,
+        topP: Float,
+        stopSequences: [String],
+        tokenizer: Tokenizer,
+        onToken: @escaping (String) -> Void
+    ) async throws -> String {
+        guard let model = model, !promptIds.isEmpty else {
+            throw LLMError.modelNotLoaded
         }
-        let vocabSize = vocabSizeNumber.intValue
-        let lastPosition = logits.shape[1].intValue - 1
+        let state = model.makeState()
+        let maskType = model.modelDescription.inputDescriptionsByName["causal_mask"]?
+            .multiArrayConstraint?.dataType
+
+        var logits = try await predictStateful(
+            model: model, state: state,
+            inputIds: try makeInputIds(promptIds),
+            causalMask: try maskType.map { try makeCausalMask(queries: promptIds.count, keys: promptIds.count, type: $0) }
+        )
 
-        // Extract logits for the last position using pointer access (much faster than NSNumber subscript)
-        var logitsArray = [Float](repeating: 0, count: vocabSize)
-        let dataPointer = logits.dataPointer.assumingMemoryBound(to: Float.self)
-        let offset = lastPosition * vocabSize
-        logitsArray.withUnsafeMutableBufferPointer { destPtr in
-            destPtr.baseAddress!.initialize(from: dataPointer.advanced(by: offset), count: vocabSize)
+        // Decode inputs keep a fixed [1, 1] shape; the array is reused every token
+        let decodeIds = try MLMultiArray(shape: [1, 1], dataType: .int32)
+        let decodeIdPointer = decodeIds.dataPointer.assumingMemoryBound(to: Int32.self)
+        var position = promptIds.count
+        var generatedText = ""
+
+        for _ in 0..<maxTokens {
+            let nextTokenId = sampleFromLogits(logits, temperature: temperature, topP: topP)
+            if nextTokenId == config.eosTokenId || position >= config.maxContextLength {
+                break
+            }
+
+            let tokenText = tokenizer.decode([nextTokenId])
+            generatedText += tokenText
+            onToken(tokenText)
+
+            if stopSequences.contains(where: { generatedText.hasSuffix($0) }) {
+                break
+            }
+
+            decodeIdPointer.pointee = Int32(nextTokenId)
+            position += 1
+            logits = try await predictStateful(
+                model: model, state: state, inputIds: decodeIds,
+                causalMask: try maskType.map { try makeCausalMask(queries: 1, keys: position, type: $0) }
+            )
         }
 
-        // Greedy sampling (argmax) - use vDSP for vectorized max finding
-        if temperature <= 0.01 {
-            var maxVal: Float = 0
-            var maxIdx: vDSP_Length = 0
-            vDSP_maxvi(logitsArray, 1, &maxVal, &maxIdx, vDSP_Length(vocabSize))
-            return Int(maxIdx)
+        return generatedText
+    }
+
+    @available(iOS 18.0, macCatalyst 18.0, *)
+    private func predictStateful(
+        model: MLModel,
+        state: MLState,
+        inputIds: MLMultiArray,
+        causalMask: MLMultiArray?
+    ) async throws -> MLMultiArray {
+        var features: [String: Any] = ["input_ids": inputIds]
+        if let causalMask = causalMask {
+            features["causal_mask"] = causalMask
         }
+        let input = try MLDictionaryFeatureProvider(dictionary: features)
 
-        // Temperature scaling using vDSP (vectorized divide)
-        var temp = temperature
-        vDSP_vsdiv(logitsArray, 1, &temp, &logitsArray, 1, vDSP_Length(vocabSize))
+        let output = try await Task.detached(priority: .userInitiated) {
+            try model.prediction(from: input, using: state)
+        }.value
 
-        // Softmax: subtract max for numerical stability, then exp, then normalize
-        var maxLogit: Float = 0
-        vDSP_maxv(logitsArray, 1, &maxLogit, vDSP_Length(vocabSize))
-        var negMax = -maxLogit
-        vDSP_vsadd(logitsArray, 1, &negMax, &logitsArray, 1, vDSP_Length(vocabSize))
-
-        // Vectorized exp
-        var count = Int32(vocabSize)
-        vvexpf(&logitsArray, logitsArray, &count)
-
-        // Normalize (sum and divide)
-        var sumProbs: Float = 0
-        vDSP_sve(logitsArray, 1, &sumProbs, vDSP_Length(vocabSize))
-        vDSP_vsdiv(logitsArray, 1, &sumProbs, &logitsArray, 1, vDSP_Length(vocabSize))
-
-        // Top-P (nucleus) sampling: sort indices by probability descending
-        // Use vDSP_vsorti for efficient sorting
-        var indices = [vDSP_Length](0..<vDSP_Length(vocabSize))
-        vDSP_vsorti(logitsArray, &indices, nil, vDSP_Length(vocabSize), -1)  // -1 = descending
-
-        // Accumulate probabilities until we reach topP
-        var cumSum: Float = 0
-        var topPCount = 0
-        for i in 0..<vocabSize {
-            cumSum += logitsArray[Int(indices[i])]
-            topPCount += 1
-            if cumSum >= topP {
-                break
+        guard let logits = output.featureValue(for: "logits")?.multiArrayValue else {
+            throw LLMError.invalidOutput
+        }
+        return logits
+    }
+
+    private func makeInputIds(_ ids: [Int]) throws -> MLMultiArray {
+        let array = try MLMultiArray(shape: [1, NSNumber(value: ids.count)], dataType: .int32)
+        let pointer = array.dataPointer.assumingMemoryBound(to: Int32.self)
+        for (index, id) in ids.enumerated() {
+            pointer[index] = Int32(id)
+        }
+        return array
+    }
+
+    /// [1, 1, queries, keys] additive mask: the last query sees every key,
+    /// earlier ones stop at their own position
+    private func makeCausalMask(queries: Int, keys: Int, type: MLMultiArrayDataType) throws -> MLMultiArray {
+        let mask = try MLMultiArray(shape: [1, 1, NSNumber(value: queries), NSNumber(value: keys)], dataType: type)
+        let offset = keys - queries
+        switch type {
+        case .float16:
+            let pointer = mask.dataPointer.assumingMemoryBound(to: UInt16.self)
+            for q in 0..<queries {
+                for k in 0..<keys {
+                    pointer[q * keys + k] = k > q + offset ? 0xFC00 : 0  // -inf / 0
+                }
+            }
+        default:
+            let pointer = mask.dataPointer.assumingMemoryBound(to: Float.self)
+            for q in 0..<queries {
+                for k in 0..<keys {
+                    pointer[q * keys + k] = k > q + offset ? -Float.infinity : 0
+                }
             }
         }
+        return mask
+    }
+
+    // MARK: - Decode Benchmark
+
+    struct DecodeBenchmark {
+        let backend: String
+        let promptTokens: Int
+        /// Prompt processing plus the first sampled token
+        let timeToFirstToken: Double
+        let decodedTokens: Int
+        let decodeSeconds: Double
+
+        var decodeTokensPerSecond: Double {
+            decodeSeconds > 0 ? Double(decodedTokens) / decodeSeconds : 0
+        }
 
-        // Renormalize the top-P subset and sample
-        var filteredSum: Float = 0
-        for i in 0..<topPCount {
-            filteredSum += logitsArray[Int(indices[i])]
+        var text: String {
+            String(format: "%@: prompt %d tokens, first token %.0f ms, decode %.1f tokens/s (%d tokens)",
+                   backend, promptTokens, timeToFirstToken * 1000, decodeTokensPerSecond, decodedTokens)
         }
+    }
 
-        let random = Float.random(in: 0..<filteredSum)
-        var cumulative: Float = 0
-        for i in 0..<topPCount {
-            cumulative += logitsArray[Int(indices[i])]
-            if cumulative >= random {
-                return Int(indices[i])
+    /// Times the loaded path (GGUF, stateful or stateless CoreML) greedily
+    /// on one prompt. Run it once with each model loaded to compare them.
+    func benchmarkDecode(prompt: String, tokens: Int = 64) async throws -> DecodeBenchmark {
+        let backend = isGGUFModel ? "GGUF (llama.cpp)" : isStateful ? "CoreML (stateful)" : "CoreML"
+        let promptTokens = tokenCounter?.tokens(in: prompt) ?? tokenizer?.encode(prompt).count ?? 0
+
+        let start = CFAbsoluteTimeGetCurrent()
+        var firstToken: CFAbsoluteTime?
+        var callbacks = 0
+        let text = try await generate(prompt: prompt, maxTokens: tokens, temperature: 0) { _ in
+            if firstToken == nil {
+                firstToken = CFAbsoluteTimeGetCurrent()
             }
+            callbacks += 1
         }
+        let end = CFAbsoluteTimeGetCurrent()
+
+        // The GGUF path delivers text once per display frame, so count its tokens from the output
+        let generated = tokenCounter?.tokens(in: text) ?? callbacks
+        let first = firstToken ?? end
+        return DecodeBenchmark(
+            backend: backend,
+            promptTokens: promptTokens,
+            timeToFirstToken: first - start,
+            decodedTokens: max(generated - 1, 0),
+            decodeSeconds: end - first
+        )
+    }
 
-        return Int(indices[0])
+    /// Samples from the last position's logits without copying them out of the MLMultiArray
+    private func sampleFromLogits(_ logits: MLMultiArray, temperature: Float, topP: Float) -> Int {
+        guard let vocabSizeNumber = logits.shape.last else {
+            logError("CoreMLInference", "Invalid logits shape - no last dimension")
+            return 0
+        }
+        let vocabSize = vocabSizeNumber.intValue
+        let lastPosition = logits.shape[1].intValue - 1
+
+        let dataPointer = logits.dataPointer.assumingMemoryBound(to: Float.self)
+        return sampler.sample(dataPointer.advanced(by: lastPosition * vocabSize), count: vocabSize,
+                              temperature: temperature, topP: topP)
     }
 
     // MARK: - GGUF Model Inference
@@ -525,6 +662,114 @@ final class CoreMLInference: ObservableObject {
     }
 }
 
+// MARK: - Logit Sampling
+
+/// Temperature and top-p sampling over a full vocabulary with Accelerate.
+/// Buffers are allocated once per vocabulary size and reused every token,
+/// and the nucleus is found by thresholding instead of sorting the vocabulary.
+final class LogitSampler {
+    private var vocabSize = 0
+    private var weights: [Float] = []
+    private var gate: [Float] = []
+    private var tokenIds: [Float] = []      // 0, 1, 2, ... (exact in Float below 2^24)
+    private var candidateWeights: [Float] = []
+    private var candidateIds: [Float] = []
+    private var order: [vDSP_Length] = []
+
+    /// Weight relative to the most likely token at which candidates are first gathered
+    private static let initialThreshold: Float = 1e-3
+
+    func sample(_ logits: UnsafePointer<Float>, count: Int, temperature: Float, topP: Float) -> Int {
+        let n = vDSP_Length(count)
+        var maxLogit: Float = 0
+        var maxIndex: vDSP_Length = 0
+        vDSP_maxvi(logits, 1, &maxLogit, &maxIndex, n)
+
+        // Greedy sampling (argmax)
+        if temperature <= 0.01 || count < 2 {
+            return Int(maxIndex)
+        }
+        prepare(count)
+
+        // (logit - max) / T in one pass, then exp: the top token weighs 1
+        var scale = 1 / temperature
+        var shift = -maxLogit / temperature
+        vDSP_vsmsa(logits, 1, &scale, &shift, &weights, 1, n)
+        var expCount = Int32(count)
+        vvexpf(&weights, weights, &expCount)
+        var total: Float = 0
+        vDSP_sve(weights, 1, &total, n)
+
+        // Gather every token above a threshold, lowering it until the
+        // gathered mass covers top-p; the nucleus is a prefix of that set
+        let target = min(max(topP, 0), 1) * total
+        var threshold = Self.initialThreshold
+        var one: Float = 1
+        var candidates = 0
+        var mass: Float = 0
+        while true {
+            // gate = 2 where weight >= threshold, else 0
+            vDSP_vlim(weights, 1, &threshold, &one, &gate, 1, n)
+            vDSP_vsadd(gate, 1, &one, &gate, 1, n)
+            var gated: Float = 0
+            vDSP_sve(gate, 1, &gated, n)
+            vDSP_dotpr(weights, 1, gate, 1, &mass, n)
+            candidates = Int(gated / 2)
+            mass /= 2
+            if mass >= target || threshold == 0 {
+                break
+            }
+            threshold = threshold < 1e-12 ? 0 : threshold / 64
+        }
+        guard candidates > 0 else {
+            return Int(maxIndex)
+        }
+
+        vDSP_vcmprs(weights, 1, gate, 1, &candidateWeights, 1, n)
+        vDSP_vcmprs(tokenIds, 1, gate, 1, &candidateIds, 1, n)
+        for i in 0..<candidates {
+            order[i] = vDSP_Length(i)
+        }
+        vDSP_vsorti(candidateWeights, &order, nil, vDSP_Length(candidates), -1)  // -1 = descending
+
+        // Smallest prefix reaching top-p, then sample within it
+        var nucleusMass: Float = 0
+        var nucleus = 0
+        while nucleus < candidates {
+            nucleusMass += candidateWeights[Int(order[nucleus])]
+            nucleus += 1
+            if nucleusMass >= target {
+                break
+            }
+        }
+
+        let random = Float.random(in: 0..<max(nucleusMass, .leastNormalMagnitude))
+        var cumulative: Float = 0
+        for i in 0..<nucleus {
+            let candidate = Int(order[i])
+            cumulative += candidateWeights[candidate]
+            if cumulative >= random {
+                return Int(candidateIds[candidate])
+            }
+        }
+        return Int(candidateIds[Int(order[0])])
+    }
+
+    private func prepare(_ count: Int) {
+        guard count != vocabSize else { return }
+        vocabSize = count
+        weights = [Float](repeating: 0, count: count)
+        gate = [Float](repeating: 0, count: count)
+        candidateWeights = [Float](repeating: 0, count: count)
+        candidateIds = [Float](repeating: 0, count: count)
+        order = [vDSP_Length](repeating: 0, count: count)
+        tokenIds = [Float](repeating: 0, count: count)
+        var start: Float = 0
+        var step: Float = 1
+        vDSP_vramp(&start, &step, &tokenIds, 1, vDSP_Length(count))
+    }
+}
+
 enum LLMError: Error, LocalizedError {
     case modelNotLoaded
     case tokenizerNotLoaded
@@ -0,0 +1,99 @@
+//
+//  InferenceScheduler.swift
+//  LocalAIAgent
+//
+//  Scales inference work to the device's thermal state and power mode
+//
+
+import Combine
+import Foundation
+
+/// How much of the device one turn of inference may use
+struct InferenceBudget: Equatable, Sendable {
+    /// Share of the tuned decode and prefill threads, in quarters
+    let threadQuarters: Int
+    /// Tokens per llama_decode call while prefilling
+    let prefillChunk: Int
+    /// Share of the model's layers kept on the GPU, in quarters
+    let gpuQuarters: Int
+
+    static let full = InferenceBudget(threadQuarters: 4, prefillChunk: 512, gpuQuarters: 4)
+
+    init(threadQuarters: Int, prefillChunk: Int, gpuQuarters: Int) {
+        self.threadQuarters = threadQuarters
+        self.prefillChunk = prefillChunk
+        self.gpuQuarters = gpuQuarters
+    }
+
+    /// Budget for a thermal state, tightened further in Low Power Mode
+    init(thermalState: ProcessInfo.ThermalState, lowPowerMode: Bool) {
+        var budget: InferenceBudget
+        switch thermalState {
+        case .nominal: budget = .full
+        case .fair: budget = InferenceBudget(threadQuarters: 4, prefillChunk: 256, gpuQuarters: 4)
+        case .serious: budget = InferenceBudget(threadQuarters: 2, prefillChunk: 128, gpuQuarters: 3)
+        case .critical: budget = InferenceBudget(threadQuarters: 1, prefillChunk: 64, gpuQuarters: 2)
+        @unknown default: budget = .full
+        }
+        // Low Power Mode caps the CPU side; the GPU is the cheaper place
+        // per token, so its share is left to the thermal state
+        if lowPowerMode {
+            budget = InferenceBudget(threadQuarters: min(budget.threadQuarters, 2),
+                                     prefillChunk: min(budget.prefillChunk, 256),
+                                     gpuQuarters: budget.gpuQuarters)
+        }
+        self = budget
+    }
+
+    /// Threads to use out of `tuned`, never fewer than two while decoding
+    func threads(_ tuned: Int32) -> Int32 {
+        guard tuned > 2 else { return max(1, tuned) }
+        return max(2, tuned * Int32(threadQuarters) / 4)
+    }
+
+    /// GPU layers out of `requested` for a model with `layerCount` layers
+    /// (nil before the first load: the request is passed through)
+    func gpuLayers(_ requested: Int32, layerCount: Int32?) -> Int32 {
+        guard gpuQuarters < 4, requested > 0, let layerCount = layerCount, layerCount > 0 else {
+            return requested
+        }
+        return min(requested, layerCount) * Int32(gpuQuarters) / 4
+    }
+}
+
+/// Publishes the inference budget as the thermal state and Low Power Mode
+/// change. Engines read it between turns; a turn in progress keeps the
+/// budget it started with.
+@MainActor
+final class InferenceScheduler: ObservableObject {
+    static let shared = InferenceScheduler()
+
+    @Published private(set) var budget: InferenceBudget
+
+    private var observers = Set<AnyCancellable>()
+
+    private init() {
+        budget = Self.currentBudget()
+
+        NotificationCenter.default.publisher(for: ProcessInfo.thermalStateDidChangeNotification)
+            .merge(with: NotificationCenter.default.publisher(for: .NSProcessInfoPowerStateDidChange))
+            .map { _ in () }
+            .receive(on: RunLoop.main)
+            .sink { [weak self] in
+                self?.update()
+            }
+            .store(in: &observers)
+    }
+
+    private func update() {
+        let next = Self.currentBudget()
+        guard next != budget else { return }
+        print("[InferenceScheduler] thermal \(ProcessInfo.processInfo.thermalState.rawValue), low power \(ProcessInfo.processInfo.isLowPowerModeEnabled): threads \(next.threadQuarters)/4, chunk \(next.prefillChunk), GPU \(next.gpuQuarters)/4")
+        budget = next
+    }
+
+    private nonisolated static func currentBudget() -> InferenceBudget {
+        let info = ProcessInfo.processInfo
+        return InferenceBudget(thermalState: info.thermalState, lowPowerMode: info.isLowPowerModeEnabled)
+    }
+}
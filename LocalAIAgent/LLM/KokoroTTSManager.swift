@@ -21,6 +21,14 @@ final class KokoroTTSManager: NSObject, ObservableObject {
     private var tts: SherpaOnnxOfflineTtsWrapper?
     private var audioPlayer: AVAudioPlayer?
 
+    // Streaming speech: sentences are synthesized in order on synthesisQueue
+    // and queued on one player node while earlier ones play
+    private var speechStream: SpeechStream?
+    private var streamEngine: AVAudioEngine?
+    private var streamPlayer: AVAudioPlayerNode?
+    private var streamFormat: AVAudioFormat?
+    private let synthesisQueue = DispatchQueue(label: "com.localaiagent.kokoro.synthesis", qos: .userInitiated)
+
     // Kokoro TTS model hosted on Hugging Face (sherpa-onnx models)
     // Using kokoro multi-language INT8 model with Japanese, English, Chinese support
     private let modelName = "kokoro-int8-multi-lang"
@@ -983,10 +991,202 @@ final class KokoroTTSManager: NSObject, ObservableObject {
         return data
     }
 
+    // MARK: - Streaming Speech
+
+    /// Start speaking a reply that is still being generated. Text goes in
+    /// through appendStreamingText; each complete sentence is synthesized
+    /// while the ones before it play. Returns false when the model is not
+    /// loaded yet, in which case the caller should speak the full text.
+    func beginStreaming(messageId: UUID? = nil, speakerId: Int? = nil, speed: Float = 1.0,
+                        completion: (() -> Void)? = nil) -> Bool {
+        if ProcessInfo.processInfo.arguments.contains("-SkipDownload") {
+            return false
+        }
+        guard tts != nil else {
+            // Load in the background so the next reply can stream
+            if isModelDownloaded {
+                Task { try? await self.downloadModelIfNeeded() }
+            }
+            return false
+        }
+
+        if isSpeaking {
+            stop()
+        }
+        speechStream = SpeechStream(speakerId: speakerId ?? Self.defaultSpeakerId, speed: speed,
+                                    completion: completion)
+        isSpeaking = true
+        currentMessageId = messageId
+        return true
+    }
+
+    /// Next piece of the streamed reply, e.g. one token
+    func appendStreamingText(_ text: String) {
+        guard let stream = speechStream, !stream.finished else { return }
+        stream.pending += visibleText(text, in: stream)
+        for sentence in takeSentences(from: &stream.pending) {
+            enqueueSentence(sentence, in: stream)
+        }
+    }
+
+    /// The reply is complete: speak what is left and finish after it plays
+    func finishStreaming() {
+        guard let stream = speechStream, !stream.finished else { return }
+        if !stream.inThinking {
+            stream.pending += stream.held
+        }
+        stream.held = ""
+        enqueueSentence(stream.pending, in: stream)
+        stream.pending = ""
+        stream.finished = true
+        finishStreamIfDone(stream)
+    }
+
+    /// Text outside <think>...</think>; a possibly partial tag is held back
+    private func visibleText(_ text: String, in stream: SpeechStream) -> String {
+        stream.held += text
+        var visible = ""
+        while true {
+            if stream.inThinking {
+                guard let close = stream.held.range(of: "</think>") else {
+                    stream.held = String(stream.held.suffix(7))
+                    return visible
+                }
+                stream.held.removeSubrange(..<close.upperBound)
+                stream.inThinking = false
+            } else if let open = stream.held.range(of: "<think>") {
+                visible += stream.held[..<open.lowerBound]
+                stream.held.removeSubrange(..<open.upperBound)
+                stream.inThinking = true
+            } else {
+                var keep = stream.held.endIndex
+                if let lt = stream.held.lastIndex(of: "<"),
+                   stream.held.distance(from: lt, to: stream.held.endIndex) < 7 {
+                    keep = lt
+                }
+                visible += stream.held[..<keep]
+                stream.held.removeSubrange(..<keep)
+                return visible
+            }
+        }
+    }
+
+    private static let sentenceEnds: Set<Character> = ["。", "！", "？", "．", "!", "?", "\n"]
+
+    /// Complete sentences at the front of text, leaving the unfinished rest
+    private func takeSentences(from text: inout String) -> [String] {
+        var sentences: [String] = []
+        var start = text.startIndex
+        var index = text.startIndex
+        while index < text.endIndex {
+            let char = text[index]
+            let next = text.index(after: index)
+            // "." ends a sentence only before whitespace, so 3.14 and URLs stay whole
+            if Self.sentenceEnds.contains(char) || (char == "." && next < text.endIndex && text[next].isWhitespace) {
+                sentences.append(String(text[start..<next]))
+                start = next
+            }
+            index = next
+        }
+        text.removeSubrange(..<start)
+        return sentences
+    }
+
+    private func enqueueSentence(_ sentence: String, in stream: SpeechStream) {
+        var cleaned = cleanTextForTTS(sentence)
+        guard let tts = tts, cleaned.contains(where: { $0.isLetter || $0.isNumber }) else { return }
+        if containsKanji(cleaned) {
+            cleaned = convertKanjiToHiragana(cleaned)
+        }
+
+        stream.inFlight += 1
+        let speakerId = stream.speakerId
+        let speed = stream.speed
+        synthesisQueue.async { [weak self] in
+            // Samples go straight into a PCM buffer, without a WAV file in between
+            let audio = tts.generate(text: cleaned, sid: speakerId, speed: speed)
+            let buffer = Self.makeBuffer(audio)
+            DispatchQueue.main.async {
+                self?.schedule(buffer, in: stream)
+            }
+        }
+    }
+
+    private nonisolated static func makeBuffer(_ audio: SherpaOnnxGeneratedAudioWrapper) -> AVAudioPCMBuffer? {
+        guard audio.audio != nil, audio.n > 0, let samples = audio.audio.pointee.samples,
+              let format = AVAudioFormat(standardFormatWithSampleRate: Double(audio.sampleRate), channels: 1),
+              let buffer = AVAudioPCMBuffer(pcmFormat: format, frameCapacity: AVAudioFrameCount(audio.n)),
+              let channel = buffer.floatChannelData?[0] else {
+            return nil
+        }
+        channel.update(from: samples, count: Int(audio.n))
+        buffer.frameLength = AVAudioFrameCount(audio.n)
+        return buffer
+    }
+
+    private func schedule(_ buffer: AVAudioPCMBuffer?, in stream: SpeechStream) {
+        guard stream === speechStream else { return }
+        guard let buffer = buffer, let player = streamPlayer(for: buffer.format) else {
+            print("[KokoroTTS] No audio generated for a streamed sentence")
+            sentenceFinished(in: stream)
+            return
+        }
+
+        player.scheduleBuffer(buffer) { [weak self] in
+            DispatchQueue.main.async {
+                self?.sentenceFinished(in: stream)
+            }
+        }
+        if !player.isPlaying {
+            player.play()
+        }
+    }
+
+    /// The player node, with the engine (re)started for format
+    private func streamPlayer(for format: AVAudioFormat) -> AVAudioPlayerNode? {
+        if let player = streamPlayer, let engine = streamEngine, engine.isRunning, streamFormat == format {
+            return player
+        }
+        streamEngine?.stop()
+
+        let engine = AVAudioEngine()
+        let player = AVAudioPlayerNode()
+        engine.attach(player)
+        engine.connect(player, to: engine.mainMixerNode, format: format)
+        do {
+            try engine.start()
+        } catch {
+            print("[KokoroTTS] Audio engine start error: \(error)")
+            return nil
+        }
+        streamEngine = engine
+        streamPlayer = player
+        streamFormat = format
+        return player
+    }
+
+    private func sentenceFinished(in stream: SpeechStream) {
+        guard stream === speechStream else { return }
+        stream.inFlight -= 1
+        finishStreamIfDone(stream)
+    }
+
+    private func finishStreamIfDone(_ stream: SpeechStream) {
+        guard stream.finished, stream.inFlight == 0, stream === speechStream else { return }
+        speechStream = nil
+        isSpeaking = false
+        currentMessageId = nil
+        print("[KokoroTTS] Streamed speech finished")
+        stream.completion?()
+    }
+
     /// Stop current speech
     func stop() {
         audioPlayer?.stop()
         audioPlayer = nil
+        // Queued sentences see that their stream is gone and are dropped
+        speechStream = nil
+        streamPlayer?.stop()
         isSpeaking = false
         currentMessageId = nil
     }
@@ -1042,6 +1242,29 @@ extension KokoroTTSManager: AVAudioPlayerDelegate {
     }
 }
 
+// MARK: - Speech Stream
+
+/// One reply being spoken while it streams in
+private final class SpeechStream {
+    let speakerId: Int
+    let speed: Float
+    let completion: (() -> Void)?
+    /// Incoming text not yet checked for thinking tags
+    var held = ""
+    var inThinking = false
+    /// Visible text after the last sentence boundary
+    var pending = ""
+    /// Sentences synthesizing or playing
+    var inFlight = 0
+    var finished = false
+
+    init(speakerId: Int, speed: Float, completion: (() -> Void)?) {
+        self.speakerId = speakerId
+        self.speed = speed
+        self.completion = completion
+    }
+}
+
 // MARK: - Errors
 
 enum KokoroTTSError: LocalizedError {
@@ -1076,6 +1299,10 @@ final class KokoroTTSManager: NSObject, ObservableObject {
     private override init() { super.init() }
     func downloadModelIfNeeded() async throws {}
     func speak(_ text: String, messageId: UUID? = nil, speakerId: Int? = nil, speed: Float = 1.0) async {}
+    func beginStreaming(messageId: UUID? = nil, speakerId: Int? = nil, speed: Float = 1.0,
+                        completion: (() -> Void)? = nil) -> Bool { false }
+    func appendStreamingText(_ text: String) {}
+    func finishStreaming() {}
     func stop() {}
     func resetModel() {}
 }
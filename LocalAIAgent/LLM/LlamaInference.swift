@@ -1,11 +1,15 @@
+import Combine
 import Foundation
 import LlamaSwift
+import os
+import QuartzCore
 
 /// Wrapper to safely pass OpaquePointer across actor boundaries
 /// OpaquePointer is thread-safe for llama.cpp operations
 private struct SendablePointer: @unchecked Sendable {
     let model: OpaquePointer
     let context: OpaquePointer
+    let cacheSettings: LlamaInference.CacheSettings
 }
 
 /// Inference acceleration mode
@@ -82,10 +86,30 @@ final class LlamaInference: ObservableObject {
     /// Current KV cache quantization settings
     private(set) var kvCacheTypeK: KVCacheQuantType = .q8_0
     private(set) var kvCacheTypeV: KVCacheQuantType = .q8_0
+    /// Context length of the current context (at most config.contextSize)
+    private(set) var contextSize: UInt32 = 0
+
+    // Settings tried in order when memory runs short, largest context first
+    private var cacheLadder: [CacheSettings] = []
+    private var reconfiguration: Task<Void, Never>?
+    // Last warmStart arguments, replayed after the context is re-created
+    private var warmStartSource: (systemPrompt: String, cacheDirectory: URL)?
 
     private var model: OpaquePointer?
-    private var context: OpaquePointer?
+    private var context: OpaquePointer? {
+        didSet { contextEpoch &+= 1 }
+    }
+    // Bumped whenever the context is replaced; work that started on an
+    // older context must not record what it left in the new one's cache
+    private var contextEpoch = 0
     private var modelPath: URL?
+    private var cacheSettings: CacheSettings?
+
+    // GPU layers the model was loaded with, and its layer count, so the
+    // split can follow InferenceScheduler's budget between turns
+    private var loadedGPULayers: Int32 = 0
+    private var layerCount: Int32?
+    private var budgetObserver: AnyCancellable?
 
     // Background queue for llama_decode to prevent blocking MainActor/UI thread
     private static let inferenceQueue = DispatchQueue(label: "love.elio.app.llama.inference", qos: .userInitiated)
@@ -93,6 +117,11 @@ final class LlamaInference: ObservableObject {
     // Reusable buffer for token-to-bytes conversion (avoids allocation per token)
     private var tokenBuffer = [CChar](repeating: 0, count: 256)
 
+    // Tokens known to be in sequence 0 of the KV cache, from a restored
+    // state or the last generation (prompt plus decoded reply); the next
+    // prompt reuses their common prefix and prefills only the rest
+    private var cachedPrefix: [llama_token] = []
+
     // Model configuration
     struct Config: Sendable {
         let name: String
@@ -174,6 +203,14 @@ final class LlamaInference: ObservableObject {
         setenv("GGML_METAL_PATH_RESOURCES", Bundle.main.bundlePath, 1)
         // Initialize llama backend
         llama_backend_init()
+
+        // A new budget may move layers between GPU and CPU; a turn in
+        // progress finishes first
+        budgetObserver = InferenceScheduler.shared.$budget
+            .dropFirst()
+            .sink { [weak self] _ in
+                Task { @MainActor in self?.rebalanceGPULayers() }
+            }
     }
 
     deinit {
@@ -192,6 +229,11 @@ final class LlamaInference: ObservableObject {
     }
 
     private func cleanup() {
+        cachedPrefix = []
+        cacheLadder = []
+        cacheSettings = nil
+        warmStartSource = nil
+        contextSize = 0
         if let ctx = context {
             llama_free(ctx)
             context = nil
@@ -241,6 +283,9 @@ final class LlamaInference: ObservableObject {
             isLoaded = false
         }
 
+        if self.modelPath != url {
+            layerCount = nil
+        }
         self.modelPath = url
         self.modelName = url.deletingPathExtension().lastPathComponent
 
@@ -248,7 +293,7 @@ final class LlamaInference: ObservableObject {
         print("[LlamaInference] Starting model load...")
 
         // Capture values needed for background thread
-        let gpuLayers = inferenceMode.gpuLayers
+        let gpuLayers = InferenceScheduler.shared.budget.gpuLayers(inferenceMode.gpuLayers, layerCount: layerCount)
         let contextSize = config.contextSize
         let modelUrl = url
         let ggmlTypeK = toGGMLType(kvCacheTypeK)
@@ -273,31 +318,16 @@ final class LlamaInference: ObservableObject {
             let loadDuration = Date().timeIntervalSince(loadStart)
             print("[LlamaInference] Model loaded in \(String(format: "%.2f", loadDuration))s")
 
-            // Context parameters - optimized for speed on iOS
-            var contextParams = llama_context_default_params()
-            contextParams.n_ctx = contextSize
-            // Larger batch sizes for faster prompt processing
-            contextParams.n_batch = min(1024, contextSize)  // Increased from 512
-            contextParams.n_ubatch = 512  // Increased micro-batch for better throughput
-            // Use all performance cores for maximum speed
-            let perfCores = max(4, ProcessInfo.processInfo.activeProcessorCount)
-            contextParams.n_threads = Int32(perfCores)
-            contextParams.n_threads_batch = Int32(perfCores)
-
-            // KV Cache quantization for faster inference (reduces memory bandwidth)
-            contextParams.type_k = ggmlTypeK
-            contextParams.type_v = ggmlTypeV
-
-            // Enable Flash Attention for Metal GPU acceleration
-            contextParams.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_ENABLED
-
-            // Offload KQV operations to GPU for maximum speed
-            contextParams.offload_kqv = true
+            // Largest context and best KV cache type that fit in memory now
+            let ladder = Self.cacheLadder(model: model, maxContext: contextSize, typeK: ggmlTypeK, typeV: ggmlTypeV)
+            let budget = Self.kvCacheBudget()
+            let settings = ladder.first { $0.kvBytes <= budget } ?? ladder.last!
+            print("[LlamaInference] KV cache: n_ctx \(settings.contextSize), budget \(budget / 1_000_000) MB, needs \(settings.kvBytes / 1_000_000) MB")
 
             // Create context (secondary blocking operation)
             print("[LlamaInference] Creating context...")
             let ctxStart = Date()
-            guard let context = llama_init_from_model(model, contextParams) else {
+            guard let context = Self.makeContext(model: model, settings: settings) else {
                 print("[LlamaInference] ERROR: llama_init_from_model returned nil")
                 llama_model_free(model)
                 throw LlamaError.contextCreationFailed
@@ -305,15 +335,23 @@ final class LlamaInference: ObservableObject {
             let ctxDuration = Date().timeIntervalSince(ctxStart)
             print("[LlamaInference] Context created in \(String(format: "%.2f", ctxDuration))s")
 
-            return SendablePointer(model: model, context: context)
+            return SendablePointer(model: model, context: context, cacheSettings: settings)
         }.value
 
         // Back on MainActor - update state
         self.model = pointers.model
         self.context = pointers.context
+        self.loadedGPULayers = gpuLayers
+        self.layerCount = llama_model_n_layer(pointers.model)
+        applyCacheSettings(pointers.cacheSettings)
+        self.cacheLadder = Self.cacheLadder(model: pointers.model, maxContext: contextSize,
+                                            typeK: ggmlTypeK, typeV: ggmlTypeV)
         self.loadingProgress = 1.0
         self.isLoaded = true
         print("[LlamaInference] Model load complete!")
+
+        // Loaded hot before the layer count was known: apply the split now
+        rebalanceGPULayers()
     }
 
     /// Generate with ModelSettings
@@ -345,15 +383,26 @@ final class LlamaInference: ObservableObject {
         stopSequences: [String] = [],
         onToken: @escaping @MainActor (String) -> Void
     ) async throws -> String {
+        // A context being re-created for memory pressure is waited for
+        await reconfiguration?.value
         guard isLoaded, let model = model, let context = context else {
             throw LlamaError.modelNotLoaded
         }
 
         isGenerating = true
-        defer { isGenerating = false }
+        defer {
+            isGenerating = false
+            // The budget may have changed during the turn
+            rebalanceGPULayers()
+        }
 
         let currentConfig = config
 
+        // Threads and prefill chunk follow the thermal budget from turn to turn
+        let budget = InferenceScheduler.shared.budget
+        let threads = budget.threads(Self.performanceThreads)
+        llama_set_n_threads(context, threads, threads)
+
         // Get vocab
         guard let vocab = llama_model_get_vocab(model) else {
             throw LlamaError.tokenizationFailed
@@ -367,7 +416,7 @@ final class LlamaInference: ObservableObject {
         }
 
         // Check for context overflow before processing
-        let maxContextWithBuffer = Int(config.contextSize) - maxTokens
+        let maxContextWithBuffer = Int(contextSize) - maxTokens
         if promptTokens.count > maxContextWithBuffer {
             logWarning("LLM", "Context overflow detected", [
                 "tokenCount": "\(promptTokens.count)",
@@ -381,16 +430,31 @@ final class LlamaInference: ObservableObject {
         let capturedVocab = vocab
         let capturedEosTokenId = currentConfig.eosTokenId
         let capturedTokenBuffer = tokenBuffer  // copy of reusable buffer
+        let capturedPrefix = cachedPrefix
+        let capturedEpoch = contextEpoch
+        cachedPrefix = []
+
+        // Text reaches the UI through a ring the main thread drains once per frame
+        guard let ring = token_ring_create(Self.uiRingCapacity) else {
+            throw LlamaError.generationFailed("Failed to allocate the token ring")
+        }
+        let capturedRing = RingPointer(ring: ring)
+        let drain = TokenRingDrain(ring: ring, onToken: onToken)
+        drain.start()
 
         // Run ENTIRE inference (prompt processing + token generation) on background queue.
         // This keeps the main thread completely free for UI during inference.
-        let generatedText: String = try await withCheckedThrowingContinuation { continuation in
+        let output: InferenceOutput
+        do {
+            output = try await withCheckedThrowingContinuation { continuation in
             Self.inferenceQueue.async {
                 do {
                     let result = try Self.inferenceLoop(
                         context: capturedContext,
                         vocab: capturedVocab,
                         promptTokens: promptTokens,
+                        cachedPrefix: capturedPrefix,
+                        prefillChunk: budget.prefillChunk,
                         maxTokens: maxTokens,
                         temperature: temperature,
                         topP: topP,
@@ -399,25 +463,51 @@ final class LlamaInference: ObservableObject {
                         stopSequences: stopSequences,
                         eosTokenId: capturedEosTokenId,
                         tokenBufferSize: capturedTokenBuffer.count,
-                        onToken: onToken
+                        ring: capturedRing.ring
                     )
                     continuation.resume(returning: result)
                 } catch {
                     continuation.resume(throwing: error)
                 }
             }
+            }
+        } catch {
+            drain.finish(remaining: [])
+            token_ring_free(ring)
+            throw error
         }
 
-        return generatedText
+        // The loop has stopped writing: deliver the rest before returning
+        drain.finish(remaining: output.undelivered)
+        token_ring_free(ring)
+
+        // A context re-created mid-turn (memory warning) never held these tokens
+        if contextEpoch == capturedEpoch {
+            cachedPrefix = output.cachedTokens
+        }
+        return output.text
+    }
+
+    /// What inferenceLoop produced and left in the KV cache
+    private struct InferenceOutput: Sendable {
+        let text: String
+        let cachedTokens: [llama_token]
+        /// Bytes that did not fit in the UI ring
+        let undelivered: [UInt8]
     }
 
+    /// Bytes the UI ring holds; a frame's worth of text is far smaller
+    private static let uiRingCapacity = 64 * 1024
+
     /// Runs the entire inference loop on a background queue (NOT on MainActor).
-    /// Only touches MainActor via onToken callback dispatched to main queue.
-    /// Optimized: batched UI dispatch, suffix-only stop sequence check, reduced allocations.
+    /// Never touches MainActor: piece bytes go into the ring, which
+    /// TokenRingDrain empties on the main thread. No String is built per token.
     private static func inferenceLoop(
         context: OpaquePointer,
         vocab: OpaquePointer,
         promptTokens: [llama_token],
+        cachedPrefix: [llama_token],
+        prefillChunk: Int,
         maxTokens: Int,
         temperature: Float,
         topP: Float,
@@ -426,32 +516,25 @@ final class LlamaInference: ObservableObject {
         stopSequences: [String],
         eosTokenId: llama_token,
         tokenBufferSize: Int,
-        onToken: @escaping @MainActor (String) -> Void
-    ) throws -> String {
-        // Clear memory
+        ring: UnsafeMutablePointer<token_ring>
+    ) throws -> InferenceOutput {
+        // Keep the cached common prefix; the last prompt token is always
+        // decoded again so its logits are fresh
         let memory = llama_get_memory(context)
-        llama_memory_clear(memory, true)
-
-        // Process prompt in chunks
-        let batchSize = 512
-        let totalTokens = promptTokens.count
-        var processedTokens = 0
-
-        while processedTokens < totalTokens {
-            let chunkSize = min(batchSize, totalTokens - processedTokens)
-            var chunkTokens = Array(promptTokens[processedTokens..<processedTokens + chunkSize])
-
-            let decodeResult = chunkTokens.withUnsafeMutableBufferPointer { bufferPtr in
-                let batch = llama_batch_get_one(bufferPtr.baseAddress!, Int32(chunkSize))
-                return llama_decode(context, batch)
-            }
-
-            if decodeResult != 0 {
-                throw LlamaError.generationFailed("Failed to process prompt chunk at offset \(processedTokens): \(decodeResult)")
-            }
-            processedTokens += chunkSize
+        let reusable = min(cachedPrefix.count, promptTokens.count - 1)
+        var reused = 0
+        while reused < reusable && cachedPrefix[reused] == promptTokens[reused] {
+            reused += 1
+        }
+        if reused == 0 || !llama_memory_seq_rm(memory, 0, Int32(reused), -1) {
+            llama_memory_clear(memory, true)
+            reused = 0
         }
 
+        try decodePrompt(context: context, tokens: promptTokens, from: reused, batchSize: prefillChunk)
+        var cachedTokens = promptTokens
+        cachedTokens.reserveCapacity(promptTokens.count + maxTokens)
+
         // Create sampler chain
         let samplerParams = llama_sampler_chain_default_params()
         guard let sampler = llama_sampler_chain_init(samplerParams) else {
@@ -471,25 +554,21 @@ final class LlamaInference: ObservableObject {
             llama_sampler_chain_add(sampler, llama_sampler_init_dist(UInt32.random(in: 0..<UInt32.max)))
         }
 
-        var generatedText = ""
-        generatedText.reserveCapacity(maxTokens * 4)
-        var pendingBytes: [UInt8] = []
-        pendingBytes.reserveCapacity(16)
-        var tokenBuffer = [CChar](repeating: 0, count: tokenBufferSize)
+        // Closing the ring tells the drain no more bytes follow
+        defer { token_ring_close(ring) }
 
-        // Pre-compute maximum stop sequence length for efficient suffix checking
-        let maxStopSeqLen = stopSequences.map(\.count).max() ?? 0
-        let hasStopSequences = !stopSequences.isEmpty
+        var generatedBytes: [UInt8] = []
+        generatedBytes.reserveCapacity(maxTokens * 4)
+        // Bytes waiting for room in the ring, kept in order
+        var undelivered: [UInt8] = []
+        var tokenBuffer = [CChar](repeating: 0, count: tokenBufferSize)
 
-        // Batched UI dispatch: accumulate tokens and dispatch at intervals
-        // to reduce main queue dispatch overhead (reduces context switches)
-        var pendingUIText = ""
-        var tokensSinceLastDispatch = 0
-        let dispatchInterval = 4  // Dispatch to UI every N tokens
+        // Stop sequences are matched against the raw bytes
+        let stopBytes = stopSequences.map { Array($0.utf8) }.filter { !$0.isEmpty }
 
-        for _ in 0..<maxTokens {
+        for index in 0..<maxTokens {
             // Check cancellation every 8 tokens to reduce overhead
-            if tokensSinceLastDispatch % 8 == 0 && Task.isCancelled { break }
+            if index % 8 == 0 && Task.isCancelled { break }
 
             // Sample next token
             let newToken = llama_sampler_sample(sampler, context, -1)
@@ -500,52 +579,32 @@ final class LlamaInference: ObservableObject {
             }
 
             // Convert token to bytes using pre-allocated buffer
-            let length = llama_token_to_piece(vocab, newToken, &tokenBuffer, Int32(tokenBuffer.count), 0, true)
+            let length = Int(llama_token_to_piece(vocab, newToken, &tokenBuffer, Int32(tokenBuffer.count), 0, true))
             if length > 0 {
-                // Append bytes directly without intermediate Array allocation
-                for i in 0..<Int(length) {
-                    pendingBytes.append(UInt8(bitPattern: tokenBuffer[i]))
-                }
-            }
+                tokenBuffer.withUnsafeBytes { raw in
+                    let piece = UnsafeRawBufferPointer(rebasing: raw[0..<length])
+                    generatedBytes.append(contentsOf: piece)
 
-            // Try to convert accumulated bytes to valid UTF-8
-            let (validText, remaining) = bytesToStringStatic(pendingBytes)
-            pendingBytes = remaining
-
-            if !validText.isEmpty {
-                generatedText += validText
-                pendingUIText += validText
-                tokensSinceLastDispatch += 1
-
-                // Batch UI dispatches: send accumulated text every N tokens
-                // or immediately if it contains a newline (for visual line breaks)
-                if tokensSinceLastDispatch >= dispatchInterval || validText.contains("\n") {
-                    let textToSend = pendingUIText
-                    pendingUIText = ""
-                    tokensSinceLastDispatch = 0
-                    DispatchQueue.main.async {
-                        onToken(textToSend)
+                    if !undelivered.isEmpty {
+                        let written = undelivered.withUnsafeBytes { token_ring_write(ring, $0.baseAddress, $0.count) }
+                        undelivered.removeFirst(written)
+                    }
+                    if undelivered.isEmpty {
+                        let written = token_ring_write(ring, piece.baseAddress, length)
+                        undelivered.append(contentsOf: piece[written...])
+                    } else {
+                        undelivered.append(contentsOf: piece)
                     }
                 }
             }
 
-            // Check stop sequences efficiently: only check suffix of generated text
-            // instead of scanning the entire string each time
-            if hasStopSequences {
-                let suffixStart = generatedText.index(generatedText.endIndex, offsetBy: -min(maxStopSeqLen + 4, generatedText.count))
-                let suffix = generatedText[suffixStart...]
-                for stopSeq in stopSequences {
-                    if suffix.hasSuffix(stopSeq) {
-                        // Flush any pending UI text before returning
-                        if !pendingUIText.isEmpty {
-                            let textToSend = pendingUIText
-                            DispatchQueue.main.async {
-                                onToken(textToSend)
-                            }
-                        }
-                        return generatedText
-                    }
-                }
+            // Check stop sequences against the end of the output only
+            if stopBytes.contains(where: { stop in
+                generatedBytes.count >= stop.count &&
+                    generatedBytes[(generatedBytes.count - stop.count)...].elementsEqual(stop)
+            }) {
+                return InferenceOutput(text: String(decoding: generatedBytes, as: UTF8.self),
+                                       cachedTokens: cachedTokens, undelivered: undelivered)
             }
 
             // Decode next token (same background queue, no context switch needed)
@@ -556,32 +615,381 @@ final class LlamaInference: ObservableObject {
             }
 
             if result != 0 { break }
+            cachedTokens.append(newToken)
+        }
+
+        return InferenceOutput(text: String(decoding: generatedBytes, as: UTF8.self),
+                               cachedTokens: cachedTokens, undelivered: undelivered)
+    }
+
+    /// Decodes tokens[start...] after the cache's current contents, in chunks
+    private static func decodePrompt(context: OpaquePointer, tokens: [llama_token], from start: Int,
+                                     batchSize: Int = 512) throws {
+        let totalTokens = tokens.count
+        var processedTokens = start
+
+        while processedTokens < totalTokens {
+            let chunkSize = min(batchSize, totalTokens - processedTokens)
+            var chunkTokens = Array(tokens[processedTokens..<processedTokens + chunkSize])
+
+            let decodeResult = chunkTokens.withUnsafeMutableBufferPointer { bufferPtr in
+                let batch = llama_batch_get_one(bufferPtr.baseAddress!, Int32(chunkSize))
+                return llama_decode(context, batch)
+            }
+
+            if decodeResult != 0 {
+                throw LlamaError.generationFailed("Failed to process prompt chunk at offset \(processedTokens): \(decodeResult)")
+            }
+            processedTokens += chunkSize
+        }
+    }
+
+    // MARK: - Warm Start
+
+    /// Restores the KV cache for `systemPrompt` from `cacheDirectory`, or
+    /// prefills it and saves it there for the next launch. Prompts that
+    /// start with the same tokens then skip that prefill.
+    /// Returns true when the cache was restored from disk.
+    @discardableResult
+    func warmStart(systemPrompt: String, cacheDirectory: URL) async throws -> Bool {
+        await reconfiguration?.value
+        guard isLoaded, let model = model, let context = context,
+              let vocab = llama_model_get_vocab(model) else {
+            throw LlamaError.modelNotLoaded
+        }
+
+        let tokens = tokenize(systemPrompt, vocab: vocab, addSpecial: true)
+        guard !tokens.isEmpty else {
+            throw LlamaError.tokenizationFailed
+        }
+
+        let stateURL = cacheDirectory.appendingPathComponent(stateFileName(for: tokens, vocab: vocab))
+        let capturedContext = context
+        let capturedEpoch = contextEpoch
+        cachedPrefix = []
+
+        let restored: Bool = try await withCheckedThrowingContinuation { continuation in
+            Self.inferenceQueue.async {
+                do {
+                    let restored = try Self.restoreOrPrefill(context: capturedContext, tokens: tokens, stateURL: stateURL)
+                    continuation.resume(returning: restored)
+                } catch {
+                    continuation.resume(throwing: error)
+                }
+            }
+        }
+
+        if contextEpoch == capturedEpoch {
+            cachedPrefix = tokens
+        }
+        warmStartSource = (systemPrompt, cacheDirectory)
+        return restored
+    }
+
+    /// State file name, keyed by the model (file, vocabulary, KV cache types) and prompt tokens
+    private func stateFileName(for tokens: [llama_token], vocab: OpaquePointer) -> String {
+        var key = "\(modelName)|\(llama_vocab_n_tokens(vocab))|\(kvCacheTypeK.rawValue)|\(kvCacheTypeV.rawValue)"
+        if let path = modelPath?.path,
+           let size = (try? FileManager.default.attributesOfItem(atPath: path))?[.size] as? Int64 {
+            key += "|\(size)"
+        }
+
+        // FNV-1a: stable across launches, unlike Hasher
+        var hash: UInt64 = 0xcbf29ce484222325
+        for byte in key.utf8 {
+            hash = (hash ^ UInt64(byte)) &* 0x100000001b3
         }
+        for token in tokens {
+            withUnsafeBytes(of: token.littleEndian) { bytes in
+                for byte in bytes {
+                    hash = (hash ^ UInt64(byte)) &* 0x100000001b3
+                }
+            }
+        }
+        return String(format: "llama-%016llx.kvstate", hash)
+    }
+
+    private static func restoreOrPrefill(context: OpaquePointer, tokens: [llama_token], stateURL: URL) throws -> Bool {
+        let memory = llama_get_memory(context)
+        llama_memory_clear(memory, true)
 
-        // Flush any remaining pending UI text
-        if !pendingUIText.isEmpty {
-            let textToSend = pendingUIText
-            DispatchQueue.main.async {
-                onToken(textToSend)
+        if FileManager.default.fileExists(atPath: stateURL.path) {
+            var restoredTokens = [llama_token](repeating: 0, count: tokens.count)
+            var restoredCount = 0
+            let read = llama_state_seq_load_file(context, stateURL.path, 0, &restoredTokens, restoredTokens.count, &restoredCount)
+            if read > 0 && restoredCount == tokens.count && restoredTokens == tokens {
+                return true
             }
+            // Stale or unreadable: rebuild it
+            llama_memory_clear(memory, true)
+            try? FileManager.default.removeItem(at: stateURL)
         }
 
-        // Flush remaining bytes
-        if !pendingBytes.isEmpty {
-            if let finalText = String(bytes: pendingBytes, encoding: .utf8), !finalText.isEmpty {
-                generatedText += finalText
-                let text = finalText
-                DispatchQueue.main.async {
-                    onToken(text)
+        try decodePrompt(context: context, tokens: tokens, from: 0)
+
+        // Written aside and moved, so a later launch never reads a partial file
+        try? FileManager.default.createDirectory(at: stateURL.deletingLastPathComponent(), withIntermediateDirectories: true)
+        let tempURL = stateURL.appendingPathExtension("tmp")
+        if llama_state_seq_save_file(context, tempURL.path, 0, tokens, tokens.count) > 0 {
+            try? FileManager.default.moveItem(at: tempURL, to: stateURL)
+        }
+        try? FileManager.default.removeItem(at: tempURL)
+        return false
+    }
+
+    // MARK: - Memory Pressure
+
+    /// KV cache shape of one context
+    struct CacheSettings: Sendable {
+        let contextSize: UInt32
+        let typeK: ggml_type
+        let typeV: ggml_type
+        let kvBytes: UInt64
+    }
+
+    private static let contextSteps: [UInt32] = [8192, 6144, 4096, 2048]
+
+    /// Every context size up to maxContext crossed with the requested and
+    /// lower-precision KV cache types, in the order to try them
+    private nonisolated static func cacheLadder(model: OpaquePointer, maxContext: UInt32,
+                                    typeK: ggml_type, typeV: ggml_type) -> [CacheSettings] {
+        let layers = UInt64(max(0, llama_model_n_layer(model)))
+        let heads = max(1, llama_model_n_head(model))
+        let embdKV = UInt64(max(0, llama_model_n_embd(model) * llama_model_n_head_kv(model) / heads))
+
+        let qualities: [ggml_type] = [GGML_TYPE_F16, GGML_TYPE_Q8_0, GGML_TYPE_Q4_0]
+        let preferred = max(qualities.firstIndex(of: typeK) ?? 0, qualities.firstIndex(of: typeV) ?? 0)
+        var types: [(ggml_type, ggml_type)] = [(typeK, typeV)]
+        for type in qualities.dropFirst(preferred + 1) {
+            types.append((type, type))
+        }
+
+        let contexts = [maxContext] + contextSteps.filter { $0 < maxContext }
+        var ladder: [CacheSettings] = []
+        for nCtx in contexts {
+            for (k, v) in types {
+                // Bytes per element times 1000, from the ggml block sizes
+                let milliBytes = bytesPerElementMilli(k) + bytesPerElementMilli(v)
+                let kvBytes = layers * UInt64(nCtx) * embdKV * milliBytes / 1000
+                ladder.append(CacheSettings(contextSize: nCtx, typeK: k, typeV: v, kvBytes: kvBytes))
+            }
+        }
+        return ladder
+    }
+
+    private nonisolated static func bytesPerElementMilli(_ type: ggml_type) -> UInt64 {
+        switch type {
+        case GGML_TYPE_Q8_0: return 1063   // 34 bytes per 32
+        case GGML_TYPE_Q4_0: return 563    // 18 bytes per 32
+        default: return 2000
+        }
+    }
+
+    /// Memory the KV cache may take: what the process may still allocate,
+    /// less headroom for compute buffers and the rest of the app
+    private nonisolated static func kvCacheBudget() -> UInt64 {
+        var available = UInt64(os_proc_available_memory())
+        if available == 0 {
+            // No per-process limit (Mac): assume half of physical memory
+            available = ProcessInfo.processInfo.physicalMemory / 2
+        }
+        let headroom = max(UInt64(512_000_000), available / 5)
+        return available > headroom ? available - headroom : 0
+    }
+
+    private nonisolated static func makeContext(model: OpaquePointer, settings: CacheSettings) -> OpaquePointer? {
+        // Context parameters - optimized for speed on iOS
+        var contextParams = llama_context_default_params()
+        contextParams.n_ctx = settings.contextSize
+        // Larger batch sizes for faster prompt processing
+        contextParams.n_batch = min(1024, settings.contextSize)  // Increased from 512
+        contextParams.n_ubatch = 512  // Increased micro-batch for better throughput
+        // Use all performance cores for maximum speed; generate scales
+        // this down when the device is hot
+        contextParams.n_threads = performanceThreads
+        contextParams.n_threads_batch = performanceThreads
+
+        // KV Cache quantization for faster inference (reduces memory bandwidth)
+        contextParams.type_k = settings.typeK
+        contextParams.type_v = settings.typeV
+
+        // Enable Flash Attention for Metal GPU acceleration
+        contextParams.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_ENABLED
+
+        // Offload KQV operations to GPU for maximum speed
+        contextParams.offload_kqv = true
+
+        return llama_init_from_model(model, contextParams)
+    }
+
+    /// Threads for a cool device; InferenceBudget.threads scales them
+    private nonisolated static var performanceThreads: Int32 {
+        Int32(max(4, ProcessInfo.processInfo.activeProcessorCount))
+    }
+
+    private func applyCacheSettings(_ settings: CacheSettings) {
+        cacheSettings = settings
+        contextSize = settings.contextSize
+        kvCacheTypeK = Self.quantType(settings.typeK)
+        kvCacheTypeV = Self.quantType(settings.typeV)
+    }
+
+    private static func quantType(_ type: ggml_type) -> KVCacheQuantType {
+        switch type {
+        case GGML_TYPE_Q8_0: return .q8_0
+        case GGML_TYPE_Q4_0: return .q4_0
+        default: return .f16
+        }
+    }
+
+    /// Re-creates the context one step down the ladder (a lower-precision
+    /// KV cache, then a shorter context) and restores the cached prompt.
+    /// Returns false when already at the smallest settings.
+    func reduceMemoryUsage() async -> Bool {
+        await reconfiguration?.value
+        guard isLoaded, let model = model, let oldContext = context else { return false }
+
+        let current = cacheLadder.firstIndex {
+            $0.contextSize == contextSize && $0.typeK == toGGMLType(kvCacheTypeK) && $0.typeV == toGGMLType(kvCacheTypeV)
+        } ?? -1
+        guard current + 1 < cacheLadder.count else { return false }
+        let settings = cacheLadder[current + 1]
+
+        // The sequence state stays valid while the cache types are unchanged
+        let prefix = cachedPrefix
+        let keepState = !prefix.isEmpty && prefix.count < Int(settings.contextSize) &&
+            settings.typeK == toGGMLType(kvCacheTypeK) && settings.typeV == toGGMLType(kvCacheTypeV)
+        cachedPrefix = []
+        context = nil
+
+        // Generation and warm starts wait for this before using the context
+        let recreate = Task { () -> (replaced: Bool, restored: Bool) in
+            let result = await withCheckedContinuation { continuation in
+                Self.inferenceQueue.async {
+                    continuation.resume(returning: Self.recreateContext(
+                        model: model, old: oldContext, settings: settings, keepState: keepState))
                 }
             }
+            guard let pointers = result.pointers else {
+                self.isLoaded = false
+                return (false, false)
+            }
+            self.context = pointers.context
+            self.applyCacheSettings(settings)
+            if result.restored {
+                self.cachedPrefix = prefix
+            }
+            return (true, result.restored)
+        }
+        reconfiguration = Task { _ = await recreate.value }
+        let outcome = await recreate.value
+        reconfiguration = nil
+        guard outcome.replaced else { return false }
+        print("[LlamaInference] Reduced KV cache to n_ctx \(settings.contextSize), \(kvCacheTypeK.rawValue)/\(kvCacheTypeV.rawValue)")
+
+        if !outcome.restored, let source = warmStartSource {
+            // The saved system prompt state for the new settings, or a prefill
+            _ = try? await warmStart(systemPrompt: source.systemPrompt, cacheDirectory: source.cacheDirectory)
         }
+        return true
+    }
+
+    /// Copies out sequence 0's state (when kept), frees the old context and
+    /// creates one with settings, restoring the state into it
+    private nonisolated static func recreateContext(model: OpaquePointer, old: OpaquePointer, settings: CacheSettings,
+                                        keepState: Bool) -> (pointers: SendablePointer?, restored: Bool) {
+        let state = keepState ? sequenceState(of: old) : []
+        llama_free(old)
+
+        guard let context = makeContext(model: model, settings: settings) else {
+            return (nil, false)
+        }
+        let restored = restoreSequenceState(state, into: context)
+        return (SendablePointer(model: model, context: context, cacheSettings: settings), restored)
+    }
 
-        return generatedText
+    /// Sequence 0's KV cache state, to carry into a new context
+    private nonisolated static func sequenceState(of context: OpaquePointer) -> [UInt8] {
+        var state = [UInt8](repeating: 0, count: llama_state_seq_get_size(context, 0))
+        let written = llama_state_seq_get_data(context, &state, state.count, 0)
+        state.removeSubrange(written...)
+        return state
+    }
+
+    /// Restores sequence 0 from state, or clears the cache when it cannot
+    private nonisolated static func restoreSequenceState(_ state: [UInt8], into context: OpaquePointer) -> Bool {
+        let restored = !state.isEmpty && llama_state_seq_set_data(context, state, state.count, 0) > 0
+        if !restored {
+            llama_memory_clear(llama_get_memory(context), true)
+        }
+        return restored
+    }
+
+    // MARK: - Thermal Budget
+
+    /// Reloads the model with the GPU layer count the current budget allows
+    /// when it differs from the loaded one, keeping the KV cache. Only runs
+    /// between turns; the next generation waits for it.
+    private func rebalanceGPULayers() {
+        guard isLoaded, !isGenerating, reconfiguration == nil,
+              let url = modelPath, let layerCount = layerCount, let settings = cacheSettings,
+              let oldModel = model, let oldContext = context else { return }
+        let gpuLayers = InferenceScheduler.shared.budget.gpuLayers(inferenceMode.gpuLayers, layerCount: layerCount)
+        guard gpuLayers != loadedGPULayers else { return }
+
+        let old = SendablePointer(model: oldModel, context: oldContext, cacheSettings: settings)
+        let prefix = cachedPrefix
+        cachedPrefix = []
+        context = nil
+        model = nil
+
+        reconfiguration = Task {
+            let result = await withCheckedContinuation { continuation in
+                Self.inferenceQueue.async {
+                    continuation.resume(returning: Self.reloadModel(
+                        url: url, gpuLayers: gpuLayers, old: old, keepState: !prefix.isEmpty))
+                }
+            }
+            self.reconfiguration = nil
+            guard let pointers = result.pointers else {
+                self.isLoaded = false
+                return
+            }
+            self.model = pointers.model
+            self.context = pointers.context
+            self.loadedGPULayers = gpuLayers
+            print("[LlamaInference] Moved to \(gpuLayers) GPU layers for the thermal budget")
+            if result.restored {
+                self.cachedPrefix = prefix
+            } else if let source = self.warmStartSource {
+                _ = try? await self.warmStart(systemPrompt: source.systemPrompt, cacheDirectory: source.cacheDirectory)
+            }
+        }
+    }
+
+    /// Frees the old model and context, loads the model with gpuLayers and
+    /// restores sequence 0 (when kept) into a context with the same settings
+    private nonisolated static func reloadModel(url: URL, gpuLayers: Int32, old: SendablePointer,
+                                                keepState: Bool) -> (pointers: SendablePointer?, restored: Bool) {
+        let state = keepState ? sequenceState(of: old.context) : []
+        llama_free(old.context)
+        llama_model_free(old.model)
+
+        var modelParams = llama_model_default_params()
+        modelParams.n_gpu_layers = gpuLayers
+        guard let model = llama_model_load_from_file(url.path, modelParams) else {
+            return (nil, false)
+        }
+        guard let context = makeContext(model: model, settings: old.cacheSettings) else {
+            llama_model_free(model)
+            return (nil, false)
+        }
+        let restored = restoreSequenceState(state, into: context)
+        return (SendablePointer(model: model, context: context, cacheSettings: old.cacheSettings), restored)
     }
 
     /// Static version of bytesToString for use in background queue (no self reference needed)
-    private static func bytesToStringStatic(_ bytes: [UInt8]) -> (String, [UInt8]) {
+    fileprivate nonisolated static func bytesToStringStatic(_ bytes: [UInt8]) -> (String, [UInt8]) {
         guard !bytes.isEmpty else { return ("", []) }
 
         var validEnd = bytes.count
@@ -614,6 +1022,16 @@ final class LlamaInference: ObservableObject {
         return ("", bytes)
     }
 
+    /// Tokens text takes in the loaded vocab, counted without a token buffer
+    func countTokens(_ text: String) -> Int? {
+        guard let model = model, let vocab = llama_model_get_vocab(model) else { return nil }
+        let byteCount = Int32(text.utf8.count)
+        guard byteCount > 0 else { return 0 }
+        // With no room for tokens llama_tokenize returns -(tokens needed)
+        let n = llama_tokenize(vocab, text, byteCount, nil, 0, false, true)
+        return n == Int32.min ? nil : Int(abs(n))
+    }
+
     private func tokenize(_ text: String, vocab: OpaquePointer, addSpecial: Bool) -> [llama_token] {
         let maxTokens = Int32(text.utf8.count) + 32
 
@@ -799,6 +1217,74 @@ final class LlamaInference: ObservableObject {
     }
 }
 
+/// Lets the ring pointer cross to the inference queue; the ring itself
+/// synchronizes its one producer and one consumer
+private struct RingPointer: @unchecked Sendable {
+    let ring: UnsafeMutablePointer<token_ring>
+}
+
+/// Empties a token ring on the main thread once per display refresh and
+/// hands the text, cut at UTF-8 character boundaries, to onToken
+@MainActor
+private final class TokenRingDrain: NSObject {
+    private let ring: UnsafeMutablePointer<token_ring>
+    private let onToken: @MainActor (String) -> Void
+    private var chunk = [UInt8](repeating: 0, count: 4096)
+    private var pending: [UInt8] = []
+    private var displayLink: CADisplayLink?
+
+    init(ring: UnsafeMutablePointer<token_ring>, onToken: @escaping @MainActor (String) -> Void) {
+        self.ring = ring
+        self.onToken = onToken
+        super.init()
+    }
+
+    func start() {
+        let link = CADisplayLink(target: self, selector: #selector(tick))
+        link.add(to: .main, forMode: .common)
+        displayLink = link
+    }
+
+    /// Delivers everything left, plus bytes that never fit in the ring
+    func finish(remaining: [UInt8]) {
+        drain()
+        pending.append(contentsOf: remaining)
+        if !pending.isEmpty {
+            let text = String(decoding: pending, as: UTF8.self)
+            pending.removeAll()
+            onToken(text)
+        }
+        stop()
+    }
+
+    @objc private func tick() {
+        drain()
+        if token_ring_finished(ring) {
+            stop()
+        }
+    }
+
+    private func drain() {
+        while true {
+            let count = chunk.withUnsafeMutableBytes { token_ring_read(ring, $0.baseAddress, $0.count) }
+            if count == 0 { break }
+            pending.append(contentsOf: chunk[0..<count])
+        }
+        guard !pending.isEmpty else { return }
+
+        let (text, remaining) = LlamaInference.bytesToStringStatic(pending)
+        pending = remaining
+        if !text.isEmpty {
+            onToken(text)
+        }
+    }
+
+    private func stop() {
+        displayLink?.invalidate()
+        displayLink = nil
+    }
+}
+
 enum LlamaError: Error, LocalizedError {
     case modelNotFound
     case modelNotLoaded
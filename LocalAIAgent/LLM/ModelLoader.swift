@@ -1,6 +1,7 @@
 import Foundation
 import CoreML
 import Compression
+import CryptoKit
 import UIKit
 
 // Device tier for model recommendations
@@ -1266,12 +1267,10 @@ final class ModelLoader: ObservableObject {
                 try fileManager.createDirectory(at: modelsDirectory, withIntermediateDirectories: true)
             }
 
-            // Copy ODR resource to Documents/Models for persistent access
+            // Stage the ODR resource in Documents/Models for persistent access
+            // (cloned or linked, so no second copy of the bytes)
             let destinationPath = modelsDirectory.appendingPathComponent("\(model.id).gguf")
-            if fileManager.fileExists(atPath: destinationPath.path) {
-                try fileManager.removeItem(at: destinationPath)
-            }
-            try fileManager.copyItem(at: resourceURL, to: destinationPath)
+            try OnDemandResourceManager.stageResource(at: resourceURL, to: destinationPath)
 
             // Release ODR resources (the copy is in Documents now)
             odrManager.endAccessingResources(for: model.id)
@@ -1366,13 +1365,20 @@ final class ModelLoader: ObservableObject {
             try fileManager.createDirectory(at: modelsDirectory, withIntermediateDirectories: true)
         }
 
-        // Use URLSessionDownloadTask with delegate for progress
-        // Pass actual size for accurate progress calculation
-        let (tempURL, _) = try await downloadWithProgress(from: url, modelId: model.id, expectedSize: actualSize)
-
         // Determine file extension from URL or response
         let fileExtension = url.pathExtension.lowercased()
 
+        // Ranged, resumable download when the server supports it; otherwise
+        // one URLSessionDownloadTask with delegate for progress
+        let tempURL: URL
+        if let totalBytes = await SegmentedDownloader.rangedSize(of: url) {
+            let partURL = modelsDirectory.appendingPathComponent("\(model.id).\(fileExtension).part")
+            tempURL = try await downloadSegmented(from: url, to: partURL, modelId: model.id, totalBytes: totalBytes)
+        } else {
+            // Pass actual size for accurate progress calculation
+            tempURL = try await downloadWithProgress(from: url, modelId: model.id, expectedSize: actualSize).0
+        }
+
         if fileExtension == "gguf" {
             // Direct GGUF file - just move it
             let destinationPath = modelsDirectory.appendingPathComponent("\(model.id).gguf")
@@ -1455,6 +1461,54 @@ final class ModelLoader: ObservableObject {
         }
     }
 
+    /// Run a SegmentedDownloader into partURL, reporting progress the same way
+    /// downloadWithProgress does. Background time is requested so a download
+    /// keeps going briefly after the app leaves the foreground; if it is cut
+    /// off anyway, the next attempt resumes from the finished chunks.
+    private func downloadSegmented(from url: URL, to partURL: URL, modelId: String, totalBytes: Int64) async throws -> URL {
+        var backgroundTask = UIBackgroundTaskIdentifier.invalid
+        backgroundTask = UIApplication.shared.beginBackgroundTask(withName: "ModelDownload") {
+            UIApplication.shared.endBackgroundTask(backgroundTask)
+            backgroundTask = .invalid
+        }
+        defer {
+            if backgroundTask != .invalid {
+                UIApplication.shared.endBackgroundTask(backgroundTask)
+            }
+        }
+
+        let downloader = SegmentedDownloader(url: url, partURL: partURL, totalBytes: totalBytes)
+        let startTime = Date()
+        var resumedBytes: Int64?
+        try await downloader.run { [weak self] downloaded in
+            let resumed = resumedBytes ?? downloaded
+            resumedBytes = resumed
+            let elapsed = Date().timeIntervalSince(startTime)
+            let speed = elapsed > 0 ? Double(downloaded - resumed) / elapsed : 0
+            let eta: TimeInterval? = speed > 0 ? TimeInterval(totalBytes - downloaded) / speed : nil
+            let progress = Double(downloaded) / Double(totalBytes)
+
+            Task { @MainActor in
+                guard let self = self else { return }
+                // Re-assign entire dictionary to trigger @Published notification
+                var newProgress = self.downloadProgress
+                newProgress[modelId] = progress
+                self.downloadProgress = newProgress
+
+                var newInfo = self.downloadProgressInfo
+                newInfo[modelId] = DownloadProgressInfo(
+                    progress: progress,
+                    bytesDownloaded: downloaded,
+                    totalBytes: totalBytes,
+                    speed: speed,
+                    estimatedTimeRemaining: eta
+                )
+                self.downloadProgressInfo = newInfo
+            }
+        }
+        return partURL
+    }
+
     private func unzipModel(from source: URL, to destination: URL) async throws {
         try await Task.detached(priority: .userInitiated) {
             try self.extractZIP(from: source, to: destination)
@@ -1472,115 +1526,514 @@ final class ModelLoader: ObservableObject {
 
 // MARK: - Simple ZIP Extraction for iOS
 
+/// Extracts from a memory-mapped archive. Each entry is inflated chunk by
+/// chunk straight into its file and checked against its CRC, so a multi-GB
+/// model never has to fit in RAM; entries are extracted in parallel.
 private final class ZIPArchive {
-    private let fileHandle: FileHandle
-    private let fileSize: UInt64
+    private struct Entry {
+        let name: String
+        let method: UInt16
+        let crc32: UInt32
+        let compressedSize: Int
+        let uncompressedSize: Int
+        let localHeaderOffset: Int
+    }
+
+    private static let chunkSize = 1 << 20
+    private let data: Data
 
     init?(url: URL) {
-        guard let handle = try? FileHandle(forReadingFrom: url) else {
+        guard let data = try? Data(contentsOf: url, options: .alwaysMapped) else {
             return nil
         }
-        self.fileHandle = handle
+        self.data = data
+    }
 
-        do {
-            let attrs = try FileManager.default.attributesOfItem(atPath: url.path)
-            self.fileSize = attrs[.size] as? UInt64 ?? 0
-        } catch {
-            return nil
+    func extractAll(to destination: URL) throws {
+        try data.withUnsafeBytes { (archive: UnsafeRawBufferPointer) in
+            let fileManager = FileManager.default
+            let root = destination.standardizedFileURL
+
+            var files: [(entry: Entry, path: URL)] = []
+            for entry in try Self.readCentralDirectory(archive) {
+                let path = try Self.destinationPath(for: entry.name, in: root)
+                if entry.name.hasSuffix("/") {
+                    try fileManager.createDirectory(at: path, withIntermediateDirectories: true)
+                } else {
+                    try fileManager.createDirectory(at: path.deletingLastPathComponent(), withIntermediateDirectories: true)
+                    files.append((entry, path))
+                }
+            }
+
+            let lock = NSLock()
+            var firstError: Error?
+            DispatchQueue.concurrentPerform(iterations: files.count) { index in
+                lock.lock()
+                let failed = firstError != nil
+                lock.unlock()
+                guard !failed else { return }
+
+                do {
+                    try Self.extract(files[index].entry, from: archive, to: files[index].path)
+                } catch {
+                    lock.lock()
+                    firstError = firstError ?? error
+                    lock.unlock()
+                }
+            }
+            if let error = firstError {
+                throw error
+            }
         }
     }
 
-    deinit {
-        try? fileHandle.close()
+    // MARK: Central Directory
+
+    private static func readCentralDirectory(_ archive: UnsafeRawBufferPointer) throws -> [Entry] {
+        // The end record is 22 bytes plus a comment of up to 64 KB
+        guard archive.count >= 22 else {
+            throw ModelLoaderError.extractionFailed
+        }
+        var endRecord: Int?
+        var position = archive.count - 22
+        while position >= max(0, archive.count - 22 - 0xFFFF) {
+            if read32(archive, position) == 0x06054b50 {
+                endRecord = position
+                break
+            }
+            position -= 1
+        }
+        guard let end = endRecord else {
+            throw ModelLoaderError.extractionFailed
+        }
+
+        var count = Int(read16(archive, end + 10))
+        var offset = Int(read32(archive, end + 16))
+        // ZIP64: a locator just before the end record points at the 64-bit one
+        if end >= 20, read32(archive, end - 20) == 0x07064b50 {
+            let record = Int(read64(archive, end - 20 + 8))
+            guard record >= 0, record + 56 <= archive.count, read32(archive, record) == 0x06064b50 else {
+                throw ModelLoaderError.extractionFailed
+            }
+            count = Int(read64(archive, record + 32))
+            offset = Int(read64(archive, record + 48))
+        }
+
+        var entries: [Entry] = []
+        for _ in 0..<count {
+            guard offset >= 0, offset + 46 <= archive.count, read32(archive, offset) == 0x02014b50 else {
+                throw ModelLoaderError.extractionFailed
+            }
+            let method = read16(archive, offset + 10)
+            let crc = read32(archive, offset + 16)
+            var compressedSize = UInt64(read32(archive, offset + 20))
+            var uncompressedSize = UInt64(read32(archive, offset + 24))
+            let nameLength = Int(read16(archive, offset + 28))
+            let extraLength = Int(read16(archive, offset + 30))
+            let commentLength = Int(read16(archive, offset + 32))
+            var localHeaderOffset = UInt64(read32(archive, offset + 42))
+
+            let nameStart = offset + 46
+            let extraStart = nameStart + nameLength
+            let extraEnd = extraStart + extraLength
+            let next = extraEnd + commentLength
+            guard next <= archive.count else {
+                throw ModelLoaderError.extractionFailed
+            }
+
+            // ZIP64 extra field: 64-bit values for the fields saturated above, in this order
+            var field = extraStart
+            while field + 4 <= extraEnd {
+                let id = read16(archive, field)
+                let fieldEnd = min(field + 4 + Int(read16(archive, field + 2)), extraEnd)
+                if id == 0x0001 {
+                    var cursor = field + 4
+                    if uncompressedSize == 0xFFFFFFFF, cursor + 8 <= fieldEnd {
+                        uncompressedSize = read64(archive, cursor)
+                        cursor += 8
+                    }
+                    if compressedSize == 0xFFFFFFFF, cursor + 8 <= fieldEnd {
+                        compressedSize = read64(archive, cursor)
+                        cursor += 8
+                    }
+                    if localHeaderOffset == 0xFFFFFFFF, cursor + 8 <= fieldEnd {
+                        localHeaderOffset = read64(archive, cursor)
+                    }
+                }
+                field = fieldEnd
+            }
+
+            offset = next
+            guard let name = String(bytes: UnsafeRawBufferPointer(rebasing: archive[nameStart..<extraStart]),
+                                    encoding: .utf8) else {
+                continue
+            }
+            entries.append(Entry(name: name, method: method, crc32: crc,
+                                 compressedSize: Int(compressedSize),
+                                 uncompressedSize: Int(uncompressedSize),
+                                 localHeaderOffset: Int(localHeaderOffset)))
+        }
+        return entries
     }
 
-    func extractAll(to destination: URL) throws {
-        let fileManager = FileManager.default
+    /// Where an entry extracts to; names that would land outside root are refused
+    private static func destinationPath(for name: String, in root: URL) throws -> URL {
+        let path = root.appendingPathComponent(name).standardizedFileURL
+        guard path.path == root.path || path.path.hasPrefix(root.path + "/") else {
+            throw ModelLoaderError.extractionFailed
+        }
+        return path
+    }
 
-        try fileHandle.seek(toOffset: 0)
-        let data = fileHandle.readDataToEndOfFile()
+    // MARK: Entries
 
-        var offset = 0
+    private static func extract(_ entry: Entry, from archive: UnsafeRawBufferPointer, to path: URL) throws {
+        guard entry.method == 0 || entry.method == 8 else {
+            print("[ModelLoader] Skipping \(entry.name): compression method \(entry.method)")
+            return
+        }
 
-        while offset < data.count - 4 {
-            let signature = data.subdata(in: offset..<offset+4).withUnsafeBytes { $0.load(as: UInt32.self) }
+        // The local name and extra field may differ in length from the central copies
+        let header = entry.localHeaderOffset
+        guard header >= 0, header + 30 <= archive.count, read32(archive, header) == 0x04034b50 else {
+            throw ModelLoaderError.extractionFailed
+        }
+        let start = header + 30 + Int(read16(archive, header + 26)) + Int(read16(archive, header + 28))
+        guard entry.compressedSize >= 0, start + entry.compressedSize <= archive.count else {
+            throw ModelLoaderError.extractionFailed
+        }
+        let source = UnsafeRawBufferPointer(rebasing: archive[start..<start + entry.compressedSize])
 
-            guard signature == 0x04034b50 else {
-                break
+        let fd = open(path.path, O_WRONLY | O_CREAT | O_TRUNC, 0o644)
+        guard fd >= 0 else {
+            throw ModelLoaderError.extractionFailed
+        }
+        defer { close(fd) }
+
+        var crc = CRC32()
+        var written = 0
+        let emit: (UnsafeRawBufferPointer) throws -> Void = { bytes in
+            guard let base = bytes.baseAddress else { return }
+            crc.update(bytes)
+            var done = 0
+            while done < bytes.count {
+                let n = write(fd, base + done, bytes.count - done)
+                guard n > 0 else {
+                    throw ModelLoaderError.extractionFailed
+                }
+                done += n
             }
+            written += bytes.count
+        }
 
-            let header = data.subdata(in: offset..<min(offset+30, data.count))
-            guard header.count >= 30 else { break }
+        if entry.method == 0 {
+            var offset = 0
+            while offset < source.count {
+                let end = min(offset + chunkSize, source.count)
+                try emit(UnsafeRawBufferPointer(rebasing: source[offset..<end]))
+                offset = end
+            }
+        } else {
+            try inflate(source, into: emit)
+        }
 
-            let compressionMethod = header.subdata(in: 8..<10).withUnsafeBytes { $0.load(as: UInt16.self) }
-            let compressedSize = header.subdata(in: 18..<22).withUnsafeBytes { $0.load(as: UInt32.self) }
-            let uncompressedSize = header.subdata(in: 22..<26).withUnsafeBytes { $0.load(as: UInt32.self) }
-            let fileNameLength = header.subdata(in: 26..<28).withUnsafeBytes { $0.load(as: UInt16.self) }
-            let extraFieldLength = header.subdata(in: 28..<30).withUnsafeBytes { $0.load(as: UInt16.self) }
+        guard written == entry.uncompressedSize, crc.value == entry.crc32 else {
+            print("[ModelLoader] CRC or size mismatch in \(entry.name)")
+            throw ModelLoaderError.extractionFailed
+        }
+    }
 
-            let fileNameStart = offset + 30
-            let fileNameEnd = fileNameStart + Int(fileNameLength)
-            guard fileNameEnd <= data.count else { break }
+    /// Raw deflate through compression_stream, one chunk of output at a time
+    private static func inflate(_ source: UnsafeRawBufferPointer,
+                                into emit: (UnsafeRawBufferPointer) throws -> Void) throws {
+        guard let input = source.baseAddress else { return }
 
-            let fileNameData = data.subdata(in: fileNameStart..<fileNameEnd)
-            guard let fileName = String(data: fileNameData, encoding: .utf8) else {
-                offset = fileNameEnd + Int(extraFieldLength) + Int(compressedSize)
+        let output = UnsafeMutablePointer<UInt8>.allocate(capacity: chunkSize)
+        defer { output.deallocate() }
+        let stream = UnsafeMutablePointer<compression_stream>.allocate(capacity: 1)
+        defer { stream.deallocate() }
+        guard compression_stream_init(stream, COMPRESSION_STREAM_DECODE, COMPRESSION_ZLIB) == COMPRESSION_STATUS_OK else {
+            throw ModelLoaderError.extractionFailed
+        }
+        defer { compression_stream_destroy(stream) }
+
+        stream.pointee.src_ptr = input.assumingMemoryBound(to: UInt8.self)
+        stream.pointee.src_size = source.count
+        while true {
+            stream.pointee.dst_ptr = output
+            stream.pointee.dst_size = chunkSize
+            let status = compression_stream_process(stream, Int32(COMPRESSION_STREAM_FINALIZE.rawValue))
+
+            let produced = chunkSize - stream.pointee.dst_size
+            if produced > 0 {
+                try emit(UnsafeRawBufferPointer(start: output, count: produced))
+            }
+            switch status {
+            case COMPRESSION_STATUS_OK:
                 continue
+            case COMPRESSION_STATUS_END:
+                return
+            default:
+                throw ModelLoaderError.extractionFailed
             }
+        }
+    }
+
+    // Little-endian reads at any alignment
+    private static func read16(_ bytes: UnsafeRawBufferPointer, _ offset: Int) -> UInt16 {
+        UInt16(littleEndian: bytes.loadUnaligned(fromByteOffset: offset, as: UInt16.self))
+    }
 
-            let fileDataStart = fileNameEnd + Int(extraFieldLength)
-            let fileDataEnd = fileDataStart + Int(compressedSize)
-            guard fileDataEnd <= data.count else { break }
+    private static func read32(_ bytes: UnsafeRawBufferPointer, _ offset: Int) -> UInt32 {
+        UInt32(littleEndian: bytes.loadUnaligned(fromByteOffset: offset, as: UInt32.self))
+    }
 
-            let compressedData = data.subdata(in: fileDataStart..<fileDataEnd)
-            let filePath = destination.appendingPathComponent(fileName)
+    private static func read64(_ bytes: UnsafeRawBufferPointer, _ offset: Int) -> UInt64 {
+        UInt64(littleEndian: bytes.loadUnaligned(fromByteOffset: offset, as: UInt64.self))
+    }
+}
+
+/// CRC-32 as ZIP stores it (zlib polynomial), sliced by 8 to keep up with inflate
+private struct CRC32 {
+    private static let table: [UInt32] = {
+        var table = [UInt32](repeating: 0, count: 8 * 256)
+        for i in 0..<256 {
+            var c = UInt32(i)
+            for _ in 0..<8 {
+                c = c & 1 != 0 ? 0xEDB88320 ^ (c >> 1) : c >> 1
+            }
+            table[i] = c
+        }
+        for slice in 1..<8 {
+            for i in 0..<256 {
+                let previous = table[(slice - 1) * 256 + i]
+                table[slice * 256 + i] = (previous >> 8) ^ table[Int(previous & 0xFF)]
+            }
+        }
+        return table
+    }()
+
+    private(set) var value: UInt32 = 0
+
+    mutating func update(_ bytes: UnsafeRawBufferPointer) {
+        guard var p = bytes.baseAddress else { return }
+        var remaining = bytes.count
+        var crc = ~value
+        Self.table.withUnsafeBufferPointer { t in
+            while remaining >= 8 {
+                let one = UInt32(littleEndian: p.loadUnaligned(as: UInt32.self)) ^ crc
+                let two = UInt32(littleEndian: (p + 4).loadUnaligned(as: UInt32.self))
+                let low = t[7 * 256 + Int(one & 0xFF)] ^ t[6 * 256 + Int((one >> 8) & 0xFF)] ^
+                    t[5 * 256 + Int((one >> 16) & 0xFF)] ^ t[4 * 256 + Int(one >> 24)]
+                let high = t[3 * 256 + Int(two & 0xFF)] ^ t[2 * 256 + Int((two >> 8) & 0xFF)] ^
+                    t[256 + Int((two >> 16) & 0xFF)] ^ t[Int(two >> 24)]
+                crc = low ^ high
+                p += 8
+                remaining -= 8
+            }
+            while remaining > 0 {
+                crc = t[Int((crc ^ UInt32(p.load(as: UInt8.self))) & 0xFF)] ^ (crc >> 8)
+                p += 1
+                remaining -= 1
+            }
+        }
+        value = ~crc
+    }
+}
+
+// MARK: - Segmented Download
+
+/// Fetches a file as concurrent HTTP Range requests into a preallocated
+/// (sparse) .part file. Each finished chunk's SHA-256 is recorded in a JSON
+/// sidecar, so an interrupted download resumes from the chunks it has, and
+/// chunks from an earlier run are re-hashed before they are trusted.
+private final class SegmentedDownloader {
+    private struct State: Codable {
+        let url: String
+        let totalBytes: Int64
+        let chunkSize: Int64
+        /// SHA-256 of each finished chunk, nil while it is missing
+        var chunkHashes: [String?]
+    }
+
+    private static let chunkSize: Int64 = 8 << 20
+    private static let maxConcurrentChunks = 4
+    private static let attemptsPerChunk = 3
+
+    private let url: URL
+    private let partURL: URL
+    private let stateURL: URL
+    private let totalBytes: Int64
+    private let session: URLSession
+
+    init(url: URL, partURL: URL, totalBytes: Int64) {
+        self.url = url
+        self.partURL = partURL
+        self.stateURL = partURL.appendingPathExtension("json")
+        self.totalBytes = totalBytes
+
+        let config = URLSessionConfiguration.default
+        config.httpMaximumConnectionsPerHost = Self.maxConcurrentChunks
+        config.timeoutIntervalForRequest = 60
+        self.session = URLSession(configuration: config)
+    }
+
+    deinit {
+        session.invalidateAndCancel()
+    }
 
-            if fileName.hasSuffix("/") {
-                try fileManager.createDirectory(at: filePath, withIntermediateDirectories: true)
+    /// Total size if the server answers byte ranges, nil otherwise
+    static func rangedSize(of url: URL) async -> Int64? {
+        var request = URLRequest(url: url)
+        request.setValue("bytes=0-0", forHTTPHeaderField: "Range")
+        request.timeoutInterval = 15
+
+        guard let (_, response) = try? await URLSession.shared.data(for: request),
+              let httpResponse = response as? HTTPURLResponse,
+              httpResponse.statusCode == 206,
+              let contentRange = httpResponse.value(forHTTPHeaderField: "Content-Range"),
+              let slash = contentRange.lastIndex(of: "/"),
+              let total = Int64(contentRange[contentRange.index(after: slash)...]),
+              total > 0 else {
+            return nil
+        }
+        print("[ModelLoader] Server supports ranges - size: \(total)")
+        return total
+    }
+
+    /// Download every missing chunk; progress gets the bytes on disk so far
+    func run(progress: @escaping (Int64) -> Void) async throws {
+        let chunkCount = Int((totalBytes + Self.chunkSize - 1) / Self.chunkSize)
+        var state = loadState(chunkCount: chunkCount)
+            ?? State(url: url.absoluteString, totalBytes: totalBytes, chunkSize: Self.chunkSize,
+                     chunkHashes: Array(repeating: nil, count: chunkCount))
+
+        let fd = open(partURL.path, O_RDWR | O_CREAT, 0o644)
+        guard fd >= 0 else {
+            throw ModelLoaderError.downloadFailed
+        }
+        defer { close(fd) }
+        // Only the ranges actually written take space on APFS
+        guard ftruncate(fd, off_t(totalBytes)) == 0 else {
+            throw ModelLoaderError.downloadFailed
+        }
+
+        // A write cut short by suspension or a crash fails this and is fetched again
+        for index in 0..<chunkCount where state.chunkHashes[index] != nil {
+            if hashChunk(index, fd: fd) != state.chunkHashes[index] {
+                state.chunkHashes[index] = nil
+            }
+        }
+
+        var downloaded: Int64 = 0
+        var pending: [Int] = []
+        for index in 0..<chunkCount {
+            if state.chunkHashes[index] != nil {
+                downloaded += Int64(chunkRange(index).count)
             } else {
-                let parentDir = filePath.deletingLastPathComponent()
-                if !fileManager.fileExists(atPath: parentDir.path) {
-                    try fileManager.createDirectory(at: parentDir, withIntermediateDirectories: true)
-                }
+                pending.append(index)
+            }
+        }
+        if downloaded > 0 {
+            print("[ModelLoader] Resuming download - \(chunkCount - pending.count)/\(chunkCount) chunks on disk")
+        }
+        progress(downloaded)
+
+        try await withThrowingTaskGroup(of: (Int, String).self) { group in
+            var next = 0
+            while next < min(Self.maxConcurrentChunks, pending.count) {
+                let index = pending[next]
+                group.addTask { try await self.fetchChunk(index, fd: fd) }
+                next += 1
+            }
 
-                let fileData: Data
-                if compressionMethod == 0 {
-                    fileData = compressedData
-                } else if compressionMethod == 8 {
-                    fileData = try decompressDeflate(compressedData, uncompressedSize: Int(uncompressedSize))
-                } else {
-                    offset = fileDataEnd
-                    continue
-                }
+            while let (index, hash) = try await group.next() {
+                state.chunkHashes[index] = hash
+                saveState(state)
+                downloaded += Int64(chunkRange(index).count)
+                progress(downloaded)
 
-                try fileData.write(to: filePath)
+                if next < pending.count {
+                    let index = pending[next]
+                    group.addTask { try await self.fetchChunk(index, fd: fd) }
+                    next += 1
+                }
             }
+        }
 
-            offset = fileDataEnd
+        guard fsync(fd) == 0 else {
+            throw ModelLoaderError.downloadFailed
         }
+        try? FileManager.default.removeItem(at: stateURL)
     }
 
-    private func decompressDeflate(_ data: Data, uncompressedSize: Int) throws -> Data {
-        var decompressedData = Data(count: uncompressedSize)
+    private func chunkRange(_ index: Int) -> Range<Int> {
+        let start = Int64(index) * Self.chunkSize
+        return Int(start)..<Int(min(start + Self.chunkSize, totalBytes))
+    }
 
-        let result = decompressedData.withUnsafeMutableBytes { destBuffer in
-            data.withUnsafeBytes { srcBuffer in
-                compression_decode_buffer(
-                    destBuffer.bindMemory(to: UInt8.self).baseAddress!,
-                    uncompressedSize,
-                    srcBuffer.bindMemory(to: UInt8.self).baseAddress!,
-                    data.count,
-                    nil,
-                    COMPRESSION_ZLIB
-                )
+    /// Fetch one chunk into place, retrying transient failures
+    private func fetchChunk(_ index: Int, fd: Int32) async throws -> (Int, String) {
+        let range = chunkRange(index)
+        var request = URLRequest(url: url)
+        request.setValue("bytes=\(range.lowerBound)-\(range.upperBound - 1)", forHTTPHeaderField: "Range")
+
+        var lastError: Error = ModelLoaderError.downloadFailed
+        for attempt in 1...Self.attemptsPerChunk {
+            try Task.checkCancellation()
+            do {
+                let (data, response) = try await session.data(for: request)
+                guard let httpResponse = response as? HTTPURLResponse,
+                      httpResponse.statusCode == 206,
+                      data.count == range.count else {
+                    throw ModelLoaderError.downloadFailed
+                }
+                let written = data.withUnsafeBytes { bytes in
+                    pwrite(fd, bytes.baseAddress, bytes.count, off_t(range.lowerBound))
+                }
+                guard written == data.count else {
+                    throw ModelLoaderError.downloadFailed
+                }
+                return (index, Self.hex(SHA256.hash(data: data)))
+            } catch {
+                lastError = error
+                print("[ModelLoader] Chunk \(index) attempt \(attempt) failed: \(error.localizedDescription)")
             }
         }
+        throw lastError
+    }
 
-        guard result > 0 else {
-            throw ModelLoaderError.extractionFailed
+    private func hashChunk(_ index: Int, fd: Int32) -> String? {
+        let range = chunkRange(index)
+        var data = Data(count: range.count)
+        let read = data.withUnsafeMutableBytes { bytes in
+            pread(fd, bytes.baseAddress, bytes.count, off_t(range.lowerBound))
         }
+        guard read == range.count else { return nil }
+        return Self.hex(SHA256.hash(data: data))
+    }
+
+    private static func hex(_ digest: SHA256.Digest) -> String {
+        digest.map { String(format: "%02x", $0) }.joined()
+    }
+
+    /// The previous run's state if it was for this URL and size
+    private func loadState(chunkCount: Int) -> State? {
+        guard FileManager.default.fileExists(atPath: partURL.path),
+              let data = try? Data(contentsOf: stateURL),
+              let state = try? JSONDecoder().decode(State.self, from: data),
+              state.url == url.absoluteString,
+              state.totalBytes == totalBytes,
+              state.chunkSize == Self.chunkSize,
+              state.chunkHashes.count == chunkCount else {
+            return nil
+        }
+        return state
+    }
 
-        return decompressedData.prefix(result)
+    private func saveState(_ state: State) {
+        guard let data = try? JSONEncoder().encode(state) else { return }
+        try? data.write(to: stateURL, options: .atomic)
     }
 }
 
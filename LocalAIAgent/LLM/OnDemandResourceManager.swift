@@ -1,5 +1,6 @@
 @preconcurrency import Foundation
 import Combine
+import UIKit
 
 /// Manages On-Demand Resources (ODR) for model files
 /// ODR allows downloading large resources from App Store CDN when needed
@@ -17,6 +18,16 @@ final class OnDemandResourceManager: ObservableObject {
     // MARK: - Private Properties
     private var activeRequests: [String: NSBundleResourceRequest] = [:]
     private var progressObservations: [String: NSKeyValueObservation] = [:]
+    private var prefetchRequests: [String: NSBundleResourceRequest] = [:]
+    private var prefetchObservers: Set<AnyCancellable> = []
+
+    // MARK: - Prefetch Configuration
+    private static let usageKey = "odr_model_usage"
+    private static let usageHistoryLimit = 10
+    /// Uses older than this count for about a third as much
+    private static let usageDecay: TimeInterval = 7 * 24 * 60 * 60
+    /// Score from which a model is fetched ahead of time
+    private static let prefetchThreshold = 1.0
 
     // MARK: - ODR Configuration
     struct ODRModelConfig {
@@ -182,17 +193,35 @@ final class OnDemandResourceManager: ObservableObject {
 
         let destinationURL = modelsDirectory.appendingPathComponent(sourceURL.lastPathComponent)
 
+        do {
+            try Self.stageResource(at: sourceURL, to: destinationURL)
+            return destinationURL
+        } catch {
+            throw ODRError.copyFailed(error)
+        }
+    }
+
+    /// Place an ODR asset at destination without copying its bytes: an APFS
+    /// clone where possible, then a hard link, and only then a real copy
+    nonisolated static func stageResource(at sourceURL: URL, to destinationURL: URL) throws {
+        let fileManager = FileManager.default
+
         // Remove existing file if present
         if fileManager.fileExists(atPath: destinationURL.path) {
             try fileManager.removeItem(at: destinationURL)
         }
 
+        if clonefile(sourceURL.path, destinationURL.path, 0) == 0 {
+            return
+        }
+        print("[ODR] clonefile failed (errno \(errno)), trying a hard link")
         do {
-            try fileManager.copyItem(at: sourceURL, to: destinationURL)
-            return destinationURL
+            try fileManager.linkItem(at: sourceURL, to: destinationURL)
+            return
         } catch {
-            throw ODRError.copyFailed(error)
+            print("[ODR] Hard link failed: \(error.localizedDescription), copying")
         }
+        try fileManager.copyItem(at: sourceURL, to: destinationURL)
     }
 
     /// Cancel an ongoing download
@@ -238,6 +267,112 @@ final class OnDemandResourceManager: ObservableObject {
     }
 }
 
+// MARK: - Predictive Prefetch
+extension OnDemandResourceManager {
+
+    /// Note that a model was loaded; drives preservation priority and prefetch
+    func recordModelUse(_ modelId: String) {
+        guard ODRModelConfig.config(for: modelId) != nil else { return }
+        var usage = UserDefaults.standard.dictionary(forKey: Self.usageKey) as? [String: [Double]] ?? [:]
+        var uses = usage[modelId] ?? []
+        uses.append(Date().timeIntervalSince1970)
+        usage[modelId] = Array(uses.suffix(Self.usageHistoryLimit))
+        UserDefaults.standard.set(usage, forKey: Self.usageKey)
+        updatePrefetch()
+    }
+
+    /// Re-evaluate prefetching whenever the network or power state changes
+    func startPrefetchScheduling() {
+        guard prefetchObservers.isEmpty else { return }
+        UIDevice.current.isBatteryMonitoringEnabled = true
+
+        let network = NetworkMonitor.shared
+        network.$isExpensive
+            .combineLatest(network.$isConnected, network.$connectionType)
+            .map { _ in () }
+            .merge(with: NotificationCenter.default.publisher(for: UIDevice.batteryStateDidChangeNotification).map { _ in () })
+            .merge(with: NotificationCenter.default.publisher(for: .NSProcessInfoPowerStateDidChange).map { _ in () })
+            .debounce(for: .seconds(2), scheduler: RunLoop.main)
+            .sink { [weak self] in
+                self?.updatePrefetch()
+            }
+            .store(in: &prefetchObservers)
+    }
+
+    /// Recency-weighted use count, plus one if the model suits this device
+    private func prefetchScore(for config: ODRModelConfig) -> Double {
+        let usage = UserDefaults.standard.dictionary(forKey: Self.usageKey) as? [String: [Double]] ?? [:]
+        let now = Date().timeIntervalSince1970
+        var score = (usage[config.modelId] ?? []).reduce(0.0) { total, usedAt in
+            total + exp(-(now - usedAt) / Self.usageDecay)
+        }
+        if ModelLoader.shared.getModelInfo(config.modelId)?.isRecommended(for: DeviceTier.current) == true {
+            score += 1
+        }
+        return score
+    }
+
+    /// Unmetered network and external power (not Low Power Mode)
+    private var canPrefetch: Bool {
+        let network = NetworkMonitor.shared
+        let battery = UIDevice.current.batteryState
+        return network.isConnected && !network.isExpensive &&
+            (network.connectionType == .wifi || network.connectionType == .ethernet) &&
+            (battery == .charging || battery == .full) &&
+            !ProcessInfo.processInfo.isLowPowerModeEnabled
+    }
+
+    private func updatePrefetch() {
+        let allowed = canPrefetch
+        for config in ODRModelConfig.allConfigs {
+            let installed = ModelLoader.shared.isModelDownloaded(config.modelId)
+            let score = installed ? 0 : prefetchScore(for: config)
+
+            // Installed models no longer need their ODR copy kept around
+            Bundle.main.setPreservationPriority(min(1.0, score / 3), forTags: [config.tag])
+
+            let wanted = allowed && !installed && score >= Self.prefetchThreshold
+            if wanted {
+                prefetch(config)
+            } else if let request = prefetchRequests.removeValue(forKey: config.tag) {
+                print("[ODR] Stopping prefetch of \(config.tag)")
+                request.progress.cancel()
+            }
+        }
+    }
+
+    /// Download a tag at low priority and release it, leaving it cached for
+    /// requestResource (subject to its preservation priority)
+    private func prefetch(_ config: ODRModelConfig) {
+        let tag = config.tag
+        guard prefetchRequests[tag] == nil, activeRequests[tag] == nil else { return }
+
+        nonisolated(unsafe) let request = NSBundleResourceRequest(tags: [tag])
+        request.loadingPriority = 0.1
+        prefetchRequests[tag] = request
+
+        Task {
+            if await request.conditionallyBeginAccessingResources() {
+                request.endAccessingResources()
+                prefetchRequests.removeValue(forKey: tag)
+                return
+            }
+
+            print("[ODR] Prefetching \(tag)")
+            do {
+                try await request.beginAccessingResources()
+                print("[ODR] Prefetched \(tag)")
+                request.endAccessingResources()
+            } catch {
+                print("[ODR] Prefetch of \(tag) stopped: \(error.localizedDescription)")
+            }
+            if prefetchRequests[tag] === request {
+                prefetchRequests.removeValue(forKey: tag)
+            }
+        }
+    }
+}
+
 // MARK: - ODR Availability Extension
 extension OnDemandResourceManager {
 
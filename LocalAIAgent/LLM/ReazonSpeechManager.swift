@@ -1,6 +1,12 @@
 #if !targetEnvironment(macCatalyst)
 import Foundation
 import AVFoundation
+import Accelerate
+
+/// Lets the audio tap hold the sample ring it writes into
+private struct SampleRingPointer: @unchecked Sendable {
+    let ring: UnsafeMutablePointer<token_ring>
+}
 
 @MainActor
 final class ReazonSpeechManager: ObservableObject {
@@ -20,6 +26,17 @@ final class ReazonSpeechManager: ObservableObject {
     private var audioSamples: [Float] = []
     private let sampleRate: Int = 16000
 
+    // The tap converts into one reused buffer and copies the samples into
+    // sampleRing; the main thread drains the ring into audioSamples, so the
+    // audio thread does not allocate per callback
+    private var sampleRing: UnsafeMutablePointer<token_ring>?
+    private var drainTimer: Timer?
+    private var drainScratch: UnsafeMutableBufferPointer<Float>?
+    private static let ringSeconds = 2
+    private static let drainInterval: TimeInterval = 1.0 / 30
+    /// Room reserved up front in audioSamples, enough for most utterances
+    private static let reservedSeconds = 30
+
     // ReazonSpeech model files on Hugging Face (hosted by yukihamada)
     private let modelName = "sherpa-onnx-reazonspeech-ja"
     private let hfBaseURL = "https://huggingface.co/yukihamada/sherpa-onnx-reazonspeech-ja/resolve/main"
@@ -224,11 +241,15 @@ final class ReazonSpeechManager: ObservableObject {
         try session.setActive(true)
 
         audioSamples = []
+        audioSamples.reserveCapacity(sampleRate * Self.reservedSeconds)
         audioEngine = AVAudioEngine()
 
-        guard let audioEngine = audioEngine else {
+        guard let audioEngine = audioEngine,
+              let ring = token_ring_create(sampleRate * Self.ringSeconds * MemoryLayout<Float>.size) else {
             throw ReazonSpeechError.audioEngineError
         }
+        sampleRing = ring
+        let ringPointer = SampleRingPointer(ring: ring)
 
         let inputNode = audioEngine.inputNode
         let inputFormat = inputNode.outputFormat(forBus: 0)
@@ -243,9 +264,13 @@ final class ReazonSpeechManager: ObservableObject {
 
         let converter = AVAudioConverter(from: inputFormat, to: outputFormat)!
 
-        inputNode.installTap(onBus: 0, bufferSize: 1024, format: inputFormat) { [weak self] buffer, _ in
-            guard let self = self else { return }
+        // One second of output covers any tap buffer size iOS hands us
+        let convertedBuffer = AVAudioPCMBuffer(
+            pcmFormat: outputFormat,
+            frameCapacity: AVAudioFrameCount(sampleRate)
+        )!
 
+        inputNode.installTap(onBus: 0, bufferSize: 1024, format: inputFormat) { buffer, _ in
             var newBufferAvailable = true
             let inputCallback: AVAudioConverterInputBlock = { _, outStatus in
                 if newBufferAvailable {
@@ -258,35 +283,63 @@ final class ReazonSpeechManager: ObservableObject {
                 }
             }
 
-            let convertedBuffer = AVAudioPCMBuffer(
-                pcmFormat: outputFormat,
-                frameCapacity: AVAudioFrameCount(Double(outputFormat.sampleRate) * Double(buffer.frameLength) / inputFormat.sampleRate)
-            )!
-
+            convertedBuffer.frameLength = 0
             var error: NSError?
             _ = converter.convert(to: convertedBuffer, error: &error, withInputFrom: inputCallback)
 
-            if let floatData = convertedBuffer.floatChannelData?[0] {
-                let samples = Array(UnsafeBufferPointer(start: floatData, count: Int(convertedBuffer.frameLength)))
-
-                // Calculate RMS audio level
-                let sumSquares = samples.reduce(0) { $0 + $1 * $1 }
-                let rms = sqrt(sumSquares / Float(samples.count))
-                // Normalize to 0-1 range (typical voice RMS is 0.01-0.3)
-                let normalizedLevel = min(1.0, rms * 5.0)
-
-                Task { @MainActor [weak self] in
-                    self?.audioSamples.append(contentsOf: samples)
-                    self?.audioLevel = normalizedLevel
+            if let floatData = convertedBuffer.floatChannelData?[0], convertedBuffer.frameLength > 0 {
+                let bytes = Int(convertedBuffer.frameLength) * MemoryLayout<Float>.size
+                if token_ring_write(ringPointer.ring, floatData, bytes) < bytes {
+                    print("[ReazonSpeech] Sample ring full, dropping audio")
                 }
             }
         }
 
-        try audioEngine.start()
+        drainScratch = UnsafeMutableBufferPointer<Float>.allocate(capacity: sampleRate * Self.ringSeconds)
+        drainTimer = Timer.scheduledTimer(withTimeInterval: Self.drainInterval, repeats: true) { [weak self] _ in
+            MainActor.assumeIsolated {
+                self?.drainSamples()
+            }
+        }
+
+        do {
+            try audioEngine.start()
+        } catch {
+            cancelRecording()
+            throw error
+        }
         isRecording = true
         transcribedText = ""
     }
 
+    /// Move what the tap has written into audioSamples and update the level
+    private func drainSamples() {
+        guard let ring = sampleRing, let scratch = drainScratch, let base = scratch.baseAddress else { return }
+        let read = token_ring_read(ring, base, scratch.count * MemoryLayout<Float>.size) / MemoryLayout<Float>.size
+        guard read > 0 else { return }
+
+        let chunk = UnsafeBufferPointer(rebasing: scratch[..<read])
+        audioSamples.append(contentsOf: chunk)
+
+        // RMS audio level, normalized to 0-1 (typical voice RMS is 0.01-0.3)
+        var rms: Float = 0
+        vDSP_rmsqv(base, 1, &rms, vDSP_Length(read))
+        audioLevel = min(1.0, rms * 5.0)
+    }
+
+    /// Stop the tap's consumer side once the engine no longer writes
+    private func releaseSampleRing(drain: Bool) {
+        drainTimer?.invalidate()
+        drainTimer = nil
+        if drain {
+            drainSamples()
+        }
+        token_ring_free(sampleRing)
+        sampleRing = nil
+        drainScratch?.deallocate()
+        drainScratch = nil
+    }
+
     func stopRecording() async throws -> String {
         guard isRecording else {
             throw ReazonSpeechError.notRecording
@@ -296,6 +349,7 @@ final class ReazonSpeechManager: ObservableObject {
         audioEngine?.inputNode.removeTap(onBus: 0)
         audioEngine = nil
         isRecording = false
+        releaseSampleRing(drain: true)
 
         return try await transcribe()
     }
@@ -305,6 +359,7 @@ final class ReazonSpeechManager: ObservableObject {
         audioEngine?.inputNode.removeTap(onBus: 0)
         audioEngine = nil
         isRecording = false
+        releaseSampleRing(drain: false)
         audioSamples = []
         audioLevel = 0
     }
@@ -327,7 +382,9 @@ final class ReazonSpeechManager: ObservableObject {
         }
 
         // Decode audio samples
-        let result = recognizer.decode(samples: audioSamples, sampleRate: sampleRate)
+        let result = audioSamples.withUnsafeBufferPointer { samples in
+            recognizer.decode(samples: samples, sampleRate: sampleRate)
+        }
         let text = result.text.trimmingCharacters(in: .whitespacesAndNewlines)
 
         transcribedText = text
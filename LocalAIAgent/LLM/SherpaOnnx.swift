@@ -275,7 +275,14 @@ class SherpaOnnxRecognizer {
   ///   - sampleRate: Sample rate of the input audio samples. Must match
   ///                 the one expected by the model.
   func acceptWaveform(samples: [Float], sampleRate: Int = 16_000) {
-    SherpaOnnxOnlineStreamAcceptWaveform(stream, Int32(sampleRate), samples, Int32(samples.count))
+    samples.withUnsafeBufferPointer { acceptWaveform(samples: $0, sampleRate: sampleRate) }
+  }
+
+  /// Decode wave samples without copying them, e.g. straight from a
+  /// ring buffer or an AVAudioPCMBuffer channel.
+  func acceptWaveform(samples: UnsafeBufferPointer<Float>, sampleRate: Int = 16_000) {
+    guard let base = samples.baseAddress, !samples.isEmpty else { return }
+    SherpaOnnxOnlineStreamAcceptWaveform(stream, Int32(sampleRate), base, Int32(samples.count))
   }
 
   func isReady() -> Bool {
@@ -689,13 +696,17 @@ class SherpaOnnxOfflineRecognizer {
   ///   - sampleRate: Sample rate of the input audio samples. Must match
   ///                 the one expected by the model.
   func decode(samples: [Float], sampleRate: Int = 16_000) -> SherpaOnnxOfflineRecongitionResult {
+    samples.withUnsafeBufferPointer { decode(samples: $0, sampleRate: sampleRate) }
+  }
+
+  func decode(samples: UnsafeBufferPointer<Float>, sampleRate: Int = 16_000) -> SherpaOnnxOfflineRecongitionResult {
     guard let stream = SherpaOnnxCreateOfflineStream(recognizer) else {
       fatalError("Failed to create offline stream")
     }
 
     defer { SherpaOnnxDestroyOfflineStream(stream) }
 
-    SherpaOnnxAcceptWaveformOffline(stream, Int32(sampleRate), samples, Int32(samples.count))
+    SherpaOnnxAcceptWaveformOffline(stream, Int32(sampleRate), samples.baseAddress, Int32(samples.count))
 
     SherpaOnnxDecodeOfflineStream(recognizer, stream)
 
@@ -780,20 +791,30 @@ class SherpaOnnxCircularBufferWrapper {
   }
 
   func push(samples: [Float]) {
-    guard !samples.isEmpty else { return }
-    SherpaOnnxCircularBufferPush(buffer, samples, Int32(samples.count))
+    samples.withUnsafeBufferPointer { push(samples: $0) }
+  }
+
+  func push(samples: UnsafeBufferPointer<Float>) {
+    guard let base = samples.baseAddress, !samples.isEmpty else { return }
+    SherpaOnnxCircularBufferPush(buffer, base, Int32(samples.count))
   }
 
   func get(startIndex: Int, n: Int) -> [Float] {
-    guard startIndex >= 0 else { return [] }
-    guard n > 0 else { return [] }
+    withSamples(startIndex: startIndex, n: n) { Array($0) } ?? []
+  }
+
+  /// Lend n samples from startIndex to body without copying them into an
+  /// array. The pointer is only valid inside body; nil if nothing is read.
+  func withSamples<R>(startIndex: Int, n: Int, _ body: (UnsafeBufferPointer<Float>) throws -> R) rethrows -> R? {
+    guard startIndex >= 0 else { return nil }
+    guard n > 0 else { return nil }
 
     guard let ptr = SherpaOnnxCircularBufferGet(buffer, Int32(startIndex), Int32(n)) else {
-      return []
+      return nil
     }
     defer { SherpaOnnxCircularBufferFree(ptr) }
 
-    return Array(UnsafeBufferPointer(start: ptr, count: n))
+    return try body(UnsafeBufferPointer(start: ptr, count: n))
   }
 
   func pop(n: Int) {
@@ -850,7 +871,12 @@ class SherpaOnnxVoiceActivityDetectorWrapper {
   }
 
   func acceptWaveform(samples: [Float]) {
-    SherpaOnnxVoiceActivityDetectorAcceptWaveform(vad, samples, Int32(samples.count))
+    samples.withUnsafeBufferPointer { acceptWaveform(samples: $0) }
+  }
+
+  func acceptWaveform(samples: UnsafeBufferPointer<Float>) {
+    guard let base = samples.baseAddress, !samples.isEmpty else { return }
+    SherpaOnnxVoiceActivityDetectorAcceptWaveform(vad, base, Int32(samples.count))
   }
 
   func isEmpty() -> Bool {
@@ -1330,7 +1356,12 @@ class SherpaOnnxKeywordSpotterWrapper {
   }
 
   func acceptWaveform(samples: [Float], sampleRate: Int = 16000) {
-    SherpaOnnxOnlineStreamAcceptWaveform(stream, Int32(sampleRate), samples, Int32(samples.count))
+    samples.withUnsafeBufferPointer { acceptWaveform(samples: $0, sampleRate: sampleRate) }
+  }
+
+  func acceptWaveform(samples: UnsafeBufferPointer<Float>, sampleRate: Int = 16000) {
+    guard let base = samples.baseAddress, !samples.isEmpty else { return }
+    SherpaOnnxOnlineStreamAcceptWaveform(stream, Int32(sampleRate), base, Int32(samples.count))
   }
 
   func isReady() -> Bool {
@@ -1585,7 +1616,12 @@ class SherpaOnnxOnlineStreamWrapper {
   }
 
   func acceptWaveform(samples: [Float], sampleRate: Int = 16000) {
-    SherpaOnnxOnlineStreamAcceptWaveform(impl, Int32(sampleRate), samples, Int32(samples.count))
+    samples.withUnsafeBufferPointer { acceptWaveform(samples: $0, sampleRate: sampleRate) }
+  }
+
+  func acceptWaveform(samples: UnsafeBufferPointer<Float>, sampleRate: Int = 16000) {
+    guard let base = samples.baseAddress, !samples.isEmpty else { return }
+    SherpaOnnxOnlineStreamAcceptWaveform(impl, Int32(sampleRate), base, Int32(samples.count))
   }
 
   func inputFinished() {
@@ -0,0 +1,108 @@
+//
+//  TokenRing.h
+//  LocalAIAgent
+//
+//  Single-producer/single-consumer byte ring between the decode thread and
+//  the UI. Neither side blocks or allocates after token_ring_create.
+//
+
+#ifndef TokenRing_h
+#define TokenRing_h
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct token_ring {
+    _Atomic size_t head;    // Bytes ever written; only the producer stores it
+    _Atomic size_t tail;    // Bytes ever read; only the consumer stores it
+    _Atomic bool closed;    // Set by the producer after its last write
+    size_t mask;            // Capacity - 1 (capacity is a power of two)
+    uint8_t* data;
+} token_ring;
+
+// Ring of at least capacity bytes, or NULL
+static inline token_ring* token_ring_create(size_t capacity) {
+    size_t size = 64;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    token_ring* ring = (token_ring*)calloc(1, sizeof(token_ring));
+    if (!ring) {
+        return NULL;
+    }
+    ring->data = (uint8_t*)malloc(size);
+    if (!ring->data) {
+        free(ring);
+        return NULL;
+    }
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, false);
+    return ring;
+}
+
+static inline void token_ring_free(token_ring* ring) {
+    if (ring) {
+        free(ring->data);
+        free(ring);
+    }
+}
+
+// Producer: copy up to length bytes in, returning how many fit
+static inline size_t token_ring_write(token_ring* ring, const void* bytes, size_t length) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t space = ring->mask + 1 - (head - tail);
+    size_t n = length < space ? length : space;
+
+    size_t start = head & ring->mask;
+    size_t first = ring->mask + 1 - start;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(ring->data + start, bytes, first);
+    memcpy(ring->data, (const uint8_t*)bytes + first, n - first);
+
+    atomic_store_explicit(&ring->head, head + n, memory_order_release);
+    return n;
+}
+
+// Producer: no more writes follow
+static inline void token_ring_close(token_ring* ring) {
+    atomic_store_explicit(&ring->closed, true, memory_order_release);
+}
+
+// Consumer: copy up to capacity bytes out, returning how many were read
+static inline size_t token_ring_read(token_ring* ring, void* out, size_t capacity) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t available = head - tail;
+    size_t n = capacity < available ? capacity : available;
+
+    size_t start = tail & ring->mask;
+    size_t first = ring->mask + 1 - start;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(out, ring->data + start, first);
+    memcpy((uint8_t*)out + first, ring->data, n - first);
+
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+    return n;
+}
+
+// Consumer: the producer closed the ring and everything has been read
+static inline bool token_ring_finished(token_ring* ring) {
+    if (!atomic_load_explicit(&ring->closed, memory_order_acquire)) {
+        return false;
+    }
+    return atomic_load_explicit(&ring->head, memory_order_acquire) ==
+           atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+#endif /* TokenRing_h */
@@ -208,3 +208,53 @@ enum TokenizerError: Error {
     case invalidFormat
     case fileNotFound
 }
+
+/// Exact token counts from the loaded model's vocabulary. Message counts are
+/// memoized by message id, so unchanged history is never tokenized again.
+@MainActor
+final class TokenCounter {
+    /// Template tokens around each message (role header, end-of-turn marker)
+    static let messageOverhead = 8
+
+    private struct Entry {
+        let contentBytes: Int
+        let thinkingBytes: Int
+        let tokens: Int
+    }
+
+    private let count: (String) -> Int?
+    private var entries: [UUID: Entry] = [:]
+
+    /// count returns the tokens text takes in the vocab, or nil when no model is loaded
+    init(count: @escaping (String) -> Int?) {
+        self.count = count
+    }
+
+    func tokens(in text: String) -> Int? {
+        return count(text)
+    }
+
+    /// Content plus thinking plus template overhead
+    func tokens(in message: Message) -> Int? {
+        let contentBytes = message.content.utf8.count
+        let thinkingBytes = message.thinkingContent?.utf8.count ?? 0
+        // The lengths catch a message whose text changed under the same id
+        if let entry = entries[message.id],
+           entry.contentBytes == contentBytes, entry.thinkingBytes == thinkingBytes {
+            return entry.tokens
+        }
+
+        guard let contentTokens = count(message.content) else { return nil }
+        var tokens = contentTokens + Self.messageOverhead
+        if let thinking = message.thinkingContent {
+            guard let thinkingTokens = count(thinking) else { return nil }
+            tokens += thinkingTokens
+        }
+        entries[message.id] = Entry(contentBytes: contentBytes, thinkingBytes: thinkingBytes, tokens: tokens)
+        return tokens
+    }
+
+    func removeAll() {
+        entries.removeAll()
+    }
+}
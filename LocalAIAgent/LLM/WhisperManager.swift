@@ -15,12 +15,39 @@ final class WhisperManager: ObservableObject {
     @Published var errorMessage: String?
 
     private var whisperKit: WhisperKit?
-    private var audioRecorder: AVAudioRecorder?
-    private var recordingURL: URL?
+    private var audioEngine: AVAudioEngine?
+    private var audioSamples: [Float] = []
+    private let sampleRate = 16000
+
+    // Speech segments finished while recording are transcribed one after
+    // another as they come in, so stopRecording only waits for the last one
+    private var segmentTask: Task<Void, Never>?
+    private var segmentTexts: [String] = []
+    private var recordingGeneration = 0
+#if !targetEnvironment(macCatalyst)
+    private var vad: SherpaOnnxVoiceActivityDetectorWrapper?
+    private let vadQueue = DispatchQueue(label: "com.localaiagent.whisper.vad", qos: .userInitiated)
+    private var vadDownloadTask: Task<Void, Never>?
+    private let vadModelURL = URL(string: "https://github.com/k2-fsa/sherpa-onnx/releases/download/asr-models/silero_vad.onnx")!
+#endif
 
     // Use small model for balance between speed and accuracy
     private let modelName = "openai_whisper-small"
 
+    // Japanese transcription settings - optimized for accuracy
+    private let decodeOptions = DecodingOptions(
+        task: .transcribe,
+        language: "ja",
+        temperature: 0.0,
+        temperatureFallbackCount: 3,
+        sampleLength: 224,
+        usePrefillPrompt: true,
+        usePrefillCache: true,
+        skipSpecialTokens: true,
+        withoutTimestamps: true,
+        suppressBlank: true
+    )
+
     private var modelsDirectory: URL {
         let documentsPath = FileManager.default.urls(for: .documentDirectory, in: .userDomainMask)[0]
         return documentsPath.appendingPathComponent("WhisperModels")
@@ -132,6 +159,92 @@ final class WhisperManager: ObservableObject {
         }
     }
 
+    // MARK: - Voice Activity Detection
+
+#if !targetEnvironment(macCatalyst)
+    private var vadModelPath: URL {
+        modelsDirectory.appendingPathComponent("silero_vad.onnx")
+    }
+
+    /// A fresh VAD for one recording, or nil while its model is not on disk yet
+    private func makeVAD() -> SherpaOnnxVoiceActivityDetectorWrapper? {
+        guard FileManager.default.fileExists(atPath: vadModelPath.path) else {
+            downloadVADModel()
+            return nil
+        }
+
+        // Whisper decodes 30 s windows, so longer speech is cut before that
+        let sileroConfig = sherpaOnnxSileroVadModelConfig(
+            model: vadModelPath.path,
+            threshold: 0.5,
+            minSilenceDuration: 0.5,
+            minSpeechDuration: 0.25,
+            windowSize: 512,
+            maxSpeechDuration: 20.0
+        )
+        var config = sherpaOnnxVadModelConfig(sileroVad: sileroConfig, sampleRate: Int32(sampleRate))
+        return SherpaOnnxVoiceActivityDetectorWrapper(config: &config, buffer_size_in_seconds: 60)
+    }
+
+    /// Fetch the Silero VAD model in the background; recordings started
+    /// before it arrives are transcribed in one piece
+    private func downloadVADModel() {
+        guard vadDownloadTask == nil else { return }
+        let source = vadModelURL
+        let destination = vadModelPath
+        vadDownloadTask = Task { [weak self] in
+            defer { self?.vadDownloadTask = nil }
+            do {
+                let (tempURL, response) = try await URLSession.shared.download(from: source)
+                guard let httpResponse = response as? HTTPURLResponse,
+                      (200...299).contains(httpResponse.statusCode) else {
+                    print("[Whisper] VAD model download failed")
+                    return
+                }
+                try FileManager.default.createDirectory(at: destination.deletingLastPathComponent(),
+                                                        withIntermediateDirectories: true)
+                if FileManager.default.fileExists(atPath: destination.path) {
+                    try FileManager.default.removeItem(at: destination)
+                }
+                try FileManager.default.moveItem(at: tempURL, to: destination)
+                print("[Whisper] VAD model downloaded")
+            } catch {
+                print("[Whisper] VAD model download error: \(error)")
+            }
+        }
+    }
+
+    /// Segments the VAD has closed, removed from it (call on vadQueue)
+    private nonisolated static func takeSegments(from vad: SherpaOnnxVoiceActivityDetectorWrapper) -> [[Float]] {
+        var segments: [[Float]] = []
+        while !vad.isEmpty() {
+            segments.append(vad.front().samples)
+            vad.pop()
+        }
+        return segments
+    }
+#endif
+
+    /// Queue one speech segment behind the ones already transcribing
+    private func enqueueSegment(_ samples: [Float], generation: Int) {
+        guard generation == recordingGeneration, !samples.isEmpty, let whisper = whisperKit else { return }
+        let previous = segmentTask
+        let options = decodeOptions
+        segmentTask = Task { [weak self] in
+            await previous?.value
+            guard let self = self, generation == self.recordingGeneration else { return }
+            do {
+                let results = try await whisper.transcribe(audioArray: samples, decodeOptions: options)
+                let text = Self.joinedText(results)
+                guard generation == self.recordingGeneration, !text.isEmpty else { return }
+                self.segmentTexts.append(text)
+                self.transcribedText = self.segmentTexts.joined(separator: " ")
+            } catch {
+                print("[Whisper] Segment transcription error: \(error)")
+            }
+        }
+    }
+
     // MARK: - Recording
 
     func startRecording() async throws {
@@ -154,32 +267,96 @@ final class WhisperManager: ObservableObject {
         try session.setCategory(.playAndRecord, mode: .default, options: [.defaultToSpeaker])
         try session.setActive(true)
 
-        // Create recording URL
-        let documentsPath = FileManager.default.urls(for: .documentDirectory, in: .userDomainMask)[0]
-        recordingURL = documentsPath.appendingPathComponent("whisper_recording.wav")
-
-        // Audio settings for Whisper (16kHz mono)
-        let settings: [String: Any] = [
-            AVFormatIDKey: Int(kAudioFormatLinearPCM),
-            AVSampleRateKey: 16000,
-            AVNumberOfChannelsKey: 1,
-            AVEncoderAudioQualityKey: AVAudioQuality.high.rawValue,
-            AVLinearPCMBitDepthKey: 16,
-            AVLinearPCMIsFloatKey: false
-        ]
-
-        audioRecorder = try AVAudioRecorder(url: recordingURL!, settings: settings)
-        audioRecorder?.record()
-        isRecording = true
+        recordingGeneration += 1
+        let generation = recordingGeneration
+        audioSamples = []
+        segmentTexts = []
+        segmentTask = nil
         transcribedText = ""
+
+        let engine = AVAudioEngine()
+        let inputNode = engine.inputNode
+        let inputFormat = inputNode.outputFormat(forBus: 0)
+
+        // Whisper takes 16kHz mono float32
+        let outputFormat = AVAudioFormat(
+            commonFormat: .pcmFormatFloat32,
+            sampleRate: Double(sampleRate),
+            channels: 1,
+            interleaved: false
+        )!
+        guard let converter = AVAudioConverter(from: inputFormat, to: outputFormat) else {
+            throw WhisperError.noRecording
+        }
+
+#if !targetEnvironment(macCatalyst)
+        vad = makeVAD()
+        let vad = self.vad
+        let vadQueue = self.vadQueue
+#endif
+
+        inputNode.installTap(onBus: 0, bufferSize: 1024, format: inputFormat) { [weak self] buffer, _ in
+            var newBufferAvailable = true
+            let inputCallback: AVAudioConverterInputBlock = { _, outStatus in
+                if newBufferAvailable {
+                    outStatus.pointee = .haveData
+                    newBufferAvailable = false
+                    return buffer
+                } else {
+                    outStatus.pointee = .noDataNow
+                    return nil
+                }
+            }
+
+            guard let convertedBuffer = AVAudioPCMBuffer(
+                pcmFormat: outputFormat,
+                frameCapacity: AVAudioFrameCount(Double(outputFormat.sampleRate) * Double(buffer.frameLength) / inputFormat.sampleRate) + 1
+            ) else { return }
+
+            var error: NSError?
+            _ = converter.convert(to: convertedBuffer, error: &error, withInputFrom: inputCallback)
+
+            guard let floatData = convertedBuffer.floatChannelData?[0], convertedBuffer.frameLength > 0 else { return }
+            let samples = Array(UnsafeBufferPointer(start: floatData, count: Int(convertedBuffer.frameLength)))
+
+#if !targetEnvironment(macCatalyst)
+            if let vad = vad {
+                vadQueue.async {
+                    vad.acceptWaveform(samples: samples)
+                    let segments = Self.takeSegments(from: vad)
+                    guard !segments.isEmpty else { return }
+                    DispatchQueue.main.async {
+                        for segment in segments {
+                            self?.enqueueSegment(segment, generation: generation)
+                        }
+                    }
+                }
+            }
+#endif
+
+            Task { @MainActor [weak self] in
+                self?.audioSamples.append(contentsOf: samples)
+            }
+        }
+
+        do {
+            try engine.start()
+        } catch {
+            inputNode.removeTap(onBus: 0)
+            throw error
+        }
+        audioEngine = engine
+        isRecording = true
     }
 
     func stopRecording() async throws -> String {
-        guard isRecording, let recorder = audioRecorder else {
+        guard isRecording, let engine = audioEngine else {
             throw WhisperError.notRecording
         }
 
-        recorder.stop()
+        engine.stop()
+        engine.inputNode.removeTap(onBus: 0)
+        audioEngine = nil
         isRecording = false
 
         // Transcribe the recording
@@ -187,53 +364,73 @@ final class WhisperManager: ObservableObject {
     }
 
     func cancelRecording() {
-        audioRecorder?.stop()
-        audioRecorder = nil
+        audioEngine?.stop()
+        audioEngine?.inputNode.removeTap(onBus: 0)
+        audioEngine = nil
         isRecording = false
 
-        // Delete recording file
-        if let url = recordingURL {
-            try? FileManager.default.removeItem(at: url)
-        }
-        recordingURL = nil
+        // Late segments and transcriptions see the new generation and are dropped
+        recordingGeneration += 1
+        segmentTask?.cancel()
+        segmentTask = nil
+        segmentTexts = []
+        audioSamples = []
+#if !targetEnvironment(macCatalyst)
+        vad = nil
+#endif
     }
 
     // MARK: - Transcription
 
     private func transcribe() async throws -> String {
-        guard let url = recordingURL else {
-            throw WhisperError.noRecording
-        }
-
         guard let whisper = whisperKit else {
             throw WhisperError.modelNotLoaded
         }
 
         isTranscribing = true
-        defer { isTranscribing = false }
+        defer {
+            isTranscribing = false
+            audioSamples = []
+        }
 
-        do {
-            // Japanese transcription settings - optimized for accuracy
-            let results = try await whisper.transcribe(audioPath: url.path, decodeOptions: DecodingOptions(
-                task: .transcribe,
-                language: "ja",
-                temperature: 0.0,
-                temperatureFallbackCount: 3,
-                sampleLength: 224,
-                usePrefillPrompt: true,
-                usePrefillCache: true,
-                skipSpecialTokens: true,
-                withoutTimestamps: true,
-                suppressBlank: true
-            ))
-
-            let text = results.map { $0.text }.joined(separator: " ").trimmingCharacters(in: CharacterSet.whitespacesAndNewlines)
-            transcribedText = text
+        let generation = recordingGeneration
+#if !targetEnvironment(macCatalyst)
+        if let vad = vad {
+            self.vad = nil
+            // Close the speech still open when recording stopped. Going
+            // through the main queue keeps it behind segments already posted
+            await withCheckedContinuation { (continuation: CheckedContinuation<Void, Never>) in
+                vadQueue.async {
+                    vad.flush()
+                    let tail = Self.takeSegments(from: vad)
+                    DispatchQueue.main.async {
+                        for segment in tail {
+                            self.enqueueSegment(segment, generation: generation)
+                        }
+                        continuation.resume()
+                    }
+                }
+            }
+            await segmentTask?.value
+            segmentTask = nil
+
+            if !segmentTexts.isEmpty {
+                let text = segmentTexts.joined(separator: " ")
+                transcribedText = text
+                return text
+            }
+            // Nothing detected as speech: fall back to the whole recording
+        }
+#endif
 
-            // Clean up recording file
-            try? FileManager.default.removeItem(at: url)
-            recordingURL = nil
+        guard !audioSamples.isEmpty else {
+            throw WhisperError.noRecording
+        }
 
+        do {
+            let results = try await whisper.transcribe(audioArray: audioSamples, decodeOptions: decodeOptions)
+            let text = Self.joinedText(results)
+            transcribedText = text
             return text
         } catch {
             errorMessage = String(localized: "whisper.transcribe.error") + ": \(error.localizedDescription)"
@@ -241,6 +438,10 @@ final class WhisperManager: ObservableObject {
         }
     }
 
+    private nonisolated static func joinedText(_ results: [TranscriptionResult]) -> String {
+        results.map { $0.text }.joined(separator: " ").trimmingCharacters(in: CharacterSet.whitespacesAndNewlines)
+    }
+
     // MARK: - Cleanup
 
     func cleanup() {
@@ -2,17 +2,21 @@
 //  LocalAIAgent-Bridging-Header.h
 //  LocalAIAgent
 //
-//  Bridging header for sherpa-onnx and BitNet C APIs
+//  Bridging header for sherpa-onnx, BitNet and CAgentLib C APIs
 //
 
 #ifndef LocalAIAgent_Bridging_Header_h
 #define LocalAIAgent_Bridging_Header_h
 
 #include <TargetConditionals.h>
+#import "LLM/TokenRing.h"
+#import "agent_lib.h"
+
 #if !TARGET_OS_MACCATALYST
 #import <sherpa-onnx/c-api/c-api.h>
 // BitNet integration (WIP)
 // #import "LLM/BitNetWrapper.h"
+// #import "LLM/BitNetKernelBench.h"
 #endif
 
 #endif /* LocalAIAgent_Bridging_Header_h */
@@ -873,14 +873,31 @@ struct ChatView: View {
         isGenerating = true
         var fullResponse = ""
 
+        // With Kokoro loaded, sentences are spoken while the rest is generated
+        let streamingSpeech = ttsManager.beginStreaming(messageId: UUID())
+
         // Generate response
         _ = await appState.sendMessageWithStreamingNoUserMessage(text, imageData: nil) { token in
             guard !Task.isCancelled else { return }
             fullResponse += token
+            if streamingSpeech {
+                ttsManager.appendStreaming(token)
+            }
         }
 
         isGenerating = false
 
+        if streamingSpeech {
+            guard isVoiceConversationMode else {
+                ttsManager.stop()
+                return
+            }
+            voiceConversationState = .aiSpeaking
+            // Goes back to listening through onSpeechFinished once the queue has played
+            ttsManager.finishStreaming()
+            return
+        }
+
         // Speak the response
         if isVoiceConversationMode && !fullResponse.isEmpty {
             voiceConversationState = .aiSpeaking
@@ -3317,6 +3334,35 @@ class SpeechManager: NSObject, ObservableObject {
         }
     }
 
+    /// Start speaking a reply while it is generated (Kokoro only). Returns
+    /// false when the caller should speak the complete text with speak()
+    func beginStreaming(messageId: UUID) -> Bool {
+        guard useKokoroTTS && isKokoroReady else { return false }
+        if isSpeaking {
+            stop()
+        }
+
+        let started = kokoroTTS.beginStreaming(messageId: messageId) { [weak self] in
+            guard let self = self, self.currentMessageId == messageId else { return }
+            self.isSpeaking = false
+            self.currentMessageId = nil
+            self.onSpeechFinished?()
+        }
+        guard started else { return false }
+
+        isSpeaking = true
+        currentMessageId = messageId
+        return true
+    }
+
+    func appendStreaming(_ text: String) {
+        kokoroTTS.appendStreamingText(text)
+    }
+
+    func finishStreaming() {
+        kokoroTTS.finishStreaming()
+    }
+
     func stop() {
         // Stop Kokoro TTS
         kokoroTTS.stop()
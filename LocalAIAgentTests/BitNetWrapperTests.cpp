@@ -0,0 +1,292 @@
+/**
+ * @file BitNetWrapperTests.cpp
+ * @brief Tests for BitNetWrapper.cpp's bookkeeping, on a stub llama
+ *
+ * The wrapper is compiled in directly against a stand-in for the llama API:
+ * a "model" predicts the next token from a hash of everything in the
+ * sequence's cache, and llama_decode fails the test when a token's position
+ * is not the next one in its sequence. The real llama.h only supplies the
+ * declarations, so this runs without the framework's binaries:
+ *
+ *   g++ -std=c++17 -Wall -IFrameworks/BitNet.xcframework/ios-arm64/Headers \
+ *       -ICAgentLib/include -ILocalAIAgent/LLM \
+ *       LocalAIAgentTests/BitNetWrapperTests.cpp -o bitnet_wrapper_tests
+ */
+
+#include "../LocalAIAgent/LLM/BitNetWrapper.cpp"
+
+#undef NDEBUG
+#include <cassert>
+#include <map>
+
+#define TEST(name) static void test_##name(void)
+#define RUN_TEST(name) do { printf("  " #name "..."); test_##name(); printf(" OK\n"); } while(0)
+
+// Stub llama
+
+static const int32_t STUB_VOCAB = 64;
+static const llama_token STUB_EOS = STUB_VOCAB - 1;
+
+struct llama_model {
+    // Non-zero: a draft that guesses differently from the target now and then
+    uint64_t salt;
+};
+
+struct llama_context {
+    llama_model* model;
+    uint32_t n_batch;
+    std::map<llama_seq_id, std::vector<llama_token>> cache;  // Tokens by position
+    std::vector<llama_token> predictions;                     // Per output of the last decode
+};
+
+static llama_token stub_predict(const llama_model* model, const std::vector<llama_token>& cache) {
+    uint64_t h = fnv1a(FNV_OFFSET, cache.data(), cache.size() * sizeof(llama_token));
+    if (model->salt && h % 3 == 0) {
+        h ^= model->salt;
+    }
+    return (llama_token)(h % (STUB_VOCAB - 2)) + 1;  // Never EOS
+}
+
+struct llama_model_params llama_model_default_params(void) { return {}; }
+struct llama_context_params llama_context_default_params(void) { return {}; }
+struct llama_sampler_chain_params llama_sampler_chain_default_params(void) { return {}; }
+void llama_backend_init(void) {}
+void llama_backend_free(void) {}
+
+struct llama_model* llama_load_model_from_file(const char*, struct llama_model_params) {
+    return new llama_model{0};
+}
+void llama_free_model(struct llama_model* model) { delete model; }
+
+struct llama_context* llama_new_context_with_model(struct llama_model* model,
+                                                   struct llama_context_params params) {
+    return new llama_context{model, params.n_batch, {}, {}};
+}
+void llama_free(struct llama_context* ctx) { delete ctx; }
+uint32_t llama_n_ctx(const struct llama_context*) { return 4096; }
+uint32_t llama_n_batch(const struct llama_context* ctx) { return ctx->n_batch; }
+void llama_set_n_threads(struct llama_context*, int32_t, int32_t) {}
+
+int32_t llama_n_vocab(const struct llama_model*) { return STUB_VOCAB; }
+int32_t llama_n_ctx_train(const struct llama_model*) { return 4096; }
+llama_token llama_token_bos(const struct llama_model*) { return 0; }
+llama_token llama_token_eos(const struct llama_model*) { return STUB_EOS; }
+llama_token llama_token_nl(const struct llama_model*) { return 1; }
+uint64_t llama_model_size(const struct llama_model*) { return 0; }
+uint64_t llama_model_n_params(const struct llama_model*) { return 0; }
+int32_t llama_model_desc(const struct llama_model*, char* buf, size_t buf_size) {
+    return snprintf(buf, buf_size, "stub");
+}
+
+int32_t llama_tokenize(const struct llama_model*, const char*, int32_t text_len, llama_token* tokens,
+                       int32_t n_tokens_max, bool, bool) {
+    if (text_len > n_tokens_max) {
+        return -text_len;
+    }
+    for (int32_t i = 0; i < text_len; i++) {
+        tokens[i] = i + 1;
+    }
+    return text_len;
+}
+
+int32_t llama_token_to_piece(const struct llama_model*, llama_token token, char* buf, int32_t length,
+                             int32_t, bool) {
+    char piece[16];
+    int32_t n = snprintf(piece, sizeof(piece), "<%d>", token);
+    if (n > length) {
+        return -n;
+    }
+    memcpy(buf, piece, (size_t)n);
+    return n;
+}
+
+struct llama_batch llama_batch_init(int32_t n_tokens, int32_t, int32_t n_seq_max) {
+    llama_batch batch = {};
+    batch.token = new llama_token[n_tokens];
+    batch.pos = new llama_pos[n_tokens];
+    batch.n_seq_id = new int32_t[n_tokens];
+    batch.seq_id = new llama_seq_id*[n_tokens];
+    for (int32_t i = 0; i < n_tokens; i++) {
+        batch.seq_id[i] = new llama_seq_id[n_seq_max];
+    }
+    batch.logits = new int8_t[n_tokens];
+    batch.all_pos_0 = n_tokens;  // Remembered for llama_batch_free
+    return batch;
+}
+
+void llama_batch_free(struct llama_batch batch) {
+    for (int32_t i = 0; i < batch.all_pos_0; i++) {
+        delete[] batch.seq_id[i];
+    }
+    delete[] batch.token;
+    delete[] batch.pos;
+    delete[] batch.n_seq_id;
+    delete[] batch.seq_id;
+    delete[] batch.logits;
+}
+
+int32_t llama_decode(struct llama_context* ctx, struct llama_batch batch) {
+    ctx->predictions.assign((size_t)batch.n_tokens, -1);
+    for (int32_t i = 0; i < batch.n_tokens; i++) {
+        std::vector<llama_token>& cache = ctx->cache[batch.seq_id[i][0]];
+        // No holes and no overlaps: every token lands right after the last
+        assert(batch.pos[i] == (llama_pos)cache.size());
+        cache.push_back(batch.token[i]);
+        if (batch.logits[i]) {
+            ctx->predictions[(size_t)i] = stub_predict(ctx->model, cache);
+        }
+    }
+    return 0;
+}
+
+bool llama_kv_cache_seq_rm(struct llama_context* ctx, llama_seq_id seq_id, llama_pos p0, llama_pos p1) {
+    assert(p1 < 0);
+    std::vector<llama_token>& cache = ctx->cache[seq_id];
+    if ((size_t)p0 < cache.size()) {
+        cache.resize((size_t)p0);
+    }
+    return true;
+}
+
+size_t llama_state_seq_get_size(struct llama_context*, llama_seq_id) { return 0; }
+size_t llama_state_seq_get_data(struct llama_context*, uint8_t*, size_t, llama_seq_id) { return 0; }
+size_t llama_state_seq_set_data(struct llama_context*, const uint8_t*, size_t, llama_seq_id) { return 0; }
+
+// Every sampler is greedy over the stub's single prediction per output
+static struct llama_sampler* stub_sampler(void) { return new llama_sampler{nullptr, nullptr}; }
+struct llama_sampler* llama_sampler_chain_init(struct llama_sampler_chain_params) { return stub_sampler(); }
+struct llama_sampler* llama_sampler_init_greedy(void) { return stub_sampler(); }
+struct llama_sampler* llama_sampler_init_dist(uint32_t) { return stub_sampler(); }
+struct llama_sampler* llama_sampler_init_temp(float) { return stub_sampler(); }
+struct llama_sampler* llama_sampler_init_top_k(int32_t) { return stub_sampler(); }
+struct llama_sampler* llama_sampler_init_top_p(float, size_t) { return stub_sampler(); }
+struct llama_sampler* llama_sampler_init_penalties(int32_t, llama_token, llama_token, int32_t, float,
+                                                   float, float, bool, bool) {
+    return stub_sampler();
+}
+void llama_sampler_chain_add(struct llama_sampler*, struct llama_sampler* smpl) { delete smpl; }
+void llama_sampler_free(struct llama_sampler* smpl) { delete smpl; }
+void llama_sampler_reset(struct llama_sampler*) {}
+void llama_sampler_accept(struct llama_sampler*, llama_token) {}
+
+llama_token llama_sampler_sample(struct llama_sampler*, struct llama_context* ctx, int32_t idx) {
+    size_t i = idx < 0 ? ctx->predictions.size() - 1 : (size_t)idx;
+    assert(i < ctx->predictions.size() && ctx->predictions[i] >= 0);
+    return ctx->predictions[i];
+}
+
+// Helpers
+
+static bool collect_text(const char* text, size_t length, void* user_data) {
+    ((std::string*)user_data)->append(text, length);
+    return true;
+}
+
+static bitnet_context* new_context(bitnet_model* model) {
+    bitnet_context_params params = bitnet_context_default_params();
+    params.n_batch = 16;
+    return bitnet_new_context(model, params);
+}
+
+// The wrapper's record of sequence 0 matches the stub's cache
+static void assert_in_step(const bitnet_context* ctx) {
+    auto it = ctx->ctx->cache.find(0);
+    const std::vector<llama_token> empty;
+    assert(ctx->tokens == (it == ctx->ctx->cache.end() ? empty : it->second));
+}
+
+// Tests
+
+TEST(speculative_matches_generate) {
+    bitnet_model* target_model = bitnet_load_model("target", bitnet_model_default_params());
+    bitnet_model* draft_model = bitnet_load_model("draft", bitnet_model_default_params());
+    draft_model->model->salt = 0x9e3779b97f4a7c15ull;
+    bitnet_sampling_params params = bitnet_sampling_default_params();
+
+    const bitnet_token prompt[] = {5, 9, 2, 17, 30, 4, 11};
+    for (int32_t n_prompt = 1; n_prompt <= 7; n_prompt += 3) {
+        for (int32_t n_draft = 1; n_draft <= 6; n_draft++) {
+            bitnet_context* plain = new_context(target_model);
+            std::string expected;
+            int32_t expected_count = bitnet_generate(plain, prompt, n_prompt, params, 40,
+                                                     nullptr, 0, collect_text, &expected);
+            assert(expected_count == 40);
+            bitnet_free_context(plain);
+
+            bitnet_context* target = new_context(target_model);
+            bitnet_context* draft = new_context(draft_model);
+            bitnet_speculative_context* spec = bitnet_speculative_new(target, draft, n_draft);
+            std::string text;
+            int32_t count = bitnet_speculative_generate(spec, prompt, n_prompt, params, 40,
+                                                        nullptr, 0, collect_text, &text);
+            assert(count == expected_count);
+            assert(text == expected);
+
+            // Both caches start with the prompt and stay in step with the
+            // wrapper; the draft agrees with the target up to its last
+            // accepted token
+            assert_in_step(target);
+            assert_in_step(draft);
+            assert(std::equal(prompt, prompt + n_prompt, draft->tokens.begin()));
+            assert(draft->tokens.size() > (size_t)n_prompt);
+
+            bitnet_speculative_free(spec);
+            bitnet_free_context(draft);
+            bitnet_free_context(target);
+        }
+    }
+
+    bitnet_free_model(draft_model);
+    bitnet_free_model(target_model);
+}
+
+TEST(speculative_draft_reuses_prompt) {
+    bitnet_model* model = bitnet_load_model("model", bitnet_model_default_params());
+    bitnet_context* target = new_context(model);
+    bitnet_context* draft = new_context(model);
+    bitnet_speculative_context* spec = bitnet_speculative_new(target, draft, 4);
+    bitnet_sampling_params params = bitnet_sampling_default_params();
+
+    // A second turn extends the first: both caches keep their prefix
+    const bitnet_token prompt[] = {3, 8, 21, 6, 14, 2, 9, 40};
+    std::string text;
+    assert(bitnet_speculative_generate(spec, prompt, 5, params, 12, nullptr, 0, collect_text, &text) == 12);
+    assert(bitnet_speculative_generate(spec, prompt, 8, params, 12, nullptr, 0, collect_text, &text) == 12);
+    assert_in_step(target);
+    assert_in_step(draft);
+
+    // With the same model every draft is accepted
+    size_t n = std::min(target->tokens.size(), draft->tokens.size());
+    assert(std::equal(target->tokens.begin(), target->tokens.begin() + (long)n, draft->tokens.begin()));
+
+    bitnet_speculative_free(spec);
+    bitnet_free_context(draft);
+    bitnet_free_context(target);
+    bitnet_free_model(model);
+}
+
+TEST(tokenize_segment_size_query) {
+    bitnet_model* model = bitnet_load_model("model", bitnet_model_default_params());
+
+    // Asking for the size first writes nothing, cached or not
+    bitnet_token tokens[4];
+    assert(bitnet_tokenize_segment(model, "abc", 3, nullptr, 0, false) == -3);
+    assert(bitnet_tokenize_segment(model, "abc", 3, nullptr, 0, false) == -3);
+    assert(bitnet_tokenize_segment(model, "abc", 3, tokens, 2, false) == -3);
+    assert(bitnet_tokenize_segment(model, "abc", 3, tokens, 4, false) == 3);
+    assert(tokens[0] == 1 && tokens[2] == 3);
+    assert(bitnet_tokenize_segment(model, "abc", 3, nullptr, 4, false) == INT32_MIN);
+
+    bitnet_free_model(model);
+}
+
+int main(void) {
+    printf("Running BitNet wrapper tests...\n");
+
+    RUN_TEST(speculative_matches_generate);
+    RUN_TEST(speculative_draft_reuses_prompt);
+    RUN_TEST(tokenize_segment_size_query);
+
+    printf("\nAll BitNet wrapper tests passed!\n");
+    return 0;
+}